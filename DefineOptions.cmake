@@ -15,6 +15,7 @@ option(USE_ISOBMFF "Enable ISOBMFF support." ON)
 option(USE_LIBRAW "Enable LibRaw support." ON)
 option(USE_BUNDLED_LIBRAW "Use bundled LibRaw source instead of system library." ON)
 option(BUILD_CMSTEST "Build a test program to check your system's color management setup." ON)
+option(BUILD_MICROBENCH "Build ansel-microbench, the per-kernel and per-module performance harness, and the drawlayer sidecar benchmark." OFF)
 option(USE_OPENEXR "Enable OpenEXR support." ON)
 option(USE_CMARK "Enable CommonMark Markdown parser for text notes." ON)
 option(BUILD_PRINT "Enable the print module." ON)
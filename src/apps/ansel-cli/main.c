@@ -58,8 +58,11 @@
 #include "caches/image_cache.h"
 #include "imageio/imageio_module.h"
 #include "common/l10n.h"
+#include "common/times.h"
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
+#include <json-glib/json-glib.h>
 #include <libintl.h>
 
 #ifdef __APPLE__
@@ -103,6 +106,16 @@ static void usage(const char *progname)
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
   fprintf(stderr, "   --icc-intent <intent> specify icc intent, default to LAST\n");
   fprintf(stderr, "                     use --help icc-intent for list of supported intents\n");
+  fprintf(stderr, "   --counters <file>  append per-module pipeline counters (wall and CPU time,\n");
+  fprintf(stderr, "                     bytes read/written, tiles, cache hits) to <file> as NDJSON\n");
+  fprintf(stderr, "   --batch <file|->  run the jobs listed in <file>, or read from stdin as they\n");
+  fprintf(stderr, "                     come, in this one process. one JSON object per line:\n");
+  fprintf(stderr, "                     {\"input\": ..., \"output\": ..., \"xmp\": ..., \"out_ext\": ...,\n");
+  fprintf(stderr, "                      \"width\": ..., \"height\": ..., \"style\": ..., \"export_masks\": ...,\n");
+  fprintf(stderr, "                      \"icc_type\": ..., \"icc_file\": ..., \"icc_intent\": ...}\n");
+  fprintf(stderr, "                     only input and output are required, the others default to\n");
+  fprintf(stderr, "                     the command line options. one JSON status line per job is\n");
+  fprintf(stderr, "                     printed on stdout. takes no positional argument\n");
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h [option]\n");
   fprintf(stderr, "   --version\n");
@@ -195,6 +208,440 @@ static dt_iop_color_intent_t get_icc_intent(const char* option)
 }
 #undef ICC_INTENT_FROM_STR
 
+// Export settings shared by every image of a run, or of a batch job.
+typedef struct _cli_export_t
+{
+  int width, height;
+  const char *output_ext; // NULL to take it from the output filename
+  const char *style;
+  gboolean export_masks;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} _cli_export_t;
+
+// Import a file or a folder, and return the ids of the images it holds.
+static GList *_import_input(const char *input)
+{
+  if(g_file_test(input, G_FILE_TEST_IS_DIR))
+  {
+    const int filmid = dt_film_import(input);
+    if(!filmid)
+    {
+      // one of inputs was a failure, no prob
+      fprintf(stderr, _("error: can't open folder %s"), input);
+      fprintf(stderr, "\n");
+      return NULL;
+    }
+    return dt_film_get_image_ids(filmid);
+  }
+
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(input);
+  const int filmid = dt_film_new(&film, directory);
+  const int32_t id = dt_image_import(filmid, input, TRUE);
+  dt_free(directory);
+  if(!id)
+  {
+    fprintf(stderr, _("error: can't open file %s"), input);
+    fprintf(stderr, "\n");
+    return NULL;
+  }
+  return g_list_append(NULL, GINT_TO_POINTER(id));
+}
+
+// Replace the history of the images by the one in `xmp_filename`. Returns 1 on error.
+static int _apply_xmp(GList *id_list, const char *xmp_filename)
+{
+  for(GList *iter = id_list; iter; iter = g_list_next(iter))
+  {
+    const int id = GPOINTER_TO_INT(iter->data);
+    dt_image_t *image = dt_image_cache_get(id, 'w');
+    const int err = dt_exif_xmp_read(image, xmp_filename, 1);
+    // don't write new xmp:
+    dt_image_cache_write_release(image, DT_IMAGE_CACHE_RELAXED);
+    if(err)
+    {
+      fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
+      fprintf(stderr, "\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Export the images to `output`, a filename pattern or a directory. Usage errors print the
+// usage of `progname`, when not NULL. Returns 0 if every image was exported.
+static int _export_images(GList *id_list, const char *output, const _cli_export_t *opt, const char *progname)
+{
+  int res = 1;
+  gchar *output_filename = g_strdup(output);
+  gchar *output_ext = g_strdup(opt->output_ext);
+  dt_imageio_module_format_t *format = NULL;
+  dt_imageio_module_storage_t *storage = NULL;
+  dt_imageio_module_data_t *sdata = NULL, *fdata = NULL;
+  const int total = g_list_length(id_list);
+
+  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
+  {
+    if(IS_NULL_PTR(output_ext))
+    {
+      output_ext = g_strdup("jpg");
+    }
+    fprintf(stderr, _("notice: output location is a directory. assuming '%s/$(FILE_NAME).%s' output pattern"), output_filename, output_ext);
+    fprintf(stderr, "\n");
+    gchar* temp_of = g_strdup(output_filename);
+    dt_free(output_filename);
+    if(g_str_has_suffix(temp_of, "/"))
+      temp_of[strlen(temp_of) - 1] = '\0';
+    output_filename = g_strconcat(temp_of, "/$(FILE_NAME)", NULL);
+    dt_free(temp_of);
+  }
+  // the output file already exists, so there will be a sequence number added
+  else if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
+  {
+    if(IS_NULL_PTR(output_ext) || (output_ext && g_str_has_suffix(output_filename, output_ext) && !g_strcmp0(output_ext,strrchr(output_filename, '.')+1))){
+      //output file exists or there's output ext specified and it's same as file...
+      fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+    }
+    //TODO: test if file with replaced ext exists
+    // or not if we decide we don't replace file ext with output ext specified
+  }
+
+  if(IS_NULL_PTR(output_ext))
+  {
+    // by this point we're sure output is not dir, there's no output ext specified
+    // so only place to look for it is in filename
+    // try to find out the export format from the output_filename
+    char *ext = strrchr(output_filename, '.');
+    if(ext && strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
+    {
+      // too long ext, no point in wasting time
+      fprintf(stderr, _("too long output file extension: %s\n"), ext);
+      if(progname) usage(progname);
+      goto end;
+    }
+    else if(!ext || strlen(ext) <= 1)
+    {
+      // no ext or empty ext, no point in wasting time
+      fprintf(stderr, _("no output file extension given\n"));
+      if(progname) usage(progname);
+      goto end;
+    }
+    *ext = '\0';
+    ext++;
+    output_ext = g_strdup(ext);
+  } else {
+    // check and remove redundant file ext
+    char *ext = strrchr(output_filename, '.');
+    if(ext && !strcmp(output_ext, ext+1))
+    {
+      *ext = '\0';
+    }
+  }
+
+  if(!strcmp(output_ext, "jpg"))
+  {
+    dt_free(output_ext);
+    output_ext = g_strdup("jpeg");
+  }
+
+  if(!strcmp(output_ext, "tif"))
+  {
+    dt_free(output_ext);
+    output_ext = g_strdup("tiff");
+  }
+
+  // init the export data structures
+  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
+  if(IS_NULL_PTR(storage))
+  {
+    fprintf(
+        stderr, "%s\n",
+        _("cannot find disk storage module. please check your installation, something seems to be broken."));
+    goto end;
+  }
+
+  sdata = storage->get_params(storage);
+  if(IS_NULL_PTR(sdata))
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
+    goto end;
+  }
+
+  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
+  // any longer ...
+  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
+  // all is good now, the last line didn't happen.
+
+  format = dt_imageio_get_format_by_name(output_ext);
+  if(IS_NULL_PTR(format))
+  {
+    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
+    fprintf(stderr, "\n");
+    goto end;
+  }
+
+  fdata = format->get_params(format);
+  if(IS_NULL_PTR(fdata))
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    goto end;
+  }
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = opt->width;
+  fdata->max_height = opt->height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+
+  if(opt->style)
+  {
+    g_strlcpy((char *)fdata->style, opt->style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+  }
+
+  if(storage->initialize_store)
+  {
+    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, TRUE);
+
+    format->set_params(format, fdata, format->params_size(format));
+    storage->set_params(storage, sdata, storage->params_size(storage));
+  }
+
+  // TODO: add a callback to set the bpp without going through the config
+
+  res = 0;
+  int num = 1;
+  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  {
+    const int id = GPOINTER_TO_INT(iter->data);
+    // TODO: have a parameter in command line to get the export presets
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(storage->store(storage, sdata, id, format, fdata, num, total, TRUE, opt->export_masks,
+                      opt->icc_type, opt->icc_filename, opt->icc_intent, &metadata) != 0)
+      res = 1;
+  }
+
+  if(storage->finalize_store) storage->finalize_store(storage, sdata);
+
+end:
+  if(sdata) storage->free_params(storage, sdata);
+  if(fdata) format->free_params(format, fdata);
+  dt_free(output_filename);
+  dt_free(output_ext);
+  return res;
+}
+
+// One line of NDJSON on stdout per batch job, flushed so a driver can follow along.
+static void _print_job_status(const int job, const char *input, const char *output, const int images,
+                              const char *error, const double seconds)
+{
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "job");
+  json_builder_add_int_value(builder, job);
+  if(input)
+  {
+    json_builder_set_member_name(builder, "input");
+    json_builder_add_string_value(builder, input);
+  }
+  if(output)
+  {
+    json_builder_set_member_name(builder, "output");
+    json_builder_add_string_value(builder, output);
+  }
+  json_builder_set_member_name(builder, "status");
+  json_builder_add_string_value(builder, error ? "error" : "ok");
+  if(error)
+  {
+    json_builder_set_member_name(builder, "error");
+    json_builder_add_string_value(builder, error);
+  }
+  json_builder_set_member_name(builder, "images");
+  json_builder_add_int_value(builder, images);
+  json_builder_set_member_name(builder, "seconds");
+  json_builder_add_double_value(builder, seconds);
+  json_builder_end_object(builder);
+
+  JsonNode *root = json_builder_get_root(builder);
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_root(gen, root);
+  gchar *str = json_generator_to_data(gen, NULL);
+  printf("%s\n", str);
+  fflush(stdout);
+
+  dt_free(str);
+  g_object_unref(gen);
+  json_node_free(root);
+  g_object_unref(builder);
+}
+
+static const char *_job_string(JsonObject *job, const char *member)
+{
+  JsonNode *node = json_object_get_member(job, member);
+  if(IS_NULL_PTR(node) || json_node_get_value_type(node) != G_TYPE_STRING) return NULL;
+  return json_node_get_string(node);
+}
+
+// Read one line of any length. FALSE at the end of the stream.
+static gboolean _read_line(FILE *f, GString *line)
+{
+  char chunk[4096];
+  g_string_truncate(line, 0);
+  while(fgets(chunk, sizeof(chunk), f))
+  {
+    g_string_append(line, chunk);
+    if(line->str[line->len - 1] == '\n') break;
+  }
+  return line->len > 0;
+}
+
+// Run one job, described by a JSON object. Returns NULL on success, or the error message.
+static const char *_run_job(JsonObject *job, const _cli_export_t *defaults, GHashTable *xmp_applied,
+                            int *images)
+{
+  const char *input = _job_string(job, "input");
+  const char *output = _job_string(job, "output");
+  const char *xmp = _job_string(job, "xmp");
+  if(IS_NULL_PTR(input) || IS_NULL_PTR(output)) return "`input' and `output' are required";
+  if(!g_file_test(input, G_FILE_TEST_EXISTS)) return "input not found";
+
+  _cli_export_t opt = *defaults;
+  if(json_object_has_member(job, "width")) opt.width = MAX((int)json_object_get_int_member(job, "width"), 0);
+  if(json_object_has_member(job, "height")) opt.height = MAX((int)json_object_get_int_member(job, "height"), 0);
+  if(json_object_has_member(job, "out_ext")) opt.output_ext = _job_string(job, "out_ext");
+  if(opt.output_ext && opt.output_ext[0] == '.') opt.output_ext++;
+  if(json_object_has_member(job, "style")) opt.style = _job_string(job, "style");
+  if(json_object_has_member(job, "export_masks"))
+    opt.export_masks = json_object_get_boolean_member(job, "export_masks");
+  if(_job_string(job, "icc_type"))
+  {
+    gchar *str = g_ascii_strup(_job_string(job, "icc_type"), -1);
+    opt.icc_type = get_icc_type(str);
+    dt_free(str);
+    if(opt.icc_type >= DT_COLORSPACE_LAST) return "unknown icc_type";
+  }
+  if(json_object_has_member(job, "icc_file")) opt.icc_filename = _job_string(job, "icc_file");
+  if(_job_string(job, "icc_intent"))
+  {
+    gchar *str = g_ascii_strup(_job_string(job, "icc_intent"), -1);
+    opt.icc_intent = get_icc_intent(str);
+    dt_free(str);
+    if(opt.icc_intent >= DT_INTENT_LAST) return "unknown icc_intent";
+  }
+
+  GList *id_list = _import_input(input);
+  *images = g_list_length(id_list);
+  if(IS_NULL_PTR(id_list)) return "no image imported";
+
+  // The library outlives the job: an image edited with an explicit XMP by an earlier job
+  // must get its own sidecar (or no history) back when a later job gives none.
+  const char *error = NULL;
+  if(xmp)
+  {
+    if(_apply_xmp(id_list, xmp)) error = "can't read the xmp file";
+    for(GList *iter = id_list; iter; iter = g_list_next(iter)) g_hash_table_add(xmp_applied, iter->data);
+  }
+  else
+  {
+    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    {
+      if(!g_hash_table_remove(xmp_applied, iter->data)) continue;
+      const int id = GPOINTER_TO_INT(iter->data);
+      char sidecar[PATH_MAX] = { 0 };
+      gboolean from_cache = FALSE;
+      dt_image_full_path(id, sidecar, sizeof(sidecar), &from_cache, __FUNCTION__);
+      dt_image_path_append_version(id, sidecar, sizeof(sidecar));
+      g_strlcat(sidecar, ".xmp", sizeof(sidecar));
+      dt_history_delete_on_image(id);
+      if(g_file_test(sidecar, G_FILE_TEST_EXISTS))
+      {
+        GList image = { .data = iter->data, .next = NULL, .prev = NULL };
+        _apply_xmp(&image, sidecar);
+      }
+    }
+  }
+
+  if(!error && _export_images(id_list, output, &opt, NULL))
+    error = "export failed";
+
+  g_list_free(id_list);
+  return error;
+}
+
+// Process the jobs listed in `filename`, or on stdin for "-", in this process. Returns 0 if
+// every job succeeded.
+static int _run_batch(const char *filename, const _cli_export_t *defaults)
+{
+  FILE *f = strcmp(filename, "-") ? g_fopen(filename, "rb") : stdin;
+  if(IS_NULL_PTR(f))
+  {
+    fprintf(stderr, _("error: can't open job list %s"), filename);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  int res = 0;
+  int job = 0;
+  GHashTable *xmp_applied = g_hash_table_new(NULL, NULL);
+  GString *line = g_string_new(NULL);
+  JsonParser *parser = json_parser_new();
+
+  while(_read_line(f, line))
+  {
+    g_strstrip(line->str);
+    if(line->str[0] == '\0' || line->str[0] == '#') continue;
+    job++;
+
+    const double start = dt_get_wtime();
+    const char *input = NULL, *output = NULL;
+    const char *error = NULL;
+    int images = 0;
+
+    GError *err = NULL;
+    JsonNode *root = NULL;
+    if(!json_parser_load_from_data(parser, line->str, -1, &err))
+      error = err->message;
+    else if(IS_NULL_PTR(root = json_parser_get_root(parser)) || !JSON_NODE_HOLDS_OBJECT(root))
+      error = "a job is a JSON object";
+    else
+    {
+      JsonObject *obj = json_node_get_object(root);
+      input = _job_string(obj, "input");
+      output = _job_string(obj, "output");
+      error = _run_job(obj, defaults, xmp_applied, &images);
+    }
+
+    if(error) res = 1;
+    _print_job_status(job, input, output, images, error, dt_get_wtime() - start);
+    if(err) g_error_free(err);
+  }
+
+  g_object_unref(parser);
+  g_string_free(line, TRUE);
+  g_hash_table_destroy(xmp_applied);
+  if(f != stdin) fclose(f);
+  return res;
+}
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -217,10 +664,11 @@ int main(int argc, char *arg[])
   gchar *output_filename = NULL;
   gchar *output_ext = NULL;
   char *style = NULL;
+  char *counters_filename = NULL;
+  char *batch_filename = NULL;
   int file_counter = 0;
   int width = 0, height = 0, bpp = 0;
-  gboolean verbose = FALSE, custom_presets = TRUE, export_masks = FALSE,
-           output_to_dir = FALSE;
+  gboolean verbose = FALSE, custom_presets = TRUE, export_masks = FALSE;
 
   GList* inputs = NULL;
   GList* imgids = NULL;
@@ -380,6 +828,16 @@ int main(int argc, char *arg[])
           exit(1);
         }
       }
+      else if(!strcmp(arg[k], "--counters") && argc > k + 1)
+      {
+        k++;
+        counters_filename = arg[k];
+      }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch_filename = arg[k];
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -410,7 +868,7 @@ int main(int argc, char *arg[])
   }
 
   int m_argc = 0;
-  char **m_arg = malloc(sizeof(char *) * (5 + argc - k + 1));
+  char **m_arg = malloc(sizeof(char *) * (7 + argc - k + 1));
   m_arg[m_argc++] = "ansel-cli";
 
   // --imgid mode reads the image and its editing history from the user's library.db, so the
@@ -423,10 +881,35 @@ int main(int argc, char *arg[])
 
   m_arg[m_argc++] = "--conf";
   m_arg[m_argc++] = "write_sidecar_files=FALSE";
+
+  if(counters_filename)
+  {
+    m_arg[m_argc++] = "--pipe-counters";
+    m_arg[m_argc++] = counters_filename;
+  }
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
-  if(imgids && (inputs || file_counter != 1))
+  if(batch_filename)
+  {
+    if(file_counter > 0 || inputs || imgids)
+    {
+      // jobs carry their own inputs and outputs
+      fprintf(stderr, _("error: --batch cannot be combined with input files, --import or --imgid\n"));
+      usage(arg[0]);
+      dt_free(m_arg);
+      dt_free(output_filename);
+      dt_free(output_ext);
+      g_list_free(imgids);
+      if(inputs)
+      {
+        g_list_free_full(inputs, dt_free_gpointer);
+        inputs = NULL;
+      }
+      exit(1);
+    }
+  }
+  else if(imgids && (inputs || file_counter != 1))
   {
     // --imgid takes no input file and no XMP: the only positional argument is the output
     if(inputs || file_counter > 1)
@@ -529,34 +1012,6 @@ int main(int argc, char *arg[])
     input_filename = NULL;
   }
 
-  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
-  {
-    output_to_dir = TRUE;
-    if(IS_NULL_PTR(output_ext))
-    {
-      output_ext = g_strdup("jpg");
-    }
-    fprintf(stderr, _("notice: output location is a directory. assuming '%s/$(FILE_NAME).%s' output pattern"), output_filename, output_ext);
-    fprintf(stderr, "\n");
-    gchar* temp_of = g_strdup(output_filename);
-    dt_free(output_filename);
-    if(g_str_has_suffix(temp_of, "/"))
-      temp_of[strlen(temp_of) - 1] = '\0';
-    output_filename = g_strconcat(temp_of, "/$(FILE_NAME)", NULL);
-    dt_free(temp_of);
-  }
-
-  // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
-  {
-    if(IS_NULL_PTR(output_ext) || (output_ext && g_str_has_suffix(output_filename, output_ext) && !g_strcmp0(output_ext,strrchr(output_filename, '.')+1))){
-      //output file exists or there's output ext specified and it's same as file...
-      fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
-    }
-    //TODO: test if file with replaced ext exists
-    // or not if we decide we don't replace file ext with output ext specified
-  }
-
   // init dt without gui and without data.db:
   if(dt_init(m_argc, m_arg, FALSE, custom_presets))
   {
@@ -574,6 +1029,26 @@ int main(int argc, char *arg[])
     exit(1);
   }
 
+  const _cli_export_t opt = { .width = width,
+                              .height = height,
+                              .output_ext = output_ext,
+                              .style = style,
+                              .export_masks = export_masks,
+                              .icc_type = icc_type,
+                              .icc_filename = icc_filename,
+                              .icc_intent = icc_intent };
+
+  if(batch_filename)
+  {
+    // modules, profiles and the pixelpipe cache stay warm from one job to the next
+    const int res = _run_batch(batch_filename, &opt);
+    dt_free(icc_filename);
+    dt_free(output_ext);
+    dt_cleanup();
+    dt_free(m_arg);
+    exit(res);
+  }
+
   GList *id_list = NULL;
 
   // --imgid mode: the images are already in the library with their history; just check they exist
@@ -600,39 +1075,7 @@ int main(int argc, char *arg[])
   imgids = NULL;
 
   for(GList *l = inputs; !IS_NULL_PTR(l); l=g_list_next(l))
-  {
-    gchar* input = l->data;
-
-    if(g_file_test(input, G_FILE_TEST_IS_DIR))
-    {
-      const int filmid = dt_film_import(input);
-      if(!filmid)
-      {
-        // one of inputs was a failure, no prob
-        fprintf(stderr, _("error: can't open folder %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_concat(id_list, dt_film_get_image_ids(filmid));
-    }
-    else
-    {
-      dt_film_t film;
-      int filmid = 0;
-
-      gchar *directory = g_path_get_dirname(input);
-      filmid = dt_film_new(&film, directory);
-      const int32_t id = dt_image_import(filmid, input, TRUE);
-      dt_free(directory);
-      if(!id)
-      {
-        fprintf(stderr, _("error: can't open file %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-    }
-  }
+    id_list = g_list_concat(id_list, _import_input(l->data));
 
   //we no longer need inputs
   if(inputs)
@@ -656,27 +1099,15 @@ int main(int argc, char *arg[])
   }
 
   // attach xmp, if requested:
-  if(xmp_filename)
+  if(xmp_filename && _apply_xmp(id_list, xmp_filename))
   {
-    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    dt_free(m_arg);
+    dt_free(output_filename);
+    if(output_ext)
     {
-      int id = GPOINTER_TO_INT(iter->data);
-      dt_image_t *image = dt_image_cache_get(id, 'w');
-      if(dt_exif_xmp_read(image, xmp_filename, 1) != 0)
-      {
-        fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
-        fprintf(stderr, "\n");
-        dt_free(m_arg);
-        dt_free(output_filename);
-        if(output_ext)
-        {
-          dt_free(output_ext);
-        }
-        exit(1);
-      }
-      // don't write new xmp:
-      dt_image_cache_write_release(image, DT_IMAGE_CACHE_RELAXED);
+      dt_free(output_ext);
     }
+    exit(1);
   }
 
   // print the history stack. only look at the first image and assume all got the same processing applied
@@ -690,158 +1121,11 @@ int main(int argc, char *arg[])
       printf("[%s]\n", _("empty history stack"));
   }
 
-  if(IS_NULL_PTR(output_ext))
-  {
-    // by this point we're sure output is not dir, there's no output ext specified
-    // so only place to look for it is in filename
-    // try to find out the export format from the output_filename
-    char *ext = strrchr(output_filename, '.');
-    if(ext && strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
-    {
-      // too long ext, no point in wasting time
-      fprintf(stderr, _("too long output file extension: %s\n"), ext);
-      usage(arg[0]);
-      dt_free(output_filename);
-      exit(1);
-    }
-    else if(!ext || strlen(ext) <= 1)
-    {
-      // no ext or empty ext, no point in wasting time
-      fprintf(stderr, _("no output file extension given\n"));
-      usage(arg[0]);
-      dt_free(output_filename);
-      exit(1);
-    }
-    *ext = '\0';
-    ext++;
-    output_ext = g_strdup(ext);
-  } else {
-    // check and remove redundant file ext
-    char *ext = strrchr(output_filename, '.');
-    if(ext && !strcmp(output_ext, ext+1))
-    {
-      *ext = '\0';
-    }
-  }
-
-  if(!strcmp(output_ext, "jpg"))
-  {
-    dt_free(output_ext);
-    output_ext = g_strdup("jpeg");
-  }
-
-  if(!strcmp(output_ext, "tif"))
-  {
-    dt_free(output_ext);
-    output_ext = g_strdup("tiff");
-  }
-
-  // init the export data structures
-  dt_imageio_module_format_t *format;
-  dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
-
-  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
-  if(IS_NULL_PTR(storage))
-  {
-    fprintf(
-        stderr, "%s\n",
-        _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    dt_free(m_arg);
-    dt_free(output_filename);
-    dt_free(output_ext);
-    exit(1);
-  }
-
-  sdata = storage->get_params(storage);
-  if(IS_NULL_PTR(sdata))
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
-    dt_free(m_arg);
-    dt_free(output_filename);
-    dt_free(output_ext);
-    exit(1);
-  }
-
-  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
-  // any longer ...
-  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
-  // all is good now, the last line didn't happen.
-  dt_free(output_filename);
-
-  format = dt_imageio_get_format_by_name(output_ext);
-  if(IS_NULL_PTR(format))
-  {
-    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
-    fprintf(stderr, "\n");
-    dt_free(m_arg);
-    dt_free(output_ext);
-    exit(1);
-  }
-
-  fdata = format->get_params(format);
-  if(IS_NULL_PTR(fdata))
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    dt_free(m_arg);
-    dt_free(output_ext);
-    exit(1);
-  }
-
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-
-  if(style)
-  {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
-  }
-
-  if(storage->initialize_store)
-  {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, TRUE);
-
-    format->set_params(format, fdata, format->params_size(format));
-    storage->set_params(storage, sdata, storage->params_size(storage));
-  }
-
-  // TODO: add a callback to set the bpp without going through the config
-
-  int num = 1, res = 0;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
-  {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, TRUE, export_masks,
-                      icc_type, icc_filename, icc_intent, &metadata) != 0)
-      res = 1;
-  }
+  const int res = _export_images(id_list, output_filename, &opt, arg[0]);
 
   // cleanup time
-  if(storage->finalize_store) storage->finalize_store(storage, sdata);
-  storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
+  dt_free(output_filename);
+  dt_free(output_ext);
   g_list_free(id_list);
   id_list = NULL;
 
@@ -0,0 +1,839 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Aurélien Pierre.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Compiled micro-benchmarks for the pixel code.
+ *
+ * tests/benchmark/ansel-bench times whole ansel-cli exports: decoding, the full pipe and the
+ * encoder all land in one number, and a 5 % regression in one module drowns in the run-to-run
+ * noise of the rest. This tool times one thing at a time, over a grid of sizes and thread
+ * counts, and reports the median and 95th percentile of the repeated runs:
+ *
+ *   - `kernels`: the shared filters of src/pixel/ (gaussian, bilateral, guided filter,
+ *     interpolation, à-trous wavelets) on a deterministic synthetic buffer. Needs no image.
+ *   - `iops`: every enabled module of the default pipe of a real image, each `process()` called
+ *     in isolation on a synthetic input sized by the pipe's own ROI planning. The pipe is built
+ *     exactly as for export, so `piece->data`, formats and ROIs are the ones production sees;
+ *     only the pixels are fake, which is irrelevant for timing and keeps the runs reproducible.
+ *     Blending, colour conversions and the cache are not timed: they are not the module's.
+ *   - `collection`: diffing two orderings of a collection the way a reload does before the
+ *     lighttable patches its LUT, for a single moved image, a single removed image and a full
+ *     reversal, on 10k to 1M images. The first two should stay flat as the collection grows,
+ *     apart from the linear compare of the unchanged ends. Needs no image.
+ *   - `dev`: dt_dev_init() and dt_dev_cleanup() of a headless dev, as thumbnails, exports and
+ *     history pastes build them, reported with the number of modules as width. Headless module
+ *     instances are cloned from prototypes; run it again with
+ *     `--core --conf develop/module_prototypes=FALSE` to time the full init() of each module.
+ *     Needs no image.
+ *   - `demosaic`: every CPU method of the demosaic module on synthetic Bayer and X-Trans mosaics
+ *     of 24, 45 and 100 Mpx, the frames where their memory traffic matters. `--only` takes the
+ *     method names as reported, like `bayer_rcd_vng` or `xtrans_vng`. Needs no image.
+ *
+ * Usage:
+ *   ansel-microbench [kernels|iops|collection|dev|demosaic|all] [options] [--core <ansel options>]
+ *
+ * Output is a human-readable table, or one JSON object per line with `--ndjson`, meant to be
+ * diffed between two builds on the same machine.
+ */
+
+#include "darktable.h"
+#include "caches/image_cache.h"
+#include "caches/mipmap_cache.h"
+#include "common/collection.h"
+#include "common/introspection.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/times.h"
+#include "common/xmp_sidecar.h"
+#include "develop/dev_pixelpipe.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/iop_order.h"
+#include "develop/pixelpipe_hb.h"
+#include "imageio/imageio_core.h"
+#include "imageio/imageio_profile.h"
+#include "pixel/bilateral.h"
+#include "pixel/eaw.h"
+#include "pixel/gaussian.h"
+#include "pixel/guided_filter.h"
+#include "pixel/interpolation.h"
+#include "system/macros.h"
+#include "system/mem_alloc.h"
+#include "system/openmp.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_SIZES 8
+#define BENCH_MAX_THREADS 8
+
+typedef struct bench_options_t
+{
+  gboolean kernels;
+  gboolean iops;
+  gboolean collection;
+  gboolean dev;
+  gboolean demosaic;
+  gboolean ndjson;
+  int sizes[BENCH_MAX_SIZES];
+  int num_sizes;
+  int threads[BENCH_MAX_THREADS];
+  int num_threads;
+  int runs;
+  int warmup;
+  const char *image;
+  const char *xmp;
+  const char *only; // comma-separated list of kernel or module names, NULL for all
+} bench_options_t;
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [kernels|iops|collection|dev|demosaic|all] [options] [--core <ansel options>]\n",
+          progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --image <file>     raw or image whose default pipe is benchmarked by `iops'\n");
+  fprintf(stderr, "   --xmp <file>       history to apply to --image, default: the default pipe\n");
+  fprintf(stderr, "   --sizes <list>     comma-separated square ROI sizes, default: 512,1024,2048\n");
+  fprintf(stderr, "   --threads <list>   comma-separated OpenMP thread counts, default: 1,<all>\n");
+  fprintf(stderr, "   --runs <n>         timed runs per measurement, default: 15\n");
+  fprintf(stderr, "   --warmup <n>       untimed runs before measuring, default: 2\n");
+  fprintf(stderr, "   --only <list>      comma-separated kernel or module names to run\n");
+  fprintf(stderr, "   --ndjson           print one JSON object per measurement\n");
+}
+
+static int _parse_list(const char *str, int *out, const int max)
+{
+  int n = 0;
+  gchar **tokens = g_strsplit(str, ",", -1);
+  for(gchar **t = tokens; *t && n < max; t++)
+  {
+    const int v = atoi(*t);
+    if(v > 0) out[n++] = v;
+  }
+  g_strfreev(tokens);
+  return n;
+}
+
+static gboolean _selected(const bench_options_t *opt, const char *name)
+{
+  if(IS_NULL_PTR(opt->only)) return TRUE;
+  gchar **tokens = g_strsplit(opt->only, ",", -1);
+  gboolean found = FALSE;
+  for(gchar **t = tokens; *t && !found; t++) found = !g_strcmp0(*t, name);
+  g_strfreev(tokens);
+  return found;
+}
+
+// The thread count is read from two places: the OpenMP ICV for the parallel regions, and
+// dt_get_num_openmp_threads() for the per-thread scratch buffers some kernels size up front.
+// Both have to agree, or a kernel allocates for N threads and runs M.
+static void _set_threads(const int threads)
+{
+  darktable.num_openmp_threads = threads;
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+static int _cmp_double(const void *a, const void *b)
+{
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void _report(const bench_options_t *opt, const char *group, const char *name, const int width,
+                    const int height, const int threads, double *samples, const int n, const int error)
+{
+  double median = 0.0, p95 = 0.0;
+  if(!error && n > 0)
+  {
+    qsort(samples, n, sizeof(double), _cmp_double);
+    median = (n & 1) ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    // nearest-rank percentile: the smallest sample with at least 95 % of the runs at or below it
+    p95 = samples[MIN(n - 1, (int)ceil(0.95 * n) - 1)];
+  }
+  const double mpix_s = median > 0.0 ? (double)width * height / median * 1e-6 : 0.0;
+
+  if(opt->ndjson)
+    printf("{\"group\":\"%s\",\"name\":\"%s\",\"width\":%d,\"height\":%d,\"threads\":%d,\"runs\":%d,"
+           "\"error\":%s,\"median_ms\":%.4f,\"p95_ms\":%.4f,\"mpix_s\":%.2f}\n",
+           group, name, width, height, threads, n, error ? "true" : "false", median * 1e3, p95 * 1e3, mpix_s);
+  else if(error)
+    printf("%-8s %-24s %5dx%-5d %3d  %s\n", group, name, width, height, threads, "error");
+  else
+    printf("%-8s %-24s %5dx%-5d %3d  %10.3f %10.3f %10.1f\n", group, name, width, height, threads,
+           median * 1e3, p95 * 1e3, mpix_s);
+  fflush(stdout);
+}
+
+static void _print_header(const bench_options_t *opt)
+{
+  if(opt->ndjson) return;
+  printf("%-8s %-24s %11s %3s  %10s %10s %10s\n", "group", "name", "size", "thr", "median ms", "p95 ms",
+         "Mpix/s");
+}
+
+// Deterministic content: a smooth gradient plus LCG noise, in [0; 1). Smooth enough that
+// edge-aware filters do not degenerate into a box blur, noisy enough that they do not
+// short-circuit on flat areas. Same seed, same buffer, on every machine.
+static void _fill_synthetic(float *const buf, const size_t width, const size_t height, const size_t ch)
+{
+  uint32_t state = 0x2545F491u;
+  for(size_t j = 0; j < height; j++)
+    for(size_t i = 0; i < width; i++)
+      for(size_t c = 0; c < ch; c++)
+      {
+        state = state * 1664525u + 1013904223u;
+        const float noise = (float)(state >> 8) / (float)(1u << 24);
+        const float ramp = (float)(i + j + c * 7) / (float)(width + height + ch * 7);
+        buf[(j * width + i) * ch + c] = 0.75f * ramp + 0.25f * noise;
+      }
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* src/pixel kernels                                                                           */
+/* ------------------------------------------------------------------------------------------- */
+
+typedef struct bench_buffers_t
+{
+  int width, height;
+  float *in;     // RGBA, [0; 1)
+  float *lab;    // RGBA with channel 0 in [0; 100), as the bilateral grid expects Lab L
+  float *out;
+  float *aux;
+  float *detail;
+} bench_buffers_t;
+
+typedef int (*bench_kernel_t)(const bench_buffers_t *b);
+
+static int _kernel_gaussian(const bench_buffers_t *b)
+{
+  const dt_aligned_pixel_t max = { INFINITY, INFINITY, INFINITY, INFINITY };
+  const dt_aligned_pixel_t min = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+  dt_gaussian_t *g = dt_gaussian_init(b->width, b->height, 4, max, min, 8.0f, 0);
+  if(IS_NULL_PTR(g)) return 1;
+  dt_gaussian_blur_4c(g, b->in, b->out);
+  dt_gaussian_free(g);
+  return 0;
+}
+
+static int _kernel_bilateral(const bench_buffers_t *b)
+{
+  dt_bilateral_t *grid = dt_bilateral_init(b->width, b->height, 16.0f, 10.0f);
+  if(IS_NULL_PTR(grid)) return 1;
+  dt_bilateral_splat(grid, b->lab);
+  dt_bilateral_blur(grid);
+  dt_bilateral_slice(grid, b->lab, b->out, -1.0f);
+  dt_bilateral_free(grid);
+  return 0;
+}
+
+static int _kernel_guided_filter(const bench_buffers_t *b)
+{
+  return guided_filter(b->in, b->in, b->out, b->width, b->height, 4, 8, 0.1f, 1.0f, -FLT_MAX, FLT_MAX);
+}
+
+static int _kernel_interpolation(const bench_buffers_t *b)
+{
+  // 2:1 downscale with the default interpolator, the common case of every preview pipe
+  const struct dt_interpolation *itor = dt_interpolation_new(DT_INTERPOLATION_DEFAULT);
+  const dt_iop_roi_t roi_in = { 0, 0, b->width, b->height, 1.0 };
+  const dt_iop_roi_t roi_out = { 0, 0, b->width / 2, b->height / 2, 0.5 };
+  dt_interpolation_resample(itor, b->out, &roi_out, b->in, &roi_in);
+  return 0;
+}
+
+static int _kernel_eaw(const bench_buffers_t *b)
+{
+  // one decomposition and its synthesis, at the scale equalizer's middle band
+  const dt_aligned_pixel_t thrs = { 0.01f, 0.01f, 0.01f, 0.01f };
+  const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
+  eaw_decompose(b->aux, b->in, b->detail, 2, 0.0f, b->width, b->height);
+  eaw_synthesize(b->out, b->aux, b->detail, thrs, boost, b->width, b->height);
+  return 0;
+}
+
+static int _kernel_eaw_dn(const bench_buffers_t *b)
+{
+  dt_aligned_pixel_t sum_squared = { 0.0f, 0.0f, 0.0f, 0.0f };
+  eaw_dn_decompose(b->aux, b->in, b->detail, sum_squared, 2, 100.0f, b->width, b->height);
+  return 0;
+}
+
+static const struct
+{
+  const char *name;
+  bench_kernel_t run;
+} _kernels[] = {
+  { "gaussian", _kernel_gaussian },
+  { "bilateral", _kernel_bilateral },
+  { "guided_filter", _kernel_guided_filter },
+  { "interpolation", _kernel_interpolation },
+  { "eaw", _kernel_eaw },
+  { "eaw_dn", _kernel_eaw_dn },
+};
+
+static void _bench_kernels(const bench_options_t *opt, double *samples)
+{
+  for(int s = 0; s < opt->num_sizes; s++)
+  {
+    const int size = opt->sizes[s];
+    const size_t floats = (size_t)size * size * 4;
+    bench_buffers_t b = { .width = size, .height = size };
+    b.in = dt_alloc_align_float(floats);
+    b.lab = dt_alloc_align_float(floats);
+    b.out = dt_alloc_align_float(floats);
+    b.aux = dt_alloc_align_float(floats);
+    b.detail = dt_alloc_align_float(floats);
+    if(IS_NULL_PTR(b.in) || IS_NULL_PTR(b.lab) || IS_NULL_PTR(b.out) || IS_NULL_PTR(b.aux)
+       || IS_NULL_PTR(b.detail))
+    {
+      fprintf(stderr, "[ansel-microbench] can't allocate buffers for %dx%d\n", size, size);
+      goto next;
+    }
+
+    _fill_synthetic(b.in, size, size, 4);
+    for(size_t k = 0; k < floats; k++) b.lab[k] = (k % 4 == 0) ? 100.0f * b.in[k] : b.in[k] - 0.5f;
+
+    for(size_t k = 0; k < sizeof(_kernels) / sizeof(_kernels[0]); k++)
+    {
+      if(!_selected(opt, _kernels[k].name)) continue;
+      for(int t = 0; t < opt->num_threads; t++)
+      {
+        _set_threads(opt->threads[t]);
+        int error = 0;
+        for(int r = 0; r < opt->warmup && !error; r++) error = _kernels[k].run(&b);
+        for(int r = 0; r < opt->runs && !error; r++)
+        {
+          const double start = dt_get_wtime();
+          error = _kernels[k].run(&b);
+          samples[r] = dt_get_wtime() - start;
+        }
+        _report(opt, "kernel", _kernels[k].name, size, size, opt->threads[t], samples, opt->runs, error);
+      }
+    }
+
+next:
+    dt_free_align(b.in);
+    dt_free_align(b.lab);
+    dt_free_align(b.out);
+    dt_free_align(b.aux);
+    dt_free_align(b.detail);
+  }
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* IOP process() in isolation                                                                  */
+/* ------------------------------------------------------------------------------------------- */
+
+static int32_t _import_image(const bench_options_t *opt)
+{
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(opt->image);
+  const int filmid = dt_film_new(&film, directory);
+  dt_free(directory);
+  const int32_t imgid = dt_image_import(filmid, opt->image, FALSE);
+  if(imgid <= 0)
+  {
+    fprintf(stderr, "[ansel-microbench] can't open %s\n", opt->image);
+    return -1;
+  }
+
+  if(opt->xmp)
+  {
+    dt_image_t *image = dt_image_cache_get(imgid, 'w');
+    const int err = dt_exif_xmp_read(image, opt->xmp, 1);
+    dt_image_cache_write_release(image, DT_IMAGE_CACHE_RELAXED);
+    if(err)
+    {
+      fprintf(stderr, "[ansel-microbench] can't read %s\n", opt->xmp);
+      return -1;
+    }
+  }
+  return imgid;
+}
+
+// Time every enabled node of `pipe` for the ROI planned from `roi_out`.
+static void _bench_pipe_at(const bench_options_t *opt, dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t roi_out,
+                           double *samples)
+{
+  dt_dev_pixelpipe_get_roi_in(pipe, roi_out);
+
+  for(GList *node = g_list_first(pipe->nodes); node; node = g_list_next(node))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)node->data;
+    dt_iop_module_t *module = piece->module;
+    if(!piece->enabled || IS_NULL_PTR(module->process) || !_selected(opt, module->op)) continue;
+
+    const dt_iop_roi_t *roi_in = &piece->roi_in;
+    const dt_iop_roi_t *roi_o = &piece->roi_out;
+    const size_t in_size = (size_t)roi_in->width * roi_in->height * piece->dsc_in.bpp;
+    const size_t out_size = (size_t)roi_o->width * roi_o->height * piece->dsc_out.bpp;
+    if(in_size == 0 || out_size == 0) continue;
+
+    void *input = dt_alloc_align(in_size);
+    void *output = dt_alloc_align(out_size);
+    if(IS_NULL_PTR(input) || IS_NULL_PTR(output))
+    {
+      fprintf(stderr, "[ansel-microbench] can't allocate buffers for %s\n", module->op);
+      dt_free_align(input);
+      dt_free_align(output);
+      continue;
+    }
+
+    if(piece->dsc_in.datatype == TYPE_FLOAT)
+      _fill_synthetic((float *)input, roi_in->width, roi_in->height, piece->dsc_in.bpp / sizeof(float));
+    else
+      memset(input, 0x5a, in_size);
+
+    for(int t = 0; t < opt->num_threads; t++)
+    {
+      _set_threads(opt->threads[t]);
+      int error = 0;
+      for(int r = 0; r < opt->warmup && !error; r++)
+        error = module->process(module, pipe, piece, input, output);
+      for(int r = 0; r < opt->runs && !error; r++)
+      {
+        const double start = dt_get_wtime();
+        error = module->process(module, pipe, piece, input, output);
+        samples[r] = dt_get_wtime() - start;
+      }
+      _report(opt, "iop", module->op, roi_o->width, roi_o->height, opt->threads[t], samples, opt->runs,
+              error);
+    }
+
+    dt_free_align(input);
+    dt_free_align(output);
+  }
+}
+
+static int _bench_iops(const bench_options_t *opt, double *samples)
+{
+  const int32_t imgid = _import_image(opt);
+  if(imgid <= 0) return 1;
+
+  // Same construction as dt_imageio_export_with_flags(), minus styles and the final encode.
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+  dt_ioppr_resync_modules_order(&dev);
+
+  dt_dev_pixelpipe_t pipe;
+  if(!dt_dev_pixelpipe_init_export(&pipe, &dev, IMAGEIO_FLOAT | IMAGEIO_RGB, FALSE))
+  {
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+  dt_dev_pixelpipe_create_nodes(&pipe);
+
+  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
+  dt_colorspaces_get_output_profile(imgid, &icc_type, NULL);
+  dt_dev_pixelpipe_set_icc(&pipe, icc_type, NULL, DT_INTENT_LAST);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(&buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  const int width = buf.width;
+  const int height = buf.height;
+  const float iscale = buf.iscale;
+  const gboolean valid = !IS_NULL_PTR(buf.buf) && width > 0 && height > 0;
+  dt_mipmap_cache_release(&buf);
+
+  int res = 1;
+  if(valid)
+  {
+    dt_dev_pixelpipe_set_input(&pipe, imgid, width, height, iscale, DT_MIPMAP_FULL);
+    dt_dev_pixelpipe_synch_all(&pipe);
+    dt_dev_pixelpipe_propagate_formats(&pipe);
+    dt_dev_pixelpipe_get_roi_out(&pipe, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                 &pipe.processed_height);
+
+    // Full-resolution crops: scale 1 is where process() does the most work per output
+    // pixel, and it keeps the ROI of every node the same size across modules.
+    for(int s = 0; s < opt->num_sizes; s++)
+    {
+      const dt_iop_roi_t roi = { 0, 0, MIN(opt->sizes[s], pipe.processed_width),
+                                 MIN(opt->sizes[s], pipe.processed_height), 1.0 };
+      _bench_pipe_at(opt, &pipe, roi, samples);
+    }
+    res = 0;
+  }
+  else
+    fprintf(stderr, "[ansel-microbench] can't load the full-size input of image %d\n", imgid);
+
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_cleanup(&dev);
+  return res;
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* collection diffs                                                                            */
+/* ------------------------------------------------------------------------------------------- */
+
+typedef void (*bench_edit_t)(int32_t *ids, const uint32_t count);
+
+// A rating change in a collection sorted by rating: one image jumps a few places
+static void _edit_move(int32_t *ids, const uint32_t count)
+{
+  const uint32_t from = count / 2, to = MIN(from + 16, count - 1);
+  const int32_t moved = ids[from];
+  memmove(ids + from, ids + from + 1, (to - from) * sizeof(int32_t));
+  ids[to] = moved;
+}
+
+// An image removed, or filtered out by its new rating: everything after it shifts by one
+static void _edit_remove(int32_t *ids, const uint32_t count)
+{
+  memmove(ids + count / 2, ids + count / 2 + 1, (count - count / 2 - 1) * sizeof(int32_t));
+}
+
+// Sort order flipped: the whole collection is the window, the worst case
+static void _edit_reverse(int32_t *ids, const uint32_t count)
+{
+  for(uint32_t i = 0; i < count / 2; i++)
+  {
+    const int32_t t = ids[i];
+    ids[i] = ids[count - 1 - i];
+    ids[count - 1 - i] = t;
+  }
+}
+
+static const struct
+{
+  const char *name;
+  bench_edit_t edit;
+  gboolean shrinks;
+} _edits[] = {
+  { "diff_move", _edit_move, FALSE },
+  { "diff_remove", _edit_remove, TRUE },
+  { "diff_reverse", _edit_reverse, FALSE },
+};
+
+static void _bench_collection(const bench_options_t *opt, double *samples)
+{
+  const uint32_t counts[] = { 10000, 100000, 1000000 };
+  for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+  {
+    const uint32_t count = counts[c];
+    int32_t *before = malloc(sizeof(int32_t) * count);
+    int32_t *after = malloc(sizeof(int32_t) * count);
+    if(IS_NULL_PTR(before) || IS_NULL_PTR(after))
+    {
+      fprintf(stderr, "[ansel-microbench] can't allocate a collection of %u images\n", count);
+      dt_free(before);
+      dt_free(after);
+      continue;
+    }
+    for(uint32_t i = 0; i < count; i++) before[i] = (int32_t)i + 1;
+
+    for(size_t e = 0; e < sizeof(_edits) / sizeof(_edits[0]); e++)
+    {
+      if(!_selected(opt, _edits[e].name)) continue;
+      memcpy(after, before, sizeof(int32_t) * count);
+      _edits[e].edit(after, count);
+      const uint32_t after_count = _edits[e].shrinks ? count - 1 : count;
+
+      for(int r = 0; r < opt->warmup; r++)
+        dt_collection_diff_free(dt_collection_diff_new(before, count, after, after_count));
+      for(int r = 0; r < opt->runs; r++)
+      {
+        const double start = dt_get_wtime();
+        dt_collection_diff_t *diff = dt_collection_diff_new(before, count, after, after_count);
+        samples[r] = dt_get_wtime() - start;
+        dt_collection_diff_free(diff);
+      }
+      _report(opt, "collect", _edits[e].name, count, 1, 1, samples, opt->runs, 0);
+    }
+
+    dt_free(before);
+    dt_free(after);
+  }
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* headless devs                                                                               */
+/* ------------------------------------------------------------------------------------------- */
+
+static void _bench_dev(const bench_options_t *opt, double *samples)
+{
+  if(!_selected(opt, "dev_init_cleanup")) return;
+
+  dt_develop_t dev;
+  for(int r = 0; r < opt->warmup; r++)
+  {
+    dt_dev_init(&dev, FALSE);
+    dt_dev_cleanup(&dev);
+  }
+
+  int modules = 0;
+  for(int r = 0; r < opt->runs; r++)
+  {
+    const double start = dt_get_wtime();
+    dt_dev_init(&dev, FALSE);
+    const double end_init = dt_get_wtime();
+    modules = g_list_length(dev.iop);
+    const double start_cleanup = dt_get_wtime();
+    dt_dev_cleanup(&dev);
+    samples[r] = (end_init - start) + (dt_get_wtime() - start_cleanup);
+  }
+  _report(opt, "dev", "dev_init_cleanup", modules, 1, 1, samples, opt->runs, modules == 0);
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* demosaic methods                                                                            */
+/* ------------------------------------------------------------------------------------------- */
+
+static const uint8_t _xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                       { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+static const struct
+{
+  const char *name;
+  const char *method; // symbolic name of dt_iop_demosaic_method_t
+  gboolean xtrans;
+} _demosaic_methods[] = {
+  { "bayer_ppg", "DT_IOP_DEMOSAIC_PPG", FALSE },
+  { "bayer_vng4", "DT_IOP_DEMOSAIC_VNG4", FALSE },
+  { "bayer_rcd", "DT_IOP_DEMOSAIC_RCD", FALSE },
+  { "bayer_lmmse", "DT_IOP_DEMOSAIC_LMMSE", FALSE },
+  { "bayer_amaze", "DT_IOP_DEMOSAIC_AMAZE", FALSE },
+  { "bayer_rcd_vng", "DT_IOP_DEMOSAIC_RCD_VNG", FALSE },
+  { "bayer_amaze_vng", "DT_IOP_DEMOSAIC_AMAZE_VNG", FALSE },
+  { "xtrans_vng", "DT_IOP_DEMOSAIC_VNG", TRUE },
+  { "xtrans_markesteijn", "DT_IOP_DEMOSAIC_MARKESTEIJN", TRUE },
+  { "xtrans_markesteijn3", "DT_IOP_DEMOSAIC_MARKESTEIJN_3", TRUE },
+  { "xtrans_fdc", "DT_IOP_DEMOSAIC_FDC", TRUE },
+  { "xtrans_markest3_vng", "DT_IOP_DEMOSAIC_MARKEST3_VNG", TRUE },
+};
+
+// One method on one mosaic, through the module's own commit_params() and process().
+static void _bench_demosaic_method(const bench_options_t *opt, dt_develop_t *dev, dt_iop_module_t *module,
+                                   const int method, const float *const mosaic, float *const out,
+                                   const int width, const int height, const char *name, double *samples)
+{
+  dt_iop_params_t *params = g_malloc(module->params_size);
+  memcpy(params, module->default_params, module->params_size);
+  *(int *)module->so->get_p(params, "demosaicing_method") = method;
+
+  dt_dev_pixelpipe_t pipe = { 0 };
+  pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.module = module;
+  piece.enabled = TRUE;
+  piece.dsc_in.channels = 1;
+  piece.dsc_in.datatype = TYPE_FLOAT;
+  piece.dsc_in.filters = dev->image_storage.dsc.filters;
+  memcpy(piece.dsc_in.xtrans, dev->image_storage.dsc.xtrans, sizeof(piece.dsc_in.xtrans));
+  for(int c = 0; c < 4; c++)
+  {
+    piece.dsc_in.processed_maximum[c] = 1.0f;
+    piece.dsc_in.temperature.coeffs[c] = 1.0f;
+  }
+  piece.roi_in = piece.roi_out = (dt_iop_roi_t){ 0, 0, width, height, 1.0 };
+
+  module->init_pipe(module, &pipe, &piece);
+  module->commit_params(module, params, &pipe, &piece);
+
+  for(int t = 0; t < opt->num_threads; t++)
+  {
+    _set_threads(opt->threads[t]);
+    int error = 0;
+    for(int r = 0; r < opt->warmup && !error; r++) error = module->process(module, &pipe, &piece, mosaic, out);
+    for(int r = 0; r < opt->runs && !error; r++)
+    {
+      const double start = dt_get_wtime();
+      error = module->process(module, &pipe, &piece, mosaic, out);
+      samples[r] = dt_get_wtime() - start;
+    }
+    _report(opt, "demosaic", name, width, height, opt->threads[t], samples, opt->runs, error);
+  }
+
+  module->cleanup_pipe(module, &pipe, &piece);
+  dt_free(params);
+}
+
+static void _bench_demosaic(const bench_options_t *opt, double *samples)
+{
+  // 24, 45 and 100 Mpx, 3:2 and 4:3 like the sensors
+  const int sizes[][2] = { { 6000, 4000 }, { 8256, 5504 }, { 11648, 8736 } };
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, FALSE);
+  dt_iop_module_t *module = NULL;
+  for(GList *node = dev.iop; node && IS_NULL_PTR(module); node = g_list_next(node))
+    if(!strcmp(((dt_iop_module_t *)node->data)->op, "demosaic")) module = (dt_iop_module_t *)node->data;
+  if(IS_NULL_PTR(module))
+  {
+    fprintf(stderr, "[ansel-microbench] can't find the demosaic module\n");
+    dt_dev_cleanup(&dev);
+    return;
+  }
+
+  dev.image_storage.flags = 0;
+  dev.image_storage.exif_iso = 100.0f;
+  memcpy(dev.image_storage.dsc.xtrans, _xtrans, sizeof(_xtrans));
+  dt_introspection_field_t *field = module->so->get_f("demosaicing_method");
+
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const int width = sizes[s][0], height = sizes[s][1];
+    float *mosaic = dt_alloc_align_float((size_t)width * height);
+    float *out = dt_alloc_align_float((size_t)4 * width * height);
+    if(IS_NULL_PTR(mosaic) || IS_NULL_PTR(out))
+    {
+      fprintf(stderr, "[ansel-microbench] can't allocate buffers for %dx%d\n", width, height);
+      dt_free_align(mosaic);
+      dt_free_align(out);
+      continue;
+    }
+    _fill_synthetic(mosaic, width, height, 1);
+
+    for(size_t m = 0; m < sizeof(_demosaic_methods) / sizeof(_demosaic_methods[0]); m++)
+    {
+      int method = 0;
+      if(!_selected(opt, _demosaic_methods[m].name)
+         || !dt_introspection_get_enum_value(field, _demosaic_methods[m].method, &method))
+        continue;
+      dev.image_storage.dsc.filters = _demosaic_methods[m].xtrans ? 9u : 0x94949494u;
+      _bench_demosaic_method(opt, &dev, module, method, mosaic, out, width, height, _demosaic_methods[m].name,
+                             samples);
+    }
+
+    dt_free_align(mosaic);
+    dt_free_align(out);
+  }
+
+  dt_dev_cleanup(&dev);
+}
+
+int main(int argc, char *arg[])
+{
+  bench_options_t opt = { .runs = 15, .warmup = 2 };
+  int k = 1;
+  for(; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "kernels"))
+      opt.kernels = TRUE;
+    else if(!strcmp(arg[k], "iops"))
+      opt.iops = TRUE;
+    else if(!strcmp(arg[k], "collection"))
+      opt.collection = TRUE;
+    else if(!strcmp(arg[k], "dev"))
+      opt.dev = TRUE;
+    else if(!strcmp(arg[k], "demosaic"))
+      opt.demosaic = TRUE;
+    else if(!strcmp(arg[k], "all"))
+      opt.kernels = opt.iops = opt.collection = opt.dev = opt.demosaic = TRUE;
+    else if(!strcmp(arg[k], "--image") && argc > k + 1)
+      opt.image = arg[++k];
+    else if(!strcmp(arg[k], "--xmp") && argc > k + 1)
+      opt.xmp = arg[++k];
+    else if(!strcmp(arg[k], "--sizes") && argc > k + 1)
+      opt.num_sizes = _parse_list(arg[++k], opt.sizes, BENCH_MAX_SIZES);
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      opt.num_threads = _parse_list(arg[++k], opt.threads, BENCH_MAX_THREADS);
+    else if(!strcmp(arg[k], "--runs") && argc > k + 1)
+      opt.runs = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--warmup") && argc > k + 1)
+      opt.warmup = MAX(atoi(arg[++k]), 0);
+    else if(!strcmp(arg[k], "--only") && argc > k + 1)
+      opt.only = arg[++k];
+    else if(!strcmp(arg[k], "--ndjson"))
+      opt.ndjson = TRUE;
+    else if(!strcmp(arg[k], "--core"))
+    {
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      return 1;
+    }
+  }
+
+  if(!opt.kernels && !opt.iops && !opt.collection && !opt.dev && !opt.demosaic) opt.kernels = TRUE;
+  if(opt.iops && IS_NULL_PTR(opt.image))
+  {
+    fprintf(stderr, "[ansel-microbench] `iops' needs --image\n");
+    usage(arg[0]);
+    return 1;
+  }
+  if(opt.num_sizes == 0)
+  {
+    const int sizes[] = { 512, 1024, 2048 };
+    memcpy(opt.sizes, sizes, sizeof(sizes));
+    opt.num_sizes = 3;
+  }
+
+  // Throwaway library, no sidecars: benchmarking must leave no trace on the user's setup.
+  int m_argc = 0;
+  char **m_arg = malloc(sizeof(char *) * (5 + argc - k + 1));
+  if(IS_NULL_PTR(m_arg)) return 1;
+  m_arg[m_argc++] = "ansel-microbench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  if(dt_init(m_argc, m_arg, FALSE, FALSE))
+  {
+    dt_free(m_arg);
+    return 1;
+  }
+
+  const int all_threads = MAX(dt_get_num_openmp_threads(), 1);
+  if(opt.num_threads == 0)
+  {
+    opt.threads[opt.num_threads++] = 1;
+    if(all_threads > 1) opt.threads[opt.num_threads++] = all_threads;
+  }
+
+  double *samples = malloc(sizeof(double) * opt.runs);
+  int res = IS_NULL_PTR(samples);
+  if(!res)
+  {
+    _print_header(&opt);
+    if(opt.kernels) _bench_kernels(&opt, samples);
+    if(opt.iops) res = _bench_iops(&opt, samples);
+    if(opt.collection) _bench_collection(&opt, samples);
+    if(opt.dev) _bench_dev(&opt, samples);
+    if(opt.demosaic) _bench_demosaic(&opt, samples);
+  }
+
+  _set_threads(all_threads);
+  dt_free(samples);
+  dt_cleanup();
+  dt_free(m_arg);
+  return res;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -46,6 +46,7 @@
 #include "caches/pixelpipe_cache.h"
 #include "common/opencl.h"
 #include "pixel/format.h"
+#include "pixel/half_float.h"
 /* For dt_iop_module_t: the cache reads `module->op` to special-case the gamma module
  * and calls `module->name()` for its diagnostics. That is the last edge keeping this
  * file above develop/; taking a name string instead of a module would cut it. */
@@ -54,6 +55,7 @@
 /* Set once by dt_dev_pixelpipe_cache_init(); see the header for why they are not read live. */
 static gboolean _verbose = FALSE;
 static gboolean _verbose_detail = FALSE;
+static gboolean _compact = FALSE;
 
 /* Statement-safe: a bare `if(_verbose) dt_print(...)` swallows a following `else`. */
 #define _cache_print(channel, ...)                    \
@@ -218,6 +220,7 @@ static gboolean _cache_entry_materialize_host_data_locked(dt_pixel_cache_entry_t
                                                           gboolean prefer_device_payload);
 static int dt_dev_pixelpipe_cache_flush_old(dt_dev_pixelpipe_cache_t *cache);
 static int _memory_pressure_shedder(dt_dev_pixelpipe_cache_t *cache);
+static gboolean _cache_entry_expand(dt_dev_pixelpipe_cache_t *cache, dt_pixel_cache_entry_t *entry);
 
 #ifdef HAVE_OPENCL
 static gboolean _cache_entry_clmem_flush_host_pinned_locked(dt_pixel_cache_entry_t *entry, void *host_ptr, int devid);
@@ -344,8 +347,13 @@ gboolean dt_dev_pixelpipe_cache_ref_entry_by_hash(const uint64_t hash,
 
   const gboolean found = !IS_NULL_PTR(cache_entry) && !cache_entry->auto_destroy;
   const size_t found_size = found ? cache_entry->size : 0;
+  const gboolean compacted = found && !IS_NULL_PTR(cache_entry->compact_data);
   dt_pthread_mutex_unlock(&cache->lock);
 
+  // Our reference keeps it from being packed again in-between.
+  if(compacted && _cache_entry_expand(cache, cache_entry) && !IS_NULL_PTR(data))
+    *data = dt_pixel_cache_entry_get_data(cache_entry);
+
   if(found ) _observe_read(hash, found_size);
     
   return found;
@@ -500,6 +508,7 @@ static gboolean _cache_entry_materialize_host_data(dt_dev_pixelpipe_cache_t *cac
                                                    dt_pixel_cache_entry_t *entry)
 {
   if(IS_NULL_PTR(cache) || IS_NULL_PTR(entry)) return FALSE;
+  if(!IS_NULL_PTR(entry->compact_data)) return _cache_entry_expand(cache, entry);
   if(preferred_devid < 0 && dt_pixel_cache_entry_get_data(entry) == NULL) return FALSE;
 
   dt_dev_pixelpipe_cache_wrlock_entry(TRUE, entry);
@@ -759,6 +768,67 @@ int dt_dev_pixel_pipe_cache_remove_lru(void)
   return error;
 }
 
+// find the oldest idle entry that may be packed to half floats
+static void _cache_get_oldest_compactable(gpointer key, gpointer value, gpointer user_data)
+{
+  dt_pixel_cache_entry_t *cache_entry = (dt_pixel_cache_entry_t *)value;
+  _cache_lru_t *lru = (_cache_lru_t *)user_data;
+
+  // Packing frees the upper half of the buffer: an OpenCL image pinned on it,
+  // or still borrowed from it, would lose its memory.
+  if(cache_entry->age >= lru->max_age || cache_entry->compactable == 0 || cache_entry->auto_destroy
+     || IS_NULL_PTR(cache_entry->data) || !IS_NULL_PTR(cache_entry->cl_mem_list)
+     || dt_atomic_get_int(&cache_entry->refcount) > 0)
+    return;
+
+  lru->max_age = cache_entry->age;
+  lru->hash = cache_entry->hash;
+  lru->cache_entry = cache_entry;
+}
+
+// Pack the least recently used compactable entry in place and give the upper half of its
+// buffer back to the arena. Runs before LRU eviction: keeping an output at reduced precision
+// is cheaper than recomputing it.
+// WARNING: not thread-safe, protect its calls with mutex lock
+// return 0 on success, 1 if no entry could be packed
+static int _non_thread_safe_cache_compact_lru(dt_dev_pixelpipe_cache_t *cache)
+{
+  while(TRUE)
+  {
+    _cache_lru_t lru = { .max_age = g_get_monotonic_time(), .hash = 0, .cache_entry = NULL };
+    g_hash_table_foreach(cache->entries, _cache_get_oldest_compactable, &lru);
+    dt_pixel_cache_entry_t *entry = lru.cache_entry;
+    if(IS_NULL_PTR(entry)) return 1;
+
+    // Returns 0 if WE capture the lock: nobody reads or writes it while it changes representation.
+    if(dt_pthread_rwlock_trywrlock(&entry->lock)) return 1;
+
+    const size_t payload = MIN(entry->compactable, entry->size);
+    size_t kept = 0;
+    uint32_t pages = 0;
+    const gboolean worth = dt_cache_arena_calc(&cache->arena, payload / 2, &pages, &kept) && kept < entry->size;
+    const gboolean packed = worth && dt_half_float_pack_in_place(entry->data, payload / sizeof(float));
+
+    if(packed)
+    {
+      dt_cache_arena_free(&cache->arena, (uint8_t *)entry->data + kept, entry->size - kept);
+      cache->current_memory -= entry->size - kept;
+      entry->compact_data = entry->data;
+      entry->compact_size = kept;
+      entry->data = NULL;
+      _pixel_cache_message(entry, "packed to half floats", FALSE);
+    }
+    else
+    {
+      // Out of the half range, or too small to free a page: don't look at it again.
+      entry->compactable = 0;
+    }
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    if(packed) return 0;
+  }
+}
+
 #ifdef HAVE_OPENCL
 static void *_pixel_cache_clmem_get(dt_pixel_cache_entry_t *entry, void *host_ptr, int devid,
                                     int width, int height, int bpp, int flags)
@@ -1857,8 +1927,8 @@ static gboolean _cache_entry_clmem_flush_device(dt_pixel_cache_entry_t *entry, c
 void *dt_pixel_cache_alloc(dt_pixel_cache_entry_t *cache_entry)
 {
   dt_dev_pixelpipe_cache_t *cache = _pixelpipe_cache;
-  // allocate the data buffer
-  if(IS_NULL_PTR(cache_entry->data))
+  // allocate the data buffer, unless the content is packed: only _cache_entry_expand() may replace it
+  if(IS_NULL_PTR(cache_entry->data) && IS_NULL_PTR(cache_entry->compact_data))
   {
     cache_entry->data = _arena_alloc_with_defrag(cache, cache_entry->size, &cache_entry->size);
 
@@ -1891,7 +1961,10 @@ static int _free_space_to_alloc(dt_dev_pixelpipe_cache_t *cache, const size_t si
   // If error, all entries are currently locked or in use, so we cannot free space to allocate a new entry.
   int error = 0;
   while(cache->current_memory + size > cache->max_memory && g_hash_table_size(cache->entries) > 0 && !error)
+  {
+    if(_compact && !_non_thread_safe_cache_compact_lru(cache)) continue;
     error = _non_thread_safe_pixel_pipe_cache_remove_lru(cache);
+  }
 
   if(cache->current_memory + size > cache->max_memory)
   {
@@ -1916,6 +1989,70 @@ static int _free_space_to_alloc(dt_dev_pixelpipe_cache_t *cache, const size_t si
   return error;
 }
 
+/* Unpack a compacted entry back to floats. The caller holds a reference on it, which keeps it
+ * from being packed again or evicted until the caller lets go, and holds neither the cache lock
+ * nor the entry lock. Returns TRUE if the entry has host data: FALSE only when the cache is full. */
+static gboolean _cache_entry_expand(dt_dev_pixelpipe_cache_t *cache, dt_pixel_cache_entry_t *entry)
+{
+  // Wait for it: whoever holds it is unpacking it too, or reading what was just unpacked.
+  // Giving up here would hand the caller a host-less entry it asked to read.
+  dt_pthread_rwlock_wrlock(&entry->lock);
+
+  gboolean ok = !IS_NULL_PTR(entry->data);
+  if(IS_NULL_PTR(entry->compact_data))
+  {
+    dt_pthread_rwlock_unlock(&entry->lock);
+    return ok;
+  }
+
+  // The floats are allocated while the packed pages are still held: charge the whole float
+  // buffer to the budget first, and give the packed pages back once they are unpacked.
+  const size_t size = entry->size;
+  dt_pthread_mutex_lock(&cache->lock);
+  const int error = _free_space_to_alloc(cache, size, entry->hash, entry->name);
+  if(!error) cache->current_memory += size;
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  float *data = error ? NULL : _arena_alloc_with_defrag(cache, size, &entry->size);
+  if(!IS_NULL_PTR(data))
+  {
+    dt_half_float_unpack(data, (const uint16_t *)entry->compact_data, MIN(entry->compactable, size) / sizeof(float));
+    dt_cache_arena_free(&cache->arena, entry->compact_data, entry->compact_size);
+
+    dt_pthread_mutex_lock(&cache->lock);
+    cache->current_memory -= entry->compact_size;
+    dt_pthread_mutex_unlock(&cache->lock);
+
+    entry->data = data;
+    entry->compact_data = NULL;
+    entry->compact_size = 0;
+    ok = TRUE;
+    _pixel_cache_message(entry, "unpacked from half floats", FALSE);
+  }
+  else
+  {
+    if(!error)
+    {
+      dt_pthread_mutex_lock(&cache->lock);
+      cache->current_memory -= size;
+      dt_pthread_mutex_unlock(&cache->lock);
+    }
+    _pixel_cache_message(entry, "cannot unpack: cache full", FALSE);
+  }
+
+  dt_pthread_rwlock_unlock(&entry->lock);
+  return ok;
+}
+
+void dt_dev_pixelpipe_cache_set_compactable(dt_pixel_cache_entry_t *entry, const size_t payload)
+{
+  dt_dev_pixelpipe_cache_t *cache = _pixelpipe_cache;
+  if(IS_NULL_PTR(cache) || IS_NULL_PTR(entry)) return;
+  dt_pthread_mutex_lock(&cache->lock);
+  entry->compactable = _compact ? payload : 0;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
 void *dt_pixelpipe_cache_alloc_align_cache_impl(size_t size, int id,
                                                 const char *name)
 {
@@ -2023,6 +2160,9 @@ static dt_pixel_cache_entry_t *dt_pixel_cache_new_entry(const uint64_t hash, con
   cache_entry->data = NULL;
   cache_entry->cache = cache;
   cache_entry->cl_mem_list = NULL;
+  cache_entry->compactable = 0;
+  cache_entry->compact_data = NULL;
+  cache_entry->compact_size = 0;
   dt_pthread_mutex_init(&cache_entry->cl_mem_lock, NULL);
 
   // Optionally alloc the actual buffer, but still record its size in cache
@@ -2124,8 +2264,17 @@ static void _free_cache_entry(dt_pixel_cache_entry_t *cache_entry)
     dt_dev_pixelpipe_cache_flush_entry_clmem(cache_entry);
   }
 
+  // A packed entry only holds its lower pages, and only accounts for them.
+  size_t accounted = cache_entry->size;
+  if(cache_entry->compact_data && cache)
+  {
+    dt_cache_arena_free(&cache->arena, cache_entry->compact_data, cache_entry->compact_size);
+    accounted = cache_entry->compact_size;
+  }
+  cache_entry->compact_data = NULL;
+
   cache_entry->data = NULL;
-  if(cache) cache->current_memory -= cache_entry->size;
+  if(cache) cache->current_memory -= accounted;
   dt_pthread_rwlock_destroy(&cache_entry->lock);
   dt_pthread_mutex_destroy(&cache_entry->cl_mem_lock);
   dt_free(cache_entry->name);
@@ -2136,10 +2285,11 @@ static int garbage_collection = 0;
 static int pressure_shedding = 0;
 
 gboolean dt_dev_pixelpipe_cache_init(size_t max_memory, const gboolean verbose,
-                                     const gboolean verbose_detail)
+                                     const gboolean verbose_detail, const gboolean compact)
 {
   _verbose = verbose;
   _verbose_detail = verbose_detail;
+  _compact = compact;
   dt_dev_pixelpipe_cache_t *cache = (dt_dev_pixelpipe_cache_t *)malloc(sizeof(dt_dev_pixelpipe_cache_t));
   dt_pthread_mutex_init(&cache->lock, NULL);
   cache->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, dt_free_gpointer, (GDestroyNotify)_free_cache_entry);
@@ -2237,6 +2387,7 @@ static dt_pixel_cache_entry_t *_cache_try_rekey_reuse_locked(dt_dev_pixelpipe_ca
   if(IS_NULL_PTR(cache_entry)) return NULL;
   if(cache_entry->serial != reuse_hint->serial) return NULL;
   if(cache_entry->auto_destroy) return NULL;
+  if(!IS_NULL_PTR(cache_entry->compact_data)) return NULL;
   if(cache_entry->size < size) return NULL;
   if(_non_threadsafe_cache_get_entry(cache, cache->entries, new_hash)) return NULL;
 
@@ -2323,10 +2474,15 @@ int dt_dev_pixelpipe_cache_get(const uint64_t hash,
     cache->hits++;
     cache_entry->hits++;
     _non_thread_safe_cache_ref_count_entry(cache, TRUE, cache_entry);
+    const gboolean compacted = !IS_NULL_PTR(cache_entry->compact_data);
     dt_pthread_mutex_unlock(&cache->lock);
 
+    // Unpacked under our reference, which the caller keeps until it releases the entry.
+    // Still packed afterwards means the cache is full: no allocation below would succeed either.
+    if(compacted) _cache_entry_expand(cache, cache_entry);
+
     // Allocate on demand if requested (e.g. when falling back from vRAM-only buffers).
-    if(alloc && IS_NULL_PTR(cache_entry->data))
+    if(alloc && IS_NULL_PTR(cache_entry->data) && IS_NULL_PTR(cache_entry->compact_data))
     {
       dt_dev_pixelpipe_cache_wrlock_entry(TRUE, cache_entry);
       dt_pixel_cache_alloc(cache_entry);
@@ -2553,6 +2709,16 @@ gboolean dt_dev_pixelpipe_cache_peek(const uint64_t hash, void **data,
     return FALSE;
   }
 
+  /* Packed while idle. Unpacking here would hand out a buffer nobody holds a reference on:
+   * idle again as soon as we return, it could be packed or evicted under the caller. Report
+   * a miss; the caller's dt_dev_pixelpipe_cache_get() unpacks it under its own reference. */
+  if(!IS_NULL_PTR(cache_entry->compact_data))
+  {
+    _trace_exact_hit("packed", hash, cache_entry, NULL, NULL, preferred_devid, FALSE);
+    if(data) *data = NULL;
+    return FALSE;
+  }
+
   if(dt_pixel_cache_entry_get_data(cache_entry) != NULL)
   {
     if(data) *data = dt_pixel_cache_entry_get_data(cache_entry);
@@ -2775,7 +2941,11 @@ void dt_dev_pixelpipe_cache_ref_count_entry(gboolean lock,
   dt_dev_pixelpipe_cache_t *cache = _pixelpipe_cache;
   dt_pthread_mutex_lock(&cache->lock);
   _non_thread_safe_cache_ref_count_entry(cache, lock, cache_entry);
+  const gboolean compacted = lock && cache_entry && !IS_NULL_PTR(cache_entry->compact_data);
   dt_pthread_mutex_unlock(&cache->lock);
+
+  // Whoever takes a reference is about to read it.
+  if(compacted) _cache_entry_expand(cache, cache_entry);
 }
 
 
@@ -3019,7 +3189,7 @@ GArray *dt_dev_pixelpipe_cache_get_entries_stats(void)
     if(IS_NULL_PTR(e)) continue;
     dt_pixel_cache_stats_entry_t s = { 0 };
     s.hash = e->hash;
-    s.size = e->size;
+    s.size = e->compact_data ? e->compact_size : e->size;
     s.refcount = dt_atomic_get_int((dt_atomic_int *)&e->refcount);
     s.hits = e->hits;
     if(e->name) g_strlcpy(s.name, e->name, sizeof(s.name));
@@ -83,14 +83,16 @@ typedef enum dt_dev_pixelpipe_cache_writable_status_t
  * @param verbose whether the cache traces at all (was `-d pipecache`).
  * @param verbose_detail whether it traces in detail (was `-d verbose`). Ignored when
  *        @p verbose is FALSE, matching the old two-level gate.
+ * @param compact whether idle cachelines flagged with dt_dev_pixelpipe_cache_set_compactable()
+ *        are packed to half floats before anything gets evicted (`cache/compact_cachelines`).
  *
- * @details Both flags are read ONCE, here, from the session's debug flags by the orchestrator.
+ * @details The flags are read ONCE, here, from the session's debug flags and config by the orchestrator.
  * The cache does not consult them at runtime: a cache that changes what it does halfway
  * through a session because a global moved is harder to reason about than one told at startup,
  * and it keeps the debug machinery out of a storage module.
  */
 gboolean dt_dev_pixelpipe_cache_init(size_t max_memory, const gboolean verbose,
-                                     const gboolean verbose_detail);
+                                     const gboolean verbose_detail, const gboolean compact);
 
 /** The application-wide pixelpipe cache singleton. DECLARED here because it is this
  * module's object; BOUND by the orchestrator (darktable.c), so this header
@@ -158,6 +160,9 @@ typedef struct dt_pixel_cache_entry_t
   dt_dev_pixelpipe_cache_t *cache; // reference to parent cache object
   GList *cl_mem_list;       // reusable OpenCL pinned buffers tied to this entry
   dt_pthread_mutex_t cl_mem_lock;
+  size_t compactable;       // bytes of float payload that may be packed to half floats while idle, 0 if none
+  void *compact_data;       // the packed payload while `data` is NULL, see dt_dev_pixelpipe_cache_set_compactable()
+  size_t compact_size;      // arena bytes of compact_data
 } dt_pixel_cache_entry_t;
 
 /**
@@ -722,6 +727,23 @@ void dt_dev_pixelpipe_cache_rdlock_entry(gboolean lock,
                                          struct dt_pixel_cache_entry_t *entry);
 
 
+/**
+ * @brief Allow the cache to store this entry at reduced precision while nobody uses it.
+ *
+ * @details When the cache runs out of room and was started with `compact`, the least recently
+ * used idle entries so flagged are packed to half floats (pixel/half_float.h) before any entry
+ * is evicted, and unpacked when they are referenced again: by dt_dev_pixelpipe_cache_ref_entry_by_hash(),
+ * dt_dev_pixelpipe_cache_get(), dt_dev_pixelpipe_cache_ref_count_entry() and
+ * dt_dev_pixelpipe_cache_restore_host_payload(). The unpacked buffer stays valid as long as that
+ * reference is held. dt_dev_pixelpipe_cache_peek() takes no reference: it reports packed
+ * entries as misses. A packed entry reads as host-less (NULL data) until it is unpacked. Entries holding values beyond the half range, or tied to OpenCL buffers, stay as they are.
+ *
+ * Only flag outputs whose consumers tolerate a 2^-11 relative error: not what is displayed or exported.
+ *
+ * @param payload bytes of float data at the start of the buffer, 0 to forbid packing.
+ */
+void dt_dev_pixelpipe_cache_set_compactable(struct dt_pixel_cache_entry_t *entry, const size_t payload);
+
 /**
  * @brief Flag the cache entry as "auto_destroy". This is useful for short-lived/disposable
  * cache entries, that won't be needed in the future. These will be freed out of the typical LRU, aged-based
@@ -288,8 +288,9 @@ int mat3inv(float *const dst, const float *const src);
  * and its cached transforms.
  *
  * @note Idempotent: a second call with an instance already up returns immediately.
- * @warning Called once, by the application, with no threads running. Everything that
- * reads the profile list assumes it stops changing when this returns.
+ * @warning Called once, by the application, on a startup thread of its own while the library
+ * is opened, and joined before anything reads it. Everything that reads the profile list
+ * assumes it stops changing when this returns.
  * @note Debug builds additionally run a selftest proving that the enumeration order this
  * produces still matches the legacy per-entry `*_pos` integers -- if it ever stops
  * matching, every stored combo index in every preset points at the wrong profile.
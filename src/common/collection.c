@@ -179,6 +179,60 @@ int dt_collection_update(const dt_collection_t *collection)
                                       collection->tagid);
 }
 
+dt_collection_diff_t *dt_collection_diff_new(const int32_t *old_ids, const uint32_t old_count,
+                                             const int32_t *new_ids, const uint32_t new_count)
+{
+  dt_collection_diff_t *diff = g_malloc0(sizeof(dt_collection_diff_t));
+  diff->old_count = old_count;
+  diff->new_count = new_count;
+  diff->window = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  diff->inserted = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  diff->removed = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  diff->moved = g_array_new(FALSE, FALSE, sizeof(int32_t));
+
+  // Trim what both orderings share at both ends. For an edit that is nearly everything, and it
+  // is plain integer compares: the hash tables below only ever see the window.
+  const uint32_t shortest = MIN(old_count, new_count);
+  uint32_t head = 0;
+  while(head < shortest && old_ids[head] == new_ids[head]) head++;
+  uint32_t tail = 0;
+  while(tail < shortest - head && old_ids[old_count - 1 - tail] == new_ids[new_count - 1 - tail]) tail++;
+  diff->head = head;
+  diff->tail = tail;
+
+  GHashTable *before = g_hash_table_new(NULL, NULL);
+  GHashTable *after = g_hash_table_new(NULL, NULL);
+  for(uint32_t i = head; i < old_count - tail; i++)
+    g_hash_table_add(before, GINT_TO_POINTER(old_ids[i]));
+
+  for(uint32_t i = head; i < new_count - tail; i++)
+  {
+    const int32_t imgid = new_ids[i];
+    g_array_append_val(diff->window, imgid);
+    g_hash_table_add(after, GINT_TO_POINTER(imgid));
+    g_array_append_val(g_hash_table_contains(before, GINT_TO_POINTER(imgid)) ? diff->moved : diff->inserted,
+                       imgid);
+  }
+
+  for(uint32_t i = head; i < old_count - tail; i++)
+    if(!g_hash_table_contains(after, GINT_TO_POINTER(old_ids[i])))
+      g_array_append_val(diff->removed, old_ids[i]);
+
+  g_hash_table_destroy(before);
+  g_hash_table_destroy(after);
+  return diff;
+}
+
+void dt_collection_diff_free(dt_collection_diff_t *diff)
+{
+  if(IS_NULL_PTR(diff)) return;
+  g_array_free(diff->window, TRUE);
+  g_array_free(diff->inserted, TRUE);
+  g_array_free(diff->removed, TRUE);
+  g_array_free(diff->moved, TRUE);
+  dt_free(diff);
+}
+
 void dt_collection_memory_update()
 {
   // Handle culling mode across re-queryings : re-restrict collection to selection
@@ -841,8 +895,9 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
 
   /* raise signal of collection change, only if this is an original */
   dt_collection_memory_update();
+  dt_collection_diff_t *diff = dt_collection_query_take_diff();
   DT_DEBUG_CONTROL_SIGNAL_RAISE(dt_control_signal_get_global(), DT_SIGNAL_COLLECTION_CHANGED, query_change, changed_property,
-                                list, next);
+                                list, next, diff);
 }
 
 void dt_culling_mode_to_selection()
@@ -1025,7 +1080,7 @@ void dt_collection_notify_imported(const int32_t imgid, const gchar *known_image
   // the query generation and memory.collected_images's row count) is untouched by this path, so
   // it does not rebuild grid content either.
   DT_DEBUG_CONTROL_SIGNAL_RAISE(dt_control_signal_get_global(), DT_SIGNAL_COLLECTION_CHANGED,
-                                DT_COLLECTION_CHANGE_BACKGROUND_SYNC, DT_COLLECTION_PROP_UNDEF, NULL, -1);
+                                DT_COLLECTION_CHANGE_BACKGROUND_SYNC, DT_COLLECTION_PROP_UNDEF, NULL, -1, NULL);
 }
 
 void dt_collection_load_filmroll(dt_collection_t *collection, const int32_t imgid, gboolean open_single_image,
@@ -174,6 +174,39 @@ typedef enum dt_collection_change_t
   DT_COLLECTION_CHANGE_BACKGROUND_SYNC = 4
 } dt_collection_change_t;
 
+/** What changed in `memory.collected_images` since listeners last heard of it, in collection order.
+ *
+ *  The first `head` and the last `tail` images are the same, in the same order, before and after.
+ *  Everything between them is the changed window: `window` lists what fills it now, in order,
+ *  `inserted` and `removed` the images that entered or left the collection, and `moved` the ones
+ *  that were already in the window and stayed in it. A single rating or removal in a sorted
+ *  collection gives a window of a few images, so listeners holding a per-position copy of the
+ *  collection can patch it instead of reading it all again.
+ *
+ *  `same_query` is FALSE when the filters or the sort order changed in between, and the window is
+ *  then left empty: that is a new collection, not an edit of the previous one. `serial` numbers
+ *  the diffs handed out; a listener that did not apply diff `serial - 1` has missed a step and
+ *  must rebuild too. Arrays hold `int32_t` image ids. */
+typedef struct dt_collection_diff_t
+{
+  uint64_t serial;
+  gboolean same_query;
+  uint32_t old_count;
+  uint32_t new_count;
+  uint32_t head;
+  uint32_t tail;
+  GArray *window;
+  GArray *inserted;
+  GArray *removed;
+  GArray *moved;
+} dt_collection_diff_t;
+
+/** Compare two orderings of image ids. Costs one pass over the unchanged head and tail, plus
+ *  hashing the changed window only. `same_query` and `serial` are left to the caller. */
+dt_collection_diff_t *dt_collection_diff_new(const int32_t *old_ids, const uint32_t old_count,
+                                             const int32_t *new_ids, const uint32_t new_count);
+void dt_collection_diff_free(dt_collection_diff_t *diff);
+
 /** One rule of a collection: "images whose <property> <mode> matches <text>".
  *
  *  This is what crosses into the database module. The module turns rules into SQL; reading them
@@ -15,6 +15,7 @@
 
 #include "system/mem_alloc.h"
 #include "common/folder_survey.h"
+#include "common/folder_watch.h"
 #include "control/settings.h"
 #include <glib/gstdio.h>
 #include "common/image_extensions.h"
@@ -31,6 +32,10 @@
 #include "common/logging.h"
 
 #define DT_FOLDER_SURVEY_STATE_FILE "folder-survey-state.ini"
+// Delay between a file system event and the stat that checks the file.
+// A file is imported after two checks see the same size and time, so about
+// twice this after the producer is done writing.
+#define DT_FOLDER_SURVEY_SETTLE_MS 1000
 
 typedef enum dt_folder_survey_file_state_t
 {
@@ -59,19 +64,30 @@ typedef struct dt_folder_survey_job_t
   guint generation;
 } dt_folder_survey_job_t;
 
+typedef struct dt_folder_survey_check_t
+{
+  GHashTable *paths;
+  guint generation;
+} dt_folder_survey_check_t;
+
 typedef struct dt_folder_survey_t
 {
   dt_pthread_mutex_t lock;
   GHashTable *files;
+  // Paths reported by the file system watch, waiting for the next check.
+  GHashTable *dirty;
+  dt_folder_watch_t *watch;
   char *folder;
   char *state_path;
   guint generation;
   guint timer;
   guint immediate_scan;
+  guint settle;
   gboolean initialized;
   gboolean active;
   gboolean baseline_initialized;
   gboolean scan_running;
+  gboolean check_running;
   gboolean shutting_down;
   // TRUE when the previous application session quit while monitoring.
   gboolean was_active_last_session;
@@ -324,11 +340,122 @@ static void _folder_survey_imported(const char *source, const gboolean success,
 }
 
 /**
- * @brief Compare the current directory contents with the prior survey loop.
+ * @brief Compare one observed image with what the survey knew of it.
  *
  * New files are first recorded as pending. An unchanged size and modification
- * time on the following loop proves that the producer has stopped writing
- * before the import job receives the file.
+ * time on the following observation proves that the producer has stopped writing
+ * before the import job receives the file, which is then prepended to `imports`.
+ */
+static void _folder_survey_observe_locked(const char *path, const dt_folder_survey_observation_t *observation,
+                                          GList **imports)
+{
+  dt_folder_survey_entry_t *entry = g_hash_table_lookup(_folder_survey.files, path);
+
+  if(!_folder_survey.baseline_initialized)
+  {
+    entry = calloc(1, sizeof(dt_folder_survey_entry_t));
+    if(IS_NULL_PTR(entry)) return;
+    entry->size = observation->size;
+    entry->mtime = observation->mtime;
+    entry->state = DT_FOLDER_SURVEY_FILE_DONE;
+    g_hash_table_replace(_folder_survey.files, g_strdup(path), entry);
+    return;
+  }
+
+  if(IS_NULL_PTR(entry))
+  {
+    entry = calloc(1, sizeof(dt_folder_survey_entry_t));
+    if(IS_NULL_PTR(entry)) return;
+    entry->size = observation->size;
+    entry->mtime = observation->mtime;
+    entry->state = DT_FOLDER_SURVEY_FILE_PENDING;
+    g_hash_table_replace(_folder_survey.files, g_strdup(path), entry);
+    return;
+  }
+
+  if(entry->state == DT_FOLDER_SURVEY_FILE_DONE)
+  {
+    // A producer may reuse a filename after the previous image was handled.
+    // Treat changed metadata at the same path as a new pending file.
+    if(entry->size != observation->size || entry->mtime != observation->mtime)
+    {
+      entry->size = observation->size;
+      entry->mtime = observation->mtime;
+      entry->stable_scans = 0;
+      entry->state = DT_FOLDER_SURVEY_FILE_PENDING;
+    }
+    return;
+  }
+
+  if(entry->state == DT_FOLDER_SURVEY_FILE_QUEUED) return;
+
+  if(entry->size != observation->size || entry->mtime != observation->mtime)
+  {
+    entry->size = observation->size;
+    entry->mtime = observation->mtime;
+    entry->stable_scans = 0;
+    return;
+  }
+
+  entry->stable_scans++;
+  if(entry->stable_scans >= 1)
+  {
+    entry->state = DT_FOLDER_SURVEY_FILE_QUEUED;
+    *imports = g_list_prepend(*imports, g_strdup(path));
+  }
+}
+
+/**
+ * @brief Hand the images found stable to the import job. Takes ownership of `imports`.
+ */
+static int _folder_survey_import(GList *imports, const guint generation)
+{
+  if(IS_NULL_PTR(imports)) return 0;
+
+  imports = g_list_sort(imports, (GCompareFunc)g_strcmp0);
+  const int elements = g_list_length(imports);
+  dt_control_log(ngettext("Folder survey found %d new image to import.",
+                          "Folder survey found %d new images to import.", elements),
+                 elements);
+
+  char *date = dt_conf_get_string("studio_capture/datetime");
+  if(IS_NULL_PTR(date) || date[0] == '\0')
+  {
+    dt_free(date);
+    GDateTime *now = g_date_time_new_now_local();
+    date = g_date_time_format(now, "%F");
+    g_date_time_unref(now);
+  }
+
+  dt_control_import_t data
+      = { .imgs = imports,
+          .datetime = dt_string_to_datetime(date),
+          .copy = dt_conf_get_bool("studio_capture/copy"),
+          .delete_source = dt_conf_get_bool("studio_capture/delete_source"),
+          .folder_survey = TRUE,
+          .on_conflict = CLAMP(dt_conf_get_int("studio_capture/on_conflict"), DT_IMPORT_ONCONFLICT_SKIP,
+                               DT_IMPORT_ONCONFLICT_UNIQUE),
+          .styles = _folder_survey_styles_for_import(),
+          .jobcode = dt_conf_get_string("studio_capture/jobcode"),
+          .base_folder = dt_conf_get_string("studio_capture/base_directory_pattern"),
+          .target_subfolder_pattern = dt_conf_get_string("studio_capture/sub_directory_pattern"),
+          .target_file_pattern = dt_conf_get_string("studio_capture/filename_pattern"),
+          .target_dir = NULL,
+          .elements = elements,
+          .discarded = NULL,
+          .file_imported = _folder_survey_imported,
+          .callback_data = GUINT_TO_POINTER(generation),
+          .callback_data_free = NULL };
+  dt_free(date);
+  return dt_control_import(data) ? 1 : 0;
+}
+
+/**
+ * @brief Compare the current directory contents with the prior survey loop.
+ *
+ * When the file system watch runs, this is only the reconciliation pass that
+ * catches what events missed (queue overflow, unwatched subdirectory, files
+ * changed while the application was closed).
  */
 static int32_t _folder_survey_job_run(dt_job_t *job)
 {
@@ -365,110 +492,14 @@ static int32_t _folder_survey_job_run(dt_job_t *job)
   g_hash_table_iter_init(&observed_iter, observed);
   // Compare each current image with its last size, timestamp, and import state.
   while(g_hash_table_iter_next(&observed_iter, &observed_path, &observed_value))
-  {
-    const dt_folder_survey_observation_t *observation = observed_value;
-    dt_folder_survey_entry_t *entry = g_hash_table_lookup(_folder_survey.files, observed_path);
-
-    if(!_folder_survey.baseline_initialized)
-    {
-      entry = calloc(1, sizeof(dt_folder_survey_entry_t));
-      if(IS_NULL_PTR(entry)) continue;
-      entry->size = observation->size;
-      entry->mtime = observation->mtime;
-      entry->state = DT_FOLDER_SURVEY_FILE_DONE;
-      g_hash_table_replace(_folder_survey.files, g_strdup(observed_path), entry);
-      continue;
-    }
-
-    if(IS_NULL_PTR(entry))
-    {
-      entry = calloc(1, sizeof(dt_folder_survey_entry_t));
-      if(IS_NULL_PTR(entry)) continue;
-      entry->size = observation->size;
-      entry->mtime = observation->mtime;
-      entry->state = DT_FOLDER_SURVEY_FILE_PENDING;
-      g_hash_table_replace(_folder_survey.files, g_strdup(observed_path), entry);
-      continue;
-    }
-
-    if(entry->state == DT_FOLDER_SURVEY_FILE_DONE)
-    {
-      // A producer may reuse a filename after the previous image was handled.
-      // Treat changed metadata at the same path as a new pending file.
-      if(entry->size != observation->size || entry->mtime != observation->mtime)
-      {
-        entry->size = observation->size;
-        entry->mtime = observation->mtime;
-        entry->stable_scans = 0;
-        entry->state = DT_FOLDER_SURVEY_FILE_PENDING;
-      }
-      continue;
-    }
-
-    if(entry->state == DT_FOLDER_SURVEY_FILE_QUEUED) continue;
-
-    if(entry->size != observation->size || entry->mtime != observation->mtime)
-    {
-      entry->size = observation->size;
-      entry->mtime = observation->mtime;
-      entry->stable_scans = 0;
-      continue;
-    }
-
-    entry->stable_scans++;
-    if(entry->stable_scans >= 1)
-    {
-      entry->state = DT_FOLDER_SURVEY_FILE_QUEUED;
-      imports = g_list_prepend(imports, g_strdup(observed_path));
-    }
-  }
+    _folder_survey_observe_locked(observed_path, observed_value, &imports);
 
   _folder_survey.baseline_initialized = TRUE;
   _folder_survey_save_locked();
   dt_pthread_mutex_unlock(&_folder_survey.lock);
   g_hash_table_destroy(observed);
 
-  if(!IS_NULL_PTR(imports))
-  {
-    imports = g_list_sort(imports, (GCompareFunc)g_strcmp0);
-    const int elements = g_list_length(imports);
-    dt_control_log(ngettext("Folder survey found %d new image to import.",
-                            "Folder survey found %d new images to import.", elements),
-                   elements);
-
-    char *date = dt_conf_get_string("studio_capture/datetime");
-    if(IS_NULL_PTR(date) || date[0] == '\0')
-    {
-      dt_free(date);
-      GDateTime *now = g_date_time_new_now_local();
-      date = g_date_time_format(now, "%F");
-      g_date_time_unref(now);
-    }
-
-    dt_control_import_t data
-        = { .imgs = imports,
-            .datetime = dt_string_to_datetime(date),
-            .copy = dt_conf_get_bool("studio_capture/copy"),
-            .delete_source = dt_conf_get_bool("studio_capture/delete_source"),
-            .folder_survey = TRUE,
-            .on_conflict = CLAMP(dt_conf_get_int("studio_capture/on_conflict"), DT_IMPORT_ONCONFLICT_SKIP,
-                                 DT_IMPORT_ONCONFLICT_UNIQUE),
-            .styles = _folder_survey_styles_for_import(),
-            .jobcode = dt_conf_get_string("studio_capture/jobcode"),
-            .base_folder = dt_conf_get_string("studio_capture/base_directory_pattern"),
-            .target_subfolder_pattern = dt_conf_get_string("studio_capture/sub_directory_pattern"),
-            .target_file_pattern = dt_conf_get_string("studio_capture/filename_pattern"),
-            .target_dir = NULL,
-            .elements = elements,
-            .discarded = NULL,
-            .file_imported = _folder_survey_imported,
-            .callback_data = GUINT_TO_POINTER(params->generation),
-            .callback_data_free = NULL };
-    dt_free(date);
-    if(dt_control_import(data)) return 1;
-  }
-
-  return 0;
+  return _folder_survey_import(imports, params->generation);
 }
 
 /**
@@ -547,11 +578,188 @@ static gboolean _folder_survey_scan_once(gpointer user_data)
   return G_SOURCE_REMOVE;
 }
 
+static gboolean _folder_survey_arm_check_idle(gpointer user_data);
+
+/**
+ * @brief Stat the paths the watch reported and compare them as a scan would.
+ *
+ * Only the reported paths are looked at, not the tree. Those still pending
+ * go back to the dirty set, to be checked again once they had time to settle.
+ */
+static int32_t _folder_survey_check_run(dt_job_t *job)
+{
+  dt_folder_survey_check_t *params = dt_control_job_get_params(job);
+  GHashTable *observed = g_hash_table_new_full(g_str_hash, g_str_equal, dt_free_gpointer, dt_free_gpointer);
+
+  GHashTableIter iter;
+  gpointer path = NULL;
+  g_hash_table_iter_init(&iter, params->paths);
+  while(g_hash_table_iter_next(&iter, &path, NULL))
+  {
+    GFile *file = g_file_new_for_path((const char *)path);
+    GFileInfo *info = g_file_query_info(file,
+                                        G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_SIZE
+                                                                       "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_object_unref(file);
+    if(IS_NULL_PTR(info)) continue;
+
+    dt_folder_survey_observation_t *observation
+        = g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR ? malloc(sizeof(dt_folder_survey_observation_t))
+                                                                 : NULL;
+    if(!IS_NULL_PTR(observation))
+    {
+      observation->size = g_file_info_get_size(info);
+      observation->mtime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+      g_hash_table_replace(observed, g_strdup(path), observation);
+    }
+    g_object_unref(info);
+  }
+
+  GList *imports = NULL;
+  dt_pthread_mutex_lock(&_folder_survey.lock);
+  // Without a baseline, the first scan decides what is already there.
+  if(_folder_survey.shutting_down || !_folder_survey.active || !_folder_survey.baseline_initialized
+     || params->generation != _folder_survey.generation)
+  {
+    dt_pthread_mutex_unlock(&_folder_survey.lock);
+    g_hash_table_destroy(observed);
+    return 0;
+  }
+
+  g_hash_table_iter_init(&iter, params->paths);
+  while(g_hash_table_iter_next(&iter, &path, NULL))
+  {
+    const dt_folder_survey_observation_t *observation = g_hash_table_lookup(observed, path);
+    if(IS_NULL_PTR(observation))
+    {
+      g_hash_table_remove(_folder_survey.files, path);
+      continue;
+    }
+
+    _folder_survey_observe_locked(path, observation, &imports);
+    const dt_folder_survey_entry_t *entry = g_hash_table_lookup(_folder_survey.files, path);
+    if(!IS_NULL_PTR(entry) && entry->state == DT_FOLDER_SURVEY_FILE_PENDING)
+      g_hash_table_add(_folder_survey.dirty, g_strdup(path));
+  }
+  const gboolean recheck = g_hash_table_size(_folder_survey.dirty) > 0;
+  _folder_survey_save_locked();
+  dt_pthread_mutex_unlock(&_folder_survey.lock);
+  g_hash_table_destroy(observed);
+
+  if(recheck) g_idle_add(_folder_survey_arm_check_idle, NULL);
+  return _folder_survey_import(imports, params->generation);
+}
+
+static void _folder_survey_check_cleanup(void *data)
+{
+  dt_folder_survey_check_t *params = (dt_folder_survey_check_t *)data;
+  g_hash_table_destroy(params->paths);
+  dt_free(params);
+
+  if(!_folder_survey.initialized) return;
+  dt_pthread_mutex_lock(&_folder_survey.lock);
+  _folder_survey.check_running = FALSE;
+  dt_pthread_mutex_unlock(&_folder_survey.lock);
+}
+
+/**
+ * @brief Queue one check of the dirty paths, once they had time to settle.
+ */
+static gboolean _folder_survey_check(gpointer user_data)
+{
+  dt_pthread_mutex_lock(&_folder_survey.lock);
+  // The previous check is still running: try again later rather than stat twice.
+  if(_folder_survey.check_running)
+  {
+    dt_pthread_mutex_unlock(&_folder_survey.lock);
+    return G_SOURCE_CONTINUE;
+  }
+  _folder_survey.settle = 0;
+  if(_folder_survey.shutting_down || !_folder_survey.active || g_hash_table_size(_folder_survey.dirty) == 0)
+  {
+    dt_pthread_mutex_unlock(&_folder_survey.lock);
+    return G_SOURCE_REMOVE;
+  }
+
+  dt_folder_survey_check_t *params = malloc(sizeof(dt_folder_survey_check_t));
+  if(IS_NULL_PTR(params))
+  {
+    dt_pthread_mutex_unlock(&_folder_survey.lock);
+    return G_SOURCE_REMOVE;
+  }
+  params->paths = _folder_survey.dirty;
+  params->generation = _folder_survey.generation;
+  _folder_survey.dirty = g_hash_table_new_full(g_str_hash, g_str_equal, dt_free_gpointer, NULL);
+  _folder_survey.check_running = TRUE;
+  dt_pthread_mutex_unlock(&_folder_survey.lock);
+
+  dt_job_t *job = dt_control_job_create(_folder_survey_check_run, "folder survey check");
+  if(IS_NULL_PTR(job))
+  {
+    _folder_survey_check_cleanup(params);
+    return G_SOURCE_REMOVE;
+  }
+  dt_control_job_set_params(job, params, _folder_survey_check_cleanup);
+  dt_control_add_job(dt_control_get_global(), DT_JOB_QUEUE_SYSTEM_BG, job);
+  return G_SOURCE_REMOVE;
+}
+
+static void _folder_survey_arm_check()
+{
+  if(_folder_survey.settle == 0 && !IS_NULL_PTR(_folder_survey.watch))
+    _folder_survey.settle = g_timeout_add(DT_FOLDER_SURVEY_SETTLE_MS, _folder_survey_check, NULL);
+}
+
+static gboolean _folder_survey_arm_check_idle(gpointer user_data)
+{
+  if(_folder_survey.initialized) _folder_survey_arm_check();
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief File system watch callback: remember the image path for the next check.
+ */
+static void _folder_survey_changed(const char *path, const gboolean removed, gpointer user_data)
+{
+  if(!dt_supported_image(path)) return;
+
+  dt_pthread_mutex_lock(&_folder_survey.lock);
+  const gboolean active = _folder_survey.active && !_folder_survey.shutting_down;
+  if(active) g_hash_table_add(_folder_survey.dirty, g_strdup(path));
+  dt_pthread_mutex_unlock(&_folder_survey.lock);
+
+  if(active) _folder_survey_arm_check();
+}
+
+/**
+ * @brief Stop the file system watch and drop the events not checked yet.
+ */
+static void _folder_survey_unwatch()
+{
+  dt_folder_watch_free(_folder_survey.watch);
+  _folder_survey.watch = NULL;
+  if(_folder_survey.settle > 0)
+  {
+    g_source_remove(_folder_survey.settle);
+    _folder_survey.settle = 0;
+  }
+
+  dt_pthread_mutex_lock(&_folder_survey.lock);
+  g_hash_table_remove_all(_folder_survey.dirty);
+  dt_pthread_mutex_unlock(&_folder_survey.lock);
+}
+
 /**
  * @brief Recreate the periodic source after a frequency or state change.
+ *
+ * New images are found from file system events when the whole tree could be
+ * watched. The periodic walk then only runs at the slower reconciliation
+ * interval, to catch whatever events missed.
  */
 static void _folder_survey_reschedule()
 {
+  _folder_survey_unwatch();
   if(_folder_survey.timer > 0)
   {
     g_source_remove(_folder_survey.timer);
@@ -567,7 +775,15 @@ static void _folder_survey_reschedule()
   dt_pthread_mutex_unlock(&_folder_survey.lock);
   if(!active) return;
 
-  const int interval = CLAMP(dt_conf_get_int("studio_capture/interval"), 2, 3600);
+  int interval = CLAMP(dt_conf_get_int("studio_capture/interval"), 2, 3600);
+  if(dt_conf_get_bool("studio_capture/watch"))
+  {
+    char *folder = dt_conf_get_string("studio_capture/folder");
+    _folder_survey.watch = dt_folder_watch_new(folder, _folder_survey_changed, NULL);
+    dt_free(folder);
+    if(dt_folder_watch_is_complete(_folder_survey.watch))
+      interval = MAX(interval, CLAMP(dt_conf_get_int("studio_capture/reconcile_interval"), 10, 3600));
+  }
   _folder_survey.timer = g_timeout_add_seconds(interval, _folder_survey_scan, NULL);
   _folder_survey.immediate_scan = g_idle_add(_folder_survey_scan_once, NULL);
 }
@@ -580,6 +796,7 @@ static void _folder_survey_reschedule()
  */
 static void _folder_survey_deactivate()
 {
+  _folder_survey_unwatch();
   if(_folder_survey.timer > 0)
   {
     g_source_remove(_folder_survey.timer);
@@ -772,6 +989,7 @@ void dt_folder_survey_init()
 
   dt_pthread_mutex_init(&_folder_survey.lock, NULL);
   _folder_survey.files = g_hash_table_new_full(g_str_hash, g_str_equal, dt_free_gpointer, dt_free_gpointer);
+  _folder_survey.dirty = g_hash_table_new_full(g_str_hash, g_str_equal, dt_free_gpointer, NULL);
   char config_dir[PATH_MAX] = { 0 };
   dt_loc_get_user_config_dir(config_dir, sizeof(config_dir));
   _folder_survey.state_path = g_build_filename(config_dir, DT_FOLDER_SURVEY_STATE_FILE, NULL);
@@ -1050,6 +1268,8 @@ void dt_folder_survey_cleanup()
 
   g_hash_table_destroy(_folder_survey.files);
   _folder_survey.files = NULL;
+  g_hash_table_destroy(_folder_survey.dirty);
+  _folder_survey.dirty = NULL;
   dt_free(_folder_survey.folder);
   dt_free(_folder_survey.state_path);
   dt_pthread_mutex_destroy(&_folder_survey.lock);
@@ -1060,6 +1280,7 @@ void dt_folder_survey_stop()
 {
   if(!_folder_survey.initialized || _folder_survey.shutting_down) return;
 
+  _folder_survey_unwatch();
   if(_folder_survey.timer > 0)
   {
     g_source_remove(_folder_survey.timer);
@@ -0,0 +1,241 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Guillaume STUTIN.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+*/
+
+#include "common/folder_watch.h"
+#include "system/mem_alloc.h"
+#include "common/logging.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+struct dt_folder_watch_t
+{
+  GHashTable *monitors; // canonical directory path -> GFileMonitor
+  dt_folder_watch_callback_t callback;
+  gpointer user_data;
+  gboolean complete;
+};
+
+static void _folder_watch_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                                  GFileMonitorEvent event, gpointer user_data);
+
+static char *_folder_watch_path(GFile *file)
+{
+  char *path = g_file_get_path(file);
+  if(IS_NULL_PTR(path)) return NULL;
+  char *canonical_path = g_canonicalize_filename(path, NULL);
+  dt_free(path);
+  return canonical_path;
+}
+
+static void _folder_watch_release(gpointer data)
+{
+  GFileMonitor *monitor = G_FILE_MONITOR(data);
+  g_signal_handlers_disconnect_matched(monitor, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+                                       (gpointer)_folder_watch_changed, NULL);
+  g_file_monitor_cancel(monitor);
+  g_object_unref(monitor);
+}
+
+static gboolean _folder_watch_monitor(dt_folder_watch_t *watch, GFile *directory, const char *path)
+{
+  if(g_hash_table_contains(watch->monitors, path)) return TRUE;
+
+  GError *error = NULL;
+  GFileMonitor *monitor = g_file_monitor_directory(directory, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+  if(IS_NULL_PTR(monitor))
+  {
+    dt_print(DT_DEBUG_CONTROL, "[folder watch] can't monitor %s: %s\n", path,
+             error ? error->message : "unknown error");
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  g_signal_connect(monitor, "changed", G_CALLBACK(_folder_watch_changed), watch);
+  g_hash_table_replace(watch->monitors, g_strdup(path), monitor);
+  return TRUE;
+}
+
+/**
+ * @brief Monitor `directory` and every directory below it.
+ *
+ * When the directory appeared after the watch started, the files it already
+ * holds were written before anyone listened: report them as new.
+ */
+static gboolean _folder_watch_add_tree(dt_folder_watch_t *watch, GFile *directory, const gboolean report_files)
+{
+  GQueue folders = G_QUEUE_INIT;
+  g_queue_push_tail(&folders, g_object_ref(directory));
+  gboolean root_ok = TRUE;
+  gboolean first = TRUE;
+
+  while(!g_queue_is_empty(&folders))
+  {
+    GFile *current = g_queue_pop_head(&folders);
+    char *path = _folder_watch_path(current);
+    const gboolean monitored = !IS_NULL_PTR(path) && _folder_watch_monitor(watch, current, path);
+    if(!monitored)
+    {
+      watch->complete = FALSE;
+      if(first) root_ok = FALSE;
+    }
+    first = FALSE;
+    dt_free(path);
+
+    GFileEnumerator *enumerator
+        = monitored ? g_file_enumerate_children(current, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL)
+                    : NULL;
+    g_object_unref(current);
+    if(IS_NULL_PTR(enumerator)) continue;
+
+    GFileInfo *info = NULL;
+    GFile *child = NULL;
+    while(g_file_enumerator_iterate(enumerator, &info, &child, NULL, NULL))
+    {
+      if(IS_NULL_PTR(info) || IS_NULL_PTR(child)) break;
+
+      const GFileType type = g_file_info_get_file_type(info);
+      if(type == G_FILE_TYPE_DIRECTORY)
+        g_queue_push_tail(&folders, g_object_ref(child));
+      else if(type == G_FILE_TYPE_REGULAR && report_files)
+      {
+        char *file_path = _folder_watch_path(child);
+        if(!IS_NULL_PTR(file_path)) watch->callback(file_path, FALSE, watch->user_data);
+        dt_free(file_path);
+      }
+    }
+    g_object_unref(enumerator);
+  }
+
+  return root_ok;
+}
+
+/**
+ * @brief Drop the monitors of a directory gone from the tree, and of everything below it.
+ */
+static void _folder_watch_remove_tree(dt_folder_watch_t *watch, const char *path)
+{
+  if(!g_hash_table_remove(watch->monitors, path)) return;
+
+  char *prefix = g_strconcat(path, G_DIR_SEPARATOR_S, NULL);
+  GHashTableIter iter;
+  gpointer key = NULL;
+  g_hash_table_iter_init(&iter, watch->monitors);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+    if(g_str_has_prefix((const char *)key, prefix)) g_hash_table_iter_remove(&iter);
+  dt_free(prefix);
+}
+
+static void _folder_watch_appeared(dt_folder_watch_t *watch, GFile *file)
+{
+  if(g_file_query_file_type(file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) == G_FILE_TYPE_DIRECTORY)
+  {
+    _folder_watch_add_tree(watch, file, TRUE);
+    return;
+  }
+
+  char *path = _folder_watch_path(file);
+  if(!IS_NULL_PTR(path)) watch->callback(path, FALSE, watch->user_data);
+  dt_free(path);
+}
+
+static void _folder_watch_vanished(dt_folder_watch_t *watch, GFile *file)
+{
+  char *path = _folder_watch_path(file);
+  if(IS_NULL_PTR(path)) return;
+
+  // A directory can't be queried any more once it is gone: our own table says what it was.
+  if(g_hash_table_contains(watch->monitors, path))
+    _folder_watch_remove_tree(watch, path);
+  else
+    watch->callback(path, TRUE, watch->user_data);
+  dt_free(path);
+}
+
+static void _folder_watch_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                                  GFileMonitorEvent event, gpointer user_data)
+{
+  dt_folder_watch_t *watch = (dt_folder_watch_t *)user_data;
+
+  switch(event)
+  {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      _folder_watch_appeared(watch, file);
+      break;
+
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+    {
+      char *path = _folder_watch_path(file);
+      if(!IS_NULL_PTR(path) && !g_hash_table_contains(watch->monitors, path))
+        watch->callback(path, FALSE, watch->user_data);
+      dt_free(path);
+      break;
+    }
+
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+      _folder_watch_vanished(watch, file);
+      break;
+
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      _folder_watch_vanished(watch, file);
+      if(!IS_NULL_PTR(other_file)) _folder_watch_appeared(watch, other_file);
+      break;
+
+    default:
+      // PRE_UNMOUNT, UNMOUNTED, MOVED (not emitted with G_FILE_MONITOR_WATCH_MOVES)
+      break;
+  }
+}
+
+dt_folder_watch_t *dt_folder_watch_new(const char *root, dt_folder_watch_callback_t callback, gpointer user_data)
+{
+  if(IS_NULL_PTR(root) || root[0] == '\0' || IS_NULL_PTR(callback)) return NULL;
+
+  dt_folder_watch_t *watch = calloc(1, sizeof(dt_folder_watch_t));
+  if(IS_NULL_PTR(watch)) return NULL;
+
+  watch->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, dt_free_gpointer, _folder_watch_release);
+  watch->callback = callback;
+  watch->user_data = user_data;
+  watch->complete = TRUE;
+
+  GFile *directory = g_file_new_for_path(root);
+  const gboolean root_ok = _folder_watch_add_tree(watch, directory, FALSE);
+  g_object_unref(directory);
+
+  if(!root_ok)
+  {
+    dt_folder_watch_free(watch);
+    return NULL;
+  }
+  return watch;
+}
+
+gboolean dt_folder_watch_is_complete(const dt_folder_watch_t *watch)
+{
+  return !IS_NULL_PTR(watch) && watch->complete;
+}
+
+void dt_folder_watch_free(dt_folder_watch_t *watch)
+{
+  if(IS_NULL_PTR(watch)) return;
+  g_hash_table_destroy(watch->monitors);
+  free(watch);
+}
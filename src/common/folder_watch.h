@@ -0,0 +1,69 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Guillaume STUTIN.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+*/
+
+#ifndef DT_COMMON_FOLDER_WATCH_H
+#define DT_COMMON_FOLDER_WATCH_H
+
+#include <glib.h>
+
+/**
+ * @file folder_watch.h
+ * @brief Recursive file system notifications for one directory tree.
+ *
+ * GFileMonitor (inotify on Linux) watches one directory, not a tree. This keeps
+ * one monitor per directory below a root, follows directories created or moved
+ * in after the watch started, and reports the files they already contain,
+ * since those may land before their directory's monitor exists.
+ *
+ * It only tells that a path changed. What changed, and whether it is finished,
+ * is for the caller to find out, with a stat or a scan: events are hints, they
+ * can be coalesced or dropped when the kernel queue overflows.
+ */
+
+typedef struct dt_folder_watch_t dt_folder_watch_t;
+
+/**
+ * @brief Called for each file created, modified, moved in or out, or removed.
+ *
+ * @param path canonical path of the file (see g_canonicalize_filename()).
+ * @param removed TRUE when the file was deleted or moved out of the tree.
+ * @param user_data as given to dt_folder_watch_new().
+ */
+typedef void (*dt_folder_watch_callback_t)(const char *path, const gboolean removed, gpointer user_data);
+
+/**
+ * @brief Start watching `root` and all its subdirectories.
+ *
+ * Directories are listed on the calling thread, and the callback runs from the
+ * thread-default main context of the calling thread, so call this from the
+ * thread that runs that context, normally the GUI thread.
+ *
+ * @return the watch, or NULL if `root` itself cannot be monitored.
+ */
+dt_folder_watch_t *dt_folder_watch_new(const char *root, dt_folder_watch_callback_t callback, gpointer user_data);
+
+/**
+ * @brief FALSE when some subdirectory could not be monitored (inotify watch
+ * limit, permissions...), so changes below it go unnoticed until a full scan.
+ */
+gboolean dt_folder_watch_is_complete(const dt_folder_watch_t *watch);
+
+/**
+ * @brief Stop watching. NULL-safe. No callback runs after this returns.
+ */
+void dt_folder_watch_free(dt_folder_watch_t *watch);
+
+#endif // DT_COMMON_FOLDER_WATCH_H
+
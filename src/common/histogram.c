@@ -44,23 +44,76 @@
 
 //------------------------------------------------------------------------------
 
+/* Bin the 3 channels of a pixel, once scaled to bin units. The scaling and clamping run on
+ * the 4 lanes at once; fmaxf() also sends NaN to bin 0 where a plain CLAMP would not. */
+inline static void _bin_scaled_pixel(const dt_aligned_pixel_simd_t scaled, const float max,
+                                     uint32_t *histogram)
+{
+  int32_t index[4];
+  for_four_channels(c) index[c] = (int32_t)fminf(fmaxf(scaled[c], 0.f), max);
+  histogram[4 * index[0]]++;
+  histogram[4 * index[1] + 1]++;
+  histogram[4 * index[2] + 2]++;
+}
+
+typedef void (*_pixel_binner_t)(const dt_dev_histogram_collection_params_t *const histogram_params,
+                                const float *pixel, uint32_t *histogram,
+                                const dt_iop_order_iccprofile_info_t *const profile_info);
+
+/* Where the sample of cell `cell` in strip `strip` lands, FALSE if that is outside the ROI. */
+inline static gboolean _sample_position(const dt_dev_histogram_collection_params_t *const histogram_params,
+                                        const size_t strip, const size_t cell, size_t *x, size_t *y)
+{
+  const dt_histogram_roi_t *roi = histogram_params->roi;
+  dt_histogram_sample_position(strip, cell, histogram_params->sample_step, x, y);
+  *x += roi->crop_x;
+  *y += roi->crop_y;
+  return *x < (size_t)(roi->width - roi->crop_width) && *y < (size_t)(roi->height - roi->crop_height);
+}
+
+/* Row loop shared by the float workers. Always inlined with a constant `binner`, so each worker
+ * still compiles to a straight loop around its own pixel code. */
+inline static __attribute__((always_inline)) void
+_bin_row(const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel,
+         uint32_t *histogram, const int j, const size_t channels,
+         const dt_iop_order_iccprofile_info_t *const profile_info, const _pixel_binner_t binner)
+{
+  const dt_histogram_roi_t *roi = histogram_params->roi;
+  const size_t columns = roi->width - roi->crop_width - roi->crop_x;
+
+  if(histogram_params->sample_step > 1)
+  {
+    const size_t cells = (columns + histogram_params->sample_step - 1) / histogram_params->sample_step;
+    for(size_t k = 0; k < cells; k++)
+    {
+      size_t x, y;
+      if(_sample_position(histogram_params, j, k, &x, &y))
+        binner(histogram_params, pixel + channels * (y * roi->width + x), histogram, profile_info);
+    }
+    return;
+  }
+
+  const float *in = pixel + channels * ((size_t)roi->width * j + roi->crop_x);
+  for(size_t i = 0; i < columns; i++, in += channels)
+    binner(histogram_params, in, histogram, profile_info);
+}
+
+//------------------------------------------------------------------------------
+
 inline static void histogram_helper_cs_RAW_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
+    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
+    const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const uint32_t i = PS(*pixel, histogram_params);
-  histogram[4 * i]++;
+  const float value = fminf(fmaxf(S(*pixel, histogram_params), 0.f), histogram_params->bins_count - 1);
+  histogram[4 * (uint32_t)value]++;
 }
 
 inline static void histogram_helper_cs_RAW(const dt_dev_histogram_collection_params_t *const histogram_params,
                                            const void *pixel, uint32_t *histogram, int j,
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  const float *input = (float *)pixel + roi->width * j + roi->crop_x;
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, input++)
-  {
-    histogram_helper_cs_RAW_helper_process_pixel_float(histogram_params, input, histogram);
-  }
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 1, profile_info,
+           histogram_helper_cs_RAW_helper_process_pixel_float);
 }
 
 //------------------------------------------------------------------------------
@@ -78,6 +131,21 @@ inline void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_
                                               const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+
+  if(histogram_params->sample_step > 1)
+  {
+    const size_t columns = roi->width - roi->crop_width - roi->crop_x;
+    const size_t cells = (columns + histogram_params->sample_step - 1) / histogram_params->sample_step;
+    for(size_t k = 0; k < cells; k++)
+    {
+      size_t x, y;
+      if(_sample_position(histogram_params, j, k, &x, &y))
+        histogram_helper_cs_RAW_helper_process_pixel_uint16(
+            histogram_params, (const uint16_t *)pixel + y * roi->width + x, histogram);
+    }
+    return;
+  }
+
   uint16_t *in = (uint16_t *)pixel + roi->width * j + roi->crop_x;
 
   // process pixels
@@ -87,182 +155,212 @@ inline void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_
 
 //------------------------------------------------------------------------------
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_rgb_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
+inline static void histogram_helper_cs_rgb_helper_process_pixel_float(
+    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
+    const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const uint32_t R = PS(pixel[0], histogram_params);
-  const uint32_t G = PS(pixel[1], histogram_params);
-  const uint32_t B = PS(pixel[2], histogram_params);
-  histogram[4 * R]++;
-  histogram[4 * G + 1]++;
-  histogram[4 * B + 2]++;
+  _bin_scaled_pixel(dt_load_simd_aligned(pixel) * histogram_params->mul, histogram_params->bins_count - 1,
+                    histogram);
 }
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_rgb_helper_process_pixel_float_compensated(
+inline static void histogram_helper_cs_rgb_helper_process_pixel_float_compensated(
     const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
     const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_aligned_pixel_t rgb = { dt_ioppr_compensate_middle_grey(pixel[0], profile_info),
-                                   dt_ioppr_compensate_middle_grey(pixel[1], profile_info),
-                                   dt_ioppr_compensate_middle_grey(pixel[2], profile_info) };
-  const uint32_t R = PS(rgb[0], histogram_params);
-  const uint32_t G = PS(rgb[1], histogram_params);
-  const uint32_t B = PS(rgb[2], histogram_params);
-  histogram[4 * R]++;
-  histogram[4 * G + 1]++;
-  histogram[4 * B + 2]++;
+  const dt_aligned_pixel_simd_t rgb = { dt_ioppr_compensate_middle_grey(pixel[0], profile_info),
+                                        dt_ioppr_compensate_middle_grey(pixel[1], profile_info),
+                                        dt_ioppr_compensate_middle_grey(pixel[2], profile_info), 0.f };
+  _bin_scaled_pixel(rgb * histogram_params->mul, histogram_params->bins_count - 1, histogram);
 }
 
 inline static void histogram_helper_cs_rgb(const dt_dev_histogram_collection_params_t *const histogram_params,
                                            const void *pixel, uint32_t *histogram, int j,
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
-
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
-  {
-    histogram_helper_cs_rgb_helper_process_pixel_float(histogram_params, in, histogram);
-  }
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 4, profile_info,
+           histogram_helper_cs_rgb_helper_process_pixel_float);
 }
 
 inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_collection_params_t *const histogram_params,
                                            const void *pixel, uint32_t *histogram, int j,
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
-
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
-  {
-    histogram_helper_cs_rgb_helper_process_pixel_float_compensated(histogram_params, in, histogram, profile_info);
-  }
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 4, profile_info,
+           histogram_helper_cs_rgb_helper_process_pixel_float_compensated);
 }
 
 //------------------------------------------------------------------------------
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_Lab_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
+inline static void histogram_helper_cs_Lab_helper_process_pixel_float(
+    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
+    const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const float Lv = pixel[0];
-  const float av = pixel[1];
-  const float bv = pixel[2];
-  const float max = histogram_params->bins_count - 1;
-  const uint32_t L = CLAMP(histogram_params->mul / 100.0f * (Lv), 0, max);
-  const uint32_t a = CLAMP(histogram_params->mul / 256.0f * (av + 128.0f), 0, max);
-  const uint32_t b = CLAMP(histogram_params->mul / 256.0f * (bv + 128.0f), 0, max);
-  histogram[4 * L]++;
-  histogram[4 * a + 1]++;
-  histogram[4 * b + 2]++;
+  // L in [0; 100], a and b in [-128; 128]
+  const float mul = histogram_params->mul;
+  const dt_aligned_pixel_simd_t offset = { 0.f, 128.0f, 128.0f, 0.f };
+  const dt_aligned_pixel_simd_t scale = { mul / 100.0f, mul / 256.0f, mul / 256.0f, 0.f };
+  _bin_scaled_pixel((dt_load_simd_aligned(pixel) + offset) * scale, histogram_params->bins_count - 1, histogram);
 }
 
 inline static void histogram_helper_cs_Lab(const dt_dev_histogram_collection_params_t *const histogram_params,
                                            const void *pixel, uint32_t *histogram, int j,
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 4, profile_info,
+           histogram_helper_cs_Lab_helper_process_pixel_float);
+}
 
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
-  {
-    histogram_helper_cs_Lab_helper_process_pixel_float(histogram_params, in, histogram);
-  }
+inline static void histogram_helper_cs_LCh_helper_process_pixel_float(
+    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
+    const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  const float mul = histogram_params->mul;
+  const dt_aligned_pixel_simd_t scale = { mul / 100.f, mul / (128.0f * sqrtf(2.0f)), mul, 0.f };
+  _bin_scaled_pixel(dt_load_simd_aligned(pixel) * scale, histogram_params->bins_count - 1, histogram);
 }
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_Lab_LCh_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
+inline static void histogram_helper_cs_Lab_LCh_helper_process_pixel_float(
+    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram,
+    const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   dt_aligned_pixel_t LCh;
   dt_Lab_2_LCH(pixel, LCh);
-  const uint32_t L = PS((LCh[0] / 100.f), histogram_params);
-  const uint32_t C = PS((LCh[1] / (128.0f * sqrtf(2.0f))), histogram_params);
-  const uint32_t h = PS(LCh[2], histogram_params);
-  histogram[4 * L]++;
-  histogram[4 * C + 1]++;
-  histogram[4 * h + 2]++;
+  histogram_helper_cs_LCh_helper_process_pixel_float(histogram_params, LCh, histogram, profile_info);
 }
 
 inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection_params_t *const histogram_params,
                                                const void *pixel, uint32_t *histogram, int j,
                                                const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
-
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
-  {
-    histogram_helper_cs_Lab_LCh_helper_process_pixel_float(histogram_params, in, histogram);
-  }
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 4, profile_info,
+           histogram_helper_cs_Lab_LCh_helper_process_pixel_float);
 }
 
 inline static void histogram_helper_cs_LCh(const dt_dev_histogram_collection_params_t *const histogram_params,
                                            const void *pixel, uint32_t *histogram, int j,
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  _bin_row(histogram_params, (const float *)pixel, histogram, j, 4, profile_info,
+           histogram_helper_cs_LCh_helper_process_pixel_float);
+}
 
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+//==============================================================================
+
+uint32_t *dt_histogram_partials_start(dt_histogram_partials_t *partials, const size_t count)
+{
+  const int threads = omp_get_max_threads();
+  const size_t needed = (size_t)threads * count;
+
+  if(needed > partials->capacity)
   {
-    const uint32_t L = PS((in[0] / 100.f), histogram_params);
-    const uint32_t C = PS((in[1] / (128.0f * sqrtf(2.0f))), histogram_params);
-    const uint32_t h = PS(in[2], histogram_params);
-    histogram[4 * L]++;
-    histogram[4 * C + 1]++;
-    histogram[4 * h + 2]++;
+    dt_free_align(partials->bins);
+    partials->bins = dt_alloc_align(needed * sizeof(uint32_t));
+    partials->capacity = IS_NULL_PTR(partials->bins) ? 0 : needed;
+    if(IS_NULL_PTR(partials->bins)) return NULL;
   }
+
+  partials->count = count;
+  partials->threads = threads;
+  memset(partials->bins, 0, needed * sizeof(uint32_t));
+  return partials->bins;
 }
 
-//==============================================================================
+void dt_histogram_partials_reduce(const dt_histogram_partials_t *partials, uint32_t *const out)
+{
+  const size_t count = partials->count;
+  const int threads = partials->threads;
+  const uint32_t *const bins = partials->bins;
+
+  __OMP_PARALLEL_FOR__(if(count > 4096))
+  for(size_t k = 0; k < count; k++)
+  {
+    uint32_t sum = 0;
+    for(int t = 0; t < threads; t++) sum += bins[(size_t)t * count + k];
+    out[k] += sum;
+  }
+}
+
+void dt_histogram_partials_cleanup(dt_histogram_partials_t *partials)
+{
+  dt_free_align(partials->bins);
+  partials->capacity = partials->count = 0;
+  partials->threads = 0;
+}
+
+/* Kept across calls for the preview pipe, which recomputes module histograms on every
+ * change. Concurrent callers (another pipe, deflicker) get a temporary set instead of waiting. */
+static GMutex _worker_partials_lock;
+static dt_histogram_partials_t _worker_partials = { 0 };
+
+void dt_histogram_cleanup(void)
+{
+  g_mutex_lock(&_worker_partials_lock);
+  dt_histogram_partials_cleanup(&_worker_partials);
+  g_mutex_unlock(&_worker_partials_lock);
+}
 
 void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
                          dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
                          uint32_t **histogram, const dt_worker Worker,
                          const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const int nthreads = omp_get_max_threads();
-
   const size_t bins_total = (size_t)4 * histogram_params->bins_count;
   const size_t buf_size = bins_total * sizeof(uint32_t);
-  void *partial_hists = calloc(nthreads, buf_size);
 
   if(histogram_params->mul == 0) histogram_params->mul = (double)(histogram_params->bins_count - 1);
 
   const dt_histogram_roi_t *const roi = histogram_params->roi;
-  __OMP_PARALLEL_FOR__(shared(partial_hists) )
-  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j++)
-  {
-    uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * omp_get_thread_num();
-    Worker(histogram_params, pixel, thread_hist, j, profile_info);
-  }
+  const size_t columns = roi->width - roi->crop_width - roi->crop_x;
+  const size_t rows = roi->height - roi->crop_height - roi->crop_y;
+  const size_t step = dt_histogram_sample_step(columns * rows, histogram_params->max_samples);
+  histogram_params->sample_step = step;
+
+  dt_histogram_partials_t local = { 0 };
+  const gboolean shared = g_mutex_trylock(&_worker_partials_lock);
+  dt_histogram_partials_t *const partials = shared ? &_worker_partials : &local;
 
-#ifdef _OPENMP
   *histogram = realloc(*histogram, buf_size);
-  memset(*histogram, 0, buf_size);
-  uint32_t *hist = *histogram;
+  uint32_t *const partial_hists = dt_histogram_partials_start(partials, bins_total);
+  if(IS_NULL_PTR(partial_hists) || IS_NULL_PTR(*histogram))
+  {
+    if(shared) g_mutex_unlock(&_worker_partials_lock);
+    dt_histogram_partials_cleanup(&local);
+    if(!IS_NULL_PTR(*histogram)) memset(*histogram, 0, buf_size);
+    histogram_stats->bins_count = histogram_params->bins_count;
+    histogram_stats->pixels = 0;
+    return;
+  }
 
-#pragma omp parallel for default(firstprivate) \
-  shared(hist, partial_hists) 
-  for(size_t k = 0; k < bins_total; k++)
+  if(step > 1)
   {
-    for(size_t n = 0; n < nthreads; n++)
-    {
-      const uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * n;
-      hist[k] += thread_hist[k];
-    }
+    const int strips = (rows + step - 1) / step;
+    __OMP_PARALLEL_FOR__()
+    for(int j = 0; j < strips; j++)
+      Worker(histogram_params, pixel, partial_hists + bins_total * omp_get_thread_num(), j, profile_info);
   }
-#else
-  *histogram = realloc(*histogram, buf_size);
-  memmove(*histogram, partial_hists, buf_size);
-#endif
-  dt_free(partial_hists);
+  else
+  {
+    __OMP_PARALLEL_FOR__()
+    for(int j = roi->crop_y; j < roi->height - roi->crop_height; j++)
+      Worker(histogram_params, pixel, partial_hists + bins_total * omp_get_thread_num(), j, profile_info);
+  }
+
+  memset(*histogram, 0, buf_size);
+  dt_histogram_partials_reduce(partials, *histogram);
+  if(shared) g_mutex_unlock(&_worker_partials_lock);
+  dt_histogram_partials_cleanup(&local);
 
   histogram_stats->bins_count = histogram_params->bins_count;
-  histogram_stats->pixels = (roi->width - roi->crop_width - roi->crop_x)
-                            * (roi->height - roi->crop_height - roi->crop_y);
+  if(step > 1)
+  {
+    // Samples falling outside the ROI are dropped: count what was binned. Every worker
+    // bins each pixel exactly once in channel 0.
+    size_t pixels = 0;
+    for(size_t k = 0; k < bins_total; k += 4) pixels += (*histogram)[k];
+    histogram_stats->pixels = pixels;
+  }
+  else
+    histogram_stats->pixels = columns * rows;
 }
 
 //------------------------------------------------------------------------------
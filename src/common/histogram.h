@@ -26,6 +26,7 @@
 #ifndef DT_COMMON_HISTOGRAM_H
 #define DT_COMMON_HISTOGRAM_H
 
+#include <math.h>
 #include <stdint.h>
 
 #include "develop/imageop.h"
@@ -44,6 +45,78 @@ typedef struct dt_histogram_roi_t
   int width, height, crop_x, crop_y, crop_width, crop_height;
 } dt_histogram_roi_t;
 
+/*
+ * sampling for display
+ *
+ * Histograms that are only looked at do not need every pixel. With max_samples set in the
+ * collection params, the ROI is cut in square cells of sample_step pixels and one pixel is
+ * binned per cell, at a position drawn from a hash of the cell: a stratified sample. The share
+ * of the samples landing in any bin then has a standard deviation of at most 1 / (2 sqrt(n))
+ * around the share of the whole image for n samples, the bound of a simple random sample,
+ * and far less on smooth images. The hash is fixed, so the same buffer always gives the
+ * same histogram and scopes do not flicker between redraws.
+ *
+ * DT_HISTOGRAM_DISPLAY_SAMPLES keeps that error under 1/512, half a pixel on a 256 px tall
+ * graph. Anything that computes from the counts (percentiles, auto levels) must leave
+ * max_samples at 0.
+ */
+#define DT_HISTOGRAM_DISPLAY_SAMPLES 65536
+
+/** Side of the sampling cells binning no fewer than about `max_samples` of `pixels`, 1 to bin them all. */
+static inline size_t dt_histogram_sample_step(const size_t pixels, const size_t max_samples)
+{
+  if(max_samples == 0 || pixels <= max_samples) return 1;
+  return (size_t)floor(sqrt((double)pixels / (double)max_samples));
+}
+
+/** Offset in [0, step) of the sample drawn for `key`, a cell index along one axis. */
+static inline size_t dt_histogram_sample_offset(const uint64_t key, const size_t step)
+{
+  if(step <= 1) return 0;
+  // splitmix64 finalizer: consecutive cells get unrelated offsets.
+  uint64_t h = key + 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return (size_t)(h % step);
+}
+
+/** Position, relative to the window origin, of the pixel sampled in cell `cell` of strip
+ * `strip` (the strip of `step` rows, the cell of `step` columns in it). Callers drop the
+ * positions falling past the window edges. With step 1, this is pixel (cell, strip). */
+static inline void dt_histogram_sample_position(const size_t strip, const size_t cell, const size_t step,
+                                                size_t *x, size_t *y)
+{
+  const uint64_t key = 2 * (((uint64_t)strip << 32) + cell);
+  *x = cell * step + dt_histogram_sample_offset(key, step);
+  *y = strip * step + dt_histogram_sample_offset(key + 1, step);
+}
+
+/**
+ * Per-thread partial histograms, kept from one call to the next so binning does not
+ * allocate and fault in fresh pages every time. Not thread-safe: one owner at a time.
+ */
+typedef struct dt_histogram_partials_t
+{
+  uint32_t *bins;  // threads × count
+  size_t count;    // bins per thread for the current run
+  size_t capacity; // allocated bins, all threads
+  int threads;
+} dt_histogram_partials_t;
+
+/** Zero and return threads × `count` bins, thread t owning [t × count, (t + 1) × count). NULL on OOM. */
+uint32_t *dt_histogram_partials_start(dt_histogram_partials_t *partials, const size_t count);
+
+/** Add the partials to `out`, `count` bins. */
+void dt_histogram_partials_reduce(const dt_histogram_partials_t *partials, uint32_t *const out);
+
+void dt_histogram_partials_cleanup(dt_histogram_partials_t *partials);
+
+/** Free the partials dt_histogram_worker() keeps, at shutdown. */
+void dt_histogram_cleanup(void);
+
+/* Workers bin one row `j` of the ROI. When sampling (sample_step > 1), `j` is the index of a
+ * strip of sample_step rows, counted from crop_y, and the worker bins one pixel per cell of it. */
 void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_params_t *histogram_params,
                                        const void *pixel, uint32_t *histogram, int j,
                                        const dt_iop_order_iccprofile_info_t *const profile_info);
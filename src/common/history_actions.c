@@ -26,11 +26,13 @@
 #include "common/image.h"
 #include "caches/image_cache.h"
 #include "common/styles.h"
+#include "common/thumbnail_notify.h"
 #include "common/undo.h"
 #include "common/conf.h"
 #include "develop/dev_history.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "system/openmp.h"
 
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
@@ -53,29 +55,140 @@ static void _history_action_finalize_list(const GList *list, const gboolean chan
   dt_history_changed_images(list);
 }
 
-typedef gboolean (*dt_history_action_fn)(const int32_t imgid, void *user_data);
+/**
+ * @brief One image's worth of a history action.
+ *
+ * @param batch Merge batch state to merge against, for the actions that merge. Workers of a
+ *        parallel list each get their own, in place of the one held in @p user_data.
+ * @param undo When not NULL, the action stores its before/after snapshot there instead of
+ *        recording it, so the caller can record it from its own thread. NULL means record
+ *        nothing, or record directly for the actions that always run sequentially.
+ * @return TRUE if the image history changed.
+ */
+typedef gboolean (*dt_history_action_fn)(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                         dt_undo_lt_history_t **undo);
+
+static void _history_action_record_undo(dt_undo_lt_history_t *hist)
+{
+  if(IS_NULL_PTR(hist)) return;
+  dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+}
 
-static gboolean _history_action_on_list_with_undo(const GList *list, dt_history_action_fn action, void *user_data,
-                                                  const gboolean use_undo)
+/**
+ * @brief Run a history action on every image of a list, as one undo step.
+ *
+ * @details Images do not depend on each other, so a @p parallel action runs on all of them
+ * concurrently: each one reads, merges and writes its own history, only the DB connection
+ * is shared. Three things stay on the calling thread:
+ *
+ * - the merge reports. As long as the user has not settled a decision for the whole @p batch,
+ *   images are processed one at a time, as the reports would show them. Past that point, every
+ *   worker merges against its own headless copy of @p batch: nothing the merges write is
+ *   shared, and no dialog can open from the parallel region, even on the GUI thread that leads
+ *   it. A merge that would still want the report, because the order cached by the batch does
+ *   not apply to its image, is deferred by the worker and redone here against @p batch.
+ * - the undo records. dt_undo_record() drops what is recorded while another thread holds the
+ *   undo lock, so the snapshots are collected and recorded afterwards, in the list order.
+ * - the refresh of the collection and thumbnails, once for the whole list. Workers hold the
+ *   thumbnail notifications their images raise, and the ones they changed are sent at once
+ *   from the GUI thread: the thumbnail handler queues GTK redraws.
+ *
+ * There is no single DB transaction around the batch: it would hold the write lock of the one
+ * connection for its owner thread and serialize the workers behind it.
+ */
+static gboolean _history_action_on_list_full(const GList *list, dt_history_action_fn action, void *user_data,
+                                             const gboolean use_undo, const gboolean parallel,
+                                             dt_hm_batch_state_t *batch)
 {
   if(IS_NULL_PTR(list)) return FALSE;
 
+  const int count = g_list_length((GList *)list);
+  int32_t *imgs = g_new(int32_t, count);
+  int k = 0;
+  for(const GList *l = list; l; l = g_list_next(l)) imgs[k++] = GPOINTER_TO_INT(l->data);
+
+  dt_undo_lt_history_t **hist = (use_undo && parallel) ? g_new0(dt_undo_lt_history_t *, count) : NULL;
+
   if(use_undo) dt_undo_start_group(dt_undo_get_global(), DT_UNDO_LT_HISTORY);
-  gboolean changed = FALSE;
-  for(const GList *l = list; l; l = g_list_next(l))
+
+  int changed = 0;
+  int first = 0;
+  // Actions that do not merge run without a batch
+  while(first < count && (!parallel || (batch && dt_hm_batch_needs_report(batch))))
   {
-    const int32_t imgid = GPOINTER_TO_INT(l->data);
-    changed |= action(imgid, user_data);
+    changed += action(imgs[first], user_data, batch, hist ? &hist[first] : NULL) ? 1 : 0;
+    first++;
+  }
+
+  if(first < count)
+  {
+    gboolean *touched = g_new0(gboolean, count);
+    gboolean *deferred = g_new0(gboolean, count);
+    __OMP_PARALLEL__(reduction(+:changed))
+    {
+      dt_hm_batch_state_t worker;
+      dt_hm_batch_state_fork(&worker, batch);
+      dt_thumbnail_notify_hold(TRUE);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for(int i = first; i < count; i++)
+      {
+        touched[i] = action(imgs[i], user_data, &worker, hist ? &hist[i] : NULL);
+        changed += touched[i] ? 1 : 0;
+        if(worker.deferred)
+        {
+          // Nothing was written, the image is redone below
+          deferred[i] = TRUE;
+          worker.deferred = FALSE;
+          if(hist && hist[i])
+          {
+            dt_history_snapshot_undo_lt_history_data_free(hist[i]);
+            hist[i] = NULL;
+          }
+        }
+      }
+      dt_thumbnail_notify_hold(FALSE);
+      dt_hm_batch_state_cleanup(&worker);
+    }
+
+    dt_thumbnail_notify_hold(TRUE);
+    for(int i = first; i < count; i++)
+    {
+      if(!deferred[i]) continue;
+      touched[i] = action(imgs[i], user_data, batch, hist ? &hist[i] : NULL);
+      changed += touched[i] ? 1 : 0;
+    }
+    dt_thumbnail_notify_hold(FALSE);
+    dt_free(deferred);
+
+    int n = 0;
+    for(int i = first; i < count; i++)
+      if(touched[i]) imgs[n++] = imgs[i];
+    dt_thumbnail_notify_images_changed(imgs, n, TRUE);
+    dt_free(touched);
   }
+
+  for(int i = 0; hist && i < count; i++) _history_action_record_undo(hist[i]);
   if(use_undo) dt_undo_end_group(dt_undo_get_global());
 
-  _history_action_finalize_list(list, changed);
-  return changed;
+  _history_action_finalize_list(list, changed > 0);
+
+  dt_free(hist);
+  dt_free(imgs);
+  return changed > 0;
 }
 
 static gboolean _history_action_on_list(const GList *list, dt_history_action_fn action, void *user_data)
 {
-  return _history_action_on_list_with_undo(list, action, user_data, TRUE);
+  return _history_action_on_list_full(list, action, user_data, TRUE, FALSE, NULL);
+}
+
+static gboolean _history_action_on_list_parallel(const GList *list, dt_history_action_fn action, void *user_data,
+                                                 dt_hm_batch_state_t *batch)
+{
+  return _history_action_on_list_full(list, action, user_data, TRUE, TRUE, batch);
 }
 
 /**
@@ -147,6 +260,32 @@ static GList *_get_user_mod_list(dt_develop_t *dev_src, GList *ops, gboolean cop
   return g_list_reverse(mod_list);
 }
 
+/**
+ * @brief The source side of a paste: the source image history and the modules to copy from it.
+ *
+ * @details It does not depend on the destination, so a paste on a list builds it once. Merges
+ * only read it, several of them can share it concurrently.
+ */
+typedef struct _paste_source_t
+{
+  dt_develop_t dev;
+  GList *mod_list;
+} _paste_source_t;
+
+static void _paste_source_init(_paste_source_t *src, const int32_t imgid, GList *ops, const gboolean copy_full)
+{
+  dt_dev_init(&src->dev, FALSE);
+  dt_dev_reload_history_items(&src->dev, imgid);
+  src->mod_list = _get_user_mod_list(&src->dev, ops, copy_full);
+}
+
+static void _paste_source_cleanup(_paste_source_t *src)
+{
+  g_list_free(src->mod_list);
+  src->mod_list = NULL;
+  dt_dev_cleanup(&src->dev);
+}
+
 /**
  * @brief Copy/merge history between images using the merge pipeline.
  *
@@ -157,47 +296,57 @@ static GList *_get_user_mod_list(dt_develop_t *dev_src, GList *ops, gboolean cop
  * @param ops Optional list of history indices to copy.
  * @param copy_full Whether to copy the full history.
  * @param mode Merge strategy.
+ * @param source Prepared source to merge from, or NULL to build one from @p imgid, @p ops and
+ *        @p copy_full. Unused in replace mode, which needs a source of its own.
  * @return 0 on success, non-zero on failure.
  */
 static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops,
                                                   const gboolean copy_full, const dt_history_merge_strategy_t mode,
-                                                  const gboolean copy_iop_order, dt_hm_batch_state_t *batch)
+                                                  const gboolean copy_iop_order, const gboolean paste_instances,
+                                                  _paste_source_t *source, dt_hm_batch_state_t *batch)
 {
-  // Init source history + pipeline
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t *dev_src = &_dev_src;
-  dt_dev_init(dev_src, FALSE);
-  dt_dev_reload_history_items(dev_src, imgid);
-
   int ret_val = 0;
 
   if(mode == DT_HISTORY_MERGE_REPLACE)
   {
+    // Init source history + pipeline
+    dt_develop_t _dev_src = { 0 };
+    dt_develop_t *dev_src = &_dev_src;
+    dt_dev_init(dev_src, FALSE);
+    dt_dev_reload_history_items(dev_src, imgid);
+
     // Dumb mode : keep dev_src intact but swap destination imgid and image info into it.
     //
     // NOTE: when pasting from LDR/JPEG onto RAW images, the source iop-order list might not be compatible
     // with the destination pipeline. We need to re-init the iop-order list for the destination image and
     // reload module defaults for the destination image, but we must not apply auto-presets.
     ret_val = dt_dev_replace_history_on_image(dev_src, dest_imgid, TRUE, "_history_copy_and_paste_on_image_merge");
+    dt_dev_cleanup(dev_src);
   }
   else
   {
     // Merge
-    GList *mod_list = _get_user_mod_list(dev_src, ops, copy_full);
-    ret_val = dt_dev_merge_history_into_image(dev_src, dest_imgid, mod_list,
-                                              copy_iop_order, mode,
-                                              dt_conf_get_bool("history/paste_instances"), NULL, batch);
-    g_list_free(mod_list);
-    mod_list = NULL;
+    _paste_source_t own = { 0 };
+    if(IS_NULL_PTR(source))
+    {
+      _paste_source_init(&own, imgid, ops, copy_full);
+      source = &own;
+    }
+
+    ret_val = dt_dev_merge_history_into_image(&source->dev, dest_imgid, source->mod_list,
+                                              copy_iop_order, mode, paste_instances, NULL, batch);
+
+    if(source == &own) _paste_source_cleanup(&own);
   }
-  dt_dev_cleanup(dev_src);
 
   return ret_val;
 }
 
-gboolean dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid, GList *ops,
+static int _history_copy_and_paste_undoable(const int32_t imgid, const int32_t dest_imgid, GList *ops,
                                             const gboolean copy_full, const dt_history_merge_strategy_t mode,
-                                            const gboolean copy_iop_order, dt_hm_batch_state_t *batch)
+                                            const gboolean copy_iop_order, const gboolean paste_instances,
+                                            _paste_source_t *source, dt_hm_batch_state_t *batch,
+                                            dt_undo_lt_history_t **undo)
 {
   if(imgid == dest_imgid) return 1;
 
@@ -212,15 +361,25 @@ gboolean dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t d
   dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
   int ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full, mode, copy_iop_order,
-                                                       batch);
+                                                       paste_instances, source, batch);
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-  dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  if(undo)
+    *undo = hist;
+  else
+    _history_action_record_undo(hist);
 
   return ret_val;
 }
 
+gboolean dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid, GList *ops,
+                                            const gboolean copy_full, const dt_history_merge_strategy_t mode,
+                                            const gboolean copy_iop_order, dt_hm_batch_state_t *batch)
+{
+  return _history_copy_and_paste_undoable(imgid, dest_imgid, ops, copy_full, mode, copy_iop_order,
+                                          dt_conf_get_bool("history/paste_instances"), NULL, batch, NULL);
+}
+
 gboolean dt_history_copy(int32_t imgid)
 {
   // note that this routine does not copy anything, it just setup the copy_paste proxy
@@ -236,60 +395,79 @@ gboolean dt_history_copy(int32_t imgid)
 typedef struct _paste_action_ctx_t
 {
   dt_hm_batch_state_t batch;
+  dt_history_merge_strategy_t mode;
+  gboolean copy_iop_order;
+  gboolean paste_instances;
+  _paste_source_t *source;
 } _paste_action_ctx_t;
 
-static gboolean _history_paste_apply(const int32_t imgid, void *user_data)
+// Everything a paste on a list reads from the config and the clipboard, once, so all the images of the
+// batch agree on it and the workers don't go back to the config.
+static void _paste_action_ctx_init(_paste_action_ctx_t *ctx, _paste_source_t *source)
+{
+  const dt_history_copy_item_t *copy_paste = dt_history_copy_paste_get();
+  ctx->mode = dt_conf_get_int("history/paste/mode");
+  ctx->copy_iop_order = dt_conf_get_bool("history/paste/copy_iop_order");
+  ctx->paste_instances = dt_conf_get_bool("history/paste_instances");
+  ctx->source = NULL;
+  if(ctx->mode != DT_HISTORY_MERGE_REPLACE)
+  {
+    _paste_source_init(source, copy_paste->copied_imageid, copy_paste->selops, FALSE);
+    ctx->source = source;
+  }
+}
+
+static void _paste_action_ctx_cleanup(_paste_action_ctx_t *ctx)
+{
+  if(ctx->source) _paste_source_cleanup(ctx->source);
+  ctx->source = NULL;
+  dt_hm_batch_state_cleanup(&ctx->batch);
+}
+
+static gboolean _history_paste_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                     dt_undo_lt_history_t **undo)
 {
   _paste_action_ctx_t *ctx = (_paste_action_ctx_t *)user_data;
   const dt_history_copy_item_t *copy_paste = dt_history_copy_paste_get();
   if(copy_paste->copied_imageid <= 0) return FALSE;
   if(imgid <= 0) return FALSE;
 
-  const gboolean pasted = dt_history_copy_and_paste_on_image(copy_paste->copied_imageid,
-                                                             imgid,
-                                                             copy_paste->selops,
-                                                             FALSE,
-                                                             dt_conf_get_int("history/paste/mode"),
-                                                             dt_conf_get_bool("history/paste/copy_iop_order"),
-                                                             ctx ? &ctx->batch : NULL) == 0;
-  return pasted;
+  if(IS_NULL_PTR(ctx))
+    return dt_history_copy_and_paste_on_image(copy_paste->copied_imageid, imgid, copy_paste->selops, FALSE,
+                                              dt_conf_get_int("history/paste/mode"),
+                                              dt_conf_get_bool("history/paste/copy_iop_order"), NULL) == 0;
+
+  return _history_copy_and_paste_undoable(copy_paste->copied_imageid, imgid, copy_paste->selops, FALSE,
+                                          ctx->mode, ctx->copy_iop_order, ctx->paste_instances, ctx->source,
+                                          batch, undo) == 0;
 }
 
 gboolean dt_history_paste_on_image(const int32_t imgid)
 {
-  return _history_paste_apply(imgid, NULL);  // NULL batch → always show report popup
+  return _history_paste_apply(imgid, NULL, NULL, NULL);  // NULL batch → always show report popup
 }
 
 gboolean dt_history_paste_on_list(const GList *list)
 {
   if(dt_history_copy_paste_get()->copied_imageid <= 0) return FALSE;
   _paste_action_ctx_t ctx = { 0 };
-  const gboolean changed = _history_action_on_list(list, _history_paste_apply, &ctx);
-  dt_hm_batch_state_cleanup(&ctx.batch);
+  _paste_source_t source = { 0 };
+  _paste_action_ctx_init(&ctx, &source);
+  const gboolean changed = _history_action_on_list_parallel(list, _history_paste_apply, &ctx, &ctx.batch);
+  _paste_action_ctx_cleanup(&ctx);
   return changed;
 }
 
-static gboolean _history_paste_parts_apply(const int32_t imgid, void *user_data)
+static gboolean _history_paste_parts_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                           dt_undo_lt_history_t **undo)
 {
-  _paste_action_ctx_t *ctx = (_paste_action_ctx_t *)user_data;
-  const dt_history_copy_item_t *copy_paste = dt_history_copy_paste_get();
-  if(copy_paste->copied_imageid <= 0) return FALSE;
-  if(IS_NULL_PTR(copy_paste->selops)) return FALSE;
-  if(imgid <= 0) return FALSE;
-
-  const gboolean pasted = dt_history_copy_and_paste_on_image(copy_paste->copied_imageid,
-                                                             imgid,
-                                                             copy_paste->selops,
-                                                             FALSE,
-                                                             dt_conf_get_int("history/paste/mode"),
-                                                             dt_conf_get_bool("history/paste/copy_iop_order"),
-                                                             ctx ? &ctx->batch : NULL) == 0;
-  return pasted;
+  if(IS_NULL_PTR(dt_history_copy_paste_get()->selops)) return FALSE;
+  return _history_paste_apply(imgid, user_data, batch, undo);
 }
 
 gboolean dt_history_paste_parts_on_image(const int32_t imgid)
 {
-  return _history_paste_parts_apply(imgid, NULL);  // NULL batch → always show report popup
+  return _history_paste_parts_apply(imgid, NULL, NULL, NULL);  // NULL batch → always show report popup
 }
 
 gboolean dt_history_paste_parts_on_list(const GList *list)
@@ -299,14 +477,19 @@ gboolean dt_history_paste_parts_on_list(const GList *list)
   if(IS_NULL_PTR(copy_paste->selops))
     return FALSE;
   _paste_action_ctx_t ctx = { 0 };
-  const gboolean changed = _history_action_on_list(list, _history_paste_parts_apply, &ctx);
-  dt_hm_batch_state_cleanup(&ctx.batch);
+  _paste_source_t source = { 0 };
+  _paste_action_ctx_init(&ctx, &source);
+  const gboolean changed = _history_action_on_list_parallel(list, _history_paste_parts_apply, &ctx, &ctx.batch);
+  _paste_action_ctx_cleanup(&ctx);
   return changed;
 }
 
-static gboolean _history_compress_apply(const int32_t imgid, void *user_data)
+static gboolean _history_compress_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                        dt_undo_lt_history_t **undo)
 {
   (void)user_data;
+  (void)batch;
+  (void)undo;
   dt_print(DT_DEBUG_HISTORY, "[dt_history_compress_on_image] compressing history for image %i\n", imgid);
   if(imgid <= 0) return FALSE;
 
@@ -321,12 +504,12 @@ static gboolean _history_compress_apply(const int32_t imgid, void *user_data)
 
 void dt_history_compress_on_image(const int32_t imgid)
 {
-  _history_compress_apply(imgid, NULL);
+  _history_compress_apply(imgid, NULL, NULL, NULL);
 }
 
 int dt_history_compress_on_list(const GList *imgs)
 {
-  _history_action_on_list(imgs, _history_compress_apply, NULL);
+  _history_action_on_list_parallel(imgs, _history_compress_apply, NULL, NULL);
   return 0;
 }
 
@@ -336,7 +519,8 @@ typedef struct dt_history_load_params_t
   int history_only;
 } dt_history_load_params_t;
 
-static gboolean _history_load_and_apply_apply(const int32_t imgid, void *user_data)
+static gboolean _history_load_and_apply_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                              dt_undo_lt_history_t **undo)
 {
   dt_history_load_params_t *params = (dt_history_load_params_t *)user_data;
   dt_image_t *img = dt_image_cache_get(imgid, 'w');
@@ -351,12 +535,15 @@ static gboolean _history_load_and_apply_apply(const int32_t imgid, void *user_da
     dt_image_cache_write_release(img,
                                  // ugly but if not history_only => called from crawler - do not write the xmp
                                  params->history_only ? DT_IMAGE_CACHE_SAFE : DT_IMAGE_CACHE_RELAXED);
+    dt_history_snapshot_undo_lt_history_data_free(hist);
     return FALSE;
   }
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-  dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  if(undo)
+    *undo = hist;
+  else
+    _history_action_record_undo(hist);
 
   dt_image_cache_write_release(img,
                                // ugly but if not history_only => called from crawler - do not write the xmp
@@ -376,7 +563,7 @@ static gboolean _history_load_and_apply_apply(const int32_t imgid, void *user_da
 int dt_history_load_and_apply(const int32_t imgid, gchar *filename, int history_only)
 {
   dt_history_load_params_t params = { .filename = filename, .history_only = history_only };
-  return _history_load_and_apply_apply(imgid, &params) ? 0 : 1;
+  return _history_load_and_apply_apply(imgid, &params, NULL, NULL) ? 0 : 1;
 }
 
 int dt_history_load_and_apply_on_image(int32_t imgid, gchar *filename, int history_only)
@@ -387,7 +574,7 @@ int dt_history_load_and_apply_on_image(int32_t imgid, gchar *filename, int histo
 int dt_history_load_and_apply_on_list(gchar *filename, const GList *list)
 {
   dt_history_load_params_t params = { .filename = filename, .history_only = 1 };
-  const gboolean changed = _history_action_on_list(list, _history_load_and_apply_apply, &params);
+  const gboolean changed = _history_action_on_list_parallel(list, _history_load_and_apply_apply, &params, NULL);
   return changed ? 0 : 1;
 }
 
@@ -396,15 +583,16 @@ typedef struct dt_history_delete_params_t
   gboolean undo;
 } dt_history_delete_params_t;
 
-static gboolean _history_delete_apply(const int32_t imgid, void *user_data)
+static gboolean _history_delete_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                      dt_undo_lt_history_t **undo)
 {
   if(imgid <= 0) return FALSE;
 
   const dt_history_delete_params_t *params = (dt_history_delete_params_t *)user_data;
-  const gboolean undo = params ? params->undo : TRUE;
+  const gboolean record = params ? params->undo : TRUE;
 
   dt_undo_lt_history_t *hist = NULL;
-  if(undo)
+  if(record)
   {
     hist = dt_history_snapshot_item_init();
     hist->imgid = imgid;
@@ -413,11 +601,13 @@ static gboolean _history_delete_apply(const int32_t imgid, void *user_data)
 
   dt_history_delete_on_image_ext(imgid, FALSE);
 
-  if(undo)
+  if(record)
   {
     dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-    dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist, dt_history_snapshot_undo_pop,
-                   dt_history_snapshot_undo_lt_history_data_free);
+    if(undo)
+      *undo = hist;
+    else
+      _history_action_record_undo(hist);
   }
 
   return TRUE;
@@ -426,7 +616,7 @@ static gboolean _history_delete_apply(const int32_t imgid, void *user_data)
 gboolean dt_history_delete_on_list(const GList *list, gboolean undo)
 {
   dt_history_delete_params_t params = { .undo = undo };
-  return _history_action_on_list_with_undo(list, _history_delete_apply, &params, undo);
+  return _history_action_on_list_full(list, _history_delete_apply, &params, undo, TRUE, NULL);
 }
 
 typedef struct dt_history_style_params_t
@@ -436,9 +626,12 @@ typedef struct dt_history_style_params_t
   gboolean duplicate;
   dt_history_merge_strategy_t mode;
   dt_hm_batch_state_t batch;
+  dt_styles_prepared_t *prepared;
+  gboolean defer_reload; // the caller reloads the collection once, after the whole list
 } dt_history_style_params_t;
 
-static gboolean _history_style_apply(const int32_t imgid, void *user_data)
+static gboolean _history_style_apply(const int32_t imgid, void *user_data, dt_hm_batch_state_t *batch,
+                                     dt_undo_lt_history_t **undo)
 {
   dt_history_style_params_t *params = (dt_history_style_params_t *)user_data;
   if(IS_NULL_PTR(params) || params->style_id == 0 || IS_NULL_PTR(params->name) || !*params->name) return FALSE;
@@ -453,28 +646,18 @@ static gboolean _history_style_apply(const int32_t imgid, void *user_data)
     if(newimgid == UNKNOWN_IMAGE) return FALSE;
 
     // Structural copy of original history into the duplicate; no merge report needed here.
-    const gboolean pasted = dt_history_copy_and_paste_on_image(imgid, newimgid, NULL, TRUE, params->mode,
-                                                               dt_conf_get_bool("history/style/copy_iop_order"),
-                                                               NULL) == 0;
+    const gboolean pasted
+        = _history_copy_and_paste_undoable(imgid, newimgid, NULL, TRUE, params->mode,
+                                           dt_conf_get_bool("history/style/copy_iop_order"),
+                                           dt_conf_get_bool("history/paste_instances"), NULL, NULL, undo) == 0;
 
-    dt_collection_update_query(dt_collection_get_global(), DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL);
+    if(!params->defer_reload)
+      dt_collection_update_query(dt_collection_get_global(), DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL);
 
     return pasted;
   }
 
-  dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-  hist->imgid = newimgid;
-  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
-
-  const int ret_val = dt_styles_apply_to_image_merge(params->name, params->style_id, newimgid, params->mode,
-                                                     &params->batch);
-
-  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-  dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
-
-  const gboolean changed = (ret_val == 0);
-  return changed;
+  return dt_styles_prepared_apply_to_images(params->prepared, &newimgid, 1, batch, TRUE) > 0;
 }
 
 gboolean dt_history_style_on_image(const int32_t imgid, const char *name, const gboolean duplicate)
@@ -490,7 +673,11 @@ gboolean dt_history_style_on_image(const int32_t imgid, const char *name, const
   };
   if(params.style_id == 0) return FALSE;
 
-  const gboolean changed = _history_style_apply(imgid, &params);
+  params.prepared = dt_styles_prepare(name, params.style_id, params.mode);
+  if(IS_NULL_PTR(params.prepared)) return FALSE;
+
+  const gboolean changed = _history_style_apply(imgid, &params, &params.batch, NULL);
+  dt_styles_prepared_free(params.prepared);
   dt_hm_batch_state_cleanup(&params.batch);
   return changed;
 }
@@ -508,7 +695,33 @@ gboolean dt_history_style_on_list(const GList *list, const char *name, const gbo
   };
   if(params.style_id == 0) return FALSE;
 
-  const gboolean changed = _history_action_on_list(list, _history_style_apply, &params);
+  params.prepared = dt_styles_prepare(name, params.style_id, params.mode);
+  if(IS_NULL_PTR(params.prepared)) return FALSE;
+
+  gboolean changed = FALSE;
+  if(duplicate)
+  {
+    // Duplicating picks the next version number of the image group: keep it sequential
+    params.defer_reload = TRUE;
+    changed = _history_action_on_list(list, _history_style_apply, &params);
+    dt_collection_update_query(dt_collection_get_global(), DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL);
+  }
+  else
+  {
+    // The style is applied in place: let it run on the whole list at once
+    const int count = g_list_length((GList *)list);
+    int32_t *imgs = g_new(int32_t, count);
+    int k = 0;
+    for(const GList *l = list; l; l = g_list_next(l)) imgs[k++] = GPOINTER_TO_INT(l->data);
+
+    dt_undo_start_group(dt_undo_get_global(), DT_UNDO_LT_HISTORY);
+    changed = dt_styles_prepared_apply_to_images(params.prepared, imgs, count, &params.batch, TRUE) > 0;
+    dt_undo_end_group(dt_undo_get_global());
+    _history_action_finalize_list(list, changed);
+    dt_free(imgs);
+  }
+
+  dt_styles_prepared_free(params.prepared);
   dt_hm_batch_state_cleanup(&params.batch);
   return changed;
 }
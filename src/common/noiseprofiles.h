@@ -60,7 +60,7 @@ dt_noiseprofile_t;
 
 extern const dt_noiseprofile_t dt_noiseprofile_generic;
 
-/** read the noiseprofile file once on startup (kind of)*/
+/** read the noiseprofile file, once, the first time dt_noiseprofile_get_parser_global() is called */
 JsonParser *dt_noiseprofile_init(const char *alternative);
 
 /*
@@ -124,7 +124,7 @@ static GList *_selection_database_to_glist(dt_selection_t *selection)
  */
 static void _selection_update_collection(gpointer instance, dt_collection_change_t query_change,
   dt_collection_properties_t changed_property, gpointer imgs, uint32_t next,
-  dt_selection_t *selection)
+  gpointer diff, dt_selection_t *selection)
 {
   _clean_missing_ids(selection);
   dt_selection_reload_from_database(selection);
@@ -48,13 +48,18 @@
 #include "common/conf.h"
 #include <glib/gstdio.h>
 #include "database/style_repository.h"
+#include "database/history_repository.h"
 #include "common/styles.h"
+#include "common/thumbnail_notify.h"
 #include "history/notify.h"
 #include "system/macros.h"
 #include "system/mem_alloc.h"
+#include "system/openmp.h"
 #include "common/logging.h"
 #include "common/paths.h"
 #include "common/image.h"
+#include "common/hash.h"
+#include "caches/image_cache.h"
 #include "metadata/exif.h"
 #include "common/file_location.h"
 #include "history/history.h"
@@ -350,14 +355,24 @@ void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean
 
   /* for each selected image apply style */
   dt_undo_start_group(dt_undo_get_global(), DT_UNDO_LT_HISTORY);
-  for(const GList *l = list; l; l = g_list_next(l))
+  if(duplicate)
   {
-    const int32_t imgid = GPOINTER_TO_INT(l->data);
-    for(GList *style = styles; style; style = g_list_next(style))
+    for(const GList *l = list; l; l = g_list_next(l))
     {
-      dt_history_style_on_image(imgid, (char *)style->data, duplicate);
+      const int32_t imgid = GPOINTER_TO_INT(l->data);
+      for(GList *style = styles; style; style = g_list_next(style))
+      {
+        dt_history_style_on_image(imgid, (char *)style->data, duplicate);
+      }
     }
   }
+  else
+  {
+    // Styles stack on each image in the same order either way, so apply each of them to the
+    // whole list: it gets prepared once.
+    for(GList *style = styles; style; style = g_list_next(style))
+      dt_history_style_on_list(list, (char *)style->data, FALSE);
+  }
   dt_undo_end_group(dt_undo_get_global());
 
   const guint styles_cnt = g_list_length(styles);
@@ -529,7 +544,7 @@ static void _dt_styles_tmp_module_free(dt_iop_module_t *module)
   dt_free(module);
 }
 
-static int _styles_init_source_dev(dt_develop_t *dev_src, const char *name, const int32_t imgid,
+static int _styles_init_source_dev(dt_develop_t *dev_src, const GList *style_iop_list, const int32_t imgid,
                                    gboolean *has_iop_list)
 {
   dt_dev_init(dev_src, FALSE);
@@ -540,11 +555,10 @@ static int _styles_init_source_dev(dt_develop_t *dev_src, const char *name, cons
   dt_dev_init_default_history(dev_src, imgid, FALSE);
 
   // If the style has a stored iop-order list, apply it to the temporary pipeline
-  GList *iop_list = dt_styles_module_order_list(name);
-  if(iop_list)
+  if(style_iop_list)
   {
     g_list_free_full(dev_src->iop_order_list, dt_free_gpointer);
-    dev_src->iop_order_list = iop_list;
+    dev_src->iop_order_list = dt_ioppr_iop_order_copy_deep((GList *)style_iop_list);
     *has_iop_list = TRUE;
   }
 
@@ -629,14 +643,33 @@ static int _styles_rebuild_history_from_items(dt_develop_t *dev_src, GList *appl
   return 0;
 }
 
-static int _styles_prepare_source_dev(dt_develop_t *dev_src, const char *name, const int style_id,
+static dt_style_item_t *_style_item_copy(const dt_style_item_t *item)
+{
+  dt_style_item_t *copy = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+  *copy = *item;
+  copy->name = g_strdup(item->name);
+  copy->operation = g_strdup(item->operation);
+  copy->multi_name = g_strdup(item->multi_name);
+  copy->params = (void *)malloc(item->params_size);
+  memcpy(copy->params, item->params, item->params_size);
+  copy->blendop_params = (void *)malloc(item->blendop_params_size);
+  memcpy(copy->blendop_params, item->blendop_params, item->blendop_params_size);
+  return copy;
+}
+
+static int _styles_prepare_source_dev(dt_develop_t *dev_src, const GList *items, const GList *style_iop_list,
                                       const int32_t imgid, GList **out_si_list, GHashTable **out_style_ids,
                                       GList **out_mod_list)
 {
   gboolean has_iop_list = FALSE;
-  if(_styles_init_source_dev(dev_src, name, imgid, &has_iop_list)) return 1;
+  if(_styles_init_source_dev(dev_src, style_iop_list, imgid, &has_iop_list)) return 1;
+
+  // Syncing the pipeline rewrites the items iop_order: work on a copy
+  GList *si_list = NULL;
+  for(const GList *l = items; l; l = g_list_next(l))
+    si_list = g_list_prepend(si_list, _style_item_copy((const dt_style_item_t *)l->data));
+  si_list = g_list_reverse(si_list);
 
-  GList *si_list = _dt_styles_get_apply_items(style_id);
   if(!has_iop_list)
   {
     // Without a stored iop_list, add order entries before creating the style modules;
@@ -685,44 +718,304 @@ static int _styles_prepare_source_dev(dt_develop_t *dev_src, const char *name, c
   return 0;
 }
 
-int dt_styles_apply_to_image_merge(const char *name, const int style_id, const int32_t newimgid,
-                                   const dt_history_merge_strategy_t mode, dt_hm_batch_state_t *batch)
+struct dt_styles_prepared_t
 {
-  int ret_val = 1;
+  gchar *name;
+  int style_id;
+  dt_history_merge_strategy_t mode;
+  gboolean copy_iop_order;
+  gboolean paste_instances;
+
+  GList *items;     // dt_style_item_t, as stored in the style
+  GList *iop_list;  // module order stored with the style, or NULL
+
+  // source stacks already built, by dt_styles_source_signature(). Unused in replace mode,
+  // which rewrites the source stack for each image.
+  GHashTable *sources;
+  dt_pthread_mutex_t lock;
+};
 
-  // Init source history + pipeline (style content)
-  dt_develop_t dev_src = { 0 };
+/* A style source stack: the temporary develop stack holding the style modules and history,
+ * merged into the destination images. */
+typedef struct _styles_source_t
+{
+  dt_develop_t dev;
+  GList *si_list;
+  GHashTable *style_ids;
+  GList *mod_list;
+} _styles_source_t;
 
-  GList *si_list = NULL;
-  GHashTable *style_ids = NULL;
-  GList *mod_list = NULL;
+static void _styles_source_free(gpointer data)
+{
+  _styles_source_t *source = (_styles_source_t *)data;
+  if(IS_NULL_PTR(source)) return;
+  g_list_free(source->mod_list);
+  if(source->style_ids) g_hash_table_destroy(source->style_ids);
+  g_list_free_full(source->si_list, dt_style_item_free);
+  dt_dev_cleanup(&source->dev);
+  dt_free(source);
+}
 
-  if(_styles_prepare_source_dev(&dev_src, name, style_id, newimgid, &si_list, &style_ids, &mod_list))
+static _styles_source_t *_styles_source_new(const dt_styles_prepared_t *style, const int32_t imgid)
+{
+  _styles_source_t *source = g_new0(_styles_source_t, 1);
+  if(_styles_prepare_source_dev(&source->dev, style->items, style->iop_list, imgid, &source->si_list,
+                                &source->style_ids, &source->mod_list))
   {
-    dt_dev_cleanup(&dev_src);
-    return 1;
+    _styles_source_free(source);
+    return NULL;
   }
+  return source;
+}
+
+uint64_t dt_styles_source_signature(const dt_image_t *img, const char *module_order)
+{
+  // Everything the source stack is built from, besides the style itself: the pipeline order
+  // the image starts from (dt_ioppr_set_default_iop_order()), and what module defaults depend
+  // on: image type and camera. The style items overwrite the modules params and blending,
+  // so the rest of the image (exposure, dates, ratings...) does not reach the merged history,
+  // except for the orientation: flip converts legacy params against it.
+  const uint32_t flags = img->flags
+                         & (DT_IMAGE_LDR | DT_IMAGE_RAW | DT_IMAGE_HDR | DT_IMAGE_4BAYER | DT_IMAGE_MONOCHROME
+                            | DT_IMAGE_S_RAW | DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_BAYER
+                            | DT_IMAGE_MONOCHROME_WORKFLOW | DT_IMAGE_MOSAIC | DT_IMAGE_BUFFER_RESOLVED);
+  uint64_t hash = dt_hash(5381, (const char *)&flags, sizeof(flags));
+  hash = dt_hash(hash, img->camera_makermodel, strnlen(img->camera_makermodel, sizeof(img->camera_makermodel)));
+  hash = dt_hash(hash, img->exif_lens, strnlen(img->exif_lens, sizeof(img->exif_lens)));
+  const dt_image_orientation_t orientation = dt_image_orientation(img);
+  hash = dt_hash(hash, (const char *)&orientation, sizeof(orientation));
+  if(module_order) hash = dt_hash(hash, module_order, strlen(module_order) + 1);
+  return hash;
+}
 
-  if (DT_IOP_ORDER_INFO) fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i\n",newimgid, dt_dev_get_history_end_ext(&dev_src));
+static uint64_t _styles_image_signature(const int32_t imgid)
+{
+  const dt_image_t *img = dt_image_cache_get(imgid, 'r');
+  if(IS_NULL_PTR(img)) return 0;
 
-  if(mode == DT_HISTORY_MERGE_REPLACE)
+  // Images without their own order start from the built-in one matching their type,
+  // which the flags already account for.
+  gchar *module_order = NULL;
+  if(dt_history_repository_has_module_order(imgid))
   {
-    ret_val = dt_dev_replace_history_on_image(&dev_src, newimgid, TRUE, "_styles_apply_to_image_merge");
+    GList *iop_list = dt_ioppr_get_iop_order_list(imgid, FALSE);
+    module_order = dt_ioppr_serialize_text_iop_order_list(iop_list);
+    g_list_free_full(iop_list, dt_free_gpointer);
   }
-  else
+
+  const uint64_t signature = dt_styles_source_signature(img, module_order);
+  dt_image_cache_read_release(img);
+  dt_free(module_order);
+  return signature;
+}
+
+dt_styles_prepared_t *dt_styles_prepare(const char *name, const int style_id, const dt_history_merge_strategy_t mode)
+{
+  if(IS_NULL_PTR(name) || style_id <= 0) return NULL;
+
+  GList *items = _dt_styles_get_apply_items(style_id);
+  if(IS_NULL_PTR(items)) return NULL;
+
+  dt_styles_prepared_t *style = g_new0(dt_styles_prepared_t, 1);
+  style->name = g_strdup(name);
+  style->style_id = style_id;
+  style->mode = mode;
+  style->copy_iop_order = dt_conf_get_bool("history/style/copy_iop_order");
+  style->paste_instances = dt_conf_get_bool("history/paste_instances");
+  style->items = items;
+  style->iop_list = dt_styles_module_order_list(name);
+  style->sources = g_hash_table_new_full(g_int64_hash, g_int64_equal, dt_free_gpointer, _styles_source_free);
+  dt_pthread_mutex_init(&style->lock, NULL);
+  return style;
+}
+
+void dt_styles_prepared_free(dt_styles_prepared_t *style)
+{
+  if(IS_NULL_PTR(style)) return;
+  g_hash_table_destroy(style->sources);
+  g_list_free_full(style->iop_list, dt_free_gpointer);
+  g_list_free_full(style->items, dt_style_item_free);
+  dt_pthread_mutex_destroy(&style->lock);
+  dt_free(style->name);
+  dt_free(style);
+}
+
+// Get the source stack matching imgid, building it on first use
+static _styles_source_t *_styles_prepared_get_source(dt_styles_prepared_t *style, const int32_t imgid)
+{
+  const uint64_t signature = _styles_image_signature(imgid);
+
+  dt_pthread_mutex_lock(&style->lock);
+  _styles_source_t *source = g_hash_table_lookup(style->sources, &signature);
+  dt_pthread_mutex_unlock(&style->lock);
+  if(source) return source;
+
+  source = _styles_source_new(style, imgid);
+  if(IS_NULL_PTR(source)) return NULL;
+
+  // Another thread may have built the same one meanwhile: keep the first, sources are never
+  // removed before dt_styles_prepared_free() so the pointer stays valid.
+  dt_pthread_mutex_lock(&style->lock);
+  _styles_source_t *existing = g_hash_table_lookup(style->sources, &signature);
+  if(existing)
+  {
+    dt_pthread_mutex_unlock(&style->lock);
+    _styles_source_free(source);
+    return existing;
+  }
+  uint64_t *key = g_new(uint64_t, 1);
+  *key = signature;
+  g_hash_table_insert(style->sources, key, source);
+  dt_pthread_mutex_unlock(&style->lock);
+  return source;
+}
+
+int dt_styles_prepared_apply_to_image(dt_styles_prepared_t *style, const int32_t imgid, dt_hm_batch_state_t *batch)
+{
+  if(IS_NULL_PTR(style) || imgid <= 0) return 1;
+
+  if(style->mode == DT_HISTORY_MERGE_REPLACE)
+  {
+    // Replacing rebases the source stack on the destination image: it can't be shared.
+    _styles_source_t *source = _styles_source_new(style, imgid);
+    if(IS_NULL_PTR(source)) return 1;
+
+    if(DT_IOP_ORDER_INFO)
+      fprintf(stderr, "\n^^^^^ Apply style on image %i, history size %i\n", imgid,
+              dt_dev_get_history_end_ext(&source->dev));
+
+    const int ret_val = dt_dev_replace_history_on_image(&source->dev, imgid, TRUE, "_styles_apply_to_image_merge");
+    _styles_source_free(source);
+    return ret_val;
+  }
+
+  _styles_source_t *source = _styles_prepared_get_source(style, imgid);
+  if(IS_NULL_PTR(source)) return 1;
+
+  if(DT_IOP_ORDER_INFO)
+    fprintf(stderr, "\n^^^^^ Apply style on image %i, history size %i\n", imgid,
+            dt_dev_get_history_end_ext(&source->dev));
+
+  // Merging only reads the source stack, so images can share it, even concurrently.
+  return dt_dev_merge_history_into_image(&source->dev, imgid, source->mod_list, style->copy_iop_order,
+                                         style->mode, style->paste_instances, style->name, batch);
+}
+
+static gboolean _styles_prepared_apply_undoable(dt_styles_prepared_t *style, const int32_t imgid,
+                                                dt_hm_batch_state_t *batch, dt_undo_lt_history_t **undo)
+{
+  dt_undo_lt_history_t *hist = NULL;
+  if(undo)
   {
-    ret_val = dt_dev_merge_history_into_image(&dev_src, newimgid, mod_list,
-                                              dt_conf_get_bool("history/style/copy_iop_order"), mode,
-                                              dt_conf_get_bool("history/paste_instances"), name, batch);
+    hist = dt_history_snapshot_item_init();
+    hist->imgid = imgid;
+    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
   }
 
-  g_list_free(mod_list);
-  mod_list = NULL;
-  g_hash_table_destroy(style_ids);
-  g_list_free_full(si_list, dt_style_item_free);
-  si_list = NULL;
-  dt_dev_cleanup(&dev_src);
+  const gboolean changed = (dt_styles_prepared_apply_to_image(style, imgid, batch) == 0);
+
+  if(undo)
+  {
+    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+    *undo = hist;
+  }
+  return changed;
+}
+
+int dt_styles_prepared_apply_to_images(dt_styles_prepared_t *style, const int32_t *imgs, const int count,
+                                       dt_hm_batch_state_t *batch, const gboolean undo)
+{
+  if(IS_NULL_PTR(style) || IS_NULL_PTR(imgs) || count <= 0) return 0;
+
+  dt_undo_lt_history_t **hist = undo ? g_new0(dt_undo_lt_history_t *, count) : NULL;
+  int changed = 0;
+  int first = 0;
+
+  // Merge reports are shown one image at a time, from the caller. Go sequential until the user
+  // settled the decision for the whole batch, as the reports would show.
+  while(first < count && style->mode != DT_HISTORY_MERGE_REPLACE && dt_hm_batch_needs_report(batch))
+  {
+    changed += _styles_prepared_apply_undoable(style, imgs[first], batch, hist ? &hist[first] : NULL);
+    first++;
+  }
+
+  // From there, no report is expected: apply to the rest concurrently. Each image gets its
+  // own destination stack, the source stacks are shared read-only. Each worker merges against
+  // its own headless copy of the settled batch: nothing it writes is shared, and no dialog
+  // can open from inside the parallel region, even on the GUI thread that leads it.
+  // Thumbnails are refreshed from the GUI thread afterwards, their handler queues GTK redraws.
+  if(first < count)
+  {
+    gboolean *touched = g_new0(gboolean, count);
+    gboolean *deferred = g_new0(gboolean, count);
+    __OMP_PARALLEL__(reduction(+:changed))
+    {
+      dt_hm_batch_state_t worker;
+      dt_hm_batch_state_fork(&worker, batch);
+      dt_thumbnail_notify_hold(TRUE);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for(int k = first; k < count; k++)
+      {
+        touched[k] = _styles_prepared_apply_undoable(style, imgs[k], &worker, hist ? &hist[k] : NULL);
+        changed += touched[k] ? 1 : 0;
+        if(worker.deferred)
+        {
+          // Nothing was written, the image is redone below
+          deferred[k] = TRUE;
+          worker.deferred = FALSE;
+          if(hist)
+          {
+            dt_history_snapshot_undo_lt_history_data_free(hist[k]);
+            hist[k] = NULL;
+          }
+        }
+      }
+      dt_thumbnail_notify_hold(FALSE);
+      dt_hm_batch_state_cleanup(&worker);
+    }
+
+    // The images whose merge wants the report, typically because the order cached by the batch
+    // does not apply to them, are redone one at a time against the batch itself, never accepted
+    // silently.
+    dt_thumbnail_notify_hold(TRUE);
+    for(int k = first; k < count; k++)
+    {
+      if(!deferred[k]) continue;
+      touched[k] = _styles_prepared_apply_undoable(style, imgs[k], batch, hist ? &hist[k] : NULL);
+      changed += touched[k] ? 1 : 0;
+    }
+    dt_thumbnail_notify_hold(FALSE);
+    dt_free(deferred);
+
+    int32_t *changed_imgs = g_new(int32_t, count - first);
+    int n = 0;
+    for(int k = first; k < count; k++)
+      if(touched[k]) changed_imgs[n++] = imgs[k];
+    dt_thumbnail_notify_images_changed(changed_imgs, n, TRUE);
+    dt_free(changed_imgs);
+    dt_free(touched);
+  }
+
+  // Undo steps are recorded in the images order, from the calling thread
+  for(int k = 0; hist && k < count; k++)
+    if(hist[k])
+      dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist[k],
+                     dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_free(hist);
+
+  return changed;
+}
+
+int dt_styles_apply_to_image_merge(const char *name, const int style_id, const int32_t newimgid,
+                                   const dt_history_merge_strategy_t mode, dt_hm_batch_state_t *batch)
+{
+  dt_styles_prepared_t *style = dt_styles_prepare(name, style_id, mode);
+  if(IS_NULL_PTR(style)) return 1;
 
+  const int ret_val = dt_styles_prepared_apply_to_image(style, newimgid, batch);
+  dt_styles_prepared_free(style);
   return ret_val;
 }
 
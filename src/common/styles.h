@@ -105,6 +105,42 @@ void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const
 int dt_styles_apply_to_image_merge(const char *name, const int style_id, const int32_t newimgid,
                                    const dt_history_merge_strategy_t mode, dt_hm_batch_state_t *batch);
 
+/**
+ * @brief A style resolved once, to be applied to many images.
+ *
+ * @details Applying a style builds a temporary develop stack holding the style modules and
+ * history, then merges it into the image. That stack only depends on the style and on a few
+ * properties of the image (see dt_styles_source_signature()), so a prepared style reads the
+ * style items and module order once, and builds one stack per distinct signature instead of
+ * one per image. dt_styles_apply_to_image_merge() goes through it too.
+ */
+typedef struct dt_styles_prepared_t dt_styles_prepared_t;
+
+/** read the style items and module order, and the merge preferences. NULL if the style is empty. */
+dt_styles_prepared_t *dt_styles_prepare(const char *name, const int style_id, const dt_history_merge_strategy_t mode);
+void dt_styles_prepared_free(dt_styles_prepared_t *style);
+
+/** apply a prepared style to one image. Thread-safe, as long as concurrent calls do not share
+ * @p batch (see dt_hm_batch_state_fork()). Returns 0 on success. */
+int dt_styles_prepared_apply_to_image(dt_styles_prepared_t *style, const int32_t imgid, dt_hm_batch_state_t *batch);
+
+/**
+ * @brief Apply a prepared style to `count` images, concurrently once no merge report can show up.
+ *
+ * @param batch only read and written by the images applied from the calling thread. The
+ * concurrent ones each get a headless copy of it, and those whose merge would have opened the
+ * report are redone against @p batch afterwards, from the calling thread.
+ * @param undo record one lighttable history undo step per image, in the images order.
+ * Starting the undo group is left to the caller.
+ * @return the number of images the style was applied to.
+ */
+int dt_styles_prepared_apply_to_images(dt_styles_prepared_t *style, const int32_t *imgs, const int count,
+                                       dt_hm_batch_state_t *batch, const gboolean undo);
+
+/** key of the source stack used for an image. `module_order` is the serialized module order
+    owned by the image, or NULL when it uses the built-in one. */
+uint64_t dt_styles_source_signature(const dt_image_t *img, const char *module_order);
+
 /** delete a style by name */
 void dt_styles_delete_by_name_adv(const char *name, const gboolean raise);
 
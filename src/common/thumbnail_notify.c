@@ -26,12 +26,58 @@ void dt_thumbnail_notify_set_handler(dt_thumbnail_refresh_handler_t handler)
   _handler = handler;
 }
 
+// Set on the workers of a parallel batch, see dt_thumbnail_notify_hold().
+static __thread gboolean _held = FALSE;
+
+typedef struct _notify_images_t
+{
+  GArray *imgs;
+  gboolean refresh_filmstrip;
+} _notify_images_t;
+
 void dt_thumbnail_notify_image_changed(int32_t imgid, gboolean refresh_filmstrip)
 {
-  if(_handler == NULL) return;
+  if(_handler == NULL || _held) return;
   _handler(imgid, refresh_filmstrip);
 }
 
+void dt_thumbnail_notify_hold(gboolean hold)
+{
+  _held = hold;
+}
+
+static gboolean _notify_images(gpointer data)
+{
+  const _notify_images_t *n = (const _notify_images_t *)data;
+  for(guint k = 0; k < n->imgs->len; k++) _handler(g_array_index(n->imgs, int32_t, k), n->refresh_filmstrip);
+  return G_SOURCE_REMOVE;
+}
+
+static void _notify_images_free(gpointer data)
+{
+  _notify_images_t *n = (_notify_images_t *)data;
+  g_array_free(n->imgs, TRUE);
+  g_free(n);
+}
+
+void dt_thumbnail_notify_images_changed(const int32_t *imgs, int count, gboolean refresh_filmstrip)
+{
+  if(_handler == NULL || count <= 0) return;
+
+  _notify_images_t *n = g_new(_notify_images_t, 1);
+  n->imgs = g_array_sized_new(FALSE, FALSE, sizeof(int32_t), count);
+  g_array_append_vals(n->imgs, imgs, count);
+  n->refresh_filmstrip = refresh_filmstrip;
+
+  if(g_main_context_is_owner(g_main_context_default()))
+  {
+    _notify_images(n);
+    _notify_images_free(n);
+  }
+  else
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, _notify_images, n, _notify_images_free);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
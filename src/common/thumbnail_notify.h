@@ -40,9 +40,10 @@
  * "is there a GUI?" guard.
  *
  * Threading: the handler is set once during GUI init, before any worker thread can run a
- * path that notifies, and never cleared. Handlers must be safe to invoke from whatever
- * thread mutated the image -- dt_thumbtable_refresh_thumbnail() already marshals to the
- * GUI thread itself.
+ * path that notifies, and never cleared. It is invoked on the thread that mutated the
+ * image, and the GUI one queues widget redraws. Workers running next to each other
+ * therefore hold their notifications (dt_thumbnail_notify_hold()), and their caller sends
+ * them at once from the GUI thread (dt_thumbnail_notify_images_changed()).
  */
 typedef void (*dt_thumbnail_refresh_handler_t)(int32_t imgid, gboolean refresh_filmstrip);
 
@@ -59,4 +60,12 @@ void dt_thumbnail_notify_set_handler(dt_thumbnail_refresh_handler_t handler);
  *  Safe to call with no handler registered. */
 void dt_thumbnail_notify_image_changed(int32_t imgid, gboolean refresh_filmstrip);
 
+/** Drop the notifications raised from the calling thread while `hold` is TRUE. For
+ *  workers whose caller announces the images they changed itself, once they are done. */
+void dt_thumbnail_notify_hold(gboolean hold);
+
+/** Announce `count` stale thumbnails at once, from the GUI thread: called on it, the
+ *  handler runs right away, otherwise it is queued there. */
+void dt_thumbnail_notify_images_changed(const int32_t *imgs, int count, gboolean refresh_filmstrip);
+
 #endif // DT_COMMON_THUMBNAIL_NOTIFY_H
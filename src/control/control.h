@@ -230,15 +230,15 @@ typedef struct dt_control_t
 
   // job management
   int32_t running;
-  gboolean export_scheduled;
+  // queue_mutex guards `job`, the jobs currently running, for deduplication
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread;
   dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  // per-worker deques of queued jobs, see control/job_scheduler.h
+  struct dt_job_scheduler_t *scheduler;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
@@ -0,0 +1,389 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Aurélien Pierre.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "control/job_scheduler.h"
+#include "system/dtpthread.h"
+#include "system/macros.h"
+
+typedef struct _sched_node_t
+{
+  void *job;
+  guint8 priority;
+} _sched_node_t;
+
+typedef struct _sched_deque_t
+{
+  dt_pthread_mutex_t lock;
+  GQueue classes[DT_JOB_QUEUE_MAX];
+} _sched_deque_t;
+
+struct dt_job_scheduler_t
+{
+  int workers;
+  int export_slots;
+  size_t max_stacked;
+  // One allocation per deque, so two workers' locks never share a cacheline.
+  _sched_deque_t **deques;
+
+  gint next_deque;                // round-robin cursor for pushes from outside the pool
+  gint pending[DT_JOB_QUEUE_MAX]; // queued jobs per class, all deques
+  gint exports_running;
+
+  // Counters only, bumped with atomics: a lock here would be the global mutex all over again.
+  gint pushed, popped, stolen, duplicates, evicted;
+};
+
+static inline gboolean _is_foreground(const int queue)
+{
+  return queue == DT_JOB_QUEUE_USER_FG || queue == DT_JOB_QUEUE_SYSTEM_FG;
+}
+
+dt_job_scheduler_t *dt_job_scheduler_new(const int workers, const int export_slots, const size_t max_stacked)
+{
+  dt_job_scheduler_t *s = g_new0(dt_job_scheduler_t, 1);
+  s->workers = MAX(workers, 1);
+  s->export_slots = MAX(export_slots, 1);
+  s->max_stacked = MAX(max_stacked, 1);
+  s->deques = g_new0(_sched_deque_t *, s->workers);
+  for(int k = 0; k < s->workers; k++)
+  {
+    _sched_deque_t *d = g_new0(_sched_deque_t, 1);
+    dt_pthread_mutex_init(&d->lock, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_init(&d->classes[i]);
+    s->deques[k] = d;
+  }
+  return s;
+}
+
+void dt_job_scheduler_free(dt_job_scheduler_t *s)
+{
+  if(IS_NULL_PTR(s)) return;
+  for(int k = 0; k < s->workers; k++)
+  {
+    _sched_deque_t *d = s->deques[k];
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_clear_full(&d->classes[i], g_free);
+    dt_pthread_mutex_destroy(&d->lock);
+    g_free(d);
+  }
+  g_free(s->deques);
+  g_free(s);
+}
+
+static gboolean _acquire_export_slot(dt_job_scheduler_t *s)
+{
+  int running = g_atomic_int_get(&s->exports_running);
+  while(running < s->export_slots)
+  {
+    if(g_atomic_int_compare_and_exchange(&s->exports_running, running, running + 1)) return TRUE;
+    running = g_atomic_int_get(&s->exports_running);
+  }
+  return FALSE;
+}
+
+// Class whose head wins the next pick in `d`, or -1. Caller holds d->lock.
+// Strictly-greater comparison in class order: ties go to the lower class number.
+static int _best_class(dt_job_scheduler_t *s, _sched_deque_t *d, const gboolean foreground_only)
+{
+  int best = -1;
+  int max_priority = -1;
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(foreground_only && !_is_foreground(i)) continue;
+    if(i == DT_JOB_QUEUE_USER_EXPORT && g_atomic_int_get(&s->exports_running) >= s->export_slots) continue;
+    const _sched_node_t *head = (const _sched_node_t *)g_queue_peek_head(&d->classes[i]);
+    if(head && head->priority > max_priority)
+    {
+      max_priority = head->priority;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Pop the head of class `queue` in `d` and age the heads it passed over. Caller holds d->lock.
+static void *_take(dt_job_scheduler_t *s, _sched_deque_t *d, const int queue)
+{
+  _sched_node_t *node = (_sched_node_t *)g_queue_pop_head(&d->classes[queue]);
+  void *job = node->job;
+  g_free(node);
+  g_atomic_int_add(&s->pending[queue], -1);
+
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(i == queue) continue;
+    _sched_node_t *head = (_sched_node_t *)g_queue_peek_head(&d->classes[i]);
+    if(head && head->priority < G_MAXUINT8) head->priority++;
+  }
+  return job;
+}
+
+// Pick the best job of `d`, honouring the export slots. Caller holds d->lock.
+static void *_pick(dt_job_scheduler_t *s, _sched_deque_t *d, const gboolean foreground_only, int *queue)
+{
+  int best = _best_class(s, d, foreground_only);
+  if(best == DT_JOB_QUEUE_USER_EXPORT && !_acquire_export_slot(s))
+  {
+    // another worker took the last slot between the check and now: pick among the others
+    best = -1;
+    int max_priority = -1;
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      if(i == DT_JOB_QUEUE_USER_EXPORT || (foreground_only && !_is_foreground(i))) continue;
+      const _sched_node_t *head = (const _sched_node_t *)g_queue_peek_head(&d->classes[i]);
+      if(head && head->priority > max_priority)
+      {
+        max_priority = head->priority;
+        best = i;
+      }
+    }
+  }
+  if(best < 0) return NULL;
+  *queue = best;
+  return _take(s, d, best);
+}
+
+static void *_steal(dt_job_scheduler_t *s, const int self, const gboolean foreground_only, int *queue)
+{
+  const int first = (self >= 0) ? self + 1 : 0;
+  const int victims = (self >= 0) ? s->workers - 1 : s->workers;
+  for(int v = 0; v < victims; v++)
+  {
+    _sched_deque_t *d = s->deques[(first + v) % s->workers];
+    dt_pthread_mutex_lock(&d->lock);
+    void *job = _pick(s, d, foreground_only, queue);
+    dt_pthread_mutex_unlock(&d->lock);
+    if(job)
+    {
+      if(self >= 0) g_atomic_int_inc(&s->stolen);
+      return job;
+    }
+  }
+  return NULL;
+}
+
+void *dt_job_scheduler_pop(dt_job_scheduler_t *s, const int worker, dt_job_queue_t *queue)
+{
+  const int self = (worker >= 0 && worker < s->workers) ? worker : -1;
+  int picked = DT_JOB_QUEUE_MAX;
+  void *job = NULL;
+
+  if(self >= 0)
+  {
+    _sched_deque_t *own = s->deques[self];
+    dt_pthread_mutex_lock(&own->lock);
+    const int best = _best_class(s, own, FALSE);
+    const _sched_node_t *head
+        = (best >= 0) ? (const _sched_node_t *)g_queue_peek_head(&own->classes[best]) : NULL;
+
+    // Our best is foreground, or background work that aged past the foreground priority: it
+    // is what the old global pick would have chosen too, take it.
+    if(head && (_is_foreground(best) || head->priority > DT_JOB_SCHEDULER_FG_PRIORITY))
+      job = _pick(s, own, FALSE, &picked);
+    dt_pthread_mutex_unlock(&own->lock);
+
+    // Only fresh background work here, or nothing: foreground work waiting in another deque
+    // goes first. The background heads we skip still age, so they are not starved.
+    if(IS_NULL_PTR(job)
+       && (g_atomic_int_get(&s->pending[DT_JOB_QUEUE_USER_FG]) > 0
+           || g_atomic_int_get(&s->pending[DT_JOB_QUEUE_SYSTEM_FG]) > 0))
+    {
+      job = _steal(s, self, TRUE, &picked);
+      if(job)
+      {
+        dt_pthread_mutex_lock(&own->lock);
+        for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+        {
+          _sched_node_t *h = (_sched_node_t *)g_queue_peek_head(&own->classes[i]);
+          if(h && h->priority < G_MAXUINT8) h->priority++;
+        }
+        dt_pthread_mutex_unlock(&own->lock);
+      }
+    }
+
+    if(IS_NULL_PTR(job))
+    {
+      dt_pthread_mutex_lock(&own->lock);
+      job = _pick(s, own, FALSE, &picked);
+      dt_pthread_mutex_unlock(&own->lock);
+    }
+  }
+
+  if(IS_NULL_PTR(job)) job = _steal(s, self, FALSE, &picked);
+  if(IS_NULL_PTR(job)) return NULL;
+
+  g_atomic_int_inc(&s->popped);
+  if(queue) *queue = (dt_job_queue_t)picked;
+  return job;
+}
+
+void dt_job_scheduler_finish(dt_job_scheduler_t *s, const dt_job_queue_t queue)
+{
+  if(queue == DT_JOB_QUEUE_USER_EXPORT) g_atomic_int_add(&s->exports_running, -1);
+}
+
+// Remove and return the node of a SYSTEM_FG job equal to `job`, from any deque, or NULL.
+static _sched_node_t *_unlink_equal(dt_job_scheduler_t *s, const void *job, dt_job_scheduler_equal_t equal)
+{
+  for(int k = 0; k < s->workers; k++)
+  {
+    _sched_deque_t *d = s->deques[k];
+    dt_pthread_mutex_lock(&d->lock);
+    GQueue *stack = &d->classes[DT_JOB_QUEUE_SYSTEM_FG];
+    for(GList *iter = stack->head; iter; iter = g_list_next(iter))
+    {
+      _sched_node_t *node = (_sched_node_t *)iter->data;
+      if(equal(node->job, job))
+      {
+        g_queue_delete_link(stack, iter);
+        g_atomic_int_add(&s->pending[DT_JOB_QUEUE_SYSTEM_FG], -1);
+        dt_pthread_mutex_unlock(&d->lock);
+        return node;
+      }
+    }
+    dt_pthread_mutex_unlock(&d->lock);
+  }
+  return NULL;
+}
+
+// Drop the oldest stacked job, preferring `d` (locked by the caller) but never `keep`.
+static void *_evict_oldest(dt_job_scheduler_t *s, _sched_deque_t *d, const _sched_node_t *keep)
+{
+  GQueue *stack = &d->classes[DT_JOB_QUEUE_SYSTEM_FG];
+  _sched_node_t *tail = (_sched_node_t *)g_queue_peek_tail(stack);
+  if(IS_NULL_PTR(tail) || tail == keep) return NULL;
+  g_queue_pop_tail(stack);
+  g_atomic_int_add(&s->pending[DT_JOB_QUEUE_SYSTEM_FG], -1);
+  void *job = tail->job;
+  g_free(tail);
+  return job;
+}
+
+gboolean dt_job_scheduler_push(dt_job_scheduler_t *s, const int worker, const dt_job_queue_t queue, void *job,
+                               dt_job_scheduler_equal_t equal, dt_job_scheduler_queued_t queued,
+                               void **evicted)
+{
+  if(evicted) *evicted = NULL;
+
+  const int target = (worker >= 0 && worker < s->workers)
+                         ? worker
+                         : (int)(((guint)g_atomic_int_add(&s->next_deque, 1)) % (guint)s->workers);
+  _sched_deque_t *d = s->deques[target];
+
+  _sched_node_t *node = NULL;
+  gboolean queued_ours = TRUE;
+  if(queue == DT_JOB_QUEUE_SYSTEM_FG && equal)
+  {
+    // Already asked for: bubble the queued copy up to the top of our stack, keep its
+    // accumulated priority, and hand ours back to the caller.
+    node = _unlink_equal(s, job, equal);
+    if(node)
+    {
+      queued_ours = FALSE;
+      g_atomic_int_inc(&s->duplicates);
+    }
+  }
+  if(IS_NULL_PTR(node))
+  {
+    node = g_new(_sched_node_t, 1);
+    node->job = job;
+    node->priority = _is_foreground(queue) ? DT_JOB_SCHEDULER_FG_PRIORITY : 0;
+  }
+
+  void *dropped = NULL;
+  dt_pthread_mutex_lock(&d->lock);
+  if(queued) queued(node->job);
+  if(queue == DT_JOB_QUEUE_SYSTEM_FG)
+    g_queue_push_head(&d->classes[queue], node);
+  else
+    g_queue_push_tail(&d->classes[queue], node);
+  const size_t stacked = (size_t)g_atomic_int_add(&s->pending[queue], 1) + 1;
+  if(queue == DT_JOB_QUEUE_SYSTEM_FG && stacked > s->max_stacked) dropped = _evict_oldest(s, d, node);
+  dt_pthread_mutex_unlock(&d->lock);
+
+  // Our own stack held only the job we just pushed: evict from the fullest other one.
+  if(queue == DT_JOB_QUEUE_SYSTEM_FG && stacked > s->max_stacked && IS_NULL_PTR(dropped))
+  {
+    int fullest = -1;
+    guint longest = 0;
+    for(int k = 0; k < s->workers; k++)
+    {
+      if(k == target) continue;
+      dt_pthread_mutex_lock(&s->deques[k]->lock);
+      const guint length = g_queue_get_length(&s->deques[k]->classes[DT_JOB_QUEUE_SYSTEM_FG]);
+      dt_pthread_mutex_unlock(&s->deques[k]->lock);
+      if(length > longest)
+      {
+        longest = length;
+        fullest = k;
+      }
+    }
+    if(fullest >= 0)
+    {
+      dt_pthread_mutex_lock(&s->deques[fullest]->lock);
+      dropped = _evict_oldest(s, s->deques[fullest], node);
+      dt_pthread_mutex_unlock(&s->deques[fullest]->lock);
+    }
+  }
+
+  if(dropped) g_atomic_int_inc(&s->evicted);
+  if(evicted) *evicted = dropped;
+  if(queued_ours) g_atomic_int_inc(&s->pushed);
+  return queued_ours;
+}
+
+size_t dt_job_scheduler_pending(dt_job_scheduler_t *s, const dt_job_queue_t queue)
+{
+  if((unsigned int)queue >= DT_JOB_QUEUE_MAX) return 0;
+  return (size_t)MAX(g_atomic_int_get(&s->pending[queue]), 0);
+}
+
+GList *dt_job_scheduler_drain(dt_job_scheduler_t *s)
+{
+  GList *jobs = NULL;
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    for(int k = 0; k < s->workers; k++)
+    {
+      _sched_deque_t *d = s->deques[k];
+      dt_pthread_mutex_lock(&d->lock);
+      _sched_node_t *node = NULL;
+      while((node = (_sched_node_t *)g_queue_pop_head(&d->classes[i])))
+      {
+        jobs = g_list_prepend(jobs, node->job);
+        g_free(node);
+        g_atomic_int_add(&s->pending[i], -1);
+      }
+      dt_pthread_mutex_unlock(&d->lock);
+    }
+  g_atomic_int_set(&s->exports_running, 0);
+  return g_list_reverse(jobs);
+}
+
+void dt_job_scheduler_get_stats(dt_job_scheduler_t *s, dt_job_scheduler_stats_t *stats)
+{
+  stats->pushed = (guint)g_atomic_int_get(&s->pushed);
+  stats->popped = (guint)g_atomic_int_get(&s->popped);
+  stats->stolen = (guint)g_atomic_int_get(&s->stolen);
+  stats->duplicates = (guint)g_atomic_int_get(&s->duplicates);
+  stats->evicted = (guint)g_atomic_int_get(&s->evicted);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,118 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Aurélien Pierre.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_CONTROL_JOB_SCHEDULER_H
+#define DT_CONTROL_JOB_SCHEDULER_H
+
+#include "control/jobs.h" // dt_job_queue_t
+
+#include <glib.h>
+
+/**
+ * Work-stealing scheduler behind the background job queues.
+ *
+ * The five dt_job_queue_t classes used to be five global lists under one mutex, walked by
+ * every worker on every pick. With many workers and short jobs (thumbnails), the workers spent
+ * their time convoying on that mutex, and the single export slot left the rest of the pool
+ * idle while an export ran.
+ *
+ * Each worker now owns a deque holding one FIFO per class (a LIFO for SYSTEM_FG, which is a
+ * most-recent-first stack, as before). A worker pushing a job keeps it in its own deque; other
+ * threads (the GUI) spread their jobs round-robin. A worker picks from its own deque, and when
+ * that is empty, or when it only holds background work while foreground work waits elsewhere,
+ * it steals from the others. Only one deque lock is held at any time.
+ *
+ * The queue semantics are kept as priorities: foreground classes start at
+ * DT_JOB_SCHEDULER_FG_PRIORITY and background ones at 0, and every pick from a deque ages the
+ * heads it passed over by one, so background work still gets its turn within a few picks under
+ * a steady stream of thumbnails. Ties go to the lower class number. USER_EXPORT is limited to
+ * `export_slots` concurrent jobs across the whole pool.
+ *
+ * The scheduler only moves opaque job pointers: job states, callbacks and disposal stay in
+ * control/jobs.c.
+ */
+
+#define DT_JOB_SCHEDULER_FG_PRIORITY 4
+
+typedef struct dt_job_scheduler_t dt_job_scheduler_t;
+
+/** TRUE if two jobs do the same work, so only one needs to be queued. */
+typedef gboolean (*dt_job_scheduler_equal_t)(const void *a, const void *b);
+
+/** Called on a job right before another worker can see it, under the deque lock. */
+typedef void (*dt_job_scheduler_queued_t)(void *job);
+
+typedef struct dt_job_scheduler_stats_t
+{
+  guint64 pushed;
+  guint64 popped;
+  guint64 stolen;     // popped from another worker's deque
+  guint64 duplicates; // pushes folded into an equal queued job
+  guint64 evicted;    // stacked jobs dropped past the capacity
+} dt_job_scheduler_stats_t;
+
+/**
+ * @param workers       number of worker deques, >= 1.
+ * @param export_slots  maximal number of USER_EXPORT jobs popped and not yet finished.
+ * @param max_stacked   capacity of the SYSTEM_FG stack, across all deques.
+ */
+dt_job_scheduler_t *dt_job_scheduler_new(int workers, int export_slots, size_t max_stacked);
+
+/** Free the scheduler. Queued jobs are leaked: dt_job_scheduler_drain() them first. */
+void dt_job_scheduler_free(dt_job_scheduler_t *s);
+
+/**
+ * Queue `job` in class `queue`.
+ *
+ * @param worker     index of the calling worker, or any out-of-range value from other threads.
+ * @param equal      for SYSTEM_FG only: when an equal job is already queued, that one is moved
+ *                   on top of the stack instead and `job` is NOT queued. May be NULL.
+ * @param queued     called on the job that ends up queued, before any worker can pop it.
+ * @param evicted    set to the oldest SYSTEM_FG job dropped to keep the stack within capacity,
+ *                   or NULL. The caller owns it.
+ * @return TRUE if `job` was queued, FALSE if it was a duplicate and the caller still owns it.
+ */
+gboolean dt_job_scheduler_push(dt_job_scheduler_t *s, int worker, dt_job_queue_t queue, void *job,
+                               dt_job_scheduler_equal_t equal, dt_job_scheduler_queued_t queued,
+                               void **evicted);
+
+/**
+ * Pop the next job for `worker`, from its deque or stolen from another one. NULL when there
+ * is nothing runnable. A USER_EXPORT job holds an export slot until
+ * dt_job_scheduler_finish() is called for it.
+ */
+void *dt_job_scheduler_pop(dt_job_scheduler_t *s, int worker, dt_job_queue_t *queue);
+
+/** Report the end of a popped job of class `queue`. */
+void dt_job_scheduler_finish(dt_job_scheduler_t *s, dt_job_queue_t queue);
+
+/** Number of jobs queued in class `queue`, across all deques. Advisory. */
+size_t dt_job_scheduler_pending(dt_job_scheduler_t *s, dt_job_queue_t queue);
+
+/** Detach every queued job, in class order, and return them. The caller disposes them. */
+GList *dt_job_scheduler_drain(dt_job_scheduler_t *s);
+
+void dt_job_scheduler_get_stats(dt_job_scheduler_t *s, dt_job_scheduler_stats_t *stats);
+
+#endif // DT_CONTROL_JOB_SCHEDULER_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
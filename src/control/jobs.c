@@ -27,11 +27,11 @@
 #include "system/sys_resources.h"
 #include "control/jobs.h"
 #include "control/control.h"
+#include "control/job_scheduler.h"
+#include "common/conf.h"
 #include "common/times.h"
 #include "common/logging.h"
 
-#define DT_CONTROL_FG_PRIORITY 4
-
 // The thumbtable allows at most 840 thumbs at once.
 // Once an order to recompute has been dispatched, thumbnails are not drawn
 // until it finishes and we get the final buffer.
@@ -61,7 +61,6 @@ typedef struct _dt_job_t
   dt_pthread_mutex_t wait_mutex;
 
   dt_job_state_t state;
-  unsigned char priority;
   dt_job_queue_t queue;
 
   dt_job_state_change_callback state_changed_cb;
@@ -73,7 +72,7 @@ typedef struct _dt_job_t
 
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
-    we don't want to compare result, priority or state since these will change during the course of
+    we don't want to compare result or state since these will change during the course of
    processing.
     NOTE: maybe allow to pass a comparator for params.
  */
@@ -87,6 +86,11 @@ static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
           && (g_strcmp0(j1->description, j2->description) == 0));
 }
 
+static gboolean _job_equal(const void *j1, const void *j2)
+{
+  return dt_control_job_equal((_dt_job_t *)j1, (_dt_job_t *)j2);
+}
+
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
 {
   if(IS_NULL_PTR(job)) return;
@@ -102,6 +106,12 @@ static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
   dt_pthread_mutex_unlock(&job->state_mutex);
 }
 
+// scheduler callback: the job becomes visible to the workers right after this
+static void _job_set_queued(void *job)
+{
+  dt_control_job_set_state((_dt_job_t *)job, DT_JOB_STATE_QUEUED);
+}
+
 dt_job_state_t dt_control_job_get_state(_dt_job_t *job)
 {
   if(IS_NULL_PTR(job)) return DT_JOB_STATE_DISPOSED;
@@ -176,7 +186,7 @@ void dt_control_job_set_state_callback(_dt_job_t *job, dt_job_state_change_callb
 static void dt_control_job_print(_dt_job_t *job)
 {
   if(IS_NULL_PTR(job)) return;
-  dt_print(DT_DEBUG_CONTROL, "%s | queue: %d | priority: %d", job->description, job->queue, job->priority);
+  dt_print(DT_DEBUG_CONTROL, "%s | queue: %d", job->description, job->queue);
 }
 
 void dt_control_job_cancel(_dt_job_t *job)
@@ -243,61 +253,25 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
 static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
 {
   /*
-   * job scheduling works like this:
-   * - when there is a single job in the queue head with a maximal priority -> pick it
-   * - otherwise pick among the ones with the maximal priority in the following order:
+   * job scheduling works like this, see control/job_scheduler.h:
+   * - every worker owns a deque of jobs, and picks the job with the maximal priority at its
+   *   heads, in the following order on ties:
    *   * user foreground
    *   * system foreground
    *   * user background
+   *   * user export (at most `export_workers` at a time)
    *   * system background
+   * - a worker holding only background work first steals foreground work from the others,
+   *   and an idle worker steals anything
    * - the jobs that didn't get picked this round get their priority incremented
    */
+  const int32_t threadid = dt_control_get_threadid();
+  _dt_job_t *job = (_dt_job_t *)dt_job_scheduler_pop(control->scheduler, threadid, NULL);
+  if(IS_NULL_PTR(job)) return NULL;
 
+  // place it in scheduled job array (for job deduping)
   dt_pthread_mutex_lock(&control->queue_mutex);
-
-  // find the job
-  _dt_job_t *job = NULL;
-  int winner_queue = DT_JOB_QUEUE_MAX;
-  int max_priority = -1;
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
-    {
-      max_priority = _job->priority;
-      job = _job;
-      winner_queue = i;
-    }
-  }
-
-  if(IS_NULL_PTR(job))
-  {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
-  }
-
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
-
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
-
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
-
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
-  }
-
+  control->job[threadid] = job;
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
   return job;
@@ -339,8 +313,8 @@ static int32_t dt_control_run_job(dt_control_t *control)
   // remove the job from scheduled job array (for job deduping)
   dt_pthread_mutex_lock(&control->queue_mutex);
   control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
   dt_pthread_mutex_unlock(&control->queue_mutex);
+  dt_job_scheduler_finish(control->scheduler, job->queue);
 
   // and free it
   dt_control_job_dispose(job);
@@ -425,100 +399,63 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
   job->queue = queue_id;
 
-  _dt_job_t *job_for_disposal = NULL;
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %" G_GSIZE_FORMAT " | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %" G_GSIZE_FORMAT " | ",
+           dt_job_scheduler_pending(control->scheduler, queue_id));
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
   if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
   {
-    // this is a stack with limited size and bubble up and all that stuff
-    job->priority = DT_CONTROL_FG_PRIORITY;
-
+    // this is a stack with limited size and bubble up and all that stuff.
     // check if we have already scheduled the job
-    for(int k = 0; k < control->num_threads; k++)
-    {
-      _dt_job_t *other_job = (_dt_job_t *)control->job[k];
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        dt_pthread_mutex_unlock(&control->queue_mutex);
-
-        dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
-        dt_control_job_dispose(job);
-
-        return 0; // there can't be any further copy
-      }
-    }
+    _dt_job_t *running_job = NULL;
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    for(int k = 0; k < control->num_threads && IS_NULL_PTR(running_job); k++)
+      if(dt_control_job_equal(job, (_dt_job_t *)control->job[k])) running_job = (_dt_job_t *)control->job[k];
 
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    if(running_job)
     {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
-
-        job_for_disposal = job;
-
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
+      dt_control_job_print(running_job);
+      dt_print(DT_DEBUG_CONTROL, "\n");
     }
+    dt_pthread_mutex_unlock(&control->queue_mutex);
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
-
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    if(running_job)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(job);
+      return 0; // there can't be any further copy
     }
-
-    control->queue_length[queue_id] = length;
   }
-  else
-  {
-    // the rest are FIFOs
-    if(queue_id == DT_JOB_QUEUE_USER_BG ||
-       queue_id == DT_JOB_QUEUE_USER_EXPORT ||
-       queue_id == DT_JOB_QUEUE_SYSTEM_BG)
-      job->priority = 0;
-    else
-      job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
-  }
-  dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  // the scheduler moves an equal job already in the stack to its top instead of queuing ours,
+  // and drops the oldest stacked job past DT_CONTROL_MAX_JOBS.
+  _dt_job_t *evicted = NULL;
+  const gboolean queued
+      = dt_job_scheduler_push(control->scheduler, dt_control_get_threadid(), queue_id, job,
+                              (queue_id == DT_JOB_QUEUE_SYSTEM_FG) ? _job_equal : NULL, _job_set_queued,
+                              (void **)&evicted);
 
   // notify workers
   dt_pthread_mutex_lock(&control->cond_mutex);
   pthread_cond_broadcast(&control->cond);
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
-  // dispose of dropped job, if any
-  dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
-  dt_control_job_dispose(job_for_disposal);
+  // dispose of dropped jobs, if any
+  if(!queued)
+  {
+    dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+    dt_control_job_print(job);
+    dt_print(DT_DEBUG_CONTROL, "\n");
+    dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job);
+  }
+  if(evicted)
+  {
+    dt_control_job_set_state(evicted, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(evicted);
+  }
 
   return 0;
 }
@@ -645,6 +582,10 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  // keep at least one worker free of exports when there is more than one, so thumbnails and
+  // GUI jobs never wait behind a batch export
+  const int export_workers = CLAMP(dt_conf_get_int("export_workers"), 1, MAX(control->num_threads - 1, 1));
+  control->scheduler = dt_job_scheduler_new(control->num_threads, export_workers, DT_CONTROL_MAX_JOBS);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -678,17 +619,9 @@ void dt_control_jobs_drain(dt_control_t *control)
   // its callbacks (state_changed_cb via DT_JOB_STATE_DISPOSED, then params_destroy), which for
   // module jobs point into a plug-in .so -- so these callbacks must NOT be invoked while holding
   // queue_mutex (re-entrancy), and the whole drain must happen before those .so files are
-  // unloaded. Workers are already joined when this runs, so detaching the lists is race-free.
-  GList *doomed = NULL;
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    doomed = g_list_concat(doomed, control->queues[i]);
-    control->queues[i] = NULL;
-    control->queue_length[i] = 0;
-  }
-  control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // unloaded. Workers are already joined when this runs, so detaching the deques is race-free.
+  if(IS_NULL_PTR(control->scheduler)) return;
+  GList *doomed = dt_job_scheduler_drain(control->scheduler);
 
   for(GList *l = doomed; l; l = g_list_next(l))
     dt_control_job_dispose((_dt_job_t *)l->data);
@@ -702,6 +635,18 @@ void dt_control_jobs_cleanup(dt_control_t *control)
   // headless export run); it is a no-op when the queues are already empty.
   dt_control_jobs_drain(control);
 
+  if(control->scheduler)
+  {
+    dt_job_scheduler_stats_t stats;
+    dt_job_scheduler_get_stats(control->scheduler, &stats);
+    dt_print(DT_DEBUG_CONTROL,
+             "[jobs] %" G_GUINT64_FORMAT " queued, %" G_GUINT64_FORMAT " run, %" G_GUINT64_FORMAT
+             " stolen, %" G_GUINT64_FORMAT " deduplicated, %" G_GUINT64_FORMAT " evicted\n",
+             stats.pushed, stats.popped, stats.stolen, stats.duplicates, stats.evicted);
+    dt_job_scheduler_free(control->scheduler);
+    control->scheduler = NULL;
+  }
+
   dt_free(control->job);
   dt_free(control->thread);
 }
@@ -90,6 +90,9 @@
 #include "common/film.h"
 #include "metadata/gpx.h"
 #include "history/history.h"
+#include "history/history_snapshot.h"
+#include "develop/dev_history.h"
+#include "develop/develop.h"
 #include "develop/history_merge.h"
 #include "common/image.h"
 #include "caches/image_cache.h"
@@ -620,6 +623,164 @@ end:
   return 0;
 }
 
+/* Auto-fit perspective: the input of the perspective module is exported headless, stopped
+ * right before it, and handed to its autoset() hook, as darkroom does from the preview pipe. */
+#define AUTOSET_PERSPECTIVE_SIZE 1500
+
+typedef struct dt_control_autoset_perspective_t
+{
+  dt_imageio_module_data_t parent;
+  void *params;          // fitted module params, params_size bytes
+  int32_t params_size;
+  gboolean fitted;
+} dt_control_autoset_perspective_t;
+
+static int dt_control_autoset_perspective_process(dt_imageio_module_data_t *datai, const char *filename,
+                                                  const void *const ivoid,
+                                                  dt_colorspaces_color_profile_type_t over_type,
+                                                  const char *over_filename, void *exif, int exif_len,
+                                                  int32_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
+                                                  const gboolean export_masks)
+{
+  dt_control_autoset_perspective_t *data = (dt_control_autoset_perspective_t *)datai;
+
+  dt_dev_pixelpipe_iop_t *piece = NULL;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(node->module && !strcmp(node->module->op, "ashift") && node->module->multi_priority == 0)
+    {
+      piece = node;
+      break;
+    }
+  }
+  if(IS_NULL_PTR(piece) || IS_NULL_PTR(piece->module->autoset) || piece->module->params_size != data->params_size)
+    return 1;
+
+  // The pipe was stopped before the module, so its node was never planned: describe the
+  // exported buffer as its input, against the full-size input the params refer to.
+  dt_dev_pixelpipe_iop_t input = *piece;
+  input.roi_in = (dt_iop_roi_t){ 0, 0, datai->width, datai->height, (float)datai->width / pipe->processed_width };
+  input.roi_out = input.roi_in;
+  input.buf_in = (dt_iop_roi_t){ 0, 0, pipe->processed_width, pipe->processed_height, 1.f };
+  input.dsc_in.channels = 4;
+
+  piece->module->autoset(piece->module, pipe, &input, ivoid);
+  memcpy(data->params, piece->module->params, data->params_size);
+  data->fitted = TRUE;
+  return 0;
+}
+
+// Previous enabled module in pipe order, where the export has to stop.
+static const char *_autoset_perspective_previous_op(const dt_develop_t *dev, const dt_iop_module_t *module)
+{
+  const dt_iop_module_t *prev = NULL;
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+  {
+    const dt_iop_module_t *mod = (const dt_iop_module_t *)modules->data;
+    if(mod->enabled && mod->iop_order < module->iop_order && (IS_NULL_PTR(prev) || mod->iop_order > prev->iop_order))
+      prev = mod;
+  }
+  return prev ? prev->op : NULL;
+}
+
+static gboolean _autoset_perspective_on_image(const int32_t imgid, dt_imageio_module_format_t *format, const int num,
+                                              const int total)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, FALSE);
+  dt_dev_reload_history_items(&dev, imgid);
+
+  gboolean changed = FALSE;
+  dt_iop_module_t *module = dt_iop_get_module_by_op_priority(dev.iop, "ashift", 0);
+  const char *prev_op = module ? _autoset_perspective_previous_op(&dev, module) : NULL;
+  if(IS_NULL_PTR(module) || IS_NULL_PTR(module->autoset) || IS_NULL_PTR(prev_op)) goto end;
+
+  char filter[64];
+  g_snprintf(filter, sizeof(filter), "pre:%s", prev_op);
+
+  dt_control_autoset_perspective_t dat = { .parent = { .max_width = AUTOSET_PERSPECTIVE_SIZE,
+                                                       .max_height = AUTOSET_PERSPECTIVE_SIZE },
+                                           .params = g_malloc(module->params_size),
+                                           .params_size = module->params_size,
+                                           .fitted = FALSE };
+
+  dt_imageio_export_with_flags(imgid, "unused", format, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE, TRUE,
+                               FALSE, filter, FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL, NULL,
+                               num, total, NULL, NULL);
+
+  if(dat.fitted && memcmp(module->params, dat.params, module->params_size))
+  {
+    memcpy(module->params, dat.params, module->params_size);
+    dt_dev_add_history_item_ext(&dev, module, TRUE, TRUE);
+    dt_dev_write_history_ext(&dev, imgid);
+    changed = TRUE;
+  }
+  dt_free(dat.params);
+
+end:
+  dt_dev_cleanup(&dev);
+  return changed;
+}
+
+static int32_t dt_control_autoset_perspective_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  GList *t = params->index;
+  const guint total = g_list_length(t);
+  double fraction = 0.0f;
+  char message[512] = { 0 };
+
+  dt_imageio_module_format_t buf = (dt_imageio_module_format_t){.mime = dt_control_merge_hdr_mime,
+                                                                .levels = dt_control_merge_hdr_levels,
+                                                                .bpp = dt_control_merge_hdr_bpp,
+                                                                .write_image = dt_control_autoset_perspective_process };
+
+  dt_undo_start_group(dt_undo_get_global(), DT_UNDO_LT_HISTORY);
+
+  snprintf(message, sizeof(message), ngettext("fitting perspective on %d image", "fitting perspective on %d images", total),
+           total);
+  dt_control_job_set_progress_message(job, message);
+
+  int num = 1;
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  {
+    const int32_t imgid = GPOINTER_TO_INT(t->data);
+
+    // the darkroom image has its history held by the GUI, it is fitted from the module there
+    const dt_view_t *cv = dt_view_manager_get_current_view(dt_view_manager_get_global());
+    if(dt_dev_get_global()->image_storage.id == imgid && cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM)
+    {
+      t = g_list_next(t);
+      num++;
+      continue;
+    }
+
+    dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+    hist->imgid = imgid;
+    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+
+    if(_autoset_perspective_on_image(imgid, &buf, num, total))
+    {
+      dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+      dt_undo_record(dt_undo_get_global(), NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                     dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+      dt_image_history_changed(imgid, TRUE);
+    }
+    else
+      dt_history_snapshot_undo_lt_history_data_free(hist);
+
+    t = g_list_next(t);
+    fraction += 1.0 / total;
+    dt_control_job_set_progress(job, fraction);
+    num++;
+  }
+
+  dt_undo_end_group(dt_undo_get_global());
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
 static int32_t dt_control_duplicate_images_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -1536,6 +1697,14 @@ void dt_control_merge_hdr()
                                                           NULL, PROGRESS_CANCELLABLE, TRUE));
 }
 
+void dt_control_autoset_perspective()
+{
+  dt_control_add_job(dt_control_get_global(), DT_JOB_QUEUE_USER_FG,
+                     dt_control_generic_images_job_create(&dt_control_autoset_perspective_job_run,
+                                                          N_("auto-fit perspective"), 0, NULL,
+                                                          PROGRESS_CANCELLABLE, TRUE));
+}
+
 void dt_control_gpx_apply(const gchar *filename, int32_t filmid, const gchar *tz, GList *imgs)
 {
   dt_control_add_job(dt_control_get_global(), DT_JOB_QUEUE_USER_FG,
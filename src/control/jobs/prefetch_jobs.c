@@ -0,0 +1,272 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "control/jobs/prefetch_jobs.h"
+#include "caches/image_cache.h"
+#include "caches/pixelpipe_cache.h"
+#include "common/image.h"
+#include "common/conf.h"
+#include "common/logging.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "system/atomic.h"
+#include "system/mem_alloc.h"
+
+// Bound on the images remembered as loaded ahead, for the hit statistics only.
+#define DT_PREFETCH_MAX_WARM 256
+
+typedef enum dt_prefetch_outcome_t
+{
+  DT_PREFETCH_LOADED = 0,
+  DT_PREFETCH_SKIPPED,
+  DT_PREFETCH_CANCELLED
+} dt_prefetch_outcome_t;
+
+typedef struct dt_prefetch_job_t
+{
+  GArray *imgids; // int32_t, most likely next first
+  dt_mipmap_size_t thumb_mip;
+  int full_count;
+  guint generation;
+  int32_t current; // image being loaded, under _prefetch_lock
+  gboolean ran;
+  dt_atomic_int shutdown;
+} dt_prefetch_job_t;
+
+static GMutex _prefetch_lock;
+static guint _prefetch_generation = 0;
+static dt_prefetch_job_t *_prefetch_running = NULL;
+static GHashTable *_prefetch_warm = NULL; // imgid set
+static dt_prefetch_stats_t _prefetch_stats = { 0 };
+
+/**
+ * @brief Whether loading `imgid` at `mip` fits in its cache without pushing out what is in use.
+ */
+static gboolean _prefetch_fits(const int32_t imgid, const dt_mipmap_size_t mip)
+{
+  size_t current = 0;
+  size_t max = 0;
+
+  if(mip == DT_MIPMAP_FULL)
+  {
+    const dt_image_t *img = dt_image_cache_get(imgid, 'r');
+    if(IS_NULL_PTR(img)) return FALSE;
+    const size_t bytes = (size_t)img->width * img->height * 4 * sizeof(float);
+    dt_image_cache_read_release(img);
+
+    // The darkroom pipes will need at least that much again for their first cachelines:
+    // decoding it now would only make them evict the current image's.
+    dt_dev_pixelpipe_cache_get_usage(&current, &max);
+    return max > current && max - current >= bytes;
+  }
+
+  // Keep a tenth of the thumbnail budget free: what is on screen must not be evicted
+  // for something that may never be looked at.
+  dt_mipmap_cache_get_usage(&current, &max);
+  return max == 0 || current + max / 10 <= max;
+}
+
+static dt_prefetch_outcome_t _prefetch_load(const int32_t imgid, const dt_mipmap_size_t mip, dt_atomic_int *shutdown)
+{
+  dt_mipmap_buffer_t buf;
+
+  // Already cached: the blocking get below is a lookup, and evicts nothing.
+  dt_mipmap_cache_get(&buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+  const gboolean cached = !IS_NULL_PTR(buf.cache_entry);
+  dt_mipmap_cache_release(&buf);
+
+  if(!cached && !_prefetch_fits(imgid, mip)) return DT_PREFETCH_SKIPPED;
+
+  dt_mipmap_cache_get_with_shutdown(&buf, imgid, mip, DT_MIPMAP_BLOCKING, 'r', shutdown);
+  const gboolean ok = !IS_NULL_PTR(buf.buf) && buf.width > 0 && buf.height > 0;
+  dt_mipmap_cache_release(&buf);
+
+  if(dt_atomic_get_int(shutdown)) return DT_PREFETCH_CANCELLED;
+  return ok ? DT_PREFETCH_LOADED : DT_PREFETCH_SKIPPED;
+}
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  dt_prefetch_job_t *params = dt_control_job_get_params(job);
+  guint done = 0;
+
+  g_mutex_lock(&_prefetch_lock);
+  const gboolean stale = params->generation != _prefetch_generation;
+  if(!stale) _prefetch_running = params;
+  params->ran = TRUE;
+  g_mutex_unlock(&_prefetch_lock);
+
+  for(; !stale && done < params->imgids->len; done++)
+  {
+    const int32_t imgid = g_array_index(params->imgids, int32_t, done);
+
+    g_mutex_lock(&_prefetch_lock);
+    const gboolean replaced = params->generation != _prefetch_generation;
+    params->current = replaced ? UNKNOWN_IMAGE : imgid;
+    g_mutex_unlock(&_prefetch_lock);
+    if(replaced || dt_atomic_get_int(&params->shutdown)) break;
+
+    // Thumbnail first: it is what gets drawn first when the user gets there.
+    // An image only counts as loaded once everything asked for it was actually loaded.
+    const gboolean want_thumb = params->thumb_mip < DT_MIPMAP_F;
+    const gboolean want_full = (int)done < params->full_count;
+    dt_prefetch_outcome_t outcome = DT_PREFETCH_SKIPPED;
+    if(want_thumb)
+      outcome = _prefetch_load(imgid, params->thumb_mip, &params->shutdown);
+    if(want_full && outcome != DT_PREFETCH_CANCELLED)
+    {
+      const dt_prefetch_outcome_t full = _prefetch_load(imgid, DT_MIPMAP_FULL, &params->shutdown);
+      if(!want_thumb || full != DT_PREFETCH_LOADED) outcome = full;
+    }
+
+    g_mutex_lock(&_prefetch_lock);
+    params->current = UNKNOWN_IMAGE;
+    if(outcome == DT_PREFETCH_LOADED)
+    {
+      _prefetch_stats.loaded++;
+      if(IS_NULL_PTR(_prefetch_warm)) _prefetch_warm = g_hash_table_new(g_direct_hash, g_direct_equal);
+      if(g_hash_table_size(_prefetch_warm) >= DT_PREFETCH_MAX_WARM) g_hash_table_remove_all(_prefetch_warm);
+      g_hash_table_add(_prefetch_warm, GINT_TO_POINTER(imgid));
+    }
+    else if(outcome == DT_PREFETCH_SKIPPED)
+      _prefetch_stats.skipped++;
+    g_mutex_unlock(&_prefetch_lock);
+
+    if(outcome == DT_PREFETCH_CANCELLED) break;
+  }
+
+  g_mutex_lock(&_prefetch_lock);
+  _prefetch_stats.cancelled += params->imgids->len - done;
+  if(_prefetch_running == params) _prefetch_running = NULL;
+  g_mutex_unlock(&_prefetch_lock);
+  return 0;
+}
+
+static void _prefetch_job_cleanup(void *data)
+{
+  dt_prefetch_job_t *params = (dt_prefetch_job_t *)data;
+
+  // A job dropped from the queue at shutdown never ran: its images were cancelled all the same.
+  g_mutex_lock(&_prefetch_lock);
+  if(!params->ran) _prefetch_stats.cancelled += params->imgids->len;
+  if(_prefetch_running == params) _prefetch_running = NULL;
+  g_mutex_unlock(&_prefetch_lock);
+
+  g_array_free(params->imgids, TRUE);
+  dt_free(params);
+}
+
+int dt_prefetch_neighbours(void)
+{
+  return CLAMP(dt_conf_get_int("ui/prefetch_neighbours"), 0, 16);
+}
+
+void dt_prefetch_images(const GList *imgids, const dt_mipmap_size_t thumb_mip, const int full_count)
+{
+  dt_prefetch_cancel(UNKNOWN_IMAGE);
+  if(IS_NULL_PTR(imgids)) return;
+
+  dt_prefetch_job_t *params = calloc(1, sizeof(dt_prefetch_job_t));
+  if(IS_NULL_PTR(params)) return;
+
+  params->imgids = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  // Without thumbnails, only the images getting their decoded raw have anything to load.
+  const gboolean thumbs = thumb_mip < DT_MIPMAP_F;
+  for(const GList *l = imgids; l && (thumbs || (int)params->imgids->len < full_count); l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    if(imgid > UNKNOWN_IMAGE) g_array_append_val(params->imgids, imgid);
+  }
+  params->thumb_mip = thumb_mip;
+  params->full_count = full_count;
+  params->current = UNKNOWN_IMAGE;
+  dt_atomic_set_int(&params->shutdown, 0);
+
+  g_mutex_lock(&_prefetch_lock);
+  params->generation = _prefetch_generation;
+  _prefetch_stats.requested += params->imgids->len;
+  g_mutex_unlock(&_prefetch_lock);
+
+  dt_job_t *job = dt_control_job_create(_prefetch_job_run, "prefetch %u images", params->imgids->len);
+  if(IS_NULL_PTR(job))
+  {
+    _prefetch_job_cleanup(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, _prefetch_job_cleanup);
+  dt_control_add_job(dt_control_get_global(), DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+void dt_prefetch_cancel(const int32_t keep_imgid)
+{
+  g_mutex_lock(&_prefetch_lock);
+  _prefetch_generation++;
+  if(!IS_NULL_PTR(_prefetch_running)
+     && (keep_imgid <= UNKNOWN_IMAGE || _prefetch_running->current != keep_imgid))
+    dt_atomic_set_int(&_prefetch_running->shutdown, 1);
+  g_mutex_unlock(&_prefetch_lock);
+}
+
+gboolean dt_prefetch_claim(const int32_t imgid)
+{
+  if(imgid <= UNKNOWN_IMAGE) return FALSE;
+
+  g_mutex_lock(&_prefetch_lock);
+  const gboolean hit = !IS_NULL_PTR(_prefetch_warm) && g_hash_table_remove(_prefetch_warm, GINT_TO_POINTER(imgid));
+  const gboolean late = !hit && !IS_NULL_PTR(_prefetch_running) && _prefetch_running->current == imgid;
+  if(hit)
+    _prefetch_stats.hits++;
+  else if(late)
+    _prefetch_stats.late++;
+  else
+    _prefetch_stats.misses++;
+  g_mutex_unlock(&_prefetch_lock);
+  return hit;
+}
+
+void dt_prefetch_get_stats(dt_prefetch_stats_t *stats)
+{
+  g_mutex_lock(&_prefetch_lock);
+  *stats = _prefetch_stats;
+  g_mutex_unlock(&_prefetch_lock);
+}
+
+void dt_prefetch_cleanup(void)
+{
+  dt_prefetch_stats_t stats;
+  dt_prefetch_get_stats(&stats);
+
+  const uint64_t claimed = stats.hits + stats.late + stats.misses;
+  if(claimed > 0 || stats.requested > 0)
+    dt_print(DT_DEBUG_PERF,
+             "[prefetch] %" PRIu64 " requested, %" PRIu64 " loaded, %" PRIu64 " skipped, %" PRIu64
+             " cancelled; %" PRIu64 " hits, %" PRIu64 " late, %" PRIu64 " misses (hit rate %.1f%%)\n",
+             stats.requested, stats.loaded, stats.skipped, stats.cancelled, stats.hits, stats.late,
+             stats.misses, claimed ? 100.0 * stats.hits / claimed : 0.0);
+
+  g_mutex_lock(&_prefetch_lock);
+  if(!IS_NULL_PTR(_prefetch_warm)) g_hash_table_destroy(_prefetch_warm);
+  _prefetch_warm = NULL;
+  g_mutex_unlock(&_prefetch_lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
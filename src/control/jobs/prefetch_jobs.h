@@ -0,0 +1,97 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_CONTROL_JOBS_PREFETCH_JOBS_H
+#define DT_CONTROL_JOBS_PREFETCH_JOBS_H
+
+#include "caches/mipmap_cache.h"
+
+#include <glib.h>
+#include <inttypes.h>
+
+/**
+ * @file prefetch_jobs.h
+ * @brief Speculative loading of the images the user is likely to open next.
+ *
+ * Views that step through a collection (darkroom, slideshow) tell the prefetcher
+ * which images come next, in order of likelihood. One low-priority background job
+ * warms the mipmap cache for them while the user looks at the current one:
+ *
+ * - the display-size thumbnail, which slideshow and culling draw and the darkroom
+ *   shows while its pipes start,
+ * - for the closest images only, the decoded raw (::DT_MIPMAP_FULL) both darkroom
+ *   pipes start from, which is most of the time spent opening an image.
+ *
+ * Everything is best effort: a request replaces the previous one, user input cancels
+ * it, and nothing is loaded that would not fit in the caches without evicting what
+ * is on screen. The first pipe module outputs are not rendered ahead: their cache keys
+ * depend on the darkroom ROI, which is only known once the image is open.
+ */
+
+typedef struct dt_prefetch_stats_t
+{
+  uint64_t requested; // images asked for
+  uint64_t loaded;    // images the job loaded, or found already warm
+  uint64_t skipped;   // images not loaded because the cache had no room for them
+  uint64_t cancelled; // images dropped by a newer request or by user input
+  uint64_t hits;      // images the user moved to, that were loaded ahead
+  uint64_t late;      // images the user moved to while they were loading
+  uint64_t misses;    // images the user moved to, that were not loaded ahead
+} dt_prefetch_stats_t;
+
+/**
+ * @brief Load `imgids` ahead, in list order, replacing any previous request.
+ *
+ * @param imgids image ids, most likely next first. Copied.
+ * @param thumb_mip thumbnail size to warm, or ::DT_MIPMAP_NONE for none.
+ * @param full_count how many of the first images also get their decoded raw.
+ */
+void dt_prefetch_images(const GList *imgids, const dt_mipmap_size_t thumb_mip, const int full_count);
+
+/**
+ * @brief How many neighbours the views should ask for (`ui/prefetch_neighbours`), 0 when disabled.
+ */
+int dt_prefetch_neighbours(void);
+
+/**
+ * @brief Stop prefetching, on user input. The image being loaded right now keeps
+ * loading if it is `keep_imgid`: the view is about to block on it anyway.
+ */
+void dt_prefetch_cancel(const int32_t keep_imgid);
+
+/**
+ * @brief Record that the user moved to `imgid`, for the hit-rate statistics.
+ * @return TRUE if it was loaded ahead.
+ */
+gboolean dt_prefetch_claim(const int32_t imgid);
+
+void dt_prefetch_get_stats(dt_prefetch_stats_t *stats);
+
+/**
+ * @brief Print the statistics with `-d perf` and forget the warm images. Call after
+ * the control jobs are stopped.
+ */
+void dt_prefetch_cleanup(void);
+
+#endif // DT_CONTROL_JOBS_PREFETCH_JOBS_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
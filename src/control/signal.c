@@ -36,6 +36,7 @@
     You should have received a copy of the GNU General Public License
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include "common/collection.h"
 #include "common/logging.h"
 #include "system/macros.h"
 #include "system/mem_alloc.h"
@@ -78,7 +79,7 @@ static GType int_arg[] = { G_TYPE_INT };
 static GType uint_2arg[] = { G_TYPE_UINT, G_TYPE_UINT };
 static GType pointer_arg[] = { G_TYPE_POINTER };
 static GType pointer_2arg[] = { G_TYPE_POINTER, G_TYPE_POINTER };
-static GType collection_args[] = { G_TYPE_UINT, G_TYPE_UINT, G_TYPE_POINTER, G_TYPE_UINT };
+static GType collection_args[] = { G_TYPE_UINT, G_TYPE_UINT, G_TYPE_POINTER, G_TYPE_UINT, G_TYPE_POINTER };
 static GType image_export_arg[]
     = { G_TYPE_UINT, G_TYPE_STRING, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_POINTER };
 static GType history_will_change_arg[]
@@ -89,13 +90,14 @@ static GType mask_change_arg[] = { G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_UINT }
 
 // callback for the destructor of DT_SIGNAL_COLLECTION_CHANGED
 static void _collection_changed_destroy_callback(gpointer instance, int query_change, int changed_property,
-                                                 gpointer imgs, const int next, gpointer user_data)
+                                                 gpointer imgs, const int next, gpointer diff, gpointer user_data)
 {
   if(imgs)
   {
     g_list_free(imgs);
     imgs = NULL;
   }
+  dt_collection_diff_free((dt_collection_diff_t *)diff);
 }
 
 // callback for the destructor of DT_SIGNAL_IMAGE_INFO_CHANGED
@@ -147,7 +149,7 @@ static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
   { "dt-viewmanager-filmstrip-drag-begin", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__UINT, 1, uint_arg,
     NULL, FALSE }, // DT_SIGNAL_VIEWMANAGER_FILMSTRIP_DRAG_BEGIN
 
-  { "dt-collection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 4, collection_args,
+  { "dt-collection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 5, collection_args,
     G_CALLBACK(_collection_changed_destroy_callback), FALSE }, // DT_SIGNAL_COLLECTION_CHANGED
   { "dt-selection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
     FALSE }, // DT_SIGNAL_SELECTION_CHANGED
@@ -119,9 +119,11 @@ typedef enum dt_signal_t
     2 : dt_collection_properties_t the property that has changed
     3 : GList of imageids that have changed (can be null if it's a global change)
     4 : next untouched imgid in the list (-1 if no list)
+    5 : dt_collection_diff_t of memory.collected_images since the previous signal
+        (NULL when the collection was not re-queried)
     no returned value
     */
-  /** image list not to be freed by the caller, automatically freed */
+  /** image list and diff not to be freed by the caller, automatically freed */
   DT_SIGNAL_COLLECTION_CHANGED,
 
   /** \brief This signal is raised when the selection is changed
@@ -132,6 +132,7 @@
 #include "common/folder_survey.h"
 #include "gui/common/folder_survey_gui.h"
 #include "common/grealpath.h"
+#include "common/histogram.h"
 #include "common/image.h"
 #include "caches/image_cache.h"
 #include "database/database.h"
@@ -160,10 +161,12 @@
 #include "control/control.h"
 #include "control/crawler.h"
 #include "control/jobs/film_jobs.h"
+#include "control/jobs/prefetch_jobs.h"
 #include "control/signal.h"
 #include "develop/dev_pixelpipe.h"
 #include "develop/imageop.h"
 #include "develop/supervisor.h"
+#include "develop/pipe_counters.h"
 
 #include "gui/application.h"
 #include "develop/gui_throttle.h"
@@ -267,7 +270,7 @@ static int usage(const char *argv0)
   printf("  --cachedir <user cache directory>\n");
   printf("  --conf <key>=<value>\n");
   printf("  --configdir <user config directory>\n");
-  printf("  -d {all,cache,camctl,camsupport,colorprofile,control,demosaic,dev,gtk,history,imageio,import,\n");
+  printf("  -d {all,cache,camctl,camsupport,colorprofile,control,counters,demosaic,dev,gtk,history,imageio,import,\n");
   printf("      input,ioporder,lighttable,lua,masks,memory,nan,nocache_reuse,opencl,params,\n");
   printf("      perf,pipe,pipecache,print,signal,sql,shortcuts,tiling,undo,verbose}\n");
   printf("  --d-signal <signal> \n");
@@ -290,6 +293,8 @@ static int usage(const char *argv0)
   printf("  --localedir <locale directory>\n");
   printf("  --moduledir <module directory>\n");
   printf("  --noiseprofiles <noiseprofiles json file>\n");
+  printf("  --pipe-counters <NDJSON file>\n");
+  printf("  --startup-profile\n");
   printf("  -t <num openmp threads>\n");
   printf("  --tmpdir <tmp directory>\n");
   printf("  --version\n");
@@ -306,6 +311,83 @@ static int usage(const char *argv0)
   return 1;
 }
 
+/* --startup-profile: wall time of each init stage, printed when dt_init() returns, so a
+ * regression in startup shows up as one stage getting longer instead of "it feels slow".
+ * Main-thread stages are closed in order by _startup_stage(), each one running from the end
+ * of the previous one. Stages running in the background, and subsystems loaded lazily after
+ * startup, record their own span. */
+#define DT_STARTUP_STAGES_MAX 32
+
+typedef struct dt_startup_stage_t
+{
+  const char *name;
+  double begin;
+  double end;
+  gboolean background;
+} dt_startup_stage_t;
+
+static struct
+{
+  gboolean enabled;
+  double mark;
+  int count;
+  dt_startup_stage_t stages[DT_STARTUP_STAGES_MAX];
+  GMutex lock;
+} _startup_profile = { 0 };
+
+static void _startup_stage_add(const char *name, const double begin, const double end,
+                               const gboolean background)
+{
+  g_mutex_lock(&_startup_profile.lock);
+  if(_startup_profile.count < DT_STARTUP_STAGES_MAX)
+    _startup_profile.stages[_startup_profile.count++]
+        = (dt_startup_stage_t){ .name = name, .begin = begin, .end = end, .background = background };
+  g_mutex_unlock(&_startup_profile.lock);
+}
+
+static void _startup_stage(const char *name)
+{
+  if(!_startup_profile.enabled) return;
+  const double now = dt_get_wtime();
+  _startup_stage_add(name, _startup_profile.mark, now, FALSE);
+  _startup_profile.mark = now;
+}
+
+static void _startup_profile_report(void)
+{
+  if(!_startup_profile.enabled) return;
+
+  g_mutex_lock(&_startup_profile.lock);
+  printf("[startup-profile] %-32s %10s %10s\n", "stage", "start (s)", "took (s)");
+  for(int i = 0; i < _startup_profile.count; i++)
+  {
+    const dt_startup_stage_t *stage = &_startup_profile.stages[i];
+    printf("[startup-profile] %-32s %10.3f %10.3f%s\n", stage->name, stage->begin - darktable.start_wtime,
+           stage->end - stage->begin, stage->background ? "  (background)" : "");
+  }
+  printf("[startup-profile] %-32s %10s %10.3f\n", "total", "", dt_get_wtime() - darktable.start_wtime);
+  g_mutex_unlock(&_startup_profile.lock);
+}
+
+/* Subsystems loaded on first use are not part of startup anymore, but still worth seeing:
+ * they are reported on their own line when they load. */
+static void _startup_profile_lazy(const char *name, const double begin)
+{
+  if(!_startup_profile.enabled) return;
+  printf("[startup-profile] %-32s %10.3f %10.3f  (lazy)\n", name, begin - darktable.start_wtime,
+         dt_get_wtime() - begin);
+}
+
+/* The ICC directories are scanned, and the built-in profiles built, while the library is
+ * opened and migrated: neither needs the other, and both mostly wait on disk. */
+static void *_colorprofiles_init_thread(void *data)
+{
+  const double begin = dt_get_wtime();
+  dt_colorprofiles_init();
+  if(_startup_profile.enabled) _startup_stage_add("colour profiles", begin, dt_get_wtime(), TRUE);
+  return NULL;
+}
+
 char *dt_version_major_minor()
 {
   char ver[100] = { 0 };
@@ -669,8 +751,21 @@ struct dt_dbus_t *dt_dbus_get_global(void)
   return darktable.dbus;
 }
 
+/* --noiseprofiles, kept for the first use of the noise profiles. */
+static gchar *_noiseprofiles_from_command = NULL;
+
 JsonParser *dt_noiseprofile_get_parser_global(void)
 {
+  // The json is parsed on first use: only the profiled denoising modules ever read it,
+  // and most sessions never get there.
+  static gsize loaded = 0;
+  if(g_once_init_enter(&loaded))
+  {
+    const double begin = dt_get_wtime();
+    darktable.noiseprofile_parser = dt_noiseprofile_init(_noiseprofiles_from_command);
+    _startup_profile_lazy("noise profiles", begin);
+    g_once_init_leave(&loaded, 1);
+  }
   return darktable.noiseprofile_parser;
 }
 
@@ -912,7 +1007,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   // database
   char *dbfilename_from_command = NULL;
-  char *noiseprofiles_from_command = NULL;
+  char *pipe_counters_from_command = NULL;
   char *datadir_from_command = NULL;
   char *moduledir_from_command = NULL;
   char *localedir_from_command = NULL;
@@ -1054,6 +1149,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted |= DT_DEBUG_PIPECACHE; // pipeline cache
         else if(!strcmp(argv[k + 1], "perf"))
           darktable.unmuted |= DT_DEBUG_PERF; // performance measurements
+        else if(!strcmp(argv[k + 1], "counters"))
+          darktable.unmuted |= DT_DEBUG_COUNTERS; // per-node pipeline counters (NDJSON)
         else if(!strcmp(argv[k + 1], "opencl"))
           darktable.unmuted |= DT_DEBUG_OPENCL; // gpu accel via opencl
         else if(!strcmp(argv[k + 1], "sql"))
@@ -1223,7 +1320,20 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       }
       else if(!strcmp(argv[k], "--noiseprofiles") && argc > k + 1)
       {
-        noiseprofiles_from_command = argv[++k];
+        dt_free(_noiseprofiles_from_command);
+        _noiseprofiles_from_command = g_strdup(argv[++k]);
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
+      else if(!strcmp(argv[k], "--startup-profile"))
+      {
+        _startup_profile.enabled = TRUE;
+        _startup_profile.mark = start_wtime;
+        argv[k] = NULL;
+      }
+      else if(!strcmp(argv[k], "--pipe-counters") && argc > k + 1)
+      {
+        pipe_counters_from_command = argv[++k];
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
@@ -1358,6 +1468,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   // thread-safe init:
   dt_exif_init();
+  _startup_stage("locations, locale and exiv2");
   char datadir[PATH_MAX] = { 0 };
   dt_loc_get_user_config_dir(datadir, sizeof(datadir));
   char anselrc[PATH_MAX] = { 0 };
@@ -1397,9 +1508,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
     darktable.themes = NULL;
   }
+  _startup_stage("config, languages and gtk");
 
-  // build the colour-profile module's own list; it owns it, we do not hold it
-  dt_colorprofiles_init();
+  // build the colour-profile module's own list; it owns it, we do not hold it.
+  // Nothing reads it before the GUI is initialized, where the thread is joined.
+  pthread_t colorprofiles_thread;
+  const gboolean colorprofiles_threaded
+      = !dt_pthread_create(&colorprofiles_thread, _colorprofiles_init_thread, NULL, FALSE);
+  if(!colorprofiles_threaded) _colorprofiles_init_thread(NULL);
 
   // initialize datetime data
   dt_datetime_init();
@@ -1438,6 +1554,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       printf("ERROR : cannot open database\n");
       dt_free(configured_library);
       dt_gui_splash_close();
+      if(colorprofiles_threaded) pthread_join(colorprofiles_thread, NULL);
       return 1;
     }
     else if(opened == DT_DATABASE_OPEN_LOCKED)
@@ -1480,6 +1597,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         fprintf(stderr, "ERROR: can't acquire database lock, aborting.\n");
         dt_free(configured_library);
         dt_gui_splash_close();
+        if(colorprofiles_threaded) pthread_join(colorprofiles_thread, NULL);
         return error;
       }
       else
@@ -1503,6 +1621,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   {
     dt_database_perform_maintenance();
   }
+  _startup_stage("library database");
 
   // init darktable tags table
   dt_set_darktable_tags();
@@ -1595,7 +1714,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   omp_set_num_threads(darktable.num_openmp_threads);
 #endif
 
-  darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
+  _startup_stage("signals, control and collection");
+  if(colorprofiles_threaded) pthread_join(colorprofiles_thread, NULL);
+  _startup_stage("waiting for colour profiles");
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -1616,6 +1737,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   }
   else
     darktable.gui = NULL;
+  _startup_stage("gui");
 
   // This needs to run after gui init because we init cache lines size with window size
   // but before image cache init and pipeline cache init (aka dev init aka darkroom init aka viewmanager init)
@@ -1624,6 +1746,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.view_manager = (dt_view_manager_t *)calloc(1, sizeof(dt_view_manager_t));
   dt_view_manager_init(darktable.view_manager);
+  _startup_stage("views and develop");
 
   // check whether we were able to load darkroom view. if we failed, we'll crash everywhere later on.
   if(IS_NULL_PTR(darktable.develop))
@@ -1640,7 +1763,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   size_t pipecache_size = darktable.dtresources.pixelpipe_memory;
   dt_dev_pixelpipe_cache_init(pipecache_size,
                               (dt_get_debug_flags() & DT_DEBUG_PIPECACHE) != 0,
-                              (dt_get_debug_flags() & DT_DEBUG_VERBOSE) != 0);
+                              (dt_get_debug_flags() & DT_DEBUG_VERBOSE) != 0,
+                              dt_conf_get_bool("cache/compact_cachelines"));
   while(!dt_dev_pixelpipe_cache_is_ready() && pipecache_size / 2 >= (size_t)512 * 1024 * 1024)
   {
     pipecache_size /= 2;
@@ -1650,7 +1774,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
             2 * pipecache_size / (1024 * 1024), pipecache_size / (1024 * 1024));
     dt_dev_pixelpipe_cache_init(pipecache_size,
                               (dt_get_debug_flags() & DT_DEBUG_PIPECACHE) != 0,
-                              (dt_get_debug_flags() & DT_DEBUG_VERBOSE) != 0);
+                              (dt_get_debug_flags() & DT_DEBUG_VERBOSE) != 0,
+                              dt_conf_get_bool("cache/compact_cachelines"));
   }
   darktable.dtresources.pixelpipe_memory = pipecache_size;
 
@@ -1667,10 +1792,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     dt_gui_splash_close();
     return 1;
   }
+  _startup_stage("pixelpipe cache");
 
   // High-level event supervisor registry (active only under -d supervisor).
   dt_supervisor_init();
 
+  // Per-node pipeline counters (active under -d counters or --pipe-counters <file>).
+  dt_pipe_counters_init(pipe_counters_from_command);
+
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, darktable.num_openmp_threads);
 
@@ -1688,16 +1817,19 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_image_xmp_mode_refresh_from_conf();
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_PREFERENCES_CHANGE,
                             G_CALLBACK(_xmp_mode_preferences_changed), NULL);
+  _startup_stage("image and mipmap caches");
 
 #ifdef HAVE_OPENCL
   dt_opencl_init(exclude_opencl, print_statistics);
   // Show the splash only while compiling OpenCL kernels (triggered from opencl.c),
   // then close it immediately so the rest of the startup stays splash-free.
   dt_gui_splash_close();
+  _startup_stage("opencl");
 #endif
 
   darktable.imageio = (dt_imageio_t *)calloc(1, sizeof(dt_imageio_t));
   dt_imageio_init(darktable.imageio);
+  _startup_stage("imageio");
 
   // load default iop order
   darktable.iop_order_list = dt_ioppr_get_iop_order_list(0, FALSE);
@@ -1705,6 +1837,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.iop_order_rules = dt_ioppr_get_iop_order_rules();
   // load the darkroom mode plugins once:
   dt_iop_load_modules_so();
+  _startup_stage("processing modules");
   // check if all modules have a iop order assigned
   if(dt_ioppr_check_so_iop_order(darktable.iop, darktable.iop_order_list))
   {
@@ -1721,11 +1854,13 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   // init metadata flags
   dt_metadata_init();
+  _startup_stage("iop table, exiv2 tags and metadata");
 
   if(init_gui)
   {
     darktable.lib = (dt_lib_t *)calloc(1, sizeof(dt_lib_t));
     dt_lib_init(darktable.lib);
+    _startup_stage("utility modules");
 
     // prevent bauhaus widgets from sending value-changed signals
     // because some of them expect user interactions.
@@ -1735,6 +1870,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     dt_view_manager_gui_init(darktable.view_manager);
 
     dt_gui_freeze_end();
+    _startup_stage("views gui");
 
     // initialize undo struct
     darktable.undo = dt_undo_init();
@@ -1771,6 +1907,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
 #endif
   }
+  _startup_stage("undo, menus and lighttable");
 
   // last but not least construct the popup that asks the user about images whose xmp files are newer than the
   // db entry
@@ -1811,6 +1948,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // Opt-in usage analytics (PostHog) - separate toggle from crash reporting.
   dt_telemetry_init(init_gui);
 
+  _startup_stage("folder survey, crash reports and telemetry");
+  _startup_profile_report();
+
   dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
 
   return 0;
@@ -1879,8 +2019,10 @@ void dt_cleanup()
     // Stop control workers before unloading views and libs. They can still be
     // processing lighttable-side jobs while shutdown is tearing down modules.
     dt_folder_survey_stop();
+    dt_prefetch_cancel(UNKNOWN_IMAGE);
     dt_control_shutdown(darktable.control);
     dt_folder_survey_cleanup();
+    dt_prefetch_cleanup();
 
     _dt_drain_main_context(256);
 
@@ -1953,6 +2095,8 @@ void dt_cleanup()
 
   dt_dev_pixelpipe_cache_cleanup();
   dt_supervisor_cleanup();
+  dt_pipe_counters_cleanup();
+  dt_histogram_cleanup();
 
   dt_opencl_cleanup();
 
@@ -1997,6 +2141,7 @@ void dt_cleanup()
     g_object_unref(darktable.noiseprofile_parser);
     darktable.noiseprofile_parser = NULL;
   }
+  dt_free(_noiseprofiles_from_command);
 
   if(init_gui)
   {
@@ -45,6 +45,11 @@ static uint32_t _tagid = 0;
 static gchar *_query = NULL;
 static uint32_t _count = 0;
 static uint64_t _generation = 0;
+// memory.collected_images as listeners last heard of it, for dt_collection_query_take_diff()
+static GArray *_published = NULL;
+static uint64_t _published_generation = 0;
+static uint64_t _published_serial = 0;
+static gboolean _published_stale = TRUE;
 static dt_collection_query_order_resolver_t _order_resolver = NULL;
 static const char *const *_order_names = NULL;
 static int _order_names_count = 0;
@@ -1602,6 +1607,9 @@ void dt_collection_query_cleanup(void)
   _params.text_filter = NULL;
   g_strfreev(_where_ext);
   _where_ext = NULL;
+  if(_published) g_array_free(_published, TRUE);
+  _published = NULL;
+  _published_stale = TRUE;
 }
 
 void dt_collection_query_refresh_memory_table(void){
@@ -1643,6 +1651,7 @@ void dt_collection_query_refresh_memory_table(void){
   // Re-restricting to the culling selection, and telling the user what just happened, are both
   // the caller's: this module rebuilds the table and counts what landed in it.
   _compute_count();
+  _published_stale = TRUE;
 }
 
 GList *dt_collection_query_get_images(const uint32_t limit){
@@ -1727,6 +1736,7 @@ void dt_collection_query_pop(void){
                         "INSERT INTO memory.collected_images"
                         " SELECT * FROM memory.collected_backup",
                         NULL, NULL, NULL);
+  _published_stale = TRUE;
 }
 
 void dt_collection_query_push(void){
@@ -1754,6 +1764,49 @@ void dt_collection_query_restrict_to_selection(void)
    * refresh -- the original computed its count after both, and dt_collection_get_count()
    * in culling mode must report the culled subset, not the full collection. */
   _compute_count();
+  _published_stale = TRUE;
+}
+
+dt_collection_diff_t *dt_collection_query_take_diff(void)
+{
+  // Only image ids, in order: this is the one full read a reload still costs, and it is an
+  // integer column of an in-memory table.
+  GArray *current = g_array_sized_new(FALSE, FALSE, sizeof(int32_t), _count);
+  sqlite3_stmt *stmt = NULL;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
+                              "SELECT imgid FROM memory.collected_images ORDER BY rowid",
+                              -1, &stmt, NULL);
+  // clang-format on
+  while(stmt && sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(current, imgid);
+  }
+  if(stmt) sqlite3_finalize(stmt);
+
+  // A different query is a different collection: report the counts but no window, so listeners
+  // rebuild instead of patching a sort order or a filter change row by row.
+  const gboolean same_query = _published && _published_generation == _generation;
+  dt_collection_diff_t *diff
+      = same_query ? dt_collection_diff_new((const int32_t *)_published->data, _published->len,
+                                            (const int32_t *)current->data, current->len)
+                   : dt_collection_diff_new(NULL, 0, NULL, 0);
+  diff->same_query = same_query;
+  diff->old_count = _published ? _published->len : 0;
+  diff->new_count = current->len;
+  diff->serial = ++_published_serial;
+
+  if(_published) g_array_free(_published, TRUE);
+  _published = current;
+  _published_generation = _generation;
+  _published_stale = FALSE;
+  return diff;
+}
+
+uint64_t dt_collection_query_get_diff_serial(void)
+{
+  return _published_stale ? 0 : _published_serial;
 }
 
 // clang-format off
@@ -87,6 +87,15 @@ uint32_t dt_collection_query_count(void);
  *  query string, which required the text to leave the module. */
 uint64_t dt_collection_query_get_generation(void);
 
+/** What `memory.collected_images` holds now compared to the previous call, as the payload of
+ *  DT_SIGNAL_COLLECTION_CHANGED. Each call advances the serial and makes the current content the
+ *  reference for the next one. Free with dt_collection_diff_free(). */
+dt_collection_diff_t *dt_collection_query_take_diff(void);
+
+/** Serial of the last diff handed out, or 0 if `memory.collected_images` changed since. A
+ *  listener that reads the whole collection records this to know which diff comes next. */
+uint64_t dt_collection_query_get_diff_serial(void);
+
 /** @brief One module's identity, for the rule that searches by module name. */
 typedef struct dt_iop_name_row_t
 {
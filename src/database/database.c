@@ -2587,6 +2587,34 @@ static void _create_memory_schema(dt_database_t *db)
                            "count INTEGER DEFAULT 0, count2 INTEGER DEFAULT 0)",
                NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.similar_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  /* Per-tag attachment counts, so the tagging panel reads one row per tag instead of grouping
+   * every row of main.tagged_images each time it refreshes. Seeded once here, then kept exact
+   * by the two TEMP triggers below: whoever writes main.tagged_images -- the tag repository,
+   * duplicates copying their tags, images removed by the ON DELETE CASCADE -- goes through
+   * them. TEMP because a trigger stored in main could not reach the memory schema, and because
+   * nothing of this must end up in library.db.
+   * Trigger bodies cannot qualify table names, hence the bare `tag_usage`. The row is created
+   * with a guarded INSERT rather than INSERT OR IGNORE, since an outer OR REPLACE would
+   * override the trigger's conflict clause and reset the count. */
+  sqlite3_exec(db->handle, "CREATE TABLE memory.tag_usage "
+                           "(tagid INTEGER PRIMARY KEY, count INTEGER NOT NULL DEFAULT 0)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "INSERT INTO memory.tag_usage (tagid, count)"
+                           "  SELECT tagid, COUNT(*) FROM main.tagged_images GROUP BY tagid",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TEMP TRIGGER tag_usage_attach AFTER INSERT ON main.tagged_images"
+                           " BEGIN"
+                           "   INSERT INTO tag_usage (tagid, count)"
+                           "     SELECT new.tagid, 0"
+                           "     WHERE NOT EXISTS (SELECT 1 FROM tag_usage WHERE tagid = new.tagid);"
+                           "   UPDATE tag_usage SET count = count + 1 WHERE tagid = new.tagid;"
+                           " END",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TEMP TRIGGER tag_usage_detach AFTER DELETE ON main.tagged_images"
+                           " BEGIN"
+                           "   UPDATE tag_usage SET count = count - 1 WHERE tagid = old.tagid;"
+                           " END",
+               NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.darktable_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(
       db->handle,
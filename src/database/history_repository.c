@@ -46,6 +46,8 @@ static sqlite3_stmt *_history_get_next_num_stmt = NULL;
 
 static sqlite3_stmt *_history_delete_history_stmt = NULL;
 static sqlite3_stmt *_history_delete_masks_stmt = NULL;
+static sqlite3_stmt *_history_delete_history_from_stmt = NULL;
+static sqlite3_stmt *_history_delete_masks_from_stmt = NULL;
 static sqlite3_stmt *_history_shift_history_nums_stmt = NULL;
 static sqlite3_stmt *_history_select_history_stmt = NULL;
 static sqlite3_stmt *_history_select_num_stmt = NULL;
@@ -279,6 +281,36 @@ gboolean dt_history_repository_delete_dev_history(const int32_t imgid)
   return ok;
 }
 
+gboolean dt_history_repository_delete_dev_history_from(const int32_t imgid, const int first_num)
+{
+  if(imgid <= 0) return FALSE;
+
+  _history_stmt_mutex_ensure();
+  dt_pthread_mutex_lock(&_history_stmt_mutex);
+  if(!_history_delete_history_from_stmt)
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
+                                "DELETE FROM main.history WHERE imgid = ?1 AND num >= ?2", -1,
+                                &_history_delete_history_from_stmt, NULL);
+  if(!_history_delete_masks_from_stmt)
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
+                                "DELETE FROM main.masks_history WHERE imgid = ?1 AND num >= ?2", -1,
+                                &_history_delete_masks_from_stmt, NULL);
+
+  gboolean ok = TRUE;
+  sqlite3_stmt *const stmts[] = { _history_delete_history_from_stmt, _history_delete_masks_from_stmt };
+  for(size_t i = 0; i < G_N_ELEMENTS(stmts); i++)
+  {
+    sqlite3_stmt *stmt = stmts[i];
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, first_num);
+    ok &= (sqlite3_step(stmt) == SQLITE_DONE);
+  }
+  dt_pthread_mutex_unlock(&_history_stmt_mutex);
+  return ok;
+}
+
 void dt_history_repository_foreach_row(const int32_t imgid, dt_history_repository_row_cb cb, void *user_data)
 {
   if(imgid <= 0 || IS_NULL_PTR(cb)) return;
@@ -987,6 +1019,16 @@ void dt_history_repository_cleanup(void)
     sqlite3_finalize(_history_delete_masks_stmt);
     _history_delete_masks_stmt = NULL;
   }
+  if(_history_delete_history_from_stmt)
+  {
+    sqlite3_finalize(_history_delete_history_from_stmt);
+    _history_delete_history_from_stmt = NULL;
+  }
+  if(_history_delete_masks_from_stmt)
+  {
+    sqlite3_finalize(_history_delete_masks_from_stmt);
+    _history_delete_masks_from_stmt = NULL;
+  }
   if(_history_shift_history_nums_stmt)
   {
     sqlite3_finalize(_history_shift_history_nums_stmt);
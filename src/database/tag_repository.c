@@ -73,10 +73,7 @@ GList *dt_tag_repository_get_by_path_with_counts(const char *path, const char *p
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
                               "SELECT t.id, t.name, ti.count"
                               "  FROM data.tags AS t"
-                              "  LEFT JOIN (SELECT tagid,"
-                              "               COUNT(DISTINCT imgid) AS count"
-                              "             FROM main.tagged_images"
-                              "             GROUP BY tagid) AS ti"
+                              "  LEFT JOIN memory.tag_usage AS ti"
                               "  ON ti.tagid = t.id"
                               "  WHERE name = ?1 OR SUBSTR(name, 1, LENGTH(?2)) = ?2",
                               -1, &stmt, NULL);
@@ -575,27 +572,19 @@ GList *dt_tag_repository_get_with_usage(const uint32_t nb_selected)
 {
   sqlite3_stmt *stmt = NULL;
 
-  /* Select tags that are similar to the keyword and are actually used to tag images*/
+  /* Global usage comes from memory.tag_usage, which the triggers on main.tagged_images keep
+   * current (see _create_memory_schema()). The selection's share is counted by walking from
+   * main.selected_images into the (imgid, tagid) primary key, so it costs the selection's
+   * attachments, not the whole library's. The key also makes COUNT(*) a count of images. */
   // clang-format off
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
-                              "INSERT INTO memory.taglist (id, count)"
-                              "  SELECT tagid, COUNT(*)"
-                              "  FROM main.tagged_images"
-                              "  GROUP BY tagid",
-                              -1, &stmt, NULL);
-  // clang-format on
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  /* Now put all the bits together */
-  // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
-                              "SELECT T.name, T.id, MT.count, CT.imgnb, T.flags, T.synonyms"
+                              "SELECT T.name, T.id, U.count, CT.imgnb, T.flags, T.synonyms"
                               "  FROM data.tags T "
-                              "  LEFT JOIN memory.taglist MT ON MT.id = T.id "
-                              "  LEFT JOIN (SELECT tagid, COUNT(DISTINCT imgid) AS imgnb"
-                              "             FROM main.tagged_images "
-                              "             WHERE imgid IN (SELECT imgid FROM main.selected_images) GROUP BY tagid) AS CT "
+                              "  LEFT JOIN memory.tag_usage U ON U.tagid = T.id "
+                              "  LEFT JOIN (SELECT I.tagid, COUNT(*) AS imgnb"
+                              "             FROM main.selected_images AS S"
+                              "             JOIN main.tagged_images AS I ON I.imgid = S.imgid"
+                              "             GROUP BY I.tagid) AS CT "
                               "    ON CT.tagid = T.id"
                               "  WHERE T.id NOT IN memory.darktable_tags "
                               "  ORDER BY T.name ",
@@ -622,10 +611,6 @@ GList *dt_tag_repository_get_with_usage(const uint32_t nb_selected)
   }
   sqlite3_finalize(stmt);
 
-  /* memory.taglist is scratch shared by several listings, so it is emptied on the way out
-   * rather than on the way in -- whoever runs next finds it clean. */
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get_sqlite3_global(), "DELETE FROM memory.taglist", NULL, NULL, NULL);
-
   return g_list_reverse(tags); // the ORDER BY is the point
 }
 
@@ -795,17 +780,15 @@ GList *dt_tag_repository_get_suggestions(const uint32_t nb_selected, const int c
   // clang-format off
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_sqlite3_global(),
                               "INSERT INTO memory.taglist (id, count, count2)"
-                              "  SELECT S.tagid, COUNT(imgid) AS count,"
-                              "    CASE WHEN count2 IS NULL THEN 0 ELSE count2 END AS count2"
-                              "  FROM main.tagged_images AS S"
+                              "  SELECT U.tagid, U.count, IFNULL(at.count2, 0)"
+                              "  FROM memory.tag_usage AS U"
                               "  LEFT JOIN ("
-                              "    SELECT tagid, COUNT(imgid) AS count2"
-                              "    FROM main.tagged_images"
-                              "    WHERE imgid IN main.selected_images"
-                              "    GROUP BY tagid) AS at"
-                              "  ON at.tagid = S.tagid"
-                              "  WHERE S.tagid NOT IN memory.darktable_tags"
-                              "  GROUP BY S.tagid",
+                              "    SELECT I.tagid, COUNT(*) AS count2"
+                              "    FROM main.selected_images AS S"
+                              "    JOIN main.tagged_images AS I ON I.imgid = S.imgid"
+                              "    GROUP BY I.tagid) AS at"
+                              "  ON at.tagid = U.tagid"
+                              "  WHERE U.count > 0 AND U.tagid NOT IN memory.darktable_tags",
                               -1, &stmt, NULL);
   // clang-format on
   sqlite3_step(stmt);
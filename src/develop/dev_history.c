@@ -563,6 +563,14 @@ GList *dt_history_duplicate(GList *hist)
   return g_list_reverse(result);  // list was built in reverse order, so un-reverse it
 }
 
+GList *dt_dev_history_share(GList *hist)
+{
+  GList *result = g_list_copy(hist);
+  for(GList *h = result; h; h = g_list_next(h))
+    dt_dev_history_item_ref((dt_dev_history_item_t *)h->data);
+  return result;
+}
+
 /* Installed by dt_dev_history_gui_init(); absent under ansel-cli and in tests. */
 static dt_dev_history_commit_gui_handler_t _commit_gui_handler = NULL;
 
@@ -659,7 +667,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
   GList *iop_order_list
       = (action == DT_ACTION_UNDO) ? hist->before_iop_order_list : hist->after_iop_order_list;
 
-  GList *history_temp = dt_history_duplicate(snapshot);
+  GList *history_temp = dt_dev_history_share(snapshot);
   GList *iop_order_temp = dt_ioppr_iop_order_copy_deep(iop_order_list);
 
   dt_pthread_rwlock_wrlock(&dev->history_mutex);
@@ -729,7 +737,7 @@ void dt_dev_history_undo_start_record_locked(dt_develop_t *dev)
     dev->undo_history_before_iop_order_list = NULL;
     dev->undo_history_before_end = 0;
 
-    dev->undo_history_before_snapshot = dt_history_duplicate(dev->history);
+    dev->undo_history_before_snapshot = dt_dev_history_share(dev->history);
     dev->undo_history_before_end = dt_dev_get_history_end_ext(dev);
     dev->undo_history_before_iop_order_list = dt_ioppr_iop_order_copy_deep(dev->iop_order_list);
   }
@@ -762,7 +770,7 @@ void dt_dev_history_undo_end_record_locked(dt_develop_t *dev)
   dev->undo_history_before_end = 0;
   dev->undo_history_before_iop_order_list = NULL;
 
-  hist->after_snapshot = dt_history_duplicate(dev->history);
+  hist->after_snapshot = dt_dev_history_share(dev->history);
   hist->after_end = dt_dev_get_history_end_ext(dev);
   hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(dev->iop_order_list);
 
@@ -1518,6 +1526,33 @@ void dt_dev_history_cleanup(void)
 
 
 
+void dt_dev_history_forget_written(dt_develop_t *dev)
+{
+  dt_pthread_mutex_lock(&dev->history_written_mutex);
+  dt_dev_history_release_snapshot(g_steal_pointer(&dev->history_written));
+  dev->history_written_imgid = UNKNOWN_IMAGE;
+  dt_pthread_mutex_unlock(&dev->history_written_mutex);
+}
+
+/**
+ * @brief Position of the first item of dev->history whose rows are not in the database.
+ *
+ * Items up to there are the very ones last written at the same positions. 0 when the dev did not
+ * write this image last, the whole history is written then.
+ */
+static int _history_first_unwritten(const dt_develop_t *dev, const int32_t imgid)
+{
+  if(dev->history_written_imgid != imgid) return 0;
+
+  int num = 0;
+  const GList *written = dev->history_written;
+  for(const GList *history = dev->history; history && written;
+      history = g_list_next(history), written = g_list_next(written), num++)
+    if(history->data != written->data) break;
+
+  return num;
+}
+
 void dt_dev_write_history_ext(dt_develop_t *dev, const int32_t imgid)
 {
   dt_image_t *cache_img = dt_image_cache_get(imgid, 'w');
@@ -1527,17 +1562,32 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int32_t imgid)
 
   dt_dev_set_history_hash(dev, dt_dev_history_compute_hash(dev));
 
-  _cleanup_history(imgid);
+  dt_pthread_mutex_lock(&dev->history_written_mutex);
+
+  // Rewrite from the first item that changed: rows past it may have moved, or be gone.
+  const int first = _history_first_unwritten(dev, imgid);
+  if(first == 0)
+    _cleanup_history(imgid);
+  else
+    dt_history_repository_delete_dev_history_from(imgid, first);
 
   // write history entries
-  int i = 0;
-  for(GList *history = g_list_first(dev->history); history; history = g_list_next(history))
+  int i = first;
+  for(GList *history = g_list_nth(dev->history, first); history; history = g_list_next(history))
   {
     dt_dev_history_item_t *hist = (dt_dev_history_item_t *)(history->data);
     dt_dev_write_history_item(imgid, hist, i);
     i++;
   }
 
+  dt_print(DT_DEBUG_HISTORY, "[dt_dev_write_history_ext] %i of %i history items written for image %i\n",
+           i - first, i, imgid);
+
+  dt_dev_history_release_snapshot(dev->history_written);
+  dev->history_written = dt_dev_history_share(dev->history);
+  dev->history_written_imgid = imgid;
+  dt_pthread_mutex_unlock(&dev->history_written_mutex);
+
   dt_history_repository_set_end(imgid, dt_dev_get_history_end_ext(dev));
 
   // write the current iop-order-list for this image
@@ -1560,7 +1610,7 @@ static int _dt_dev_write_history_job_run(dt_job_t *job)
   const double _write_ms = (dt_get_wtime() - _write_start) * 1000.0;
   if(_write_ms > 1.0)
     dt_print(DT_DEBUG_HISTORY,
-             "[_dt_dev_write_history_job_run] tid %lu full history+masks rewrite for image %i took %.2f ms\n",
+             "[_dt_dev_write_history_job_run] tid %lu history+masks write for image %i took %.2f ms\n",
              (unsigned long)pthread_self(), d->image_storage.id, _write_ms);
   // Clear before unlocking: dt_dev_add_history_item_real() always ends with a
   // dt_dev_write_history() call after it releases its own write lock, and that call
@@ -1587,7 +1637,7 @@ void dt_dev_write_history(dt_develop_t *dev, gboolean async)
   // Coalesce: a write already queued or running for this dev will read dev->history/
   // dev->forms live when it (finally) runs, so it necessarily picks up whatever is
   // committed by the time this call happens. Queuing another one would just repeat the
-  // exact same full history+masks_history rewrite for no additional freshness.
+  // exact same history+masks_history write for no additional freshness.
   if(dt_atomic_exch_int(&dev->history_write_pending, 1) != 0) return;
 
   dt_job_t *job = dt_control_job_create(&_dt_dev_write_history_job_run, "write history %d",
@@ -2160,6 +2210,7 @@ gboolean dt_dev_read_history_ext(dt_develop_t *dev, const int32_t imgid)
 
   // Start fresh
   dt_dev_history_free_history(dev);
+  dt_dev_history_forget_written(dev);
   int legacy_params = 0;
   dt_ioppr_set_default_iop_order(dev, imgid);
 
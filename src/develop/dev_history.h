@@ -107,14 +107,19 @@ void dt_dev_free_history_item(gpointer data);
  */
 dt_dev_history_item_t *dt_dev_history_item_ref(dt_dev_history_item_t *item);
 
+/**
+ * @brief Release a history list and one reference on each of its items.
+ */
+void dt_dev_history_release_snapshot(GList *snapshot);
+
 /**
  * @brief Copy-on-write gate for mutating a history item in place.
  *
  * If @p hist is exclusively owned by dev->history (refcount <= 1), returns it unchanged --
- * safe to mutate directly. If it's shared with an outstanding snapshot (a slow reader like a
- * pipe resync or the background DB-write job), clones it, splices the clone into dev->history
- * in place of the original (and re-points any pipe's last_history_item that referenced it),
- * releases the original reference, and returns the clone. Callers must mutate the *returned*
+ * safe to mutate directly. If it's shared with an outstanding snapshot (an undo record, the
+ * record of what was written to the database, a slow reader like a pipe resync), clones it,
+ * splices the clone into dev->history in place of the original (and re-points any pipe's
+ * last_history_item that referenced it), releases the original reference, and returns the clone. Callers must mutate the *returned*
  * pointer, never the one passed in.
  */
 dt_dev_history_item_t *dt_dev_history_cow_touch(struct dt_develop_t *dev, dt_dev_history_item_t *hist);
@@ -325,13 +330,24 @@ void dt_dev_history_drop_pending_commits(struct dt_develop_t *dev);
 /**
  * @brief Write dev->history to DB and XMP for a given image id.
  *
- * This acquires the database lock in write mode.
+ * This acquires the database lock in write mode. When the dev last wrote the same image, only the
+ * rows from the first item that changed since are rewritten: moving the history end, undoing or
+ * editing the last item touch a few rows instead of the whole history.
  *
  * @param dev Develop context.
  * @param imgid Image id.
  */
 void dt_dev_write_history_ext(struct dt_develop_t *dev, const int32_t imgid);
 
+/**
+ * @brief Forget what dt_dev_write_history_ext() last wrote, so that the next write rewrites the
+ * whole history of the image.
+ *
+ * Called whenever the rows may have changed behind the dev: history read from the database, dev
+ * cleanup.
+ */
+void dt_dev_history_forget_written(struct dt_develop_t *dev);
+
 /**
  * @brief Thread-safe wrapper around dt_dev_write_history_ext() for dev->image_storage.id.
  *
@@ -702,6 +718,17 @@ gboolean dt_dev_transient_params_active(struct dt_develop_t *dev, const struct d
  *  dt_iop_get_module() -- neither of which layer 1 can see. */
 GList *dt_history_duplicate(GList *hist);
 
+/**
+ * @brief Copy a history list sharing its items: one more reference on each.
+ *
+ * Undo snapshots and the record of what was written to the database are taken this way: items
+ * are cloned by dt_dev_history_cow_touch() only when edited, so consecutive snapshots cost a list
+ * of pointers and share every item they have in common. Release with
+ * dt_dev_history_release_snapshot(). Not for a history whose items get rebound to the modules of
+ * another dev (dev_snapshot.c, history merge backups): those need dt_history_duplicate().
+ */
+GList *dt_dev_history_share(GList *hist);
+
 #ifdef __cplusplus
 }
 #endif
@@ -313,6 +313,11 @@ static gboolean _sync_focused_in_place(dt_dev_pixelpipe_t *pipe)
  * - global histogram stages sampling their output,
  * - active GUI editing on the module itself.
  *
+ * The same walk records `piece->output_observed`: something outside the pipe
+ * (picker, histogram, autoset, the focused module) reads this output, either as
+ * the output of this module or as the input of the next one. The raw and geometry
+ * stages may only fuse a module whose output nobody looks at.
+ *
  * GUI cache requests are intentionally not turned into eager host retention
  * here. `dt_dev_pixelpipe_cache_peek_gui()` can already reopen a device-only
  * cacheline and materialize RAM on demand, so keeping the one-shot request out
@@ -339,6 +344,7 @@ static void _seal_opencl_cache_policy(dt_dev_pixelpipe_t *pipe)
   const dt_iop_module_t *const picker_module = pipe->dev->color_picker.module;
 
   gboolean current_output_must_cache_host = TRUE;
+  gboolean next_reads_input = FALSE;
 
   for(GList *pieces = g_list_last(pipe->nodes); pieces; pieces = g_list_previous(pieces))
   {
@@ -392,6 +398,10 @@ static void _seal_opencl_cache_policy(dt_dev_pixelpipe_t *pipe)
     piece->cache_output_on_ram
         = dt_dev_pipe_cache_policy_decide(&inputs, current_output_must_cache_host,
                                           &current_output_must_cache_host);
+
+    // The picker samples the input of its module too.
+    piece->output_observed = color_picker_on || global_hist_output_on || next_reads_input;
+    next_reads_input = color_picker_on || active_in_gui || module_hist_on || global_hist_input_on || has_autoset;
   }
 }
 
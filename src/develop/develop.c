@@ -135,6 +135,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dt_pthread_rwlock_set_name(&dev->history_mutex, "history_mutex"); // find_history_mutex_blocker, temporary
   dt_pthread_rwlock_init(&dev->masks_mutex, NULL);
   dt_pthread_mutex_init(&dev->transient_params_mutex, NULL);
+  dt_pthread_mutex_init(&dev->history_written_mutex, NULL);
 
   dev->gui_attached = gui_attached;
   if(gui_attached) dev->viewport = dt_dev_viewport_new();
@@ -254,6 +255,9 @@ void dt_dev_cleanup(dt_develop_t *dev)
   dt_pthread_rwlock_unlock(&dev->history_mutex);
   dt_pthread_rwlock_destroy(&dev->history_mutex);
 
+  dt_dev_history_forget_written(dev);
+  dt_pthread_mutex_destroy(&dev->history_written_mutex);
+
   // free pending "before" snapshots for history undo
   dev->undo_history_depth = 0;
   g_list_free_full(dev->undo_history_before_snapshot, dt_dev_free_history_item);
@@ -241,11 +241,21 @@ typedef struct dt_develop_t
   GList *history;
 
   // Set to 1 while a dt_dev_write_history() background job is queued or running for this
-  // dev, 0 otherwise. Lets dt_dev_write_history() skip queuing a redundant full history+masks
+  // dev, 0 otherwise. Lets dt_dev_write_history() skip queuing a redundant history+masks
   // rewrite when one is already in flight -- the pending job reads dev->history live when it
   // runs, so it always picks up whatever was last committed. See dev_history.c.
   dt_atomic_int history_write_pending;
 
+  // What main.history and main.masks_history hold for history_written_imgid, as last written by
+  // dt_dev_write_history_ext(): one reference on each item of dev->history, in order. Shared items
+  // are never mutated in place (dt_dev_history_cow_touch()), so an item found at the same position
+  // here and in dev->history still matches its rows and is not written again. NULL when the rows
+  // are not known, then the next write rewrites them all. Guarded by history_written_mutex: writes
+  // run under history_mutex taken as reader, possibly two at once.
+  GList *history_written;
+  int32_t history_written_imgid;
+  dt_pthread_mutex_t history_written_mutex;
+
   // operations pipeline
   int32_t iop_instance;
   GList *iop;
@@ -101,6 +101,11 @@ static dt_hm_missing_raster_handler_t _missing_raster_handler = NULL;
 static dt_hm_toposort_cycle_handler_t _toposort_cycle_handler = NULL;
 static dt_hm_merge_report_handler_t _merge_report_handler = NULL;
 
+/* Set by dt_history_merge() for the merge running on this thread, from its batch. A headless
+ * merge runs on a worker next to others: it gets the defaults, never the GUI. The one question
+ * with no safe default, the merge report, is deferred to the caller instead. */
+static __thread gboolean _hm_headless = FALSE;
+
 void dt_hm_set_constraints_choice_handler(dt_hm_constraints_choice_handler_t handler)
 {
   _constraints_choice_handler = handler;
@@ -125,19 +130,19 @@ static dt_hm_constraint_choice_t _hm_constraints_choice(GHashTable *id_ht, const
                                                         const char *src_prev, const char *src_next,
                                                         const char *dst_prev, const char *dst_next)
 {
-  if(IS_NULL_PTR(_constraints_choice_handler)) return DT_HM_CONSTRAINTS_PREFER_DEST;
+  if(_hm_headless || IS_NULL_PTR(_constraints_choice_handler)) return DT_HM_CONSTRAINTS_PREFER_DEST;
   return _constraints_choice_handler(id_ht, faulty_id, src_prev, src_next, dst_prev, dst_next);
 }
 
 static gboolean _hm_confirm_missing_raster(const GList *mod_list)
 {
-  if(IS_NULL_PTR(_missing_raster_handler)) return TRUE;
+  if(_hm_headless || IS_NULL_PTR(_missing_raster_handler)) return TRUE;
   return _missing_raster_handler(mod_list);
 }
 
 static void _hm_report_toposort_cycle(GList *cycle_nodes, GHashTable *id_ht)
 {
-  if(IS_NULL_PTR(_toposort_cycle_handler)) return;
+  if(_hm_headless || IS_NULL_PTR(_toposort_cycle_handler)) return;
   _toposort_cycle_handler(cycle_nodes, id_ht);
 }
 
@@ -147,7 +152,7 @@ static gboolean _hm_report_merge(dt_develop_t *dev_dest, dt_develop_t *dev_src,
                                  const GHashTable *orig_ids, const GHashTable *mod_list_ids,
                                  const char *source_label, dt_hm_batch_state_t *batch)
 {
-  if(IS_NULL_PTR(_merge_report_handler)) return FALSE;
+  if(_hm_headless || IS_NULL_PTR(_merge_report_handler)) return FALSE;
   return _merge_report_handler(dev_dest, dev_src, merge_iop_order, used_source_order, strategy, src_last_by_id,
                                dst_last_before_by_id, orig_ids, mod_list_ids, source_label, batch);
 }
@@ -1614,6 +1619,20 @@ void dt_hm_batch_state_cleanup(dt_hm_batch_state_t *batch)
   }
 }
 
+void dt_hm_batch_state_fork(dt_hm_batch_state_t *worker, const dt_hm_batch_state_t *settled)
+{
+  if(IS_NULL_PTR(worker)) return;
+  worker->decision = settled ? settled->decision : DT_HM_BATCH_UNDECIDED;
+  worker->order_ids = settled ? g_list_copy_deep(settled->order_ids, (GCopyFunc)g_strdup, NULL) : NULL;
+  worker->headless = TRUE;
+  worker->deferred = FALSE;
+}
+
+gboolean dt_hm_batch_needs_report(const dt_hm_batch_state_t *batch)
+{
+  return !IS_NULL_PTR(_merge_report_handler) && (IS_NULL_PTR(batch) || batch->decision == DT_HM_BATCH_UNDECIDED);
+}
+
 static dt_iop_module_t *_hm_dest_module_from_id(dt_develop_t *dev, const char *id)
 {
   /* Resolve a node id ("op|multi_name") to a destination module instance.
@@ -1725,6 +1744,9 @@ static const char *_hm_failure_message(const char *cleanup_reason)
   if(!g_strcmp0(cleanup_reason, "merge report revert"))
     return NULL; // user-initiated cancel, not a failure
 
+  if(!g_strcmp0(cleanup_reason, "merge report deferred"))
+    return NULL; // the caller redoes it with the report
+
   if(!g_strcmp0(cleanup_reason, "_hm_try_merge_iop_order_topologically()"))
     return _("Could not paste: the pasted modules require a pipeline order that conflicts "
              "with this image's current module order.");
@@ -1764,6 +1786,7 @@ int dt_history_merge(dt_develop_t *dev_dest, dt_develop_t *dev_src, const int32_
   if(dest_imgid <= 0) return 1;
   if(IS_NULL_PTR(mod_list)) return 0;
 
+  _hm_headless = batch && batch->headless;
   if(!_hm_confirm_missing_raster(mod_list)) return 1;
 
   int rc = 1;
@@ -1916,6 +1939,17 @@ int dt_history_merge(dt_develop_t *dev_dest, dt_develop_t *dev_src, const int32_
   const gboolean silent = batch
                           && (batch->decision == DT_HM_BATCH_REVERT
                               || (batch->decision == DT_HM_BATCH_ACCEPT && use_cached_order));
+  // A headless merge can't re-open the report, and must not accept in its place: it reverts and
+  // leaves the image to its caller, which redoes it where the report can show.
+  if(!silent && _hm_headless && !IS_NULL_PTR(_merge_report_handler))
+  {
+    batch->deferred = TRUE;
+    _hm_restore_dest_from_backup(dev_dest, &backup);
+    cleanup_reason = "merge report deferred";
+    cleanup_line = __LINE__;
+    goto cleanup;
+  }
+
   if(silent)
     revert = (batch->decision == DT_HM_BATCH_REVERT);
   else
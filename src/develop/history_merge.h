@@ -51,6 +51,13 @@ extern "C"
     // accepted image of a batch. When non-NULL, later images replay this order instead of re-solving it,
     // so a single high-level decision (and any manual reorder done in the report) applies to the whole batch.
     GList *order_ids;
+    // Merges of this batch run concurrently, off the GUI thread: no handler is asked anything, every
+    // question takes the answer it gets when no handler is registered.
+    gboolean headless;
+    // Set by a headless merge that would have re-opened the report (no settled decision, or a cached
+    // order that does not apply to its image). The merge is reverted and nothing is written: the
+    // caller clears the flag and redoes that image with its own batch, where the report can open.
+    gboolean deferred;
   } dt_hm_batch_state_t;
 
   /**
@@ -58,6 +65,28 @@ extern "C"
    */
   void dt_hm_batch_state_cleanup(dt_hm_batch_state_t *batch);
 
+  /**
+   * @brief Give one worker of a concurrent batch its own copy of the batch state, decision and cached
+   * order included, flagged headless.
+   *
+   * @details Merges write the batch they are handed (the order captured on the first accepted image),
+   * so workers must not share it. What a worker caches in its copy stays there and goes away with
+   * dt_hm_batch_state_cleanup().
+   *
+   * @param worker State to initialize.
+   * @param settled Batch whose decision is settled, or NULL for a batch with no decision.
+   */
+  void dt_hm_batch_state_fork(dt_hm_batch_state_t *worker, const dt_hm_batch_state_t *settled);
+
+  /**
+   * @brief Whether merging against @p batch asks the merge report for every image.
+   *
+   * @details TRUE while a report handler is registered and @p batch has no decision yet, NULL
+   * meaning a lone merge. Such merges must run one at a time from the caller: run headless, they
+   * would all be deferred.
+   */
+  gboolean dt_hm_batch_needs_report(const dt_hm_batch_state_t *batch);
+
   /**
    * @brief Merge a list of modules into a destination image, solving pipeline topologies
    * for proper insertion of source modules.
@@ -73,8 +102,10 @@ extern "C"
    * @param strategy DT_HISTORY_MERGE_APPEND or DT_HISTORY_MERGE_PREPEND.
    * @param force_new_modules If TRUE, always add modules from source as new instances (when possible).
    * @param source_label Optional source label for the report header (style name, for example).
+   * @param batch Batch the merge belongs to, or NULL. A headless batch never opens the report: a merge
+   *              that needs one is reverted and flagged `deferred` in @p batch instead.
    *
-   * @return 0 on success, 1 on error.
+   * @return 0 on success, 1 on error, revert or deferral.
    */
   int dt_history_merge(struct dt_develop_t *dev_dest, struct dt_develop_t *dev_src, const int32_t dest_imgid,
                        const GList *mod_list, const gboolean merge_iop_order,
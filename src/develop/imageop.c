@@ -507,7 +507,7 @@ static int _iop_load_module_static(dt_iop_module_so_t *module,
 /* The old inline widget members were zeroed here at load; the gui struct is calloc'd by
  * dt_iop_gui_init() when (and only when) a GUI attaches, so a headless load must not
  * touch module->gui at all -- it is NULL by design. */
-int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
+static int _iop_init_instance(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
 {
   module->dev = dev;
   module->hide_enable_button = 0;
@@ -571,7 +571,11 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->default_blendop_params = calloc(1, sizeof(dt_develop_blend_params_t));
 
   // Don't init defaults here, it's done when reading/initing history
+  return 0;
+}
 
+static void _iop_init_common_fields(dt_iop_module_t *module)
+{
   /* pass on the dt_gui_module_t args for bauhaus widgets
    * only when a GUI lifetime exists for this module instance. */
   if(IS_NULL_PTR(module->dev) || module->dev->gui_attached)
@@ -589,7 +593,108 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->common_fields.focus = module->iop_focus;
   module->common_fields.ensure_visible = _iop_ensure_visible;
   module->common_fields.deprecated = (module->flags() & IOP_FLAGS_DEPRECATED) == IOP_FLAGS_DEPRECATED;
+}
+
+/**
+ * @brief Module prototypes for headless devs.
+ *
+ * @details Every dt_dev_init() instantiates all the modules, and thumbnails, exports, style
+ * applications and history pastes each build a short-lived headless dev. Running ~100 init()
+ * for each of them, most of which walk the whole introspection of their params to fill the
+ * defaults, is pure overhead: init() does not depend on the dev or the image -- that is what
+ * reload_defaults() is for -- so its result is the same every time. (retouch reads its default
+ * algorithm from the config in init(), but reload_defaults() reads it again anyway.)
+ *
+ * So the first headless instance of a module keeps a pristine copy of itself in its
+ * dt_iop_module_so_t, and the next ones are a memcpy of that prototype plus their own copies
+ * of everything it owns: params, default params, blend params and the raster mask tables.
+ * GUI devs still run init(), they are long-lived and cheap by comparison.
+ *
+ * The module API lets init() allocate more than the params, as long as cleanup() frees it
+ * (see iop/useless.c). A shallow copy would share that, so a module with its own cleanup() is
+ * never cloned.
+ *
+ * Disabled by `develop/module_prototypes=FALSE`, read once at startup, to compare both paths.
+ */
+static GMutex _prototype_lock;
+static gboolean _prototypes_enabled = FALSE;
+
+static void _iop_prototype_free(dt_iop_module_t *module)
+{
+  if(IS_NULL_PTR(module)) return;
+  module->cleanup(module);
+  dt_free(module->blend_params);
+  dt_free(module->default_blendop_params);
+  g_hash_table_destroy(module->raster_mask.source.users);
+  g_hash_table_destroy(module->raster_mask.source.masks);
+  dt_free(module);
+}
+
+static const dt_iop_module_t *_iop_get_prototype(dt_iop_module_so_t *so)
+{
+  g_mutex_lock(&_prototype_lock);
+  if(IS_NULL_PTR(so->prototype) && !so->no_prototype)
+  {
+    dt_iop_module_t *prototype = (dt_iop_module_t *)calloc(1, sizeof(dt_iop_module_t));
+    if(IS_NULL_PTR(prototype) || so->cleanup != default_cleanup)
+      so->no_prototype = TRUE;
+    else if(_iop_init_instance(prototype, so, NULL)
+            || IS_NULL_PTR(prototype->params) || IS_NULL_PTR(prototype->default_params)
+            || IS_NULL_PTR(prototype->blend_params) || IS_NULL_PTR(prototype->default_blendop_params))
+    {
+      _iop_prototype_free(prototype);
+      prototype = NULL;
+      so->no_prototype = TRUE;
+    }
+    if(so->no_prototype)
+      dt_free(prototype);
+    else
+      so->prototype = prototype;
+  }
+  g_mutex_unlock(&_prototype_lock);
+  return so->prototype;
+}
+
+static int _iop_clone_prototype(dt_iop_module_t *module, const dt_iop_module_t *prototype, dt_develop_t *dev)
+{
+  memcpy(module, prototype, sizeof(dt_iop_module_t));
+  module->dev = dev;
+  module->raster_mask.source.users = g_hash_table_new(NULL, NULL);
+  module->raster_mask.source.masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_gpointer);
+  module->params = malloc(prototype->params_size);
+  module->default_params = malloc(prototype->params_size);
+  module->blend_params = calloc(1, sizeof(dt_develop_blend_params_t));
+  module->default_blendop_params = calloc(1, sizeof(dt_develop_blend_params_t));
+  if(IS_NULL_PTR(module->params) || IS_NULL_PTR(module->default_params)
+     || IS_NULL_PTR(module->blend_params) || IS_NULL_PTR(module->default_blendop_params))
+  {
+    dt_free(module->params);
+    dt_free(module->default_params);
+    dt_free(module->blend_params);
+    dt_free(module->default_blendop_params);
+    g_hash_table_destroy(module->raster_mask.source.users);
+    g_hash_table_destroy(module->raster_mask.source.masks);
+    return 1;
+  }
 
+  memcpy(module->params, prototype->params, prototype->params_size);
+  memcpy(module->default_params, prototype->default_params, prototype->params_size);
+  return 0;
+}
+
+int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
+{
+  const dt_iop_module_t *prototype
+      = (_prototypes_enabled && !IS_NULL_PTR(dev) && !dev->gui_attached) ? _iop_get_prototype(so) : NULL;
+
+  if(prototype)
+  {
+    if(_iop_clone_prototype(module, prototype, dev)) return 1;
+  }
+  else if(_iop_init_instance(module, so, dev))
+    return 1;
+
+  _iop_init_common_fields(module);
   return 0;
 }
 
@@ -973,6 +1078,8 @@ void dt_iop_load_modules_so(void)
   // Batch presets initialization in a single transaction to avoid per-module BEGIN/COMMIT overhead.
   dt_database_begin_transaction_batch();
 
+  _prototypes_enabled = dt_conf_get_bool("develop/module_prototypes");
+
   GList *modules = NULL;
   for(int k = 0; k < dt_iop_static_modules_count; k++)
   {
@@ -1063,6 +1170,8 @@ void dt_iop_unload_modules_so()
   while(darktable.iop)
   {
     dt_iop_module_so_t *module = (dt_iop_module_so_t *)darktable.iop->data;
+    _iop_prototype_free(module->prototype);
+    module->prototype = NULL;
     if(module->cleanup_global) module->cleanup_global(module);
     dt_free(darktable.iop->data);
     darktable.iop = g_list_delete_link(darktable.iop, darktable.iop);
@@ -245,6 +245,12 @@ typedef struct dt_iop_module_so_t
 
   // introspection related data
   gboolean have_introspection;
+
+  /** instance freshly out of init(), built on first use and cloned by headless devs instead of
+   * running init() again. Read-only once built; owned by dt_iop_unload_modules_so(). */
+  struct dt_iop_module_t *prototype;
+  /** init() could not be replayed by a copy, or building the prototype failed: always init. */
+  gboolean no_prototype;
 } dt_iop_module_so_t;
 
 typedef struct dt_iop_module_t
@@ -398,7 +404,8 @@ extern const int dt_iop_static_modules_count;
 void dt_iop_load_modules_so(void);
 /** tears down the module descriptors built by dt_iop_load_modules_so(). */
 void dt_iop_unload_modules_so(void);
-/** load a module for a given .so */
+/** load a module for a given .so. Instances for a headless dev are cloned from the module's
+ * prototype, see doc in imageop.c. */
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, struct dt_develop_t *dev);
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, struct dt_develop_t *dev);
 /** calls module->cleanup and closes the dl connection. */
@@ -513,7 +513,12 @@ static void _gui_delete_callback(GtkButton *button, dt_iop_module_t *module)
     {
       dt_dev_history_item_t *hist = (dt_dev_history_item_t *)(history->data);
       // the loop above guards NULL entries in this same list; this one must too
-      if(hist && hist->module == first) hist->multi_priority = 0;
+      if(hist && hist->module == first)
+      {
+        // the undo snapshot and the written history share the item: edit a clone
+        hist = dt_dev_history_cow_touch(dev, hist);
+        hist->multi_priority = 0;
+      }
     }
   }
 
@@ -0,0 +1,242 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Aurélien Pierre.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pipe_counters.h"
+#include "common/times.h"
+#include "system/dtpthread.h"
+#include "system/macros.h"
+#include "develop/imageop.h"      // dt_iop_module_t
+#include "develop/pixelpipe_hb.h" // dt_dev_pixelpipe_t, dt_pixelpipe_get_pipe_name
+
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <stdio.h>
+#include <time.h>
+
+gint dt_pipe_counters_sink_open = 0;
+
+static struct
+{
+  FILE *file;
+  dt_pthread_mutex_t lock;
+  gboolean inited;
+} _pc = { 0 };
+
+// Per-thread accumulators. The tiling and colour-conversion paths add to them from the
+// thread driving the recursion; node and run records read them as differences between
+// two samples, so nested runs on the same thread never need a reset.
+static __thread int _tiles = 0;
+static __thread double _colorspace = 0.0;
+
+// Run totals, also per thread: one pipe recursion runs on one thread.
+static __thread struct
+{
+  int nodes;
+  int hits;
+  size_t bytes_read;
+  size_t bytes_written;
+} _run = { 0 };
+
+// CPU seconds consumed by the whole process (`thread` FALSE) or by the calling thread.
+static double _cputime(const gboolean thread)
+{
+#ifdef _WIN32
+  // No per-thread clock on MinGW: fall back to the process rusage, which is what
+  // dt_get_times() reports too.
+  (void)thread;
+  dt_times_t t;
+  dt_get_times(&t);
+  return t.user;
+#else
+  struct timespec ts;
+  if(clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &ts)) return 0.0;
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static const char *_thread_tag(void)
+{
+  static __thread char tag[24];
+  g_snprintf(tag, sizeof(tag), "thread-%p", (void *)g_thread_self());
+  return tag;
+}
+
+int dt_pipe_counters_init(const char *path)
+{
+  if(_pc.inited) return 0;
+  dt_pthread_mutex_init(&_pc.lock, NULL);
+  _pc.inited = TRUE;
+
+  if(IS_NULL_PTR(path) || !path[0]) return 0;
+
+  _pc.file = g_fopen(path, "a");
+  if(IS_NULL_PTR(_pc.file))
+  {
+    fprintf(stderr, "[pipe_counters] can't open `%s' for writing\n", path);
+    return 1;
+  }
+  g_atomic_int_set(&dt_pipe_counters_sink_open, 1);
+  return 0;
+}
+
+void dt_pipe_counters_cleanup(void)
+{
+  if(!_pc.inited) return;
+  g_atomic_int_set(&dt_pipe_counters_sink_open, 0);
+  dt_pthread_mutex_lock(&_pc.lock);
+  if(_pc.file) fclose(_pc.file);
+  _pc.file = NULL;
+  dt_pthread_mutex_unlock(&_pc.lock);
+  dt_pthread_mutex_destroy(&_pc.lock);
+  _pc.inited = FALSE;
+}
+
+// Serialize `root` as one compact NDJSON line to every active sink. Takes ownership of root.
+static void _emit_line(JsonObject *root)
+{
+  JsonNode *node = json_node_new(JSON_NODE_OBJECT);
+  json_node_take_object(node, root);
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_root(gen, node);
+  json_generator_set_pretty(gen, FALSE);
+  gchar *str = json_generator_to_data(gen, NULL);
+
+  dt_pthread_mutex_lock(&_pc.lock);
+  if(dt_get_debug_flags() & DT_DEBUG_COUNTERS)
+  {
+    fprintf(stderr, "%s\n", str);
+    fflush(stderr);
+  }
+  if(_pc.file)
+  {
+    fprintf(_pc.file, "%s\n", str);
+    fflush(_pc.file);
+  }
+  dt_pthread_mutex_unlock(&_pc.lock);
+
+  g_free(str);
+  g_object_unref(gen);
+  json_node_free(node);
+}
+
+// Same keys as the supervisor envelope, so both streams merge by `ts`.
+static JsonObject *_envelope(const char *domain, const dt_dev_pixelpipe_t *pipe)
+{
+  JsonObject *o = json_object_new();
+  json_object_set_double_member(o, "ts", dt_get_wtime() - dt_get_start_wtime());
+  json_object_set_string_member(o, "thread", _thread_tag());
+  json_object_set_string_member(o, "domain", domain);
+  json_object_set_string_member(o, "pipe", dt_pixelpipe_get_pipe_name(pipe->type));
+  if(pipe->imgid > 0) json_object_set_int_member(o, "imgid", pipe->imgid);
+  return o;
+}
+
+void dt_pipe_counters_begin(dt_pipe_counters_sample_t *sample)
+{
+  sample->wall = dt_get_wtime();
+  sample->process_cpu = _cputime(FALSE);
+  sample->thread_cpu = _cputime(TRUE);
+  sample->colorspace = _colorspace;
+  sample->tiles = _tiles;
+}
+
+void dt_pipe_counters_node(const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                           const dt_pipe_counters_sample_t *start, const gboolean cache_hit,
+                           const gboolean on_gpu, const size_t bytes_read, const size_t bytes_written)
+{
+  if(!_pc.inited) return;
+
+  dt_pipe_counters_sample_t end;
+  dt_pipe_counters_begin(&end);
+
+  _run.nodes++;
+  if(cache_hit) _run.hits++;
+  _run.bytes_read += bytes_read;
+  _run.bytes_written += bytes_written;
+
+  const dt_iop_module_t *module = piece->module;
+  JsonObject *root = _envelope("counters", pipe);
+  json_object_set_string_member(root, "module", module->op);
+  json_object_set_int_member(root, "multi_priority", module->multi_priority);
+  if(module->multi_name[0]) json_object_set_string_member(root, "multi_name", module->multi_name);
+  json_object_set_int_member(root, "iop_order", module->iop_order);
+  json_object_set_string_member(root, "cache", cache_hit ? "hit" : "miss");
+  json_object_set_string_member(root, "device", cache_hit ? "none" : on_gpu ? "gpu" : "cpu");
+
+  JsonArray *roi = json_array_new();
+  json_array_add_int_element(roi, piece->roi_out.width);
+  json_array_add_int_element(roi, piece->roi_out.height);
+  json_object_set_array_member(root, "roi", roi);
+
+  json_object_set_double_member(root, "wall", end.wall - start->wall);
+  json_object_set_double_member(root, "cpu", end.process_cpu - start->process_cpu);
+  json_object_set_double_member(root, "thread_cpu", end.thread_cpu - start->thread_cpu);
+  json_object_set_double_member(root, "colorspace", end.colorspace - start->colorspace);
+  json_object_set_int_member(root, "tiles", end.tiles - start->tiles);
+  json_object_set_int_member(root, "bytes_read", (gint64)bytes_read);
+  json_object_set_int_member(root, "bytes_written", (gint64)bytes_written);
+
+  _emit_line(root);
+}
+
+void dt_pipe_counters_run_begin(dt_pipe_counters_sample_t *start)
+{
+  _run.nodes = _run.hits = 0;
+  _run.bytes_read = _run.bytes_written = 0;
+  dt_pipe_counters_begin(start);
+}
+
+void dt_pipe_counters_run_end(const dt_dev_pixelpipe_t *pipe, const dt_pipe_counters_sample_t *start,
+                              const int error)
+{
+  if(!_pc.inited) return;
+
+  dt_pipe_counters_sample_t end;
+  dt_pipe_counters_begin(&end);
+
+  JsonObject *root = _envelope("run", pipe);
+  json_object_set_boolean_member(root, "error", error != 0);
+  json_object_set_int_member(root, "nodes", _run.nodes);
+  json_object_set_int_member(root, "hits", _run.hits);
+  json_object_set_int_member(root, "misses", _run.nodes - _run.hits);
+  json_object_set_double_member(root, "wall", end.wall - start->wall);
+  json_object_set_double_member(root, "cpu", end.process_cpu - start->process_cpu);
+  json_object_set_double_member(root, "thread_cpu", end.thread_cpu - start->thread_cpu);
+  json_object_set_double_member(root, "colorspace", end.colorspace - start->colorspace);
+  json_object_set_int_member(root, "tiles", end.tiles - start->tiles);
+  json_object_set_int_member(root, "bytes_read", (gint64)_run.bytes_read);
+  json_object_set_int_member(root, "bytes_written", (gint64)_run.bytes_written);
+
+  _emit_line(root);
+}
+
+void dt_pipe_counters_add_tiles(const int tiles)
+{
+  _tiles += tiles;
+}
+
+double dt_pipe_counters_colorspace_begin(void)
+{
+  return dt_pipe_counters_active() ? dt_get_wtime() : 0.0;
+}
+
+void dt_pipe_counters_colorspace_end(const double start)
+{
+  if(start == 0.0) return;
+  _colorspace += dt_get_wtime() - start;
+}
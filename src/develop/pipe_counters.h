@@ -0,0 +1,121 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Aurélien Pierre.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_DEVELOP_PIPE_COUNTERS_H
+#define DT_DEVELOP_PIPE_COUNTERS_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/logging.h"
+
+struct dt_dev_pixelpipe_t;
+struct dt_dev_pixelpipe_iop_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Per-node pipeline counters.
+ *
+ * `-d perf` prints one human line per module to stderr, which is enough to eyeball a
+ * slow module on a workstation but useless to track regressions across versions. The
+ * counters record, for every node a pipe run touches, one line of NDJSON with:
+ *
+ *   - `wall`: wall-clock seconds spent in the node (recursion into upstream nodes excluded),
+ *   - `cpu`: process CPU seconds consumed meanwhile, i.e. summed over the OpenMP workers.
+ *     `cpu / wall` is the effective parallelism; a memory-bound module sits well below
+ *     the thread count,
+ *   - `thread_cpu`: CPU seconds of the thread driving the recursion,
+ *   - `bytes_read` / `bytes_written`: size of the input and output buffers the node
+ *     streamed through; `(bytes_read + bytes_written) / wall` is the bandwidth it achieved,
+ *   - `tiles`: number of tiles the module was split into, 0 when it ran in one piece,
+ *   - `cache`: "hit" when the output was served from the pixelpipe cache, "miss" when
+ *     it was computed,
+ *   - `colorspace`: seconds spent converting colour spaces around the module (input
+ *     conversion and blending legs), included in `wall`.
+ *
+ * A closing `run` record per dt_dev_pixelpipe_process() sums the run. Records share the
+ * supervisor envelope (`ts`, `thread`, `domain`, `pipe`, `imgid`), so both streams can
+ * be merged and sorted by timestamp. See doc/supervisor.md.
+ *
+ * Sinks: stderr under `-d counters`, and/or the file given to `--pipe-counters <file>`
+ * (also reachable from ansel-cli as `--counters <file>`). When neither is set,
+ * dt_pipe_counters_active() is one predicted-false branch per call site.
+ *
+ * Thread safety: the recursion of one pipe runs on one thread, so per-node accumulators
+ * (tiles, colour conversions) are thread-local. Only the sink is shared, under its mutex.
+ */
+
+// Non-zero while a file sink is open. Read via dt_pipe_counters_active().
+extern gint dt_pipe_counters_sink_open;
+
+static inline gboolean dt_pipe_counters_active(void)
+{
+  return (dt_get_debug_flags() & DT_DEBUG_COUNTERS) || g_atomic_int_get(&dt_pipe_counters_sink_open);
+}
+
+// Lifecycle, called once from dt_init()/dt_cleanup(). `path` may be NULL (stderr only).
+// Returns 1 if the file sink could not be opened.
+int dt_pipe_counters_init(const char *path);
+void dt_pipe_counters_cleanup(void);
+
+// Snapshot of the clocks and thread-local accumulators when a node or a run starts.
+typedef struct dt_pipe_counters_sample_t
+{
+  double wall;
+  double process_cpu;
+  double thread_cpu;
+  double colorspace;
+  int tiles;
+} dt_pipe_counters_sample_t;
+
+void dt_pipe_counters_begin(dt_pipe_counters_sample_t *sample);
+
+/**
+ * Emit the record of one node.
+ * @param start          sample taken right before the node started its own work.
+ * @param cache_hit      TRUE if the output came from the cache.
+ * @param on_gpu         TRUE if the module processed on OpenCL.
+ * @param bytes_read     input bytes consumed (0 on a cache hit).
+ * @param bytes_written  output bytes produced (0 on a cache hit).
+ */
+void dt_pipe_counters_node(const struct dt_dev_pixelpipe_t *pipe, const struct dt_dev_pixelpipe_iop_t *piece,
+                           const dt_pipe_counters_sample_t *start, gboolean cache_hit, gboolean on_gpu,
+                           size_t bytes_read, size_t bytes_written);
+
+// Open and close the `run` record wrapping one dt_dev_pixelpipe_process() recursion.
+void dt_pipe_counters_run_begin(dt_pipe_counters_sample_t *start);
+void dt_pipe_counters_run_end(const struct dt_dev_pixelpipe_t *pipe, const dt_pipe_counters_sample_t *start,
+                              int error);
+
+// Thread-local accumulators fed by the tiling and colour-conversion paths.
+void dt_pipe_counters_add_tiles(int tiles);
+
+// Bracket a colour-space conversion. Returns 0 when counters are off, and
+// dt_pipe_counters_colorspace_end() ignores a 0 start, so both are free when off.
+double dt_pipe_counters_colorspace_begin(void);
+void dt_pipe_counters_colorspace_end(double start);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // DT_DEVELOP_PIPE_COUNTERS_H
+
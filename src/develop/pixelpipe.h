@@ -62,6 +62,10 @@ typedef struct dt_dev_histogram_collection_params_t
   uint32_t bins_count;
   /** in most cases, bins_count-1. */
   float mul;
+  /** bin about that many pixels, spread over the ROI, instead of all of them. 0 bins them all. */
+  uint32_t max_samples;
+  /** set by dt_histogram_worker(): one pixel is binned every sample_step, in both directions. */
+  uint32_t sample_step;
 } dt_dev_histogram_collection_params_t;
 
 // params used to collect histogram during last histogram capture
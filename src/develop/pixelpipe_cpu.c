@@ -10,10 +10,13 @@
 #include "develop/iop_order.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe_cpu.h"
+#include "pixel/geometry_stage.h"
+#include "pixel/interpolation.h"
 
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
                              const dt_dev_pixelpipe_iop_t *previous_piece,
@@ -66,7 +69,7 @@ int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
 
     dt_dev_pixelpipe_cache_rdlock_entry(TRUE, input_entry);
     input_locked = TRUE;
-    dt_colorspaces_apply_profile(module->op, module->multi_name, input, process_input_temp, piece->roi_in.width,
+    _apply_profile_counted(module->op, module->multi_name, input, process_input_temp, piece->roi_in.width,
                                         piece->roi_in.height, process_input_dsc.cst, piece->dsc_in.cst,
                                         &process_input_dsc.cst, work_profile);
     dt_dev_pixelpipe_cache_rdlock_entry(FALSE, input_entry);
@@ -163,7 +166,7 @@ int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           return 1;
         }
 
-        dt_colorspaces_apply_profile(module->op, module->multi_name, process_input, blend_input_temp, piece->roi_in.width,
+        _apply_profile_counted(module->op, module->multi_name, process_input, blend_input_temp, piece->roi_in.width,
                                             piece->roi_in.height, blend_input_dsc.cst, blend_cst,
                                             &blend_input_dsc.cst, work_profile);
         blend_input = blend_input_temp;
@@ -194,7 +197,7 @@ int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           return 1;
         }
 
-        dt_colorspaces_apply_profile(module->op, module->multi_name, output, blend_output_temp, piece->roi_out.width,
+        _apply_profile_counted(module->op, module->multi_name, output, blend_output_temp, piece->roi_out.width,
                                             piece->roi_out.height, blend_output_dsc.cst, blend_cst,
                                             &blend_output_dsc.cst, work_profile);
         blend_output = blend_output_temp;
@@ -220,7 +223,7 @@ int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
       }
       else
       {
-        dt_colorspaces_apply_profile(module->op, module->multi_name, blend_output, output, piece->roi_out.width,
+        _apply_profile_counted(module->op, module->multi_name, blend_output, output, piece->roi_out.width,
                                             piece->roi_out.height, blend_output_dsc.cst, piece->dsc_out.cst,
                                             &blend_output_dsc.cst, work_profile);
       }
@@ -235,3 +238,92 @@ int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
 
   return err;
 }
+
+int pixelpipe_process_raw_stage_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                                       const dt_raw_stage_t *stage, dt_pixelpipe_flow_t *pixelpipe_flow,
+                                       dt_pixel_cache_entry_t *input_entry, dt_pixel_cache_entry_t *output_entry)
+{
+  const void *const input = input_entry ? dt_pixel_cache_entry_get_data(input_entry) : NULL;
+  void *output = dt_pixel_cache_entry_get_data(output_entry);
+  if(IS_NULL_PTR(output))
+    output = dt_pixel_cache_alloc(output_entry);
+
+  if(IS_NULL_PTR(input) || IS_NULL_PTR(output))
+  {
+    fprintf(stdout, "[dev_pixelpipe] raw stage ending with %s got a NULL buffer, report that to developers\n",
+            piece->module->name());
+    return 1;
+  }
+
+  dt_dev_pixelpipe_cache_rdlock_entry(TRUE, input_entry);
+  const int err = dt_raw_stage_process(stage, input, (float *)output, piece->roi_out.width, piece->roi_out.height);
+  dt_dev_pixelpipe_cache_rdlock_entry(FALSE, input_entry);
+
+  *pixelpipe_flow |= PIXELPIPE_FLOW_PROCESSED_ON_CPU;
+  *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
+
+  if(err)
+    fprintf(stdout, "[pixelpipe] raw stage ending with %s returned with an error\n", piece->module->name());
+  return err;
+}
+
+int pixelpipe_process_geometry_stage_on_CPU(dt_dev_pixelpipe_t *pipe, GList *head, GList *tail,
+                                            const gboolean resample, dt_pixelpipe_flow_t *pixelpipe_flow,
+                                            dt_pixel_cache_entry_t *input_entry, dt_pixel_cache_entry_t *output_entry)
+{
+  const dt_dev_pixelpipe_iop_t *const first = (const dt_dev_pixelpipe_iop_t *)head->data;
+  const dt_dev_pixelpipe_iop_t *const piece = (const dt_dev_pixelpipe_iop_t *)tail->data;
+  const void *const input = input_entry ? dt_pixel_cache_entry_get_data(input_entry) : NULL;
+  void *output = dt_pixel_cache_entry_get_data(output_entry);
+  if(IS_NULL_PTR(output))
+    output = dt_pixel_cache_alloc(output_entry);
+
+  if(IS_NULL_PTR(input) || IS_NULL_PTR(output))
+  {
+    fprintf(stdout, "[dev_pixelpipe] geometry stage ending with %s got a NULL buffer, report that to developers\n",
+            piece->module->name());
+    return 1;
+  }
+
+  const int width = piece->roi_out.width;
+  const int height = piece->roi_out.height;
+  const size_t npoints = (size_t)width * height;
+  float *points = dt_pixelpipe_cache_alloc_align_float(2 * npoints, pipe);
+  uint8_t *outside = dt_pixelpipe_cache_alloc_align(npoints, pipe);
+  if(IS_NULL_PTR(points) || IS_NULL_PTR(outside))
+  {
+    dt_pixelpipe_cache_free_align(points);
+    dt_pixelpipe_cache_free_align(outside);
+    return 1;
+  }
+
+  // From the last module to the first, each one moves the points to where it samples its input.
+  // A point it samples outside of its input is black for good, as it would be chained: the
+  // modules upstream must not map it back onto real pixels.
+  dt_geometry_stage_grid(points, width, height);
+  memset(outside, 0, npoints);
+  for(GList *node = tail; node; node = g_list_previous(node))
+  {
+    const dt_dev_pixelpipe_iop_t *const stage_piece = (const dt_dev_pixelpipe_iop_t *)node->data;
+    if(stage_piece->enabled)
+    {
+      stage_piece->module->resample_points(stage_piece->module, pipe, stage_piece, points, npoints);
+      dt_geometry_stage_clip(points, outside, npoints, stage_piece->roi_in.width, stage_piece->roi_in.height);
+    }
+    if(node == head) break;
+  }
+  dt_pixelpipe_cache_free_align(outside);
+
+  // One interpolator for the whole stage: the warping one, as lens, ashift and clipping use.
+  // rotatepixels and scalepixels use the general one when they run on their own.
+  const struct dt_interpolation *const itor = resample ? dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP) : NULL;
+  dt_dev_pixelpipe_cache_rdlock_entry(TRUE, input_entry);
+  dt_geometry_stage_sample(itor, (const float *)input, first->roi_in.width, first->roi_in.height, points,
+                           (float *)output, width, height);
+  dt_dev_pixelpipe_cache_rdlock_entry(FALSE, input_entry);
+  dt_pixelpipe_cache_free_align(points);
+
+  *pixelpipe_flow |= PIXELPIPE_FLOW_PROCESSED_ON_CPU;
+  *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
+  return 0;
+}
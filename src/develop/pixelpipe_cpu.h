@@ -2,10 +2,22 @@
 #define DT_DEVELOP_PIXELPIPE_CPU_H
 
 #include "develop/pixelpipe_process.h"
+#include "pixel/raw_stage.h"
 
 int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
                              const dt_dev_pixelpipe_iop_t *previous_piece,
                              dt_develop_tiling_t *tiling, dt_pixelpipe_flow_t *pixelpipe_flow,
                              gboolean *cache_output,
                              dt_pixel_cache_entry_t *input_entry, dt_pixel_cache_entry_t *output_entry);
+
+/** Run the raw stage ending with @p piece, from the input of its first module to the output of @p piece. */
+int pixelpipe_process_raw_stage_on_CPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                                       const dt_raw_stage_t *stage, dt_pixelpipe_flow_t *pixelpipe_flow,
+                                       dt_pixel_cache_entry_t *input_entry, dt_pixel_cache_entry_t *output_entry);
+
+/** Run the geometry stage from the input of the piece at @p head to the output of the piece at
+ * @p tail, resampling once, or copying the nearest pixels when no module of the stage resamples. */
+int pixelpipe_process_geometry_stage_on_CPU(dt_dev_pixelpipe_t *pipe, GList *head, GList *tail,
+                                            const gboolean resample, dt_pixelpipe_flow_t *pixelpipe_flow,
+                                            dt_pixel_cache_entry_t *input_entry, dt_pixel_cache_entry_t *output_entry);
 #endif // DT_DEVELOP_PIXELPIPE_CPU_H
@@ -0,0 +1,89 @@
+/**
+ * @file pixelpipe_geometry_stage.c
+ * @brief Resamples consecutive geometric modules once, on the CPU.
+ *
+ * @details
+ * lens, ashift, rotatepixels, scalepixels, flip, clipping and crop each interpolate the output of
+ * the previous one. When they follow each other and nothing outside the pipe reads the outputs in
+ * between, the recursion asks each of them where it samples its input instead, and reads the
+ * input of the first one once, at the positions composed through all of them (see
+ * pixel/geometry_stage.h). As for the raw stage, the last module publishes under its own hash and
+ * the outputs in between are just never written.
+ *
+ * These helpers are private to the recursion and included from `pixelpipe_hb.c`.
+ */
+
+#include "pixel/geometry_stage.h"
+
+// The output of @p prev is read as is as the input of @p next, by the stage.
+static gboolean _geometry_stage_links(const dt_dev_pixelpipe_iop_t *prev, const dt_dev_pixelpipe_iop_t *next)
+{
+  return prev->dsc_out.channels == 4 && prev->dsc_out.datatype == TYPE_FLOAT
+         && (prev->dsc_out.cst == next->dsc_in.cst
+             || (dt_iop_colorspace_is_rgb(prev->dsc_out.cst) && dt_iop_colorspace_is_rgb(next->dsc_in.cst)))
+         && !memcmp(&prev->roi_out, &next->roi_in, sizeof(dt_iop_roi_t));
+}
+
+static gboolean _geometry_stage_piece_fusable(const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_develop_blend_params_t *const blend = (const dt_develop_blend_params_t *)piece->blendop_data;
+  return piece->dsc_in.channels == 4 && piece->dsc_in.datatype == TYPE_FLOAT && piece->dsc_in.cst == piece->dsc_out.cst
+         && (IS_NULL_PTR(blend) || blend->mask_mode == DEVELOP_MASK_DISABLED);
+}
+
+/**
+ * @brief Find the geometry stage ending with the module at @p pieces.
+ *
+ * @return The node of its first module, with its position in @p head_pos. @p resample tells
+ * whether one of them interpolates, else they all copy. NULL when the module at @p pieces has
+ * to run on its own.
+ */
+static GList *_geometry_stage_find(dt_dev_pixelpipe_t *pipe, GList *pieces, int pos, gboolean *resample,
+                                   int *head_pos)
+{
+#ifdef HAVE_OPENCL
+  if(pipe->opencl_enabled && pipe->devid >= 0) return NULL;
+#endif
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return NULL;
+
+  GList *head = NULL;
+  const dt_dev_pixelpipe_iop_t *next = NULL;
+  int length = 0;
+  *resample = FALSE;
+
+  for(GList *node = pieces; node; node = g_list_previous(node), pos--)
+  {
+    const dt_dev_pixelpipe_iop_t *const piece = (const dt_dev_pixelpipe_iop_t *)node->data;
+    if(!piece->enabled) continue;
+
+    dt_iop_module_t *const module = piece->module;
+
+    // Outputs before the last one are not written. Nobody may need them, and when one is
+    // already cached the stage starts from it for less.
+    const gboolean skippable
+        = IS_NULL_PTR(next)
+          || (!piece->output_observed
+              && IS_NULL_PTR(dt_dev_pixelpipe_cache_get_entry(dt_dev_pixelpipe_node_hash(pipe, piece, piece->roi_out, pos))));
+
+    int sampling = DT_GEOMETRY_STAGE_NONE;
+    if(skippable && !IS_NULL_PTR(module->resample_points) && _geometry_stage_piece_fusable(piece)
+       && (IS_NULL_PTR(next) || _geometry_stage_links(piece, next)))
+      sampling = module->resample_points(module, pipe, piece, NULL, 0);
+
+    if(sampling == DT_GEOMETRY_STAGE_NONE)
+    {
+      // This module runs on its own and its output is the input of the stage.
+      if(length < 2 || !_geometry_stage_links(piece, next)) return NULL;
+      return head;
+    }
+
+    *resample |= (sampling == DT_GEOMETRY_STAGE_RESAMPLE);
+    head = node;
+    *head_pos = pos;
+    next = piece;
+    length++;
+  }
+
+  // Geometric modules never start the pipe, but a stage reading the image itself is not handled.
+  return NULL;
+}
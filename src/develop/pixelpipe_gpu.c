@@ -337,7 +337,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
       if(IS_NULL_PTR(cl_mem_process_input_temp))
         goto error;
 
-      if(!dt_colorspaces_apply_profile_cl(module->op, module->multi_name, pipe->devid, cl_mem_input, cl_mem_process_input_temp,
+      if(!_apply_profile_cl_counted(module->op, module->multi_name, pipe->devid, cl_mem_input, cl_mem_process_input_temp,
                                                  piece->roi_in.width, piece->roi_in.height,
                                                  process_input_dsc.cst, piece->dsc_in.cst,
                                                  &process_input_dsc.cst, work_profile))
@@ -386,7 +386,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           if(IS_NULL_PTR(cl_mem_blend_input_temp))
             goto error;
 
-          success &= dt_colorspaces_apply_profile_cl(module->op, module->multi_name, pipe->devid,
+          success &= _apply_profile_cl_counted(module->op, module->multi_name, pipe->devid,
                                                             cl_mem_process_input, cl_mem_blend_input_temp,
                                                             piece->roi_in.width, piece->roi_in.height,
                                                             blend_input_dsc.cst, blend_cst,
@@ -408,7 +408,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           if(IS_NULL_PTR(cl_mem_blend_output_temp))
             goto error;
 
-          success &= dt_colorspaces_apply_profile_cl(module->op, module->multi_name, pipe->devid, cl_mem_output,
+          success &= _apply_profile_cl_counted(module->op, module->multi_name, pipe->devid, cl_mem_output,
                                                             cl_mem_blend_output_temp, piece->roi_out.width,
                                                             piece->roi_out.height, blend_output_dsc.cst, blend_cst,
                                                             &blend_output_dsc.cst, work_profile);
@@ -442,7 +442,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           goto error;
       }
       else if((blend_transforms & DT_DEV_PIXELPIPE_BLEND_TRANSFORM_OUTPUT)
-              && !dt_colorspaces_apply_profile_cl(module->op, module->multi_name, pipe->devid, cl_mem_blend_output,
+              && !_apply_profile_cl_counted(module->op, module->multi_name, pipe->devid, cl_mem_blend_output,
                                                          cl_mem_output, piece->roi_out.width,
                                                          piece->roi_out.height, blend_output_dsc.cst,
                                                          piece->dsc_out.cst, &blend_output_dsc.cst,
@@ -492,7 +492,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
 
       dt_dev_pixelpipe_cache_rdlock_entry(TRUE, input_entry);
       input_locked = TRUE;
-      dt_colorspaces_apply_profile(module->op, module->multi_name, input, module_input_temp, piece->roi_in.width,
+      _apply_profile_counted(module->op, module->multi_name, input, module_input_temp, piece->roi_in.width,
                                           piece->roi_in.height, process_input_dsc.cst, piece->dsc_in.cst,
                                           &process_input_dsc.cst, work_profile);
       dt_dev_pixelpipe_cache_rdlock_entry(FALSE, input_entry);
@@ -552,7 +552,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           goto error;
         }
 
-        dt_colorspaces_apply_profile(module->op, module->multi_name, module_input, blend_input_temp, piece->roi_in.width,
+        _apply_profile_counted(module->op, module->multi_name, module_input, blend_input_temp, piece->roi_in.width,
                                             piece->roi_in.height, blend_input_dsc.cst, blend_cst,
                                             &blend_input_dsc.cst, work_profile);
         blend_input = blend_input_temp;
@@ -576,7 +576,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
           goto error;
         }
 
-        dt_colorspaces_apply_profile(module->op, module->multi_name, output, blend_output_temp, piece->roi_out.width,
+        _apply_profile_counted(module->op, module->multi_name, output, blend_output_temp, piece->roi_out.width,
                                             piece->roi_out.height, blend_output_dsc.cst, blend_cst,
                                             &blend_output_dsc.cst, work_profile);
         blend_output = blend_output_temp;
@@ -596,7 +596,7 @@ int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_io
       }
       else
       {
-        dt_colorspaces_apply_profile(module->op, module->multi_name, blend_output, output, piece->roi_out.width,
+        _apply_profile_counted(module->op, module->multi_name, blend_output, output, piece->roi_out.width,
                                             piece->roi_out.height, blend_output_dsc.cst, piece->dsc_out.cst,
                                             &blend_output_dsc.cst, work_profile);
       }
@@ -72,6 +72,7 @@
 #include "develop/pixelpipe.h"
 #include "caches/pixelpipe_cache.h"
 #include "develop/supervisor.h"
+#include "develop/pipe_counters.h"
 #include "develop/pixelpipe_cpu.h"
 #include "develop/pixelpipe_gpu.h"
 #include "develop/pixelpipe_process.h"
@@ -89,6 +90,8 @@
 
 #include "develop/pixelpipe_raster_masks.c"
 #include "develop/pixelpipe_rawdetail.c"
+#include "develop/pixelpipe_raw_stage.c"
+#include "develop/pixelpipe_geometry_stage.c"
 
 static void _trace_cache_owner(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
                                const char *phase, const char *slot, const uint64_t requested_hash,
@@ -695,6 +698,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe)
     piece->enabled = module->enabled;
     piece->request_histogram = DT_REQUEST_ONLY_IN_GUI;
     piece->histogram_params.bins_count = 256;
+    piece->histogram_params.max_samples = DT_HISTOGRAM_DISPLAY_SAMPLES;
     piece->iwidth = pipe->iwidth;
     piece->iheight = pipe->iheight;
     piece->module = module;
@@ -704,6 +708,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe)
     piece->global_mask_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
     _reset_piece_cache_entry(piece);
     piece->cache_output_on_ram = TRUE;
+    piece->output_observed = FALSE;
 
     // dsc_mask is static, single channel float image
     piece->dsc_mask.channels = 1;
@@ -922,6 +927,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
   // needs the upstream cache entry.
   dt_pixel_cache_entry_t *existing_cache = NULL;
   void *existing_output = NULL;
+  const gboolean counters = dt_pipe_counters_active();
+  dt_pipe_counters_sample_t counters_start = { 0 };
+  if(counters) dt_pipe_counters_begin(&counters_start);
   /* Atomically look up the entry and increment its refcount so the caller receives a
    * fully-owned reference.  peek() + separate ref_count_entry() has a TOCTOU window:
    * peek releases its tryrdlock immediately, so the entry can reach refcount 0 and be
@@ -935,6 +943,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
   if(exact_output_cache_hit)
   {
     _trace_cache_owner(pipe, module, "exact-hit-direct", "output", hash, NULL, existing_cache, FALSE);
+    if(counters) dt_pipe_counters_node(pipe, piece, &counters_start, TRUE, FALSE, 0, 0);
     *out_hash = hash;
     *out_piece = piece;
     return 0;
@@ -945,10 +954,22 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
     dt_dev_pixelpipe_cache_ref_count_entry(FALSE, existing_cache);
   }
 
+  // 2) The end of a raw or geometry stage runs it whole, from the input of its first module.
+  dt_raw_stage_t raw_stage;
+  gboolean geometry_resample = FALSE;
+  int stage_pos = pos;
+  GList *const raw_stage_head = _raw_stage_find(pipe, pieces, pos, &raw_stage, &stage_pos);
+  GList *const geometry_stage_head
+      = IS_NULL_PTR(raw_stage_head) ? _geometry_stage_find(pipe, pieces, pos, &geometry_resample, &stage_pos) : NULL;
+  GList *const input_node = !IS_NULL_PTR(raw_stage_head)        ? raw_stage_head
+                            : !IS_NULL_PTR(geometry_stage_head) ? geometry_stage_head
+                                                                : pieces;
+
   // 3) now recurse through the pipeline.
   uint64_t input_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
   const dt_dev_pixelpipe_iop_t *previous_piece = NULL;
-  if(dt_dev_pixelpipe_process_rec(pipe, &input_hash, &previous_piece, g_list_previous(pieces), pos - 1))
+  if(dt_dev_pixelpipe_process_rec(pipe, &input_hash, &previous_piece, g_list_previous(input_node),
+                                  stage_pos - 1))
   {
     /* Child recursion failed before this module acquired any output cache entry.
      * Dropping `hash` here underflows cached exact-hit outputs during shutdown. */
@@ -960,6 +981,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   KILL_SWITCH_ABORT;
 
+  // The node's own counters start here: the time spent upstream belongs to upstream nodes.
+  if(counters) dt_pipe_counters_begin(&counters_start);
+
   // Child recursion just published or exact-hit returned this hash with one ref already reserved for
   // this immediate consumer. Reopen the live cache entry directly instead of going through exact-hit
   // lookup, because exact-hit intentionally rejects auto-destroy entries while the parent recursion
@@ -1096,6 +1120,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
     _trace_cache_owner(pipe, module, "exact-hit-wait", "output", hash,
                        dt_pixel_cache_entry_get_data(exact_entry), exact_entry, FALSE);
+    if(counters) dt_pipe_counters_node(pipe, piece, &counters_start, TRUE, FALSE, 0, 0);
 
     if(input_entry)
       dt_dev_pixelpipe_cache_ref_count_entry(FALSE, input_entry);
@@ -1118,6 +1143,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
                                                          : (new_entry ? "acquire-new" : "acquire-existing"),
                      "output", hash, output, output_entry, FALSE);
 
+  // Intermediate float outputs may be kept at half precision when the cache runs short.
+  // The pipe output is what gets displayed or exported: it keeps full precision.
+  dt_dev_pixelpipe_cache_set_compactable(output_entry, (piece->dsc_out.datatype == TYPE_FLOAT && !keep_final_output)
+                                                           ? bufsize : 0);
+
   /* get tiling requirement of module */
   dt_develop_tiling_t tiling = { 0 };
   tiling.factor_cl = tiling.maxbuf_cl = -1;	// set sentinel value to detect whether callback set sizes
@@ -1155,14 +1185,20 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   const char *prev_module = dt_pixelpipe_cache_set_current_module(module ? module->op : NULL);
 
+  if(!IS_NULL_PTR(raw_stage_head))
+    error = pixelpipe_process_raw_stage_on_CPU(pipe, piece, &raw_stage, &pixelpipe_flow, input_entry, output_entry);
+  else if(!IS_NULL_PTR(geometry_stage_head))
+    error = pixelpipe_process_geometry_stage_on_CPU(pipe, geometry_stage_head, pieces, geometry_resample,
+                                                    &pixelpipe_flow, input_entry, output_entry);
+  else
 #ifdef HAVE_OPENCL
-  error = pixelpipe_process_on_GPU(pipe, piece, previous_piece, &tiling, &pixelpipe_flow,
-                                   &cache_ram_output,
-                                   input_entry, output_entry);
+    error = pixelpipe_process_on_GPU(pipe, piece, previous_piece, &tiling, &pixelpipe_flow,
+                                     &cache_ram_output,
+                                     input_entry, output_entry);
 #else
-  error = pixelpipe_process_on_CPU(pipe, piece, previous_piece, &tiling, &pixelpipe_flow,
-                                   &cache_ram_output,
-                                   input_entry, output_entry);
+    error = pixelpipe_process_on_CPU(pipe, piece, previous_piece, &tiling, &pixelpipe_flow,
+                                     &cache_ram_output,
+                                     input_entry, output_entry);
 #endif
 
   dt_pixelpipe_cache_set_current_module(prev_module);
@@ -1171,6 +1207,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
   _print_perf_debug(pipe, pixelpipe_flow, piece, module,
                     (acquire_status != DT_DEV_PIXELPIPE_CACHE_WRITABLE_CREATED), &start);
 
+  if(counters && !error)
+    dt_pipe_counters_node(pipe, piece, &counters_start, FALSE,
+                          (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) != 0,
+                          input_entry ? (size_t)piece->dsc_in.bpp * piece->roi_in.width * piece->roi_in.height : 0,
+                          bufsize);
+
   if(pipe->dev->gui_attached) pipe->dev->progress.completed++;
 
   if(error)
@@ -1707,12 +1749,15 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_iop_roi_t roi)
 
     dt_times_t start;
     dt_get_times(&start);
+    dt_pipe_counters_sample_t counters_start = { 0 };
+    if(dt_pipe_counters_active()) dt_pipe_counters_run_begin(&counters_start);
     uint64_t final_hash = -1;
     const dt_dev_pixelpipe_iop_t *final_piece = NULL;
     err = dt_dev_pixelpipe_process_rec(pipe, &final_hash, &final_piece,
                                        requested_backbuf ? pieces : requested_pieces,
                                        requested_backbuf ? pos : requested_pos);
     (void)final_piece;
+    if(dt_pipe_counters_active()) dt_pipe_counters_run_end(pipe, &counters_start, err);
     gchar *msg = g_strdup_printf("[pixelpipe] %s internal pixel pipeline processing", dt_pixelpipe_get_pipe_name(pipe->type));
     dt_show_times(&start, msg);
     dt_free(msg);
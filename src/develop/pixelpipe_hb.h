@@ -163,6 +163,11 @@ typedef struct dt_dev_pixelpipe_iop_t
   // during synchronization and then consumed by one recursion step; it does not
   // change the descriptor contract.
   gboolean cache_output_on_ram;
+
+  // Something outside the pipe reads the output of this piece: picker, histograms, autoset,
+  // or the focused module reading its input. Authored with cache_output_on_ram, and
+  // independent of the backend, so a fused raw or geometry stage does not skip it.
+  gboolean output_observed;
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -8,6 +8,8 @@
 #include "system/macros.h"
 #include "develop/pixelpipe_hb.h"
 #include "develop/tiling.h"
+#include "develop/pipe_counters.h"
+#include "colorprofiles/iop_profile.h"
 
 #include <glib.h>
 #include <string.h>
@@ -72,6 +74,41 @@ static inline void _reset_piece_cache_entry(dt_dev_pixelpipe_iop_t *piece)
   piece->cache_entry.hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
 }
 
+/**
+ * @brief dt_colorspaces_apply_profile() accounted in the per-node `colorspace` counter.
+ *
+ * @details Every colour conversion the backends run around a module (input leg, blending legs)
+ * goes through here, so develop/pipe_counters.h can tell conversion time from module time.
+ */
+static inline void _apply_profile_counted(const char *const op_name, const char *const instance_name,
+                                          const float *const image_in, float *const image_out,
+                                          const int width, const int height, const int cst_from,
+                                          const int cst_to, int *converted_cst,
+                                          const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  const double start = dt_pipe_counters_colorspace_begin();
+  dt_colorspaces_apply_profile(op_name, instance_name, image_in, image_out, width, height, cst_from, cst_to,
+                               converted_cst, profile_info);
+  dt_pipe_counters_colorspace_end(start);
+}
+
+#ifdef HAVE_OPENCL
+/** @brief OpenCL counterpart of _apply_profile_counted(). */
+static inline int _apply_profile_cl_counted(const char *const op_name, const char *const instance_name,
+                                            const int devid, cl_mem dev_img_in, cl_mem dev_img_out,
+                                            const int width, const int height, const int cst_from,
+                                            const int cst_to, int *converted_cst,
+                                            const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  const double start = dt_pipe_counters_colorspace_begin();
+  const int success = dt_colorspaces_apply_profile_cl(op_name, instance_name, devid, dev_img_in, dev_img_out,
+                                                      width, height, cst_from, cst_to, converted_cst,
+                                                      profile_info);
+  dt_pipe_counters_colorspace_end(start);
+  return success;
+}
+#endif
+
 void dt_dev_pixelpipe_debug_dump_module_io(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module, const char *stage,
                                            gboolean is_cl, const dt_iop_buffer_dsc_t *in_dsc,
                                            const dt_iop_buffer_dsc_t *out_dsc, const dt_iop_roi_t *roi_in,
@@ -0,0 +1,77 @@
+/**
+ * @file pixelpipe_raw_stage.c
+ * @brief Runs the pointwise raw modules as one pass on the CPU.
+ *
+ * @details
+ * rawprepare, temperature and highlights in clip mode each read and write the whole mosaic. When
+ * they follow each other and nothing outside the pipe reads the outputs in between, the recursion
+ * runs them as one pixel/raw_stage.h pass from the input of the first to the output of the last.
+ * The last module publishes under its own hash, so the cache and everything downstream see the
+ * same pipeline: the outputs in between are just never written. They are back as soon as someone
+ * needs one, since the recursion then stops fusing and computes them again.
+ *
+ * These helpers are private to the recursion and included from `pixelpipe_hb.c`.
+ */
+
+#include "pixel/raw_stage.h"
+
+static gboolean _raw_stage_piece_fusable(const dt_dev_pixelpipe_iop_t *piece, const dt_dev_pixelpipe_iop_t *tail)
+{
+  const dt_develop_blend_params_t *const blend = (const dt_develop_blend_params_t *)piece->blendop_data;
+  return piece->dsc_in.cst == IOP_CS_RAW
+         && (IS_NULL_PTR(blend) || blend->mask_mode == DEVELOP_MASK_DISABLED)
+         && piece->roi_out.width == tail->roi_out.width && piece->roi_out.height == tail->roi_out.height;
+}
+
+/**
+ * @brief Find the raw stage ending with the module at @p pieces.
+ *
+ * @return The node of its first module, rawprepare, with its position in @p head_pos and the
+ * steps in @p stage. NULL when the module at @p pieces has to run on its own.
+ */
+static GList *_raw_stage_find(dt_dev_pixelpipe_t *pipe, GList *pieces, int pos, dt_raw_stage_t *stage,
+                              int *head_pos)
+{
+#ifdef HAVE_OPENCL
+  if(pipe->opencl_enabled && pipe->devid >= 0) return NULL;
+#endif
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return NULL;
+
+  const dt_dev_pixelpipe_iop_t *const tail = (const dt_dev_pixelpipe_iop_t *)pieces->data;
+  memset(stage, 0, sizeof(*stage));
+  int last_step = DT_RAW_STAGE_NONE;
+
+  for(GList *node = pieces; node; node = g_list_previous(node), pos--)
+  {
+    const dt_dev_pixelpipe_iop_t *const piece = (const dt_dev_pixelpipe_iop_t *)node->data;
+    if(!piece->enabled) continue;
+
+    dt_iop_module_t *const module = piece->module;
+    if(IS_NULL_PTR(module->raw_stage) || !_raw_stage_piece_fusable(piece, tail)) return NULL;
+
+    // Outputs before the last one are not written. Nobody may need them, and when one is
+    // already cached the usual recursion starts from it for less.
+    if(piece != tail
+       && (piece->output_observed
+           || !IS_NULL_PTR(dt_dev_pixelpipe_cache_get_entry(dt_dev_pixelpipe_node_hash(pipe, piece, piece->roi_out, pos)))))
+      return NULL;
+
+    const int step = module->raw_stage(module, pipe, piece, stage);
+    if(step == DT_RAW_STAGE_NONE || (last_step != DT_RAW_STAGE_NONE && step >= last_step)) return NULL;
+
+    // Only rawprepare crops. The others read their input where they write their output.
+    if(step != DT_RAW_STAGE_PREPARE && memcmp(&piece->roi_in, &piece->roi_out, sizeof(dt_iop_roi_t)))
+      return NULL;
+
+    stage->steps |= step;
+    if(step == DT_RAW_STAGE_PREPARE)
+    {
+      if(piece == tail) return NULL;
+      *head_pos = pos;
+      return node;
+    }
+    last_step = step;
+  }
+
+  return NULL;
+}
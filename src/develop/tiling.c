@@ -38,6 +38,7 @@
 #include "develop/tiling.h"
 #include "common/opencl.h"
 #include "develop/pixelpipe.h"
+#include "develop/pipe_counters.h"
 #include "math/nelder_mead_simplex.h"
 
 #include <assert.h>
@@ -371,6 +372,8 @@ static int _default_process_tiling_ptp(struct dt_iop_module_t *self, const struc
     goto error;
   }
 
+  dt_pipe_counters_add_tiles(tiles_x * tiles_y);
+
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_ptp] (%dx%d) tiles with max dimensions %dx%d and overlap %d\n",
            tiles_x, tiles_y, width, height, overlap);
 
@@ -640,6 +643,8 @@ static int _default_process_tiling_roi(struct dt_iop_module_t *self, const struc
     goto error;
   }
 
+  dt_pipe_counters_add_tiles(tiles_x * tiles_y);
+
 
   /* calculate tile width and height excl. overlap (i.e. the good part) for output.
      values are important for all following processing steps. */
@@ -976,6 +981,8 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, const st
     return FALSE;
   }
 
+  dt_pipe_counters_add_tiles(tiles_x * tiles_y);
+
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] (%dx%d) tiles with max dimensions %dx%d, good %dx%d and overlap %d\n",
            tiles_x, tiles_y, width, height, tile_wd, tile_ht, overlap);
 
@@ -1219,6 +1226,8 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, const st
     return FALSE;
   }
 
+  dt_pipe_counters_add_tiles(tiles_x * tiles_y);
+
   /* calculate tile width and height excl. overlap (i.e. the good part) for output.
      important for all following processing steps. */
   const int tile_wd = _align_up(
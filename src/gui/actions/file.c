@@ -116,7 +116,7 @@ static gboolean update_collection_callback(GtkAccelGroup *group, GObject *accele
 void init_collection_line(gpointer instance,
                           dt_collection_change_t query_change,
                           dt_collection_properties_t changed_property, gpointer imgs, int next,
-                          gpointer user_data)
+                          gpointer diff, gpointer user_data)
 {
   GtkWidget *widget = GTK_WIDGET(user_data);
 
@@ -413,7 +413,7 @@ void append_file(GtkWidget **menus, GList **lists, const dt_menus_t index)
 
     // Call init directly just this once
     GtkWidget *this = get_last_widget(lists);
-    init_collection_line(NULL, DT_COLLECTION_CHANGE_NONE, DT_COLLECTION_PROP_UNDEF, NULL, 0, this);
+    init_collection_line(NULL, DT_COLLECTION_CHANGE_NONE, DT_COLLECTION_PROP_UNDEF, NULL, 0, NULL, this);
 
     // Connect init to collection_changed signal for future updates
     DT_DEBUG_CONTROL_SIGNAL_CONNECT(dt_control_signal_get_global(), DT_SIGNAL_COLLECTION_CHANGED,
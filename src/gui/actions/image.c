@@ -209,6 +209,7 @@ gboolean _can_be_rotated()
 }
 
 MAKE_ACCEL_WRAPPER(dt_control_refresh_exif)
+MAKE_ACCEL_WRAPPER(dt_control_autoset_perspective)
 
 void append_image(GtkWidget **menus, GList **lists, const dt_menus_t index)
 {
@@ -280,6 +281,12 @@ void append_image(GtkWidget **menus, GList **lists, const dt_menus_t index)
 
   add_menu_separator(menus[index]);
 
+  /* Perspective: the darkroom image is fitted from the module */
+  add_sub_menu_entry(menus, lists, _("Auto-fit perspective"), index, NULL,
+                     GET_ACCEL_WRAPPER(dt_control_autoset_perspective), NULL, NULL, _can_be_rotated, 0, 0);
+
+  add_menu_separator(menus[index]);
+
   /* Reload EXIF */
   add_sub_menu_entry(menus, lists, _("Reload EXIF from file"), index, NULL, GET_ACCEL_WRAPPER(dt_control_refresh_exif)
   , NULL, NULL,
@@ -490,6 +490,7 @@ int32_t _get_image_buffer(dt_job_t *job)
   const gboolean show_focus_clusters = (thumb->table && thumb->table->focus_regions);
   const gboolean zoom_in = (thumb->table && thumb->table->zoom > DT_THUMBTABLE_ZOOM_FIT);
   const int32_t imgid = thumb->info.id;
+  const uint64_t history_hash = thumb->info.history_hash;
 
   dt_pthread_mutex_unlock(&thumb->lock);
 
@@ -535,7 +536,8 @@ int32_t _get_image_buffer(dt_job_t *job)
     unsigned char *rgbbuf = cairo_image_surface_get_data(surface);
     if(rgbbuf)
     {
-      if(dt_focuspeaking(cri, rgbbuf, img_width, img_height, show_focus_peaking, &x_center, &y_center) != 0)
+      if(dt_focuspeaking_cached(cri, rgbbuf, img_width, img_height, show_focus_peaking, imgid,
+                                history_hash, &x_center, &y_center) != 0)
       {
         cairo_destroy(cri);
         cairo_surface_destroy(surface);
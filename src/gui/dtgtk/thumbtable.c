@@ -80,6 +80,9 @@
 #include "widgets/widget_style.h"
 #include "common/glib_utils.h"
 
+// Most images a collection diff may bring in before patching the LUT loses to rebuilding it:
+// they are read one by one, the rebuild reads everything in one statement.
+#define DT_THUMBTABLE_PATCH_MAX_READS 2048
 
 static gboolean _thumbtable_clone_lut(dt_thumbtable_t *dst)
 {
@@ -98,6 +101,7 @@ static gboolean _thumbtable_clone_lut(dt_thumbtable_t *dst)
                               && src->collection_inited
                               && src->collection_hash == dst->collection_hash
                               && src->collapse_groups == dst->collapse_groups
+                              && src->collection_serial == dt_collection_query_get_diff_serial()
                               && src->collection_count > 0);
   if(!can_clone)
   {
@@ -106,6 +110,7 @@ static gboolean _thumbtable_clone_lut(dt_thumbtable_t *dst)
   }
 
   const uint32_t count = src->collection_count;
+  const uint64_t serial = src->collection_serial;
   dt_thumbtable_cache_t *cloned_lut = malloc(count * sizeof(dt_thumbtable_cache_t));
   if(IS_NULL_PTR(cloned_lut))
   {
@@ -124,6 +129,7 @@ static gboolean _thumbtable_clone_lut(dt_thumbtable_t *dst)
   old_lut = dst->lut;
   dst->lut = cloned_lut;
   dst->collection_count = count;
+  dst->collection_serial = serial;
   dst->collection_inited = TRUE;
   dt_pthread_mutex_unlock(&dst->lock);
 
@@ -1009,15 +1015,16 @@ typedef struct _collection_lut_ctx_t
 {
   dt_thumbtable_t *table;
   GArray *collection;
+  uint32_t position; // rows seen so far, hidden group members included
 } _collection_lut_ctx_t;
 
-static void _collection_lut_row(void *user_data, const dt_image_t *row)
+// Seed the image cache from a row read for the LUT. Returns FALSE when the image is a group member
+// hidden by collapsed groups, which gets no LUT entry.
+static gboolean _collection_lut_seed(const dt_thumbtable_t *table, const dt_image_t *row)
 {
-  _collection_lut_ctx_t *ctx = (_collection_lut_ctx_t *)user_data;
   const int32_t imgid = row->id;
-  const int32_t groupid = row->group_id;
 
-  if(ctx->table->collapse_groups && imgid != groupid)
+  if(table->collapse_groups && imgid != row->group_id)
   {
     // if user requested to collapse image groups in GUI,
     // only the group leader is shown. But we need to make sure
@@ -1026,12 +1033,9 @@ static void _collection_lut_row(void *user_data, const dt_image_t *row)
     // and selection sanitization only deals with imgids outside of current collection,
     // but group members are always within the collection.
     dt_selection_deselect(dt_selection_get_global(), imgid);
-    return;
+    return FALSE;
   }
 
-  dt_thumbtable_cache_t entry = { .thumb = NULL, .imgid = imgid, .groupid = groupid };
-  g_array_append_val(ctx->collection, entry);
-
   // Populate the image cache. We don't keep a copy here because it wouldn't
   // be memory-managed
   dt_image_t info = *row;
@@ -1043,6 +1047,17 @@ static void _collection_lut_row(void *user_data, const dt_image_t *row)
 
   // Seed the cache and be done
   dt_thumbtable_info_seed_image_cache(&info);
+  return TRUE;
+}
+
+static void _collection_lut_row(void *user_data, const dt_image_t *row)
+{
+  _collection_lut_ctx_t *ctx = (_collection_lut_ctx_t *)user_data;
+  const uint32_t position = ctx->position++;
+  if(!_collection_lut_seed(ctx->table, row)) return;
+
+  dt_thumbtable_cache_t entry = { .thumb = NULL, .imgid = row->id, .groupid = row->group_id, .collected = position };
+  g_array_append_val(ctx->collection, entry);
 }
 
 static void _dt_collection_lut(dt_thumbtable_t *table)
@@ -1055,8 +1070,9 @@ static void _dt_collection_lut(dt_thumbtable_t *table)
   // Convert SQL imgids into C objects we can work with. In-memory collected images don't store
   // group_id, so the repository reads the whole row again from the images table.
   GArray *collection = g_array_new(FALSE, FALSE, sizeof(dt_thumbtable_cache_t));
-  _collection_lut_ctx_t ctx = { .table = table, .collection = collection };
+  _collection_lut_ctx_t ctx = { .table = table, .collection = collection, .position = 0 };
   dt_image_repository_foreach_collected(_collection_lut_row, &ctx);
+  const uint64_t serial = dt_collection_query_get_diff_serial();
 
   if(IS_NULL_PTR(collection) || collection->len == 0)
   {
@@ -1065,6 +1081,7 @@ static void _dt_collection_lut(dt_thumbtable_t *table)
     old_lut = table->lut;
     table->lut = NULL;
     table->collection_count = 0;
+    table->collection_serial = 0;
     table->collection_inited = FALSE;
     dt_pthread_mutex_unlock(&table->lock);
 
@@ -1077,7 +1094,8 @@ static void _dt_collection_lut(dt_thumbtable_t *table)
   // where the position of an image in the collection is directly the index in the LUT/array.
   // This makes for very efficient position -> imgid/thumbnail accesses directly in C,
   // especially from GUI code. The downside is we need to fully clear and recreate the LUT
-  // everytime a collection changes (meaning filters OR sorting changed).
+  // everytime a collection changes (meaning filters OR sorting changed). Images entering, leaving
+  // or moving within the same collection are patched in by _dt_collection_lut_patch() instead.
   dt_thumbtable_cache_t *new_lut = malloc(collection->len * sizeof(dt_thumbtable_cache_t));
 
   if(IS_NULL_PTR(new_lut))
@@ -1093,6 +1111,7 @@ static void _dt_collection_lut(dt_thumbtable_t *table)
   old_lut = table->lut;
   table->lut = new_lut;
   table->collection_count = collection->len;
+  table->collection_serial = serial;
   table->collection_inited = TRUE;
   dt_pthread_mutex_unlock(&table->lock);
 
@@ -1100,6 +1119,114 @@ static void _dt_collection_lut(dt_thumbtable_t *table)
   g_array_free(collection, TRUE);
 }
 
+// First LUT index whose collection position is >= position. The LUT is sorted by position.
+static int _lut_lower_bound(const dt_thumbtable_cache_t *lut, const int count, const uint32_t position)
+{
+  int lo = 0, hi = count;
+  while(lo < hi)
+  {
+    const int mid = lo + (hi - lo) / 2;
+    if(lut[mid].collected < position)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Patch the LUT in place from a collection diff instead of reading the whole collection again.
+// Only the images entering the collection are read from the database and seeded in the image
+// cache; the rest is copied over from the current LUT. Returns FALSE when the diff can't be
+// applied (different query, missed diff, window too large), in which case the caller rebuilds.
+static gboolean _dt_collection_lut_patch(dt_thumbtable_t *table, const dt_collection_diff_t *diff)
+{
+  if(IS_NULL_PTR(diff) || !diff->same_query || IS_NULL_PTR(table->lut) || table->collection_serial == 0
+     || table->collection_serial + 1 != diff->serial)
+    return FALSE;
+
+  // Past that many new images, one bulk read beats loading them one by one.
+  if(diff->inserted->len > DT_THUMBTABLE_PATCH_MAX_READS) return FALSE;
+
+  // Read what entered the collection first, without the lock: seeding reaches the selection and
+  // the image cache, see dt_image_repository_foreach_collected().
+  GHashTable *entered = g_hash_table_new(NULL, NULL);
+  for(guint k = 0; k < diff->inserted->len; k++)
+  {
+    const int32_t imgid = g_array_index(diff->inserted, int32_t, k);
+    dt_image_t info;
+    dt_image_init(&info);
+    if(!dt_image_repository_load(imgid, &info) || !_collection_lut_seed(table, &info)) continue;
+    g_hash_table_insert(entered, GINT_TO_POINTER(imgid), GINT_TO_POINTER(info.group_id));
+  }
+
+  dt_pthread_mutex_lock(&table->lock);
+  const dt_thumbtable_cache_t *old_lut = table->lut;
+  const int old_len = table->collection_count;
+  const int head = _lut_lower_bound(old_lut, old_len, diff->head);
+  const int tail_start = _lut_lower_bound(old_lut, old_len, diff->old_count - diff->tail);
+  const int tail = old_len - tail_start;
+
+  // Entries of the old window, to carry over the images that only moved
+  GHashTable *kept = g_hash_table_new(NULL, NULL);
+  for(int i = head; i < tail_start; i++)
+    g_hash_table_insert(kept, GINT_TO_POINTER(old_lut[i].imgid), (gpointer)&old_lut[i]);
+
+  const size_t max_len = (size_t)head + diff->window->len + tail;
+  dt_thumbtable_cache_t *new_lut = malloc(MAX(max_len, 1) * sizeof(dt_thumbtable_cache_t));
+  if(IS_NULL_PTR(new_lut))
+  {
+    dt_pthread_mutex_unlock(&table->lock);
+    g_hash_table_destroy(kept);
+    g_hash_table_destroy(entered);
+    return FALSE;
+  }
+
+  memcpy(new_lut, old_lut, head * sizeof(dt_thumbtable_cache_t));
+  int len = head;
+  for(guint k = 0; k < diff->window->len; k++)
+  {
+    const int32_t imgid = g_array_index(diff->window, int32_t, k);
+    const uint32_t position = diff->head + k;
+    const dt_thumbtable_cache_t *was = g_hash_table_lookup(kept, GINT_TO_POINTER(imgid));
+    gpointer groupid = NULL;
+    if(was)
+    {
+      new_lut[len] = *was;
+      new_lut[len++].collected = position;
+    }
+    else if(g_hash_table_lookup_extended(entered, GINT_TO_POINTER(imgid), NULL, &groupid))
+    {
+      new_lut[len++] = (dt_thumbtable_cache_t){ .thumb = NULL, .imgid = imgid,
+                                                .groupid = GPOINTER_TO_INT(groupid), .collected = position };
+    }
+    // else: a group member hidden by collapsed groups, before and after
+  }
+
+  // Everything after the window only shifts by the change in collection size
+  const int64_t shift = (int64_t)diff->new_count - (int64_t)diff->old_count;
+  memcpy(new_lut + len, old_lut + tail_start, tail * sizeof(dt_thumbtable_cache_t));
+  for(int i = len; i < len + tail; i++) new_lut[i].collected = (uint32_t)((int64_t)new_lut[i].collected + shift);
+  len += tail;
+
+  if(len == 0) dt_free(new_lut);
+
+  dt_thumbtable_cache_t *freed = table->lut;
+  table->lut = new_lut;
+  table->collection_count = len;
+  table->collection_serial = diff->serial;
+  table->collection_inited = (len > 0);
+  dt_pthread_mutex_unlock(&table->lock);
+
+  dt_print(DT_DEBUG_LIGHTTABLE,
+           "[thumbtable] patched collection LUT: %u inserted, %u removed, %u moved, %d entries\n",
+           diff->inserted->len, diff->removed->len, diff->moved->len, len);
+
+  dt_free(freed);
+  g_hash_table_destroy(kept);
+  g_hash_table_destroy(entered);
+  return TRUE;
+}
+
 static gboolean _dt_collection_get_hash(dt_thumbtable_t *table)
 {
   // The collection query's generation stands in for the query text, which no longer leaves the
@@ -1126,10 +1253,11 @@ static gboolean _dt_collection_get_hash(dt_thumbtable_t *table)
 // this is called each time collected images change
 static void _dt_collection_changed_callback(gpointer instance, dt_collection_change_t query_change,
                                             dt_collection_properties_t changed_property, gpointer imgs,
-                                            const int next, gpointer user_data)
+                                            const int next, gpointer collection_diff, gpointer user_data)
 {
   if(IS_NULL_PTR(user_data)) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
+  const dt_collection_diff_t *diff = (const dt_collection_diff_t *)collection_diff;
 
   gboolean collapse_groups = dt_conf_get_bool("ui_last/grouping");
   gboolean collapsing_changed = (table->collapse_groups != collapse_groups);
@@ -1141,17 +1269,29 @@ static void _dt_collection_changed_callback(gpointer instance, dt_collection_cha
   // See if the collection changed
   gboolean grouping_changed = changed_property == DT_COLLECTION_PROP_GROUPING;
   gboolean hash_changed = _dt_collection_get_hash(table);
-  gboolean changed = hash_changed || collapsing_changed || grouping_changed;
+  // Same count, same query, but images swapped places, e.g. a rating change in a collection
+  // sorted by rating: the hash can't see it, the diff can.
+  gboolean rows_changed = diff && diff->same_query && (diff->window->len > 0 || diff->removed->len > 0);
+  gboolean changed = hash_changed || collapsing_changed || grouping_changed || rows_changed;
   dt_print(DT_DEBUG_LIGHTTABLE,
           "[thumbtable] collection_changed_callback: query_change=%d changed_property=%d hash_changed=%d "
-          "collapsing_changed=%d grouping_changed=%d -> changed=%d\n",
-          query_change, changed_property, hash_changed, collapsing_changed, grouping_changed, changed);
+          "collapsing_changed=%d grouping_changed=%d rows_changed=%d -> changed=%d\n",
+          query_change, changed_property, hash_changed, collapsing_changed, grouping_changed, rows_changed,
+          changed);
+  // Nothing entered, left or moved: the LUT already is what this diff describes.
+  if(!changed && diff && table->collection_serial != 0 && table->collection_serial + 1 == diff->serial)
+    table->collection_serial = diff->serial;
+
   if(changed)
   {
     // If groups are collapsed, we add only the group leader image to the collection
     // It needs to be set before running _dt_collection_lut()
     table->collapse_groups = collapse_groups;
-    if(!_thumbtable_clone_lut(table))
+
+    // Filters, sorting or grouping changed: that's a new collection, read it all again.
+    // Otherwise images were added, removed or moved, and only those need to be looked at.
+    const gboolean can_patch = !collapsing_changed && !grouping_changed && !table->reset_collection;
+    if(!(can_patch && _dt_collection_lut_patch(table, diff)) && !_thumbtable_clone_lut(table))
       _dt_collection_lut(table);
 
     table->thumbs_inited = FALSE;
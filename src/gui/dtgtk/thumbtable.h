@@ -90,6 +90,7 @@ typedef struct dt_thumbtable_cache_t
   dt_thumbnail_t *thumb; /**< Pointer to thumbnail object */
   int32_t imgid; /**< ID of the image */
   int32_t groupid; /**< ID of the group */
+  uint32_t collected; /**< Position in memory.collected_images, counting collapsed group members */
 } dt_thumbtable_cache_t;
 
 
@@ -145,6 +146,10 @@ typedef struct dt_thumbtable_t
   uint64_t collection_hash;
   int collection_count;
 
+  // Serial of the collection diff the LUT is up to date with, 0 if unknown.
+  // See dt_collection_query_get_diff_serial().
+  uint64_t collection_serial;
+
   int min_row_id;
   int max_row_id;
 
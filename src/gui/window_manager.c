@@ -32,6 +32,7 @@
 #include "gui/application.h"
 #include "gui/dtgtk/thumbnail.h"
 #include "gui/dtgtk/thumbtable.h"
+#include "widgets/focus_peaking.h"
 #include "widgets/accelerators.h"
 #include "widgets/widget_style.h"
 #include "control/signal.h"
@@ -608,6 +609,9 @@ void dt_ui_cleanup_main_table(dt_ui_t *ui)
 
   if(filmstrip) dt_thumbtable_cleanup(filmstrip);
   if(lighttable) dt_thumbtable_cleanup(lighttable);
+
+  // The sharpness results are shared by all the thumbtables: drop them once none is left.
+  dt_focuspeaking_cache_clear();
 }
 
 
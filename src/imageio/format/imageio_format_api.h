@@ -37,6 +37,7 @@ extern "C" {
 
 struct dt_imageio_module_format_t;
 struct dt_imageio_module_data_t;
+struct dt_imageio_rows_t;
 struct dt_dev_pixelpipe_t;
 
 /* early definition of modules to do type checking */
@@ -86,6 +87,13 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* same as write_image, pulling the rows one by one from `rows` (see imageio/imageio_core.h).
+   when implemented, the export converts and hands out the pipe output by strips instead of
+   allocating a full-size copy in output precision first. */
+OPTIONAL(int, write_image_rows, struct dt_imageio_module_data_t *data, const char *filename,
+                                struct dt_imageio_rows_t *rows, dt_colorspaces_color_profile_type_t over_type,
+                                const char *over_filename, void *exif, int exif_len, int32_t imgid, int num,
+                                int total, struct dt_dev_pixelpipe_t *pipe, const gboolean export_masks);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
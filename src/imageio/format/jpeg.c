@@ -326,13 +326,12 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
-int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+int write_image_rows(dt_imageio_module_data_t *jpg_tmp, const char *filename, dt_imageio_rows_t *rows,
+                     dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                     void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                     const gboolean export_masks)
 {
   dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
-  const uint8_t *in = (const uint8_t *)in_tmp;
   struct dt_imageio_jpeg_error_mgr jerr;
 
   jpg->cinfo.err = jpeg_std_error(&jerr.pub);
@@ -384,16 +383,34 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   }
 
   uint8_t *row = dt_pixelpipe_cache_alloc_align_cache(sizeof(uint8_t) * 3 * jpg->global.width, 0);
+  gboolean failed = IS_NULL_PTR(row);
   const uint8_t *buf;
-  while(row && jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  while(!failed && jpg->cinfo.next_scanline < jpg->cinfo.image_height)
   {
     JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
+    buf = dt_imageio_rows_get(rows, jpg->cinfo.next_scanline);
+    if(IS_NULL_PTR(buf))
+    {
+      failed = TRUE;
+      break;
+    }
     for(int i = 0; i < jpg->global.width; i++)
       for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
     tmp[0] = row;
     jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
   }
+
+  if(failed)
+  {
+    // Don't leave a truncated file behind an export reported as failed.
+    jpeg_abort_compress(&(jpg->cinfo));
+    dt_pixelpipe_cache_free_align(row);
+    jpeg_destroy_compress(&(jpg->cinfo));
+    fclose(f);
+    g_unlink(filename);
+    return 1;
+  }
+
   jpeg_finish_compress(&(jpg->cinfo));
   dt_pixelpipe_cache_free_align(row);
   jpeg_destroy_compress(&(jpg->cinfo));
@@ -404,6 +421,17 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   return 0;
 }
 
+int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_rows_t rows;
+  dt_imageio_rows_wrap(&rows, in_tmp, jpg_tmp->width, jpg_tmp->height, 8);
+  return write_image_rows(jpg_tmp, filename, &rows, over_type, over_filename, exif, exif_len, imgid, num, total,
+                          pipe, export_masks);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 {
   jpg->f = g_fopen(filename, "rb");
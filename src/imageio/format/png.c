@@ -144,10 +144,10 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+int write_image_rows(dt_imageio_module_data_t *p_tmp, const char *filename, dt_imageio_rows_t *rows,
+                     dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                     void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                     const gboolean export_masks)
 {
   dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
   const int width = p->global.width, height = p->global.height;
@@ -161,6 +161,7 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   if(IS_NULL_PTR(png_ptr))
   {
     fclose(f);
+    g_unlink(filename);
     return 1;
   }
 
@@ -168,13 +169,16 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   if(IS_NULL_PTR(info_ptr))
   {
     fclose(f);
+    g_unlink(filename);
     png_destroy_write_struct(&png_ptr, NULL);
     return 1;
   }
 
   if(setjmp(png_jmpbuf(png_ptr)))
   {
+    // Don't leave a truncated file behind an export reported as failed.
     fclose(f);
+    g_unlink(filename);
     png_destroy_write_struct(&png_ptr, &info_ptr);
     return 1;
   }
@@ -239,30 +243,40 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
-  png_bytep *row_pointers = dt_pixelpipe_cache_alloc_align_cache(sizeof(png_bytep) * height, 0);
-
-  if(p->bpp > 8)
-  {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
 
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
-  }
-  else
+  // libpng copies each row before applying the transforms above, so rows are only read.
+  for(int i = 0; i < height; i++)
   {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
+    const void *row = dt_imageio_rows_get(rows, i);
+    if(IS_NULL_PTR(row))
+    {
+      fclose(f);
+      g_unlink(filename);
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      return 1;
+    }
+    png_write_row(png_ptr, (png_bytep)row);
   }
 
-  png_write_image(png_ptr, row_pointers);
-
-  dt_pixelpipe_cache_free_align(row_pointers);
-
   png_write_end(png_ptr, info_ptr);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   fclose(f);
   return 0;
 }
 
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_rows_t rows;
+  dt_imageio_rows_wrap(&rows, ivoid, p_tmp->width, p_tmp->height, ((dt_imageio_png_t *)p_tmp)->bpp);
+  return write_image_rows(p_tmp, filename, &rows, over_type, over_filename, exif, exif_len, imgid, num, total,
+                          pipe, export_masks);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -53,6 +53,7 @@
 #include "control/user_message.h"
 #include "imageio/format/imageio_format_api.h"
 #include "develop/pixelpipe_hb.h"
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -85,10 +86,10 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
-int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int32_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+int write_image_rows(dt_imageio_module_data_t *d_tmp, const char *filename, dt_imageio_rows_t *rows,
+                     dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                     void *exif, int exif_len, int32_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
+                     const gboolean export_masks)
 {
   const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
 
@@ -105,6 +106,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
 #endif
   int rc = 1; // default to error
+  gboolean created = FALSE;
 
   if(imgid > 0)
   {
@@ -146,6 +148,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     rc = 1;
     goto exit;
   }
+  created = TRUE;
 
   if(n_pages > 1)
   {
@@ -199,63 +202,9 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(dt_conf_key_exists("plugins/imageio/format/tiff/shortfile"))
     shortmode = dt_conf_get_int("plugins/imageio/format/tiff/shortfile");
 
-  if((d->global.height > 4) && (d->global.width > 4) && shortmode)
-  {
-    layers = 1;    // let's now assume a grayscale
-    if(d->bpp == 32)
-    {
-      for(int y = 1; y < d->global.height-1; y++)
-      {
-        float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-        for(int x = 1; x < d->global.width-1; x++, in += 4)
-        {
-          if((fabsf(fmaxf(in[0], 0.001f) / fmaxf(in[1], 0.001f)) > 1.01f) ||
-             (fabsf(fmaxf(in[0], 0.001f) / fmaxf(in[2], 0.001f)) > 1.01f) ||
-             (fabsf(fmaxf(in[1], 0.001f) / fmaxf(in[2], 0.001f)) > 1.01f))
-          {
-            layers = 3;
-            goto checkdone;
-          }
-        }
-      }
-    }
-    else if(d->bpp == 16)
-    {
-      for(int y = 1; y < d->global.height-1; y++)
-      {
-        uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-        for(int x = 1; x < d->global.width-1; x++, in += 4)
-        {
-          if((abs(in[0] - in[1]) > 100) ||
-             (abs(in[0] - in[2]) > 100) ||
-             (abs(in[1] - in[2]) > 100))
-          {
-            layers = 3;
-            goto checkdone;
-          }
-        }
-      }
-    }
-    else
-    {
-      for(int y = 1; y < d->global.height-1; y++)
-      {
-        uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-        for(int x = 1; x < d->global.width-1; x++, in += 4)
-        {
-          if((abs(in[0] - in[1]) > 5) ||
-             (abs(in[0] - in[2]) > 5) ||
-             (abs(in[1] - in[2]) > 5))
-          {
-            layers = 3;
-            goto checkdone;
-          }
-        }
-      }
-    }
+  if((d->global.height > 4) && (d->global.width > 4) && shortmode && dt_imageio_rows_is_grayscale(rows))
+    layers = 1;
 
-  }
-  checkdone:
   if(layers == 1)
     dt_control_log(_("will export as a grayscale image"));
 
@@ -289,8 +238,13 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   {
     for(int y = 0; y < d->global.height; y++)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
+      const float *in = (const float *)dt_imageio_rows_get(rows, y);
       float *out = (float *)rowdata;
+      if(IS_NULL_PTR(in))
+      {
+        rc = 1;
+        goto exit;
+      }
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
       {
@@ -308,8 +262,13 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   {
     for(int y = 0; y < d->global.height; y++)
     {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
+      const uint16_t *in = (const uint16_t *)dt_imageio_rows_get(rows, y);
       uint16_t *out = (uint16_t *)rowdata;
+      if(IS_NULL_PTR(in))
+      {
+        rc = 1;
+        goto exit;
+      }
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
       {
@@ -327,8 +286,13 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   {
     for(int y = 0; y < d->global.height; y++)
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
+      const uint8_t *in = (const uint8_t *)dt_imageio_rows_get(rows, y);
       uint8_t *out = (uint8_t *)rowdata;
+      if(IS_NULL_PTR(in))
+      {
+        rc = 1;
+        goto exit;
+      }
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
       {
@@ -562,6 +526,9 @@ exit:
     TIFFClose(tif);
     tif = NULL;
   }
+  // Don't leave a truncated file behind an export reported as failed.
+  if(rc != 0 && created)
+    g_unlink(filename);
   dt_free(profile);
   dt_free(rowdata);
 #ifdef _WIN32
@@ -573,6 +540,17 @@ exit:
   return rc;
 }
 
+int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int32_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_rows_t rows;
+  dt_imageio_rows_wrap(&rows, in_void, d_tmp->width, d_tmp->height, ((dt_imageio_tiff_t *)d_tmp)->bpp);
+  return write_image_rows(d_tmp, filename, &rows, over_type, over_filename, exif, exif_len, imgid, num, total,
+                          pipe, export_masks);
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
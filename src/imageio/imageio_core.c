@@ -58,6 +58,7 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#include "system/dtpthread.h"
 #include "system/macros.h"
 #include "system/openmp.h"
 #include "system/target_clones.h"
@@ -703,13 +704,23 @@ gboolean _get_export_size(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe,
 }
 
 
+static inline uint8_t _float_to_uint8(const float v)
+{
+  return (uint8_t)CLAMPF(roundf(v * 255.f), 0.f, 255.f);
+}
+
+static inline uint16_t _float_to_uint16(const float v)
+{
+  return (uint16_t)CLAMP(roundf(v * 65535.f), 0.f, 65535.f);
+}
+
 void _clamp_float_to_uint8(const float *const inbuf, uint8_t *const outbuf, const size_t processed_width,
                            const size_t processed_height)
 {
   __OMP_PARALLEL_FOR__()
   for(size_t k = 0; k < processed_width * processed_height; k++)
     for_four_channels(c)
-      outbuf[4 * k + c] = (uint8_t)CLAMPF(roundf(inbuf[4 * k + c] * 255.f), 0.f, 255.f);
+      outbuf[4 * k + c] = _float_to_uint8(inbuf[4 * k + c]);
 }
 
 
@@ -733,7 +744,205 @@ void _export_final_buffer_to_uint16(const float *const restrict inbuf, uint16_t
   __OMP_PARALLEL_FOR__()
   for(size_t k = 0; k < processed_width * processed_height; k++)
     for_four_channels(c)
-      outbuf[4 * k + c] = (uint16_t)CLAMP(roundf(inbuf[4 * k + c] * 65535.f), 0.f, 65535.f);
+      outbuf[4 * k + c] = _float_to_uint16(inbuf[4 * k + c]);
+}
+
+
+// Rows per converted strip of a streamed export. Large enough for the OpenMP conversion to
+// be worth its fork, small enough that two strips of a 100 Mpx image stay in the megabytes.
+#define DT_IMAGEIO_STRIP_ROWS 64
+
+typedef struct dt_imageio_rows_stream_t
+{
+  const float *in; // pipe output, RGBA float
+  int strips;
+
+  // Double buffer: the helper converts strip `next` into strip[next & 1] while the encoder
+  // reads strip `current` from the other one. It never runs more than one strip ahead.
+  void *strip[2];
+  int strip_index[2];
+  int current;
+  int next;
+  gboolean stop;
+
+  // Out-of-order reads, converted synchronously.
+  void *scratch;
+  int scratch_index;
+
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GThread *thread;
+} dt_imageio_rows_stream_t;
+
+static inline size_t _rows_row_size(const dt_imageio_rows_t *rows)
+{
+  return (size_t)rows->width * 4 * (rows->bpp / 8);
+}
+
+void dt_imageio_rows_wrap(dt_imageio_rows_t *rows, const void *buffer, const int width, const int height,
+                          const int bpp)
+{
+  *rows = (dt_imageio_rows_t){ .width = width, .height = height, .bpp = bpp, .buffer = buffer, .stream = NULL };
+}
+
+static void _rows_convert_strip(const dt_imageio_rows_t *rows, const int strip, void *out)
+{
+  const int y = strip * DT_IMAGEIO_STRIP_ROWS;
+  const int height = MIN(DT_IMAGEIO_STRIP_ROWS, rows->height - y);
+  const float *const in = rows->stream->in + (size_t)4 * y * rows->width;
+  if(rows->bpp == 8)
+    _clamp_float_to_uint8(in, out, rows->width, height);
+  else
+    _export_final_buffer_to_uint16(in, out, rows->width, height);
+}
+
+static gpointer _rows_convert_worker(gpointer data)
+{
+  dt_imageio_rows_t *rows = (dt_imageio_rows_t *)data;
+  dt_imageio_rows_stream_t *st = rows->stream;
+
+  dt_pthread_mutex_lock(&st->lock);
+  while(!st->stop && st->next < st->strips)
+  {
+    if(st->next > st->current + 1)
+    {
+      dt_pthread_cond_wait(&st->cond, &st->lock);
+      continue;
+    }
+
+    // The buffer we write held strip next - 2, which the encoder left already.
+    const int strip = st->next;
+    dt_pthread_mutex_unlock(&st->lock);
+    _rows_convert_strip(rows, strip, st->strip[strip & 1]);
+    dt_pthread_mutex_lock(&st->lock);
+
+    st->strip_index[strip & 1] = strip;
+    st->next++;
+    pthread_cond_broadcast(&st->cond);
+  }
+  dt_pthread_mutex_unlock(&st->lock);
+  return NULL;
+}
+
+static int _rows_stream_init(dt_imageio_rows_t *rows, const float *in, const int width, const int height,
+                             const int bpp)
+{
+  dt_imageio_rows_wrap(rows, NULL, width, height, bpp);
+
+  dt_imageio_rows_stream_t *st = g_new0(dt_imageio_rows_stream_t, 1);
+  rows->stream = st;
+
+  st->in = in;
+  st->strips = (height + DT_IMAGEIO_STRIP_ROWS - 1) / DT_IMAGEIO_STRIP_ROWS;
+  st->strip_index[0] = st->strip_index[1] = st->scratch_index = -1;
+
+  const size_t strip_size = _rows_row_size(rows) * DT_IMAGEIO_STRIP_ROWS;
+  st->strip[0] = dt_pixelpipe_cache_alloc_align_cache(strip_size, 0);
+  st->strip[1] = dt_pixelpipe_cache_alloc_align_cache(strip_size, 0);
+  if(IS_NULL_PTR(st->strip[0]) || IS_NULL_PTR(st->strip[1]))
+  {
+    dt_pixelpipe_cache_free_align(st->strip[0]);
+    dt_pixelpipe_cache_free_align(st->strip[1]);
+    dt_free(rows->stream);
+    return 1;
+  }
+
+  dt_pthread_mutex_init(&st->lock, NULL);
+  pthread_cond_init(&st->cond, NULL);
+  st->thread = g_thread_new("export-rows", _rows_convert_worker, rows);
+  return 0;
+}
+
+static void _rows_stream_cleanup(dt_imageio_rows_t *rows)
+{
+  dt_imageio_rows_stream_t *st = rows->stream;
+  if(IS_NULL_PTR(st)) return;
+
+  // The encoder may bail out halfway: wake the helper so it sees `stop`.
+  dt_pthread_mutex_lock(&st->lock);
+  st->stop = TRUE;
+  pthread_cond_broadcast(&st->cond);
+  dt_pthread_mutex_unlock(&st->lock);
+  g_thread_join(st->thread);
+
+  pthread_cond_destroy(&st->cond);
+  dt_pthread_mutex_destroy(&st->lock);
+  dt_pixelpipe_cache_free_align(st->strip[0]);
+  dt_pixelpipe_cache_free_align(st->strip[1]);
+  dt_pixelpipe_cache_free_align(st->scratch);
+  dt_free(rows->stream);
+}
+
+gboolean dt_imageio_rows_is_grayscale(const dt_imageio_rows_t *rows)
+{
+  // Borders are left alone: the pipeline may leave errors there.
+  const dt_imageio_rows_stream_t *st = rows->stream;
+  for(int y = 1; y < rows->height - 1; y++)
+  {
+    const uint8_t *const row = rows->buffer ? (const uint8_t *)rows->buffer + (size_t)y * _rows_row_size(rows) : NULL;
+    const float *const src = st ? st->in + (size_t)4 * y * rows->width : NULL;
+    for(int x = 1; x < rows->width - 1; x++)
+    {
+      if(rows->bpp == 32)
+      {
+        // Float rows are never streamed.
+        const float *const in = (const float *)row + 4 * x;
+        if((fabsf(fmaxf(in[0], 0.001f) / fmaxf(in[1], 0.001f)) > 1.01f)
+           || (fabsf(fmaxf(in[0], 0.001f) / fmaxf(in[2], 0.001f)) > 1.01f)
+           || (fabsf(fmaxf(in[1], 0.001f) / fmaxf(in[2], 0.001f)) > 1.01f))
+          return FALSE;
+        continue;
+      }
+
+      // Streamed rows are read from the pipe output, converted the same way as the strips.
+      int in[3];
+      for(int c = 0; c < 3; c++)
+      {
+        if(rows->bpp == 16)
+          in[c] = src ? _float_to_uint16(src[4 * x + c]) : ((const uint16_t *)row)[4 * x + c];
+        else
+          in[c] = src ? _float_to_uint8(src[4 * x + c]) : row[4 * x + c];
+      }
+      const int threshold = (rows->bpp == 16) ? 100 : 5;
+      if(abs(in[0] - in[1]) > threshold || abs(in[0] - in[2]) > threshold || abs(in[1] - in[2]) > threshold)
+        return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+const void *dt_imageio_rows_get(dt_imageio_rows_t *rows, const int y)
+{
+  if(y < 0 || y >= rows->height) return NULL;
+  if(rows->buffer) return (const uint8_t *)rows->buffer + (size_t)y * _rows_row_size(rows);
+
+  dt_imageio_rows_stream_t *st = rows->stream;
+  const int strip = y / DT_IMAGEIO_STRIP_ROWS;
+  const size_t offset = (size_t)(y - strip * DT_IMAGEIO_STRIP_ROWS) * _rows_row_size(rows);
+
+  // Only the encoder moves `current`, so reading it unlocked here is fine.
+  if(strip == st->current || strip == st->current + 1)
+  {
+    dt_pthread_mutex_lock(&st->lock);
+    if(strip != st->current)
+    {
+      st->current = strip;
+      pthread_cond_broadcast(&st->cond);
+    }
+    while(st->strip_index[strip & 1] != strip) dt_pthread_cond_wait(&st->cond, &st->lock);
+    dt_pthread_mutex_unlock(&st->lock);
+    return (const uint8_t *)st->strip[strip & 1] + offset;
+  }
+
+  if(st->scratch_index != strip)
+  {
+    if(IS_NULL_PTR(st->scratch))
+      st->scratch = dt_pixelpipe_cache_alloc_align_cache(_rows_row_size(rows) * DT_IMAGEIO_STRIP_ROWS, 0);
+    if(IS_NULL_PTR(st->scratch)) return NULL;
+    _rows_convert_strip(rows, strip, st->scratch);
+    st->scratch_index = strip;
+  }
+  return (const uint8_t *)st->scratch + offset;
 }
 
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
@@ -880,9 +1089,19 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
    * while the OpenMP threads are reading it. */
   dt_dev_pixelpipe_cache_rdlock_entry(TRUE, cache_entry);
 
+  /* Formats that can write scanlines pull their rows from the pipe output directly, converted
+   * by strips: the full-size copy in output precision below is never allocated. The cache
+   * entry then stays referenced and read-locked until the encoder is done. */
+  const gboolean streamed = !thumbnail_export && !display_byteorder && format->write_image_rows
+                            && dt_conf_get_bool("plugins/imageio/export/stream_rows");
+
   // Down-conversion to low-precision formats:
   const size_t pixels = pipe.backbuf.width * pipe.backbuf.height * 4;
-  if(bpp == 8)
+  if(streamed)
+  {
+    // converted later, while encoding
+  }
+  else if(bpp == 8)
   {
     outbuf = dt_pixelpipe_cache_alloc_align_cache(
         sizeof(uint8_t) * pixels,
@@ -935,11 +1154,14 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
     }
   }
 
-  // Decrease ref count on the cache entry and release the read lock
-  dt_dev_pixelpipe_cache_ref_count_entry(FALSE, cache_entry);
-  dt_dev_pixelpipe_cache_rdlock_entry(FALSE, cache_entry);
+  if(!streamed)
+  {
+    // Decrease ref count on the cache entry and release the read lock
+    dt_dev_pixelpipe_cache_ref_count_entry(FALSE, cache_entry);
+    dt_dev_pixelpipe_cache_rdlock_entry(FALSE, cache_entry);
 
-  if(IS_NULL_PTR(outbuf)) goto error;
+    if(IS_NULL_PTR(outbuf)) goto error;
+  }
 
   format_params->width = pipe.backbuf.width;
   format_params->height = pipe.backbuf.height;
@@ -962,8 +1184,27 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   }
 
   // Finally: write image buffer to target container
-  res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                            num, total, &pipe, export_masks);
+  if(streamed)
+  {
+    dt_imageio_rows_t rows;
+    if(bpp == 32)
+      dt_imageio_rows_wrap(&rows, data, pipe.backbuf.width, pipe.backbuf.height, bpp);
+    else if(_rows_stream_init(&rows, data, pipe.backbuf.width, pipe.backbuf.height, bpp))
+      rows.height = 0;
+
+    if(rows.height > 0)
+      res = format->write_image_rows(format_params, filename, &rows, icc_type, icc_filename, exif_profile, length,
+                                     imgid, num, total, &pipe, export_masks);
+    else
+      res = 1;
+
+    _rows_stream_cleanup(&rows);
+    dt_dev_pixelpipe_cache_ref_count_entry(FALSE, cache_entry);
+    dt_dev_pixelpipe_cache_rdlock_entry(FALSE, cache_entry);
+  }
+  else
+    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length,
+                              imgid, num, total, &pipe, export_masks);
 
   dt_free(exif_profile);
   if(res) goto error;
@@ -132,6 +132,53 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  int num, int total, dt_export_metadata_t *metadata,
                                  dt_atomic_int *shutdown);
 
+/**
+ * @brief Rows of an image being exported, in the precision the format asked for through bpp().
+ *
+ * @details Formats implementing write_image_rows() read their pixels through
+ * dt_imageio_rows_get() instead of a whole buffer. On the export path, 8 and 16 bit rows are
+ * converted from the pipe output one strip at a time, the next strip being converted on a
+ * helper thread while the encoder consumes the current one, so no full-size integer copy of
+ * the image is ever allocated. Float rows are read straight from the pipe output.
+ *
+ * Pixels are 4 channels (RGBA), tightly packed. The fields below are private to
+ * imageio_core.c, except width, height and bpp.
+ */
+typedef struct dt_imageio_rows_t
+{
+  int width, height;
+  int bpp; // bits per channel: 8, 16 or 32 (float)
+  const void *buffer; // whole image in output precision, or NULL when streamed
+  struct dt_imageio_rows_stream_t *stream;
+} dt_imageio_rows_t;
+
+/**
+ * @brief Point `rows` at an image already fully in output precision. Used by formats to route
+ * write_image() through their write_image_rows() implementation.
+ */
+void dt_imageio_rows_wrap(dt_imageio_rows_t *rows, const void *buffer, const int width, const int height,
+                          const int bpp);
+
+/**
+ * @brief Get row `y`. The pointer stays valid until the next call.
+ *
+ * @details Read the rows top to bottom: a streamed source converts the strip following the one
+ * being read ahead of time. Going back, or skipping strips, still works but converts
+ * synchronously.
+ *
+ * @return the row, or NULL if `y` is out of bounds.
+ */
+const void *dt_imageio_rows_get(dt_imageio_rows_t *rows, const int y);
+
+/**
+ * @brief Whether every pixel of `rows`, borders excepted, has its three channels equal within
+ * the tolerance of its precision.
+ *
+ * @details Streamed rows are checked against the pipe output directly: reading them through
+ * dt_imageio_rows_get() before writing would convert every strip twice.
+ */
+gboolean dt_imageio_rows_is_grayscale(const dt_imageio_rows_t *rows);
+
 // general, efficient buffer flipping function using memcopies
 void dt_imageio_flip_buffers(char *out, const char *in,
                              const size_t bpp, // bytes per pixel
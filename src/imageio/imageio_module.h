@@ -77,6 +77,7 @@ typedef struct dt_imageio_module_data_t
 } dt_imageio_module_data_t;
 
 struct dt_imageio_module_format_t;
+struct dt_imageio_rows_t;
 struct dt_dev_pixelpipe_t;
 /* responsible for image encoding, such as jpg,png,etc */
 typedef struct dt_imageio_module_format_t
@@ -63,6 +63,7 @@
 #include "pixel/bilateral.h"
 #include "common/image.h"
 #include "common/imagebuf.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "math/math.h"
 #include "common/opencl.h"
@@ -75,6 +76,7 @@
 
 #include "widgets/draw.h"
 #include "iop/iop_api.h"
+#include "iop/noise_generator.h"
 
 #include "gui/guides.h"
 
@@ -445,6 +447,22 @@ typedef struct dt_iop_ashift_fit_params_t
   float shear_range;
 } dt_iop_ashift_fit_params_t;
 
+// the structure detected in one image: its lines, in input coordinates of a width x height
+// image, and how many of them are selected in each direction, with their total weight
+typedef struct dt_iop_ashift_structure_t
+{
+  dt_iop_ashift_line_t *lines;
+  int lines_count;
+  int width;
+  int height;
+  int x_off;
+  int y_off;
+  int vertical_count;
+  int horizontal_count;
+  float vertical_weight;
+  float horizontal_weight;
+} dt_iop_ashift_structure_t;
+
 typedef struct dt_iop_ashift_cropfit_params_t
 {
   int width;
@@ -1603,6 +1621,63 @@ error:
   return FALSE;
 }
 
+// analyze a width x height RGBA buffer, sampled at `scale` from an input image with
+// offset x_off, y_off, for structure. `buffer` is overwritten. On success the lines in `s`
+// are owned by the caller.
+static int _detect_structure(float *buffer, const int width, const int height, const int x_off, const int y_off,
+                             const float scale, dt_iop_ashift_enhance_t enhance, const gboolean raw_origin,
+                             dt_iop_ashift_structure_t *s)
+{
+  dt_iop_ashift_line_t *lines = NULL;
+  int lines_count;
+  int vertical_count;
+  int horizontal_count;
+  float vertical_weight;
+  float horizontal_weight;
+
+  // get new structural data. The raw_origin flag tells line_detect() the image originates from a
+  // raw sensor (different edge/contrast expectations than a display-referred JPEG); this holds
+  // for any raw colorimetry, mosaiced or already-demosaiced sraw/linear DNG, hence needs_rawprepare.
+  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
+                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
+                  enhance, raw_origin))
+  {
+    // line_detect() can fail after allocating
+    dt_free(lines);
+    return FALSE;
+  }
+
+  // line_detect() rescales coordinates back to input (full-res) space, so
+  // we must apply the same scaling to metadata.
+  const float inv_scale = (scale > 0.f) ? (1.f / scale) : 1.f;
+  s->width = (int)roundf(width * inv_scale);
+  s->height = (int)roundf(height * inv_scale);
+  s->x_off = (int)roundf(x_off * inv_scale);
+  s->y_off = (int)roundf(y_off * inv_scale);
+  s->lines_count = lines_count;
+  s->vertical_count = vertical_count;
+  s->horizontal_count = horizontal_count;
+  s->vertical_weight = vertical_weight;
+  s->horizontal_weight = horizontal_weight;
+  s->lines = lines;
+  return TRUE;
+}
+
+// the structure held by the GUI, lines not copied
+static dt_iop_ashift_structure_t _gui_structure(const dt_iop_ashift_gui_data_t *g)
+{
+  return (dt_iop_ashift_structure_t){ .lines = g->lines,
+                                      .lines_count = g->lines_count,
+                                      .width = g->lines_in_width,
+                                      .height = g->lines_in_height,
+                                      .x_off = g->lines_x_off,
+                                      .y_off = g->lines_y_off,
+                                      .vertical_count = g->vertical_count,
+                                      .horizontal_count = g->horizontal_count,
+                                      .vertical_weight = g->vertical_weight,
+                                      .horizontal_weight = g->horizontal_weight };
+}
+
 // get image from buffer, analyze for structure and save results
 static int _get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhance)
 {
@@ -1632,11 +1707,7 @@ static int _get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhan
   }
   dt_iop_gui_leave_critical_section(module);
 
-  // declared before the first `goto error` and NULL-initialised, so the error path may
-  // free it unconditionally -- line_detect() can fail after allocating
-  dt_iop_ashift_line_t *lines = NULL;
-
-  if(IS_NULL_PTR(buffer)) goto error;
+  if(IS_NULL_PTR(buffer)) return FALSE;
 
   // get rid of old structural data
   g->lines_count = 0;
@@ -1646,47 +1717,30 @@ static int _get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhan
   g->lines = NULL;   // freed without NULLing: an error return below left this dangling,
                      // and the next call's dt_free(g->lines) was a double free
 
-  int lines_count;
-  int vertical_count;
-  int horizontal_count;
-  float vertical_weight;
-  float horizontal_weight;
-
-  // get new structural data. The trailing flag tells line_detect() the image originates from a
-  // raw sensor (different edge/contrast expectations than a display-referred JPEG); this holds
-  // for any raw colorimetry, mosaiced or already-demosaiced sraw/linear DNG, hence needs_rawprepare.
   const gboolean raw_origin = dt_image_needs_rawprepare(&module->dev->image_storage);
   dt_iop_fmt_log(module, "structure: class=%s raw_origin=%d enhance=%d",
                  dt_image_pipe_class_name(dt_image_pipe_class(&module->dev->image_storage)),
                  raw_origin, enhance);
-  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
-                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
-                  enhance, raw_origin))
-    goto error;
+
+  dt_iop_ashift_structure_t structure = { 0 };
+  const int success = _detect_structure(buffer, width, height, x_off, y_off, scale, enhance, raw_origin, &structure);
+  dt_free(buffer);
+  if(!success) return FALSE;
 
   // save new structural data
-  // line_detect() rescales coordinates back to input (full-res) space, so
-  // we must apply the same scaling to metadata.
-  const float inv_scale = (scale > 0.f) ? (1.f / scale) : 1.f;
-  g->lines_in_width = (int)roundf(width * inv_scale);
-  g->lines_in_height = (int)roundf(height * inv_scale);
-  g->lines_x_off = (int)roundf(x_off * inv_scale);
-  g->lines_y_off = (int)roundf(y_off * inv_scale);
-  g->lines_count = lines_count;
-  g->vertical_count = vertical_count;
-  g->horizontal_count = horizontal_count;
-  g->vertical_weight = vertical_weight;
-  g->horizontal_weight = horizontal_weight;
+  g->lines_in_width = structure.width;
+  g->lines_in_height = structure.height;
+  g->lines_x_off = structure.x_off;
+  g->lines_y_off = structure.y_off;
+  g->lines_count = structure.lines_count;
+  g->vertical_count = structure.vertical_count;
+  g->horizontal_count = structure.horizontal_count;
+  g->vertical_weight = structure.vertical_weight;
+  g->horizontal_weight = structure.horizontal_weight;
   g->lines_version++;
-  g->lines = lines;
+  g->lines = structure.lines;
 
-  dt_free(buffer);
   return TRUE;
-
-error:
-  dt_free(lines);
-  dt_free(buffer);
-  return FALSE;
 }
 
 
@@ -1715,13 +1769,17 @@ static int quickperm(int *a, int *p, const int N, int *i)
   return TRUE;
 }
 
-// Fisher-Yates shuffle
-static void shuffle(int *a, const int N)
+// Fisher-Yates shuffle of a copy of `in`, drawn from a generator seeded by `seed` alone:
+// the same seed always gives the same permutation, whichever thread asks for it.
+static void shuffle(int *out, const int *in, const int N, const uint64_t seed)
 {
+  uint32_t DT_ALIGNED_ARRAY state[4] = { splitmix32(seed + 1), splitmix32((seed + 1) * 3),
+                                         splitmix32(1337), splitmix32(666) };
+  memcpy(out, in, sizeof(int) * N);
   for(int i = 0; i < N; i++)
   {
-    int j = i + rand() % (N - i);
-    swap(&a[j], &a[i]);
+    const int j = i + MIN((int)(xoshiro128plus(state) * (N - i)), N - i - 1);
+    swap(&out[j], &out[i]);
   }
 }
 
@@ -1731,6 +1789,75 @@ static int fact(const int n)
   return (n == 1 ? 1 : n * fact(n - 1));
 }
 
+// Evaluate one model of ransac(): the vantage point of the first two lines of `set`, and
+// the lines of the set passing through it closer than `epsilon`, flagged in `inout`.
+// Returns FALSE if the two lines make no usable model, else writes the model quality and
+// adds the number of rejected lines to `eliminated`.
+static gboolean ransac_model(const dt_iop_ashift_line_t *lines, const int *set, int *inout,
+                             const int set_count, const float total_weight, const float epsilon,
+                             const int xmin, const int xmax, const int ymin, const int ymax,
+                             float *quality, int *eliminated)
+{
+  // we build a model ouf of the first two lines
+  const float *L1 = lines[set[0]].L;
+  const float *L2 = lines[set[1]].L;
+
+  // get intersection point (ideally a vantage point)
+  float V[3];
+  vec3prodn(V, L1, L2);
+
+  // catch special cases:
+  // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
+  // b) vantage point lies inside image frame (no chance to correct for this case)
+  if(vec3isnull(V) ||
+     (fabsf(V[2]) > 0.0f &&
+      V[0]/V[2] >= xmin &&
+      V[1]/V[2] >= ymin &&
+      V[0]/V[2] <= xmax &&
+      V[1]/V[2] <= ymax))
+    return FALSE;
+
+  // normalize V so that x^2 + y^2 + z^2 = 1
+  vec3norm(V, V);
+
+  // the two lines constituting the model are part of the set
+  inout[0] = 1;
+  inout[1] = 1;
+
+  // go through all remaining lines, check if they are within the model, and
+  // mark that fact in inout[].
+  // summarize a quality parameter for all lines within the model
+  float q = 0.0f;
+  for(int n = 2; n < set_count; n++)
+  {
+    // L is normalized so that x^2 + y^2 = 1
+    const float *L3 = lines[set[n]].L;
+
+    // we take the absolute value of the dot product of V and L as a measure
+    // of the "distance" between point and line. Note that this is not the real euclidean
+    // distance but - with the given normalization - just a pragmatically selected number
+    // that goes to zero if V lies on L and increases the more V and L are apart
+    const float d = fabsf(vec3scalar(V, L3));
+
+    // depending on d we either include or exclude the point from the set
+    inout[n] = (d < epsilon) ? 1 : 0;
+
+    if(inout[n] == 1)
+    {
+      // a quality parameter that depends 1/3 on the number of lines within the model,
+      // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
+      q += 0.33f / (float)set_count
+           + 0.33f * lines[set[n]].weight / total_weight
+           + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[set[n]].weight / total_weight;
+    }
+    else
+      (*eliminated)++;
+  }
+
+  *quality = q;
+  return TRUE;
+}
+
 // We use a pseudo-RANSAC algorithm to elminiate ouliers from our set of lines. The
 // original RANSAC works on linear optimization problems. Our model is nonlinear. We
 // take advantage of the fact that lines interesting for our model are vantage lines
@@ -1747,6 +1874,10 @@ static int fact(const int n)
 // note: the actual percentage of outliers removed in the final run will be lower because we
 // will finally look for the best quality model with the optimized epsilon and that quality value also
 // encloses the number of good lines
+// Every random run samples its own permutation of the original set, seeded by its run number,
+// so the runs of one optimization step, and all the final runs, are independent and run in
+// parallel. The final pick is the first best run in run order, and its permutation is drawn
+// again to store it: the result does not depend on the number of threads.
 static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout_set,
                   const int set_count, const float total_weight, const int xmin, const int xmax,
                   const int ymin, const int ymax)
@@ -1754,11 +1885,6 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
   if(set_count < 3) return;
 
   const size_t set_size = set_count * sizeof(int);
-  int *best_set = malloc(set_size);
-  memcpy(best_set, index_set, set_size);
-  int *best_inout = calloc(1, set_size);
-
-  float best_quality = 0.0f;
 
   // hurdle value epsilon for rejecting a line as an outlier will be self-tuning
   // in a number of dry runs
@@ -1768,256 +1894,232 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
   int lines_eliminated = 0;
   int valid_runs = 0;
 
-  // number of runs to optimize epsilon
-  const int optiruns = RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS;
-  // go for complete permutations on small set sizes, else for random sample consensus
-  const int riter = (set_count > RANSAC_HURDLE) ? RANSAC_RUNS : fact(set_count);
-
-  // some data needed for quickperm
-  int *perm = malloc(sizeof(int) * (set_count + 1));
-  for(int n = 0; n < set_count + 1; n++) perm[n] = n;
-  int piter = 1;
-
-  // inout holds good/bad qualification for each line
-  int *inout = malloc(set_size);
-
-  for(int r = 0; r < optiruns + riter; r++)
+  for(int step = 0; step < RANSAC_OPTIMIZATION_STEPS; step++)
   {
-    // get random or systematic variation of index set
-    if(set_count > RANSAC_HURDLE || r < optiruns)
-      shuffle(index_set, set_count);
-    else
-      (void)quickperm(index_set, perm, set_count, &piter);
-
-    // summed quality evaluation of this run
-    float quality = 0.0f;
-
-    // we build a model ouf of the first two lines
-    const float *L1 = lines[index_set[0]].L;
-    const float *L2 = lines[index_set[1]].L;
-
-    // get intersection point (ideally a vantage point)
-    float V[3];
-    vec3prodn(V, L1, L2);
-
-    // catch special cases:
-    // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
-    // b) vantage point lies inside image frame (no chance to correct for this case)
-    if(vec3isnull(V) ||
-       (fabsf(V[2]) > 0.0f &&
-        V[0]/V[2] >= xmin &&
-        V[1]/V[2] >= ymin &&
-        V[0]/V[2] <= xmax &&
-        V[1]/V[2] <= ymax))
+    int step_eliminated = 0;
+    int step_valid = 0;
+
+    __OMP_PARALLEL_FOR__(reduction(+ : step_eliminated, step_valid))
+    for(int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++)
     {
-      // no valid model
-      quality = 0.0f;
+      int *set = malloc(set_size);
+      int *inout = malloc(set_size);
+      if(!IS_NULL_PTR(set) && !IS_NULL_PTR(inout))
+      {
+        shuffle(set, index_set, set_count, (uint64_t)step * RANSAC_OPTIMIZATION_DRY_RUNS + r);
+        float quality = 0.0f;
+        if(ransac_model(lines, set, inout, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax,
+                        &quality, &step_eliminated))
+          step_valid++;
+      }
+      dt_free(inout);
+      dt_free(set);
     }
-    else
-    {
-      // valid model
-
-      // normalize V so that x^2 + y^2 + z^2 = 1
-      vec3norm(V, V);
 
-      // the two lines constituting the model are part of the set
-      inout[0] = 1;
-      inout[1] = 1;
+    lines_eliminated += step_eliminated;
+    valid_runs += step_valid;
 
-      // go through all remaining lines, check if they are within the model, and
-      // mark that fact in inout[].
-      // summarize a quality parameter for all lines within the model
-      for(int n = 2; n < set_count; n++)
-      {
-        // L is normalized so that x^2 + y^2 = 1
-        const float *L3 = lines[index_set[n]].L;
-
-        // we take the absolute value of the dot product of V and L as a measure
-        // of the "distance" between point and line. Note that this is not the real euclidean
-        // distance but - with the given normalization - just a pragmatically selected number
-        // that goes to zero if V lies on L and increases the more V and L are apart
-        const float d = fabsf(vec3scalar(V, L3));
+    // at the end of each self-tuning step
+    if(valid_runs > 0)
+    {
+#ifdef ASHIFT_DEBUG
+      printf("ransac self-tuning (step %d): epsilon %f", step, epsilon);
+#endif
+      // average ratio of lines that we eliminated with the given epsilon
+      float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
+      // adjust epsilon accordingly
+      if(ratio < RANSAC_ELIMINATION_RATIO)
+        epsilon = powf(10.0f, log10(epsilon) - epsilon_step);
+      else if(ratio > RANSAC_ELIMINATION_RATIO)
+        epsilon = powf(10.0f, log10(epsilon) + epsilon_step);
+#ifdef ASHIFT_DEBUG
+      printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
+#endif
+      // reduce step-size for next optimization round
+      epsilon_step /= 2.0f;
+      lines_eliminated = 0;
+      valid_runs = 0;
+    }
+  }
 
-        // depending on d we either include or exclude the point from the set
-        inout[n] = (d < epsilon) ? 1 : 0;
+  int *best_set = malloc(set_size);
+  int *best_inout = calloc(1, set_size);
+  int *set = malloc(set_size);
+  int *inout = malloc(set_size);
+  if(IS_NULL_PTR(best_set) || IS_NULL_PTR(best_inout) || IS_NULL_PTR(set) || IS_NULL_PTR(inout)) goto end;
 
-        float q;
+  memcpy(best_set, index_set, set_size);
+  float best_quality = 0.0f;
+  int eliminated = 0;
 
-        if(inout[n] == 1)
-        {
-          // a quality parameter that depends 1/3 on the number of lines within the model,
-          // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
-          q = 0.33f / (float)set_count
-              + 0.33f * lines[index_set[n]].weight / total_weight
-              + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[index_set[n]].weight / total_weight;
-        }
-        else
-        {
-          q = 0.0f;
-          lines_eliminated++;
-        }
+  if(set_count > RANSAC_HURDLE)
+  {
+    // random sample consensus
+    const uint64_t first_seed = (uint64_t)RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS;
+    float *qualities = malloc(sizeof(float) * RANSAC_RUNS);
+    if(IS_NULL_PTR(qualities)) goto end;
 
-        quality += q;
+    __OMP_PARALLEL_FOR__()
+    for(int r = 0; r < RANSAC_RUNS; r++)
+    {
+      int *run_set = malloc(set_size);
+      int *run_inout = malloc(set_size);
+      int run_eliminated = 0;
+      qualities[r] = 0.0f;
+      if(!IS_NULL_PTR(run_set) && !IS_NULL_PTR(run_inout))
+      {
+        shuffle(run_set, index_set, set_count, first_seed + r);
+        (void)ransac_model(lines, run_set, run_inout, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax,
+                           &qualities[r], &run_eliminated);
       }
-      valid_runs++;
+      dt_free(run_inout);
+      dt_free(run_set);
     }
 
-    if(r < optiruns)
-    {
-      // on last run of each self-tuning step
-      if((r % RANSAC_OPTIMIZATION_DRY_RUNS) == (RANSAC_OPTIMIZATION_DRY_RUNS - 1) && (valid_runs > 0))
+    // check every run against the best model found before it
+    int best_run = -1;
+    for(int r = 0; r < RANSAC_RUNS; r++)
+      if(qualities[r] > best_quality)
       {
-#ifdef ASHIFT_DEBUG
-        printf("ransac self-tuning (run %d): epsilon %f", r, epsilon);
-#endif
-        // average ratio of lines that we eliminated with the given epsilon
-        float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
-        // adjust epsilon accordingly
-        if(ratio < RANSAC_ELIMINATION_RATIO)
-          epsilon = powf(10.0f, log10(epsilon) - epsilon_step);
-        else if(ratio > RANSAC_ELIMINATION_RATIO)
-          epsilon = powf(10.0f, log10(epsilon) + epsilon_step);
-#ifdef ASHIFT_DEBUG
-        printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
-#endif
-        // reduce step-size for next optimization round
-        epsilon_step /= 2.0f;
-        lines_eliminated = 0;
-        valid_runs = 0;
+        best_quality = qualities[r];
+        best_run = r;
       }
+    dt_free(qualities);
+
+    if(best_run >= 0)
+    {
+      shuffle(best_set, index_set, set_count, first_seed + best_run);
+      float quality = 0.0f;
+      (void)ransac_model(lines, best_set, best_inout, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax,
+                         &quality, &eliminated);
     }
-    else
+  }
+  else
+  {
+    // go for complete permutations on small set sizes: there are at most RANSAC_HURDLE!
+    // of them, not worth a thread each
+    const int riter = fact(set_count);
+
+    // some data needed for quickperm
+    int perm[RANSAC_HURDLE + 1];
+    for(int n = 0; n < set_count + 1; n++) perm[n] = n;
+    int piter = 1;
+
+    memcpy(set, index_set, set_size);
+    for(int r = 0; r < riter; r++)
     {
-      // in the "real" runs check against the best model found so far
-      if(quality > best_quality)
+      (void)quickperm(set, perm, set_count, &piter);
+
+      float quality = 0.0f;
+      if(ransac_model(lines, set, inout, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax, &quality,
+                      &eliminated)
+         && quality > best_quality)
       {
-        memcpy(best_set, index_set, set_size);
+        memcpy(best_set, set, set_size);
         memcpy(best_inout, inout, set_size);
         best_quality = quality;
       }
     }
+  }
 
 #ifdef ASHIFT_DEBUG
-    // report some statistics
-    int count = 0, lastcount = 0;
-    for(int n = 0; n < set_count; n++) count += best_inout[n];
-    for(int n = 0; n < set_count; n++) lastcount += inout[n];
-    printf("ransac run %d: best qual %.6f, eps %.6f, line count %d of %d (this run: qual %.5f, count %d (%2f%%))\n", r,
-           best_quality, epsilon, count, set_count, quality, lastcount, 100.0f * lastcount / (float)set_count);
+  int count = 0;
+  for(int n = 0; n < set_count; n++) count += best_inout[n];
+  printf("ransac: best qual %.6f, eps %.6f, line count %d of %d\n", best_quality, epsilon, count, set_count);
 #endif
-  }
 
   // store back best set
   memcpy(index_set, best_set, set_size);
   memcpy(inout_set, best_inout, set_size);
 
+end:
   dt_free(inout);
-  dt_free(perm);
+  dt_free(set);
   dt_free(best_inout);
   dt_free(best_set);
 }
 
 
-// try to clean up structural data by eliminating outliers and thereby increasing
-// the chance of a convergent fitting
-static int _remove_outliers(dt_iop_module_t *module)
+// select the lines of one direction that ransac() keeps, return how many
+static int _select_ransac_lines(dt_iop_ashift_structure_t *s, int *lines_set, int *inout_set,
+                                const dt_iop_ashift_linetype_t direction, const float total_weight)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(module);
-
-  const int width = g->lines_in_width;
-  const int height = g->lines_in_height;
-  const int xmin = g->lines_x_off;
-  const int ymin = g->lines_y_off;
-  const int xmax = xmin + width;
-  const int ymax = ymin + height;
-
-  // holds the index set of lines we want to work on
-  int *lines_set = malloc(sizeof(int) * g->lines_count);
-  // holds the result of ransac
-  int *inout_set = malloc(sizeof(int) * g->lines_count);
-
-  // some accounting variables
-  int vnb = 0, vcount = 0;
-  int hnb = 0, hcount = 0;
-
-  // just to be on the safe side
-  if(IS_NULL_PTR(g->lines)) goto error;
+  const int xmin = s->x_off;
+  const int ymin = s->y_off;
+  const int xmax = xmin + s->width;
+  const int ymax = ymin + s->height;
 
-  // generate index list for the vertical lines
-  for(int n = 0; n < g->lines_count; n++)
+  // generate index list for the lines of this direction
+  int nb = 0;
+  for(int n = 0; n < s->lines_count; n++)
   {
-    // is this a selected vertical line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_VERTICAL_SELECTED)
+    // is this a selected line of this direction?
+    if((s->lines[n].type & ASHIFT_LINE_MASK) != direction)
       continue;
 
-    lines_set[vnb] = n;
-    inout_set[vnb] = 0;
-    vnb++;
+    lines_set[nb] = n;
+    inout_set[nb] = 0;
+    nb++;
   }
 
   // it only makes sense to call ransac if we have more than two lines
-  if(vnb > 2)
-    ransac(g->lines, lines_set, inout_set, vnb, g->vertical_weight,
-           xmin, xmax, ymin, ymax);
+  if(nb > 2)
+    ransac(s->lines, lines_set, inout_set, nb, total_weight, xmin, xmax, ymin, ymax);
 
   // adjust line selected flag according to the ransac results
-  for(int n = 0; n < vnb; n++)
+  int count = 0;
+  for(int n = 0; n < nb; n++)
   {
     const int m = lines_set[n];
     if(inout_set[n] == 1)
     {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
-      vcount++;
+      s->lines[m].type |= ASHIFT_LINE_SELECTED;
+      count++;
     }
     else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+      s->lines[m].type &= ~ASHIFT_LINE_SELECTED;
   }
-  // update number of vertical lines
-  g->vertical_count = vcount;
-  g->lines_version++;
-
-  // now generate index list for the horizontal lines
-  for(int n = 0; n < g->lines_count; n++)
-  {
-    // is this a selected horizontal line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_HORIZONTAL_SELECTED)
-      continue;
+  return count;
+}
 
-    lines_set[hnb] = n;
-    inout_set[hnb] = 0;
-    hnb++;
-  }
+// try to clean up structural data by eliminating outliers and thereby increasing
+// the chance of a convergent fitting
+static int _remove_structure_outliers(dt_iop_ashift_structure_t *s)
+{
+  // just to be on the safe side
+  if(IS_NULL_PTR(s->lines)) return FALSE;
 
-  // it only makes sense to call ransac if we have more than two lines
-  if(hnb > 2)
-    ransac(g->lines, lines_set, inout_set, hnb, g->horizontal_weight,
-           xmin, xmax, ymin, ymax);
+  // holds the index set of lines we want to work on
+  int *lines_set = malloc(sizeof(int) * s->lines_count);
+  // holds the result of ransac
+  int *inout_set = malloc(sizeof(int) * s->lines_count);
+  const gboolean success = !IS_NULL_PTR(lines_set) && !IS_NULL_PTR(inout_set);
 
-  // adjust line selected flag according to the ransac results
-  for(int n = 0; n < hnb; n++)
+  if(success)
   {
-    const int m = lines_set[n];
-    if(inout_set[n] == 1)
-    {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
-      hcount++;
-    }
-    else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+    s->vertical_count
+        = _select_ransac_lines(s, lines_set, inout_set, ASHIFT_LINE_VERTICAL_SELECTED, s->vertical_weight);
+    s->horizontal_count
+        = _select_ransac_lines(s, lines_set, inout_set, ASHIFT_LINE_HORIZONTAL_SELECTED, s->horizontal_weight);
   }
-  // update number of horizontal lines
-  g->horizontal_count = hcount;
-  g->lines_version++;
 
   dt_free(inout_set);
   dt_free(lines_set);
+  return success;
+}
 
-  return TRUE;
+static int _remove_outliers(dt_iop_module_t *module)
+{
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(module);
 
-error:
-  dt_free(inout_set);
-  dt_free(lines_set);
-  return FALSE;
+  dt_iop_ashift_structure_t structure = _gui_structure(g);
+  if(!_remove_structure_outliers(&structure)) return FALSE;
+
+  // update number of vertical and horizontal lines
+  g->vertical_count = structure.vertical_count;
+  g->horizontal_count = structure.horizontal_count;
+  g->lines_version++;
+  return TRUE;
 }
 
 // utility function to map a variable in [min; max] to [-INF; + INF]
@@ -2168,12 +2270,13 @@ static double model_fitness(double *params, void *data)
   return sum;
 }
 
-// setup all data structures for fitting and call NM simplex
-static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
+// setup all data structures for fitting the structure `s` and call NM simplex. `ranges` are
+// the bounds of rotation, vertical and horizontal lens shift and shear, in that order.
+static dt_iop_ashift_nmsresult_t _fit_structure(const dt_iop_ashift_structure_t *s, const float ranges[4],
+                                                const int isflipped, dt_iop_ashift_params_t *p,
+                                                dt_iop_ashift_fitaxis_t dir)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(module);
-
-  if(IS_NULL_PTR(g->lines)) return NMS_NOT_ENOUGH_LINES;
+  if(IS_NULL_PTR(s->lines)) return NMS_NOT_ENOUGH_LINES;
   if(dir == ASHIFT_FIT_NONE) return NMS_SUCCESS;
 
   double params[4];
@@ -2182,10 +2285,10 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
 
   // initialize fit parameters
   dt_iop_ashift_fit_params_t fit;
-  fit.lines = g->lines;
-  fit.lines_count = g->lines_count;
-  fit.width = g->lines_in_width;
-  fit.height = g->lines_in_height;
+  fit.lines = s->lines;
+  fit.lines_count = s->lines_count;
+  fit.width = s->width;
+  fit.height = s->height;
   fit.f_length_kb = (p->mode == ASHIFT_MODE_GENERIC) ? DEFAULT_F_LENGTH : p->f_length * p->crop_factor;
   fit.orthocorr = (p->mode == ASHIFT_MODE_GENERIC) ? 0.0f : p->orthocorr;
   fit.aspect = (p->mode == ASHIFT_MODE_GENERIC) ? 1.0f : p->aspect;
@@ -2193,10 +2296,10 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   fit.lensshift_v = p->lensshift_v;
   fit.lensshift_h = p->lensshift_h;
   fit.shear = p->shear;
-  fit.rotation_range = g->rotation_range;
-  fit.lensshift_v_range = g->lensshift_v_range;
-  fit.lensshift_h_range = g->lensshift_h_range;
-  fit.shear_range = g->shear_range;
+  fit.rotation_range = ranges[0];
+  fit.lensshift_v_range = ranges[1];
+  fit.lensshift_h_range = ranges[2];
+  fit.shear_range = ranges[3];
   fit.linetype = ASHIFT_LINE_RELEVANT | ASHIFT_LINE_SELECTED;
   fit.linemask = ASHIFT_LINE_MASK;
   fit.params_count = 0;
@@ -2209,7 +2312,7 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
      (mdir & ASHIFT_FIT_LENS_BOTH) != 0)
   {
     // flip all directions
-    mdir ^= g->isflipped ? ASHIFT_FIT_FLIP : 0;
+    mdir ^= isflipped ? ASHIFT_FIT_FLIP : 0;
     // special case that needs to be corrected
     mdir |= (mdir & ASHIFT_FIT_LINES_BOTH) == 0 ? ASHIFT_FIT_LINES_BOTH : 0;
   }
@@ -2260,16 +2363,16 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   {
     // we use vertical lines for fitting
     fit.linetype |= ASHIFT_LINE_DIRVERT;
-    fit.weight += g->vertical_weight;
-    enough_lines = enough_lines && (g->vertical_count >= MINIMUM_FITLINES);
+    fit.weight += s->vertical_weight;
+    enough_lines = enough_lines && (s->vertical_count >= MINIMUM_FITLINES);
   }
 
   if(mdir & ASHIFT_FIT_LINES_HOR)
   {
     // we use horizontal lines for fitting
     fit.linetype |= 0;
-    fit.weight += g->horizontal_weight;
-    enough_lines = enough_lines && (g->horizontal_count >= MINIMUM_FITLINES);
+    fit.weight += s->horizontal_weight;
+    enough_lines = enough_lines && (s->horizontal_count >= MINIMUM_FITLINES);
   }
 
   // this needs to come after ASHIFT_FIT_LINES_VERT and ASHIFT_FIT_LINES_HOR
@@ -2354,6 +2457,15 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   return NMS_SUCCESS;
 }
 
+static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
+{
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(module);
+
+  const dt_iop_ashift_structure_t structure = _gui_structure(g);
+  const float ranges[4] = { g->rotation_range, g->lensshift_v_range, g->lensshift_h_range, g->shear_range };
+  return _fit_structure(&structure, ranges, g->isflipped, p, dir);
+}
+
 #ifdef ASHIFT_DEBUG
 // only used in development phase. call model_fitness() with current parameters and
 // print some useful information
@@ -2526,57 +2638,10 @@ static double crop_fitness(double *params, void *data)
 // we calculate the largest crop area that still lies within the output image;
 // now we allow a Nelder-Mead simplex to search for the center coordinates
 // (and optionally the aspect angle) that delivers the largest overall crop area.
-static void do_crop(dt_iop_module_t *self, dt_iop_ashift_params_t *p)
+// crop_width x crop_height is ashift's full (uncropped) input size. Returns FALSE, margins
+// untouched, if the fit failed.
+static gboolean _fit_crop(dt_iop_ashift_params_t *p, const int crop_width, const int crop_height)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(self);
-
-  // Resetting the crop does not depend on pipeline geometry. Do it before looking up buf_in so
-  // "off" also works during initialization or after a cache-only preview pass.
-  if(p->cropmode == ASHIFT_CROP_OFF)
-  {
-    _clear_crop_box(p);
-    g->grid_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
-    if(g->editing)
-    {
-      dt_geometry_chain_rebuild(self->dev);
-      dt_dev_get_thumbnail_size(self->dev);
-      dt_dev_pixelpipe_resync_history_all(self->dev);
-    }
-    return;
-  }
-
-  // Auto-crop is a purely geometric fit: it only needs ashift's *full* (uncropped) input size, not
-  // pixel data. Read it from the geometry record, which is GUI-thread state and remains available
-  // when the preview worker exact-hits downstream cache entries without running ashift's process()
-  // to populate g->buf. ashift's roi_in is crop-dependent, while buf_in is the
-  // stable full input geometry required by the fit.
-  int crop_width = 0, crop_height = 0;
-  dt_iop_roi_t crop_in;
-  if(dt_dev_module_geometry_gui(self->dev, self, &crop_in, NULL) && crop_in.width > 0 && crop_in.height > 0)
-  {
-    crop_width = crop_in.width;
-    crop_height = crop_in.height;
-  }
-  else
-  {
-    // Fall back to the captured buffer size if the preview geometry is not ready yet.
-    crop_width = g->buf_width;
-    crop_height = g->buf_height;
-  }
-
-  // if sizes are not ready (module disabled / preview not computed yet), just ignore this
-  if(crop_width == 0 || crop_height == 0) return;
-
-  // skip if fitting is still running
-  if(g->fitting) return;
-
-  // Changing the crop changes the output geometry and thus where the control-line overlay lands.
-  // Drop the overlay's cached screen coordinates so gui_post_expose() recomputes them against the
-  // virtual-pipe geometry that the resync below makes current (#710 overlay lag).
-  g->grid_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
-
-  g->fitting = 1;
-
   double params[3];
   int pcount;
 
@@ -2667,7 +2732,7 @@ static void do_crop(dt_iop_module_t *self, dt_iop_ashift_params_t *p)
   const int iter = simplex(crop_fitness, params, pcount, crop_epsilon, NMS_CROP_SCALE, NMS_CROP_ITERATIONS,
                            crop_constraint, (void*)&cropfit);
   // in case the fit did not converge -> failed
-  if(iter >= NMS_CROP_ITERATIONS) goto failed;
+  if(iter >= NMS_CROP_ITERATIONS) return FALSE;
 
   // the fit did converge -> get clipping margins out of params:
   cropfit.x = isnan(cropfit.x) ? params[0] : cropfit.x;
@@ -2678,7 +2743,7 @@ static void do_crop(dt_iop_module_t *self, dt_iop_ashift_params_t *p)
   const float A = fabs(crop_fitness(params, (void*)&cropfit));
 
   // unlikely to happen but we need to catch this case
-  if(A == 0.0f) goto failed;
+  if(A == 0.0f) return FALSE;
 
   // we need the half diagonal of that rectangle (this is in output image dimensions);
   // no need to check for division by zero here as this case implies A == 0.0f, caught above
@@ -2694,40 +2759,97 @@ static void do_crop(dt_iop_module_t *self, dt_iop_ashift_params_t *p)
   P[1] /= P[2];
 
   // calculate clipping margins relative to output image dimensions
-  p->cl = CLAMP((P[0] - d * cosf(cropfit.alpha)) / owd, 0.0f, 1.0f);
-  p->cr = CLAMP((P[0] + d * cosf(cropfit.alpha)) / owd, 0.0f, 1.0f);
-  p->ct = CLAMP((P[1] - d * sinf(cropfit.alpha)) / oht, 0.0f, 1.0f);
-  p->cb = CLAMP((P[1] + d * sinf(cropfit.alpha)) / oht, 0.0f, 1.0f);
+  const float cl = CLAMP((P[0] - d * cosf(cropfit.alpha)) / owd, 0.0f, 1.0f);
+  const float cr = CLAMP((P[0] + d * cosf(cropfit.alpha)) / owd, 0.0f, 1.0f);
+  const float ct = CLAMP((P[1] - d * sinf(cropfit.alpha)) / oht, 0.0f, 1.0f);
+  const float cb = CLAMP((P[1] + d * sinf(cropfit.alpha)) / oht, 0.0f, 1.0f);
 
   // final sanity check
-  if(p->cr - p->cl <= 0.0f || p->cb - p->ct <= 0.0f) goto failed;
+  if(cl >= cr || ct >= cb) return FALSE;
 
-  g->fitting = 0;
+  p->cl = cl;
+  p->cr = cr;
+  p->ct = ct;
+  p->cb = cb;
 
 #ifdef ASHIFT_DEBUG
   printf("margins after crop fitting: iter %d, x %f, y %f, angle %f, crop area (%f %f %f %f), width %f, height %f\n",
          iter, cropfit.x, cropfit.y, cropfit.alpha, p->cl, p->cr, p->ct, p->cb, wd, ht);
 #endif
+  return TRUE;
+}
 
-  if(g->editing)
+static void do_crop(dt_iop_module_t *self, dt_iop_ashift_params_t *p)
+{
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)dt_iop_gui_data(self);
+
+  // Resetting the crop does not depend on pipeline geometry. Do it before looking up buf_in so
+  // "off" also works during initialization or after a cache-only preview pass.
+  if(p->cropmode == ASHIFT_CROP_OFF)
   {
-    dt_geometry_chain_rebuild(self->dev);
-    dt_dev_get_thumbnail_size(self->dev);
-    dt_dev_pixelpipe_resync_history_all(self->dev);
+    _clear_crop_box(p);
+    g->grid_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
+    if(g->editing)
+    {
+      dt_geometry_chain_rebuild(self->dev);
+      dt_dev_get_thumbnail_size(self->dev);
+      dt_dev_pixelpipe_resync_history_all(self->dev);
+    }
+    return;
   }
-  return;
 
-failed:
+  // Auto-crop is a purely geometric fit: it only needs ashift's *full* (uncropped) input size, not
+  // pixel data. Read it from the geometry record, which is GUI-thread state and remains available
+  // when the preview worker exact-hits downstream cache entries without running ashift's process()
+  // to populate g->buf. ashift's roi_in is crop-dependent, while buf_in is the
+  // stable full input geometry required by the fit.
+  int crop_width = 0, crop_height = 0;
+  dt_iop_roi_t crop_in;
+  if(dt_dev_module_geometry_gui(self->dev, self, &crop_in, NULL) && crop_in.width > 0 && crop_in.height > 0)
+  {
+    crop_width = crop_in.width;
+    crop_height = crop_in.height;
+  }
+  else
+  {
+    // Fall back to the captured buffer size if the preview geometry is not ready yet.
+    crop_width = g->buf_width;
+    crop_height = g->buf_height;
+  }
+
+  // if sizes are not ready (module disabled / preview not computed yet), just ignore this
+  if(crop_width == 0 || crop_height == 0) return;
+
+  // skip if fitting is still running
+  if(g->fitting) return;
+
+  // Changing the crop changes the output geometry and thus where the control-line overlay lands.
+  // Drop the overlay's cached screen coordinates so gui_post_expose() recomputes them against the
+  // virtual-pipe geometry that the resync below makes current (#710 overlay lag).
+  g->grid_hash = DT_PIXELPIPE_CACHE_HASH_INVALID;
+
+  g->fitting = 1;
+
+  const gboolean success = _fit_crop(p, crop_width, crop_height);
   g->fitting = 0;
 
-  // At rotation/lensshift (0,0,0) the target crop is trivially the full image regardless of
-  // whether the simplex formally reports convergence, so a non-convergence here is not worth
-  // reporting as a failure.
-  const gboolean identity_transform = (p->rotation == 0.0f && p->lensshift_v == 0.0f && p->lensshift_h == 0.0f);
-  if(!identity_transform)
-    dt_control_log(_("Automatic cropping failed. Keeping previous margins."));
+  if(!success)
+  {
+    // At rotation/lensshift (0,0,0) the target crop is trivially the full image regardless of
+    // whether the simplex formally reports convergence, so a non-convergence here is not worth
+    // reporting as a failure.
+    const gboolean identity_transform = (p->rotation == 0.0f && p->lensshift_v == 0.0f && p->lensshift_h == 0.0f);
+    if(!identity_transform)
+      dt_control_log(_("Automatic cropping failed. Keeping previous margins."));
+    return;
+  }
 
-  return;
+  if(g->editing)
+  {
+    dt_geometry_chain_rebuild(self->dev);
+    dt_dev_get_thumbnail_size(self->dev);
+    dt_dev_pixelpipe_resync_history_all(self->dev);
+  }
 }
 
 // determine if the line is vertical or horizontal
@@ -3175,6 +3297,127 @@ static void do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_as
   dt_gui_freeze_end();
 }
 
+/**
+ * @brief Fit rotation, lens shift and shear on the structure of the module input, then the crop,
+ * as the "fit both" button does in the default fitting mode.
+ *
+ * @details Everything happens on local structure data, the GUI one is left alone: this runs
+ * from darkroom autoset and from the headless "auto-fit perspective" job, whose pipelines have
+ * no GUI. Both lens shifts are fitted, so whether the output is flipped does not matter. On
+ * failure the parameters are left as they were.
+ */
+void autoset(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe,
+             const struct dt_dev_pixelpipe_iop_t *piece, const void *i)
+{
+  if(piece->dsc_in.channels != 4) return;
+
+  const dt_iop_roi_t *const roi_in = &piece->roi_in;
+  if(roi_in->width <= 0 || roi_in->height <= 0 || piece->buf_in.width <= 0 || piece->buf_in.height <= 0) return;
+
+  // line_detect() works in place, the input belongs to the pipeline cache
+  float *buffer = malloc(sizeof(float) * 4 * (size_t)roi_in->width * roi_in->height);
+  if(IS_NULL_PTR(buffer)) return;
+  dt_iop_image_copy_by_size(buffer, (const float *)i, roi_in->width, roi_in->height, 4);
+
+  const float scale = 0.5f * ((float)roi_in->width / (float)piece->buf_in.width
+                              + (float)roi_in->height / (float)piece->buf_in.height);
+  const gboolean raw_origin = dt_image_needs_rawprepare(&pipe->dev->image_storage);
+
+  dt_iop_ashift_structure_t structure = { 0 };
+  const int detected = _detect_structure(buffer, roi_in->width, roi_in->height, roi_in->x, roi_in->y, scale,
+                                         ASHIFT_ENHANCE_NONE, raw_origin, &structure);
+  dt_free(buffer);
+  if(!detected) return;
+
+  dt_iop_ashift_params_t *p = (dt_iop_ashift_params_t *)self->params;
+  dt_iop_ashift_params_t fitted = *p;
+  const float ranges[4] = { ROTATION_RANGE_SOFT, LENSSHIFT_RANGE_SOFT, LENSSHIFT_RANGE_SOFT, SHEAR_RANGE_SOFT };
+
+  if(_remove_structure_outliers(&structure)
+     && _fit_structure(&structure, ranges, FALSE, &fitted, ASHIFT_FIT_BOTH_SHEAR) == NMS_SUCCESS)
+  {
+    if(fitted.cropmode == ASHIFT_CROP_OFF)
+      _clear_crop_box(&fitted);
+    else
+      (void)_fit_crop(&fitted, piece->buf_in.width, piece->buf_in.height);
+    *p = fitted;
+  }
+
+  dt_iop_fmt_log(self, "autoset: %d lines, %d vertical, %d horizontal kept", structure.lines_count,
+                 structure.vertical_count, structure.horizontal_count);
+  dt_free(structure.lines);
+}
+
+// The preview pipe keeps a copy of the input of process() for the fitting in the GUI.
+static gboolean _ashift_collects_preview(const struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
+                                         const dt_iop_roi_t *const roi_out)
+{
+  return !IS_NULL_PTR(dt_iop_gui_data(self)) && self->dev->gui_attached && pipe == self->dev->preview_pipe
+         && dt_dev_pixelpipe_has_preview_output(self->dev, pipe, roi_out);
+}
+
+// Inverse homography and clipping offset, derived once for all the points.
+typedef struct dt_iop_ashift_sampling_t
+{
+  float ihomograph[3][3];
+  float cx, cy;
+} dt_iop_ashift_sampling_t;
+
+static void _ashift_sampling_init(const dt_iop_ashift_data_t *const data, const dt_dev_pixelpipe_iop_t *piece,
+                                  dt_iop_ashift_sampling_t *s)
+{
+  homography((float *)s->ihomograph, data->rotation, data->lensshift_v, data->lensshift_h, data->shear,
+             data->f_length_kb, data->orthocorr, data->aspect, piece->buf_in.width, piece->buf_in.height,
+             ASHIFT_HOMOGRAPH_INVERTED);
+
+  // clipping offset
+  const float fullwidth = (float)piece->buf_out.width / (data->cr - data->cl);
+  const float fullheight = (float)piece->buf_out.height / (data->cb - data->ct);
+  s->cx = piece->roi_out.scale * fullwidth * data->cl;
+  s->cy = piece->roi_out.scale * fullheight * data->ct;
+}
+
+// Where process() samples its input for the output pixel (i, j), both relative to their buffer.
+static inline void _ashift_sample_point(const dt_iop_ashift_sampling_t *const s, const dt_iop_roi_t *const roi_in,
+                                        const dt_iop_roi_t *const roi_out, const float i, const float j,
+                                        float *const po)
+{
+  float pin[3], pout[3];
+
+  // convert output pixel coordinates to original image coordinates
+  pout[0] = roi_out->x + i + s->cx;
+  pout[1] = roi_out->y + j + s->cy;
+  pout[0] /= roi_out->scale;
+  pout[1] /= roi_out->scale;
+  pout[2] = 1.0f;
+
+  // apply homograph
+  mat3mulv(pin, (const float *)s->ihomograph, pout);
+
+  // convert to input pixel coordinates
+  pin[0] /= pin[2];
+  pin[1] /= pin[2];
+  pin[0] *= roi_in->scale;
+  pin[1] *= roi_in->scale;
+  po[0] = pin[0] - roi_in->x;
+  po[1] = pin[1] - roi_in->y;
+}
+
+int resample_points(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
+                    const dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
+{
+  const dt_iop_ashift_data_t *const data = (dt_iop_ashift_data_t *)piece->data;
+  if(_ashift_collects_preview(self, pipe, &piece->roi_out)) return DT_GEOMETRY_STAGE_NONE;
+  if(isneutral(data)) return DT_GEOMETRY_STAGE_COPY;
+
+  dt_iop_ashift_sampling_t s;
+  _ashift_sampling_init(data, piece, &s);
+  __OMP_PARALLEL_FOR__(if(points_count > 100))
+  for(size_t k = 0; k < points_count * 2; k += 2)
+    _ashift_sample_point(&s, &piece->roi_in, &piece->roi_out, points[k], points[k + 1], points + k);
+  return DT_GEOMETRY_STAGE_RESAMPLE;
+}
+
 __DT_CLONE_TARGETS__
 int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid)
@@ -3188,9 +3431,7 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
   const int ch_width = ch * roi_in->width;
 
   // only for preview pipe: collect input buffer data and do some other evaluations
-  if(!IS_NULL_PTR(g) && self->dev->gui_attached
-     && pipe == self->dev->preview_pipe
-     && dt_dev_pixelpipe_has_preview_output(self->dev, pipe, roi_out))
+  if(_ashift_collects_preview(self, pipe, roi_out))
   {
     // we want to find out if the final output image is flipped in relation to this iop
     // so we can adjust the gui labels accordingly
@@ -3281,15 +3522,8 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
 
   const struct dt_interpolation *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
 
-  float ihomograph[3][3];
-  homography((float *)ihomograph, data->rotation, data->lensshift_v, data->lensshift_h, data->shear, data->f_length_kb,
-             data->orthocorr, data->aspect, piece->buf_in.width, piece->buf_in.height, ASHIFT_HOMOGRAPH_INVERTED);
-
-  // clipping offset
-  const float fullwidth = (float)piece->buf_out.width / (data->cr - data->cl);
-  const float fullheight = (float)piece->buf_out.height / (data->cb - data->ct);
-  const float cx = roi_out->scale * fullwidth * data->cl;
-  const float cy = roi_out->scale * fullheight * data->ct;
+  dt_iop_ashift_sampling_t s;
+  _ashift_sampling_init(data, piece, &s);
   __OMP_PARALLEL_FOR__()
   // go over all pixels of output image
   for(int j = 0; j < roi_out->height; j++)
@@ -3297,25 +3531,8 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
     float *const restrict out = ((float *)ovoid) + (size_t)ch * j * roi_out->width;
     for(int i = 0; i < roi_out->width; i++)
     {
-      float pin[3], pout[3];
-
-      // convert output pixel coordinates to original image coordinates
-      pout[0] = roi_out->x + i + cx;
-      pout[1] = roi_out->y + j + cy;
-      pout[0] /= roi_out->scale;
-      pout[1] /= roi_out->scale;
-      pout[2] = 1.0f;
-
-      // apply homograph
-      mat3mulv(pin, (float *)ihomograph, pout);
-
-      // convert to input pixel coordinates
-      pin[0] /= pin[2];
-      pin[1] /= pin[2];
-      pin[0] *= roi_in->scale;
-      pin[1] *= roi_in->scale;
-      pin[0] -= roi_in->x;
-      pin[1] -= roi_in->y;
+      float pin[2];
+      _ashift_sample_point(&s, roi_in, roi_out, i, j, pin);
 
       // get output values by interpolation from input image
       dt_interpolation_compute_pixel4c(interpolation, (float *)ivoid, out + ch*i, pin[0], pin[1], roi_in->width,
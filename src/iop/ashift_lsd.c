@@ -656,9 +656,11 @@ static image_double gaussian_sampler( image_double in, double scale,
 {
   image_double aux,out;
   ntuple_list kernel;
-  unsigned int N,M,h,n,x,y,i;
-  int xc,yc,j,double_x_size,double_y_size;
-  double sigma,xx,yy,sum,prec;
+  unsigned int N,M,h,n,x,y;
+  int double_x_size,double_y_size;
+  double sigma,xx,yy,prec;
+  double *xkernels,*ykernels;
+  int *xcs,*ycs;
 
   /* check parameters */
   if( IS_NULL_PTR(in) || IS_NULL_PTR(in->data) || in->xsize == 0 || in->ysize == 0 )
@@ -695,8 +697,20 @@ static image_double gaussian_sampler( image_double in, double scale,
   double_x_size = (int) (2 * in->xsize);
   double_y_size = (int) (2 * in->ysize);
 
-  /* First subsampling: x axis */
-  for(x=0;x<aux->xsize;x++)
+  /* The kernel must be computed for each output column and each output
+     row, because the fine offset between the sample and the pixel grid
+     is different in each case. It does not depend on anything else, so
+     all of them are computed first; both passes then filter rows
+     independently of each other and run in parallel, with the same
+     sums in the same order as one row at a time. */
+  xkernels = (double *) malloc( (size_t) N * n * sizeof(double) );
+  ykernels = (double *) malloc( (size_t) M * n * sizeof(double) );
+  xcs = (int *) malloc( (size_t) N * sizeof(int) );
+  ycs = (int *) malloc( (size_t) M * sizeof(int) );
+  if( IS_NULL_PTR(xkernels) || IS_NULL_PTR(ykernels) || IS_NULL_PTR(xcs) || IS_NULL_PTR(ycs) )
+    error("not enough memory.");
+
+  for(x=0;x<N;x++)
     {
       /*
          x   is the coordinate in the new image.
@@ -706,64 +720,69 @@ static image_double gaussian_sampler( image_double in, double scale,
       xx = (double) x / scale;
       /* coordinate (0.0,0.0) is in the center of pixel (0,0),
          so the pixel with xc=0 get the values of xx from -0.5 to 0.5 */
-      xc = (int) floor( xx + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + xx - (double) xc );
-      /* the kernel must be computed for each x because the fine
-         offset xx-xc is different in each case */
+      xcs[x] = (int) floor( xx + 0.5 );
+      gaussian_kernel( kernel, sigma, (double) h + xx - (double) xcs[x] );
+      memcpy( xkernels + (size_t) x * n, kernel->values, n * sizeof(double) );
+    }
 
-      for(y=0;y<aux->ysize;y++)
-        {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
-            {
-              j = xc - h + i;
+  for(y=0;y<M;y++)
+    {
+      /* same as above, for y */
+      yy = (double) y / scale;
+      ycs[y] = (int) floor( yy + 0.5 );
+      gaussian_kernel( kernel, sigma, (double) h + yy - (double) ycs[y] );
+      memcpy( ykernels + (size_t) y * n, kernel->values, n * sizeof(double) );
+    }
 
-              /* symmetry boundary condition */
-              while( j < 0 ) j += double_x_size;
-              while( j >= double_x_size ) j -= double_x_size;
-              if( j >= (int) in->xsize ) j = double_x_size-1-j;
+  /* First subsampling: x axis */
+  __OMP_PARALLEL_FOR__()
+  for(y=0;y<aux->ysize;y++)
+    for(unsigned int xo=0;xo<aux->xsize;xo++)
+      {
+        const double *const values = xkernels + (size_t) xo * n;
+        double sum = 0.0;
+        for(unsigned int i=0;i<n;i++)
+          {
+            int j = xcs[xo] - h + i;
 
-              sum += in->data[ j + y * in->xsize ] * kernel->values[i];
-            }
-          aux->data[ x + y * aux->xsize ] = sum;
-        }
-    }
+            /* symmetry boundary condition */
+            while( j < 0 ) j += double_x_size;
+            while( j >= double_x_size ) j -= double_x_size;
+            if( j >= (int) in->xsize ) j = double_x_size-1-j;
+
+            sum += in->data[ j + y * in->xsize ] * values[i];
+          }
+        aux->data[ xo + y * aux->xsize ] = sum;
+      }
 
   /* Second subsampling: y axis */
+  __OMP_PARALLEL_FOR__()
   for(y=0;y<out->ysize;y++)
     {
-      /*
-         y   is the coordinate in the new image.
-         yy  is the corresponding x-value in the original size image.
-         yc  is the integer value, the pixel coordinate of xx.
-       */
-      yy = (double) y / scale;
-      /* coordinate (0.0,0.0) is in the center of pixel (0,0),
-         so the pixel with yc=0 get the values of yy from -0.5 to 0.5 */
-      yc = (int) floor( yy + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + yy - (double) yc );
-      /* the kernel must be computed for each y because the fine
-         offset yy-yc is different in each case */
-
-      for(x=0;x<out->xsize;x++)
+      const double *const values = ykernels + (size_t) y * n;
+      for(unsigned int xo=0;xo<out->xsize;xo++)
         {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
+          double sum = 0.0;
+          for(unsigned int i=0;i<n;i++)
             {
-              j = yc - h + i;
+              int j = ycs[y] - h + i;
 
               /* symmetry boundary condition */
               while( j < 0 ) j += double_y_size;
               while( j >= double_y_size ) j -= double_y_size;
               if( j >= (int) in->ysize ) j = double_y_size-1-j;
 
-              sum += aux->data[ x + j * aux->xsize ] * kernel->values[i];
+              sum += aux->data[ xo + j * aux->xsize ] * values[i];
             }
-          out->data[ x + y * out->xsize ] = sum;
+          out->data[ xo + y * out->xsize ] = sum;
         }
     }
 
   /* free memory */
+  dt_free(xkernels);
+  dt_free(ykernels);
+  dt_free(xcs);
+  dt_free(ycs);
   free_ntuple_list(kernel);
   free_image_double(aux);
 
@@ -843,9 +862,11 @@ static image_double ll_angle( image_double in, double threshold,
   for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF;
   for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF;
 
-  /* compute gradient on the remaining pixels */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+  /* compute gradient on the remaining pixels. Each pixel only reads the
+     input, so rows run in parallel and only the maximum is reduced */
+  __OMP_PARALLEL_FOR__(reduction(max:max_grad))
+  for(y=0;y<n-1;y++)
+    for(x=0;x<p-1;x++)
       {
         adr = y*p+x;
 
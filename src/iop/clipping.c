@@ -81,6 +81,7 @@
 #include "common/module_versioning.h"
 #include "common/image.h"
 #include "common/imagebuf.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "math/math.h"
 #include "common/conf.h"
@@ -1010,6 +1011,90 @@ void modify_roi_in(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t
   roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(scheight) - roi_in->y);
 }
 
+// Keystone correction at the scale of the input, derived once for all the points.
+typedef struct dt_iop_clipping_sampling_t
+{
+  dt_boundingbox_t k_space;
+  float kxa, kya;
+  float ma, mb, md, me, mg, mh;
+} dt_iop_clipping_sampling_t;
+
+// Rotation and keystone are off and the crop is in roi_in already: process() copies.
+static gboolean _clipping_is_copy(const dt_iop_clipping_data_t *const d, const dt_iop_roi_t *const roi_in,
+                                  const dt_iop_roi_t *const roi_out)
+{
+  return !d->flags && d->angle == 0.0 && d->all_off && roi_in->width == roi_out->width
+         && roi_in->height == roi_out->height;
+}
+
+static void _clipping_sampling_init(const dt_iop_clipping_data_t *const d, const dt_dev_pixelpipe_iop_t *piece,
+                                    dt_iop_clipping_sampling_t *s)
+{
+  const float rx = piece->buf_in.width * piece->roi_in.scale;
+  const float ry = piece->buf_in.height * piece->roi_in.scale;
+  s->k_space[0] = d->k_space[0] * rx;
+  s->k_space[1] = d->k_space[1] * ry;
+  s->k_space[2] = d->k_space[2] * rx;
+  s->k_space[3] = d->k_space[3] * ry;
+  const float kxa = d->kxa * rx, kxb = d->kxb * rx, kxc = d->kxc * rx, kxd = d->kxd * rx;
+  const float kya = d->kya * ry, kyb = d->kyb * ry, kyc = d->kyc * ry, kyd = d->kyd * ry;
+  s->kxa = kxa;
+  s->kya = kya;
+  s->ma = s->mb = s->md = s->me = s->mg = s->mh = 0.0f;
+  if(d->k_apply == 1)
+    keystone_get_matrix(s->k_space, kxa, kxb, kxc, kxd, kya, kyb, kyc, kyd, &s->ma, &s->mb, &s->md, &s->me,
+                        &s->mg, &s->mh);
+}
+
+// Where process() samples its input for the output pixel (i, j), both relative to their buffer.
+static inline void _clipping_sample_point(const dt_iop_clipping_data_t *const d,
+                                          const dt_iop_clipping_sampling_t *const s,
+                                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                          const float i, const float j, float *const po)
+{
+  float pi[2];
+
+  pi[0] = roi_out->x - roi_out->scale * d->enlarge_x + roi_out->scale * d->cix + i + 0.5f;
+  pi[1] = roi_out->y - roi_out->scale * d->enlarge_y + roi_out->scale * d->ciy + j + 0.5f;
+
+  // transform this point using matrix m
+  if(d->flip)
+  {
+    pi[1] -= d->tx * roi_out->scale;
+    pi[0] -= d->ty * roi_out->scale;
+  }
+  else
+  {
+    pi[0] -= d->tx * roi_out->scale;
+    pi[1] -= d->ty * roi_out->scale;
+  }
+  pi[0] /= roi_out->scale;
+  pi[1] /= roi_out->scale;
+  backtransform(pi, po, d->m, d->k_h, d->k_v);
+  po[0] *= roi_in->scale;
+  po[1] *= roi_in->scale;
+  po[0] += d->tx * roi_in->scale;
+  po[1] += d->ty * roi_in->scale;
+  if(d->k_apply == 1)
+    keystone_backtransform(po, s->k_space, s->ma, s->mb, s->md, s->me, s->mg, s->mh, s->kxa, s->kya);
+  po[0] -= roi_in->x + 0.5f;
+  po[1] -= roi_in->y + 0.5f;
+}
+
+int resample_points(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
+                    const dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
+{
+  const dt_iop_clipping_data_t *const d = (dt_iop_clipping_data_t *)piece->data;
+  if(_clipping_is_copy(d, &piece->roi_in, &piece->roi_out)) return DT_GEOMETRY_STAGE_COPY;
+
+  dt_iop_clipping_sampling_t s;
+  _clipping_sampling_init(d, piece, &s);
+  __OMP_PARALLEL_FOR__(if(points_count > 100))
+  for(size_t k = 0; k < points_count * 2; k += 2)
+    _clipping_sample_point(d, &s, &piece->roi_in, &piece->roi_out, points[k], points[k + 1], points + k);
+  return DT_GEOMETRY_STAGE_RESAMPLE;
+}
+
 // 3rd (final) pass: you get this input region (may be different from what was requested above),
 // do your best to fill the output region!
 __DT_CLONE_TARGETS__
@@ -1025,22 +1110,15 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
   const int ch_width = ch * roi_in->width;
 
   // only crop, no rot fast and sharp path:
-  if(!d->flags && d->angle == 0.0 && d->all_off && roi_in->width == roi_out->width
-     && roi_in->height == roi_out->height)
+  if(_clipping_is_copy(d, roi_in, roi_out))
   {
     dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
   }
   else
   {
     const struct dt_interpolation *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
-    const float rx = piece->buf_in.width * roi_in->scale;
-    const float ry = piece->buf_in.height * roi_in->scale;
-    const dt_boundingbox_t k_space = { d->k_space[0] * rx, d->k_space[1] * ry, d->k_space[2] * rx, d->k_space[3] * ry };
-    const float kxa = d->kxa * rx, kxb = d->kxb * rx, kxc = d->kxc * rx, kxd = d->kxd * rx;
-    const float kya = d->kya * ry, kyb = d->kyb * ry, kyc = d->kyc * ry, kyd = d->kyd * ry;
-    float ma = 0.0f, mb = 0.0f, md = 0.0f, me = 0.0f, mg = 0.0f, mh = 0.0f;
-    if(d->k_apply == 1)
-      keystone_get_matrix(k_space, kxa, kxb, kxc, kxd, kya, kyb, kyc, kyd, &ma, &mb, &md, &me, &mg, &mh);
+    dt_iop_clipping_sampling_t s;
+    _clipping_sampling_init(d, piece, &s);
     __OMP_PARALLEL_FOR__()
     // (slow) point-by-point transformation.
     // TODO: optimize with scanlines and linear steps between?
@@ -1049,33 +1127,8 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
       float *out = ((float *)ovoid) + (size_t)ch * j * roi_out->width;
       for(int i = 0; i < roi_out->width; i++)
       {
-        float pi[2], po[2];
-
-        pi[0] = roi_out->x - roi_out->scale * d->enlarge_x + roi_out->scale * d->cix + i + 0.5f;
-        pi[1] = roi_out->y - roi_out->scale * d->enlarge_y + roi_out->scale * d->ciy + j + 0.5f;
-
-        // transform this point using matrix m
-        if(d->flip)
-        {
-          pi[1] -= d->tx * roi_out->scale;
-          pi[0] -= d->ty * roi_out->scale;
-        }
-        else
-        {
-          pi[0] -= d->tx * roi_out->scale;
-          pi[1] -= d->ty * roi_out->scale;
-        }
-        pi[0] /= roi_out->scale;
-        pi[1] /= roi_out->scale;
-        backtransform(pi, po, d->m, d->k_h, d->k_v);
-        po[0] *= roi_in->scale;
-        po[1] *= roi_in->scale;
-        po[0] += d->tx * roi_in->scale;
-        po[1] += d->ty * roi_in->scale;
-        if(d->k_apply == 1) keystone_backtransform(po, k_space, ma, mb, md, me, mg, mh, kxa, kya);
-        po[0] -= roi_in->x + 0.5f;
-        po[1] -= roi_in->y + 0.5f;
-
+        float po[2];
+        _clipping_sample_point(d, &s, roi_in, roi_out, i, j, po);
         dt_interpolation_compute_pixel4c(interpolation, (float *)ivoid, out + ch*i, po[0], po[1], roi_in->width,
                                          roi_in->height, ch_width);
       }
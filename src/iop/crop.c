@@ -40,6 +40,7 @@
 #include "common/module_versioning.h"
 #include "common/image.h"
 #include "common/imagebuf.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "math/math.h"
 #include "common/opencl.h"
@@ -415,6 +416,16 @@ void modify_roi_in(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t
   roi_in->y = CLAMP(roi_in->y, 0, (int)floorf(ih));
 }
 
+// The crop is in roi_in already: process() copies its input as is.
+int resample_points(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
+                    const dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
+{
+  const dt_iop_roi_t *const roi_in = &piece->roi_in;
+  const dt_iop_roi_t *const roi_out = &piece->roi_out;
+  if(roi_in->width != roi_out->width || roi_in->height != roi_out->height) return DT_GEOMETRY_STAGE_NONE;
+  return DT_GEOMETRY_STAGE_COPY;
+}
+
 int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid)
 {
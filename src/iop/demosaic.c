@@ -247,15 +247,6 @@ typedef struct dt_iop_demosaic_data_t
 } dt_iop_demosaic_data_t;
 
 
-static inline __attribute__((always_inline)) float intp(float a, float b, float c)
-{   // taken from rt code
-    // calculate a * b + (1 - a) * c
-    // following is valid:
-    // intp(a, b+x, c+x) = intp(a, b, c) + x
-    // intp(a, b*x, c*x) = intp(a, b, c) * x
-    return a * (b - c) + c;
-}
-
 typedef enum dt_iop_demosaic_quality_t
 {
   DT_DEMOSAIC_FAST = 0,
@@ -305,6 +296,7 @@ void amaze_demosaic_RT(
 #include "demosaic/ppg.c"
 #include "demosaic/vng.c"
 #include "demosaic/markesteijn.c"
+#include "demosaic/tiles.c"
 #include "demosaic/dual.c"
 
 
@@ -1095,6 +1087,18 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
 
   const float *const pixels = (float *)i;
 
+  // Dual methods demosaic in a buffer of their own, then blend it with VNG into the output
+  const gboolean dual = (demosaicing_method & DEMOSAIC_DUAL) && data->dual_thrs > 0.0f
+                        && !(img->flags & DT_IMAGE_4BAYER) && roi_in->width >= 16 && roi_in->height >= 16;
+  float *high = (float *)o;
+  if(dual)
+  {
+    high = dt_pixelpipe_cache_alloc_align_float((size_t)4 * roo.width * roo.height, pipe);
+    if(IS_NULL_PTR(high)) return 1;
+  }
+  // VNG and PPG run the colour smoothing passes on their tiles
+  gboolean smoothed = FALSE;
+
   // Full demosaic and then scaling if needed
   if(info) dt_get_times(&start_time);
 
@@ -1120,14 +1124,17 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
   {
     const int passes = (demosaicing_method == DT_IOP_DEMOSAIC_MARKESTEIJN) ? 1 : 3;
     if(demosaicing_method == DT_IOP_DEMOSAIC_MARKEST3_VNG)
-      xtrans_markesteijn_interpolate(o, pixels, &roo, &roi, xtrans_raw, passes);
+      xtrans_markesteijn_interpolate(high, pixels, &roo, &roi, xtrans_raw, passes);
     else if(demosaicing_method == DT_IOP_DEMOSAIC_FDC)
       xtrans_fdc_interpolate(self, o, pixels, &roo, &roi, xtrans_raw);
     else if(demosaicing_method >= DT_IOP_DEMOSAIC_MARKESTEIJN)
       xtrans_markesteijn_interpolate(o, pixels, &roo, &roi, xtrans_raw, passes);
     else
-      if(vng_interpolate(o, pixels, &roo, &roi, piece->dsc_in.filters, xtrans_raw, FALSE))
+    {
+      if(vng_interpolate_tiled(o, pixels, &roi, piece->dsc_in.filters, xtrans_raw, data->color_smoothing))
         return 1;
+      smoothed = TRUE;
+    }
   }
   else
   {
@@ -1154,6 +1161,7 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
             if(IS_NULL_PTR(aux))
             {
               dt_pixelpipe_cache_free_align(in);
+              if(dual) dt_pixelpipe_cache_free_align(high);
               return 1;
             }
             green_equilibration_favg(aux, pixels, roi_in->width, roi_in->height, piece->dsc_in.filters,
@@ -1166,14 +1174,18 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
       }
       else
       {
+        if(dual) dt_pixelpipe_cache_free_align(high);
         return 1;
       }
     }
 
     if(demosaicing_method == DT_IOP_DEMOSAIC_VNG4 || (img->flags & DT_IMAGE_4BAYER))
     {
-      if(vng_interpolate(o, in, &roo, &roi, piece->dsc_in.filters, xtrans_raw, FALSE))
+      // 4Bayer smooths after the conversion to RGB below
+      const gboolean cygm = (img->flags & DT_IMAGE_4BAYER);
+      if(vng_interpolate_tiled(o, in, &roi, piece->dsc_in.filters, xtrans_raw, cygm ? 0 : data->color_smoothing))
         return 1;
+      smoothed = !cygm;
       if(img->flags & DT_IMAGE_4BAYER)
       {
         dt_colorspaces_cygm_to_rgb(o, roo.width*roo.height, data->CAM_to_RGB);
@@ -1184,7 +1196,7 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
     }
     else if((demosaicing_method & ~DEMOSAIC_DUAL) == DT_IOP_DEMOSAIC_RCD)
     {
-      rcd_demosaic(piece, o, in, &roo, &roi, filters);
+      rcd_demosaic(piece, high, in, &roo, &roi, filters);
     }
     else if(demosaicing_method == DT_IOP_DEMOSAIC_LMMSE)
     {
@@ -1216,15 +1228,16 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
     }
     else if((demosaicing_method & ~DEMOSAIC_DUAL) != DT_IOP_DEMOSAIC_AMAZE)
     {
-      if(demosaic_ppg(o, in, &roo, &roi, filters, data->median_thrs))
+      if(demosaic_ppg_tiled(piece, o, in, &roi, data->median_thrs, data->color_smoothing))
       {
         if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO)
           dt_pixelpipe_cache_free_align(in);
         return 1;
       }
+      smoothed = TRUE;
     } // wanted ppg or zoomed out a lot and quality is limited to 1
     else
-      amaze_demosaic_RT(piece, in, o, &roi, &roo, filters);
+      amaze_demosaic_RT(piece, in, high, &roi, &roo, filters);
 
     if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO) 
       dt_pixelpipe_cache_free_align(in);
@@ -1240,13 +1253,14 @@ int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const
       method2string(demosaicing_method & ~DEMOSAIC_DUAL), mpixels, tclock, uclock, mpixels / tclock);
   }
 
-  if((demosaicing_method & DEMOSAIC_DUAL))
+  if(dual)
   {
-    if(dual_demosaic(pipe, piece, o, pixels, &roo, &roi, piece->dsc_in.filters, xtrans_raw, showmask, data->dual_thrs))
-      return 1;
+    const int err = dual_demosaic(pipe, piece, o, high, pixels, &roi, xtrans_raw, showmask, data->dual_thrs);
+    dt_pixelpipe_cache_free_align(high);
+    if(err) return 1;
   }
 
-  if(data->color_smoothing && !_is_downsample_method(demosaicing_method))
+  if(data->color_smoothing && !smoothed && !_is_downsample_method(demosaicing_method))
     color_smoothing(o, roi_out, data->color_smoothing);
     
   return 0;
@@ -16,6 +16,15 @@
     along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+static inline __attribute__((always_inline)) float intp(float a, float b, float c)
+{   // taken from rt code
+    // calculate a * b + (1 - a) * c
+    // following is valid:
+    // intp(a, b+x, c+x) = intp(a, b, c) + x
+    // intp(a, b*x, c*x) = intp(a, b, c) * x
+    return a * (b - c) + c;
+}
+
 /* taken from dcraw and demosaic_ppg below */
 
 __DT_CLONE_TARGETS__
@@ -26,7 +35,8 @@ static void lin_interpolate(float *out, const float *const in, const dt_iop_roi_
   const int colors = (filters == 9) ? 3 : 4;
 
 // border interpolate
-  __OMP_PARALLEL_FOR__(collapse(2))
+// not collapsed: the inner loop jumps from the first to the last columns
+  __OMP_PARALLEL_FOR__()
   for(int row = 0; row < roi_out->height; row++)
     for(int col = 0; col < roi_out->width; col++)
     {
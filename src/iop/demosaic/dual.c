@@ -35,79 +35,120 @@ static float slider2contrast(float slider)
 {
   return 0.005f * powf(slider, 1.1f);
 }
-__DT_CLONE_TARGETS__
-static int dual_demosaic(const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
-                         float *const restrict rgb_data, const float *const restrict raw_data,
-                         dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
-                         const uint32_t filters, const uint8_t (*const xtrans)[6],
-                         const gboolean dual_mask, float dual_threshold)
-{
-  const int width = roi_in->width;
-  const int height = roi_in->height;
-  if((width < 16) || (height < 16)) return 0;
 
-  // If the threshold is zero and we don't want to see the blend mask we don't do anything
-  if(dual_threshold <= 0.0f) return 0;
+// VNG reads 3 pixels around, plus its 2 passes of colour smoothing. The Scharr operator of the
+// detail mask reads 1 pixel around, then its 9x9 blur 4.
+#define DUAL_TILE_HALO_VNG (VNG_TILE_HALO + 2)
+#define DUAL_TILE_HALO_MASK 5
 
-  float *blend = dt_pixelpipe_cache_alloc_align_float((size_t) width * height, pipe);
-  float *tmp = dt_pixelpipe_cache_alloc_align_float((size_t) width * height, pipe);
-  float *vng_image = dt_pixelpipe_cache_alloc_align_float((size_t) 4 * width * height, pipe);
-  if(IS_NULL_PTR(blend) || IS_NULL_PTR(tmp) || IS_NULL_PTR(vng_image))
-  {
-    dt_pixelpipe_cache_free_align(tmp);
-    dt_pixelpipe_cache_free_align(blend);
-    dt_pixelpipe_cache_free_align(vng_image);
-    dt_control_log(_("[dual demosaic] can't allocate internal buffers"));
-    return 1;
-  }
-  const gboolean info = ((dt_get_debug_flags() & (DT_DEBUG_DEMOSAIC | DT_DEBUG_PERF))
-                         && (pipe->type == DT_DEV_PIXELPIPE_FULL));
+typedef struct demosaic_tile_dual_t
+{
+  const dt_dev_pixelpipe_iop_t *piece;
+  const float *high; // RGBA output of the high-frequency method
+  const float *raw;  // input of VNG
+  const uint8_t (*xtrans)[6];
+  float contrastf;
+  gboolean dual_mask;
+} demosaic_tile_dual_t;
 
-  if(vng_interpolate(vng_image, raw_data, roi_out, roi_in, filters, xtrans, FALSE))
-  {
-    dt_pixelpipe_cache_free_align(tmp);
-    dt_pixelpipe_cache_free_align(blend);
-    dt_pixelpipe_cache_free_align(vng_image);
-    return 1;
-  }
-  color_smoothing(vng_image, roi_out, 2);
+// VNG, the detail mask and the blend of one tile, all in cache.
+__DT_CLONE_TARGETS__
+static int _dual_tile(float *const out, float *const scratch, const dt_iop_roi_t *const roi,
+                      const dt_iop_roi_t *const tile, const void *const data)
+{
+  const demosaic_tile_dual_t *const d = (const demosaic_tile_dual_t *)data;
+  const dt_dev_pixelpipe_iop_t *const piece = d->piece;
+  const int width = tile->width;
+  const int height = tile->height;
+  const size_t npixels = (size_t)width * height;
+  // Every plane starts on 64 bytes, for the aligned SIMD loops here and in the detail masks.
+  const size_t plane = demosaic_tile_plane(npixels);
+  dt_iop_roi_t roo = { 0, 0, width, height, tile->scale };
 
-  dt_times_t start_blend = { 0 }, end_blend = { 0 };
-  if(info) dt_get_times(&start_blend);
+  float *const restrict vng_image = scratch;
+  float *const restrict mosaic = scratch + 4 * plane;
+  float *const restrict blend = mosaic + plane;
+  // The mosaic is not read anymore once VNG is done.
+  float *const restrict tmp = mosaic;
 
-  const float contrastf = slider2contrast(dual_threshold);
+  demosaic_tile_copy_mosaic(mosaic, d->raw, roi, tile);
+  if(vng_interpolate(vng_image, mosaic, &roo, tile, piece->dsc_in.filters, d->xtrans, FALSE)) return 1;
+  color_smoothing(vng_image, &roo, 2);
 
-  dt_masks_calc_rawdetail_mask(rgb_data, blend, tmp, width, height, piece->dsc_in.temperature.coeffs);
-  dt_masks_calc_detail_mask(blend, blend, tmp, width, height, contrastf, TRUE);
+  for(int j = 0; j < height; j++)
+    memcpy(out + 4 * (size_t)j * width,
+           d->high + 4 * ((size_t)(tile->y - roi->y + j) * roi->width + (tile->x - roi->x)),
+           sizeof(float) * 4 * width);
 
-  if(dual_mask)
+  dt_masks_calc_rawdetail_mask(out, blend, tmp, width, height, piece->dsc_in.temperature.coeffs);
+  dt_masks_calc_detail_mask(blend, blend, tmp, width, height, d->contrastf, TRUE);
+
+  if(d->dual_mask)
   {
-    ((dt_dev_pixelpipe_t *)pipe)->mask_display = DT_DEV_PIXELPIPE_DISPLAY_PASSTHRU;
-    __OMP_FOR_SIMD__(aligned(blend, vng_image, rgb_data : 64))
-    for(int idx = 0; idx < width * height; idx++)
+    __OMP_SIMD__(aligned(blend, out : 64))
+    for(size_t idx = 0; idx < npixels; idx++)
     {
       for(int c = 0; c < 4; c++)
-        rgb_data[idx * 4 + c] = blend[idx];
+        out[idx * 4 + c] = blend[idx];
     }
   }
   else
   {
-    __OMP_FOR_SIMD__(aligned(blend, vng_image, rgb_data : 64))
-    for(int idx = 0; idx < width * height; idx++)
+    __OMP_SIMD__(aligned(blend, vng_image, out : 64))
+    for(size_t idx = 0; idx < npixels; idx++)
     {
-      const int oidx = 4 * idx;
+      const size_t oidx = 4 * idx;
       for(int c = 0; c < 4; c++)
-        rgb_data[oidx + c] = intp(blend[idx], rgb_data[oidx + c], vng_image[oidx + c]);
+        out[oidx + c] = intp(blend[idx], out[oidx + c], vng_image[oidx + c]);
     }
   }
+  return 0;
+}
+
+/**
+ * @brief Blend the output of RCD, AMaZE or Markesteijn 3-pass with VNG along the detail mask.
+ *
+ * The high-frequency method runs over the full frame, it is already tiled internally. VNG, the
+ * detail mask and the blend then run tile by tile in cache, instead of a full-frame VNG followed
+ * by full-frame masking and blending.
+ *
+ * @param rgb_data RGBA output, packed over @p roi_in.
+ * @param high_data RGBA output of the high-frequency method, packed over @p roi_in.
+ * @param raw_data Mosaic read by VNG.
+ */
+__DT_CLONE_TARGETS__
+static int dual_demosaic(const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                         float *const restrict rgb_data, const float *const restrict high_data,
+                         const float *const restrict raw_data, const dt_iop_roi_t *const roi_in,
+                         const uint8_t (*const xtrans)[6], const gboolean dual_mask, float dual_threshold)
+{
+  const gboolean info = ((dt_get_debug_flags() & (DT_DEBUG_DEMOSAIC | DT_DEBUG_PERF))
+                         && (pipe->type == DT_DEV_PIXELPIPE_FULL));
+  dt_times_t start_blend = { 0 }, end_blend = { 0 };
+  if(info) dt_get_times(&start_blend);
+
+  if(dual_mask)
+    ((dt_dev_pixelpipe_t *)pipe)->mask_display = DT_DEV_PIXELPIPE_DISPLAY_PASSTHRU;
+
+  const demosaic_tile_dual_t d = { .piece = piece,
+                                   .high = high_data,
+                                   .raw = raw_data,
+                                   .xtrans = xtrans,
+                                   .contrastf = slider2contrast(dual_threshold),
+                                   .dual_mask = dual_mask };
+
+  // scratch: VNG image, mosaic then mask tmp, blend
+  if(demosaic_tiled(rgb_data, roi_in, MAX(DUAL_TILE_HALO_VNG, DUAL_TILE_HALO_MASK), 6, _dual_tile, &d))
+  {
+    dt_control_log(_("[dual demosaic] can't allocate internal buffers"));
+    return 1;
+  }
+
   if(info)
   {
     dt_get_times(&end_blend);
     fprintf(stderr," [demosaic] CPU dual blending %.4f secs (%.4f CPU)\n", end_blend.clock - start_blend.clock, end_blend.user - start_blend.user);
   }
-  dt_pixelpipe_cache_free_align(tmp);
-  dt_pixelpipe_cache_free_align(blend);
-  dt_pixelpipe_cache_free_align(vng_image);
   return 0;
 }
 
@@ -0,0 +1,223 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Why tiling?
+   RCD, LMMSE, AMaZE and Markesteijn already work on small internal tiles. VNG, PPG and the dual
+   methods do not: each of their steps (linear interpolation, gradients, green mixing, median
+   passes, colour smoothing, detail mask, blending) sweeps the whole frame before the next one
+   starts, so on a 24 to 100 Mpx mosaic every step reads and writes main memory again.
+
+   Here the frame is cut in square tiles sized to stay in the L2 cache of one core, each grown by
+   a halo as wide as the reach of the whole chain of steps. A thread runs all the steps on its
+   tile, then writes back only the core: halo pixels are computed against the border handling of
+   the tile and are thrown away, core pixels only ever see true neighbours and come out the same
+   as over the full frame. Tiles are cut from the ROI, so the CFA phase of a tile is read from
+   its own roi x and y like the frame's, and the frame borders are handled by the methods exactly
+   as before.
+
+   The helpers called on a tile have their own parallel loops, some of them orphaned worksharing
+   constructs (`omp for`). Each tile runs in a nested team of one thread, so that these bind to it
+   instead of the team sharing the tiles.
+*/
+
+// Cache budget of one tile, all its buffers included. On some machines larger tiles are faster:
+// pass DEMOSAIC_TILE_BYTES at build time, as for AMAZETS or RCD_TILESIZE.
+#ifndef DEMOSAIC_TILE_BYTES
+  #define DEMOSAIC_TILE_BYTES (2 << 20)
+#endif
+
+// Reach of each method, in pixels, on top of which come the colour smoothing passes.
+// VNG reads 2 pixels around on the linear interpolation, which reads 1 pixel around.
+#define VNG_TILE_HALO 3
+// PPG red/blue read 1 pixel around on green, which reads 3 pixels around on the pre-median,
+// which reads 2 pixels around but leaves a 3 pixel border.
+#define PPG_TILE_HALO 7
+
+/**
+ * @brief Demosaic one tile.
+ *
+ * @param out RGBA output of the tile, packed, of `tile->width` x `tile->height`.
+ * @param scratch Scratch space of the tile, as many floats per pixel as declared to demosaic_tiled().
+ * @param roi Frame being demosaiced, the inputs are packed over it.
+ * @param tile Tile in the same coordinates as @p roi, halo included.
+ * @return non-zero on error.
+ */
+typedef int (*demosaic_tile_t)(float *const out, float *const scratch, const dt_iop_roi_t *const roi,
+                               const dt_iop_roi_t *const tile, const void *const data);
+
+// Pixels of one plane of tile scratch, rounded up to 16 floats so that the next plane also starts
+// on 64 bytes.
+static inline size_t demosaic_tile_plane(const size_t npixels)
+{
+  return (npixels + 15) & ~(size_t)15;
+}
+
+static inline void demosaic_tile_copy_mosaic(float *const restrict tile_in, const float *const restrict in,
+                                             const dt_iop_roi_t *const roi, const dt_iop_roi_t *const tile)
+{
+  for(int j = 0; j < tile->height; j++)
+    memcpy(tile_in + (size_t)j * tile->width,
+           in + (size_t)(tile->y - roi->y + j) * roi->width + (tile->x - roi->x),
+           sizeof(float) * tile->width);
+}
+
+/**
+ * @brief Run @p process_tile over the L2-sized tiles of the frame @p roi, in parallel, and write
+ * back their cores into the RGBA @p out, packed over @p roi.
+ *
+ * @param halo Reach of @p process_tile, in pixels: core pixels closer to the border of their
+ * tile would be computed from its border handling.
+ * @param scratch_floats Floats of scratch space that @p process_tile needs per pixel of tile. They
+ * are allocated per demosaic_tile_plane() of the tile, so @p process_tile can cut the scratch in
+ * 64-bytes aligned planes.
+ */
+__DT_CLONE_TARGETS__
+static int demosaic_tiled(float *const out, const dt_iop_roi_t *const roi, const int halo,
+                          const int scratch_floats, demosaic_tile_t process_tile, const void *const data)
+{
+  const size_t pixel_bytes = sizeof(float) * (4 + scratch_floats);
+  const int side = (int)sqrtf((float)DEMOSAIC_TILE_BYTES / (float)pixel_bytes);
+  // Below 4 halos per core, more time goes into halos than into cores.
+  const int core = MAX(side - 2 * halo, 4 * halo);
+  const int tiles_x = (roi->width + core - 1) / core;
+  const int tiles_y = (roi->height + core - 1) / core;
+  const int max_side = core + 2 * halo + XTRANS_SNAPPER - 1;
+  const size_t max_pixels = demosaic_tile_plane((size_t)MIN(max_side, roi->width) * MIN(max_side, roi->height));
+
+  int error = 0;
+#ifdef _OPENMP
+  #pragma omp parallel reduction(| : error)
+#endif
+  {
+    float *tile_out = dt_pixelpipe_cache_alloc_align_float_cache(4 * max_pixels, 0);
+    float *scratch = (scratch_floats > 0)
+                         ? dt_pixelpipe_cache_alloc_align_float_cache(scratch_floats * max_pixels, 0)
+                         : NULL;
+    error = IS_NULL_PTR(tile_out) || (scratch_floats > 0 && IS_NULL_PTR(scratch));
+
+#ifdef _OPENMP
+  #pragma omp for schedule(dynamic) collapse(2)
+#endif
+    for(int ty = 0; ty < tiles_y; ty++)
+      for(int tx = 0; tx < tiles_x; tx++)
+      {
+        if(error) continue;
+
+        const int core_x = tx * core;
+        const int core_y = ty * core;
+        const int core_width = MIN(core, roi->width - core_x);
+        const int core_height = MIN(core, roi->height - core_y);
+        // Tiles of the last row and column grow inwards when their core is thin, so no tile gets
+        // much thinner than its halos.
+        const int x0 = MAX(MIN(core_x - halo, roi->width - 4 * halo), 0);
+        const int y0 = MAX(MIN(core_y - halo, roi->height - 4 * halo), 0);
+        // Tiles see the CFA in the same phase as the frame, X-Trans or Bayer: some methods are not
+        // symmetric in the phase.
+        const int x = x0 - x0 % XTRANS_SNAPPER;
+        const int y = y0 - y0 % XTRANS_SNAPPER;
+        const dt_iop_roi_t tile = { roi->x + x, roi->y + y,
+                                    MIN(core_x + core_width + halo, roi->width) - x,
+                                    MIN(core_y + core_height + halo, roi->height) - y, roi->scale };
+
+        int tile_error = 0;
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(1)
+#endif
+        tile_error = process_tile(tile_out, scratch, roi, &tile, data);
+
+        if(tile_error)
+        {
+          error = 1;
+          continue;
+        }
+
+        for(int j = 0; j < core_height; j++)
+          memcpy(out + 4 * ((size_t)(core_y + j) * roi->width + core_x),
+                 tile_out + 4 * ((size_t)(core_y - y + j) * tile.width + (core_x - x)),
+                 sizeof(float) * 4 * core_width);
+      }
+
+    dt_pixelpipe_cache_free_align(tile_out);
+    dt_pixelpipe_cache_free_align(scratch);
+  }
+
+  return error;
+}
+
+typedef struct demosaic_tile_vng_t
+{
+  const float *in;
+  uint32_t filters;
+  const uint8_t (*xtrans)[6];
+  int smoothing;
+} demosaic_tile_vng_t;
+
+static int _vng_tile(float *const out, float *const scratch, const dt_iop_roi_t *const roi,
+                     const dt_iop_roi_t *const tile, const void *const data)
+{
+  const demosaic_tile_vng_t *const d = (const demosaic_tile_vng_t *)data;
+  const dt_iop_roi_t roo = { 0, 0, tile->width, tile->height, tile->scale };
+
+  demosaic_tile_copy_mosaic(scratch, d->in, roi, tile);
+  if(vng_interpolate(out, scratch, &roo, tile, d->filters, d->xtrans, FALSE)) return 1;
+  if(d->smoothing) color_smoothing(out, &roo, d->smoothing);
+  return 0;
+}
+
+/** VNG and VNG4 over L2-sized tiles, followed by @p smoothing passes of colour smoothing. */
+static int vng_interpolate_tiled(float *const out, const float *const in, const dt_iop_roi_t *const roi_in,
+                                 const uint32_t filters, const uint8_t (*const xtrans)[6], const int smoothing)
+{
+  const demosaic_tile_vng_t d = { .in = in, .filters = filters, .xtrans = xtrans, .smoothing = smoothing };
+  return demosaic_tiled(out, roi_in, VNG_TILE_HALO + smoothing, 1, _vng_tile, &d);
+}
+
+typedef struct demosaic_tile_ppg_t
+{
+  const dt_dev_pixelpipe_iop_t *piece;
+  const float *in;
+  float median_thrs;
+  int smoothing;
+} demosaic_tile_ppg_t;
+
+static int _ppg_tile(float *const out, float *const scratch, const dt_iop_roi_t *const roi,
+                     const dt_iop_roi_t *const tile, const void *const data)
+{
+  const demosaic_tile_ppg_t *const d = (const demosaic_tile_ppg_t *)data;
+  const dt_iop_roi_t roo = { 0, 0, tile->width, tile->height, tile->scale };
+
+  // PPG works in tile-local coordinates, the phase of the tile goes into the filters.
+  demosaic_tile_copy_mosaic(scratch, d->in, roi, tile);
+  if(demosaic_ppg(out, scratch, &roo, tile, dt_dev_get_roi_filters(d->piece, tile), d->median_thrs)) return 1;
+  if(d->smoothing) color_smoothing(out, &roo, d->smoothing);
+  return 0;
+}
+
+/** PPG over L2-sized tiles, followed by @p smoothing passes of colour smoothing. */
+static int demosaic_ppg_tiled(const dt_dev_pixelpipe_iop_t *const piece, float *const out, const float *const in,
+                              const dt_iop_roi_t *const roi_in, const float median_thrs, const int smoothing)
+{
+  const demosaic_tile_ppg_t d = { .piece = piece, .in = in, .median_thrs = median_thrs, .smoothing = smoothing };
+  return demosaic_tiled(out, roi_in, PPG_TILE_HALO + smoothing, 1, _ppg_tile, &d);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
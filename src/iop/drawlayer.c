@@ -2116,6 +2116,7 @@ static gboolean _create_new_layer(dt_iop_module_t *self, const char *requested_n
     return FALSE;
   }
   g->process.cache_dirty = TRUE;
+  dt_drawlayer_paint_runtime_state_reset(&g->process.flush_dirty_rect);
   if(!_flush_layer_cache(self))
   {
     *params = previous;
@@ -2434,6 +2435,7 @@ static gboolean _fill_current_layer(dt_iop_module_t *self, const float value)
   g->process.cache_dirty_rect.nw[1] = 0;
   g->process.cache_dirty_rect.se[0] = g->process.base_patch.width;
   g->process.cache_dirty_rect.se[1] = g->process.base_patch.height;
+  g->process.flush_dirty_rect = g->process.cache_dirty_rect;
   _touch_stroke_commit_hash(params, 0, FALSE, 0.0f, 0.0f, 0u);
   _reset_stroke_session(g);
 
@@ -2462,6 +2464,7 @@ static gboolean _clear_current_layer(dt_iop_module_t *self)
   g->process.cache_dirty_rect.nw[1] = 0;
   g->process.cache_dirty_rect.se[0] = g->process.base_patch.width;
   g->process.cache_dirty_rect.se[1] = g->process.base_patch.height;
+  g->process.flush_dirty_rect = g->process.cache_dirty_rect;
   _touch_stroke_commit_hash(params, 0, FALSE, 0.0f, 0.0f, 0u);
   _reset_stroke_session(g);
 
@@ -27,6 +27,7 @@
 #include "imageio/imageio_module.h"
 #include "control/jobs.h"
 #include "iop/drawlayer/cache.h"
+#include "iop/drawlayer/sidecar.h"
 
 #include <glib/gstdio.h>
 #include <math.h>
@@ -258,62 +259,23 @@ static gboolean _set_directory_tags(TIFF *tiff, const uint32_t width, const uint
      && !TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_LZW))
     TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
 
-  TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tiff, 0));
+  if(!dt_drawlayer_sidecar_set_tile_layout(tiff)) return FALSE;
   if(!IS_NULL_PTR(name) && name[0]) TIFFSetField(tiff, TIFFTAG_PAGENAME, name);
   if(!IS_NULL_PTR(work_profile) && work_profile[0]) TIFFSetField(tiff, TIFFTAG_IMAGEDESCRIPTION, work_profile);
   return TRUE;
 }
 
-/** @brief Read one TIFF scanline into half-float RGBA buffer. */
-static gboolean _read_scanline_rgba(TIFF *tiff, const uint32_t width, const uint32_t row, uint16_t *out)
-{
-  uint16_t bpp = 0;
-  uint16_t spp = 0;
-  uint16_t sampleformat = SAMPLEFORMAT_UINT;
-
-  TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bpp);
-  TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &spp);
-  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleformat);
-
-  if(spp != 4) return FALSE;
-
-  const tsize_t scanline = TIFFScanlineSize(tiff);
-  tdata_t buffer = _TIFFmalloc((tsize_t)scanline);
-  if(IS_NULL_PTR(buffer)) return FALSE;
-
-  const int ok = TIFFReadScanline(tiff, buffer, row, 0);
-  if(ok == -1)
-  {
-    _TIFFfree(buffer);
-    return FALSE;
-  }
-
-  if(bpp == 16 && sampleformat == SAMPLEFORMAT_IEEEFP)
-    memcpy(out, buffer, (size_t)width * 4 * sizeof(uint16_t));
-  else
-  {
-    _TIFFfree(buffer);
-    return FALSE;
-  }
-
-  _TIFFfree(buffer);
-  return TRUE;
-}
-
-/** @brief Write one half-float RGBA scanline into TIFF page. */
-static gboolean _write_scanline_rgba(TIFF *tiff, const uint32_t row, const uint16_t *in)
-{
-  return TIFFWriteScanline(tiff, (tdata_t)in, row, 0) != -1;
-}
-
-/** @brief Overlay one clipped float patch span into a half-float TIFF row. */
-static void _overlay_patch_row_rgba(uint16_t *dst_row, const uint32_t width, const int offset_x,
+/** @brief Overlay one clipped float patch span into a half-float TIFF row span.
+ *
+ * `dst_row` holds `width` pixels of the page row, starting at page column `first_x`.
+ */
+static void _overlay_patch_row_rgba(uint16_t *dst_row, const uint32_t width, const int first_x, const int offset_x,
                                     const int raw_y, const dt_drawlayer_io_patch_t *patch)
 {
   if(IS_NULL_PTR(dst_row) || IS_NULL_PTR(patch) || IS_NULL_PTR(patch->pixels) || raw_y < patch->y || raw_y >= patch->y + patch->height) return;
 
-  const int dst_x0 = MAX(0, patch->x - offset_x);
-  const int dst_x1 = MIN((int)width, patch->x + patch->width - offset_x);
+  const int dst_x0 = MAX(first_x, patch->x - offset_x);
+  const int dst_x1 = MIN(first_x + (int)width, patch->x + patch->width - offset_x);
   if(dst_x0 >= dst_x1) return;
 
   const float *patch_row = patch->pixels + 4 * (size_t)(raw_y - patch->y) * patch->width;
@@ -321,10 +283,11 @@ static void _overlay_patch_row_rgba(uint16_t *dst_row, const uint32_t width, con
   for(int dst_x = dst_x0; dst_x < dst_x1; dst_x++)
   {
     const float *src_pixel = patch_row + 4 * (size_t)(dst_x + offset_x - patch->x);
-    dst_row[4 * dst_x + 0] = _float_to_half(src_pixel[0]);
-    dst_row[4 * dst_x + 1] = _float_to_half(src_pixel[1]);
-    dst_row[4 * dst_x + 2] = _float_to_half(src_pixel[2]);
-    dst_row[4 * dst_x + 3] = _float_to_half(src_pixel[3]);
+    uint16_t *dst_pixel = dst_row + 4 * (size_t)(dst_x - first_x);
+    dst_pixel[0] = _float_to_half(src_pixel[0]);
+    dst_pixel[1] = _float_to_half(src_pixel[1]);
+    dst_pixel[2] = _float_to_half(src_pixel[2]);
+    dst_pixel[3] = _float_to_half(src_pixel[3]);
   }
 }
 
@@ -470,61 +433,46 @@ static gboolean _write_page(TIFF *dst, TIFF *src, const int src_dir, const char
   if(page_profile && page_profile[0] && _icc_blob_from_profile_key(page_profile, &icc_profile, &icc_profile_len))
     TIFFSetField(dst, TIFFTAG_ICCPROFILE, icc_profile_len, icc_profile);
 
-  uint16_t *src_row = g_malloc_n((gsize)width * 4, sizeof(uint16_t));
-  uint16_t *dst_row = g_malloc_n((gsize)width * 4, sizeof(uint16_t));
-  if(IS_NULL_PTR(src_row) || IS_NULL_PTR(dst_row))
-  {
-    dt_free(icc_profile);
-    dt_free(src_row);
-    dt_free(dst_row);
-    return FALSE;
-  }
-
   const int offset_x = (layer_width - (int)width) / 2;
   const int offset_y = (layer_height - (int)height) / 2;
 
-  for(uint32_t y = 0; y < height; y++)
+  dt_drawlayer_sidecar_reader_t reader = { 0 };
+  dt_drawlayer_sidecar_writer_t writer = { 0 };
+  uint16_t *row = g_malloc_n((gsize)width * 4, sizeof(uint16_t));
+  gboolean ok = !IS_NULL_PTR(row) && dt_drawlayer_sidecar_writer_init(&writer, dst, width, height)
+                && (IS_NULL_PTR(src) || dt_drawlayer_sidecar_reader_init(&reader, src));
+  // A resized page only keeps what the patch brings.
+  const gboolean copy_src = ok && !IS_NULL_PTR(src) && reader.width == width && reader.height == height;
+
+  for(uint32_t y = 0; y < height && ok; y++)
   {
-    if(!IS_NULL_PTR(src))
-    {
-      if(!_read_scanline_rgba(src, width, y, src_row))
-      {
-        dt_free(icc_profile);
-        dt_free(src_row);
-        dt_free(dst_row);
-        return FALSE;
-      }
-      memcpy(dst_row, src_row, (size_t)width * 4 * sizeof(uint16_t));
-    }
+    if(copy_src)
+      ok = dt_drawlayer_sidecar_read_row(&reader, y, row);
     else
-      _clear_transparent_half(dst_row, (size_t)width);
+      _clear_transparent_half(row, (size_t)width);
 
-    if(!IS_NULL_PTR(patch))
+    if(ok && !IS_NULL_PTR(patch))
     {
       const int layer_y = (int)y + offset_y;
-      _overlay_patch_row_rgba(dst_row, width, offset_x, layer_y, patch);
+      _overlay_patch_row_rgba(row, width, 0, offset_x, layer_y, patch);
     }
 
-    if(!_write_scanline_rgba(dst, y, dst_row))
-    {
-      dt_free(icc_profile);
-      dt_free(src_row);
-      dt_free(dst_row);
-      return FALSE;
-    }
+    ok = ok && dt_drawlayer_sidecar_write_row(&writer, row);
   }
+  ok = ok && dt_drawlayer_sidecar_writer_finish(&writer);
 
+  dt_drawlayer_sidecar_reader_cleanup(&reader);
+  dt_drawlayer_sidecar_writer_cleanup(&writer);
   dt_free(icc_profile);
-  dt_free(src_row);
-  dt_free(dst_row);
-  return TIFFWriteDirectory(dst) != 0;
+  dt_free(row);
+  return ok && TIFFWriteDirectory(dst) != 0;
 }
 
-/** @brief Rewrite sidecar with optional update/insert/delete of one target layer. */
-static gboolean _rewrite_sidecar(const char *path, const char *target_name, const int target_order,
-                                 const char *work_profile, const dt_drawlayer_io_patch_t *patch, const int layer_width,
-                                 const int layer_height, const gboolean delete_target, const int insert_order,
-                                 int *final_order)
+/** @brief Rewrite sidecar with optional update/insert/delete of one target layer. The caller owns the sidecar. */
+static gboolean _rewrite_sidecar_locked(const char *path, const char *target_name, const int target_order,
+                                        const char *work_profile, const dt_drawlayer_io_patch_t *patch,
+                                        const int layer_width, const int layer_height, const gboolean delete_target,
+                                        const int insert_order, int *final_order)
 {
   if(!IS_NULL_PTR(final_order)) *final_order = -1;
 
@@ -610,12 +558,26 @@ static gboolean _rewrite_sidecar(const char *path, const char *target_name, cons
   return ok;
 }
 
+/** @brief Rewrite sidecar with optional update/insert/delete of one target layer. */
+static gboolean _rewrite_sidecar(const char *path, const char *target_name, const int target_order,
+                                 const char *work_profile, const dt_drawlayer_io_patch_t *patch, const int layer_width,
+                                 const int layer_height, const gboolean delete_target, const int insert_order,
+                                 int *final_order)
+{
+  if(!IS_NULL_PTR(final_order)) *final_order = -1;
+  if(IS_NULL_PTR(path) || !dt_drawlayer_sidecar_begin_rewrite(path)) return FALSE;
+  const gboolean ok = _rewrite_sidecar_locked(path, target_name, target_order, work_profile, patch, layer_width,
+                                              layer_height, delete_target, insert_order, final_order);
+  dt_drawlayer_sidecar_end_rewrite();
+  return ok;
+}
+
 /** @brief Test if a layer name already exists in sidecar TIFF. */
 gboolean dt_drawlayer_io_layer_name_exists(const char *path, const char *candidate, const int ignore_index)
 {
   if(IS_NULL_PTR(path) || !candidate || candidate[0] == '\0' || !g_file_test(path, G_FILE_TEST_EXISTS)) return FALSE;
 
-  TIFF *tiff = TIFFOpen(path, "rb");
+  TIFF *tiff = dt_drawlayer_sidecar_open(path);
   if(IS_NULL_PTR(tiff)) return FALSE;
 
   gboolean exists = FALSE;
@@ -635,7 +597,7 @@ gboolean dt_drawlayer_io_layer_name_exists(const char *path, const char *candida
     } while(TIFFReadDirectory(tiff));
   }
 
-  TIFFClose(tiff);
+  dt_drawlayer_sidecar_close(tiff);
   return exists;
 }
 
@@ -689,10 +651,10 @@ gboolean dt_drawlayer_io_find_layer(const char *path, const char *target_name, c
   if(!IS_NULL_PTR(info)) memset(info, 0, sizeof(*info));
   if(IS_NULL_PTR(path) || !g_file_test(path, G_FILE_TEST_EXISTS)) return FALSE;
 
-  TIFF *tiff = TIFFOpen(path, "rb");
+  TIFF *tiff = dt_drawlayer_sidecar_open(path);
   if(IS_NULL_PTR(tiff)) return FALSE;
   _scan_directories(tiff, target_name, target_order, info);
-  TIFFClose(tiff);
+  dt_drawlayer_sidecar_close(tiff);
   return info && info->found;
 }
 
@@ -705,27 +667,30 @@ gboolean dt_drawlayer_io_load_layer(const char *path, const char *target_name, c
 
   if(!g_file_test(path, G_FILE_TEST_EXISTS)) return TRUE;
 
-  TIFF *tiff = TIFFOpen(path, "rb");
+  TIFF *tiff = dt_drawlayer_sidecar_open(path);
   if(IS_NULL_PTR(tiff)) return FALSE;
 
   dt_drawlayer_io_layer_info_t info;
   _scan_directories(tiff, target_name, target_order, &info);
   if(!info.found)
   {
-    TIFFClose(tiff);
+    dt_drawlayer_sidecar_close(tiff);
     return TRUE;
   }
 
   if(!TIFFSetDirectory(tiff, (tdir_t)info.index))
   {
-    TIFFClose(tiff);
+    dt_drawlayer_sidecar_close(tiff);
     return FALSE;
   }
 
+  dt_drawlayer_sidecar_reader_t reader = { 0 };
   uint16_t *row = g_malloc_n((gsize)info.width * 4, sizeof(uint16_t));
-  if(IS_NULL_PTR(row))
+  if(IS_NULL_PTR(row) || !dt_drawlayer_sidecar_reader_init(&reader, tiff) || reader.width != info.width)
   {
-    TIFFClose(tiff);
+    dt_drawlayer_sidecar_reader_cleanup(&reader);
+    dt_free(row);
+    dt_drawlayer_sidecar_close(tiff);
     return FALSE;
   }
 
@@ -737,10 +702,11 @@ gboolean dt_drawlayer_io_load_layer(const char *path, const char *target_name, c
     const int layer_y = patch->y + py;
     const int src_y = layer_y - offset_y;
     if(src_y < 0 || src_y >= (int)info.height) continue;
-    if(!_read_scanline_rgba(tiff, info.width, (uint32_t)src_y, row))
+    if(!dt_drawlayer_sidecar_read_row(&reader, (uint32_t)src_y, row))
     {
+      dt_drawlayer_sidecar_reader_cleanup(&reader);
       dt_free(row);
-      TIFFClose(tiff);
+      dt_drawlayer_sidecar_close(tiff);
       return FALSE;
     }
 
@@ -754,8 +720,9 @@ gboolean dt_drawlayer_io_load_layer(const char *path, const char *target_name, c
     }
   }
 
+  dt_drawlayer_sidecar_reader_cleanup(&reader);
   dt_free(row);
-  TIFFClose(tiff);
+  dt_drawlayer_sidecar_close(tiff);
   return TRUE;
 }
 
@@ -913,6 +880,65 @@ gboolean dt_drawlayer_io_store_layer(const char *path, const char *target_name,
                           delete_target, -1, final_order);
 }
 
+/** @brief Where a float patch lands in the tiles of its page. */
+typedef struct dt_drawlayer_io_tile_fill_t
+{
+  const dt_drawlayer_io_patch_t *patch;
+  int offset_x;
+  int offset_y;
+} dt_drawlayer_io_tile_fill_t;
+
+/** @brief Overlay the patch on one stored tile, for `dt_drawlayer_sidecar_update_tiles()`. */
+static void _fill_tile_from_patch(void *user_data, const uint32_t x, const uint32_t y, const uint32_t width,
+                                  const uint32_t height, uint16_t *pixels)
+{
+  const dt_drawlayer_io_tile_fill_t *fill = (const dt_drawlayer_io_tile_fill_t *)user_data;
+  for(uint32_t r = 0; r < height; r++)
+    _overlay_patch_row_rgba(pixels + 4 * (size_t)r * DT_DRAWLAYER_SIDECAR_TILE, width, (int)x, fill->offset_x,
+                            (int)(y + r) + fill->offset_y, fill->patch);
+}
+
+/** @brief Commit the dirty area of one layer, in place when its page allows it. */
+gboolean dt_drawlayer_io_update_layer(const char *path, const char *target_name, const int target_order,
+                                      const char *work_profile, const dt_drawlayer_io_patch_t *patch,
+                                      const int layer_width, const int layer_height, const int dirty_x,
+                                      const int dirty_y, const int dirty_width, const int dirty_height,
+                                      int *final_order)
+{
+  if(IS_NULL_PTR(target_name) || target_name[0] == ' ' || IS_NULL_PTR(patch) || IS_NULL_PTR(patch->pixels))
+    return FALSE;
+
+  /* In place, the page keeps its tags: only take that path when a full rewrite would have
+   * written the very same ones, i.e. same name, size and profile. Anything else, pages
+   * written before tiling included, goes through the full rewrite, which also compacts. */
+  dt_drawlayer_io_layer_info_t info = { 0 };
+  if(dt_drawlayer_io_find_layer(path, target_name, target_order, &info) && !g_strcmp0(info.name, target_name)
+     && info.width == (uint32_t)patch->width && info.height == (uint32_t)patch->height
+     && !g_strcmp0(info.work_profile, work_profile ? work_profile : ""))
+  {
+    const dt_drawlayer_io_tile_fill_t fill = {
+      .patch = patch,
+      .offset_x = (layer_width - patch->width) / 2,
+      .offset_y = (layer_height - patch->height) / 2,
+    };
+    const gboolean whole = (dirty_width <= 0 || dirty_height <= 0);
+    const dt_drawlayer_sidecar_update_t status = dt_drawlayer_sidecar_update_tiles(
+        path, info.index, info.name, whole ? 0 : dirty_x - fill.offset_x, whole ? 0 : dirty_y - fill.offset_y,
+        whole ? (int)info.width : dirty_width, whole ? (int)info.height : dirty_height, _fill_tile_from_patch,
+        (void *)&fill, NULL);
+
+    if(status == DT_DRAWLAYER_SIDECAR_UPDATE_DONE)
+    {
+      if(!IS_NULL_PTR(final_order)) *final_order = info.index;
+      return TRUE;
+    }
+    if(status == DT_DRAWLAYER_SIDECAR_UPDATE_FAILED) return FALSE;
+  }
+
+  return dt_drawlayer_io_store_layer(path, target_name, target_order, work_profile, patch, layer_width, layer_height,
+                                     FALSE, final_order);
+}
+
 /** @brief Insert a new layer after given order in sidecar TIFF. */
 gboolean dt_drawlayer_io_insert_layer(const char *path, const char *target_name, const int insert_after_order,
                                       const char *work_profile, const dt_drawlayer_io_patch_t *patch,
@@ -1013,7 +1039,7 @@ gboolean dt_drawlayer_io_list_layer_names(const char *path, char ***names, int *
   if(!IS_NULL_PTR(count)) *count = 0;
   if(IS_NULL_PTR(path) || IS_NULL_PTR(names) || !count || !g_file_test(path, G_FILE_TEST_EXISTS)) return FALSE;
 
-  TIFF *tiff = TIFFOpen(path, "rb");
+  TIFF *tiff = dt_drawlayer_sidecar_open(path);
   if(IS_NULL_PTR(tiff)) return FALSE;
 
   GPtrArray *arr = g_ptr_array_new_with_free_func(g_free);
@@ -1026,7 +1052,7 @@ gboolean dt_drawlayer_io_list_layer_names(const char *path, char ***names, int *
       g_ptr_array_add(arr, g_strdup(page_name ? page_name : ""));
     } while(TIFFReadDirectory(tiff));
   }
-  TIFFClose(tiff);
+  dt_drawlayer_sidecar_close(tiff);
 
   *count = (int)arr->len;
   if(arr->len == 0)
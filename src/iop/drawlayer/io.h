@@ -97,6 +97,17 @@ gboolean dt_drawlayer_io_load_layer(const char *path, const char *target_name, i
 gboolean dt_drawlayer_io_store_layer(const char *path, const char *target_name, int target_order,
                                      const char *work_profile, const dt_drawlayer_io_patch_t *patch, int layer_width,
                                      int layer_height, gboolean delete_target, int *final_order);
+/**
+ * @brief Commit one layer patch, rewriting in place only the tiles of its page that changed.
+ *
+ * The dirty rectangle is in layer coordinates and only needs to cover the changes: tiles
+ * it touches are still compared to what is stored. An empty one compares the whole page.
+ * Falls back to `dt_drawlayer_io_store_layer()` when the page cannot be updated in place.
+ */
+gboolean dt_drawlayer_io_update_layer(const char *path, const char *target_name, int target_order,
+                                      const char *work_profile, const dt_drawlayer_io_patch_t *patch, int layer_width,
+                                      int layer_height, int dirty_x, int dirty_y, int dirty_width, int dirty_height,
+                                      int *final_order);
 /** @brief Insert new layer after target order in sidecar TIFF. */
 gboolean dt_drawlayer_io_insert_layer(const char *path, const char *target_name, int insert_after_order,
                                       const char *work_profile, const dt_drawlayer_io_patch_t *patch, int layer_width,
@@ -380,15 +380,21 @@ gboolean dt_drawlayer_flush_layer_cache(dt_iop_module_t *self)
     .height = g->process.base_patch.height,
     .pixels = g->process.base_patch.pixels,
   };
-  const gboolean ok
-      = dt_drawlayer_io_store_layer(path, g->process.cache_layer_name, g->process.cache_layer_order, work_profile, &io_patch,
-                                    g->process.base_patch.width, g->process.base_patch.height, FALSE, &final_order);
+  /* Only the tiles under the strokes since the last flush get rewritten, when the layer page
+   * allows it. The damage is in base-patch coordinates. */
+  const dt_drawlayer_damaged_rect_t *dirty = &g->process.flush_dirty_rect;
+  const gboolean ok = dt_drawlayer_io_update_layer(
+      path, g->process.cache_layer_name, g->process.cache_layer_order, work_profile, &io_patch,
+      g->process.base_patch.width, g->process.base_patch.height, io_patch.x + (dirty->valid ? dirty->nw[0] : 0),
+      io_patch.y + (dirty->valid ? dirty->nw[1] : 0), dirty->valid ? dirty->se[0] - dirty->nw[0] : 0,
+      dirty->valid ? dirty->se[1] - dirty->nw[1] : 0, &final_order);
   dt_drawlayer_cache_patch_rdunlock(&g->process.base_patch);
   if(!ok) return FALSE;
 
   g->process.cache_layer_order = final_order;
   g->process.cache_dirty = FALSE;
   dt_drawlayer_paint_runtime_state_reset(&g->process.cache_dirty_rect);
+  dt_drawlayer_paint_runtime_state_reset(&g->process.flush_dirty_rect);
 
   dt_iop_drawlayer_params_t *mutable_params = (dt_iop_drawlayer_params_t *)self->params;
   if(mutable_params)
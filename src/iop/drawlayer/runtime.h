@@ -43,6 +43,9 @@ typedef struct dt_drawlayer_process_state_t
   gboolean cache_valid;
   gboolean cache_dirty;
   dt_drawlayer_damaged_rect_t cache_dirty_rect;
+  /* Same damage as `cache_dirty_rect`, but kept until the next sidecar flush: the OpenCL
+   * upload consumes the former. May over-cover; invalid means compare the whole layer. */
+  dt_drawlayer_damaged_rect_t flush_dirty_rect;
 
   int32_t cache_imgid;
   char cache_layer_name[DRAWLAYER_NAME_SIZE];
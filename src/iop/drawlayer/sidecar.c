@@ -0,0 +1,578 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "system/macros.h"
+#include "system/mem_alloc.h"
+#include "iop/drawlayer/io.h"
+#include "iop/drawlayer/sidecar.h"
+
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @file
+ *  @brief Tiled sidecar pages and journaled in-place tile updates.
+ */
+
+#define DT_DRAWLAYER_SIDECAR_TILE_BYTES \
+  ((size_t)DT_DRAWLAYER_SIDECAR_TILE * DT_DRAWLAYER_SIDECAR_TILE * 4 * sizeof(uint16_t))
+
+/* In-place tiles that do not fit their former slot anymore are appended at the end of the
+ * file, and the slot is lost until the next full rewrite. Past this much dead space, we ask
+ * for that rewrite. */
+#define DT_DRAWLAYER_SIDECAR_SLACK ((uint64_t)64 << 20)
+
+static const char _journal_magic[8] = { 'D', 'L', 'J', 'R', 'N', 'L', '0', '1' };
+static const char _commit_magic[8] = { 'D', 'L', 'C', 'O', 'M', 'M', 'I', 'T' };
+
+/** @brief Journal header: which page the records belong to. Native endianness, the journal never travels. */
+typedef struct dt_drawlayer_sidecar_journal_header_t
+{
+  char magic[8];
+  uint32_t page;
+  uint32_t tile_width;
+  uint32_t tile_height;
+  uint32_t reserved;
+  char page_name[DT_DRAWLAYER_IO_NAME_SIZE];
+} dt_drawlayer_sidecar_journal_header_t;
+
+/** @brief Journal record header, followed by one raw tile. */
+typedef struct dt_drawlayer_sidecar_journal_record_t
+{
+  uint32_t tile;
+  uint32_t reserved;
+} dt_drawlayer_sidecar_journal_record_t;
+
+/** @brief Commit record, written and synced after every tile record. */
+typedef struct dt_drawlayer_sidecar_journal_footer_t
+{
+  char magic[8];
+  uint32_t count;
+  uint32_t reserved;
+} dt_drawlayer_sidecar_journal_footer_t;
+
+/* One lock for all sidecars: readers share it, in-place updates and full rewrites own it. */
+static GRWLock _sidecar_lock;
+
+static gchar *_journal_path(const char *path)
+{
+  return g_strdup_printf("%s.journal", path);
+}
+
+/** @brief Make a newly created or deleted journal entry itself durable. */
+static void _sync_parent_directory(const char *path)
+{
+#ifndef _WIN32
+  gchar *dir = g_path_get_dirname(path);
+  const int fd = g_open(dir, O_RDONLY, 0);
+  if(fd >= 0)
+  {
+    g_fsync(fd);
+    g_close(fd, NULL);
+  }
+  dt_free(dir);
+#endif
+}
+
+static gboolean _sync_file(FILE *file)
+{
+  return fflush(file) == 0 && g_fsync(fileno(file)) == 0;
+}
+
+/** @brief Pages we read and write: contiguous 16-bit float RGBA. */
+static gboolean _page_format_supported(TIFF *tiff)
+{
+  uint16_t bpp = 0;
+  uint16_t spp = 0;
+  uint16_t sampleformat = SAMPLEFORMAT_UINT;
+  uint16_t planar = PLANARCONFIG_CONTIG;
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bpp);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &spp);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleformat);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+  return bpp == 16 && spp == 4 && sampleformat == SAMPLEFORMAT_IEEEFP && planar == PLANARCONFIG_CONTIG;
+}
+
+/** @brief TRUE when the current page is laid out in our own tiles. */
+static gboolean _page_tiled(TIFF *tiff)
+{
+  uint32_t tile_width = 0;
+  uint32_t tile_height = 0;
+  if(!TIFFIsTiled(tiff)) return FALSE;
+  TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tile_width);
+  TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tile_height);
+  return tile_width == DT_DRAWLAYER_SIDECAR_TILE && tile_height == DT_DRAWLAYER_SIDECAR_TILE
+         && TIFFTileSize(tiff) == (tmsize_t)DT_DRAWLAYER_SIDECAR_TILE_BYTES;
+}
+
+gboolean dt_drawlayer_sidecar_set_tile_layout(TIFF *tiff)
+{
+  return TIFFSetField(tiff, TIFFTAG_TILEWIDTH, (uint32_t)DT_DRAWLAYER_SIDECAR_TILE)
+         && TIFFSetField(tiff, TIFFTAG_TILELENGTH, (uint32_t)DT_DRAWLAYER_SIDECAR_TILE);
+}
+
+gboolean dt_drawlayer_sidecar_reader_init(dt_drawlayer_sidecar_reader_t *reader, TIFF *tiff)
+{
+  if(IS_NULL_PTR(reader)) return FALSE;
+  memset(reader, 0, sizeof(*reader));
+  reader->band_row = -1;
+  if(IS_NULL_PTR(tiff) || !_page_format_supported(tiff)) return FALSE;
+
+  reader->tiff = tiff;
+  TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &reader->width);
+  TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &reader->height);
+  if(reader->width == 0 || reader->height == 0) return FALSE;
+
+  reader->tiled = TIFFIsTiled(tiff);
+  if(reader->tiled)
+  {
+    TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &reader->tile_width);
+    TIFFGetField(tiff, TIFFTAG_TILELENGTH, &reader->tile_height);
+    const tmsize_t tile_size = TIFFTileSize(tiff);
+    if(reader->tile_width == 0 || reader->tile_height == 0
+       || tile_size != (tmsize_t)((size_t)reader->tile_width * reader->tile_height * 4 * sizeof(uint16_t)))
+      return FALSE;
+    reader->band = g_malloc_n((gsize)reader->tile_height * reader->width * 4, sizeof(uint16_t));
+    reader->tile = g_malloc(tile_size);
+    return !IS_NULL_PTR(reader->band) && !IS_NULL_PTR(reader->tile);
+  }
+
+  reader->scanline = _TIFFmalloc(TIFFScanlineSize(tiff));
+  return !IS_NULL_PTR(reader->scanline);
+}
+
+/** @brief Decode the row of tiles starting at page row `band_row`. */
+static gboolean _read_band(dt_drawlayer_sidecar_reader_t *reader, const uint32_t band_row)
+{
+  const uint32_t rows = MIN(reader->tile_height, reader->height - band_row);
+  for(uint32_t x = 0; x < reader->width; x += reader->tile_width)
+  {
+    if(TIFFReadTile(reader->tiff, reader->tile, x, band_row, 0, 0) == -1) return FALSE;
+    const uint32_t cols = MIN(reader->tile_width, reader->width - x);
+    for(uint32_t r = 0; r < rows; r++)
+      memcpy(reader->band + 4 * ((size_t)r * reader->width + x), reader->tile + 4 * (size_t)r * reader->tile_width,
+             (size_t)cols * 4 * sizeof(uint16_t));
+  }
+  return TRUE;
+}
+
+gboolean dt_drawlayer_sidecar_read_row(dt_drawlayer_sidecar_reader_t *reader, const uint32_t row, uint16_t *out)
+{
+  if(IS_NULL_PTR(reader) || IS_NULL_PTR(reader->tiff) || IS_NULL_PTR(out) || row >= reader->height) return FALSE;
+
+  if(!reader->tiled)
+  {
+    if(TIFFReadScanline(reader->tiff, reader->scanline, row, 0) == -1) return FALSE;
+    memcpy(out, reader->scanline, (size_t)reader->width * 4 * sizeof(uint16_t));
+    return TRUE;
+  }
+
+  const uint32_t band_row = row - row % reader->tile_height;
+  if(reader->band_row != (int64_t)band_row)
+  {
+    reader->band_row = -1;
+    if(!_read_band(reader, band_row)) return FALSE;
+    reader->band_row = band_row;
+  }
+  memcpy(out, reader->band + 4 * (size_t)(row - band_row) * reader->width,
+         (size_t)reader->width * 4 * sizeof(uint16_t));
+  return TRUE;
+}
+
+void dt_drawlayer_sidecar_reader_cleanup(dt_drawlayer_sidecar_reader_t *reader)
+{
+  if(IS_NULL_PTR(reader)) return;
+  dt_free(reader->band);
+  dt_free(reader->tile);
+  if(reader->scanline) _TIFFfree(reader->scanline);
+  reader->scanline = NULL;
+  reader->tiff = NULL;
+}
+
+gboolean dt_drawlayer_sidecar_writer_init(dt_drawlayer_sidecar_writer_t *writer, TIFF *tiff, const uint32_t width,
+                                          const uint32_t height)
+{
+  if(IS_NULL_PTR(writer)) return FALSE;
+  memset(writer, 0, sizeof(*writer));
+  if(IS_NULL_PTR(tiff) || width == 0 || height == 0 || !_page_tiled(tiff)) return FALSE;
+
+  writer->tiff = tiff;
+  writer->width = width;
+  writer->height = height;
+  writer->band = g_malloc_n((gsize)DT_DRAWLAYER_SIDECAR_TILE * width * 4, sizeof(uint16_t));
+  writer->tile = g_malloc(DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+  return !IS_NULL_PTR(writer->band) && !IS_NULL_PTR(writer->tile);
+}
+
+/** @brief Encode the first `rows` rows of the band as tiles starting at page row `band_row`. */
+static gboolean _write_band(dt_drawlayer_sidecar_writer_t *writer, const uint32_t band_row, const uint32_t rows)
+{
+  for(uint32_t x = 0; x < writer->width; x += DT_DRAWLAYER_SIDECAR_TILE)
+  {
+    const uint32_t cols = MIN(DT_DRAWLAYER_SIDECAR_TILE, writer->width - x);
+    // Tiles past the page edges are padded with transparent black, like the rest of the layer.
+    if(cols < DT_DRAWLAYER_SIDECAR_TILE || rows < DT_DRAWLAYER_SIDECAR_TILE)
+      memset(writer->tile, 0, DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+    for(uint32_t r = 0; r < rows; r++)
+      memcpy(writer->tile + 4 * (size_t)r * DT_DRAWLAYER_SIDECAR_TILE, writer->band + 4 * ((size_t)r * writer->width + x),
+             (size_t)cols * 4 * sizeof(uint16_t));
+    if(TIFFWriteTile(writer->tiff, writer->tile, x, band_row, 0, 0) == -1) return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean dt_drawlayer_sidecar_write_row(dt_drawlayer_sidecar_writer_t *writer, const uint16_t *in)
+{
+  if(IS_NULL_PTR(writer) || IS_NULL_PTR(writer->tiff) || IS_NULL_PTR(in) || writer->rows >= writer->height)
+    return FALSE;
+
+  const uint32_t band_offset = writer->rows % DT_DRAWLAYER_SIDECAR_TILE;
+  memcpy(writer->band + 4 * (size_t)band_offset * writer->width, in, (size_t)writer->width * 4 * sizeof(uint16_t));
+  writer->rows++;
+
+  if(band_offset + 1 < DT_DRAWLAYER_SIDECAR_TILE) return TRUE;
+  return _write_band(writer, writer->rows - DT_DRAWLAYER_SIDECAR_TILE, DT_DRAWLAYER_SIDECAR_TILE);
+}
+
+gboolean dt_drawlayer_sidecar_writer_finish(dt_drawlayer_sidecar_writer_t *writer)
+{
+  if(IS_NULL_PTR(writer) || IS_NULL_PTR(writer->tiff) || writer->rows != writer->height) return FALSE;
+  const uint32_t remainder = writer->rows % DT_DRAWLAYER_SIDECAR_TILE;
+  return remainder == 0 || _write_band(writer, writer->rows - remainder, remainder);
+}
+
+void dt_drawlayer_sidecar_writer_cleanup(dt_drawlayer_sidecar_writer_t *writer)
+{
+  if(IS_NULL_PTR(writer)) return;
+  dt_free(writer->band);
+  dt_free(writer->tile);
+  writer->tiff = NULL;
+}
+
+/** @brief Bytes referenced by the pixel data of all pages. Leaves the directory undefined. */
+static uint64_t _live_bytes(TIFF *tiff)
+{
+  uint64_t total = 0;
+  if(!TIFFSetDirectory(tiff, 0)) return 0;
+  do
+  {
+    const gboolean tiled = TIFFIsTiled(tiff);
+    const uint32_t count = tiled ? TIFFNumberOfTiles(tiff) : TIFFNumberOfStrips(tiff);
+    uint64_t *bytecounts = NULL;
+    if(TIFFGetField(tiff, tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &bytecounts)
+       && !IS_NULL_PTR(bytecounts))
+      for(uint32_t k = 0; k < count; k++) total += bytecounts[k];
+  } while(TIFFReadDirectory(tiff));
+  return total;
+}
+
+/** @brief Read and validate a journal: its header, and whether it was committed. */
+static gboolean _journal_committed(const char *journal_path, dt_drawlayer_sidecar_journal_header_t *header,
+                                   uint32_t *count)
+{
+  GStatBuf st = { 0 };
+  if(g_stat(journal_path, &st) != 0) return FALSE;
+
+  FILE *file = g_fopen(journal_path, "rb");
+  if(IS_NULL_PTR(file)) return FALSE;
+
+  dt_drawlayer_sidecar_journal_footer_t footer = { 0 };
+  const gboolean read = fread(header, sizeof(*header), 1, file) == 1
+                        && fseek(file, -(long)sizeof(footer), SEEK_END) == 0
+                        && fread(&footer, sizeof(footer), 1, file) == 1;
+  fclose(file);
+  if(!read) return FALSE;
+
+  const uint64_t record_size = sizeof(dt_drawlayer_sidecar_journal_record_t) + DT_DRAWLAYER_SIDECAR_TILE_BYTES;
+  const uint64_t expected = sizeof(*header) + (uint64_t)footer.count * record_size + sizeof(footer);
+  if(memcmp(header->magic, _journal_magic, sizeof(_journal_magic)) || memcmp(footer.magic, _commit_magic, sizeof(_commit_magic))
+     || header->tile_width != DT_DRAWLAYER_SIDECAR_TILE || header->tile_height != DT_DRAWLAYER_SIDECAR_TILE
+     || (uint64_t)st.st_size != expected)
+    return FALSE;
+
+  header->page_name[sizeof(header->page_name) - 1] = '\0';
+  *count = footer.count;
+  return TRUE;
+}
+
+/** @brief Write the tiles of a committed journal into the sidecar, and sync it. */
+static gboolean _replay_journal(const char *path, const char *journal_path,
+                                const dt_drawlayer_sidecar_journal_header_t *header, const uint32_t count)
+{
+  FILE *file = g_fopen(journal_path, "rb");
+  if(IS_NULL_PTR(file)) return FALSE;
+  if(fseek(file, sizeof(*header), SEEK_SET) != 0)
+  {
+    fclose(file);
+    return FALSE;
+  }
+
+  TIFF *tiff = TIFFOpen(path, "r+");
+  if(IS_NULL_PTR(tiff))
+  {
+    fclose(file);
+    return FALSE;
+  }
+
+  char *page_name = NULL;
+  gboolean ok = TIFFSetDirectory(tiff, (tdir_t)header->page) && _page_tiled(tiff)
+                && TIFFGetField(tiff, TIFFTAG_PAGENAME, &page_name) && !g_strcmp0(page_name, header->page_name);
+
+  uint16_t *tile = ok ? g_malloc(DT_DRAWLAYER_SIDECAR_TILE_BYTES) : NULL;
+  const uint32_t tiles = ok ? TIFFNumberOfTiles(tiff) : 0;
+  for(uint32_t k = 0; k < count && ok; k++)
+  {
+    dt_drawlayer_sidecar_journal_record_t record = { 0 };
+    ok = fread(&record, sizeof(record), 1, file) == 1 && fread(tile, DT_DRAWLAYER_SIDECAR_TILE_BYTES, 1, file) == 1
+         && record.tile < tiles
+         && TIFFWriteEncodedTile(tiff, record.tile, tile, DT_DRAWLAYER_SIDECAR_TILE_BYTES) != -1;
+  }
+
+  ok = ok && TIFFFlush(tiff) && g_fsync(TIFFFileno(tiff)) == 0;
+  TIFFClose(tiff);
+  fclose(file);
+  dt_free(tile);
+  return ok;
+}
+
+/** @brief Recovery proper. The caller owns `_sidecar_lock`. */
+static gboolean _recover_locked(const char *path)
+{
+
+  gchar *journal_path = _journal_path(path);
+  if(!g_file_test(journal_path, G_FILE_TEST_EXISTS))
+  {
+    dt_free(journal_path);
+    return TRUE;
+  }
+
+  // Without its commit record, the journal was interrupted before the sidecar got touched:
+  // dropping it rolls the update back.
+  dt_drawlayer_sidecar_journal_header_t header = { 0 };
+  uint32_t count = 0;
+  gboolean ok = TRUE;
+  if(g_file_test(path, G_FILE_TEST_EXISTS) && _journal_committed(journal_path, &header, &count))
+    ok = _replay_journal(path, journal_path, &header, count);
+
+  if(ok)
+  {
+    g_unlink(journal_path);
+    _sync_parent_directory(journal_path);
+  }
+  dt_free(journal_path);
+  return ok;
+}
+
+gboolean dt_drawlayer_sidecar_recover(const char *path)
+{
+  if(IS_NULL_PTR(path)) return FALSE;
+  g_rw_lock_writer_lock(&_sidecar_lock);
+  const gboolean ok = _recover_locked(path);
+  g_rw_lock_writer_unlock(&_sidecar_lock);
+  return ok;
+}
+
+TIFF *dt_drawlayer_sidecar_open(const char *path)
+{
+  if(!dt_drawlayer_sidecar_recover(path)) return NULL;
+
+  g_rw_lock_reader_lock(&_sidecar_lock);
+  TIFF *tiff = TIFFOpen(path, "rb");
+  if(IS_NULL_PTR(tiff)) g_rw_lock_reader_unlock(&_sidecar_lock);
+  return tiff;
+}
+
+void dt_drawlayer_sidecar_close(TIFF *tiff)
+{
+  if(IS_NULL_PTR(tiff)) return;
+  TIFFClose(tiff);
+  g_rw_lock_reader_unlock(&_sidecar_lock);
+}
+
+gboolean dt_drawlayer_sidecar_begin_rewrite(const char *path)
+{
+  if(IS_NULL_PTR(path)) return FALSE;
+  g_rw_lock_writer_lock(&_sidecar_lock);
+  if(_recover_locked(path)) return TRUE;
+  g_rw_lock_writer_unlock(&_sidecar_lock);
+  return FALSE;
+}
+
+void dt_drawlayer_sidecar_end_rewrite(void)
+{
+  g_rw_lock_writer_unlock(&_sidecar_lock);
+}
+
+/** @brief Check the page can be updated in place and leave `tiff` on it. */
+static dt_drawlayer_sidecar_update_t _select_page(TIFF *tiff, const char *path, const int page,
+                                                  const char *page_name)
+{
+  GStatBuf st = { 0 };
+  if(g_stat(path, &st) != 0) return DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+  if((uint64_t)st.st_size > 2 * _live_bytes(tiff) + DT_DRAWLAYER_SIDECAR_SLACK)
+    return DT_DRAWLAYER_SIDECAR_UPDATE_UNSUPPORTED;
+
+  char *name = NULL;
+  if(!TIFFSetDirectory(tiff, (tdir_t)page) || !_page_format_supported(tiff) || !_page_tiled(tiff))
+    return DT_DRAWLAYER_SIDECAR_UPDATE_UNSUPPORTED;
+  TIFFGetField(tiff, TIFFTAG_PAGENAME, &name);
+  if(g_strcmp0(name ? name : "", page_name ? page_name : "")) return DT_DRAWLAYER_SIDECAR_UPDATE_UNSUPPORTED;
+  return DT_DRAWLAYER_SIDECAR_UPDATE_DONE;
+}
+
+static FILE *_journal_open(const char *journal_path, const int page, const char *page_name)
+{
+  FILE *file = g_fopen(journal_path, "wb");
+  if(IS_NULL_PTR(file)) return NULL;
+
+  dt_drawlayer_sidecar_journal_header_t header = { 0 };
+  memcpy(header.magic, _journal_magic, sizeof(_journal_magic));
+  header.page = (uint32_t)page;
+  header.tile_width = DT_DRAWLAYER_SIDECAR_TILE;
+  header.tile_height = DT_DRAWLAYER_SIDECAR_TILE;
+  g_strlcpy(header.page_name, page_name ? page_name : "", sizeof(header.page_name));
+  if(fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+/** @brief Make the records durable, then the commit record. From there on, the update will happen. */
+static gboolean _journal_commit(FILE *file, const char *journal_path, const uint32_t count)
+{
+  dt_drawlayer_sidecar_journal_footer_t footer = { 0 };
+  memcpy(footer.magic, _commit_magic, sizeof(_commit_magic));
+  footer.count = count;
+
+  gboolean ok = _sync_file(file);
+  if(ok) _sync_parent_directory(journal_path);
+  ok = ok && fwrite(&footer, sizeof(footer), 1, file) == 1 && _sync_file(file);
+  return (fclose(file) == 0) && ok;
+}
+
+/** @brief In-place update proper. The caller owns `_sidecar_lock`. */
+static dt_drawlayer_sidecar_update_t _update_tiles_locked(const char *path, const int page, const char *page_name,
+                                                          const int x, const int y, const int width,
+                                                          const int height, dt_drawlayer_sidecar_tile_fn fill,
+                                                          void *user_data, int *written)
+{
+  if(!g_file_test(path, G_FILE_TEST_EXISTS)) return DT_DRAWLAYER_SIDECAR_UPDATE_UNSUPPORTED;
+  if(!_recover_locked(path)) return DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+
+  TIFF *tiff = TIFFOpen(path, "rb");
+  if(IS_NULL_PTR(tiff)) return DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+
+  dt_drawlayer_sidecar_update_t status = _select_page(tiff, path, page, page_name);
+  if(status != DT_DRAWLAYER_SIDECAR_UPDATE_DONE)
+  {
+    TIFFClose(tiff);
+    return status;
+  }
+
+  uint32_t page_width = 0;
+  uint32_t page_height = 0;
+  TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &page_width);
+  TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &page_height);
+  const int x0 = MAX(x, 0);
+  const int y0 = MAX(y, 0);
+  const int x1 = MIN(x + width, (int)page_width);
+  const int y1 = MIN(y + height, (int)page_height);
+  if(x0 >= x1 || y0 >= y1)
+  {
+    TIFFClose(tiff);
+    return DT_DRAWLAYER_SIDECAR_UPDATE_DONE;
+  }
+
+  gchar *journal_path = _journal_path(path);
+  uint16_t *stored = g_malloc(DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+  uint16_t *tile = g_malloc(DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+  FILE *journal = NULL;
+  uint32_t count = 0;
+  gboolean ok = !IS_NULL_PTR(stored) && !IS_NULL_PTR(tile);
+
+  // Strokes commit as their bounding box, which most often leaves many of its tiles
+  // untouched: only tiles whose content really changed get journaled and re-encoded.
+  for(uint32_t ty = y0 - y0 % DT_DRAWLAYER_SIDECAR_TILE; ok && ty < (uint32_t)y1; ty += DT_DRAWLAYER_SIDECAR_TILE)
+    for(uint32_t tx = x0 - x0 % DT_DRAWLAYER_SIDECAR_TILE; ok && tx < (uint32_t)x1; tx += DT_DRAWLAYER_SIDECAR_TILE)
+    {
+      const uint32_t index = TIFFComputeTile(tiff, tx, ty, 0, 0);
+      ok = TIFFReadEncodedTile(tiff, index, stored, DT_DRAWLAYER_SIDECAR_TILE_BYTES) != -1;
+      if(!ok) break;
+
+      memcpy(tile, stored, DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+      fill(user_data, tx, ty, MIN(DT_DRAWLAYER_SIDECAR_TILE, page_width - tx),
+           MIN(DT_DRAWLAYER_SIDECAR_TILE, page_height - ty), tile);
+      if(!memcmp(tile, stored, DT_DRAWLAYER_SIDECAR_TILE_BYTES)) continue;
+
+      if(IS_NULL_PTR(journal)) journal = _journal_open(journal_path, page, page_name);
+      const dt_drawlayer_sidecar_journal_record_t record = { .tile = index };
+      ok = !IS_NULL_PTR(journal) && fwrite(&record, sizeof(record), 1, journal) == 1
+           && fwrite(tile, DT_DRAWLAYER_SIDECAR_TILE_BYTES, 1, journal) == 1;
+      if(ok) count++;
+    }
+
+  TIFFClose(tiff);
+  dt_free(stored);
+  dt_free(tile);
+
+  if(ok && count > 0)
+  {
+    ok = _journal_commit(journal, journal_path, count);
+    journal = NULL;
+    // Once committed, a failed replay is left to the next recovery: never drop the journal then.
+    if(ok)
+      status = _recover_locked(path) ? DT_DRAWLAYER_SIDECAR_UPDATE_DONE : DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+  }
+
+  if(!ok)
+  {
+    if(journal) fclose(journal);
+    // A commit record may have reached the disk even if closing failed: let recovery decide
+    // between replaying and dropping what we wrote.
+    _recover_locked(path);
+    status = DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+  }
+
+  dt_free(journal_path);
+  if(status == DT_DRAWLAYER_SIDECAR_UPDATE_DONE && !IS_NULL_PTR(written)) *written = (int)count;
+  return status;
+}
+
+dt_drawlayer_sidecar_update_t dt_drawlayer_sidecar_update_tiles(const char *path, const int page, const char *page_name,
+                                                                const int x, const int y, const int width,
+                                                                const int height, dt_drawlayer_sidecar_tile_fn fill,
+                                                                void *user_data, int *written)
+{
+  if(!IS_NULL_PTR(written)) *written = 0;
+  if(IS_NULL_PTR(path) || IS_NULL_PTR(fill) || page < 0) return DT_DRAWLAYER_SIDECAR_UPDATE_FAILED;
+
+  g_rw_lock_writer_lock(&_sidecar_lock);
+  const dt_drawlayer_sidecar_update_t status
+      = _update_tiles_locked(path, page, page_name, x, y, width, height, fill, user_data, written);
+  g_rw_lock_writer_unlock(&_sidecar_lock);
+  return status;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
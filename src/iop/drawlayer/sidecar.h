@@ -0,0 +1,154 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_IOP_DRAWLAYER_SIDECAR_H
+#define DT_IOP_DRAWLAYER_SIDECAR_H
+
+#include <glib.h>
+#include <stdint.h>
+#include <tiffio.h>
+
+/** @file
+ *  @brief Tiled page layout and journaled in-place tile updates for drawlayer sidecar TIFFs.
+ *
+ * Layer pages are stored as deflated tiles of half-float RGBA, so one stroke commit only
+ * re-encodes the tiles it touched, in place, instead of rewriting every page of the file.
+ *
+ * In-place writes are made crash-safe by a redo journal next to the sidecar
+ * (`<sidecar>.journal`): the new content of every changed tile is written and synced there
+ * first, then a commit record, and only then are the tiles written into the TIFF. A journal
+ * without its commit record is dropped, the TIFF was not touched yet. A committed one is
+ * replayed by `dt_drawlayer_sidecar_recover()`, which every sidecar access goes through first.
+ *
+ * Unlike the rename ending a full rewrite, in-place writes are not atomic for readers of the
+ * same process: sidecar accesses go through `dt_drawlayer_sidecar_open()` and
+ * `dt_drawlayer_sidecar_begin_rewrite()`, which keep them away from in-flight updates.
+ *
+ * Depends on glib and libtiff only, so tools/benchmark_drawlayer_sidecar.c can build it alone.
+ * Pages written before the tiled layout (strips) are still read; they get tiled the next time
+ * the whole file is rewritten.
+ */
+
+#define DT_DRAWLAYER_SIDECAR_TILE 256
+
+/** @brief Sequential row reader over the current page, tiled or stripped. */
+typedef struct dt_drawlayer_sidecar_reader_t
+{
+  TIFF *tiff;
+  uint32_t width;
+  uint32_t height;
+  gboolean tiled;
+  uint32_t tile_width;
+  uint32_t tile_height;
+  uint16_t *band;    /**< Decoded tile row: `tile_height` rows of `width` RGBA halves. */
+  uint16_t *tile;    /**< One decoded tile. */
+  int64_t band_row;  /**< First page row held in `band`, -1 when none. */
+  void *scanline;    /**< Strip pages only. */
+} dt_drawlayer_sidecar_reader_t;
+
+/** @brief Sequential row writer into the current page, tiled. */
+typedef struct dt_drawlayer_sidecar_writer_t
+{
+  TIFF *tiff;
+  uint32_t width;
+  uint32_t height;
+  uint16_t *band;
+  uint16_t *tile;
+  uint32_t rows; /**< Rows received so far. */
+} dt_drawlayer_sidecar_writer_t;
+
+/**
+ * @brief Fill the new content of one tile.
+ *
+ * `pixels` holds the stored content on entry, RGBA halves with a row stride of
+ * DT_DRAWLAYER_SIDECAR_TILE pixels. Only the `width` × `height` top-left area lies inside
+ * the page. (`x`, `y`) is the page position of the tile.
+ */
+typedef void (*dt_drawlayer_sidecar_tile_fn)(void *user_data, uint32_t x, uint32_t y, uint32_t width,
+                                             uint32_t height, uint16_t *pixels);
+
+typedef enum dt_drawlayer_sidecar_update_t
+{
+  DT_DRAWLAYER_SIDECAR_UPDATE_DONE = 0,    /**< Changed tiles written in place, possibly none. */
+  DT_DRAWLAYER_SIDECAR_UPDATE_UNSUPPORTED, /**< Page not tiled, not found, or file worth compacting: rewrite it. */
+  DT_DRAWLAYER_SIDECAR_UPDATE_FAILED       /**< I/O error. The sidecar holds either the old or the new tiles. */
+} dt_drawlayer_sidecar_update_t;
+
+/** @brief Set the tile layout tags on a page about to be written. */
+gboolean dt_drawlayer_sidecar_set_tile_layout(TIFF *tiff);
+
+/** @brief Start reading the current page of `tiff`: 16-bit float RGBA only. */
+gboolean dt_drawlayer_sidecar_reader_init(dt_drawlayer_sidecar_reader_t *reader, TIFF *tiff);
+/** @brief Read page row `row` into `out` (`width` RGBA halves). Fastest in increasing row order. */
+gboolean dt_drawlayer_sidecar_read_row(dt_drawlayer_sidecar_reader_t *reader, uint32_t row, uint16_t *out);
+void dt_drawlayer_sidecar_reader_cleanup(dt_drawlayer_sidecar_reader_t *reader);
+
+/** @brief Start writing the current page of `tiff`, whose tags are already set. */
+gboolean dt_drawlayer_sidecar_writer_init(dt_drawlayer_sidecar_writer_t *writer, TIFF *tiff, uint32_t width,
+                                          uint32_t height);
+/** @brief Append the next page row, in order. */
+gboolean dt_drawlayer_sidecar_write_row(dt_drawlayer_sidecar_writer_t *writer, const uint16_t *in);
+/** @brief Encode the last partial tile row. All rows must have been written. */
+gboolean dt_drawlayer_sidecar_writer_finish(dt_drawlayer_sidecar_writer_t *writer);
+void dt_drawlayer_sidecar_writer_cleanup(dt_drawlayer_sidecar_writer_t *writer);
+
+/**
+ * @brief Rewrite in place the tiles of page `page` that intersect the page rectangle
+ * (`x`, `y`, `width`, `height`) and whose content `fill` changes.
+ *
+ * `page_name` must match the page: this guards against a page order changed under us.
+ * `written` receives the number of tiles written, when not NULL.
+ */
+dt_drawlayer_sidecar_update_t dt_drawlayer_sidecar_update_tiles(const char *path, int page, const char *page_name,
+                                                                int x, int y, int width, int height,
+                                                                dt_drawlayer_sidecar_tile_fn fill,
+                                                                void *user_data, int *written);
+
+/**
+ * @brief Open the sidecar at `path` for reading, once any interrupted update is finished.
+ *
+ * In-place updates wait until the handle is released by `dt_drawlayer_sidecar_close()`,
+ * which must be called from the same thread.
+ */
+TIFF *dt_drawlayer_sidecar_open(const char *path);
+void dt_drawlayer_sidecar_close(TIFF *tiff);
+
+/**
+ * @brief Take the sidecar at `path` for a full rewrite, once any interrupted update is finished.
+ *
+ * Every other access waits for `dt_drawlayer_sidecar_end_rewrite()`. Nothing is held when
+ * this returns FALSE.
+ */
+gboolean dt_drawlayer_sidecar_begin_rewrite(const char *path);
+void dt_drawlayer_sidecar_end_rewrite(void);
+
+/**
+ * @brief Finish or drop the journal left by an interrupted update of the sidecar at `path`.
+ *
+ * @return FALSE if a committed journal could not be replayed: the sidecar must not be
+ * trusted, nor rewritten, until it is.
+ */
+gboolean dt_drawlayer_sidecar_recover(const char *path);
+
+#endif // DT_IOP_DRAWLAYER_SIDECAR_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
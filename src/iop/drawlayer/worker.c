@@ -362,6 +362,7 @@ void dt_drawlayer_worker_publish_backend_stroke_damage(dt_iop_module_t *self)
   {
     g->process.cache_dirty = TRUE;
     dt_drawlayer_paint_runtime_note_dab_damage(&g->process.cache_dirty_rect, &backend_damage);
+    dt_drawlayer_paint_runtime_note_dab_damage(&g->process.flush_dirty_rect, &backend_damage);
   }
 }
 
@@ -971,6 +972,7 @@ static guint _rasterize_pending_dab_batch(drawlayer_paint_backend_ctx_t *ctx, gi
 
       g->process.cache_dirty = TRUE;
       dt_drawlayer_paint_runtime_note_dab_damage(&g->process.cache_dirty_rect, &absolute_damage);
+      dt_drawlayer_paint_runtime_note_dab_damage(&g->process.flush_dirty_rect, &absolute_damage);
       dt_drawlayer_paint_runtime_note_dab_damage(worker->backend_path, &absolute_damage);
       dt_drawlayer_paint_runtime_note_dab_damage(&worker->live_publish_damage, &absolute_damage);
       g->stroke.last_dab_valid = TRUE;
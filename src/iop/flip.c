@@ -68,6 +68,7 @@
 
 #include "gui/presets.h"
 #include "iop/iop_api.h"
+#include "pixel/geometry_stage.h"
 
 DT_MODULE_INTROSPECTION(2, dt_iop_flip_params_t)
 
@@ -383,6 +384,29 @@ void modify_roi_in(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t
   roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(h) - roi_in->y);
 }
 
+// dt_imageio_flip_buffers() backwards: the input pixel copied to each output pixel.
+int resample_points(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
+                    const dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
+{
+  const dt_iop_flip_data_t *d = (dt_iop_flip_data_t *)piece->data;
+  const float wd = piece->roi_in.width - 1.0f;
+  const float ht = piece->roi_in.height - 1.0f;
+  const dt_image_orientation_t orientation = d->orientation;
+
+  __OMP_PARALLEL_FOR__(if(points_count > 500))
+  for(size_t k = 0; k < points_count * 2; k += 2)
+  {
+    const float x = points[k];
+    const float y = points[k + 1];
+    const float i = (orientation & ORIENTATION_SWAP_XY) ? y : x;
+    const float j = (orientation & ORIENTATION_SWAP_XY) ? x : y;
+    points[k] = (orientation & ORIENTATION_FLIP_X) ? wd - i : i;
+    points[k + 1] = (orientation & ORIENTATION_FLIP_Y) ? ht - j : j;
+  }
+
+  return DT_GEOMETRY_STAGE_COPY;
+}
+
 // 3rd (final) pass: you get this input region (may be different from what was requested above),
 // do your best to fill the output region!
 int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -82,6 +82,7 @@
 #include "iop/highlights/laplacian.h"
 #include "iop/highlights/lch.h"
 #include "iop/highlights/process.h"
+#include "pixel/raw_stage.h"
 
 #include <gtk/gtk.h>
 #include <inttypes.h>
@@ -676,6 +677,25 @@ static gboolean _highlights_mode_supported(const dt_iop_highlights_mode_t mode,
           || mode == DT_IOP_HIGHLIGHTS_HARMONIC);
 }
 
+int raw_stage(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+              dt_raw_stage_t *stage)
+{
+  const dt_iop_highlights_data_t *const data = (dt_iop_highlights_data_t *)piece->data;
+  const dt_iop_highlights_gui_data_t *const g = (dt_iop_highlights_gui_data_t *)dt_iop_gui_data(self);
+  // Same visualization test as process(): the preview replaces the output.
+  const gboolean visualizing = !IS_NULL_PTR(g) && g->show_visualize && self->dev->gui_attached
+                               && pipe == self->dev->pipe;
+  if(data->mode != DT_IOP_HIGHLIGHTS_CLIP || !piece->dsc_in.filters || visualizing)
+    return DT_RAW_STAGE_NONE;
+
+  dt_aligned_pixel_t pmax;
+  for(int c = 0; c < 4; c++)
+    pmax[c] = (piece->dsc_in.processed_maximum[c] > 0.f) ? piece->dsc_in.processed_maximum[c] : 1.0f;
+  stage->clip = data->clip * fminf(pmax[0], fminf(pmax[1], pmax[2]));
+  stage->min_clipped = DT_HL_MIN_CLIPPED_PIXELS;
+  return DT_RAW_STAGE_CLIP;
+}
+
 __DT_CLONE_TARGETS__
 int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
             const void *const ivoid, void *const ovoid)
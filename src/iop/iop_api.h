@@ -62,6 +62,7 @@ struct dt_geometry_record_t;
 struct dt_iop_roi_t;
 struct dt_develop_tiling_t;
 struct dt_iop_buffer_dsc_t;
+struct dt_raw_stage_t;
 struct dt_gui_module_t;
 struct _GtkWidget;
 
@@ -350,6 +351,28 @@ OPTIONAL(int, populate_masks_context_menu, struct dt_iop_module_t *self, GtkWidg
  */
 OPTIONAL(void, autoset, struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe, const struct dt_dev_pixelpipe_iop_t *piece, const void *i);
 
+/**
+ * @brief Describe the pointwise work of process() on a raw mosaic, for the pipeline to run it
+ * fused with its neighbours in one pass (see pixel/raw_stage.h).
+ *
+ * Fill only the fields of your step in @p stage. Return the dt_raw_stage_step_t you filled, or
+ * DT_RAW_STAGE_NONE when process() does more than that with the current parameters.
+ */
+OPTIONAL(int, raw_stage, struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe, const struct dt_dev_pixelpipe_iop_t *piece, struct dt_raw_stage_t *stage);
+
+/**
+ * @brief Tell where process() reads its input for each point of its output, for the pipeline
+ * to resample consecutive geometric modules once (see pixel/geometry_stage.h).
+ *
+ * Points are (x, y) pairs in pixels of the output buffer, that is relative to piece->roi_out,
+ * and not necessarily on integers. Overwrite them with the positions process() samples in the
+ * input buffer, relative to piece->roi_in. Called with no points to only ask.
+ *
+ * Return the dt_geometry_stage_sampling_t of process(), or DT_GEOMETRY_STAGE_NONE when it does
+ * more than moving pixels with the current parameters.
+ */
+OPTIONAL(int, resample_points, struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe, const struct dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
@@ -80,6 +80,7 @@
 #include "config.h"
 #endif
 #include "widgets/bauhaus.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "common/file_location.h"
 #include "common/imagebuf.h"
@@ -665,6 +666,49 @@ static inline void _lens_fill_vignette_row(float *const buf, const int width, co
   }
 }
 
+/* Composable when the correction is a single displacement for the whole pixel: no TCA, which
+ * moves each channel on its own, and no vignetting, which changes values. Points are taken
+ * from the green channel and clamped to the input, as process() does. */
+int resample_points(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                    float *points, size_t points_count)
+{
+  const dt_iop_roi_t *const roi_in = &piece->roi_in;
+  const dt_iop_roi_t *const roi_out = &piece->roi_out;
+  const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+
+  if(!d->ls_have || d->crop <= 0.0f) return DT_GEOMETRY_STAGE_COPY;
+  if(dt_image_is_monochrome(&self->dev->image_storage) || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE)
+    return DT_GEOMETRY_STAGE_NONE;
+
+  const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
+
+  dt_pthread_mutex_lock(dt_plugin_threadsafe_mutex());
+  int modflags;
+  ls_modifier_t modifier;
+  get_modifier(&modflags, orig_w, orig_h, d, DT_LENS_MODIFY_ALL, FALSE, &modifier);
+  dt_pthread_mutex_unlock(dt_plugin_threadsafe_mutex());
+
+  if(modflags & (DT_LENS_MODIFY_TCA | DT_LENS_MODIFY_VIGNETTING)) return DT_GEOMETRY_STAGE_NONE;
+  if(!(modflags & (DT_LENS_MODIFY_DISTORTION | DT_LENS_MODIFY_GEOMETRY | DT_LENS_MODIFY_SCALE)))
+    return DT_GEOMETRY_STAGE_COPY;
+
+  __OMP_PARALLEL_FOR__(firstprivate(points, points_count, modifier, d, roi_in, roi_out) if(points_count > 100))
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    float DT_ALIGNED_ARRAY buf[6];
+    ls_modifier_apply_subpixel_geometry(&modifier, roi_out->x + points[i], roi_out->y + points[i + 1], 1, 1, buf);
+    if(d->do_nan_checks && (!isfinite(buf[2]) || !isfinite(buf[3])))
+    {
+      points[i] = points[i + 1] = NAN;
+      continue;
+    }
+    points[i] = fmaxf(fminf(buf[2] - roi_in->x, roi_in->width - 1.0f), 0.0f);
+    points[i + 1] = fmaxf(fminf(buf[3] - roi_in->y, roi_in->height - 1.0f), 0.0f);
+  }
+
+  return DT_GEOMETRY_STAGE_RESAMPLE;
+}
+
 /* Why do we care about being a monochrome image or not?
  The lensfun library does not have an algorithm for distortion or tca correction specialized for monochrome images,
    the builtin correction works with subtle differences for the color channels leading to some colorizing of the images.
@@ -493,6 +493,9 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
   piece->request_histogram |= (DT_REQUEST_ONLY_IN_GUI);
 
   piece->histogram_params.bins_count = 256;
+  // The histogram is drawn, but the "auto" button also takes the levels from its counts:
+  // bin every pixel, in every mode.
+  piece->histogram_params.max_samples = 0;
 
   if(p->mode == LEVELS_MODE_AUTOMATIC)
   {
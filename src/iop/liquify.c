@@ -55,6 +55,7 @@
 #include "system/mem_alloc.h"
 #include "common/logging.h"
 #include "common/module_versioning.h"
+#include "common/hash.h"
 #include "pixel/interpolation.h"
 #include "common/opencl.h"
 #include "math/math.h"
@@ -295,9 +296,31 @@ typedef struct
   dt_liquify_path_data_t nodes[MAX_NODES];
 } dt_iop_liquify_params_t;
 
+#define LIQUIFY_MAP_CACHE_SLOTS 4
+#define LIQUIFY_MAP_CACHE_BYTES ((size_t)128 << 20)
+
+/** @brief A rasterised distortion map, shared between its users and the map cache. */
+typedef struct dt_liquify_map_t
+{
+  uint64_t hash;                  ///< folded paths, scale, roi and direction: see _get_distortion_map()
+  cairo_rectangle_int_t extent;   ///< union of the warps the map covers, empty when none
+  float complex *map;             ///< NULL when the extent is empty
+  int refs;                       ///< one per user, plus one while held by the cache
+  uint64_t last_use;
+} dt_liquify_map_t;
+
 typedef struct
 {
   int warp_kernel;
+
+  /* Last distortion maps built by any pipe or geometry query, least recently used evicted.
+   * Kept here rather than in the shared pixelpipe cache: while a node is dragged, every frame
+   * gives a new map that is dead the moment the next one lands, and publishing those would
+   * evict the pipeline's own outputs (see the same finding in develop/masks/group.c).
+   * Guarded by lock. */
+  dt_pthread_mutex_t lock;
+  dt_liquify_map_t *maps[LIQUIFY_MAP_CACHE_SLOTS];
+  uint64_t clock;
 } dt_iop_liquify_global_data_t;
 
 typedef struct
@@ -963,6 +986,41 @@ static void compute_round_stamp_extent(cairo_rectangle_int_t *const restrict sta
   stamp_extent->width = stamp_extent->height = 2 * iradius + 1;
 }
 
+static inline float complex stamp_strength(const dt_liquify_warp_t *const restrict warp)
+{
+  // 0.5 is factored in so the warp starts to degenerate when the
+  // strength arrow crosses the warp radius.
+  const float complex strength = 0.5f * (warp->strength - warp->point);
+  return (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) ?
+    (strength * STAMP_RELOCATION) : strength;
+}
+
+/*
+  The warp vector of a round stamp at offset (dx, dy) from its center, given
+  the lookup table value at that distance. Shared by the rasterised stamp and
+  the direct evaluation of single points, so both give the same vectors.
+*/
+
+static inline float complex stamp_vector(const dt_liquify_warp_type_enum_t type,
+                                         const float complex strength,
+                                         const float abs_strength,
+                                         const float lookup,
+                                         const int iradius,
+                                         const float dx,
+                                         const float dy)
+{
+  const float abs_lookup = abs_strength * lookup / iradius;
+  switch(type)
+  {
+    case DT_LIQUIFY_WARP_TYPE_RADIAL_GROW:
+      return abs_lookup * (dx + dy * I);
+    case DT_LIQUIFY_WARP_TYPE_RADIAL_SHRINK:
+      return -abs_lookup * (dx + dy * I);
+    default:
+      return strength * lookup;
+  }
+}
+
 /*
   Compute a round(circular) stamp.
 
@@ -993,11 +1051,7 @@ static int build_round_stamp(float complex **pstamp,
   stamp_extent->x = stamp_extent->y = -iradius;
   stamp_extent->width = stamp_extent->height = 2 * iradius + 1;
 
-  // 0.5 is factored in so the warp starts to degenerate when the
-  // strength arrow crosses the warp radius.
-  float complex strength = 0.5f * (warp->strength - warp->point);
-  strength = (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) ?
-    (strength * STAMP_RELOCATION) : strength;
+  const float complex strength = stamp_strength(warp);
   const float abs_strength = cabsf(strength);
 
   float complex *restrict stamp =
@@ -1039,28 +1093,11 @@ static int build_round_stamp(float complex **pstamp,
       float complex *const q3 = center + y * stamp_extent->width - x;
       float complex *const q4 = center + y * stamp_extent->width + x;
 
-      float abs_lookup = abs_strength * lookup_table[idist] / iradius;
-
-      switch (warp->type)
-      {
-         case DT_LIQUIFY_WARP_TYPE_RADIAL_GROW:
-           *q1 = abs_lookup * ( x - y * I);
-           *q2 = abs_lookup * (-x - y * I);
-           *q3 = abs_lookup * (-x + y * I);
-           *q4 = abs_lookup * ( x + y * I);
-           break;
-
-         case DT_LIQUIFY_WARP_TYPE_RADIAL_SHRINK:
-           *q1 = -abs_lookup * ( x - y * I);
-           *q2 = -abs_lookup * (-x - y * I);
-           *q3 = -abs_lookup * (-x + y * I);
-           *q4 = -abs_lookup * ( x + y * I);
-           break;
-
-         default:
-           *q1 = *q2 = *q3 = *q4 = strength * lookup_table[idist];
-           break;
-      }
+      const float lookup = lookup_table[idist];
+      *q1 = stamp_vector(warp->type, strength, abs_strength, lookup, iradius,  x, -y);
+      *q2 = stamp_vector(warp->type, strength, abs_strength, lookup, iradius, -x, -y);
+      *q3 = stamp_vector(warp->type, strength, abs_strength, lookup, iradius, -x,  y);
+      *q4 = stamp_vector(warp->type, strength, abs_strength, lookup, iradius,  x,  y);
     }
   }
 
@@ -1309,29 +1346,203 @@ static float complex *create_global_distortion_map(const cairo_rectangle_int_t *
   return map;
 }
 
-static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_t *pipe,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+/* The interpolated warps depend on the node types, links and geometry, not on the hover and
+ * selection state kept in the same nodes: only the former goes into the map keys. */
+static uint64_t _paths_hash(const dt_iop_liquify_params_t *const p)
 {
-  // copy params
-  dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  uint64_t hash = 5381;
+  for(int k = 0; k < MAX_NODES; k++)
+  {
+    const dt_liquify_path_data_t *data = &p->nodes[k];
+    if(data->header.type == DT_LIQUIFY_PATH_INVALIDATED)
+      break;
 
-  distort_paths_raw_to_piece(module, pipe, roi_in->scale, &copy_params, FALSE);
+    hash = dt_hash(hash, (const char *)&data->header.type, sizeof(data->header.type));
+    hash = dt_hash(hash, (const char *)&data->header.prev, sizeof(data->header.prev));
+    hash = dt_hash(hash, (const char *)&data->header.next, sizeof(data->header.next));
+    hash = dt_hash(hash, (const char *)&data->warp, sizeof(dt_liquify_warp_t));
+    hash = dt_hash(hash, (const char *)&data->node, sizeof(dt_liquify_node_t));
+  }
+  return hash;
+}
 
-  GList *interpolated = interpolate_paths(&copy_params);
-  GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, map_extent);
+/* The key is taken on the nodes once folded into this module's input space at @p scale, not on
+ * the raw parameters: a change upstream that moves the paths misses the cache as it should. */
+static uint64_t _map_hash(const dt_iop_liquify_params_t *const folded, const float scale,
+                          const dt_iop_roi_t *const roi, const gboolean inverted)
+{
+  const int rect[4] = { roi->x, roi->y, roi->width, roi->height };
+  uint64_t hash = _paths_hash(folded);
+  hash = dt_hash(hash, (const char *)&scale, sizeof(scale));
+  hash = dt_hash(hash, (const char *)rect, sizeof(rect));
+  return dt_hash(hash, (const char *)&inverted, sizeof(inverted));
+}
+
+static size_t _map_bytes(const dt_liquify_map_t *const m)
+{
+  return sizeof(float complex) * (size_t)m->extent.width * m->extent.height;
+}
+
+static void _map_unref_locked(dt_liquify_map_t *m)
+{
+  if(--m->refs > 0) return;
+  dt_pixelpipe_cache_free_align(m->map);
+  dt_free(m);
+}
+
+static void _map_release(dt_iop_module_t *module, dt_liquify_map_t *m)
+{
+  if(IS_NULL_PTR(m)) return;
+  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *)module->global_data;
+  dt_pthread_mutex_lock(&gd->lock);
+  _map_unref_locked(m);
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
+static dt_liquify_map_t *_map_lookup(dt_iop_module_t *module, const uint64_t hash)
+{
+  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *)module->global_data;
+  dt_liquify_map_t *found = NULL;
+  dt_pthread_mutex_lock(&gd->lock);
+  for(int k = 0; k < LIQUIFY_MAP_CACHE_SLOTS; k++)
+  {
+    dt_liquify_map_t *m = gd->maps[k];
+    if(!IS_NULL_PTR(m) && m->hash == hash)
+    {
+      m->refs++;
+      m->last_use = ++gd->clock;
+      found = m;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+  return found;
+}
+
+static void _map_publish(dt_iop_module_t *module, dt_liquify_map_t *m)
+{
+  const size_t bytes = _map_bytes(m);
+  if(bytes > LIQUIFY_MAP_CACHE_BYTES) return; // full-resolution exports: built once, used once
+
+  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *)module->global_data;
+  dt_pthread_mutex_lock(&gd->lock);
+
+  // another pipe may have built the same map meanwhile: the first one stays
+  for(int k = 0; k < LIQUIFY_MAP_CACHE_SLOTS; k++)
+    if(!IS_NULL_PTR(gd->maps[k]) && gd->maps[k]->hash == m->hash)
+    {
+      dt_pthread_mutex_unlock(&gd->lock);
+      return;
+    }
+
+  int slot = -1;
+  while(TRUE)
+  {
+    size_t held = 0;
+    int lru = -1;
+    slot = -1;
+    for(int k = 0; k < LIQUIFY_MAP_CACHE_SLOTS; k++)
+    {
+      const dt_liquify_map_t *const c = gd->maps[k];
+      if(IS_NULL_PTR(c))
+      {
+        slot = k;
+        continue;
+      }
+      held += _map_bytes(c);
+      if(lru < 0 || c->last_use < gd->maps[lru]->last_use) lru = k;
+    }
+    if(slot >= 0 && held + bytes <= LIQUIFY_MAP_CACHE_BYTES) break;
+
+    // maps still in use by another thread are only dropped from the cache, freed by their last user
+    _map_unref_locked(gd->maps[lru]);
+    gd->maps[lru] = NULL;
+  }
+
+  m->refs++;
+  m->last_use = ++gd->clock;
+  gd->maps[slot] = m;
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
+static void _map_cache_flush(dt_iop_liquify_global_data_t *gd)
+{
+  dt_pthread_mutex_lock(&gd->lock);
+  for(int k = 0; k < LIQUIFY_MAP_CACHE_SLOTS; k++)
+  {
+    if(IS_NULL_PTR(gd->maps[k])) continue;
+    _map_unref_locked(gd->maps[k]);
+    gd->maps[k] = NULL;
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
+/* Rasterise the map of the warps already selected by _get_map_extent() and hand it to the
+ * cache. The caller holds one reference. NULL on allocation failure. */
+static dt_liquify_map_t *_map_build(dt_iop_module_t *module, const uint64_t hash,
+                                    const GSList *interpolated_in_roi,
+                                    const cairo_rectangle_int_t *const map_extent, const gboolean inverted)
+{
+  dt_liquify_map_t *m = calloc(1, sizeof(dt_liquify_map_t));
+  if(IS_NULL_PTR(m)) return NULL;
+
+  m->hash = hash;
+  m->extent = *map_extent;
+  m->refs = 1;
+  m->map = create_global_distortion_map(&m->extent, interpolated_in_roi, inverted);
+  if(IS_NULL_PTR(m->map) && m->extent.width != 0 && m->extent.height != 0)
+  {
+    dt_free(m);
+    return NULL;
+  }
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated_in_roi, FALSE);
+  _map_publish(module, m);
+  return m;
+}
+
+/**
+ * @brief The distortion map of the @p folded paths over the warps overlapping @p roi, from the
+ * cache when the same one was built before.
+ *
+ * @p folded are the parameters already brought into this module's input space at @p scale.
+ * Release the result with _map_release(). Its map is NULL when no warp overlaps @p roi.
+ *
+ * @return NULL on allocation failure.
+ */
+static dt_liquify_map_t *_get_distortion_map(dt_iop_module_t *module, dt_iop_liquify_params_t *folded,
+                                             const float scale, const dt_iop_roi_t *const roi,
+                                             const gboolean inverted)
+{
+  const uint64_t hash = _map_hash(folded, scale, roi, inverted);
+  dt_liquify_map_t *m = _map_lookup(module, hash);
+  if(!IS_NULL_PTR(m)) return m;
+
+  GList *interpolated = interpolate_paths(folded);
+  cairo_rectangle_int_t map_extent;
+  GSList *interpolated_in_roi = _get_map_extent(roi, interpolated, &map_extent);
+
+  m = _map_build(module, hash, interpolated_in_roi, &map_extent, inverted);
 
   g_slist_free(interpolated_in_roi);
   interpolated_in_roi = NULL;
   g_list_free_full(interpolated, dt_free_gpointer);
   interpolated = NULL;
-  return map;
+  return m;
+}
+
+static dt_liquify_map_t *build_global_distortion_map(struct dt_iop_module_t *module,
+                                                     const dt_dev_pixelpipe_t *pipe,
+                                                     const dt_dev_pixelpipe_iop_t *piece,
+                                                     const dt_iop_roi_t *roi_in,
+                                                     const dt_iop_roi_t *roi_out)
+{
+  // copy params
+  dt_iop_liquify_params_t copy_params;
+  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+
+  distort_paths_raw_to_piece(module, pipe, roi_in->scale, &copy_params, FALSE);
+
+  return _get_distortion_map(module, &copy_params, roi_in->scale, roi_out, FALSE);
 }
 
 // 1st pass: how large would the output be, given this input roi?
@@ -1405,15 +1616,136 @@ void modify_roi_in(struct dt_iop_module_t *module, const struct dt_dev_pixelpipe
   cairo_region_destroy(roi_in_region);
 }
 
+/* One warp's stamp, ready to be evaluated at single points instead of rasterised. */
+typedef struct
+{
+  const dt_liquify_warp_t *warp;
+  float cx, cy;              // center, rounded as add_to_global_distortion_map() places the stamp
+  int iradius;
+  int table_size;
+  float complex strength;
+  float abs_strength;
+  float *lookup;
+} dt_liquify_point_stamp_t;
+
+/* What the rasterised map holds at map position (x, y): minus the sum of the stamps covering
+ * it, accumulated in the same order, so integer positions get the same floats. Off the grid, the
+ * distance is still quantized to 1 / LOOKUP_OVERSAMPLE pixel. */
+static inline float complex _stamps_at(const dt_liquify_point_stamp_t *const restrict stamps, const int count,
+                                       const float x, const float y)
+{
+  float complex d = 0.0f;
+  for(int k = 0; k < count; k++)
+  {
+    const dt_liquify_point_stamp_t *const s = stamps + k;
+    const float dx = x - s->cx;
+    const float dy = y - s->cy;
+    if(fabsf(dx) > s->iradius || fabsf(dy) > s->iradius) continue;
+
+    const int idist = round(dt_fast_hypotf(fabsf(dx), fabsf(dy)) * LOOKUP_OVERSAMPLE);
+    if(idist >= s->table_size) continue;
+
+    d -= stamp_vector(s->warp->type, s->strength, s->abs_strength, s->lookup[idist], s->iradius, dx, dy);
+  }
+  return d;
+}
+
+/*
+  Warp points one by one, without rasterising anything: O(points x warps).
+
+  Backwards, a point gets the map value at its pixel, as _liquify_warp_points() would read it
+  from the map. Forwards, the rasterised map used to be inverted by scattering every pixel to
+  where it lands and filling the gaps. Here the pixel u that lands on the point p, u + map(u) = p,
+  is solved by fixed point iteration instead: the warp is a contraction as long as no strength
+  arrow crosses its radius, which is where stamps start to degenerate anyway.
+*/
+static int _warp_points_direct(const GSList *warps, float *const restrict points, const size_t points_count,
+                               const gboolean inverted)
+{
+  const int count = g_slist_length((GSList *)warps);
+  if(count == 0) return 1;
+
+  dt_liquify_point_stamp_t *stamps = calloc(count, sizeof(dt_liquify_point_stamp_t));
+  if(IS_NULL_PTR(stamps)) return 0;
+
+  int k = 0;
+  for(const GSList *i = warps; i; i = g_slist_next(i), k++)
+  {
+    const dt_liquify_warp_t *warp = (const dt_liquify_warp_t *)i->data;
+    dt_liquify_point_stamp_t *s = stamps + k;
+    s->warp = warp;
+    s->cx = round(crealf(warp->point));
+    s->cy = round(cimagf(warp->point));
+    s->iradius = round(cabsf(warp->radius - warp->point));
+    s->table_size = s->iradius * LOOKUP_OVERSAMPLE;
+    s->strength = stamp_strength(warp);
+    s->abs_strength = cabsf(s->strength);
+  }
+
+  int err = 0;
+  __OMP_PARALLEL_FOR__(if(count > 16) reduction(|:err))
+  for(int j = 0; j < count; j++)
+  {
+    stamps[j].lookup = build_lookup_table(stamps[j].table_size, stamps[j].warp->control1,
+                                          stamps[j].warp->control2);
+    if(IS_NULL_PTR(stamps[j].lookup)) err |= 1;
+  }
+
+  if(!err)
+  {
+    __OMP_PARALLEL_FOR__(if(points_count > 100))
+    for(size_t i = 0; i < points_count; i++)
+    {
+      float *const px = &points[i * 2];
+      float *const py = &points[i * 2 + 1];
+
+      if(!inverted)
+      {
+        const float complex d = _stamps_at(stamps, count, (int)(*px - 0.5), (int)(*py - 0.5));
+        *px += crealf(d);
+        *py += cimagf(d);
+        continue;
+      }
+
+      const float x = *px - 0.5f;
+      const float y = *py - 0.5f;
+      float ux = x;
+      float uy = y;
+      float complex d = 0.0f;
+      for(int iter = 0; iter < 8; iter++)
+      {
+        d = _stamps_at(stamps, count, ux, uy);
+        const float nx = x - crealf(d);
+        const float ny = y - cimagf(d);
+        const float step = fabsf(nx - ux) + fabsf(ny - uy);
+        ux = nx;
+        uy = ny;
+        if(step < 1e-2f) break;
+      }
+      *px -= crealf(d);
+      *py -= cimagf(d);
+    }
+  }
+
+  for(int j = 0; j < count; j++) dt_pixelpipe_cache_free_align(stamps[j].lookup);
+  dt_free(stamps);
+  return !err;
+}
+
 /**
  * @brief Warp @p points, given this module's parameters brought into its own input space.
  *
  * @details The whole of the transform, minus where the parameters come from and minus how the
  * path nodes are composed out of RAW coordinates. Those two are the caller's: the pixel pipe
  * takes them from a piece and folds through the pipe, the geometry service takes them from a
- * record and folds through the chain. Everything after that -- interpolating the paths,
- * rasterising the warp map over the points' extent, inverting it for the forward direction --
- * is the same code either way, which is the point.
+ * record and folds through the chain. Everything after that -- interpolating the paths, then
+ * either evaluating the warps at each point or reading a map rasterised over the points'
+ * extent -- is the same code either way, which is the point.
+ *
+ * A map is only worth it for dense queries: a mask outline or the corners of a ROI are a few
+ * hundred points spread over most of the image, which direct evaluation handles without
+ * touching the pixels in between. When a map is rasterised, it goes to the map cache, where the
+ * next query over the same extent finds it.
  */
 static int _liquify_warp_points(const dt_iop_liquify_params_t *const params_in,
                                 dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
@@ -1448,24 +1780,56 @@ static int _liquify_warp_points(const dt_iop_liquify_params_t *const params_in,
     else
       distort_paths_raw_to_piece(self, pipe, 1.f, &copy_params, TRUE);
 
-    // create the distortion map for this extent
+    dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
+    const uint64_t hash = _map_hash(&copy_params, 1.f, &roi_in, inverted);
+    dt_liquify_map_t *m = _map_lookup(self, hash);
 
-    GList *interpolated = interpolate_paths(&copy_params);
+    if(IS_NULL_PTR(m))
+    {
+      GList *interpolated = interpolate_paths(&copy_params);
 
-    // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
-    // the warps that are in (possibly partly) in this same region.
+      // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
+      // the warps that are in (possibly partly) in this same region.
+      GSList *interpolated_in_roi = _get_map_extent(&roi_in, interpolated, &extent);
 
-    dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
-    GSList *interpolated_in_roi = _get_map_extent(&roi_in, interpolated, &extent);
+      // rasterising costs the map area plus the stamps, evaluating costs every point against every
+      // warp, a few times over when the iteration of the inverse runs.
+      size_t raster_cost = (size_t)extent.width * extent.height;
+      size_t warps_count = 0;
+      for(const GSList *i = interpolated_in_roi; i; i = g_slist_next(i), warps_count++)
+      {
+        const dt_liquify_warp_t *warp = (const dt_liquify_warp_t *)i->data;
+        const size_t side = 2 * (size_t)round(cabsf(warp->radius - warp->point)) + 1;
+        raster_cost += side * side;
+      }
+      const size_t direct_cost = points_count * warps_count * (inverted ? 4 : 1);
+
+      int res = 1;
+      if(direct_cost < raster_cost)
+        res = _warp_points_direct(interpolated_in_roi, points, points_count, inverted);
+      else
+      {
+        m = _map_build(self, hash, interpolated_in_roi, &extent, inverted);
+        res = !IS_NULL_PTR(m);
+      }
 
-    float complex *map = create_global_distortion_map(&extent, interpolated_in_roi, inverted);
-    g_slist_free(interpolated_in_roi);
-    interpolated_in_roi = NULL;
-    g_list_free_full(interpolated, dt_free_gpointer);
-    interpolated = NULL;
+      g_slist_free(interpolated_in_roi);
+      interpolated_in_roi = NULL;
+      g_list_free_full(interpolated, dt_free_gpointer);
+      interpolated = NULL;
 
-    if(IS_NULL_PTR(map)) return 0;
+      if(IS_NULL_PTR(m)) return res;
+    }
+
+    if(IS_NULL_PTR(m->map))
+    {
+      // no warp reaches the points
+      _map_release(self, m);
+      return 1;
+    }
 
+    const float complex *const map = m->map;
+    extent = m->extent;
     const int map_size =  extent.width * extent.height;
     const int x_last = extent.x + extent.width;
     const int y_last = extent.y + extent.height;
@@ -1488,7 +1852,7 @@ static int _liquify_warp_points(const dt_iop_liquify_params_t *const params_in,
       }
     }
 
-    dt_pixelpipe_cache_free_align(map);
+    _map_release(self, m);
   }
 
   return 1;
@@ -1536,9 +1900,9 @@ int distort_backtransform(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe,
  * the chain (dt_geometry_chain_compose(), bounded BACK_EXCL of this module's own iop_order so
  * the recursion terminates).
  *
- * The cost is inherited, not introduced: each query rasterises a warp map over the extent of
- * the points it was given, so it is O(area), not O(points), exactly as the pipe's own
- * distort_transform() has always been.
+ * The cost is the pipe's own distort_transform()'s: sparse queries evaluate the warps at each
+ * point, O(points x warps), and dense ones read a map rasterised over the points' extent, which
+ * the map cache keeps for the next query over the same extent (see _liquify_warp_points()).
  */
 
 static int _liquify_geometry_transform(const void *data, const dt_geometry_record_t *const record,
@@ -1597,21 +1961,15 @@ void distort_mask(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(self, pipe, piece, roi_in, roi_out, &map_extent);
-  if(IS_NULL_PTR(map))
-  {
-    if(map_extent.width != 0 && map_extent.height != 0) return;
-    return;
-  }
+  dt_liquify_map_t *m = build_global_distortion_map(self, pipe, piece, roi_in, roi_out);
+  if(IS_NULL_PTR(m)) return;
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
-    apply_global_distortion_map(self, piece, in, out, roi_in, roi_out, 1, map, &map_extent);
-
-  dt_pixelpipe_cache_free_align(map);
+  if(!IS_NULL_PTR(m->map))
+    apply_global_distortion_map(self, piece, in, out, roi_in, roi_out, 1, m->map, &m->extent);
 
+  _map_release(self, m);
 }
 
 __DT_CLONE_TARGETS__
@@ -1638,20 +1996,15 @@ int process(struct dt_iop_module_t *module, const dt_dev_pixelpipe_t *pipe, cons
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(module, pipe, piece, roi_in, roi_out, &map_extent);
-  if(IS_NULL_PTR(map))
-  {
-    if(map_extent.width != 0 && map_extent.height != 0) return 1;
-    return 0;
-  }
+  dt_liquify_map_t *m = build_global_distortion_map(module, pipe, piece, roi_in, roi_out);
+  if(IS_NULL_PTR(m)) return 1;
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
-    apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, 1, map, &map_extent);
+  if(!IS_NULL_PTR(m->map))
+    apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, 1, m->map, &m->extent);
 
-  dt_pixelpipe_cache_free_align(map);
+  _map_release(module, m);
 
   return 0;
 }
@@ -1809,18 +2162,17 @@ int process_cl(struct dt_iop_module_t *module, const dt_dev_pixelpipe_t *pipe,
   }
 
   // 2. build the distortion map
-  cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map(module, pipe, piece, roi_in, roi_out, &map_extent);
-  if(IS_NULL_PTR(map))
+  dt_liquify_map_t *m = build_global_distortion_map(module, pipe, piece, roi_in, roi_out);
+  if(IS_NULL_PTR(m)) return FALSE;
+  if(IS_NULL_PTR(m->map))
   {
-    if(map_extent.width != 0 && map_extent.height != 0) return FALSE;
+    _map_release(module, m);
     return TRUE;
   }
 
   // 3. apply the map
-  if(map_extent.width != 0 && map_extent.height != 0)
-    err = apply_global_distortion_map_cl(module, pipe, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
-  dt_pixelpipe_cache_free_align(map);
+  err = apply_global_distortion_map_cl(module, pipe, piece, dev_in, dev_out, roi_in, roi_out, m->map, &m->extent);
+  _map_release(module, m);
   if(err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1836,9 +2188,10 @@ void init_global(dt_iop_module_so_t *module)
 {
   // called once at startup
   const int program = 17; // from programs.conf
-  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *) malloc(sizeof(dt_iop_liquify_global_data_t));
+  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *) calloc(1, sizeof(dt_iop_liquify_global_data_t));
   module->data = gd;
   gd->warp_kernel = dt_opencl_create_kernel(program, "warp_kernel");
+  dt_pthread_mutex_init(&gd->lock, NULL);
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
@@ -1846,6 +2199,8 @@ void cleanup_global(dt_iop_module_so_t *module)
   // called once at shutdown
   dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *) module->data;
   dt_opencl_free_kernel(gd->warp_kernel);
+  _map_cache_flush(gd);
+  dt_pthread_mutex_destroy(&gd->lock);
   dt_free(module->data);
 }
 
@@ -57,6 +57,7 @@
 #include "gui/presets.h"
 #include "iop/iop_api.h"
 #include "common/dng_opcode.h"
+#include "pixel/raw_stage.h"
 
 #include <gtk/gtk.h>
 #include <stdint.h>
@@ -459,6 +460,30 @@ void autoset(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe
   // Do we need to handle float mosaiced images and non-mosaiced (sRAW) images too ?
 }
 
+int raw_stage(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+              dt_raw_stage_t *stage)
+{
+  const dt_iop_rawprepare_data_t *const d = (dt_iop_rawprepare_data_t *)piece->data;
+  // Gain maps are interpolated per photosite, which is not a pointwise scaling.
+  if(!piece->dsc_in.filters || piece->dsc_in.channels != 1 || d->apply_gainmaps
+     || (piece->dsc_in.datatype != TYPE_UINT16 && piece->dsc_in.datatype != TYPE_FLOAT))
+    return DT_RAW_STAGE_NONE;
+
+  const dt_iop_roi_t *const roi_in = &piece->roi_in;
+  for(int k = 0; k < 4; k++)
+  {
+    stage->sub[k] = d->sub[k];
+    stage->div[k] = d->div[k];
+  }
+  stage->prepare_x = piece->roi_out.x + d->x;
+  stage->prepare_y = piece->roi_out.y + d->y;
+  stage->input_x = compute_proper_crop(piece, roi_in, d->x);
+  stage->input_y = compute_proper_crop(piece, roi_in, d->y);
+  stage->input_width = roi_in->width;
+  stage->input_float = (piece->dsc_in.datatype == TYPE_FLOAT);
+  return DT_RAW_STAGE_PREPARE;
+}
+
 /* Some comments about the cpu code path; tests with gcc 10.x show a clear performance gain for the
    compile generated code vs SSE specific code. This depends slightly on the cpu but it's 1.2 to 3-fold
    better for all tested cases.
@@ -37,6 +37,7 @@
 #include "develop/imageop_gui.h"
 #include "common/module_versioning.h"
 #include "system/target_clones.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "math/math.h"
 #include "develop/develop.h"
@@ -278,6 +279,31 @@ void modify_roi_in(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, dt_dev
   roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(orig_h) - roi_in->y);
 }
 
+// Where process() samples its input for the output pixel pi, both relative to their buffer.
+static inline void _rotatepixels_sample_point(const dt_iop_rotatepixels_data_t *const d,
+                                              const dt_iop_roi_t *const roi_in,
+                                              const dt_iop_roi_t *const roi_out, const float *const pi,
+                                              float *const po)
+{
+  const float p[2] = { roi_out->x + pi[0], roi_out->y + pi[1] };
+  backtransform(d, roi_in->scale, p, po);
+  po[0] -= roi_in->x;
+  po[1] -= roi_in->y;
+}
+
+int resample_points(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                    float *points, size_t points_count)
+{
+  const dt_iop_rotatepixels_data_t *const d = (const dt_iop_rotatepixels_data_t *)piece->data;
+  __OMP_PARALLEL_FOR__(if(points_count > 100))
+  for(size_t k = 0; k < points_count * 2; k += 2)
+  {
+    const float pi[2] = { points[k], points[k + 1] };
+    _rotatepixels_sample_point(d, &piece->roi_in, &piece->roi_out, pi, points + k);
+  }
+  return DT_GEOMETRY_STAGE_RESAMPLE;
+}
+
 // 3rd (final) pass: you get this input region (may be different from what was requested above),
 // do your best to fill the output region!
 __DT_CLONE_TARGETS__
@@ -290,8 +316,6 @@ int process(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_
   const int ch = piece->dsc_in.channels;
   const int ch_width = ch * roi_in->width;
 
-  const float scale = roi_in->scale;
-
   const struct dt_interpolation *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
   __OMP_PARALLEL_FOR__()
   // (slow) point-by-point transformation.
@@ -301,15 +325,9 @@ int process(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_
     float *out = ((float *)ovoid) + (size_t)ch * j * roi_out->width;
     for(int i = 0; i < roi_out->width; i++, out += ch)
     {
-      float pi[2], po[2];
-
-      pi[0] = roi_out->x + i;
-      pi[1] = roi_out->y + j;
-
-      backtransform((const dt_iop_rotatepixels_data_t *)piece->data, scale, pi, po);
-
-      po[0] -= roi_in->x;
-      po[1] -= roi_in->y;
+      const float pi[2] = { i, j };
+      float po[2];
+      _rotatepixels_sample_point((const dt_iop_rotatepixels_data_t *)piece->data, roi_in, roi_out, pi, po);
 
       dt_interpolation_compute_pixel4c(interpolation, (float *)ivoid, out, po[0], po[1], roi_in->width,
                                        roi_in->height, ch_width);
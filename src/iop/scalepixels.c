@@ -37,6 +37,7 @@
 #include "widgets/bauhaus.h"
 #include "common/module_versioning.h"
 #include "system/target_clones.h"
+#include "pixel/geometry_stage.h"
 #include "pixel/interpolation.h"
 #include "develop/geometry/geometry.h"
 #include "develop/imageop.h"
@@ -248,6 +249,24 @@ void modify_roi_in(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, dt_dev
   roi_in->y = roi_out->y * d->y_scale;
 }
 
+// Where process() samples its input for the output pixel (x, y).
+static inline void _scalepixels_sample_point(const dt_iop_scalepixels_data_t *const d, const float x,
+                                             const float y, float *const xi, float *const yi)
+{
+  *xi = x * d->x_scale;
+  *yi = y * d->y_scale;
+}
+
+int resample_points(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                    float *points, size_t points_count)
+{
+  const dt_iop_scalepixels_data_t *const d = piece->data;
+  __OMP_PARALLEL_FOR__(if(points_count > 100))
+  for(size_t k = 0; k < points_count * 2; k += 2)
+    _scalepixels_sample_point(d, points[k], points[k + 1], &points[k], &points[k + 1]);
+  return DT_GEOMETRY_STAGE_RESAMPLE;
+}
+
 __DT_CLONE_TARGETS__
 int process(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
             const void *const ivoid, void *const ovoid)
@@ -267,8 +286,8 @@ int process(dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_
     float *out = ((float *)ovoid) + (size_t)4 * j * roi_out->width;
     for(int i = 0; i < roi_out->width; i++, out += 4)
     {
-      float x = i*d->x_scale;
-      float y = j*d->y_scale;
+      float x, y;
+      _scalepixels_sample_point(d, i, j, &x, &y);
 
       dt_interpolation_compute_pixel4c(interpolation, (float *)ivoid, out, x, y, roi_in->width,
                                        roi_in->height, ch_width);
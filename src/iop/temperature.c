@@ -83,6 +83,7 @@
 
 #include "gui/color_picker_proxy.h"
 #include "iop/iop_api.h"
+#include "pixel/raw_stage.h"
 
 // for Kelvin temperature and bogus WB
 #include "colorprofiles/colorspaces.h"
@@ -483,6 +484,20 @@ static void mul2temp(dt_iop_module_t *self, dt_iop_temperature_params_t *p, floa
   XYZ_to_temperature(mul2xyz(self, p), TempK, tint);
 }
 
+int raw_stage(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+              dt_raw_stage_t *stage)
+{
+  if(!piece->dsc_in.filters) return DT_RAW_STAGE_NONE;
+
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+  for(int k = 0; k < 4; k++) stage->coeffs[k] = d->coeffs[k];
+  stage->filters = piece->dsc_in.filters;
+  memcpy(stage->xtrans, piece->dsc_in.xtrans, sizeof(stage->xtrans));
+  stage->wb_x = piece->roi_out.x;
+  stage->wb_y = piece->roi_out.y;
+  return DT_RAW_STAGE_WHITE_BALANCE;
+}
+
 __DT_CLONE_TARGETS__
 int process(struct dt_iop_module_t *self, const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid)
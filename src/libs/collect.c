@@ -278,7 +278,7 @@ static void entry_changed(GtkEntry *entry, dt_lib_collect_rule_t *dr);
 static void combo_changed(GtkWidget *combo, dt_lib_collect_rule_t *dr);
 static void collection_updated(gpointer instance, dt_collection_change_t query_change,
                                dt_collection_properties_t changed_property, gpointer imgs, int next,
-                               gpointer self);
+                               gpointer diff, gpointer self);
 static void tag_changed(gpointer instance, gpointer self);
 static void row_activated(GtkTreeView *view, GtkTreePath *path, GdkEventButton *event, dt_lib_collect_t *d);
 static void update_view(dt_lib_collect_rule_t *dr);
@@ -2944,7 +2944,8 @@ static void _lib_collect_gui_update(dt_lib_module_t *self)
 // =====================================================================================
 
 static void collection_updated(gpointer instance, dt_collection_change_t query_change,
-                               dt_collection_properties_t changed_property, gpointer imgs, int next, gpointer self)
+                               dt_collection_properties_t changed_property, gpointer imgs, int next, gpointer diff,
+                               gpointer self)
 {
   dt_lib_collect_t *d = (dt_lib_collect_t *)((dt_lib_module_t *)self)->data;
   d->view_rule = -1;
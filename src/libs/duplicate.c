@@ -337,7 +337,7 @@ static void _lib_duplicate_init_callback(gpointer instance, dt_lib_module_t *sel
 
 static void _lib_duplicate_collection_changed(gpointer instance, dt_collection_change_t query_change,
                                               dt_collection_properties_t changed_property, gpointer imgs, int next,
-                                              dt_lib_module_t *self)
+                                              gpointer diff, dt_lib_module_t *self)
 {
   _lib_duplicate_init_callback(instance, self);
 }
@@ -99,6 +99,8 @@
 #define HISTOGRAM_BINS 256
 #define GAMMA 1.f / 2.f
 #define DT_LIB_HISTOGRAM_SCOPE_MIN_VALUE (1.f / 256.f)
+// Pixels binned per waveform/parade raster line: 1 / (2 sqrt(2048)), about 1 % of the line, at worst.
+#define DT_LIB_HISTOGRAM_WAVEFORM_LINE_SAMPLES 2048
 #define DT_LIB_HISTOGRAM_SCOPE_ENABLE_SMOOTHING 1
 #define DT_LIB_HISTOGRAM_SCOPE_SMOOTH_SPATIAL_PASSES 1
 #define DT_LIB_HISTOGRAM_SCOPE_SMOOTH_TONE_PASSES 4
@@ -178,6 +180,7 @@ typedef struct dt_lib_histogram_t
   dt_dev_pixelpipe_cache_wait_t scope_wait;
   dt_dev_pixelpipe_cache_wait_t picker_wait;
   dt_dev_pixelpipe_cache_wait_t module_wait;
+  dt_histogram_partials_t partials;    // per-thread bins of the histogram and vectorscope, GUI thread only
 
   dt_gui_collapsible_section_t cs;
 
@@ -855,34 +858,49 @@ static inline void _sample_raw_point_to_image_norm(const dt_colorpicker_sample_t
 // pass a widget/panel dimension here: the binning window [min_x;max_x]×[min_y;max_y] is expressed
 // in source-buffer coordinates, and a foreign stride silently re-samples a sheared subset of the
 // image (issue #828: the histogram shape used to change with the left panel width).
+// One pixel is binned per `step` × `step` cell of the window, see dt_histogram_sample_position().
 static inline void _bin_pixels_histogram_in_roi(const float *const restrict image, uint32_t *const restrict bins,
                                                 const size_t min_x, const size_t max_x,
                                                 const size_t min_y, const size_t max_y,
-                                                const size_t stride)
+                                                const size_t stride, const size_t step,
+                                                dt_histogram_partials_t *partials)
 {
-  //fprintf(stdout, "computing histogram from x = [%lu;%lu], y = [%lu;%lu]\n", min_x, max_x, min_y, max_y);
-  // Process
-#ifdef _OPENMP
-#ifndef _WIN32
-__OMP_PARALLEL_FOR__(reduction(+: bins[0: HISTOGRAM_BINS * 4])  collapse(3))
-#else
-__OMP_PARALLEL_FOR__(shared(bins)  collapse(3))
-#endif
-#endif
-  for(size_t i = min_y; i < max_y; i++)
-    for(size_t j = min_x; j < max_x; j++)
-      for(size_t c = 0; c < 3; c++)
-      {
-        const float value = image[(i * stride + j) * 4 + c];
-        const size_t index = (size_t)CLAMP(roundf(value * (HISTOGRAM_BINS - 1)), 0, HISTOGRAM_BINS - 1);
-        bins[index * 4 + c]++;
-      }
+  if(max_x <= min_x || max_y <= min_y) return;
+  uint32_t *const partial_bins = dt_histogram_partials_start(partials, HISTOGRAM_BINS * 4);
+  if(IS_NULL_PTR(partial_bins)) return;
+
+  const size_t cells = (max_x - min_x + step - 1) / step;
+  const size_t strips = (max_y - min_y + step - 1) / step;
+
+  __OMP_PARALLEL_FOR__()
+  for(size_t strip = 0; strip < strips; strip++)
+  {
+    uint32_t *const thread_bins = partial_bins + (size_t)HISTOGRAM_BINS * 4 * omp_get_thread_num();
+    for(size_t cell = 0; cell < cells; cell++)
+    {
+      size_t x, y;
+      dt_histogram_sample_position(strip, cell, step, &x, &y);
+      x += min_x;
+      y += min_y;
+      if(x >= max_x || y >= max_y) continue;
+
+      // Scale and clamp the 3 channels at once, fmaxf() sends NaN to the first bin.
+      const dt_aligned_pixel_simd_t scaled = dt_load_simd(image + (y * stride + x) * 4) * (float)(HISTOGRAM_BINS - 1);
+      int32_t index[4];
+      for_four_channels(c) index[c] = (int32_t)fminf(fmaxf(roundf(scaled[c]), 0.f), HISTOGRAM_BINS - 1);
+      thread_bins[index[0] * 4]++;
+      thread_bins[index[1] * 4 + 1]++;
+      thread_bins[index[2] * 4 + 2]++;
+    }
+  }
+
+  dt_histogram_partials_reduce(partials, bins);
 }
 
 
 static inline void _bin_pickers_histogram(const float *const restrict image,
                                           const size_t width, const size_t height,
-                                          uint32_t *bins,
+                                          uint32_t *bins, dt_histogram_partials_t *partials,
                                           dt_colorpicker_sample_t *sample)
 {
   if(sample->size == DT_LIB_COLORPICKER_SIZE_BOX)
@@ -895,7 +913,7 @@ static inline void _bin_pickers_histogram(const float *const restrict image,
       CLAMP((size_t)roundf(image_box[2] * width), 0, width),
       CLAMP((size_t)roundf(image_box[3] * height), 0, height)
     };
-    _bin_pixels_histogram_in_roi(image, bins, box[0], box[2], box[1], box[3], width);
+    _bin_pixels_histogram_in_roi(image, bins, box[0], box[2], box[1], box[3], width, 1, partials);
   }
   else
   {
@@ -903,7 +921,7 @@ static inline void _bin_pickers_histogram(const float *const restrict image,
     _sample_raw_point_to_image_norm(sample, image_point);
     const size_t x = CLAMP((size_t)roundf(image_point[0] * width), 0, width - 1);
     const size_t y = CLAMP((size_t)roundf(image_point[1] * height), 0, height - 1);
-    _bin_pixels_histogram_in_roi(image, bins, x, x + 1, y, y + 1, width);
+    _bin_pixels_histogram_in_roi(image, bins, x, x + 1, y, y + 1, width, 1, partials);
   }
 }
 
@@ -1006,17 +1024,20 @@ static void _process_histogram(dt_backbuf_t *backbuf, const char *op, cairo_t *c
     {
       dt_colorpicker_sample_t *sample = samples->data;
       _bin_pickers_histogram(oriented.data, oriented.width, oriented.height,
-                             bins, sample);
+                             bins, &d->partials, sample);
       samples = g_slist_next(samples);
     }
 
     if(dt_dev_get_global()->color_picker.picker)
       _bin_pickers_histogram(oriented.data, oriented.width, oriented.height,
-                             bins, dt_dev_get_global()->color_picker.primary_sample);
+                             bins, &d->partials, dt_dev_get_global()->color_picker.primary_sample);
   }
   else
   {
-    _bin_pixels_histogram_in_roi(oriented.data, bins, 0, oriented.width, 0, oriented.height, oriented.width);
+    // The whole image is only looked at: a sample shows the same shape, see common/histogram.h.
+    const size_t step = dt_histogram_sample_step(oriented.width * oriented.height, DT_HISTOGRAM_DISPLAY_SAMPLES);
+    _bin_pixels_histogram_in_roi(oriented.data, bins, 0, oriented.width, 0, oriented.height, oriented.width,
+                                 step, &d->partials);
   }
 
   if(oriented.owned) dt_free_align(oriented.data);
@@ -1057,12 +1078,31 @@ static void _process_histogram(dt_backbuf_t *backbuf, const char *op, cairo_t *c
 }
 
 
+/* Waveform tone contribution of one source pixel to its raster line, split between the two
+ * nearest tone bins. `tone_stride` is the distance between consecutive tones in `line`. */
+static inline void _bin_waveform_pixel(const float *const restrict pixel, uint32_t *const restrict line,
+                                       const size_t tone_bins, const ptrdiff_t tone_stride,
+                                       const uint32_t weight)
+{
+  for(size_t c = 0; c < 3; c++)
+  {
+    const float position = CLAMPF(pixel[c], 0.f, 1.f) * (float)(tone_bins - 1);
+    const size_t tone0 = (size_t)position;
+    const size_t tone1 = MIN(tone0 + 1, tone_bins - 1);
+    const uint32_t weight1 = (uint32_t)roundf((float)weight * (position - (float)tone0));
+    line[(ptrdiff_t)tone0 * tone_stride + c] += weight - weight1;
+    line[(ptrdiff_t)tone1 * tone_stride + c] += weight1;
+  }
+}
+
+/* `sample_step` thins the pixels binned along the axis each raster line sums over: one pixel per
+ * run of sample_step, jittered as in dt_histogram_sample_position(). 1 bins them all. */
 static inline void _bin_pixels_waveform_in_roi(const float *const restrict image, uint32_t *const restrict bins,
                                                const size_t min_x, const size_t max_x,
                                                const size_t min_y, const size_t max_y,
                                                const size_t source_width, const size_t source_height,
                                                const size_t tone_bins, const size_t raster_extent,
-                                               const gboolean vertical)
+                                               const gboolean vertical, const size_t sample_step)
 {
   if(vertical)
   {
@@ -1078,24 +1118,16 @@ static inline void _bin_pixels_waveform_in_roi(const float *const restrict image
       const size_t source_y1 = MIN(max_y, (size_t)ceil(source_y1d));
       if(source_y0 >= source_y1) continue;
 
+      uint32_t *const line = bins + raster_y * tone_bins * 4;
       for(size_t i = source_y0; i < source_y1; i++)
       {
         const double overlap = MIN((double)(i + 1), source_y1d) - MAX((double)i, source_y0d);
         const uint32_t weight = MAX(1u, (uint32_t)round(overlap * 256.));
-        __OMP_PARALLEL_FOR__(shared(bins) collapse(2))
-        for(size_t j = min_x; j < max_x; j++)
-          for(size_t c = 0; c < 3; c++)
-          {
-            const float value = image[(i * source_width + j) * 4 + c];
-            const float tone_position = CLAMPF(value, 0.f, 1.f) * (float)(tone_bins - 1);
-            const size_t tone0 = (size_t)floorf(tone_position);
-            const size_t tone1 = MIN(tone0 + 1, tone_bins - 1);
-            const float tone_mix = tone_position - (float)tone0;
-            const uint32_t weight1 = (uint32_t)roundf((float)weight * tone_mix);
-            const uint32_t weight0 = weight - weight1;
-            bins[(raster_y * tone_bins + tone0) * 4 + c] += weight0;
-            bins[(raster_y * tone_bins + tone1) * 4 + c] += weight1;
-          }
+        for(size_t j = min_x; j < max_x; j += sample_step)
+        {
+          const size_t x = j + dt_histogram_sample_offset(((uint64_t)i << 32) + j, sample_step);
+          if(x < max_x) _bin_waveform_pixel(image + (i * source_width + x) * 4, line, tone_bins, 4, weight);
+        }
       }
     }
   }
@@ -1112,24 +1144,19 @@ static inline void _bin_pixels_waveform_in_roi(const float *const restrict image
       const size_t source_x1 = MIN(max_x, (size_t)ceil(source_x1d));
       if(source_x0 >= source_x1) continue;
 
+      // Highest tone on the first raster row.
+      uint32_t *const line = bins + ((tone_bins - 1) * raster_extent + raster_x) * 4;
       for(size_t j = source_x0; j < source_x1; j++)
       {
         const double overlap = MIN((double)(j + 1), source_x1d) - MAX((double)j, source_x0d);
         const uint32_t weight = MAX(1u, (uint32_t)round(overlap * 256.));
-        __OMP_PARALLEL_FOR__(shared(bins) collapse(2))
-        for(size_t i = min_y; i < max_y; i++)
-          for(size_t c = 0; c < 3; c++)
-          {
-            const float value = image[(i * source_width + j) * 4 + c];
-            const float tone_position = CLAMPF(value, 0.f, 1.f) * (float)(tone_bins - 1);
-            const size_t tone0 = (size_t)floorf(tone_position);
-            const size_t tone1 = MIN(tone0 + 1, tone_bins - 1);
-            const float tone_mix = tone_position - (float)tone0;
-            const uint32_t weight1 = (uint32_t)roundf((float)weight * tone_mix);
-            const uint32_t weight0 = weight - weight1;
-            bins[((tone_bins - 1 - tone0) * raster_extent + raster_x) * 4 + c] += weight0;
-            bins[((tone_bins - 1 - tone1) * raster_extent + raster_x) * 4 + c] += weight1;
-          }
+        for(size_t i = min_y; i < max_y; i += sample_step)
+        {
+          const size_t y = i + dt_histogram_sample_offset(((uint64_t)j << 32) + i, sample_step);
+          if(y < max_y)
+            _bin_waveform_pixel(image + (y * source_width + j) * 4, line, tone_bins,
+                                -(ptrdiff_t)raster_extent * 4, weight);
+        }
       }
     }
   }
@@ -1151,7 +1178,7 @@ static inline void _bin_pickers_waveforms(const float *const restrict image, uin
       CLAMP((size_t)roundf(image_box[3] * height), 0, height)
     };
     _bin_pixels_waveform_in_roi(image, bins, box[0], box[2], box[1], box[3],
-                                width, height, tone_bins, raster_extent, vertical);
+                                width, height, tone_bins, raster_extent, vertical, 1);
   }
   else
   {
@@ -1160,7 +1187,7 @@ static inline void _bin_pickers_waveforms(const float *const restrict image, uin
     const size_t x = CLAMP((size_t)roundf(image_point[0] * width), 0, width - 1);
     const size_t y = CLAMP((size_t)roundf(image_point[1] * height), 0, height - 1);
     _bin_pixels_waveform_in_roi(image, bins, x, x + 1, y, y + 1,
-                                width, height, tone_bins, raster_extent, vertical);
+                                width, height, tone_bins, raster_extent, vertical, 1);
   }
 }
 
@@ -1191,9 +1218,12 @@ static inline void _bin_pixels_waveform(const float *const restrict image, uint3
   }
   else
   {
-    // Bin the whole image
+    // Bin the whole image. Each raster line is a histogram of its own: give each one the
+    // sample budget, rather than the whole scope.
+    const size_t line_pixels = width * height / raster_extent;
+    const size_t sample_step = MAX((size_t)1, line_pixels / DT_LIB_HISTOGRAM_WAVEFORM_LINE_SAMPLES);
     _bin_pixels_waveform_in_roi(image, bins, 0, width, 0, height,
-                                width, height, tone_bins, raster_extent, vertical);
+                                width, height, tone_bins, raster_extent, vertical, sample_step);
   }
 }
 
@@ -1618,27 +1648,36 @@ static float _vectorscope_coord_zoom_to_Luv(const float value, const float zoom)
   return value * (2.f * zoom) / (HISTOGRAM_BINS - 1) - zoom;
 }
 
+// One pixel is binned per `step` × `step` cell of the window, see dt_histogram_sample_position().
 static void _bin_pixels_vectorscope_in_roi(const float *const restrict image, uint32_t *const restrict vectorscope,
                                            const size_t min_x, const size_t max_x, const size_t min_y,
-                                           const size_t max_y, const size_t width, const float zoom,
-                                           dt_lib_histogram_t *d)
+                                           const size_t max_y, const size_t width, const size_t step,
+                                           const float zoom, dt_lib_histogram_t *d)
 {
-#ifdef _OPENMP
-#ifndef _WIN32
-#pragma omp parallel for default(firstprivate) \
-        reduction(+: vectorscope[0: HISTOGRAM_BINS * HISTOGRAM_BINS]) 
-#else
-#pragma omp parallel for default(firstprivate) \
-        shared(vectorscope) 
-#endif
-#endif
-  for(size_t i = min_y; i < max_y; i++)
-    for(size_t j = min_x; j < max_x; j++)
+  if(max_x <= min_x || max_y <= min_y) return;
+  // 64k bins: an OpenMP array reduction would allocate and zero that much per thread on every redraw.
+  uint32_t *const partial_bins = dt_histogram_partials_start(&d->partials, HISTOGRAM_BINS * HISTOGRAM_BINS);
+  if(IS_NULL_PTR(partial_bins)) return;
+
+  const size_t cells = (max_x - min_x + step - 1) / step;
+  const size_t strips = (max_y - min_y + step - 1) / step;
+
+  __OMP_PARALLEL_FOR__()
+  for(size_t strip = 0; strip < strips; strip++)
+  {
+    uint32_t *const thread_bins = partial_bins + (size_t)HISTOGRAM_BINS * HISTOGRAM_BINS * omp_get_thread_num();
+    for(size_t cell = 0; cell < cells; cell++)
     {
+      size_t x, y;
+      dt_histogram_sample_position(strip, cell, step, &x, &y);
+      x += min_x;
+      y += min_y;
+      if(x >= max_x || y >= max_y) continue;
+
       dt_aligned_pixel_t XYZ_D50 = { 0.f };
       dt_aligned_pixel_t xyY = { 0.f };
       dt_aligned_pixel_t Luv = { 0.f };
-      _scope_pixel_to_xyz(image + (i * width + j) * 4, XYZ_D50, d);
+      _scope_pixel_to_xyz(image + (y * width + x) * 4, XYZ_D50, d);
       dt_XYZ_to_xyY(XYZ_D50, xyY);
       dt_xyY_to_Luv(xyY, Luv);
 
@@ -1647,8 +1686,11 @@ static void _bin_pixels_vectorscope_in_roi(const float *const restrict image, ui
       const size_t V_index = (size_t)CLAMP(roundf(_Luv_to_vectorscope_coord_zoom(Luv[2], zoom)), 0, HISTOGRAM_BINS - 1);
 
       // We put V = 0 at the bottom of the image.
-      vectorscope[(HISTOGRAM_BINS - 1 - V_index) * HISTOGRAM_BINS + U_index]++;
+      thread_bins[(HISTOGRAM_BINS - 1 - V_index) * HISTOGRAM_BINS + U_index]++;
     }
+  }
+
+  dt_histogram_partials_reduce(&d->partials, vectorscope);
 }
 
 static inline void _bin_pickers_vectorscope(const float *const restrict image,
@@ -1666,7 +1708,7 @@ static inline void _bin_pickers_vectorscope(const float *const restrict image,
       CLAMP((size_t)roundf(image_box[2] * width), 0, width),
       CLAMP((size_t)roundf(image_box[3] * height), 0, height)
     };
-    _bin_pixels_vectorscope_in_roi(image, vectorscope, box[0], box[2], box[1], box[3], width, zoom, d);
+    _bin_pixels_vectorscope_in_roi(image, vectorscope, box[0], box[2], box[1], box[3], width, 1, zoom, d);
   }
   else
   {
@@ -1674,7 +1716,7 @@ static inline void _bin_pickers_vectorscope(const float *const restrict image,
     _sample_raw_point_to_image_norm(sample, image_point);
     const size_t x = CLAMP((size_t)roundf(image_point[0] * width), 0, width - 1);
     const size_t y = CLAMP((size_t)roundf(image_point[1] * height), 0, height - 1);
-    _bin_pixels_vectorscope_in_roi(image, vectorscope, x, x + 1, y, y + 1, width, zoom, d);
+    _bin_pixels_vectorscope_in_roi(image, vectorscope, x, x + 1, y, y + 1, width, 1, zoom, d);
   }
 }
 
@@ -1737,8 +1779,9 @@ static void _bin_vectorscope(const float *const restrict image, uint32_t *const
   }
   else
   {
-    // Bin the whole image
-    _bin_pixels_vectorscope_in_roi(image, vectorscope, 0, width, 0, height, width, zoom, d);
+    // Bin a sample of the whole image, see common/histogram.h.
+    const size_t step = dt_histogram_sample_step(width * height, DT_HISTOGRAM_DISPLAY_SAMPLES);
+    _bin_pixels_vectorscope_in_roi(image, vectorscope, 0, width, 0, height, width, step, zoom, d);
   }
 }
 
@@ -3196,6 +3239,7 @@ void gui_cleanup(dt_lib_module_t *self)
   }
   if(d->pending_hashes) g_array_free(d->pending_hashes, TRUE);
   _destroy_surface(d);
+  dt_histogram_partials_cleanup(&d->partials);
   dt_iop_color_picker_reset(NULL, FALSE);
 
   dev->color_picker.histogram_module = NULL;
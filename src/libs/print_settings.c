@@ -151,6 +151,7 @@ typedef struct dt_lib_print_settings_t
   dt_box_control_set sel_controls; // which border/corner is selected
   float click_pos_x, click_pos_y;
   gboolean has_changed;
+  gboolean printers_discovered;    // CUPS is asked on the first entry in the print view
 } dt_lib_print_settings_t;
 
 typedef struct dt_lib_print_job_t
@@ -1381,6 +1382,14 @@ void view_enter(struct dt_lib_module_t *self,struct dt_view_t *old_view,struct d
   // keeps a stale or not-yet-initialized images box between switches.
   dt_view_print_settings(dt_view_manager_get_global(), &ps->prt, &ps->imgs);
 
+  // Printers are discovered on the first entry in the view, not at startup: enumerating CUPS
+  // destinations can take seconds on a network, and most sessions never print.
+  if(!ps->printers_discovered)
+  {
+    ps->printers_discovered = TRUE;
+    dt_printers_discovery(_new_printer_callback, self);
+  }
+
   // user activated a new image via the filmstrip or user entered view
   // mode which activates an image: get image_id and orientation
   DT_DEBUG_CONTROL_SIGNAL_CONNECT(dt_control_signal_get_global(), DT_SIGNAL_VIEWMANAGER_FILMSTRIP_ACTIVATE,
@@ -2151,6 +2160,7 @@ void gui_init(dt_lib_module_t *self)
   d->selected = -1;
   d->last_selected = -1;
   d->has_changed = FALSE;
+  d->printers_discovered = FALSE;
 
   dt_init_print_info(&d->prt);
   dt_view_print_settings(dt_view_manager_get_global(), &d->prt, &d->imgs);
@@ -2684,10 +2694,6 @@ void gui_init(dt_lib_module_t *self)
 
   dt_free(system_profile_dir);
   dt_free(user_profile_dir);
-
-  // Let's start the printer discovery now
-
-  dt_printers_discovery(_new_printer_callback, self);
 }
 
 void *legacy_params(dt_lib_module_t *self, const void *const old_params, const size_t old_params_size,
@@ -798,7 +798,7 @@ static void _image_selection_changed_callback(gpointer instance, dt_lib_module_t
 
 static void _collection_updated_callback(gpointer instance, dt_collection_change_t query_change,
                                          dt_collection_properties_t changed_property, gpointer imgs, int next,
-                                         dt_lib_module_t *self)
+                                         gpointer diff, dt_lib_module_t *self)
 {
   _update(self);
 }
@@ -649,7 +649,7 @@ static void _lib_tagging_tags_changed_callback(gpointer instance, dt_lib_module_
 
 static void _collection_updated_callback(gpointer instance, dt_collection_change_t query_change,
                                          dt_collection_properties_t changed_property, gpointer imgs, int next,
-                                         dt_lib_module_t *self)
+                                         gpointer diff, dt_lib_module_t *self)
 {
   dt_lib_tagging_t *d = (dt_lib_tagging_t *)self->data;
   d->collection[0] = '\0';
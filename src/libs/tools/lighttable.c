@@ -119,7 +119,7 @@ gboolean _columns_out_action(GtkAccelGroup *accel_group, GObject *accelerable, g
 
 static void _dt_collection_changed_callback(gpointer instance, dt_collection_change_t query_change,
                                             dt_collection_properties_t changed_property, gpointer imgs,
-                                            const int next, gpointer user_data)
+                                            const int next, gpointer diff, gpointer user_data)
 {
   if(IS_NULL_PTR(user_data)) return;
   // DT_COLLECTION_CHANGE_BACKGROUND_SYNC means the signal comes from a passive background sync
@@ -0,0 +1,730 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "pixel/crystgrain.h"
+#include "math/math.h"
+#include "iop/noise_generator.h"
+#include "system/atomic.h"
+#include "system/macros.h"
+#include "system/openmp.h"
+#include "system/target_clones.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Turn a 64-bit seed into a uniform random number in [0; 1).
+ */
+static inline float _uniform_random(const uint64_t seed)
+{
+  return splitmix32(seed) * 0x1.0p-32f;
+}
+
+/**
+ * @brief Turn 2 seeds into one gaussian deviate.
+ *
+ * @details We only need gaussian draws to pick crystal size and vertex count
+ * for one whole layer, so Box-Muller is enough and keeps the implementation
+ * local to this module.
+ */
+static inline float _gaussian_random(const uint64_t seed_a, const uint64_t seed_b)
+{
+  const float u1 = fmaxf(_uniform_random(seed_a), FLT_MIN);
+  const float u2 = _uniform_random(seed_b);
+  return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI_F * u2);
+}
+
+/**
+ * @brief Mirror indices outside the current buffer like scipy
+ * `boundary='symm'`.
+ */
+static inline int _reflect_index(int i, const int max)
+{
+  if(max <= 1) return 0;
+
+  while(i < 0 || i >= max)
+  {
+    if(i < 0)
+      i = -i - 1;
+    else
+      i = 2 * max - i - 1;
+  }
+
+  return i;
+}
+
+/**
+ * @brief Map the requested filling ratio to the Bernoulli probability used to
+ * plant seeds.
+ *
+ * @details In the simplified Bernoulli model, one binary crystal of area `A`
+ * covers a destination pixel if any of the `A` source positions that would
+ * hit that pixel spawns a seed. Assuming independent seed events, the
+ * uncovered probability is `(1 - p)^A`, so matching a requested filling ratio
+ * `f` amounts to solving `1 - f = (1 - p)^A`, that is
+ * `p = 1 - (1 - f)^(1 / A)`. This keeps the expected covered surface stable
+ * for the actual discrete grain area at every preview scale.
+ */
+static inline float _seed_probability(const float filling, const float crystal_area)
+{
+  const float clamped_filling = CLAMPS(filling, 0.0f, 0.9999f);
+  if(crystal_area <= 1.0f) return clamped_filling;
+  return 1.0f - powf(1.0f - clamped_filling, 1.0f / crystal_area);
+}
+
+/**
+ * @brief Estimate the partial coverage of one pixel by one crystal boundary.
+ *
+ * @details The continuous grain radius lives in floating-point, but the raster
+ * simulation ultimately writes on whole pixels. We therefore keep the exact
+ * radius for the geometry and only quantize the support window. Pixels fully
+ * inside the crystal get weight 1, fully outside get 0, and pixels crossed by
+ * the boundary get a linear partial occlusion in a 1-pixel transition band.
+ */
+static inline float _crystal_coverage(const int dx, const int dy, const float radius_f, const float vertices,
+                                      const float rotation)
+{
+  const float local_radius = hypotf((float)dx, (float)dy);
+  float signed_distance = 0.0f;
+  const float theta = atan2f((float)dy, (float)dx);
+  const float envelope = cosf(M_PI_F / vertices)
+                          / cosf((2.0f * asinf(cosf(vertices * (theta + rotation))) + M_PI_F)
+                                / (2.0f * vertices));
+  const float polygon_radius = radius_f * envelope;
+  signed_distance = polygon_radius - local_radius;
+  return CLAMPS(signed_distance + 0.5f, 0.0f, 1.0f);
+}
+
+/**
+ * @brief Build one partially-occluding crystal footprint for a layer.
+ *
+ * @details Each bank entry keeps one crystal size, shape and orientation, then
+ * the stochastic look comes from stacking many layers and randomly picking
+ * between several bank entries at each seed position. The support window is
+ * rasterized to integer pixels, but each tap stores a partial-coverage weight
+ * so non-integer radii do not collapse to a binary edge.
+ */
+__DT_CLONE_TARGETS__
+static int _create_crystal_kernel(dt_crystgrain_kernel_t *const kernel, const float radius_f,
+                                  const float vertices, const float rotation)
+{
+  memset(kernel, 0, sizeof(*kernel));
+
+  const int radius = MAX((int)ceilf(radius_f + 0.5f), 1);
+  const int width = 2 * radius + 1;
+  int count = 0;
+  float area = 0.0f;
+
+  for(int y = 0; y < width; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      const float alpha = _crystal_coverage(x - radius, y - radius, radius_f, vertices, rotation);
+      if(alpha > FLT_EPSILON)
+      {
+        count++;
+        area += alpha;
+      }
+    }
+  }
+
+  if(count <= 0 || area <= FLT_EPSILON) return 1;
+
+  kernel->dx = malloc(sizeof(int) * count);
+  kernel->dy = malloc(sizeof(int) * count);
+  kernel->alpha = malloc(sizeof(float) * count);
+  if(IS_NULL_PTR(kernel->dx) || IS_NULL_PTR(kernel->dy) || IS_NULL_PTR(kernel->alpha))
+  {
+    free(kernel->dx);
+    free(kernel->dy);
+    free(kernel->alpha);
+    memset(kernel, 0, sizeof(*kernel));
+    return 1;
+  }
+
+  kernel->count = count;
+  kernel->radius = radius;
+  kernel->radius_f = radius_f;
+  kernel->area = area;
+
+  int k = 0;
+  for(int y = 0; y < width; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      const float alpha = _crystal_coverage(x - radius, y - radius, radius_f, vertices, rotation);
+      if(alpha > FLT_EPSILON)
+      {
+        kernel->dx[k] = x - radius;
+        kernel->dy[k] = y - radius;
+        kernel->alpha[k] = alpha;
+        k++;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Release one crystal kernel.
+ */
+static inline __attribute__((always_inline)) void _free_crystal_kernel(dt_crystgrain_kernel_t *const kernel)
+{
+  free(kernel->dx);
+  free(kernel->dy);
+  free(kernel->alpha);
+  memset(kernel, 0, sizeof(*kernel));
+}
+
+/**
+ * @brief Pick one crystal geometry for one bank entry.
+ */
+__DT_CLONE_TARGETS__
+static int _pick_layer_kernel(dt_crystgrain_layer_kernel_t *const entry,
+                              const dt_crystgrain_runtime_t *const rt, const uint64_t seed)
+{
+  memset(entry, 0, sizeof(*entry));
+
+  // Let the grain follow the preview scaling below 100% so zoomed-out views
+  // stay visually coherent, but clamp at 100% to avoid inventing larger
+  // crystals when the user zooms in past the native image scale.
+  const float mean_size = MAX(rt->grain_size * rt->kernel_scale, 1.0f);
+  const float max_size = MAX(3.0f * mean_size, 1.0f);
+
+  for(int attempt = 0; attempt < 8; attempt++)
+  {
+    const float vertices = CLAMPS(6.0f + 1.5f * _gaussian_random(seed + 17u + attempt * 31u,
+                                                                  seed + 23u + attempt * 37u),
+                                  3.0f, 10.0f);
+    const float rotation = 2.0f * M_PI_F * _uniform_random(seed + 101u + attempt * 43u);
+    const float log_size = logf(mean_size) + rt->size_stddev * _gaussian_random(seed + 151u + attempt * 47u,
+                                                                                 seed + 181u + attempt * 53u);
+    const float random_size = CLAMPS(expf(log_size), 1.0f, max_size);
+    const float radius_f = MAX(0.5f * (random_size - 1.0f), 0.5f);
+
+    if(_create_crystal_kernel(&entry->footprint, radius_f, vertices, rotation) == 0)
+    {
+      entry->probability = _seed_probability(rt->filling, entry->footprint.area);
+      entry->vertices = vertices;
+      entry->rotation = rotation;
+      entry->width = 2 * entry->footprint.radius + 1;
+      return 0;
+    }
+  }
+
+  if(_create_crystal_kernel(&entry->footprint, 0.5f, 4.0f, 0.0f) != 0) return 1;
+
+  entry->probability = _seed_probability(rt->filling, entry->footprint.area);
+  entry->vertices = 4.0f;
+  entry->rotation = 0.0f;
+  entry->width = 1;
+  return 0;
+}
+
+/**
+ * @brief Estimate the reference grain surface used to normalize layer capture.
+ *
+ * @details The user-facing layer capture is expressed against the average
+ * grain size control, not against the exact randomized footprint drawn for
+ * each seed. We therefore normalize it by the area of a circle built from the
+ * average grain radius at the current preview scale.
+ */
+static inline float _average_grain_surface(const dt_crystgrain_runtime_t *const rt)
+{
+  const float mean_size = MAX(rt->grain_size * rt->kernel_scale, 1.0f);
+  const float mean_radius = MAX(0.5f * (mean_size - 1.0f), 0.5f);
+  return M_PI_F * mean_radius * mean_radius;
+}
+
+/**
+ * @brief Estimate the actual rasterized grain surface at the current scale.
+ *
+ * @details The grain size slider lives in continuous preview pixels, but the
+ * simulation ultimately grows integer odd-width kernels that get discretized
+ * on the raster grid. That quantization is exactly what changes the look at
+ * small preview scales, so we normalize layer capture against the average
+ * discrete footprint area sampled from a few layer banks instead of against a
+ * noisier variance proxy.
+ */
+__DT_CLONE_TARGETS__
+float dt_crystgrain_average_discrete_grain_surface(const dt_crystgrain_runtime_t *const rt)
+{
+  const int sampled_layers = MIN(rt->layers, 4);
+  if(sampled_layers <= 0) return _average_grain_surface(rt);
+
+  float total_area = 0.0f;
+  int total_kernels = 0;
+
+  for(int layer = 0; layer < sampled_layers; layer++)
+  {
+    dt_crystgrain_layer_kernel_t bank[DT_CRYSTGRAIN_LAYER_KERNELS];
+    const uint64_t layer_seed = rt->base_seed + layer * 4099u;
+
+    if(dt_crystgrain_build_layer_kernel_bank(bank, rt, layer_seed) != 0)
+      return _average_grain_surface(rt);
+
+    for(int i = 0; i < DT_CRYSTGRAIN_LAYER_KERNELS; i++)
+      total_area += bank[i].footprint.area;
+
+    total_kernels += DT_CRYSTGRAIN_LAYER_KERNELS;
+    dt_crystgrain_free_layer_kernel_bank(bank);
+  }
+
+  return (total_area > FLT_EPSILON && total_kernels > 0)
+    ? total_area / total_kernels
+    : _average_grain_surface(rt);
+}
+
+/**
+ * @brief Build the crystal bank for one layer.
+ *
+ * @details We precompute several crystal footprints for the current layer so
+ * each accepted seed can randomly pick one geometry without paying the kernel
+ * construction cost inside the hot pixel loop.
+ */
+__DT_CLONE_TARGETS__
+int dt_crystgrain_build_layer_kernel_bank(dt_crystgrain_layer_kernel_t *const bank,
+                                          const dt_crystgrain_runtime_t *const rt, const uint64_t layer_seed)
+{
+  memset(bank, 0, sizeof(dt_crystgrain_layer_kernel_t) * DT_CRYSTGRAIN_LAYER_KERNELS);
+
+  for(int i = 0; i < DT_CRYSTGRAIN_LAYER_KERNELS; i++)
+  {
+    const uint64_t kernel_seed = layer_seed ^ ((uint64_t)(i + 1) * 0xd1342543de82ef95ull);
+    if(_pick_layer_kernel(&bank[i], rt, kernel_seed) != 0)
+    {
+      for(int k = 0; k < i; k++) _free_crystal_kernel(&bank[k].footprint);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Release all crystal footprints from one layer bank.
+ */
+__DT_CLONE_TARGETS__
+void dt_crystgrain_free_layer_kernel_bank(dt_crystgrain_layer_kernel_t *const bank)
+{
+  for(int i = 0; i < DT_CRYSTGRAIN_LAYER_KERNELS; i++) _free_crystal_kernel(&bank[i].footprint);
+}
+
+/**
+ * @brief Predict the mean captured energy of one flat-field layer.
+ *
+ * @details The output normalization only needs the average exposure loss of
+ * the stochastic crystal stack. For a unit flat field with remaining energy
+ * `r`, one seed of kernel area `A` prints a flat tone
+ * `c = min(r, A * layer_scale)`, because the unit input averages to `1` over
+ * the whole crystal support and the layer sensitivity is expressed per grain
+ * surface. One translated crystal contributes `c * alpha` to a destination
+ * pixel, and the sum of all translated weights over the lattice equals `A`,
+ * so the expected per-pixel capture of one bank entry is:
+ *
+ * `E_i = p_i * A_i * min(r, A_i * layer_scale)`
+ *
+ * where `p_i` is the Bernoulli seed probability of that bank entry. Averaging
+ * `E_i` over the precomputed kernel bank gives a mean-field prediction of the
+ * layer capture that depends only on the grain statistics, not on the image
+ * content.
+ */
+__DT_CLONE_TARGETS__
+float dt_crystgrain_predict_layer_capture(const dt_crystgrain_layer_kernel_t *const bank, const float layer_scale,
+                                          const float remaining_fraction)
+{
+  double capture = 0.0;
+
+  for(int i = 0; i < DT_CRYSTGRAIN_LAYER_KERNELS; i++)
+  {
+    const float area = bank[i].footprint.area;
+    const float captured = fminf(remaining_fraction, area * layer_scale);
+    capture += bank[i].probability * area * captured;
+  }
+
+  return MAX((float)(capture / DT_CRYSTGRAIN_LAYER_KERNELS), 0.0f);
+}
+
+static inline size_t _rgb_index(const size_t pixel, const int channel)
+{
+  return 4 * pixel + channel;
+}
+
+// Columns a row publishes at once to the row below it.
+#define DT_CRYSTGRAIN_SCAN_CHUNK 64
+
+/**
+ * @brief What one layer scan needs to grow the crystals seeded on a row span.
+ */
+typedef struct dt_crystgrain_scan_t
+{
+  const dt_crystgrain_runtime_t *rt;
+  const dt_crystgrain_layer_kernel_t *bank;
+  const float *image;
+  float *result;
+  float *remaining;
+  int layer;   // sub-layer within the spectral stack in color mode
+  int channel; // color mode only
+} dt_crystgrain_scan_t;
+
+typedef void (*dt_crystgrain_span_t)(const dt_crystgrain_scan_t *const scan, const int y, const int x0,
+                                     const int x1);
+
+/**
+ * @brief Grow the monochrome crystals seeded on row `y`, columns [x0; x1).
+ *
+ * @details We loop over seed candidates, looking for pixels that still have
+ * photons left to capture on the current layer. Each seed first picks one
+ * crystal footprint from the precomputed layer bank, then averages the local
+ * layer energy over that footprint so one whole crystal prints one uniform
+ * tone. The crystal is finally grown over that footprint while capping the
+ * accumulated capture by the local layer capacity so the growth stays
+ * energy-conserving. Most pixels live away from image borders, so we keep a
+ * fast path there with direct indexing and only fall back to reflected
+ * coordinates near the edges.
+ */
+__DT_CLONE_TARGETS__
+static void _scan_channel_span(const dt_crystgrain_scan_t *const scan, const int y, const int x0, const int x1)
+{
+  const dt_crystgrain_runtime_t *const rt = scan->rt;
+  const float *const image = scan->image;
+  float *const result = scan->result;
+  float *const remaining = scan->remaining;
+  const int width = rt->width;
+  const int height = rt->height;
+  const int layer = scan->layer;
+  const int world_y = (int)((rt->roi_y + y) * rt->inv_scale);
+
+  for(int x = x0; x < x1; x++)
+  {
+    const size_t index = (size_t)y * width + x;
+    if(remaining[index] <= 0.0f) continue;
+
+    const int world_x = (int)((rt->roi_x + x) * rt->inv_scale);
+    const uint64_t pixel_seed = rt->base_seed
+                                ^ ((uint64_t)(uint32_t)world_x << 32)
+                                ^ (uint32_t)world_y
+                                ^ (uint64_t)(layer + 1) * 0x9e3779b97f4a7c15ull;
+    const int kernel_index = splitmix32(pixel_seed ^ 0x94d049bb133111ebull) & (DT_CRYSTGRAIN_LAYER_KERNELS - 1);
+    const dt_crystgrain_layer_kernel_t *const entry = &scan->bank[kernel_index];
+    const dt_crystgrain_kernel_t *const kernel = &entry->footprint;
+    const int radius = kernel->radius;
+    const int interior = (y >= radius && y < height - radius && x >= radius && x < width - radius);
+    float seed_energy = 0.0f;
+    float original_energy = 0.0f;
+
+    // The seed tests the light field that is still available after all
+    // previous grains and layers have already depleted their share.
+    if(_uniform_random(pixel_seed ^ 0xda942042e4dd58b5ull) >= entry->probability) continue;
+
+    // Like the OpenCL path, each pixel either exits immediately or sweeps
+    // only its own crystal footprint to print one flat tone into the
+    // reconstruction while depleting the remaining light field in place.
+    for(int tap = 0; tap < kernel->count; tap++)
+    {
+      int xx = x + kernel->dx[tap];
+      int yy = y + kernel->dy[tap];
+      if(!interior)
+      {
+        xx = _reflect_index(xx, width);
+        yy = _reflect_index(yy, height);
+      }
+
+      const size_t dst = (size_t)yy * width + xx;
+      // A crystal prints one flat tone from the average of the current
+      // light field and of the immutable input over the whole grain
+      // surface, so no detail finer than the grain survives inside it.
+      seed_energy += remaining[dst] * kernel->alpha[tap];
+      original_energy += image[dst] * kernel->alpha[tap];
+    }
+    seed_energy /= kernel->area;
+    // The user layer scale now applies to the whole grain surface, so the
+    // per-pixel flat tone cap must scale with the grain area too.
+    original_energy *= rt->layer_scale;
+    seed_energy = fminf(seed_energy, original_energy);
+    if(seed_energy <= 0.0f) continue;
+
+    for(int tap = 0; tap < kernel->count; tap++)
+    {
+      int xx = x + kernel->dx[tap];
+      int yy = y + kernel->dy[tap];
+      if(!interior)
+      {
+        xx = _reflect_index(xx, width);
+        yy = _reflect_index(yy, height);
+      }
+
+      const size_t dst = (size_t)yy * width + xx;
+      // Write the flat crystal tone back to the output and subtract the
+      // same quantity from the light field that will feed deeper layers.
+      const float deposited = seed_energy * kernel->alpha[tap];
+      result[dst] += deposited;
+      remaining[dst] = fmaxf(remaining[dst] - deposited, 0.0f);
+    }
+  }
+}
+
+/**
+ * @brief Grow the crystals of one spectral layer seeded on row `y`, columns [x0; x1).
+ */
+__DT_CLONE_TARGETS__
+static void _scan_color_span(const dt_crystgrain_scan_t *const scan, const int y, const int x0, const int x1)
+{
+  const dt_crystgrain_runtime_t *const rt = scan->rt;
+  const float *const image = scan->image;
+  float *const result = scan->result;
+  float *const remaining = scan->remaining;
+  const int width = rt->width;
+  const int height = rt->height;
+  const int c = scan->channel;
+  const int sublayer = scan->layer;
+  const uint64_t channel_salt[3] = {
+    0xa24baed4963ee407ull,
+    0x9fb21c651e98df25ull,
+    0xc13fa9a902a6328full
+  };
+  const int world_y = (int)((rt->roi_y + y) * rt->inv_scale);
+
+  for(int x = x0; x < x1; x++)
+  {
+    const size_t index = (size_t)y * width + x;
+    const float remaining_total = remaining[_rgb_index(index, 0)]
+                                  + remaining[_rgb_index(index, 1)]
+                                  + remaining[_rgb_index(index, 2)];
+    if(remaining_total <= 0.0f) continue;
+
+    const int world_x = (int)((rt->roi_x + x) * rt->inv_scale);
+    const uint64_t shared_seed = rt->base_seed
+                                 ^ ((uint64_t)(uint32_t)world_x << 32)
+                                 ^ (uint32_t)world_y
+                                 ^ (uint64_t)(sublayer + 1) * 0x9e3779b97f4a7c15ull;
+    const uint64_t channel_seed = shared_seed ^ channel_salt[c];
+    const int use_shared = _uniform_random(channel_seed ^ 0x4f1bbcdc6762f96bull) < rt->channel_correlation;
+    const uint64_t pixel_seed = use_shared ? shared_seed : channel_seed;
+    const int kernel_index = splitmix32(pixel_seed ^ 0x94d049bb133111ebull) & (DT_CRYSTGRAIN_LAYER_KERNELS - 1);
+    const dt_crystgrain_layer_kernel_t *const entry = &scan->bank[kernel_index];
+    const dt_crystgrain_kernel_t *const kernel = &entry->footprint;
+    const int radius = kernel->radius;
+    const int interior = (y >= radius && y < height - radius && x >= radius && x < width - radius);
+    float seed_energy = 0.0f;
+    float original_energy = 0.0f;
+
+    if(_uniform_random(pixel_seed ^ 0xda942042e4dd58b5ull) >= entry->probability) continue;
+
+    for(int tap = 0; tap < kernel->count; tap++)
+    {
+      int xx = x + kernel->dx[tap];
+      int yy = y + kernel->dy[tap];
+      if(!interior)
+      {
+        xx = _reflect_index(xx, width);
+        yy = _reflect_index(yy, height);
+      }
+
+      const size_t dst = (size_t)yy * width + xx;
+      // Each depth layer belongs to one spectral emulsion only, so it
+      // prints one flat tone from that channel and leaves the others to
+      // deeper layers.
+      seed_energy += remaining[_rgb_index(dst, c)] * kernel->alpha[tap];
+      original_energy += image[_rgb_index(dst, c)] * kernel->alpha[tap];
+    }
+
+    seed_energy /= kernel->area;
+    original_energy *= rt->layer_scale;
+    const float captured = fminf(seed_energy, original_energy);
+    if(captured <= 0.0f) continue;
+
+    for(int tap = 0; tap < kernel->count; tap++)
+    {
+      int xx = x + kernel->dx[tap];
+      int yy = y + kernel->dy[tap];
+      if(!interior)
+      {
+        xx = _reflect_index(xx, width);
+        yy = _reflect_index(yy, height);
+      }
+
+      const size_t dst = (size_t)yy * width + xx;
+      const float deposited = captured * kernel->alpha[tap];
+      result[_rgb_index(dst, c)] += deposited;
+      remaining[_rgb_index(dst, c)] = fmaxf(remaining[_rgb_index(dst, c)] - deposited, 0.0f);
+    }
+  }
+}
+
+/**
+ * @brief Run `span` over the whole layer, in an order equivalent to the serial raster scan.
+ *
+ * @details A crystal only reads and writes pixels within its kernel radius of its seed,
+ * reflected borders included, so two seeds can only depend on each other when they are
+ * at most `reach = 2 * max radius` apart on both axes. The serial scan orders any such
+ * pair by row, then by column. Rows are dealt round-robin to the threads, and row `y`
+ * only grows the crystals of columns [x0; x1) once row `y - 1` is done up to column
+ * `x1 + reach`. By induction, every row above is then done at least that far, and no
+ * seed still pending above is within `reach` of the span. Crystals that can touch a
+ * common pixel are therefore grown in the serial order, and the same float additions
+ * happen in the same order: the output is identical, not just close.
+ *
+ * Each row waits on the one above, which its thread took earlier in the round-robin,
+ * so the scan always makes progress whatever the number of threads OpenMP hands out.
+ */
+__DT_CLONE_TARGETS__
+static void _scan_layer(const dt_crystgrain_scan_t *const scan, dt_crystgrain_span_t span)
+{
+  const dt_crystgrain_runtime_t *const rt = scan->rt;
+  const int width = rt->width;
+  const int height = rt->height;
+  int reach = 0;
+  for(int i = 0; i < DT_CRYSTGRAIN_LAYER_KERNELS; i++) reach = MAX(reach, 2 * scan->bank[i].footprint.radius);
+
+  // Each row trails the one above by about a chunk and a reach: beyond width / lag rows
+  // in flight, threads would only wait on each other.
+  const int lag = DT_CRYSTGRAIN_SCAN_CHUNK + reach;
+  int threads = MIN(omp_get_max_threads(), MIN(width / lag, height));
+  if(rt->threads > 0) threads = MIN(threads, rt->threads);
+
+  dt_atomic_int *const progress = (threads > 1) ? calloc(height, sizeof(dt_atomic_int)) : NULL;
+  if(IS_NULL_PTR(progress))
+  {
+    for(int y = 0; y < height; y++) span(scan, y, 0, width);
+    return;
+  }
+
+  for(int y = 0; y < height; y++) dt_atomic_set_int(&progress[y], 0);
+
+  __OMP_PARALLEL__(num_threads(threads))
+  {
+    const int stride = omp_get_num_threads();
+    for(int y = omp_get_thread_num(); y < height; y += stride)
+    {
+      for(int x0 = 0; x0 < width; x0 += DT_CRYSTGRAIN_SCAN_CHUNK)
+      {
+        const int x1 = MIN(x0 + DT_CRYSTGRAIN_SCAN_CHUNK, width);
+        if(y > 0)
+        {
+          const int needed = MIN(x1 + reach, width);
+          while(dt_atomic_get_int(&progress[y - 1]) < needed) g_thread_yield();
+        }
+        span(scan, y, x0, x1);
+        dt_atomic_set_int(&progress[y], x1);
+      }
+    }
+  }
+
+  free(progress);
+}
+
+int dt_crystgrain_simulate_channel(const dt_crystgrain_runtime_t *const rt, const float *const image,
+                                   float *const result, float *const remaining, float *const exposure)
+{
+  const size_t npixels = (size_t)rt->width * rt->height;
+  float predicted_remaining = 1.0f;
+  memset(result, 0, sizeof(float) * npixels);
+  memcpy(remaining, image, sizeof(float) * npixels);
+
+  for(int layer = 0; layer < rt->layers; layer++)
+  {
+    dt_crystgrain_layer_kernel_t kernel_bank[DT_CRYSTGRAIN_LAYER_KERNELS];
+    const uint64_t layer_seed = rt->base_seed + layer * 4099u;
+    if(dt_crystgrain_build_layer_kernel_bank(kernel_bank, rt, layer_seed) != 0) return 1;
+    predicted_remaining = fmaxf(predicted_remaining
+                                - dt_crystgrain_predict_layer_capture(kernel_bank, rt->layer_scale,
+                                                                      predicted_remaining),
+                                0.0f);
+
+    const dt_crystgrain_scan_t scan = {
+      .rt = rt,
+      .bank = kernel_bank,
+      .image = image,
+      .result = result,
+      .remaining = remaining,
+      .layer = layer,
+      .channel = 0
+    };
+    _scan_layer(&scan, _scan_channel_span);
+
+    dt_crystgrain_free_layer_kernel_bank(kernel_bank);
+  }
+
+  *exposure = dt_crystgrain_predict_stack_exposure(predicted_remaining);
+  return 0;
+}
+
+/**
+ * @brief Simulate one color grain stack with shared crystal geometry.
+ *
+ * @details Real color film is not achromatic either: it stacks blue-, green-
+ * and red-sensitive monochrome emulsions in depth, each with its own crystal
+ * population. This routine therefore keeps one sequential remaining-light
+ * model, but assigns each layer to one spectral sub-stack in blue/green/red
+ * order. That keeps the physical "light goes through upper layers first"
+ * behavior while avoiding the over-correlated all-channels-at-once look.
+ */
+int dt_crystgrain_simulate_color(const dt_crystgrain_runtime_t *const rt,
+                                 const dt_crystgrain_color_state_t *const state, float *const exposure)
+{
+  const size_t npixels = (size_t)rt->width * rt->height;
+  const int blue_layers = (rt->layers + 2) / 3;
+  const int green_layers = (rt->layers + 1) / 3;
+  float predicted_remaining[3] = { 1.0f, 1.0f, 1.0f };
+
+  memset(state->result, 0, sizeof(float) * npixels * 4);
+  memcpy(state->remaining, state->image, sizeof(float) * npixels * 4);
+
+  for(int layer = 0; layer < rt->layers; layer++)
+  {
+    dt_crystgrain_layer_kernel_t kernel_bank[DT_CRYSTGRAIN_LAYER_KERNELS];
+    const int c = (layer < blue_layers) ? 2 : ((layer < blue_layers + green_layers) ? 1 : 0);
+    const int sublayer = (c == 2) ? layer : ((c == 1) ? layer - blue_layers : layer - blue_layers - green_layers);
+    const uint64_t layer_seed = rt->base_seed + (uint64_t)(sublayer + 1) * 4099u;
+    if(dt_crystgrain_build_layer_kernel_bank(kernel_bank, rt, layer_seed) != 0) return 1;
+    predicted_remaining[c] = fmaxf(predicted_remaining[c]
+                                   - dt_crystgrain_predict_layer_capture(kernel_bank, rt->layer_scale,
+                                                                         predicted_remaining[c]),
+                                   0.0f);
+
+    const dt_crystgrain_scan_t scan = {
+      .rt = rt,
+      .bank = kernel_bank,
+      .image = state->image,
+      .result = state->result,
+      .remaining = state->remaining,
+      .layer = sublayer,
+      .channel = c
+    };
+    _scan_layer(&scan, _scan_color_span);
+
+    dt_crystgrain_free_layer_kernel_bank(kernel_bank);
+  }
+
+  for(int c = 0; c < 3; c++) exposure[c] = dt_crystgrain_predict_stack_exposure(predicted_remaining[c]);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,151 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_PIXEL_CRYSTGRAIN_H
+#define DT_PIXEL_CRYSTGRAIN_H
+
+/**
+ * @file crystgrain.h
+ * @brief CPU simulation of stacked silver-halide crystal layers, for the crystgrain module.
+ *
+ * Every layer scans the image in raster order: each seed reads the light left by the
+ * seeds before it over its crystal footprint, then depletes it. The result therefore
+ * depends on that order. The parallel path keeps it: rows run concurrently, each one far
+ * enough behind the row above that no two crystals being grown at the same time can
+ * touch a common pixel. It gives the same floats as the serial scan, bit for bit.
+ */
+
+#include <float.h>
+#include <stdint.h>
+
+#define DT_CRYSTGRAIN_LAYER_KERNELS 16
+
+typedef struct dt_crystgrain_kernel_t
+{
+  int count;
+  int radius;
+  float radius_f;
+  float area;
+  int *dx;
+  int *dy;
+  float *alpha;
+} dt_crystgrain_kernel_t;
+
+typedef struct dt_crystgrain_layer_kernel_t
+{
+  dt_crystgrain_kernel_t footprint;
+  float probability;
+  float vertices;
+  float rotation;
+  int width;
+} dt_crystgrain_layer_kernel_t;
+
+typedef struct dt_crystgrain_runtime_t
+{
+  int width;
+  int height;
+  int roi_x;
+  int roi_y;
+  int layers;
+  float layer_scale;
+  float filling;
+  float grain_size;
+  float size_stddev;
+  float kernel_scale;
+  float inv_scale;
+  float channel_correlation;
+  uint64_t base_seed;
+  int threads; // upper bound on the rows scanned concurrently, 0 for as many as useful, 1 for serial
+} dt_crystgrain_runtime_t;
+
+typedef struct dt_crystgrain_color_state_t
+{
+  const float *image;
+  float *result;
+  float *remaining;
+} dt_crystgrain_color_state_t;
+
+/**
+ * @brief Build the crystal bank for one layer.
+ *
+ * @return 0 on success, 1 on allocation failure (nothing to free then).
+ */
+int dt_crystgrain_build_layer_kernel_bank(dt_crystgrain_layer_kernel_t *const bank,
+                                          const dt_crystgrain_runtime_t *const rt, const uint64_t layer_seed);
+
+/**
+ * @brief Release all crystal footprints from one layer bank.
+ */
+void dt_crystgrain_free_layer_kernel_bank(dt_crystgrain_layer_kernel_t *const bank);
+
+/**
+ * @brief Predict the mean captured energy of one flat-field layer.
+ */
+float dt_crystgrain_predict_layer_capture(const dt_crystgrain_layer_kernel_t *const bank, const float layer_scale,
+                                          const float remaining_fraction);
+
+/**
+ * @brief Estimate the actual rasterized grain surface at the current scale.
+ */
+float dt_crystgrain_average_discrete_grain_surface(const dt_crystgrain_runtime_t *const rt);
+
+/**
+ * @brief Predict the exposure compensation of one grain stack from its flat-field
+ * remaining light fraction.
+ *
+ * @details If `r_l` is the remaining light fraction before layer `l`, the recurrence is
+ *
+ * `r_(l+1) = max(r_l - mean_i(E_i(r_l)), 0)`
+ *
+ * with `r_0 = 1`. The synthesized stack therefore transmits on average
+ * `1 - r_L`, so the final global exposure correction is simply
+ *
+ * `exposure = 1 / (1 - r_L)`.
+ *
+ * This keeps the output normalization tied to the current grain size, filling
+ * ratio and layer sensitivity without measuring any image averages.
+ */
+static inline float dt_crystgrain_predict_stack_exposure(const float remaining_fraction)
+{
+  const float transmitted = 1.0f - remaining_fraction;
+  return (transmitted > FLT_EPSILON) ? 1.0f / transmitted : 1.0f;
+}
+
+/**
+ * @brief Simulate one monochrome grain field from one scalar image.
+ *
+ * @return 0 on success, 1 on allocation failure.
+ */
+int dt_crystgrain_simulate_channel(const dt_crystgrain_runtime_t *const rt, const float *const image,
+                                   float *const result, float *const remaining, float *const exposure);
+
+/**
+ * @brief Simulate one color grain stack on RGBA buffers, writing 3 exposures.
+ *
+ * @return 0 on success, 1 on allocation failure.
+ */
+int dt_crystgrain_simulate_color(const dt_crystgrain_runtime_t *const rt,
+                                 const dt_crystgrain_color_state_t *const state, float *const exposure);
+
+#endif // DT_PIXEL_CRYSTGRAIN_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,102 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixel/geometry_stage.h"
+#include "pixel/interpolation.h"
+#include "system/openmp.h"
+#include "system/target_clones.h"
+
+#include <math.h>
+#include <string.h>
+
+void dt_geometry_stage_grid(float *const points, const int width, const int height)
+{
+  __OMP_PARALLEL_FOR__()
+  for(int j = 0; j < height; j++)
+  {
+    float *const restrict row = points + (size_t)2 * width * j;
+    for(int i = 0; i < width; i++)
+    {
+      row[2 * i] = (float)i;
+      row[2 * i + 1] = (float)j;
+    }
+  }
+}
+
+void dt_geometry_stage_clip(float *const points, uint8_t *const outside, const size_t count, const int width,
+                            const int height)
+{
+  __OMP_PARALLEL_FOR__(if(count > 1000))
+  for(size_t k = 0; k < count; k++)
+  {
+    const float x = points[2 * k];
+    const float y = points[2 * k + 1];
+    // Written so that NaN fails it too.
+    const int inside = x > -1.f && y > -1.f && x < (float)width && y < (float)height;
+    if(outside[k] || !inside)
+    {
+      outside[k] = 1;
+      points[2 * k] = points[2 * k + 1] = NAN;
+    }
+  }
+}
+
+__DT_CLONE_TARGETS__
+void dt_geometry_stage_sample(const struct dt_interpolation *const itor, const float *const in,
+                              const int in_width, const int in_height, const float *const points,
+                              float *const out, const int width, const int height)
+{
+  const int linestride = 4 * in_width;
+
+  __OMP_PARALLEL_FOR__()
+  for(int j = 0; j < height; j++)
+  {
+    const float *const restrict row = points + (size_t)2 * width * j;
+    float *const restrict out_row = out + (size_t)4 * width * j;
+    for(int i = 0; i < width; i++)
+    {
+      const float x = row[2 * i];
+      const float y = row[2 * i + 1];
+      float *const pixel = out_row + 4 * i;
+
+      if(!isfinite(x) || !isfinite(y))
+      {
+        memset(pixel, 0, 4 * sizeof(float));
+      }
+      else if(itor)
+      {
+        dt_interpolation_compute_pixel4c(itor, in, pixel, x, y, in_width, in_height, linestride);
+      }
+      else
+      {
+        const int ix = (int)roundf(x);
+        const int iy = (int)roundf(y);
+        if(ix >= 0 && iy >= 0 && ix < in_width && iy < in_height)
+          memcpy(pixel, in + (size_t)linestride * iy + 4 * ix, 4 * sizeof(float));
+        else
+          memset(pixel, 0, 4 * sizeof(float));
+      }
+    }
+  }
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
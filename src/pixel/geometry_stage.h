@@ -0,0 +1,91 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_PIXEL_GEOMETRY_STAGE_H
+#define DT_PIXEL_GEOMETRY_STAGE_H
+
+/**
+ * @file geometry_stage.h
+ * @brief Consecutive geometric modules, resampled once.
+ *
+ * lens, ashift, rotatepixels, scalepixels, flip, clipping and crop each move pixels and
+ * nothing else. Run one after the other, each interpolates the output of the previous one:
+ * the image is resampled as many times as there are modules, which costs a full buffer and
+ * some sharpness every time.
+ *
+ * A geometry stage asks each of them where it reads its input for each point of its output
+ * instead, from the last module to the first, so every pixel of the last output ends up with
+ * a position in the input of the first. The input is then sampled once at these positions.
+ * Up to the interpolation error, which is now paid once instead of at every step, the result
+ * is the one of the modules chained.
+ *
+ * Chained, a pixel a module samples outside of its input comes out black, and stays black
+ * downstream. Composed, the upstream modules would still map that point somewhere, often onto
+ * real pixels, so after each module the points falling outside of its input are put out of
+ * the game (see dt_geometry_stage_clip()).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct dt_interpolation;
+
+/** What process() does to go from its input to its output, when it only moves pixels. */
+typedef enum dt_geometry_stage_sampling_t
+{
+  DT_GEOMETRY_STAGE_NONE = 0,     // process() does more than moving pixels: it has to run
+  DT_GEOMETRY_STAGE_COPY = 1,     // output pixels are input pixels, points land on integers
+  DT_GEOMETRY_STAGE_RESAMPLE = 2, // output pixels are interpolated between input pixels
+} dt_geometry_stage_sampling_t;
+
+/**
+ * @brief Fill @p points with the (x, y) pixel coordinates of a @p width x @p height buffer,
+ * row after row.
+ */
+void dt_geometry_stage_grid(float *const points, const int width, const int height);
+
+/**
+ * @brief Turn into NaN the points outside of a @p width x @p height input, and the points
+ * already flagged in @p outside, and flag them.
+ *
+ * The test is the one of dt_interpolation_compute_pixel4c(): a point is inside while its
+ * coordinates truncated toward zero are. @p outside holds one flag per point, zeroed before the
+ * first call. It outlives the calls because an upstream module is free to map a NaN point back
+ * into the image, as lens does when it clamps.
+ */
+void dt_geometry_stage_clip(float *const points, uint8_t *const outside, const size_t count, const int width,
+                            const int height);
+
+/**
+ * @brief Sample the RGBA buffer @p in at @p points, one (x, y) pair per pixel of @p out.
+ *
+ * Points are in pixels of @p in. With @p itor NULL, the nearest pixel is copied, which is exact
+ * when all the modules of the stage copy. Otherwise @p itor interpolates. Points outside of
+ * @p in, or not finite, give black.
+ */
+void dt_geometry_stage_sample(const struct dt_interpolation *const itor, const float *const in,
+                              const int in_width, const int in_height, const float *const points,
+                              float *const out, const int width, const int height);
+
+#endif // DT_PIXEL_GEOMETRY_STAGE_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
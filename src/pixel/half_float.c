@@ -0,0 +1,266 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "pixel/half_float.h"
+#include "system/openmp.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DT_HALF_FLOAT_F16C 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Elements per OpenMP chunk: large enough to amortize the dispatch, small enough to balance.
+#define DT_HALF_FLOAT_BLOCK 65536
+
+static inline uint32_t _float_bits(const float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float _bits_float(const uint32_t u)
+{
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+// Round to nearest, ties to even. `in` must be within ±DT_HALF_FLOAT_MAX.
+static inline uint16_t _float_to_half(const float in)
+{
+  const uint32_t bits = _float_bits(in);
+  const uint32_t sign = (bits >> 16) & 0x8000u;
+  const uint32_t abs = bits & 0x7fffffffu;
+
+  // Below 2^-25, half of the smallest subnormal: rounds to zero.
+  if(abs < 0x33000000u) return (uint16_t)sign;
+
+  if(abs < 0x38800000u)
+  {
+    // Subnormal half, in units of 2^-24. The carry out of the mantissa gives the
+    // smallest normal, which is the right encoding.
+    const uint32_t mantissa = (abs & 0x7fffffu) | 0x800000u;
+    const uint32_t shift = 126u - (abs >> 23);
+    const uint32_t halfway = 1u << (shift - 1);
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t half = mantissa >> shift;
+    if(rest > halfway || (rest == halfway && (half & 1u))) half++;
+    return (uint16_t)(sign | half);
+  }
+
+  // Normal: rebias the exponent from 127 to 15 and drop 13 mantissa bits.
+  uint32_t half = (abs - 0x38000000u) >> 13;
+  const uint32_t rest = abs & 0x1fffu;
+  if(rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+  return (uint16_t)(sign | half);
+}
+
+static inline float _half_to_float(const uint16_t in)
+{
+  const uint32_t sign = (uint32_t)(in & 0x8000u) << 16;
+  const uint32_t exponent = (in >> 10) & 0x1fu;
+  const uint32_t mantissa = in & 0x3ffu;
+
+  if(exponent == 0) return _bits_float(_float_bits((float)mantissa * 0x1p-24f) | sign);
+  if(exponent == 31) return _bits_float(sign | 0x7f800000u | (mantissa << 13));
+  return _bits_float(sign | ((exponent + 112u) << 23) | (mantissa << 13));
+}
+
+static gboolean _pack_scalar(uint16_t *const out, const float *const in, const size_t count)
+{
+  for(size_t k = 0; k < count; k++)
+  {
+    // Also catches NaN.
+    if(!(fabsf(in[k]) <= DT_HALF_FLOAT_MAX)) return FALSE;
+    out[k] = _float_to_half(in[k]);
+  }
+  return TRUE;
+}
+
+static void _unpack_scalar(float *const out, const uint16_t *const in, const size_t count)
+{
+  for(size_t k = 0; k < count; k++) out[k] = _half_to_float(in[k]);
+}
+
+#if defined(DT_HALF_FLOAT_F16C)
+__attribute__((target("avx,f16c")))
+static gboolean _pack_f16c(uint16_t *const out, const float *const in, const size_t count)
+{
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 limit = _mm256_set1_ps(DT_HALF_FLOAT_MAX);
+  __m256 out_of_range = _mm256_setzero_ps();
+  size_t k = 0;
+
+  for(; k + 8 <= count; k += 8)
+  {
+    const __m256 v = _mm256_loadu_ps(in + k);
+    // Not less or equal, unordered: true for NaN too.
+    out_of_range = _mm256_or_ps(out_of_range, _mm256_cmp_ps(_mm256_and_ps(v, abs_mask), limit, _CMP_NLE_UQ));
+    _mm_storeu_si128((__m128i *)(out + k), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+
+  if(_mm256_movemask_ps(out_of_range)) return FALSE;
+  return _pack_scalar(out + k, in + k, count - k);
+}
+
+__attribute__((target("avx,f16c")))
+static void _unpack_f16c(float *const out, const uint16_t *const in, const size_t count)
+{
+  size_t k = 0;
+  for(; k + 8 <= count; k += 8)
+    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + k))));
+  _unpack_scalar(out + k, in + k, count - k);
+}
+#elif defined(__aarch64__)
+static gboolean _pack_neon(uint16_t *const out, const float *const in, const size_t count)
+{
+  const float32x4_t limit = vdupq_n_f32(DT_HALF_FLOAT_MAX);
+  uint32x4_t in_range = vdupq_n_u32(0xffffffffu);
+  size_t k = 0;
+
+  for(; k + 4 <= count; k += 4)
+  {
+    const float32x4_t v = vld1q_f32(in + k);
+    // False for NaN.
+    in_range = vandq_u32(in_range, vcaleq_f32(v, limit));
+    vst1_u16(out + k, vreinterpret_u16_f16(vcvt_f16_f32(v)));
+  }
+
+  if(vminvq_u32(in_range) == 0) return FALSE;
+  return _pack_scalar(out + k, in + k, count - k);
+}
+
+static void _unpack_neon(float *const out, const uint16_t *const in, const size_t count)
+{
+  size_t k = 0;
+  for(; k + 4 <= count; k += 4) vst1q_f32(out + k, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in + k))));
+  _unpack_scalar(out + k, in + k, count - k);
+}
+#endif
+
+static gboolean _pack_block(uint16_t *const out, const float *const in, const size_t count)
+{
+#if defined(DT_HALF_FLOAT_F16C)
+  if(__builtin_cpu_supports("f16c")) return _pack_f16c(out, in, count);
+#elif defined(__aarch64__)
+  return _pack_neon(out, in, count);
+#endif
+  return _pack_scalar(out, in, count);
+}
+
+static void _unpack_block(float *const out, const uint16_t *const in, const size_t count)
+{
+#if defined(DT_HALF_FLOAT_F16C)
+  if(__builtin_cpu_supports("f16c"))
+  {
+    _unpack_f16c(out, in, count);
+    return;
+  }
+#elif defined(__aarch64__)
+  _unpack_neon(out, in, count);
+  return;
+#endif
+  _unpack_scalar(out, in, count);
+}
+
+gboolean dt_half_float_pack(uint16_t *const out, const float *const in, const size_t count)
+{
+  const size_t blocks = (count + DT_HALF_FLOAT_BLOCK - 1) / DT_HALF_FLOAT_BLOCK;
+  int ok = TRUE;
+
+  __OMP_PARALLEL_FOR__(reduction(&:ok))
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t start = b * DT_HALF_FLOAT_BLOCK;
+    const size_t n = MIN(DT_HALF_FLOAT_BLOCK, count - start);
+    ok &= _pack_block(out + start, in + start, n);
+  }
+
+  return ok != 0;
+}
+
+static int _in_range(const float *const in, const size_t count)
+{
+  int ok = TRUE;
+  for(size_t k = 0; k < count; k++) ok &= (fabsf(in[k]) <= DT_HALF_FLOAT_MAX);
+  return ok;
+}
+
+gboolean dt_half_float_pack_in_place(void *const buf, const size_t count)
+{
+  const float *const in = (const float *)buf;
+  uint16_t *const out = (uint16_t *)buf;
+  const size_t blocks = (count + DT_HALF_FLOAT_BLOCK - 1) / DT_HALF_FLOAT_BLOCK;
+  int ok = TRUE;
+
+  // Check everything first: once packing starts, the floats are gone.
+  __OMP_PARALLEL_FOR__(reduction(&:ok))
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t start = b * DT_HALF_FLOAT_BLOCK;
+    ok &= _in_range(in + start, MIN(DT_HALF_FLOAT_BLOCK, count - start));
+  }
+  if(!ok) return FALSE;
+  if(blocks == 0) return TRUE;
+
+  // Block 0 overwrites its own input, behind the read position.
+  _pack_block(out, in, MIN(DT_HALF_FLOAT_BLOCK, count));
+
+  // Any other block b overwrites the input of block b / 2 only. So blocks [first, 2 first)
+  // overwrite blocks the previous waves are done with, and not each other.
+  for(size_t first = 1; first < blocks; first *= 2)
+  {
+    const size_t last = MIN(2 * first, blocks);
+    __OMP_PARALLEL_FOR__()
+    for(size_t b = first; b < last; b++)
+    {
+      const size_t start = b * DT_HALF_FLOAT_BLOCK;
+      _pack_block(out + start, in + start, MIN(DT_HALF_FLOAT_BLOCK, count - start));
+    }
+  }
+
+  return TRUE;
+}
+
+void dt_half_float_unpack(float *const out, const uint16_t *const in, const size_t count)
+{
+  const size_t blocks = (count + DT_HALF_FLOAT_BLOCK - 1) / DT_HALF_FLOAT_BLOCK;
+
+  __OMP_PARALLEL_FOR__()
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t start = b * DT_HALF_FLOAT_BLOCK;
+    _unpack_block(out + start, in + start, MIN(DT_HALF_FLOAT_BLOCK, count - start));
+  }
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
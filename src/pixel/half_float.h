@@ -0,0 +1,69 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_PIXEL_HALF_FLOAT_H
+#define DT_PIXEL_HALF_FLOAT_H
+
+/**
+ * @file half_float.h
+ * @brief Packing float buffers to IEEE 754 binary16 and back.
+ *
+ * Used to store idle pixelpipe cachelines in half the memory. Rounding is to nearest,
+ * ties to even, so a value that fits in the half range comes back within:
+ *
+ * - DT_HALF_FLOAT_RELATIVE_ERROR × |x| for |x| >= 2^-14 (normal halves),
+ * - DT_HALF_FLOAT_ABSOLUTE_ERROR for smaller |x| (subnormal halves).
+ *
+ * Uses F16C on x86 CPUs that have it (checked at runtime) and NEON on arm64.
+ */
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DT_HALF_FLOAT_MAX 65504.f
+#define DT_HALF_FLOAT_RELATIVE_ERROR 0x1p-11f
+#define DT_HALF_FLOAT_ABSOLUTE_ERROR 0x1p-25f
+
+/**
+ * @brief Convert `count` floats to halves.
+ *
+ * @return FALSE if some value is NaN or beyond ±DT_HALF_FLOAT_MAX: `out` is then
+ * partially written and must be discarded, the caller keeps the floats.
+ */
+gboolean dt_half_float_pack(uint16_t *const out, const float *const in, const size_t count);
+
+/**
+ * @brief Pack `count` floats to halves in place, in the first half of `buf`.
+ *
+ * @return FALSE, with `buf` untouched, if some value is NaN or beyond ±DT_HALF_FLOAT_MAX.
+ */
+gboolean dt_half_float_pack_in_place(void *const buf, const size_t count);
+
+/**
+ * @brief Convert `count` halves back to floats.
+ */
+void dt_half_float_unpack(float *const out, const uint16_t *const in, const size_t count);
+
+#endif // DT_PIXEL_HALF_FLOAT_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -47,334 +47,251 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
- *
- * I reduced the convergence criteria to 0.1% (0.001) as we are
- * dealing here with RGB integer components, more is overkill.
+ * mask.
  *
  * Jean-Yves Couleaud cjyves@free.fr
  */
 
+/* The membrane is solved by geometric multigrid V-cycles. The red/black Gauss-Seidel
+ * with over-relaxation used before needed a number of iterations growing with the
+ * size of the patch, so large shapes at 1:1 and in exports took seconds, or stopped at
+ * max_iter before converging. Gauss-Seidel only damps the error at the scale of a few
+ * pixels; the V-cycle hands the smooth remainder down to coarser grids where it is a
+ * few pixels wide again, and each cycle divides the error by about the same factor
+ * whatever the patch size.
+ *
+ * Every level solves the same discrete equation, one per unknown pixel p:
+ *
+ *   deg(p) * u(p) - sum of u over the 4-neighbours of p inside the patch = rhs(p)
+ *
+ * where deg(p) counts those neighbours (the patch border is free, as before) and
+ * rhs = 0 on the finest level. Pixels outside the mask hold the Dirichlet values there,
+ * and zero correction on coarser levels. A coarse cell is unknown only when its 2x2 fine
+ * pixels all are: a coarse grid overhanging the mask border would solve a wider membrane
+ * than the fine one and overshoot, cycle after cycle. Strokes thinner than a coarse cell
+ * drop out of that grid, which costs nothing since the fine sweeps converge quickly that
+ * close to the border. Residuals are summed over each 2x2 block (the cell-centred
+ * restriction, scaled for the coarse grid spacing), corrections come back bilinearly.
+ */
+
+#define HEAL_PRE_SMOOTH 2
+#define HEAL_POST_SMOOTH 2
+#define HEAL_COARSEST_SMOOTH 32
+#define HEAL_MAX_LEVELS 16
 
-// Subtract bottom from top and store in result as a float; separate 'red' and 'black' pixels into
-// two contiguous regions
-static void _heal_sub(const float *const top_buffer, const float *const bottom_buffer,
-                      float *const restrict red_buffer, float *const restrict black_buffer,
-                      const size_t width, const size_t height)
+// Cycles stop once they change no pixel by more than this, relative to the largest
+// Dirichlet value. Each cycle divides the error by about 10, so what is left by then is
+// of the same order; tighter would only chase float rounding on large patches.
+#define HEAL_TOLERANCE 1e-5f
+
+typedef struct _heal_level_t
 {
-  // how many red or black pixels per line?  For consistency, we need the larger of the two, so round up
-  const size_t res_stride = 4 * ((width + 1) / 2);
-  __OMP_PARALLEL_FOR__()
-  for(size_t row = 0; row < height; row++)
+  size_t width;
+  size_t height;
+  float *u;       // 4 floats per pixel: the membrane on the finest level, its correction below
+  float *rhs;     // 4 floats per pixel, NULL on the finest level where the equation is homogeneous
+  uint8_t *mask;  // 1 for unknown pixels
+} _heal_level_t;
+
+// Sum of u over the neighbours of pixel (row, col) inside the level, and their count
+static inline float _heal_neighbours(const _heal_level_t *const l, const size_t row, const size_t col,
+                                     dt_aligned_pixel_t sum)
+{
+  const float *const u = l->u;
+  const size_t k = row * l->width + col;
+  float deg = 0.f;
+  for_four_channels(c) sum[c] = 0.f;
+  if(row > 0)
   {
-    const int parity = row & 1;
-    const size_t row_start = (row+1) * res_stride;
-    float *const buf1 = parity ? red_buffer + row_start : black_buffer + row_start;
-    float *const buf2 = parity ? black_buffer + row_start : red_buffer + row_start;
-    // handle the pixels of the row pairwise, one red and one black at a time
-    for(size_t col = 0; col < width/2; col++)
-    {
-      const size_t idx = 4 * (row * width + 2*col);
-      for_each_channel(c)
-      {
-        buf1[4*col + c] = top_buffer[idx + c] - bottom_buffer[idx + c];
-        buf2[4*col + c] = top_buffer[idx+4 + c] - bottom_buffer[idx+4 + c];
-      }
-    }
-    if(width & 1)
-    {
-      // Handle the left-over pixel when the total width is odd.  Its color will always be the same as the
-      // left-most pixel, so it goes into buf1
-      const size_t res_idx = (width-1)/2;
-      const size_t idx = 4 * (row * width + (width-1));
-      for_each_channel(c)
-      {
-        buf1[4*res_idx + c] = top_buffer[idx + c] - bottom_buffer[idx + c];
-        buf2[4*res_idx + c] = 0.0f;
-      }
-    }
+    for_each_channel(c) sum[c] += u[4 * (k - l->width) + c];
+    deg += 1.f;
+  }
+  if(row + 1 < l->height)
+  {
+    for_each_channel(c) sum[c] += u[4 * (k + l->width) + c];
+    deg += 1.f;
+  }
+  if(col > 0)
+  {
+    for_each_channel(c) sum[c] += u[4 * (k - 1) + c];
+    deg += 1.f;
+  }
+  if(col + 1 < l->width)
+  {
+    for_each_channel(c) sum[c] += u[4 * (k + 1) + c];
+    deg += 1.f;
   }
-  // clear the top and bottom rows, used for padding
-  memset(red_buffer, 0, res_stride * sizeof(float));
-  memset(red_buffer + (height+1)*res_stride, 0, res_stride * sizeof(float));
-  memset(black_buffer, 0, res_stride * sizeof(float));
-  memset(black_buffer + (height+1)*res_stride, 0, res_stride * sizeof(float));
+  return deg;
 }
 
-// Add first to second and store in result, re-interleaving the 'red' and 'black' pixels
-static void _heal_add(const float *const restrict red_buffer, const float *const black_buffer,
-                      const float *const restrict second_buffer, float *const restrict result_buffer,
-                      const size_t width, const size_t height)
+// One red/black Gauss-Seidel sweep over the unknowns of a level. Returns the largest update.
+static float _heal_smooth(_heal_level_t *const l)
 {
-  // how many red or black pixels per line?  For consistency, we need the larger of the two, so round up, then
-  // add one to ensure a padding pixel on the right
-  const size_t res_stride = 4 * ((width + 1) / 2);
-  __OMP_PARALLEL_FOR__()
-  for(size_t row = 0; row < height; row++)
+  const size_t w = l->width;
+  float max_update = 0.f;
+  for(size_t color = 0; color < 2; color++)
   {
-    const int parity = row & 1;
-    const size_t row_start = (row+1) * res_stride;
-    const float *const restrict buf1 = parity ? red_buffer + row_start : black_buffer + row_start;
-    const float *const restrict buf2 = parity ? black_buffer + row_start : red_buffer + row_start;
-    // handle the pixels of the row pairwise, one red and one black at a time
-    for(size_t col = 0; col < width/2; col++)
+    __OMP_PARALLEL_FOR__(reduction(max : max_update))
+    for(size_t row = 0; row < l->height; row++)
     {
-      const size_t idx = 4 * (row * width + 2*col);
-      for_each_channel(c)
+      const gboolean inner_row = row > 0 && row + 1 < l->height;
+      for(size_t col = (row + color) & 1; col < w; col += 2)
       {
-        result_buffer[idx + c] = buf1[4*col + c] + second_buffer[idx + c];
-        result_buffer[idx + 4 + c] = buf2[4*col + c] + second_buffer[idx + 4 + c];
+        const size_t k = row * w + col;
+        if(!l->mask[k]) continue;
+
+        float *const u = l->u + 4 * k;
+        dt_aligned_pixel_t sum;
+        float deg = 4.f;
+        if(inner_row && col > 0 && col + 1 < w)
+          for_each_channel(c) sum[c] = u[c - 4 * w] + u[c + 4 * w] + u[c - 4] + u[c + 4];
+        else
+          deg = _heal_neighbours(l, row, col, sum);
+        if(deg == 0.f) continue; // 1x1 level: the correction stays 0
+
+        if(l->rhs) for_each_channel(c) sum[c] += l->rhs[4 * k + c];
+        dt_aligned_pixel_t update = { 0.f, 0.f, 0.f, 0.f };
+        for_each_channel(c)
+        {
+          const float v = sum[c] / deg;
+          update[c] = fabsf(v - u[c]);
+          u[c] = v;
+        }
+        max_update = fmaxf(max_update, fmaxf(update[0], fmaxf(update[1], update[2])));
       }
     }
-    if(width & 1)
-    {
-      // handle the left-over pixel when the total width is odd
-      const size_t res_idx = (width-1)/2;
-      const size_t idx = 4 * (row * width + (width-1));
-      for_each_channel(c)
-        result_buffer[idx + c] = buf1[4*res_idx + c] + second_buffer[idx + c];
-    }
   }
+  return max_update;
 }
 
-// define a custom reduction operation to handle a 3-vector of floats
-// we can't return an array from a function, so wrap the array type in a struct
-typedef struct _aligned_pixel { dt_aligned_pixel_t v; } _aligned_pixel;
-#ifdef _OPENMP
-static inline _aligned_pixel _add_float4(_aligned_pixel acc, _aligned_pixel newval)
-{
-  for_each_channel(c) acc.v[c] += newval.v[c];
-  return acc;
-}
-#pragma omp declare reduction(vsum:_aligned_pixel:omp_out=_add_float4(omp_out,omp_in)) \
-  initializer(omp_priv = { { 0.0f, 0.0f, 0.0f, 0.0f } })
-#endif
-
-// Perform one iteration of Gauss-Seidel, and return the sum squared residual.
-static float _heal_laplace_iteration(float *const restrict active_pixels,
-                                     const float *const restrict neighbor_pixels,
-                                     const size_t height, const size_t width, const unsigned *const restrict runs,
-                                     const size_t num_runs, const size_t start_parity, const float w)
+// Sum the residual of the fine level over each 2x2 block into the coarse right-hand side,
+// and reset the coarse correction.
+static void _heal_restrict_residual(const _heal_level_t *const fine, _heal_level_t *const coarse)
 {
-  _aligned_pixel err = { { 0.f } };
-
-  // on each iteration, we adjust each cell of the current color by a weighted fraction of the difference between
-  // it and the sum of the adjacenct cells of the opposite color.  Because we've split the cells by color, this
-  // leads to a somewhat different computation of neighbors.
-  // Rearranged, as provided to this function:
-  //   r00 r01 r02 ...           b00 b01 b02 ...
-  //   r10 r11 r12               b10 b11 b12
-  //   r20 r21 r22               b20 b21 b22
-  //   ...                       ...
-  // Original layout, from which we need to get the neighbors:
-  //     r00 b00 r01 b01 r02 b02 ...
-  //     b10 r10 b11 r11 b12 r12
-  //     r20 b20 r21 b21 r22 b22
-  //     b30 r30 b31 r31 b32 r32
-  //     ...
-  // As can be seen, the 'above' and 'below' neighbors of r(i)(j) are always b(i-1)(j) and b(i+1)(j).  The
-  // left and right neighbors depend on which color the row starts with: if red, they are b(i)(j-1) and b(i)(j);
-  // if black, they are b(i)(j) and b(i)(j+1).  All of the above holds when colors are swapped.
-#if !(defined(__apple_build_version__) && __apple_build_version__ < 11030000) //makes Xcode 11.3.1 compiler crash
-__OMP_PARALLEL_FOR__(reduction(vsum : err)) /* _OPENMP */
-#endif
-    for(size_t i = 0; i < num_runs; i++)
+  __OMP_PARALLEL_FOR__()
+  for(size_t row = 0; row < coarse->height; row++)
+  {
+    for(size_t col = 0; col < coarse->width; col++)
     {
-      const size_t idx = runs[2*i];
-      const unsigned count = runs[2*i+1];
-      const size_t index = (size_t)4 * idx;
-      const size_t row = idx / width;
-      float a = 4.0f; // four neighboring pixels except at the edges
-      if(row == 1) a -= 1.0f;  // we added a padding row at top and bottom
-      if(row == height) a -= 1.0f;
-      const size_t vert_offset = 4 * width;
-      const size_t lroffset = 4 * (start_parity ^ (row & 1)); // how many floats to offset the left/right neighbors
-      if(count == 1)
-      {
-        const size_t col = idx % width;
-        float aa = a;
-        dt_aligned_pixel_t left = { 0.0f };
-        dt_aligned_pixel_t right = { 0.0f };
-        if(col > 0 || lroffset) // first pixel in original stamp?
-          for_each_channel(c) left[c] = neighbor_pixels[index - 4 + lroffset + c];
-        else
-          aa -= 1.0f;
-        if(col + 1 < width || lroffset == 0) // last pixel in original stamp?
-          for_each_channel(c) right[c] = neighbor_pixels[index + lroffset + c];
-        else
-          aa -= 1.0f;
-
-        dt_aligned_pixel_t diff;
-        for_each_channel(c, aligned(active_pixels, neighbor_pixels))
-        {
-          diff[c] = w * ((aa * active_pixels[index+c])
-                             - (neighbor_pixels[index - vert_offset + c] + neighbor_pixels[index + vert_offset + c]
-                                + left[c] + right[c]));
-          active_pixels[index + c] -= diff[c];
-          err.v[c] += (diff[c] * diff[c]);
-        }
-        continue;
-      }
-      dt_aligned_pixel_t left;
-      copy_pixel(left, neighbor_pixels + index - 4 + lroffset);
-      for(size_t j = 0; j < count; j++)
-      {
-        const size_t pixidx = index + 4*j;
-        dt_aligned_pixel_t diff;
-        dt_aligned_pixel_t right;
-        for_each_channel(c, aligned(active_pixels,neighbor_pixels))
+      dt_aligned_pixel_t r = { 0.f, 0.f, 0.f, 0.f };
+      for(size_t y = 2 * row; y < MIN(2 * row + 2, fine->height); y++)
+        for(size_t x = 2 * col; x < MIN(2 * col + 2, fine->width); x++)
         {
-          right[c] = neighbor_pixels[pixidx + lroffset + c];
-          diff[c] = w * (a * active_pixels[pixidx+c]
-                         - (neighbor_pixels[pixidx - vert_offset + c] + neighbor_pixels[pixidx + vert_offset + c]
-                            + left[c] + right[c]));
-          active_pixels[pixidx + c] -= diff[c];
-          err.v[c] += (diff[c] * diff[c]);
-          left[c] = right[c];
+          const size_t k = y * fine->width + x;
+          if(!fine->mask[k]) continue;
+
+          dt_aligned_pixel_t sum;
+          const float deg = _heal_neighbours(fine, y, x, sum);
+          for_each_channel(c)
+          {
+            const float rhs = fine->rhs ? fine->rhs[4 * k + c] : 0.f;
+            r[c] += rhs + sum[c] - deg * fine->u[4 * k + c];
+          }
         }
-      }
+
+      const size_t k = row * coarse->width + col;
+      copy_pixel(coarse->rhs + 4 * k, r);
+      for_four_channels(c) coarse->u[4 * k + c] = 0.f;
     }
-  return err.v[0] + err.v[1] + err.v[2];
+  }
 }
 
-// convert alternating pixels of one row of the opacity mask into a set of runs of opaque pixels of the
-// form (start_index, count), and return the updated number of runs
-static size_t _collect_color_runs(const float *const restrict mask, const size_t start_index,
-                                  size_t start, const size_t width,
-                                  unsigned *const restrict runs, size_t count, size_t *nmask)
+// Add the coarse correction, interpolated bilinearly, to the unknowns of the fine level.
+// Returns the largest correction.
+static float _heal_prolong(const _heal_level_t *const coarse, _heal_level_t *const fine)
 {
-  size_t masked = 0;
-  // handle the first and last pixels of the row specially so that we don't need checks on every pixel in the
-  // adaptation loop (which will be run hundreds of times for any stamp large enough that execution time is
-  // non-negligible)
-  if(start == 0 && mask[start])
+  float max_correction = 0.f;
+  __OMP_PARALLEL_FOR__(reduction(max : max_correction))
+  for(size_t row = 0; row < fine->height; row++)
   {
-    runs[2*count] = start_index;
-    runs[2*count+1] = 1;
-    count++;
-    masked++;
-    start += 2; // we've processed the first pixel
-  }
-  gboolean in_run = FALSE;
-  unsigned run_start = 0;
-  size_t col;
-  for(col = start; col < width; col += 2)
-  {
-    if(mask[col])
+    // the fine pixel sits in one quarter of its coarse cell: the other three cells weighted
+    // are the ones on that side, or the cell itself past the border
+    const size_t cy = row / 2;
+    const size_t ny = (row & 1) ? MIN(cy + 1, coarse->height - 1) : (cy > 0 ? cy - 1 : 0);
+    for(size_t col = 0; col < fine->width; col++)
     {
-      masked++;
-      if(!in_run)
+      const size_t k = row * fine->width + col;
+      if(!fine->mask[k]) continue;
+
+      const size_t cx = col / 2;
+      const size_t nx = (col & 1) ? MIN(cx + 1, coarse->width - 1) : (cx > 0 ? cx - 1 : 0);
+      const float *const e00 = coarse->u + 4 * (cy * coarse->width + cx);
+      const float *const e01 = coarse->u + 4 * (cy * coarse->width + nx);
+      const float *const e10 = coarse->u + 4 * (ny * coarse->width + cx);
+      const float *const e11 = coarse->u + 4 * (ny * coarse->width + nx);
+      dt_aligned_pixel_t e = { 0.f, 0.f, 0.f, 0.f };
+      for_each_channel(c)
       {
-        run_start = col;
-        in_run = TRUE;
+        e[c] = (9.f * e00[c] + 3.f * e01[c] + 3.f * e10[c] + e11[c]) / 16.f;
+        fine->u[4 * k + c] += e[c];
       }
+      max_correction = fmaxf(max_correction, fmaxf(fabsf(e[0]), fmaxf(fabsf(e[1]), fabsf(e[2]))));
     }
-    else if(in_run)
-    {
-      runs[2*count] = start_index + run_start / 2;
-      runs[2*count + 1] = (col - run_start) / 2;
-      count++;
-      in_run = FALSE;
-    }
-  }
-  if(in_run)  // finish off a run that doesn't have a zero pixel to its right
-  {
-    runs[2*count] = start_index + run_start / 2;
-    const unsigned runlen = (col - run_start) / 2;
-    runs[2*count + 1] = runlen;
-    if(runlen > 1 && col > width)
-    {
-      // split off the final pixel into its own run
-      runs[2*count + 1]--;
-      runs[2*count + 2] = runs[2*count] + runs[2*count+1];
-      runs[2*count + 3] = 1;
-      count++;
-    }
-    count++;
   }
-  *nmask += masked;
-  return count;
+  return max_correction;
 }
 
-// convert one row of the opacity mask into a set of runs of opaque pixels of the form (start_index, count)
-static void collect_runs(const int start, const float *const restrict mask, const size_t width, const size_t height,
-                         const size_t subwidth, unsigned *const restrict runs, size_t *count, size_t *nmask)
+// One V-cycle from `level` down. Returns how much it still changed that level at the end:
+// the coarse correction, or the last smoothing sweep if that moved it more.
+static float _heal_vcycle(_heal_level_t *const levels, const int level, const int num_levels)
 {
-  for(size_t row = 0; row < height; row++)
+  _heal_level_t *const l = levels + level;
+  if(level == num_levels - 1)
   {
-    const int parity = start ^ (row & 1);
-    const size_t index = (row + 1) * subwidth;
-    const size_t mask_index = row * width;
-    *count = _collect_color_runs(mask + mask_index, index, parity, width, runs, *count, nmask);
+    float update = 0.f;
+    for(int i = 0; i < HEAL_COARSEST_SMOOTH; i++) update = _heal_smooth(l);
+    return update;
   }
+
+  for(int i = 0; i < HEAL_PRE_SMOOTH; i++) _heal_smooth(l);
+  _heal_restrict_residual(l, l + 1);
+  _heal_vcycle(levels, level + 1, num_levels);
+  const float correction = _heal_prolong(l + 1, l);
+  float update = 0.f;
+  for(int i = 0; i < HEAL_POST_SMOOTH; i++) update = _heal_smooth(l);
+  return fmaxf(correction, update);
 }
 
-// Solve the laplace equation for pixels and store the result in-place.
-static void _heal_laplace_loop(float *const restrict red_pixels, float *const restrict black_pixels,
-                               const size_t width, const size_t height,
-                               const float *const restrict mask, const int max_iter)
+// Build the coarse levels below levels[0]. Returns how many levels there are, 0 on allocation failure.
+static int _heal_alloc_levels(_heal_level_t *const levels)
 {
-  // we start by converting the opacity mask into runs of nonzero positions, handling the 'red' and 'black'
-  // checkerboarded pixels separately
-  // the worst case is when consecutive red pixels alternate between being in the mask and out (same for black),
-  // in which case we will need exactly as many values in the run-length encoding as pixels; any other
-  // arrangement will yield fewer runs.  For any mask a user would have the patience to draw, there will only be
-  // a handful of runs in each row of pixels.
-  // Note that using `unsigned` instead of size_t, the stamp is limited to ~8 gigapixels (the main image can be larger)
-  const size_t subwidth = (width+1)/2;  // round up to be able to handle odd widths
-  unsigned *const restrict red_runs = dt_pixelpipe_cache_alloc_align_cache(
-      sizeof(unsigned) * subwidth * (height + 2),
-      0);
-  unsigned *const restrict black_runs = dt_pixelpipe_cache_alloc_align_cache(
-      sizeof(unsigned) * subwidth * (height + 2),
-      0);
-  if(IS_NULL_PTR(red_runs) || IS_NULL_PTR(black_runs))
+  int num_levels = 1;
+  while(num_levels < HEAL_MAX_LEVELS && (levels[num_levels - 1].width > 2 || levels[num_levels - 1].height > 2))
   {
-    fprintf(stderr, "_heal_laplace_loop: error allocating memory for healing\n");
-    goto cleanup;
-  }
-
-  size_t num_red = 0;
-  size_t num_black = 0;
-  size_t nmask_red = 0;
-  size_t nmask_black = 0;
-
-#ifdef _OPENMP
-#pragma omp parallel sections
-#endif
-  {
-    collect_runs(1, mask, width, height, subwidth, red_runs, &num_red, &nmask_red);
-    #ifdef _OPENMP
-    #pragma omp section
-    #endif
-    collect_runs(0, mask, width, height, subwidth, black_runs, &num_black, &nmask_black);
+    const _heal_level_t *const fine = levels + num_levels - 1;
+    _heal_level_t *const coarse = levels + num_levels;
+    coarse->width = (fine->width + 1) / 2;
+    coarse->height = (fine->height + 1) / 2;
+    const size_t npixels = coarse->width * coarse->height;
+    coarse->u = dt_pixelpipe_cache_alloc_align_float_cache(4 * npixels, 0);
+    coarse->rhs = dt_pixelpipe_cache_alloc_align_float_cache(4 * npixels, 0);
+    coarse->mask = dt_pixelpipe_cache_alloc_align_cache(npixels, 0);
+    num_levels++;
+    if(IS_NULL_PTR(coarse->u) || IS_NULL_PTR(coarse->rhs) || IS_NULL_PTR(coarse->mask)) return 0;
+
+    __OMP_PARALLEL_FOR__()
+    for(size_t row = 0; row < coarse->height; row++)
+      for(size_t col = 0; col < coarse->width; col++)
+      {
+        uint8_t unknown = 1;
+        for(size_t y = 2 * row; y < MIN(2 * row + 2, fine->height); y++)
+          for(size_t x = 2 * col; x < MIN(2 * col + 2, fine->width); x++)
+            unknown &= fine->mask[y * fine->width + x];
+        coarse->mask[row * coarse->width + col] = unknown;
+      }
   }
-  const size_t nmask = nmask_red + nmask_black;
-
-  /* Empirically optimal over-relaxation factor. (Benchmarked on
-   * round brushes, at least. I don't know whether aspect ratio
-   * affects it.)
-   */
-  const float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
-
-  const float epsilon = (0.1 / 255);
-  const float err_exit = epsilon * epsilon * w * w;
+  return num_levels;
+}
 
-  /* Gauss-Seidel with successive over-relaxation */
-  for(int iter = 0; iter < max_iter; iter++)
+static void _heal_free_levels(_heal_level_t *const levels)
+{
+  // levels[0] belongs to the caller
+  for(int i = 1; i < HEAL_MAX_LEVELS; i++)
   {
-    // process red/black cells separately
-    float err = _heal_laplace_iteration(black_pixels, red_pixels, height, subwidth, black_runs, num_black, 1, w);
-    err += _heal_laplace_iteration(red_pixels, black_pixels, height, subwidth, red_runs, num_red, 0, w);
-
-    if(err < err_exit) break;
+    dt_pixelpipe_cache_free_align(levels[i].u);
+    dt_pixelpipe_cache_free_align(levels[i].rhs);
+    dt_pixelpipe_cache_free_align(levels[i].mask);
   }
-
-cleanup:
-  dt_pixelpipe_cache_free_align(red_runs);
-  dt_pixelpipe_cache_free_align(black_runs);
 }
 
 
@@ -391,26 +308,56 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
     fprintf(stderr,"dt_heal: full-color image required\n");
     return;
   }
-  const size_t subwidth = 4 * ((width+1)/2);  // round up to be able to handle odd widths
-  float *const restrict red_buffer = dt_pixelpipe_cache_alloc_align_float_cache(subwidth * (height + 2), 0);
-  float *const restrict black_buffer = dt_pixelpipe_cache_alloc_align_float_cache(subwidth * (height + 2), 0);
-  if(IS_NULL_PTR(red_buffer) || IS_NULL_PTR(black_buffer))
+  const size_t npixels = (size_t)width * height;
+  _heal_level_t levels[HEAL_MAX_LEVELS] = { { 0 } };
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].u = dt_pixelpipe_cache_alloc_align_float_cache(4 * npixels, 0);
+  levels[0].mask = dt_pixelpipe_cache_alloc_align_cache(npixels, 0);
+  if(IS_NULL_PTR(levels[0].u) || IS_NULL_PTR(levels[0].mask))
   {
     fprintf(stderr, "dt_heal: error allocating memory for healing\n");
     goto cleanup;
   }
 
-  /* subtract pattern from image and store the result split by 'red' and 'black' positions  */
-  _heal_sub(dest_buffer, src_buffer, red_buffer, black_buffer, width, height);
+  /* subtract pattern from image: the Dirichlet values outside the mask, the initial guess inside */
+  size_t nmask = 0;
+  float boundary = 0.f;
+  __OMP_PARALLEL_FOR__(reduction(+ : nmask) reduction(max : boundary))
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const uint8_t unknown = mask_buffer[k] != 0.f;
+    levels[0].mask[k] = unknown;
+    nmask += unknown;
+    float *const u = levels[0].u + 4 * k;
+    for_four_channels(c) u[c] = dest_buffer[4 * k + c] - src_buffer[4 * k + c];
+    if(!unknown) boundary = fmaxf(boundary, fmaxf(fabsf(u[0]), fmaxf(fabsf(u[1]), fabsf(u[2]))));
+  }
+  if(nmask == 0) goto cleanup;
+
+  const int num_levels = _heal_alloc_levels(levels);
+  if(num_levels == 0)
+  {
+    fprintf(stderr, "dt_heal: error allocating memory for healing\n");
+    goto cleanup;
+  }
 
-  _heal_laplace_loop(red_buffer, black_buffer, width, height, mask_buffer, max_iter);
+  const float tolerance = HEAL_TOLERANCE * fmaxf(boundary, 1.f);
+  for(int cycle = 0; cycle < max_iter; cycle++)
+    if(_heal_vcycle(levels, 0, num_levels) < tolerance) break;
 
   /* add solution to original image and store in dest */
-  _heal_add(red_buffer, black_buffer, src_buffer, dest_buffer, width, height);
+  __OMP_PARALLEL_FOR__()
+  for(size_t k = 0; k < npixels; k++)
+  {
+    if(!levels[0].mask[k]) continue;
+    for_each_channel(c) dest_buffer[4 * k + c] = levels[0].u[4 * k + c] + src_buffer[4 * k + c];
+  }
 
 cleanup:
-  dt_pixelpipe_cache_free_align(red_buffer);
-  dt_pixelpipe_cache_free_align(black_buffer);
+  _heal_free_levels(levels);
+  dt_pixelpipe_cache_free_align(levels[0].u);
+  dt_pixelpipe_cache_free_align(levels[0].mask);
 }
 
 #ifdef HAVE_OPENCL
@@ -24,6 +24,8 @@
 
 /* heals dest_buffer using src_buffer as a reference and mask_buffer to define the area to be healed
  * the 3 buffers must have the same size, but mask_buffer is 1 channel and is tested for != 0.f
+ * max_iter caps the number of multigrid V-cycles; the solver stops earlier once converged,
+ * usually after about ten whatever the size of the patch
  */
 void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
              const int height, const int ch, const int max_iter);
@@ -0,0 +1,112 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixel/raw_stage.h"
+#include "develop/imageop_math.h"
+#include "system/openmp.h"
+#include "system/target_clones.h"
+
+#include <math.h>
+
+// 6 is the period of both CFA: 2 for Bayer, 6 for X-Trans.
+#define RAW_STAGE_PERIOD 6
+
+typedef struct raw_stage_row_t
+{
+  float sub[RAW_STAGE_PERIOD];
+  float inv_div[RAW_STAGE_PERIOD];
+  float coeff[RAW_STAGE_PERIOD];
+} raw_stage_row_t;
+
+// Factors of the photosites of row j, by column modulo the period.
+static inline void _row_factors(const dt_raw_stage_t *const stage, const int j, raw_stage_row_t *const row)
+{
+  const gboolean wb = (stage->steps & DT_RAW_STAGE_WHITE_BALANCE) != 0;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])stage->xtrans;
+  const int row_phase = ((j + stage->prepare_y) & 1) << 1;
+  for(int k = 0; k < RAW_STAGE_PERIOD; k++)
+  {
+    const int id = row_phase + ((k + stage->prepare_x) & 1);
+    row->sub[k] = stage->sub[id];
+    row->inv_div[k] = 1.0f / stage->div[id];
+    row->coeff[k] = wb ? stage->coeffs[fcol(j + stage->wb_y, k + stage->wb_x, stage->filters, xtrans)] : 1.0f;
+  }
+}
+
+static inline float _raw_value(const dt_raw_stage_t *const stage, const void *const in, const size_t p)
+{
+  return stage->input_float ? ((const float *)in)[p] : (float)((const uint16_t *)in)[p];
+}
+
+// rawprepare then white balance on photosite i0 + k of the row.
+static inline float _scaled(const dt_raw_stage_t *const stage, const raw_stage_row_t *const row,
+                            const void *const in, const size_t pin, const int i0, const int k)
+{
+  return ((_raw_value(stage, in, pin + i0 + k) - row->sub[k]) * row->inv_div[k]) * row->coeff[k];
+}
+
+__DT_CLONE_TARGETS__
+static size_t _count_clipped(const dt_raw_stage_t *const stage, const void *const in, const int width,
+                             const int height)
+{
+  size_t clipped = 0;
+  __OMP_PARALLEL_FOR__(reduction(+ : clipped))
+  for(int j = 0; j < height; j++)
+  {
+    raw_stage_row_t row;
+    _row_factors(stage, j, &row);
+    const size_t pin = (size_t)stage->input_width * (j + stage->input_y) + stage->input_x;
+    for(int i0 = 0; i0 < width; i0 += RAW_STAGE_PERIOD)
+      for(int k = 0; k < RAW_STAGE_PERIOD && i0 + k < width; k++)
+        clipped += (_scaled(stage, &row, in, pin, i0, k) > stage->clip);
+  }
+  return clipped;
+}
+
+__DT_CLONE_TARGETS__
+int dt_raw_stage_process(const dt_raw_stage_t *const stage, const void *const in, float *const out,
+                         const int width, const int height)
+{
+  if(!(stage->steps & DT_RAW_STAGE_PREPARE)) return 1;
+
+  // highlights leaves the image alone when too few photosites are clipped. Counting reads
+  // the raw input only, which is cheaper than writing everything and clipping afterwards.
+  const gboolean clip = (stage->steps & DT_RAW_STAGE_CLIP)
+                        && _count_clipped(stage, in, width, height) >= stage->min_clipped;
+  const float threshold = clip ? stage->clip : INFINITY;
+
+  __OMP_PARALLEL_FOR__()
+  for(int j = 0; j < height; j++)
+  {
+    raw_stage_row_t row;
+    _row_factors(stage, j, &row);
+    const size_t pin = (size_t)stage->input_width * (j + stage->input_y) + stage->input_x;
+    float *const restrict out_row = out + (size_t)j * width;
+    for(int i0 = 0; i0 < width; i0 += RAW_STAGE_PERIOD)
+      for(int k = 0; k < RAW_STAGE_PERIOD && i0 + k < width; k++)
+        out_row[i0 + k] = MIN(threshold, _scaled(stage, &row, in, pin, i0, k));
+  }
+
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
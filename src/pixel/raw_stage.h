@@ -0,0 +1,95 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_PIXEL_RAW_STAGE_H
+#define DT_PIXEL_RAW_STAGE_H
+
+/**
+ * @file raw_stage.h
+ * @brief The pointwise operations of the raw stage, on a mosaic, in one pass.
+ *
+ * rawprepare subtracts the black level and divides by the white range, white balance
+ * multiplies each photosite by the coefficient of its colour, and highlights in clip mode
+ * clamps to the clipping threshold. Run one after the other, each writes a full-size float
+ * mosaic that the next one reads back. Here each photosite goes through all of them while
+ * it is in a register: the mosaic is read once and the result written once.
+ *
+ * Each photosite goes through the same operations, in the same order, as in the modules
+ * chained, so the result is theirs up to what the compiler is allowed to reassociate.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+/** Steps a raw stage can hold. They always run in this order. */
+typedef enum dt_raw_stage_step_t
+{
+  DT_RAW_STAGE_NONE = 0,
+  DT_RAW_STAGE_PREPARE = 1 << 0,       // rawprepare: (in - sub) / div
+  DT_RAW_STAGE_WHITE_BALANCE = 1 << 1, // temperature: in * coeffs
+  DT_RAW_STAGE_CLIP = 1 << 2,          // highlights, clip mode: MIN(clip, in)
+} dt_raw_stage_step_t;
+
+typedef struct dt_raw_stage_t
+{
+  dt_raw_stage_step_t steps;
+
+  // DT_RAW_STAGE_PREPARE. Black and white levels are indexed by the position in the 2x2 block,
+  // counted from (prepare_x, prepare_y), even on X-Trans.
+  float sub[4];
+  float div[4];
+  int prepare_x;
+  int prepare_y;
+  // The output starts at (input_x, input_y) in an input of input_width photosites per row.
+  int input_x;
+  int input_y;
+  int input_width;
+  gboolean input_float; // float input, else uint16_t
+
+  // DT_RAW_STAGE_WHITE_BALANCE. Coefficients are indexed by CFA colour, looked up with the
+  // Bayer filters, or the X-Trans pattern when filters == 9, from (wb_x, wb_y).
+  float coeffs[4];
+  uint32_t filters;
+  uint8_t xtrans[6][6];
+  int wb_x;
+  int wb_y;
+
+  // DT_RAW_STAGE_CLIP. When fewer than min_clipped photosites are over the threshold, nothing
+  // is clipped, as highlights does.
+  float clip;
+  size_t min_clipped;
+} dt_raw_stage_t;
+
+/**
+ * @brief Run the steps of @p stage from the raw mosaic @p in to the float mosaic @p out.
+ *
+ * @param width,height Size of @p out.
+ * @return 0 on success, 1 when @p stage does not start with DT_RAW_STAGE_PREPARE.
+ */
+int dt_raw_stage_process(const dt_raw_stage_t *const stage, const void *const in, float *const out,
+                         const int width, const int height);
+
+#endif // DT_PIXEL_RAW_STAGE_H
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
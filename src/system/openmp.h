@@ -59,6 +59,7 @@
 
 # define omp_get_max_threads() 1
 # define omp_get_thread_num() 0
+# define omp_get_num_threads() 1
 # define dt_omp_in_parallel() 0
 
 #define __OMP_PARALLEL__(...)
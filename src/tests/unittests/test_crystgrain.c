@@ -0,0 +1,154 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** The parallel grain scan is a reordering of the serial raster scan, not an approximation
+ * of it: for a fixed seed, both must give the same floats, bit for bit, in the grain
+ * field and in the light left over. Sizes are chosen so several rows are in flight at
+ * once, and grains are large enough that neighbouring rows do interact.
+ */
+
+#include "pixel/crystgrain.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#define WIDTH 1031
+#define HEIGHT 97
+
+static dt_crystgrain_runtime_t _runtime(const int threads, const float grain_size)
+{
+  dt_crystgrain_runtime_t rt = {
+    .width = WIDTH,
+    .height = HEIGHT,
+    .roi_x = 17,
+    .roi_y = 5,
+    .layers = 7,
+    .layer_scale = 0.0f,
+    .filling = 0.6f,
+    .grain_size = grain_size,
+    .size_stddev = 0.4f,
+    .kernel_scale = 1.0f,
+    .inv_scale = 1.0f,
+    .channel_correlation = 0.5f,
+    .base_seed = 0x5eed0000c0ffeeull,
+    .threads = threads
+  };
+  // Same normalization as the module, so layers deplete the light as they would there.
+  rt.layer_scale = 2.0f / rt.layers / dt_crystgrain_average_discrete_grain_surface(&rt);
+  return rt;
+}
+
+static float *_image(const int channels)
+{
+  float *image = g_new(float, (size_t)WIDTH * HEIGHT * channels);
+  GRand *rand = g_rand_new_with_seed(0xf11);
+  for(size_t k = 0; k < (size_t)WIDTH * HEIGHT * channels; k++)
+    image[k] = (float)g_rand_double_range(rand, 0.0, 1.5);
+  g_rand_free(rand);
+  return image;
+}
+
+static void _check_channel(const int threads, const float grain_size)
+{
+  const size_t npixels = (size_t)WIDTH * HEIGHT;
+  float *image = _image(1);
+  float *expected_result = g_new(float, npixels);
+  float *expected_remaining = g_new(float, npixels);
+  float *result = g_new(float, npixels);
+  float *remaining = g_new(float, npixels);
+  float expected_exposure = 0.0f;
+  float exposure = 0.0f;
+
+  const dt_crystgrain_runtime_t serial = _runtime(1, grain_size);
+  const dt_crystgrain_runtime_t parallel = _runtime(threads, grain_size);
+  assert_int_equal(dt_crystgrain_simulate_channel(&serial, image, expected_result, expected_remaining,
+                                                  &expected_exposure), 0);
+  assert_int_equal(dt_crystgrain_simulate_channel(&parallel, image, result, remaining, &exposure), 0);
+
+  assert_memory_equal(expected_result, result, npixels * sizeof(float));
+  assert_memory_equal(expected_remaining, remaining, npixels * sizeof(float));
+  assert_memory_equal(&expected_exposure, &exposure, sizeof(float));
+
+  g_free(image);
+  g_free(expected_result);
+  g_free(expected_remaining);
+  g_free(result);
+  g_free(remaining);
+}
+
+static void test_channel_matches_serial(void **state)
+{
+  // Small grains, many rows in flight; then grains wide enough to reach several rows
+  // above and below; then as many threads as OpenMP wants.
+  _check_channel(8, 3.0f);
+  _check_channel(8, 12.0f);
+  _check_channel(0, 5.0f);
+}
+
+static void test_color_matches_serial(void **state)
+{
+  const size_t count = (size_t)WIDTH * HEIGHT * 4;
+  float *image = _image(4);
+  float *expected_result = g_new(float, count);
+  float *expected_remaining = g_new(float, count);
+  float *result = g_new(float, count);
+  float *remaining = g_new(float, count);
+  float expected_exposure[3] = { 0.0f };
+  float exposure[3] = { 0.0f };
+
+  const dt_crystgrain_runtime_t serial = _runtime(1, 6.0f);
+  const dt_crystgrain_runtime_t parallel = _runtime(8, 6.0f);
+  const dt_crystgrain_color_state_t expected_state = { image, expected_result, expected_remaining };
+  const dt_crystgrain_color_state_t parallel_state = { image, result, remaining };
+  assert_int_equal(dt_crystgrain_simulate_color(&serial, &expected_state, expected_exposure), 0);
+  assert_int_equal(dt_crystgrain_simulate_color(&parallel, &parallel_state, exposure), 0);
+
+  assert_memory_equal(expected_result, result, count * sizeof(float));
+  assert_memory_equal(expected_remaining, remaining, count * sizeof(float));
+  assert_memory_equal(expected_exposure, exposure, sizeof(exposure));
+
+  g_free(image);
+  g_free(expected_result);
+  g_free(expected_remaining);
+  g_free(result);
+  g_free(remaining);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_channel_matches_serial),
+    cmocka_unit_test(test_color_matches_serial),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,252 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** VNG, PPG and the dual blend demosaic the frame tile by tile, each tile grown by a halo
+ * covering the reach of the whole chain of steps, and keep only its core. The core pixels must
+ * come out as over the full frame, which is the same tile function run once on a tile spanning
+ * the whole frame. Checked on Bayer and X-Trans, at odd ROI offsets, so that tiles see the CFA
+ * in a phase of their own, on frames cut in many tiles with thin last cores, and on frames
+ * smaller than four halos, which are a single tile grown past the frame.
+ *
+ * The demosaic kernels are static to the module: their sources are compiled in here, as
+ * demosaic.c includes them, over tiles shrunk so that small frames already make many of them.
+ */
+
+#include "caches/pixelpipe_cache.h"
+#include "caches/pixelpipe_cache_alloc.h"
+#include "common/imagebuf.h"
+#include "common/logging.h"
+#include "common/times.h"
+#include "control/user_message.h"
+#include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/masks.h"
+#include "develop/pixelpipe_hb.h"
+#include "imageio/imageio_core.h"
+#include "system/macros.h"
+#include "system/mem_alloc.h"
+#include "system/openmp.h"
+#include "system/simd.h"
+#include "system/target_clones.h"
+
+#include <glib/gi18n.h>
+
+// As in demosaic.c.
+#define XTRANS_SNAPPER 6
+#define DEMOSAIC_TILE_BYTES (64 << 10)
+
+// The OpenCL halves of these files need the global data of the module, and some kernels go
+// unused here.
+#undef HAVE_OPENCL
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "iop/demosaic/basic.c"
+#include "iop/demosaic/ppg.c"
+#include "iop/demosaic/vng.c"
+#include "iop/demosaic/tiles.c"
+#include "iop/demosaic/dual.c"
+#pragma GCC diagnostic pop
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BAYER_FILTERS 0x94949494u
+#define XTRANS_FILTERS 9u
+#define TOLERANCE 1e-6f
+
+static const uint8_t xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                      { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+/* With tiles of 64 KiB, cores are 30 (dual) to 51 (VNG) pixels wide: the large frames leave
+ * last cores from 1 to 46 pixels, that grow inwards. The small ones are smaller than four
+ * halos of every method checked, both ways. */
+static const dt_iop_roi_t frames[] = {
+  { 3, 5, 301, 233, 1.f },
+  { 0, 0, 107, 94, 1.f },
+  { 7, 1, 11, 9, 1.f },
+  { 2, 3, 10, 11, 1.f },
+};
+
+#define MAX_PIXELS ((size_t)301 * 233)
+
+static float *mosaic = NULL; // packed over the frame being checked
+static float *high = NULL;   // RGBA, stands for the output of RCD, AMaZE or Markesteijn in the dual blend
+static dt_dev_pixelpipe_iop_t piece;
+
+// Noise over stripes, so that gradients and medians take every branch. Function of the position
+// in the image, not in the frame: frames at other offsets see the same scene.
+static float _sample(const int x, const int y, const int c)
+{
+  uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)c * 83492791u;
+  h ^= h >> 13;
+  h *= 0x5bd1e995u;
+  h ^= h >> 15;
+  const float noise = (float)(h & 0xffff) / 65535.f;
+  const float stripe = ((x + 2 * y) % 37 < 18) ? 0.7f : 0.2f;
+  return 0.05f + 0.5f * stripe + 0.25f * noise;
+}
+
+static void _fill_frame(const dt_iop_roi_t *const roi)
+{
+  for(int j = 0; j < roi->height; j++)
+    for(int i = 0; i < roi->width; i++)
+    {
+      const size_t k = (size_t)j * roi->width + i;
+      mosaic[k] = _sample(roi->x + i, roi->y + j, 3);
+      for(int c = 0; c < 4; c++) high[4 * k + c] = _sample(roi->x + i, roi->y + j, c);
+    }
+}
+
+// Run `process_tile` tiled and once over the whole frame, on every frame, and compare the RGB.
+static void _check_tiled(const char *method, demosaic_tile_t process_tile, const void *const data, const int halo,
+                         const int scratch_floats)
+{
+  for(size_t f = 0; f < G_N_ELEMENTS(frames); f++)
+  {
+    const dt_iop_roi_t *const roi = &frames[f];
+    const size_t npixels = (size_t)roi->width * roi->height;
+    _fill_frame(roi);
+
+    float *tiled = dt_pixelpipe_cache_alloc_align_float_cache(4 * npixels, 0);
+    float *full = dt_pixelpipe_cache_alloc_align_float_cache(4 * npixels, 0);
+    float *scratch = dt_pixelpipe_cache_alloc_align_float_cache(scratch_floats * demosaic_tile_plane(npixels), 0);
+    assert_non_null(tiled);
+    assert_non_null(full);
+    assert_non_null(scratch);
+
+    assert_int_equal(process_tile(full, scratch, roi, roi, data), 0);
+    assert_int_equal(demosaic_tiled(tiled, roi, halo, scratch_floats, process_tile, data), 0);
+
+    int wrong = 0;
+    for(size_t k = 0; k < npixels; k++)
+      for(int c = 0; c < 3; c++)
+        if(!(fabsf(tiled[4 * k + c] - full[4 * k + c]) <= TOLERANCE))
+        {
+          if(wrong == 0)
+            fprintf(stderr, "%s, frame %dx%d at (%d, %d): pixel (%d, %d) channel %d is %g tiled, %g full\n",
+                    method, roi->width, roi->height, roi->x, roi->y, (int)(k % roi->width),
+                    (int)(k / roi->width), c, tiled[4 * k + c], full[4 * k + c]);
+          wrong++;
+        }
+
+    dt_pixelpipe_cache_free_align(tiled);
+    dt_pixelpipe_cache_free_align(full);
+    dt_pixelpipe_cache_free_align(scratch);
+    assert_int_equal(wrong, 0);
+  }
+}
+
+static void _check_vng(const char *method, const uint32_t filters, const int smoothing)
+{
+  const demosaic_tile_vng_t d = { .in = mosaic, .filters = filters, .xtrans = xtrans, .smoothing = smoothing };
+  _check_tiled(method, _vng_tile, &d, VNG_TILE_HALO + smoothing, 1);
+}
+
+static void _check_dual(const char *method, const uint32_t filters, const gboolean dual_mask)
+{
+  piece.dsc_in.filters = filters;
+  const demosaic_tile_dual_t d = { .piece = &piece,
+                                   .high = high,
+                                   .raw = mosaic,
+                                   .xtrans = xtrans,
+                                   .contrastf = slider2contrast(0.2f),
+                                   .dual_mask = dual_mask };
+  _check_tiled(method, _dual_tile, &d, MAX(DUAL_TILE_HALO_VNG, DUAL_TILE_HALO_MASK), 6);
+}
+
+static void test_vng_bayer(void **state)
+{
+  _check_vng("VNG4", BAYER_FILTERS, 0);
+  _check_vng("VNG4 smoothed", BAYER_FILTERS, 2);
+}
+
+static void test_vng_xtrans(void **state)
+{
+  _check_vng("VNG X-Trans", XTRANS_FILTERS, 0);
+  _check_vng("VNG X-Trans smoothed", XTRANS_FILTERS, 2);
+}
+
+static void test_ppg(void **state)
+{
+  piece.dsc_in.filters = BAYER_FILTERS;
+  // The median threshold runs the pre-median, the widest step.
+  const demosaic_tile_ppg_t plain = { .piece = &piece, .in = mosaic, .median_thrs = 0.f, .smoothing = 0 };
+  _check_tiled("PPG", _ppg_tile, &plain, PPG_TILE_HALO, 1);
+  const demosaic_tile_ppg_t median = { .piece = &piece, .in = mosaic, .median_thrs = 0.1f, .smoothing = 1 };
+  _check_tiled("PPG median smoothed", _ppg_tile, &median, PPG_TILE_HALO + 1, 1);
+}
+
+static void test_dual_bayer(void **state)
+{
+  _check_dual("dual Bayer", BAYER_FILTERS, FALSE);
+  _check_dual("dual Bayer mask", BAYER_FILTERS, TRUE);
+}
+
+static void test_dual_xtrans(void **state)
+{
+  _check_dual("dual X-Trans", XTRANS_FILTERS, FALSE);
+  _check_dual("dual X-Trans mask", XTRANS_FILTERS, TRUE);
+}
+
+static int _setup(void **state)
+{
+  if(!dt_dev_pixelpipe_cache_init((size_t)256 << 20, FALSE, FALSE, FALSE)) return -1;
+  mosaic = dt_pixelpipe_cache_alloc_align_float_cache(MAX_PIXELS, 0);
+  high = dt_pixelpipe_cache_alloc_align_float_cache(4 * MAX_PIXELS, 0);
+  memset(&piece, 0, sizeof(piece));
+  piece.dsc_in.temperature.coeffs[0] = 2.1f;
+  piece.dsc_in.temperature.coeffs[1] = 1.f;
+  piece.dsc_in.temperature.coeffs[2] = 1.6f;
+  piece.dsc_in.temperature.coeffs[3] = 1.f;
+  return (mosaic && high) ? 0 : -1;
+}
+
+static int _teardown(void **state)
+{
+  dt_pixelpipe_cache_free_align(mosaic);
+  dt_pixelpipe_cache_free_align(high);
+  dt_dev_pixelpipe_cache_cleanup();
+  return 0;
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_vng_bayer),
+    cmocka_unit_test(test_vng_xtrans),
+    cmocka_unit_test(test_ppg),
+    cmocka_unit_test(test_dual_bayer),
+    cmocka_unit_test(test_dual_xtrans),
+  };
+  return cmocka_run_group_tests(tests, _setup, _teardown);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
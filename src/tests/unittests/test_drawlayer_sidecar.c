@@ -0,0 +1,319 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Drawlayer sidecars commit strokes by rewriting their tiles in place, behind a redo
+ * journal. A stroke committed in place must read back exactly like the same stroke written
+ * by a full rewrite of the file. A journal left by a crash after its commit record must be
+ * replayed to that same content, and one left before it dropped without touching the file.
+ *
+ * Module code is built with hidden symbols into lib_ansel, and the journal format is private
+ * to sidecar.c: the file is compiled in here, so the crashed updates can be left behind
+ * through the very helpers the update writes its journal with.
+ */
+
+#include "iop/drawlayer/sidecar.c"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+// Three pages, each three tiles wide and two tiles high, the lower ones cut by the page edge.
+#define PAGES 3
+#define WIDTH 600
+#define HEIGHT 400
+
+typedef struct sidecar_stroke_t
+{
+  int page;
+  int x;
+  int y;
+  int width;
+  int height;
+  uint16_t value;
+} sidecar_stroke_t;
+
+// Spans four tiles, two of them on the partial lower tile row.
+static const sidecar_stroke_t stroke = { .page = 1, .x = 200, .y = 100, .width = 150, .height = 200, .value = 0x3c00 };
+
+typedef struct sidecar_fixture_t
+{
+  char *dir;
+  char *path;    // the sidecar updated in place, or through its journal
+  char *rewrite; // the same stroke, written as a full rewrite
+} sidecar_fixture_t;
+
+static void _page_name(char *name, const size_t size, const int page)
+{
+  g_snprintf(name, size, "layer %d", page);
+}
+
+// Positive half-floats in [0.125, 0.25), different on every page.
+static uint16_t _pixel(const int page, const uint32_t x, const uint32_t y, const int c)
+{
+  return (uint16_t)(0x3000 + ((x * 7 + y * 13 + (uint32_t)page * 31 + (uint32_t)c) & 0x3ff));
+}
+
+static gboolean _in_stroke(const sidecar_stroke_t *s, const int page, const uint32_t x, const uint32_t y)
+{
+  return s && page == s->page && (int)x >= s->x && (int)x < s->x + s->width && (int)y >= s->y
+         && (int)y < s->y + s->height;
+}
+
+static uint16_t _expected(const sidecar_stroke_t *s, const int page, const uint32_t x, const uint32_t y, const int c)
+{
+  return _in_stroke(s, page, x, y) ? s->value : _pixel(page, x, y, c);
+}
+
+static void _fill_stroke(void *user_data, const uint32_t x, const uint32_t y, const uint32_t width,
+                         const uint32_t height, uint16_t *pixels)
+{
+  const sidecar_stroke_t *s = user_data;
+  for(uint32_t j = 0; j < height; j++)
+    for(uint32_t i = 0; i < width; i++)
+      if(_in_stroke(s, s->page, x + i, y + j))
+        for(int c = 0; c < 4; c++) pixels[4 * ((size_t)j * DT_DRAWLAYER_SIDECAR_TILE + i) + c] = s->value;
+}
+
+static gboolean _set_tags(TIFF *tiff, const char *name)
+{
+  const uint16_t extrasamples[] = { EXTRASAMPLE_ASSOCALPHA };
+  return TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, (uint32_t)WIDTH)
+         && TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, (uint32_t)HEIGHT)
+         && TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 16)
+         && TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP)
+         && TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 4)
+         && TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+         && TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB)
+         && TIFFSetField(tiff, TIFFTAG_EXTRASAMPLES, 1, extrasamples)
+         && TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE)
+         && dt_drawlayer_sidecar_set_tile_layout(tiff) && TIFFSetField(tiff, TIFFTAG_PAGENAME, name);
+}
+
+// Write every page, with the stroke already painted when there is one: a full rewrite.
+static void _write_sidecar(const char *path, const sidecar_stroke_t *s)
+{
+  TIFF *tiff = TIFFOpen(path, "w");
+  assert_non_null(tiff);
+  uint16_t *row = g_malloc_n((gsize)WIDTH * 4, sizeof(uint16_t));
+  for(int page = 0; page < PAGES; page++)
+  {
+    char name[DT_DRAWLAYER_IO_NAME_SIZE];
+    _page_name(name, sizeof(name), page);
+    assert_true(_set_tags(tiff, name));
+
+    dt_drawlayer_sidecar_writer_t writer;
+    assert_true(dt_drawlayer_sidecar_writer_init(&writer, tiff, WIDTH, HEIGHT));
+    for(uint32_t y = 0; y < HEIGHT; y++)
+    {
+      for(uint32_t x = 0; x < WIDTH; x++)
+        for(int c = 0; c < 4; c++) row[4 * x + c] = _expected(s, page, x, y, c);
+      assert_true(dt_drawlayer_sidecar_write_row(&writer, row));
+    }
+    assert_true(dt_drawlayer_sidecar_writer_finish(&writer));
+    dt_drawlayer_sidecar_writer_cleanup(&writer);
+    assert_true(TIFFWriteDirectory(tiff));
+  }
+  g_free(row);
+  TIFFClose(tiff);
+}
+
+// Read every page back through the public accessors, and compare it to what `s` paints.
+static void _check_sidecar(const char *path, const sidecar_stroke_t *s)
+{
+  TIFF *tiff = dt_drawlayer_sidecar_open(path);
+  assert_non_null(tiff);
+  uint16_t *row = g_malloc_n((gsize)WIDTH * 4, sizeof(uint16_t));
+  int page = 0;
+  do
+  {
+    char expected_name[DT_DRAWLAYER_IO_NAME_SIZE];
+    _page_name(expected_name, sizeof(expected_name), page);
+    char *name = NULL;
+    assert_true(TIFFGetField(tiff, TIFFTAG_PAGENAME, &name));
+    assert_string_equal(name, expected_name);
+
+    dt_drawlayer_sidecar_reader_t reader;
+    assert_true(dt_drawlayer_sidecar_reader_init(&reader, tiff));
+    assert_int_equal(reader.width, WIDTH);
+    assert_int_equal(reader.height, HEIGHT);
+    int wrong = 0;
+    for(uint32_t y = 0; y < HEIGHT; y++)
+    {
+      assert_true(dt_drawlayer_sidecar_read_row(&reader, y, row));
+      for(uint32_t x = 0; x < WIDTH; x++)
+        for(int c = 0; c < 4; c++)
+          if(row[4 * x + c] != _expected(s, page, x, y, c)) wrong++;
+    }
+    dt_drawlayer_sidecar_reader_cleanup(&reader);
+    assert_int_equal(wrong, 0);
+    page++;
+  } while(TIFFReadDirectory(tiff));
+  g_free(row);
+  dt_drawlayer_sidecar_close(tiff);
+  assert_int_equal(page, PAGES);
+}
+
+static gboolean _journal_exists(const char *path)
+{
+  gchar *journal_path = _journal_path(path);
+  const gboolean exists = g_file_test(journal_path, G_FILE_TEST_EXISTS);
+  g_free(journal_path);
+  return exists;
+}
+
+/* Journal the stroke as an update does, then stop where a crash would: before the commit
+ * record when `commit` is FALSE, right after it otherwise. The sidecar is left untouched. */
+static void _journal_stroke(const char *path, const sidecar_stroke_t *s, const gboolean commit)
+{
+  char name[DT_DRAWLAYER_IO_NAME_SIZE];
+  _page_name(name, sizeof(name), s->page);
+  TIFF *tiff = TIFFOpen(path, "rb");
+  assert_non_null(tiff);
+  assert_true(TIFFSetDirectory(tiff, (tdir_t)s->page));
+
+  gchar *journal_path = _journal_path(path);
+  FILE *journal = _journal_open(journal_path, s->page, name);
+  assert_non_null(journal);
+  uint16_t *tile = g_malloc(DT_DRAWLAYER_SIDECAR_TILE_BYTES);
+  uint32_t count = 0;
+  for(uint32_t ty = s->y - s->y % DT_DRAWLAYER_SIDECAR_TILE; ty < (uint32_t)(s->y + s->height);
+      ty += DT_DRAWLAYER_SIDECAR_TILE)
+    for(uint32_t tx = s->x - s->x % DT_DRAWLAYER_SIDECAR_TILE; tx < (uint32_t)(s->x + s->width);
+        tx += DT_DRAWLAYER_SIDECAR_TILE)
+    {
+      const dt_drawlayer_sidecar_journal_record_t record = { .tile = TIFFComputeTile(tiff, tx, ty, 0, 0) };
+      assert_int_not_equal(TIFFReadEncodedTile(tiff, record.tile, tile, DT_DRAWLAYER_SIDECAR_TILE_BYTES), -1);
+      _fill_stroke((void *)s, tx, ty, MIN(DT_DRAWLAYER_SIDECAR_TILE, WIDTH - tx),
+                   MIN(DT_DRAWLAYER_SIDECAR_TILE, HEIGHT - ty), tile);
+      assert_int_equal(fwrite(&record, sizeof(record), 1, journal), 1);
+      assert_int_equal(fwrite(tile, DT_DRAWLAYER_SIDECAR_TILE_BYTES, 1, journal), 1);
+      count++;
+    }
+  TIFFClose(tiff);
+  g_free(tile);
+
+  if(commit)
+    assert_true(_journal_commit(journal, journal_path, count));
+  else
+    assert_int_equal(fclose(journal), 0);
+  g_free(journal_path);
+}
+
+static void test_update_matches_rewrite(void **state)
+{
+  sidecar_fixture_t *f = *state;
+  _write_sidecar(f->path, NULL);
+  _write_sidecar(f->rewrite, &stroke);
+
+  char name[DT_DRAWLAYER_IO_NAME_SIZE];
+  _page_name(name, sizeof(name), stroke.page);
+  int written = -1;
+  assert_int_equal(dt_drawlayer_sidecar_update_tiles(f->path, stroke.page, name, stroke.x, stroke.y, stroke.width,
+                                                     stroke.height, _fill_stroke, (void *)&stroke, &written),
+                   DT_DRAWLAYER_SIDECAR_UPDATE_DONE);
+  assert_int_equal(written, 4);
+  assert_false(_journal_exists(f->path));
+
+  _check_sidecar(f->rewrite, &stroke);
+  _check_sidecar(f->path, &stroke);
+
+  // Painting the same stroke again changes no tile: nothing gets journaled nor written.
+  assert_int_equal(dt_drawlayer_sidecar_update_tiles(f->path, stroke.page, name, stroke.x, stroke.y, stroke.width,
+                                                     stroke.height, _fill_stroke, (void *)&stroke, &written),
+                   DT_DRAWLAYER_SIDECAR_UPDATE_DONE);
+  assert_int_equal(written, 0);
+  _check_sidecar(f->path, &stroke);
+}
+
+static void test_committed_journal_is_replayed(void **state)
+{
+  sidecar_fixture_t *f = *state;
+  _write_sidecar(f->path, NULL);
+  _journal_stroke(f->path, &stroke, TRUE);
+  assert_true(_journal_exists(f->path));
+
+  assert_true(dt_drawlayer_sidecar_recover(f->path));
+  assert_false(_journal_exists(f->path));
+  _check_sidecar(f->path, &stroke);
+}
+
+static void test_uncommitted_journal_is_dropped(void **state)
+{
+  sidecar_fixture_t *f = *state;
+  _write_sidecar(f->path, NULL);
+  _journal_stroke(f->path, &stroke, FALSE);
+  assert_true(_journal_exists(f->path));
+
+  assert_true(dt_drawlayer_sidecar_recover(f->path));
+  assert_false(_journal_exists(f->path));
+  _check_sidecar(f->path, NULL);
+}
+
+static int _setup(void **state)
+{
+  sidecar_fixture_t *f = g_new0(sidecar_fixture_t, 1);
+  f->dir = g_dir_make_tmp("ansel-drawlayer-sidecar-XXXXXX", NULL);
+  if(!f->dir)
+  {
+    g_free(f);
+    return -1;
+  }
+  f->path = g_build_filename(f->dir, "layers.tiff", NULL);
+  f->rewrite = g_build_filename(f->dir, "rewrite.tiff", NULL);
+  *state = f;
+  return 0;
+}
+
+static int _teardown(void **state)
+{
+  sidecar_fixture_t *f = *state;
+  gchar *journal_path = _journal_path(f->path);
+  g_remove(journal_path);
+  g_free(journal_path);
+  g_remove(f->path);
+  g_remove(f->rewrite);
+  g_rmdir(f->dir);
+  g_free(f->path);
+  g_free(f->rewrite);
+  g_free(f->dir);
+  g_free(f);
+  return 0;
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_update_matches_rewrite, _setup, _teardown),
+    cmocka_unit_test_setup_teardown(test_committed_journal_is_replayed, _setup, _teardown),
+    cmocka_unit_test_setup_teardown(test_uncommitted_journal_is_dropped, _setup, _teardown),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,219 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Guillaume STUTIN.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** The folder survey learns about new images from the file system watch, not from its walk.
+ *
+ * Each test drops files into a temporary tree and spins the default main context until the
+ * watch reports them, asserting they are reported well before the periodic walk would have
+ * found them (studio_capture/interval defaults to 10 s). Directories created after the watch
+ * started must be followed, including the files written into them before their own monitor
+ * existed. The measured latencies are printed.
+ */
+
+#include "common/folder_watch.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+// Generous for a loaded CI machine, still far below the 10 s default scan interval.
+#define DETECTION_BUDGET_US (2 * G_USEC_PER_SEC)
+
+typedef struct watch_fixture_t
+{
+  char *root;
+  GHashTable *created; // canonical path -> report time, first report only
+  GHashTable *removed; // canonical path -> report time
+  dt_folder_watch_t *watch;
+} watch_fixture_t;
+
+static void _record(const char *path, const gboolean removed, gpointer user_data)
+{
+  watch_fixture_t *f = (watch_fixture_t *)user_data;
+  GHashTable *table = removed ? f->removed : f->created;
+  if(!g_hash_table_contains(table, path))
+  {
+    gint64 *when = g_new(gint64, 1);
+    *when = g_get_monotonic_time();
+    g_hash_table_insert(table, g_strdup(path), when);
+  }
+}
+
+/* Spin the main context until `path` is reported, return the latency since `since`, or -1. */
+static gint64 _wait_for(watch_fixture_t *f, const char *path, const gboolean removed, const gint64 since)
+{
+  GHashTable *table = removed ? f->removed : f->created;
+  const gint64 deadline = since + 2 * DETECTION_BUDGET_US;
+  while(g_get_monotonic_time() < deadline)
+  {
+    const gint64 *when = g_hash_table_lookup(table, path);
+    if(when) return *when - since;
+    if(!g_main_context_iteration(NULL, FALSE)) g_usleep(1000);
+  }
+  return -1;
+}
+
+static char *_write(watch_fixture_t *f, const char *relative)
+{
+  char *path = g_build_filename(f->root, relative, NULL);
+  assert_true(g_file_set_contents(path, "not really a raw", -1, NULL));
+  return path;
+}
+
+static void _remove_tree(const char *path)
+{
+  GDir *dir = g_dir_open(path, 0, NULL);
+  if(dir)
+  {
+    const char *name = NULL;
+    while((name = g_dir_read_name(dir)))
+    {
+      char *child = g_build_filename(path, name, NULL);
+      _remove_tree(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+  }
+  g_remove(path);
+}
+
+static int _setup(void **state)
+{
+  watch_fixture_t *f = g_new0(watch_fixture_t, 1);
+  char *tmp = g_dir_make_tmp("ansel-folder-watch-XXXXXX", NULL);
+  if(!tmp) return -1;
+  f->root = g_canonicalize_filename(tmp, NULL);
+  g_free(tmp);
+
+  char *existing = g_build_filename(f->root, "card", "DCIM", NULL);
+  g_mkdir_with_parents(existing, 0700);
+  g_free(existing);
+
+  f->created = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  f->removed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  f->watch = dt_folder_watch_new(f->root, _record, f);
+  *state = f;
+  return f->watch ? 0 : -1;
+}
+
+static int _teardown(void **state)
+{
+  watch_fixture_t *f = *state;
+  dt_folder_watch_free(f->watch);
+  // Drain what the cancelled monitors may have queued: no callback must run past free.
+  while(g_main_context_iteration(NULL, FALSE))
+    ;
+  _remove_tree(f->root);
+  g_hash_table_destroy(f->created);
+  g_hash_table_destroy(f->removed);
+  g_free(f->root);
+  g_free(f);
+  return 0;
+}
+
+static void test_file_in_existing_subfolder(void **state)
+{
+  watch_fixture_t *f = *state;
+  assert_true(dt_folder_watch_is_complete(f->watch));
+
+  const gint64 start = g_get_monotonic_time();
+  char *path = _write(f, "card/DCIM/IMG_0001.CR2");
+  const gint64 latency = _wait_for(f, path, FALSE, start);
+  print_message("existing subfolder: reported after %.1f ms\n", latency / 1000.0);
+  assert_true(latency >= 0);
+  assert_true(latency < DETECTION_BUDGET_US);
+
+  // The files that were there before the watch are not news.
+  assert_int_equal(g_hash_table_size(f->created), 1);
+  g_free(path);
+}
+
+static void test_new_subfolder_is_followed(void **state)
+{
+  watch_fixture_t *f = *state;
+
+  // The file lands right after its directory, most likely before the watch monitors it.
+  const gint64 start = g_get_monotonic_time();
+  char *folder = g_build_filename(f->root, "session", "tethered", NULL);
+  assert_int_equal(g_mkdir_with_parents(folder, 0700), 0);
+  char *first = _write(f, "session/tethered/IMG_0002.NEF");
+  const gint64 first_latency = _wait_for(f, first, FALSE, start);
+  print_message("new subfolder, early file: reported after %.1f ms\n", first_latency / 1000.0);
+  assert_true(first_latency >= 0);
+  assert_true(first_latency < DETECTION_BUDGET_US);
+
+  // Once the directory is known, the next file comes through its own monitor.
+  const gint64 second_start = g_get_monotonic_time();
+  char *second = _write(f, "session/tethered/IMG_0003.NEF");
+  const gint64 second_latency = _wait_for(f, second, FALSE, second_start);
+  print_message("new subfolder, later file: reported after %.1f ms\n", second_latency / 1000.0);
+  assert_true(second_latency >= 0);
+  assert_true(second_latency < DETECTION_BUDGET_US);
+
+  g_free(first);
+  g_free(second);
+  g_free(folder);
+}
+
+static void test_removal_and_rename(void **state)
+{
+  watch_fixture_t *f = *state;
+
+  char *path = _write(f, "card/DCIM/IMG_0004.CR2");
+  assert_true(_wait_for(f, path, FALSE, g_get_monotonic_time()) >= 0);
+
+  // A producer writing to a temporary name then renaming is the common case.
+  char *renamed = g_build_filename(f->root, "card", "DCIM", "IMG_0004_final.CR2", NULL);
+  gint64 start = g_get_monotonic_time();
+  assert_int_equal(g_rename(path, renamed), 0);
+  assert_true(_wait_for(f, path, TRUE, start) >= 0);
+  assert_true(_wait_for(f, renamed, FALSE, start) >= 0);
+
+  start = g_get_monotonic_time();
+  assert_int_equal(g_remove(renamed), 0);
+  const gint64 latency = _wait_for(f, renamed, TRUE, start);
+  print_message("removal: reported after %.1f ms\n", latency / 1000.0);
+  assert_true(latency >= 0);
+  assert_true(latency < DETECTION_BUDGET_US);
+
+  g_free(path);
+  g_free(renamed);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_file_in_existing_subfolder, _setup, _teardown),
+    cmocka_unit_test_setup_teardown(test_new_subfolder_is_followed, _setup, _teardown),
+    cmocka_unit_test_setup_teardown(test_removal_and_rename, _setup, _teardown),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,387 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** A geometry stage samples the input once, at the positions composed through all its modules,
+ * where the modules chained resample the output of each other. The steps below map points the
+ * way rotatepixels, scalepixels and flip do. Chained, each one fills its own buffer from the
+ * previous one; composed, the points go through the three of them backwards and the source is
+ * sampled once. Both must agree within the interpolation error, and the composed result must be
+ * at least as close to the true image as the chained one. When every step copies, the two must
+ * be identical. Where a step reads outside of its input, both must be black, whatever the steps
+ * before it would make of the point.
+ *
+ * The steps stand for the modules. The copying modules are also checked for real: the points
+ * flip and crop return from resample_points() must sample exactly what their process() writes.
+ */
+
+#include "common/image.h"
+#include "develop/pixelpipe_hb.h"
+#include "pixel/geometry_stage.h"
+#include "pixel/interpolation.h"
+#include "system/mem_alloc.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+// The modules are compiled into lib_ansel, their entry points prefixed by module name (see
+// common/module_api.h).
+int dt_iop_flip__resample_points(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe,
+                                 const struct dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count);
+int dt_iop_flip__process(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe,
+                         const struct dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid);
+int dt_iop_crop__resample_points(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe,
+                                 const struct dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count);
+int dt_iop_crop__process(struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_t *pipe,
+                         const struct dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid);
+
+// Pixels this far from the borders of the output are compared: closer, the kernels of the
+// chained steps reach past the borders of their input.
+#define MARGIN 8
+
+typedef enum step_type_t
+{
+  STEP_ROTATE,
+  STEP_SCALE,
+  STEP_FLIP_X,
+  STEP_TRANSPOSE,
+  STEP_SHIFT,
+  STEP_CLAMP,
+} step_type_t;
+
+typedef struct step_t
+{
+  step_type_t type;
+  int in_width, in_height;
+  int out_width, out_height;
+  float a, b; // angle in degrees, x and y scales, or x and y shift
+} step_t;
+
+// Where the step samples its input for each point of its output, as resample_points() does.
+static void _step_points(const step_t *s, float *points, const size_t count)
+{
+  const float cos_a = cosf(s->a * M_PI / 180.f), sin_a = sinf(s->a * M_PI / 180.f);
+  for(size_t k = 0; k < 2 * count; k += 2)
+  {
+    const float x = points[k], y = points[k + 1];
+    switch(s->type)
+    {
+      case STEP_ROTATE:
+      {
+        const float dx = x - 0.5f * (s->out_width - 1), dy = y - 0.5f * (s->out_height - 1);
+        points[k] = cos_a * dx + sin_a * dy + 0.5f * (s->in_width - 1);
+        points[k + 1] = -sin_a * dx + cos_a * dy + 0.5f * (s->in_height - 1);
+        break;
+      }
+      case STEP_SCALE:
+        points[k] = x * s->a;
+        points[k + 1] = y * s->b;
+        break;
+      case STEP_FLIP_X:
+        points[k] = s->in_width - 1 - x;
+        break;
+      case STEP_TRANSPOSE:
+        points[k] = y;
+        points[k + 1] = x;
+        break;
+      case STEP_SHIFT:
+        points[k] = x + s->a;
+        points[k + 1] = y + s->b;
+        break;
+      case STEP_CLAMP:
+        // As lens does: whatever comes in is pulled onto the border of the input.
+        points[k] = fmaxf(fminf(x, s->in_width - 1.f), 0.f);
+        points[k + 1] = fmaxf(fminf(y, s->in_height - 1.f), 0.f);
+        break;
+    }
+  }
+}
+
+// Periods of 10 to 15 pixels: smooth enough for bicubic, fine enough for its error to show.
+static float _truth(const float x, const float y, const int c)
+{
+  return 0.5f + 0.2f * sinf(0.5f * x + 0.7f * c) * cosf(0.4f * y - 0.3f * c) + 0.001f * (x + y);
+}
+
+static float *_source(const int width, const int height)
+{
+  float *in = dt_alloc_align_float((size_t)4 * width * height);
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      for(int c = 0; c < 4; c++) in[4 * ((size_t)y * width + x) + c] = _truth(x, y, c);
+  return in;
+}
+
+static float *_grid(const int width, const int height)
+{
+  float *points = dt_alloc_align_float((size_t)2 * width * height);
+  dt_geometry_stage_grid(points, width, height);
+  return points;
+}
+
+// Each step resamples the output of the previous one, as the modules chained do.
+static float *_chained(const struct dt_interpolation *itor, const float *src, const step_t *steps, const int n)
+{
+  float *in = dt_alloc_align_float((size_t)4 * steps[0].in_width * steps[0].in_height);
+  memcpy(in, src, sizeof(float) * 4 * steps[0].in_width * steps[0].in_height);
+  for(int k = 0; k < n; k++)
+  {
+    const step_t *s = &steps[k];
+    float *points = _grid(s->out_width, s->out_height);
+    _step_points(s, points, (size_t)s->out_width * s->out_height);
+    float *out = dt_alloc_align_float((size_t)4 * s->out_width * s->out_height);
+    dt_geometry_stage_sample(itor, in, s->in_width, s->in_height, points, out, s->out_width, s->out_height);
+    dt_free_align(points);
+    dt_free_align(in);
+    in = out;
+  }
+  return in;
+}
+
+// The points go through all the steps backwards and the source is sampled once. As the pipe does,
+// the points a step samples outside of its input are dropped before the previous step.
+static float *_composed(const struct dt_interpolation *itor, const float *src, const step_t *steps, const int n,
+                        float **points_out)
+{
+  const step_t *last = &steps[n - 1];
+  const size_t count = (size_t)last->out_width * last->out_height;
+  float *points = _grid(last->out_width, last->out_height);
+  uint8_t *outside = calloc(count, 1);
+  for(int k = n - 1; k >= 0; k--)
+  {
+    _step_points(&steps[k], points, count);
+    dt_geometry_stage_clip(points, outside, count, steps[k].in_width, steps[k].in_height);
+  }
+  free(outside);
+  float *out = dt_alloc_align_float(4 * count);
+  dt_geometry_stage_sample(itor, src, steps[0].in_width, steps[0].in_height, points, out, last->out_width,
+                           last->out_height);
+  *points_out = points;
+  return out;
+}
+
+static void test_resampling_steps(void **state)
+{
+  // rotatepixels, then scalepixels stretching x, then flip.
+  const step_t steps[] = {
+    { STEP_ROTATE, 200, 160, 170, 130, 4.f, 0.f },
+    { STEP_SCALE, 170, 130, 200, 130, 0.84f, 1.f },
+    { STEP_FLIP_X, 200, 130, 200, 130, 0.f, 0.f },
+  };
+  const int n = sizeof(steps) / sizeof(steps[0]);
+  const int width = steps[n - 1].out_width, height = steps[n - 1].out_height;
+  const struct dt_interpolation *itor = dt_interpolation_new(DT_INTERPOLATION_BICUBIC);
+
+  float *src = _source(steps[0].in_width, steps[0].in_height);
+  float *chained = _chained(itor, src, steps, n);
+  float *points = NULL;
+  float *composed = _composed(itor, src, steps, n, &points);
+
+  double max_diff = 0.0, err_chained = 0.0, err_composed = 0.0;
+  for(int y = MARGIN; y < height - MARGIN; y++)
+    for(int x = MARGIN; x < width - MARGIN; x++)
+    {
+      const size_t k = (size_t)y * width + x;
+      for(int c = 0; c < 4; c++)
+      {
+        const double truth = _truth(points[2 * k], points[2 * k + 1], c);
+        max_diff = fmax(max_diff, fabs(composed[4 * k + c] - chained[4 * k + c]));
+        err_chained = fmax(err_chained, fabs(chained[4 * k + c] - truth));
+        err_composed = fmax(err_composed, fabs(composed[4 * k + c] - truth));
+      }
+    }
+
+  assert_true(max_diff < 5e-3);
+  assert_true(err_composed < err_chained);
+
+  dt_free_align(src);
+  dt_free_align(chained);
+  dt_free_align(composed);
+  dt_free_align(points);
+}
+
+static void test_copying_steps(void **state)
+{
+  // flip, then a transposition as flip does for a quarter turn, then a crop.
+  const step_t steps[] = {
+    { STEP_FLIP_X, 61, 47, 61, 47, 0.f, 0.f },
+    { STEP_TRANSPOSE, 61, 47, 47, 61, 0.f, 0.f },
+    { STEP_SHIFT, 47, 61, 40, 50, 3.f, 5.f },
+  };
+  const int n = sizeof(steps) / sizeof(steps[0]);
+  const size_t count = (size_t)steps[n - 1].out_width * steps[n - 1].out_height;
+
+  float *src = _source(steps[0].in_width, steps[0].in_height);
+  float *chained = _chained(NULL, src, steps, n);
+  float *points = NULL;
+  float *composed = _composed(NULL, src, steps, n, &points);
+
+  assert_memory_equal(composed, chained, 4 * count * sizeof(float));
+
+  dt_free_align(src);
+  dt_free_align(chained);
+  dt_free_align(composed);
+  dt_free_align(points);
+}
+
+static void test_rotated_corners(void **state)
+{
+  // A step that clamps everything onto its input, as lens does, then a rotation whose corners
+  // fall outside of it. Chained, the corners are black. Composed, the clamping step must not get
+  // a chance to smear its borders into them.
+  const step_t steps[] = {
+    { STEP_CLAMP, 90, 70, 90, 70, 0.f, 0.f },
+    { STEP_ROTATE, 90, 70, 90, 70, 12.f, 0.f },
+  };
+  const int n = sizeof(steps) / sizeof(steps[0]);
+  const int width = steps[n - 1].out_width, height = steps[n - 1].out_height;
+  const struct dt_interpolation *itor = dt_interpolation_new(DT_INTERPOLATION_BICUBIC);
+
+  float *src = _source(steps[0].in_width, steps[0].in_height);
+  float *chained = _chained(itor, src, steps, n);
+  float *points = NULL;
+  float *composed = _composed(itor, src, steps, n, &points);
+
+  // Where the rotation reads outside of its input, by the same test as the interpolation.
+  float *rotated = _grid(width, height);
+  _step_points(&steps[n - 1], rotated, (size_t)width * height);
+
+  int corners = 0;
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    const float x = rotated[2 * k], y = rotated[2 * k + 1];
+    if(x > -1.f && y > -1.f && x < steps[n - 1].in_width && y < steps[n - 1].in_height) continue;
+    corners++;
+    assert_true(isnan(points[2 * k]));
+    for(int c = 0; c < 4; c++)
+    {
+      assert_true(chained[4 * k + c] == 0.f);
+      assert_true(composed[4 * k + c] == 0.f);
+    }
+  }
+  // The four corners are out at 12 degrees, the case is not empty.
+  assert_true(corners > 4 * 20);
+
+  dt_free_align(src);
+  dt_free_align(chained);
+  dt_free_align(composed);
+  dt_free_align(points);
+  dt_free_align(rotated);
+}
+
+static void test_outside_points(void **state)
+{
+  const int width = 8, height = 4;
+  float *src = _source(width, height);
+  float points[] = { -3.f, 1.f, 2.f, 40.f, NAN, 1.f, 2.f, 1.f };
+  float out[4 * 4];
+  dt_geometry_stage_sample(NULL, src, width, height, points, out, 4, 1);
+  for(int c = 0; c < 12; c++) assert_true(out[c] == 0.f);
+  assert_memory_equal(out + 12, src + 4 * (width + 2), 4 * sizeof(float));
+  dt_free_align(src);
+}
+
+// process() of the module against its resample_points() sampled by the stage, on one piece.
+static void _check_module(int (*resample_points)(struct dt_iop_module_t *, const struct dt_dev_pixelpipe_t *,
+                                                 const struct dt_dev_pixelpipe_iop_t *, float *, size_t),
+                          int (*process)(struct dt_iop_module_t *, const struct dt_dev_pixelpipe_t *,
+                                         const struct dt_dev_pixelpipe_iop_t *, const void *const, void *const),
+                          const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_roi_t *const roi_in = &piece->roi_in;
+  const dt_iop_roi_t *const roi_out = &piece->roi_out;
+  const size_t count = (size_t)roi_out->width * roi_out->height;
+
+  float *src = _source(roi_in->width, roi_in->height);
+  float *processed = dt_alloc_align_float(4 * count);
+  float *sampled = dt_alloc_align_float(4 * count);
+  float *points = _grid(roi_out->width, roi_out->height);
+
+  assert_int_equal(process(NULL, NULL, piece, src, processed), 0);
+  assert_int_equal(resample_points(NULL, NULL, piece, points, count), DT_GEOMETRY_STAGE_COPY);
+  dt_geometry_stage_sample(NULL, src, roi_in->width, roi_in->height, points, sampled, roi_out->width,
+                           roi_out->height);
+  assert_memory_equal(sampled, processed, 4 * count * sizeof(float));
+
+  dt_free_align(src);
+  dt_free_align(processed);
+  dt_free_align(sampled);
+  dt_free_align(points);
+}
+
+static void test_flip_module(void **state)
+{
+  // Same layout as dt_iop_flip_data_t.
+  struct { dt_image_orientation_t orientation; } data;
+  for(int orientation = ORIENTATION_NONE; orientation <= ORIENTATION_TRANSVERSE; orientation++)
+  {
+    data.orientation = (dt_image_orientation_t)orientation;
+    const gboolean swap = (orientation & ORIENTATION_SWAP_XY) != 0;
+    dt_dev_pixelpipe_iop_t piece;
+    memset(&piece, 0, sizeof(piece));
+    piece.data = &data;
+    piece.dsc_in.channels = 4;
+    piece.roi_in = (dt_iop_roi_t){ 0, 0, 23, 17, 1.f };
+    piece.roi_out = (dt_iop_roi_t){ 0, 0, swap ? 17 : 23, swap ? 23 : 17, 1.f };
+    _check_module(dt_iop_flip__resample_points, dt_iop_flip__process, &piece);
+  }
+}
+
+static void test_crop_module(void **state)
+{
+  // The crop offset lives in the ROI, process() copies its input whole.
+  dt_dev_pixelpipe_iop_t piece;
+  memset(&piece, 0, sizeof(piece));
+  piece.dsc_in.channels = 4;
+  piece.roi_in = (dt_iop_roi_t){ 5, 3, 31, 19, 1.f };
+  piece.roi_out = (dt_iop_roi_t){ 0, 0, 31, 19, 1.f };
+  _check_module(dt_iop_crop__resample_points, dt_iop_crop__process, &piece);
+
+  // Not a plain copy anymore: the stage has to run process().
+  piece.roi_out.width = 30;
+  assert_int_equal(dt_iop_crop__resample_points(NULL, NULL, &piece, NULL, 0), DT_GEOMETRY_STAGE_NONE);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_resampling_steps),
+    cmocka_unit_test(test_copying_steps),
+    cmocka_unit_test(test_rotated_corners),
+    cmocka_unit_test(test_outside_points),
+    cmocka_unit_test(test_flip_module),
+    cmocka_unit_test(test_crop_module),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,184 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Half-float packing keeps the error bound half_float.h promises, over every exponent the
+ * pipe produces, and refuses what it cannot store rather than clipping it: a cacheline
+ * packed with a clipped highlight would silently change the render.
+ *
+ * The in-place variant is checked against the out-of-place one on sizes straddling its
+ * block boundaries, since its wave ordering is what keeps blocks from overwriting input
+ * not read yet.
+ */
+
+#include "pixel/half_float.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+// Matches DT_HALF_FLOAT_BLOCK in half_float.c: the sizes below straddle it.
+#define BLOCK 65536
+
+static void _fill_random(float *buf, const size_t count, GRand *rand)
+{
+  // Log-uniform magnitudes from deep in the subnormals to the top of the range, both signs.
+  for(size_t k = 0; k < count; k++)
+  {
+    const float magnitude = exp2f((float)g_rand_double_range(rand, -30.0, 15.9));
+    buf[k] = g_rand_boolean(rand) ? magnitude : -magnitude;
+  }
+}
+
+static void test_error_bound(void **state)
+{
+  const size_t count = 1 << 20;
+  float *in = g_new(float, count);
+  uint16_t *packed = g_new(uint16_t, count);
+  float *out = g_new(float, count);
+  GRand *rand = g_rand_new_with_seed(0x5eed);
+  _fill_random(in, count, rand);
+
+  assert_true(dt_half_float_pack(packed, in, count));
+  dt_half_float_unpack(out, packed, count);
+
+  double worst_relative = 0.0;
+  for(size_t k = 0; k < count; k++)
+  {
+    const float error = fabsf(out[k] - in[k]);
+    if(fabsf(in[k]) >= 0x1p-14f)
+    {
+      assert_true(error <= DT_HALF_FLOAT_RELATIVE_ERROR * fabsf(in[k]));
+      worst_relative = MAX(worst_relative, error / fabsf(in[k]));
+    }
+    else
+      assert_true(error <= DT_HALF_FLOAT_ABSOLUTE_ERROR);
+  }
+  print_message("worst relative error: %g (bound %g)\n", worst_relative, (double)DT_HALF_FLOAT_RELATIVE_ERROR);
+
+  g_rand_free(rand);
+  g_free(in);
+  g_free(packed);
+  g_free(out);
+}
+
+static void test_halves_round_trip(void **state)
+{
+  // Every finite half is a float: unpacking then packing must give it back bit for bit.
+  uint16_t halves[65536];
+  float floats[65536];
+  uint16_t again[65536];
+  size_t count = 0;
+  for(uint32_t h = 0; h < 65536; h++)
+    if(((h >> 10) & 0x1f) != 0x1f) halves[count++] = (uint16_t)h;
+
+  dt_half_float_unpack(floats, halves, count);
+  assert_true(dt_half_float_pack(again, floats, count));
+  assert_memory_equal(halves, again, count * sizeof(uint16_t));
+}
+
+static void test_out_of_range_rejected(void **state)
+{
+  const float rejected[] = { 65536.f, -65536.f, NAN, INFINITY, -INFINITY, 1e30f };
+  float buf[1024];
+  uint16_t packed[1024];
+
+  for(size_t r = 0; r < G_N_ELEMENTS(rejected); r++)
+  {
+    // Both in the middle of a buffer and as its last value, where the vector paths hand over to scalar.
+    for(size_t pos = 0; pos < 1024; pos += 337)
+    {
+      for(size_t k = 0; k < 1024; k++) buf[k] = 0.5f * k;
+      buf[pos] = rejected[r];
+      assert_false(dt_half_float_pack(packed, buf, 1024));
+      assert_false(dt_half_float_pack(packed, buf, pos + 1));
+    }
+  }
+
+  // The largest half itself is accepted.
+  buf[0] = DT_HALF_FLOAT_MAX;
+  buf[1] = -DT_HALF_FLOAT_MAX;
+  assert_true(dt_half_float_pack(packed, buf, 2));
+}
+
+static void test_in_place_matches(void **state)
+{
+  const size_t sizes[] = { 0, 1, 7, 8, 9, BLOCK - 1, BLOCK, BLOCK + 1, 3 * BLOCK + 5, 9 * BLOCK + 13 };
+  GRand *rand = g_rand_new_with_seed(0xf16c);
+
+  for(size_t s = 0; s < G_N_ELEMENTS(sizes); s++)
+  {
+    const size_t count = sizes[s];
+    float *in = g_new(float, count + 1);
+    uint16_t *expected = g_new(uint16_t, count + 1);
+    _fill_random(in, count, rand);
+
+    assert_true(dt_half_float_pack(expected, in, count));
+    assert_true(dt_half_float_pack_in_place(in, count));
+    assert_memory_equal(expected, in, count * sizeof(uint16_t));
+
+    g_free(in);
+    g_free(expected);
+  }
+
+  g_rand_free(rand);
+}
+
+static void test_in_place_untouched_on_reject(void **state)
+{
+  const size_t count = 5 * BLOCK + 3;
+  float *buf = g_new(float, count);
+  float *copy = g_new(float, count);
+  GRand *rand = g_rand_new_with_seed(0xbad);
+  _fill_random(buf, count, rand);
+  buf[4 * BLOCK + 1] = 1e6f;
+  memcpy(copy, buf, count * sizeof(float));
+
+  assert_false(dt_half_float_pack_in_place(buf, count));
+  assert_memory_equal(copy, buf, count * sizeof(float));
+
+  g_rand_free(rand);
+  g_free(buf);
+  g_free(copy);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_error_bound),
+    cmocka_unit_test(test_halves_round_trip),
+    cmocka_unit_test(test_out_of_range_rejected),
+    cmocka_unit_test(test_in_place_matches),
+    cmocka_unit_test(test_in_place_untouched_on_reject),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,196 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** The multigrid heal solves the same discrete membrane as the red/black SOR it replaced:
+ * every masked pixel is the mean of its neighbours inside the patch, pixels outside the mask
+ * are fixed. The reference below is that SOR again, in double precision and run to
+ * convergence, so it is what the former solver was heading to. The heal must land on it
+ * within a few V-cycles, on a small and on a large patch alike, and leave unmasked pixels
+ * alone.
+ */
+
+#include "caches/pixelpipe_cache.h"
+#include "pixel/heal.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+// Cycles allowed to the heal: it usually needs about ten, and must not need more
+// on the larger patch.
+#define MAX_CYCLES 12
+#define TOLERANCE 5e-5
+
+typedef struct heal_patch_t
+{
+  int width;
+  int height;
+  float *src;
+  float *dest;
+  float *mask;
+} heal_patch_t;
+
+// A disc, as a circle shape leaves it in its bounding box, crossed by a thin diagonal
+// stroke reaching out of it, as a brush would.
+static heal_patch_t _patch(const int width, const int height)
+{
+  const size_t npixels = (size_t)width * height;
+  heal_patch_t p = { width, height, g_new(float, 4 * npixels), g_new(float, 4 * npixels), g_new(float, npixels) };
+  GRand *rand = g_rand_new_with_seed(0x4ea1);
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      const size_t k = (size_t)y * width + x;
+      for(int c = 0; c < 4; c++)
+      {
+        p.src[4 * k + c] = 0.3f + 0.2f * sinf(0.05f * x + c) + (float)g_rand_double_range(rand, 0.0, 0.05);
+        p.dest[4 * k + c] = 0.5f + 0.3f * cosf(0.03f * y - c) + (float)g_rand_double_range(rand, 0.0, 0.05);
+      }
+      const float dx = (x - 0.5f * width) / (0.4f * width);
+      const float dy = (y - 0.5f * height) / (0.4f * height);
+      const gboolean disc = dx * dx + dy * dy < 1.f;
+      const gboolean stroke = abs(y - x * height / width) < 2 && x > 2 && x < width - 3;
+      p.mask[k] = (disc || stroke) ? 1.f : 0.f;
+    }
+  g_rand_free(rand);
+  return p;
+}
+
+static void _free_patch(heal_patch_t *p)
+{
+  g_free(p->src);
+  g_free(p->dest);
+  g_free(p->mask);
+}
+
+// The former solver, in double precision: over-relaxed Gauss-Seidel on dest - src,
+// then src added back on the masked pixels.
+static double *_reference(const heal_patch_t *p)
+{
+  const int w = p->width;
+  const int h = p->height;
+  const size_t npixels = (size_t)w * h;
+  const double omega = 2.0 / (1.0 + sin(M_PI / MAX(w, h)));
+  double *u = g_new(double, 4 * npixels);
+  for(size_t k = 0; k < 4 * npixels; k++) u[k] = (double)p->dest[k] - p->src[k];
+
+  double max_update = 1.0;
+  for(int iter = 0; iter < 100000 && max_update > 1e-12; iter++)
+  {
+    max_update = 0.0;
+    for(int y = 0; y < h; y++)
+      for(int x = 0; x < w; x++)
+      {
+        const size_t k = (size_t)y * w + x;
+        if(p->mask[k] == 0.f) continue;
+        for(int c = 0; c < 3; c++)
+        {
+          double sum = 0.0;
+          int deg = 0;
+          if(y > 0) { sum += u[4 * (k - w) + c]; deg++; }
+          if(y + 1 < h) { sum += u[4 * (k + w) + c]; deg++; }
+          if(x > 0) { sum += u[4 * (k - 1) + c]; deg++; }
+          if(x + 1 < w) { sum += u[4 * (k + 1) + c]; deg++; }
+          const double update = omega * (sum / deg - u[4 * k + c]);
+          u[4 * k + c] += update;
+          max_update = fmax(max_update, fabs(update));
+        }
+      }
+  }
+
+  for(size_t k = 0; k < 4 * npixels; k++) u[k] += p->src[k];
+  return u;
+}
+
+static void _check_heal(const int width, const int height)
+{
+  heal_patch_t p = _patch(width, height);
+  const size_t npixels = (size_t)width * height;
+  double *expected = _reference(&p);
+  float *healed = g_new(float, 4 * npixels);
+  memcpy(healed, p.dest, 4 * npixels * sizeof(float));
+
+  dt_heal(p.src, healed, p.mask, width, height, 4, MAX_CYCLES);
+
+  double max_error = 0.0;
+  for(size_t k = 0; k < npixels; k++)
+  {
+    if(p.mask[k] == 0.f)
+    {
+      assert_memory_equal(healed + 4 * k, p.dest + 4 * k, 4 * sizeof(float));
+      continue;
+    }
+    for(int c = 0; c < 3; c++)
+    {
+      assert_true(isfinite(healed[4 * k + c]));
+      max_error = fmax(max_error, fabs(healed[4 * k + c] - expected[4 * k + c]));
+    }
+  }
+  assert_true(max_error < TOLERANCE);
+
+  g_free(expected);
+  g_free(healed);
+  _free_patch(&p);
+}
+
+static void test_small_patch(void **state)
+{
+  _check_heal(64, 48);
+  _check_heal(31, 77);
+}
+
+static void test_large_patch(void **state)
+{
+  _check_heal(257, 255);
+}
+
+static int _setup(void **state)
+{
+  return dt_dev_pixelpipe_cache_init((size_t)256 << 20, FALSE, FALSE, FALSE) ? 0 : -1;
+}
+
+static int _teardown(void **state)
+{
+  dt_dev_pixelpipe_cache_cleanup();
+  return 0;
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_small_patch),
+    cmocka_unit_test(test_large_patch),
+  };
+  return cmocka_run_group_tests(tests, _setup, _teardown);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
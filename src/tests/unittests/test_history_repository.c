@@ -103,6 +103,28 @@ static void test_find_version_for_params(void **state)
   assert_int_equal(dt_history_repository_find_version_for_params("filmic", params_a, sizeof(params_a)), 0);
 }
 
+static void test_delete_dev_history_from(void **state)
+{
+  (void)state;
+  const int32_t film = testdb_make_film("/testdb/tail");
+  const int32_t img = testdb_make_image(film, "a.raw");
+  assert_true(img > 0);
+
+  for(int num = 0; num < 3; num++)
+  {
+    assert_true(dt_history_repository_write_item(img, num, "exposure", params_a, sizeof(params_a), 3,
+                                                 TRUE, blend_a, sizeof(blend_a), 11, 0, ""));
+    assert_true(dt_history_repository_write_mask_item(img, num, 100 + num, 1, "circle", 6, params_b,
+                                                      sizeof(params_b), 1, params_b, sizeof(params_b)));
+  }
+
+  // the tail goes from both tables, the head stays untouched
+  assert_true(dt_history_repository_delete_dev_history_from(img, 1));
+  assert_int_equal(dt_history_repository_count_items(img), 1);
+  assert_int_equal(dt_history_repository_count_mask_items(img), 1);
+  assert_int_equal(dt_history_repository_get_next_num(img), 1);
+}
+
 typedef struct _active_collect_t
 {
   int count;
@@ -151,6 +173,7 @@ int main(void)
     cmocka_unit_test(test_module_order_absent_vs_zero),
     cmocka_unit_test(test_history_item_cycle),
     cmocka_unit_test(test_find_version_for_params),
+    cmocka_unit_test(test_delete_dev_history_from),
     cmocka_unit_test(test_foreach_active_module),
   };
   return cmocka_run_group_tests(tests, testdb_setup, testdb_teardown);
@@ -0,0 +1,371 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** The background job scheduler keeps the semantics of the old global queues.
+ *
+ * The first tests pin the contract one worker at a time, where the order is deterministic:
+ * FIFO classes stay FIFO, the thumbnail stack stays most-recent-first with its deduplication
+ * and its capacity, exports never exceed their slots, and a background job is not starved by a
+ * steady stream of thumbnails.
+ *
+ * The last one is the stress test: thousands of tiny jobs pushed from outside the pool and from
+ * a single worker's deque, popped by a full pool. It asserts that every job runs exactly once,
+ * that idle workers steal, that the export slots hold under contention, and that background
+ * work progresses while foreground work keeps coming. It prints the throughput; it does not
+ * assert on it, because a loaded CI machine would make that flaky.
+ */
+
+#include "control/job_scheduler.h"
+#include "system/macros.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <glib.h>
+
+typedef struct fake_job_t
+{
+  int id;
+  dt_job_queue_t queue;
+  gint queued; // times the scheduler published it
+  gint runs;   // times a worker popped it
+  gint done_at; // completion rank, across all jobs
+} fake_job_t;
+
+static gboolean _same_id(const void *a, const void *b)
+{
+  return ((const fake_job_t *)a)->id == ((const fake_job_t *)b)->id;
+}
+
+static void _mark_queued(void *job)
+{
+  g_atomic_int_inc(&((fake_job_t *)job)->queued);
+}
+
+static fake_job_t *_jobs_new(const int count, const dt_job_queue_t queue)
+{
+  fake_job_t *jobs = g_new0(fake_job_t, count);
+  for(int k = 0; k < count; k++)
+  {
+    jobs[k].id = k;
+    jobs[k].queue = queue;
+  }
+  return jobs;
+}
+
+static void test_fifo_classes_keep_order(void **state)
+{
+  (void)state;
+  dt_job_scheduler_t *s = dt_job_scheduler_new(1, 1, 16);
+  fake_job_t *jobs = _jobs_new(100, DT_JOB_QUEUE_USER_BG);
+
+  for(int k = 0; k < 100; k++)
+    assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_USER_BG, &jobs[k], NULL, _mark_queued, NULL));
+  assert_int_equal(dt_job_scheduler_pending(s, DT_JOB_QUEUE_USER_BG), 100);
+
+  for(int k = 0; k < 100; k++)
+  {
+    dt_job_queue_t queue = DT_JOB_QUEUE_MAX;
+    fake_job_t *job = (fake_job_t *)dt_job_scheduler_pop(s, 0, &queue);
+    assert_ptr_equal(job, &jobs[k]);
+    assert_int_equal(queue, DT_JOB_QUEUE_USER_BG);
+    assert_int_equal(job->queued, 1);
+  }
+  assert_null(dt_job_scheduler_pop(s, 0, NULL));
+
+  dt_job_scheduler_free(s);
+  g_free(jobs);
+}
+
+static void test_stack_is_lifo_deduplicated_and_bounded(void **state)
+{
+  (void)state;
+  dt_job_scheduler_t *s = dt_job_scheduler_new(1, 1, 4);
+  fake_job_t *jobs = _jobs_new(6, DT_JOB_QUEUE_SYSTEM_FG);
+  void *evicted = NULL;
+
+  for(int k = 0; k < 3; k++)
+    assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_SYSTEM_FG, &jobs[k], _same_id, _mark_queued, &evicted));
+
+  // asking again for job 0 bubbles the queued copy up; the new request is handed back
+  fake_job_t again = { .id = 0, .queue = DT_JOB_QUEUE_SYSTEM_FG };
+  assert_false(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_SYSTEM_FG, &again, _same_id, _mark_queued, &evicted));
+  assert_null(evicted);
+  assert_int_equal(again.queued, 0);
+  assert_int_equal(dt_job_scheduler_pending(s, DT_JOB_QUEUE_SYSTEM_FG), 3);
+
+  // past the capacity, the oldest request goes: that is job 1 now
+  assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_SYSTEM_FG, &jobs[3], _same_id, _mark_queued, &evicted));
+  assert_null(evicted);
+  assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_SYSTEM_FG, &jobs[4], _same_id, _mark_queued, &evicted));
+  assert_ptr_equal(evicted, &jobs[1]);
+
+  const int expected[] = { 4, 3, 0, 2 };
+  for(int k = 0; k < 4; k++)
+  {
+    fake_job_t *job = (fake_job_t *)dt_job_scheduler_pop(s, 0, NULL);
+    assert_non_null(job);
+    assert_int_equal(job->id, expected[k]);
+  }
+  assert_null(dt_job_scheduler_pop(s, 0, NULL));
+
+  dt_job_scheduler_stats_t stats;
+  dt_job_scheduler_get_stats(s, &stats);
+  assert_int_equal(stats.duplicates, 1);
+  assert_int_equal(stats.evicted, 1);
+
+  dt_job_scheduler_free(s);
+  g_free(jobs);
+}
+
+static void test_exports_respect_their_slots(void **state)
+{
+  (void)state;
+  dt_job_scheduler_t *s = dt_job_scheduler_new(3, 2, 16);
+  fake_job_t *jobs = _jobs_new(3, DT_JOB_QUEUE_USER_EXPORT);
+  for(int k = 0; k < 3; k++)
+    assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_USER_EXPORT, &jobs[k], NULL, NULL, NULL));
+
+  // two workers get one each, the third finds nothing runnable although a job is queued
+  assert_ptr_equal(dt_job_scheduler_pop(s, 0, NULL), &jobs[0]);
+  assert_ptr_equal(dt_job_scheduler_pop(s, 1, NULL), &jobs[1]);
+  assert_null(dt_job_scheduler_pop(s, 2, NULL));
+  assert_int_equal(dt_job_scheduler_pending(s, DT_JOB_QUEUE_USER_EXPORT), 1);
+
+  dt_job_scheduler_finish(s, DT_JOB_QUEUE_USER_EXPORT);
+  assert_ptr_equal(dt_job_scheduler_pop(s, 2, NULL), &jobs[2]);
+
+  dt_job_scheduler_free(s);
+  g_free(jobs);
+}
+
+static void test_background_is_not_starved(void **state)
+{
+  (void)state;
+  dt_job_scheduler_t *s = dt_job_scheduler_new(1, 1, 1024);
+  fake_job_t background = { .id = -1, .queue = DT_JOB_QUEUE_USER_BG };
+  fake_job_t *thumbs = _jobs_new(64, DT_JOB_QUEUE_SYSTEM_FG);
+
+  assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_USER_BG, &background, NULL, NULL, NULL));
+
+  // one new thumbnail request per pick: the old global scheduler let the background job
+  // through on pick DT_JOB_SCHEDULER_FG_PRIORITY + 2, once aging lifted it above the
+  // thumbnails' priority. The new one must not do worse.
+  int picks = 0;
+  fake_job_t *job = NULL;
+  do
+  {
+    assert_true(dt_job_scheduler_push(s, 0, DT_JOB_QUEUE_SYSTEM_FG, &thumbs[picks], _same_id, NULL, NULL));
+    job = (fake_job_t *)dt_job_scheduler_pop(s, 0, NULL);
+    picks++;
+  } while(job != &background && picks < 64);
+
+  assert_ptr_equal(job, &background);
+  assert_true(picks <= DT_JOB_SCHEDULER_FG_PRIORITY + 2);
+
+  g_list_free(dt_job_scheduler_drain(s));
+  dt_job_scheduler_free(s);
+  g_free(thumbs);
+}
+
+/* ------------------------------------------------------------------------------------------- */
+/* stress                                                                                      */
+/* ------------------------------------------------------------------------------------------- */
+
+#define STRESS_WORKERS 8
+#define STRESS_PRODUCERS 4
+#define STRESS_JOBS_PER_PRODUCER 5000
+#define STRESS_JOBS (STRESS_PRODUCERS * STRESS_JOBS_PER_PRODUCER)
+#define STRESS_EXPORT_SLOTS 2
+
+typedef struct stress_t
+{
+  dt_job_scheduler_t *s;
+  fake_job_t *jobs;
+  gint producers_left;
+  gint completed;
+  gint exports_running;
+  gint exports_peak;
+  gint per_worker[STRESS_WORKERS];
+} stress_t;
+
+typedef struct stress_thread_t
+{
+  stress_t *stress;
+  int index;
+} stress_thread_t;
+
+// A few hundred nanoseconds of work, the order of a cache-hit thumbnail request.
+static void _spin(const int id)
+{
+  volatile uint32_t x = (uint32_t)id;
+  for(int k = 0; k < 200; k++) x = x * 1664525u + 1013904223u;
+}
+
+static gpointer _producer_main(gpointer user_data)
+{
+  stress_thread_t *t = (stress_thread_t *)user_data;
+  stress_t *st = t->stress;
+  const int first = t->index * STRESS_JOBS_PER_PRODUCER;
+  for(int k = first; k < first + STRESS_JOBS_PER_PRODUCER; k++)
+  {
+    fake_job_t *job = &st->jobs[k];
+    // Producer 0 stands for a worker spawning jobs in its own deque: everything it makes lands
+    // in deque 0, and only stealing spreads it. The others stand for the GUI thread.
+    const int hint = (t->index == 0) ? 0 : STRESS_WORKERS;
+    const gboolean queued
+        = dt_job_scheduler_push(st->s, hint, job->queue, job, NULL, _mark_queued, NULL);
+    assert_true(queued);
+  }
+  g_atomic_int_add(&st->producers_left, -1);
+  return NULL;
+}
+
+static gpointer _worker_main(gpointer user_data)
+{
+  stress_thread_t *t = (stress_thread_t *)user_data;
+  stress_t *st = t->stress;
+  while(g_atomic_int_get(&st->completed) < STRESS_JOBS)
+  {
+    dt_job_queue_t queue = DT_JOB_QUEUE_MAX;
+    fake_job_t *job = (fake_job_t *)dt_job_scheduler_pop(st->s, t->index, &queue);
+    if(IS_NULL_PTR(job))
+    {
+      g_thread_yield();
+      continue;
+    }
+
+    if(queue == DT_JOB_QUEUE_USER_EXPORT)
+    {
+      const int running = g_atomic_int_add(&st->exports_running, 1) + 1;
+      int peak = g_atomic_int_get(&st->exports_peak);
+      while(running > peak && !g_atomic_int_compare_and_exchange(&st->exports_peak, peak, running))
+        peak = g_atomic_int_get(&st->exports_peak);
+    }
+
+    _spin(job->id);
+    g_atomic_int_inc(&job->runs);
+    g_atomic_int_set(&job->done_at, g_atomic_int_add(&st->completed, 1));
+    st->per_worker[t->index]++;
+
+    if(queue == DT_JOB_QUEUE_USER_EXPORT) g_atomic_int_add(&st->exports_running, -1);
+    dt_job_scheduler_finish(st->s, queue);
+  }
+  return NULL;
+}
+
+static void test_stress_many_small_jobs(void **state)
+{
+  (void)state;
+  stress_t st = { 0 };
+  st.s = dt_job_scheduler_new(STRESS_WORKERS, STRESS_EXPORT_SLOTS, STRESS_JOBS);
+  st.jobs = g_new0(fake_job_t, STRESS_JOBS);
+  st.producers_left = STRESS_PRODUCERS;
+
+  // mostly thumbnails, then background work, some exports and a few GUI actions
+  for(int k = 0; k < STRESS_JOBS; k++)
+  {
+    st.jobs[k].id = k;
+    const int r = k % 20;
+    st.jobs[k].queue = (r < 12)   ? DT_JOB_QUEUE_SYSTEM_FG
+                       : (r < 16) ? DT_JOB_QUEUE_USER_BG
+                       : (r < 18) ? DT_JOB_QUEUE_USER_EXPORT
+                       : (r < 19) ? DT_JOB_QUEUE_SYSTEM_BG
+                                  : DT_JOB_QUEUE_USER_FG;
+  }
+
+  stress_thread_t workers[STRESS_WORKERS];
+  stress_thread_t producers[STRESS_PRODUCERS];
+  GThread *threads[STRESS_WORKERS + STRESS_PRODUCERS];
+
+  const gint64 start = g_get_monotonic_time();
+  for(int k = 0; k < STRESS_WORKERS; k++)
+  {
+    workers[k] = (stress_thread_t){ &st, k };
+    threads[k] = g_thread_new("stress-worker", _worker_main, &workers[k]);
+  }
+  for(int k = 0; k < STRESS_PRODUCERS; k++)
+  {
+    producers[k] = (stress_thread_t){ &st, k };
+    threads[STRESS_WORKERS + k] = g_thread_new("stress-producer", _producer_main, &producers[k]);
+  }
+  for(int k = 0; k < STRESS_WORKERS + STRESS_PRODUCERS; k++) g_thread_join(threads[k]);
+  const double seconds = (g_get_monotonic_time() - start) * 1e-6;
+
+  dt_job_scheduler_stats_t stats;
+  dt_job_scheduler_get_stats(st.s, &stats);
+  print_message("stress: %d jobs in %.3f s (%.0f jobs/s), %" G_GUINT64_FORMAT " stolen, export peak %d\n",
+                STRESS_JOBS, seconds, STRESS_JOBS / seconds, stats.stolen, st.exports_peak);
+
+  // every job ran exactly once, and was published exactly once
+  for(int k = 0; k < STRESS_JOBS; k++)
+  {
+    assert_int_equal(st.jobs[k].runs, 1);
+    assert_int_equal(st.jobs[k].queued, 1);
+  }
+  assert_int_equal(stats.pushed, STRESS_JOBS);
+  assert_int_equal(stats.popped, STRESS_JOBS);
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) assert_int_equal(dt_job_scheduler_pending(st.s, i), 0);
+
+  // the export slots held under contention
+  assert_true(st.exports_peak <= STRESS_EXPORT_SLOTS);
+
+  // idle workers stole. Not all of them are asserted busy: on a loaded machine a thread may
+  // not get a timeslice before the run is over.
+  assert_true(stats.stolen > 0);
+  int busy = 0;
+  for(int k = 0; k < STRESS_WORKERS; k++) busy += (st.per_worker[k] > 0);
+  assert_true(busy >= STRESS_WORKERS / 2);
+
+  // background work progressed under the thumbnail stream: the first background job finished
+  // before the last thumbnail did
+  int first_background = STRESS_JOBS;
+  int last_thumbnail = -1;
+  for(int k = 0; k < STRESS_JOBS; k++)
+  {
+    if(st.jobs[k].queue == DT_JOB_QUEUE_USER_BG) first_background = MIN(first_background, st.jobs[k].done_at);
+    if(st.jobs[k].queue == DT_JOB_QUEUE_SYSTEM_FG) last_thumbnail = MAX(last_thumbnail, st.jobs[k].done_at);
+  }
+  assert_true(first_background < last_thumbnail);
+
+  dt_job_scheduler_free(st.s);
+  g_free(st.jobs);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fifo_classes_keep_order),
+    cmocka_unit_test(test_stack_is_lifo_deduplicated_and_bounded),
+    cmocka_unit_test(test_exports_respect_their_slots),
+    cmocka_unit_test(test_background_is_not_starved),
+    cmocka_unit_test(test_stress_many_small_jobs),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
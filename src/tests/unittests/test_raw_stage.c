@@ -0,0 +1,220 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** The fused raw stage must give what rawprepare, temperature and highlights in clip mode give
+ * when run one after the other. The reference below is their three process() loops, each
+ * writing its own buffer, on a cropped input with odd CFA offsets, Bayer and X-Trans, integer
+ * and float raw, with and without enough clipped photosites for highlights to clip.
+ */
+
+#include "develop/imageop_math.h"
+#include "pixel/raw_stage.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#define TOLERANCE 1e-6
+
+// Fuji X-Trans pattern, as rawspeed hands it over.
+static const uint8_t _xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                       { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+typedef struct raw_case_t
+{
+  int in_width;
+  int in_height;
+  int width;
+  int height;
+  void *raw;
+  dt_raw_stage_t stage;
+} raw_case_t;
+
+// A mosaic of the input size, as the raw loader leaves it. A share of the photosites, drawn
+// with probability `hot`, sits at the white level.
+static raw_case_t _case(const int width, const int height, const gboolean input_float, const uint32_t filters,
+                        const double hot)
+{
+  const int in_width = width + 9;
+  const int in_height = height + 7;
+  raw_case_t c = { in_width, in_height, width, height, NULL, { 0 } };
+  dt_raw_stage_t *s = &c.stage;
+  s->steps = DT_RAW_STAGE_PREPARE | DT_RAW_STAGE_WHITE_BALANCE | DT_RAW_STAGE_CLIP;
+  const float black[4] = { 511.f, 512.f, 509.f, 514.f };
+  for(int k = 0; k < 4; k++)
+  {
+    s->sub[k] = black[k];
+    s->div[k] = 16383.f - black[k];
+  }
+  s->input_x = 5;
+  s->input_y = 3;
+  s->input_width = in_width;
+  s->prepare_x = 7;
+  s->prepare_y = 1;
+  s->input_float = input_float;
+  const float coeffs[4] = { 2.1f, 1.f, 1.6f, 1.f };
+  memcpy(s->coeffs, coeffs, sizeof(coeffs));
+  s->filters = filters;
+  memcpy(s->xtrans, _xtrans, sizeof(_xtrans));
+  s->wb_x = 3;
+  s->wb_y = 2;
+  s->clip = 0.98f;
+  s->min_clipped = 25;
+
+  const size_t n = (size_t)in_width * in_height;
+  GRand *rand = g_rand_new_with_seed(0x2a3);
+  c.raw = input_float ? (void *)g_new(float, n) : (void *)g_new(uint16_t, n);
+  for(size_t k = 0; k < n; k++)
+  {
+    const double v = g_rand_double(rand) < hot ? 16383.0 : g_rand_double_range(rand, 400.0, 6000.0);
+    if(input_float)
+      ((float *)c.raw)[k] = (float)v;
+    else
+      ((uint16_t *)c.raw)[k] = (uint16_t)v;
+  }
+  g_rand_free(rand);
+  return c;
+}
+
+// rawprepare, temperature and highlights' process(), each to its own buffer.
+static float *_reference(const raw_case_t *c)
+{
+  const dt_raw_stage_t *s = &c->stage;
+  const size_t n = (size_t)c->width * c->height;
+  float *prepared = g_new(float, n);
+  for(int j = 0; j < c->height; j++)
+    for(int i = 0; i < c->width; i++)
+    {
+      const size_t pin = (size_t)s->input_width * (j + s->input_y) + s->input_x + i;
+      const int id = (((j + s->prepare_y) & 1) << 1) + ((i + s->prepare_x) & 1);
+      const float raw = s->input_float ? ((const float *)c->raw)[pin] : (float)((const uint16_t *)c->raw)[pin];
+      prepared[(size_t)j * c->width + i] = (raw - s->sub[id]) * (1.0f / s->div[id]);
+    }
+
+  float *balanced = g_new(float, n);
+  const dt_iop_roi_t roi = { .x = s->wb_x, .y = s->wb_y, .width = c->width, .height = c->height, .scale = 1.f };
+  for(int j = 0; j < c->height; j++)
+    for(int i = 0; i < c->width; i++)
+    {
+      const size_t p = (size_t)j * c->width + i;
+      const float coeff = (s->steps & DT_RAW_STAGE_WHITE_BALANCE)
+                              ? s->coeffs[s->filters == 9u ? FCxtrans(j, i, &roi, s->xtrans)
+                                                           : FC(j + roi.y, i + roi.x, s->filters)]
+                              : 1.f;
+      balanced[p] = (s->steps & DT_RAW_STAGE_WHITE_BALANCE) ? prepared[p] * coeff : prepared[p];
+    }
+
+  float *clipped = g_new(float, n);
+  size_t over = 0;
+  for(size_t k = 0; k < n; k++) over += (balanced[k] > s->clip);
+  for(size_t k = 0; k < n; k++)
+    clipped[k] = (over < s->min_clipped) ? balanced[k] : MIN(s->clip, balanced[k]);
+
+  g_free(prepared);
+  g_free(balanced);
+  return clipped;
+}
+
+static void _check(const raw_case_t *c)
+{
+  const size_t n = (size_t)c->width * c->height;
+  float *expected = _reference(c);
+  float *fused = g_new(float, n);
+
+  assert_int_equal(dt_raw_stage_process(&c->stage, c->raw, fused, c->width, c->height), 0);
+
+  for(size_t k = 0; k < n; k++)
+    assert_true(fabs((double)fused[k] - expected[k]) <= TOLERANCE * fmax(1.0, fabs(expected[k])));
+
+  g_free(expected);
+  g_free(fused);
+}
+
+static void test_bayer_clipped(void **state)
+{
+  raw_case_t c = _case(64, 48, FALSE, 0x94949494u, 0.02);
+  _check(&c);
+  // Something was clipped indeed.
+  float *out = g_new(float, (size_t)c.width * c.height);
+  dt_raw_stage_process(&c.stage, c.raw, out, c.width, c.height);
+  size_t at_clip = 0;
+  for(size_t k = 0; k < (size_t)c.width * c.height; k++) at_clip += (out[k] == c.stage.clip);
+  assert_true(at_clip >= c.stage.min_clipped);
+  g_free(out);
+  g_free(c.raw);
+}
+
+static void test_bayer_too_few_clipped(void **state)
+{
+  // A handful of hot photosites only: highlights copies its input through.
+  raw_case_t c = _case(33, 21, FALSE, 0x16161616u, 0.004);
+  _check(&c);
+  g_free(c.raw);
+}
+
+static void test_xtrans_float(void **state)
+{
+  raw_case_t c = _case(61, 37, TRUE, 9u, 0.03);
+  _check(&c);
+  g_free(c.raw);
+}
+
+static void test_without_white_balance(void **state)
+{
+  raw_case_t c = _case(40, 30, FALSE, 0x49494949u, 0.05);
+  c.stage.steps = DT_RAW_STAGE_PREPARE | DT_RAW_STAGE_CLIP;
+  _check(&c);
+  g_free(c.raw);
+}
+
+static void test_needs_prepare(void **state)
+{
+  raw_case_t c = _case(8, 8, FALSE, 0x94949494u, 0.0);
+  c.stage.steps = DT_RAW_STAGE_WHITE_BALANCE | DT_RAW_STAGE_CLIP;
+  float out[64];
+  assert_int_equal(dt_raw_stage_process(&c.stage, c.raw, out, c.width, c.height), 1);
+  g_free(c.raw);
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_bayer_clipped),
+    cmocka_unit_test(test_bayer_too_few_clipped),
+    cmocka_unit_test(test_xtrans_float),
+    cmocka_unit_test(test_without_white_balance),
+    cmocka_unit_test(test_needs_prepare),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,144 @@
+/*
+    This file is part of Ansel,
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Which images may share the source stack of a prepared style.
+ *
+ * A prepared style builds the style modules and history once per signature, and merges that
+ * same stack into every image carrying it. Applying a style image by image builds it for each
+ * image instead, so both give the same history exactly when two images with equal signatures
+ * would have built equal stacks. That is what these tests pin: everything the stack is built
+ * from splits the signature, and nothing else does -- otherwise a batch of 5000 shots from the
+ * same camera would build 5000 stacks again.
+ */
+
+#include "common/styles.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+// cmocka.h declares `extern jmp_buf global_expect_assert_env' at file scope without including
+// <setjmp.h> itself. Same suppression as test_metadata_notify.c, and for the same reason.
+#include <setjmp.h>  // NOLINT(misc-include-cleaner)
+#include <stdint.h>
+#include <string.h>
+#include <cmocka.h>
+
+static dt_image_t _raw_image(const int32_t id)
+{
+  dt_image_t img;
+  memset(&img, 0, sizeof(img));
+  img.id = id;
+  img.flags = DT_IMAGE_RAW | DT_IMAGE_MOSAIC;
+  g_strlcpy(img.camera_makermodel, "Fujifilm X-T5", sizeof(img.camera_makermodel));
+  g_strlcpy(img.exif_lens, "XF16-55mmF2.8 R LM WR", sizeof(img.exif_lens));
+  return img;
+}
+
+/** Two shots of the same series differ by everything the style overwrites or never reads. */
+static void _same_series_shares_the_stack(void **state)
+{
+  (void)state;
+  dt_image_t a = _raw_image(1);
+  dt_image_t b = _raw_image(2);
+  g_strlcpy(b.filename, "DSCF0002.RAF", sizeof(b.filename));
+  g_strlcpy(b.datetime, "2026:06:01 12:00:00", sizeof(b.datetime));
+  b.exif_exposure = 1.f / 250.f;
+  b.exif_iso = 3200.f;
+  b.flags |= DT_IMAGE_REJECTED | DT_IMAGE_AUTO_PRESETS_APPLIED | DT_IMAGE_HAS_TXT;
+  b.history_hash = 0x1234;
+
+  assert_true(dt_styles_source_signature(&a, NULL) == dt_styles_source_signature(&b, NULL));
+}
+
+/** The image type decides the built-in module order and the default-enabled modules. */
+static void _image_type_splits(void **state)
+{
+  (void)state;
+  const dt_image_t raw = _raw_image(1);
+  dt_image_t jpg = _raw_image(2);
+  jpg.flags = DT_IMAGE_LDR;
+  dt_image_t mono = _raw_image(3);
+  mono.flags |= DT_IMAGE_MONOCHROME;
+
+  const uint64_t s_raw = dt_styles_source_signature(&raw, NULL);
+  assert_true(s_raw != dt_styles_source_signature(&jpg, NULL));
+  assert_true(s_raw != dt_styles_source_signature(&mono, NULL));
+}
+
+/** Module defaults may depend on the camera and the lens. */
+static void _camera_and_lens_split(void **state)
+{
+  (void)state;
+  const dt_image_t a = _raw_image(1);
+  dt_image_t camera = _raw_image(2);
+  g_strlcpy(camera.camera_makermodel, "Fujifilm X-H2", sizeof(camera.camera_makermodel));
+  dt_image_t lens = _raw_image(3);
+  g_strlcpy(lens.exif_lens, "XF23mmF1.4 R LM WR", sizeof(lens.exif_lens));
+
+  const uint64_t s = dt_styles_source_signature(&a, NULL);
+  assert_true(s != dt_styles_source_signature(&camera, NULL));
+  assert_true(s != dt_styles_source_signature(&lens, NULL));
+}
+
+/** flip converts legacy params against the EXIF orientation of the image. */
+static void _orientation_splits(void **state)
+{
+  (void)state;
+  const dt_image_t a = _raw_image(1);
+  dt_image_t rotated = _raw_image(2);
+  rotated.orientation = ORIENTATION_ROTATE_CW_90_DEG;
+  dt_image_t unknown = _raw_image(3);
+  unknown.orientation = ORIENTATION_NULL;
+
+  const uint64_t s = dt_styles_source_signature(&a, NULL);
+  assert_true(s != dt_styles_source_signature(&rotated, NULL));
+  // Unknown reads as none, as in dt_image_orientation().
+  assert_true(s == dt_styles_source_signature(&unknown, NULL));
+}
+
+/** An image owning a module order starts the stack from it, not from the built-in one. */
+static void _module_order_splits(void **state)
+{
+  (void)state;
+  const dt_image_t a = _raw_image(1);
+  const dt_image_t b = _raw_image(2);
+
+  const uint64_t builtin = dt_styles_source_signature(&a, NULL);
+  const uint64_t custom = dt_styles_source_signature(&b, "rawprepare,0,exposure,0");
+  assert_true(builtin != custom);
+  assert_true(custom != dt_styles_source_signature(&b, "exposure,0,rawprepare,0"));
+  assert_true(custom == dt_styles_source_signature(&a, "rawprepare,0,exposure,0"));
+}
+
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(_same_series_shares_the_stack),
+    cmocka_unit_test(_image_type_splits),
+    cmocka_unit_test(_camera_and_lens_split),
+    cmocka_unit_test(_orientation_splits),
+    cmocka_unit_test(_module_order_splits),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -100,6 +100,7 @@
 #include "control/input.h"
 #include "control/control.h"
 #include "control/jobs.h"
+#include "control/jobs/prefetch_jobs.h"
 #include "develop/dev_pixelpipe.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -174,6 +175,13 @@ static dt_iop_module_t *_darkroom_pending_focus_module = NULL;
 static GtkWidget *_darkroom_ioporder_button = NULL;
 static gboolean _darkroom_center_pan_drag = FALSE;
 
+/* Neighbouring images are loaded ahead (control/jobs/prefetch_jobs.h) in the direction the
+ * user last moved: +1 next, -1 previous, 0 after a jump from the filmstrip. It starts once the
+ * current image is rendered, and every edit interrupts it until the render is done again. */
+static int _darkroom_travel = 1;
+static int32_t _darkroom_travel_target = UNKNOWN_IMAGE;
+static gboolean _darkroom_prefetch_pending = FALSE;
+
 static dt_autoset_manager_t *_autoset_manager = NULL;
 static GtkWidget *_darkroom_autoset_button = NULL;
 static GtkWidget *_darkroom_autoset_popover = NULL;
@@ -1201,6 +1209,10 @@ static void _darkroom_image_loaded_callback(gpointer instance, guint request_id,
 
   dt_view_image_info_update(dev->image_storage.id);
 
+  dt_prefetch_claim(dev->image_storage.id);
+  _darkroom_travel_target = UNKNOWN_IMAGE;
+  _darkroom_prefetch_pending = TRUE;
+
   dt_dev_start_all_pipelines(dev);
 }
 
@@ -1247,6 +1259,67 @@ int try_enter(dt_view_t *self)
   return 0;
 }
 
+static void _darkroom_prefetch_neighbours(const int32_t imgid)
+{
+  const int neighbours = dt_prefetch_neighbours();
+  if(neighbours <= 0) return;
+
+  GList *collection = dt_collection_get_all(dt_collection_get_global(), -1);
+  GList *ahead = g_list_find(collection, GINT_TO_POINTER(imgid));
+  GList *behind = ahead;
+  GList *wanted = NULL;
+  int count = 0;
+
+  // Straight on when stepping, alternately on both sides after a jump.
+  while(count < neighbours && ((_darkroom_travel >= 0 && ahead) || (_darkroom_travel <= 0 && behind)))
+  {
+    if(_darkroom_travel >= 0 && ahead && (ahead = g_list_next(ahead)))
+    {
+      wanted = g_list_prepend(wanted, ahead->data);
+      count++;
+    }
+    if(_darkroom_travel <= 0 && behind && count < neighbours && (behind = g_list_previous(behind)))
+    {
+      wanted = g_list_prepend(wanted, behind->data);
+      count++;
+    }
+  }
+  wanted = g_list_reverse(wanted);
+
+  // Only the decoded raw: the filmstrip already has the thumbnails, and one raw is
+  // what fits next to the current image in the full-size mipmap cache.
+  dt_prefetch_images(wanted, DT_MIPMAP_NONE, 1);
+  g_list_free(wanted);
+  g_list_free(collection);
+}
+
+static void _darkroom_prefetch_resume(gpointer instance, gpointer user_data)
+{
+  if(!_darkroom_prefetch_pending) return;
+  _darkroom_prefetch_pending = FALSE;
+  _darkroom_prefetch_neighbours(dt_dev_get_global()->image_storage.id);
+}
+
+static void _darkroom_prefetch_interrupt(gpointer instance, gpointer user_data)
+{
+  // The user is working on this image: give the pipes the CPU back, resume once they are done.
+  // Loading the image we travel to emits this too, don't stop what it waits for.
+  dt_prefetch_cancel(_darkroom_travel_target);
+  _darkroom_prefetch_pending = TRUE;
+}
+
+/**
+ * @brief Remember where the user is going before leaving the current image: the neighbour
+ * being loaded ahead keeps loading if it is that one.
+ */
+static void _darkroom_travel_to(const int32_t imgid, const int direction)
+{
+  _darkroom_travel = direction;
+  _darkroom_travel_target = imgid;
+  _darkroom_prefetch_pending = FALSE;
+  dt_prefetch_cancel(imgid);
+}
+
 static void _dev_change_image(dt_view_t *self, int32_t imgid)
 {
   // Lazy trick to cleanup, reset, reinit, reload everything without
@@ -1264,6 +1337,7 @@ static void _view_darkroom_filmstrip_activate_callback(gpointer instance, int32_
   if(imgid > UNKNOWN_IMAGE)
   {
     // switch images in darkroom mode:
+    _darkroom_travel_to(imgid, 0);
     _dev_change_image(user_data, imgid);
   }
 }
@@ -1441,6 +1515,7 @@ gboolean _switch_to_next_picture(GtkAccelGroup *accel_group, GObject *accelerabl
     int32_t next_img = GPOINTER_TO_INT(current_item->next->data);
     g_list_free(current_collection);
     current_collection = NULL;
+    _darkroom_travel_to(next_img, 1);
     _dev_change_image(data, next_img);
   }
   else
@@ -1466,6 +1541,7 @@ gboolean _switch_to_prev_picture(GtkAccelGroup *accel_group, GObject *accelerabl
     int32_t prev_img = GPOINTER_TO_INT(current_item->prev->data);
     g_list_free(current_collection);
     current_collection = NULL;
+    _darkroom_travel_to(prev_img, -1);
     _dev_change_image(data, prev_img);
   }
   else
@@ -1960,6 +2036,10 @@ void enter(dt_view_t *self)
   /* connect signal for filmstrip image activate */
   DT_DEBUG_CONTROL_SIGNAL_CONNECT(dt_control_signal_get_global(), DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE,
                                   G_CALLBACK(_view_darkroom_filmstrip_activate_callback), self);
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(dt_control_signal_get_global(), DT_SIGNAL_DEVELOP_UI_PIPE_FINISHED,
+                                  G_CALLBACK(_darkroom_prefetch_resume), self);
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(dt_control_signal_get_global(), DT_SIGNAL_DEVELOP_HISTORY_CHANGE,
+                                  G_CALLBACK(_darkroom_prefetch_interrupt), self);
 
   gtk_widget_grab_focus(dt_gui_center_widget()); // ensure the center view has focus for keybindings to work
 
@@ -2045,6 +2125,13 @@ void leave(dt_view_t *self)
   /* disconnect from filmstrip image activate */
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(dt_control_signal_get_global(), G_CALLBACK(_view_darkroom_filmstrip_activate_callback),
   (gpointer)self);
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(dt_control_signal_get_global(), G_CALLBACK(_darkroom_prefetch_resume),
+                                     (gpointer)self);
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(dt_control_signal_get_global(), G_CALLBACK(_darkroom_prefetch_interrupt),
+                                     (gpointer)self);
+  // Switching images goes through here too: spare the image being switched to.
+  dt_prefetch_cancel(_darkroom_travel_target);
+  _darkroom_prefetch_pending = FALSE;
 
   dt_iop_color_picker_cleanup();
 
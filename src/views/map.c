@@ -170,7 +170,7 @@ static void _view_map_drag_set_icon(const dt_view_t *self, GdkDragContext *conte
 /* callback when the collection changes */
 static void _view_map_collection_changed(gpointer instance, dt_collection_change_t query_change,
                                          dt_collection_properties_t changed_property, gpointer imgs, int next,
-                                         gpointer user_data);
+                                         gpointer diff, gpointer user_data);
 /* callback when the selection changes */
 static void _view_map_selection_changed(gpointer instance, gpointer user_data);
 /* callback when images geotags change */
@@ -2541,7 +2541,7 @@ static void _view_map_check_preference_changed(gpointer instance, gpointer user_
 
 static void _view_map_collection_changed(gpointer instance, dt_collection_change_t query_change,
                                          dt_collection_properties_t changed_property, gpointer imgs, int next,
-                                         gpointer user_data)
+                                         gpointer diff, gpointer user_data)
 {
   dt_view_t *self = (dt_view_t *)user_data;
   dt_map_t *lib = (dt_map_t *)self->data;
@@ -44,6 +44,7 @@
 #include "system/dtpthread.h"
 #include "common/conf.h"
 #include "control/control.h"
+#include "control/jobs/prefetch_jobs.h"
 #include "gui/dtgtk/thumbtable.h"
 
 #include "gui/application.h"
@@ -192,6 +193,35 @@ static dt_view_surface_value_t _slideshow_request_slot(dt_slideshow_t *d, const
   return res;
 }
 
+/**
+ * @brief Load ahead the images after the one the next/previous slot already fetches,
+ * in the direction of travel, so holding the arrow key does not outrun the decoder.
+ */
+static void _slideshow_prefetch(dt_slideshow_t *d, const int direction)
+{
+  const int neighbours = dt_prefetch_neighbours();
+  const int32_t current = d->buf[S_CURRENT].imgid;
+  dt_prefetch_claim(current);
+  if(neighbours <= 0 || current <= UNKNOWN_IMAGE) return;
+
+  GList *wanted = NULL;
+  for(int k = 2; k < neighbours + 2; k++)
+  {
+    const int32_t rank = d->buf[S_CURRENT].rank + direction * k;
+    if(rank < 0 || rank >= d->col_count) break;
+    const int32_t imgid = _slideshow_get_imgid_from_rank(d, rank);
+    if(imgid > UNKNOWN_IMAGE) wanted = g_list_prepend(wanted, GINT_TO_POINTER(imgid));
+  }
+  wanted = g_list_reverse(wanted);
+
+  // Same size as dt_view_image_get_surface_async() will ask for, give or take the image ratio.
+  const dt_mipmap_size_t mip
+      = dt_mipmap_cache_get_matching_size(ceilf(MAX(2, (int)d->width) * dt_gui_get_global()->ppd),
+                                          ceilf(MAX(2, (int)d->height) * dt_gui_get_global()->ppd), current);
+  dt_prefetch_images(wanted, mip, 0);
+  g_list_free(wanted);
+}
+
 static gboolean auto_advance(gpointer user_data)
 {
   dt_slideshow_t *d = (dt_slideshow_t *)user_data;
@@ -248,6 +278,7 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
       d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
       d->buf[S_RIGHT].invalidated = d->buf[S_RIGHT].rank < d->col_count;
       _refresh_display(d);
+      _slideshow_prefetch(d, 1);
     }
     else
     {
@@ -269,6 +300,7 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
       d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
       d->buf[S_LEFT].invalidated = d->buf[S_LEFT].rank >= 0;
       _refresh_display(d);
+      _slideshow_prefetch(d, -1);
     }
     else
     {
@@ -433,6 +465,7 @@ void leave(dt_view_t *self)
   d->auto_advance_timeout = 0;
   dt_control_change_cursor(GDK_LEFT_PTR);
   d->auto_advance = FALSE;
+  dt_prefetch_cancel(UNKNOWN_IMAGE);
   dt_accels_disconnect_active_group(dt_gui_get_accels());
 
   dt_selection_clear(dt_selection_get_global());
@@ -26,36 +26,151 @@
 
 #include "system/macros.h"
 #include <math.h>
+#include <string.h>
+#include "widgets/focus_peaking.h"
 #include "widgets/widget_settings.h"
 #include "system/openmp.h"
 #include "system/simd.h"
 
+#include "common/hash.h"
 #include "pixel/eigf.h"
 #include "system/mem_alloc.h"
 #include "math/openmp_maths.h"
 
+// Pixels left out of the sharpness map on each side: the far laplacian reads 6 pixels away.
+#define DT_FOCUSPEAKING_BORDER 8
+
+// Rows of sharpness map computed per band. Each band filters its rows horizontally into a
+// per-thread scratch buffer, with 6 rows of apron above and below, then vertically.
+#define DT_FOCUSPEAKING_BAND 32
+
+// Number of (image, size, history) sharpness maps kept around for redraws.
+#define DT_FOCUSPEAKING_CACHE_SIZE 8
+
+/*
+ * The Laplacian of a Gaussian with sigma = 1.05 we used to convolve as a full 7×7 kernel
+ * is, up to rounding of its 8th decimal, D ⊗ G + G ⊗ D, where G is the 1D gaussian and D its
+ * second derivative (scaled to the original kernel norm). So it is computed as 2 horizontal
+ * and 2 vertical 7-taps passes instead of 49 taps per pixel. Taps are given from the center.
+ */
+static const float _gauss[4] = { 1.00000000e+00f, 6.35390989e-01f, 1.62991218e-01f, 1.68798841e-02f };
+static const float _gauss_dd[4] = { -1.30937164e-01f, -7.73480288e-03f, 5.60882621e-02f, 1.58322788e-02f };
+
+// symmetric 7-taps filter centered on *in, sampled every `stride` elements
+static inline float _tap7(const float *const restrict in, const ptrdiff_t stride, const float taps[4])
+{
+  return taps[0] * in[0]
+         + taps[1] * (in[-stride] + in[stride])
+         + taps[2] * (in[-2 * stride] + in[2 * stride])
+         + taps[3] * (in[-3 * stride] + in[3 * stride]);
+}
+
 __OMP_DECLARE_SIMD__()
 static inline float uint8_to_float(const uint8_t i)
 {
   return (float)i / 255.0f;
 }
 
-int dt_focuspeaking(cairo_t *cr,
-                    uint8_t *const restrict image,
-                    const int buf_width, const int buf_height,
-                    gboolean draw,
-                    float *x, float *y)
+// Sharpness of rows [r0 ; r1[, written in luma_ds. `scratch` holds 4 planes of
+// (r1 - r0 + 12) rows: gaussian and second derivative along x, sampled every 1 (close)
+// and 2 (far) pixels.
+static void _sharpness_band(const float *const restrict luma, float *const restrict luma_ds,
+                            float *const restrict scratch, const size_t width, const size_t r0,
+                            const size_t r1, float *mass, float *x_integral, float *y_integral)
 {
-  float *const restrict luma = dt_alloc_align(sizeof(float) * (size_t)buf_width * buf_height);
-  float *const restrict luma_ds = dt_alloc_align(sizeof(float) * (size_t)buf_width * buf_height);
-  uint8_t *restrict focus_peaking = NULL;
-  int err = 0;
-  if(IS_NULL_PTR(luma_ds) || IS_NULL_PTR(luma))
+  const size_t first = DT_FOCUSPEAKING_BORDER;
+  const size_t last = width - DT_FOCUSPEAKING_BORDER;
+  const size_t rows = r1 - r0 + 12;
+  float *const restrict gauss_close = scratch;
+  float *const restrict dd_close = scratch + rows * width;
+  float *const restrict gauss_far = scratch + 2 * rows * width;
+  float *const restrict dd_far = scratch + 3 * rows * width;
+
+  // Horizontal passes, over the band and its apron
+  for(size_t k = 0; k < rows; k++)
   {
-    err = 1;
-    goto error_early;
+    const float *const restrict in = luma + (r0 - 6 + k) * width;
+    const size_t offset = k * width;
+    __OMP_SIMD__()
+    for(size_t j = first; j < last; j++)
+    {
+      gauss_close[offset + j] = _tap7(in + j, 1, _gauss);
+      dd_close[offset + j] = _tap7(in + j, 1, _gauss_dd);
+      gauss_far[offset + j] = _tap7(in + j, 2, _gauss);
+      dd_far[offset + j] = _tap7(in + j, 2, _gauss_dd);
+    }
   }
 
+  // Vertical passes, TV and sharpness
+  for(size_t i = r0; i < r1; i++)
+  {
+    const size_t offset = (i - r0 + 6) * width;
+    const ptrdiff_t stride = width;
+    const float *const restrict l = luma + i * width;
+    float *const restrict out = luma_ds + i * width;
+    float row_mass = 0.f;
+    float row_x = 0.f;
+
+    __OMP_SIMD__(reduction(+:row_mass, row_x))
+    for(size_t j = first; j < last; j++)
+    {
+      // The close laplacian is the local-local contrast
+      // The far laplacian is the far local contrast, sampled 2 times farther in an a-trous fashion.
+      // If far / 2 = close, we are on a slowly-varying gradient, aka on a contrasted edge that is not sharp.
+      const float laplacian_close = _tap7(dd_close + offset + j, stride, _gauss)
+                                    + _tap7(gauss_close + offset + j, stride, _gauss_dd);
+      const float laplacian_far = _tap7(dd_far + offset + j, 2 * stride, _gauss)
+                                  + _tap7(gauss_far + offset + j, 2 * stride, _gauss_dd);
+
+      const float *const restrict c = l + j;
+
+      // gradient on principal directions
+      const float gradient_1_y = (c[-2 * stride] - c[2 * stride]) / 4.f;
+      const float gradient_1_x = (c[-2] - c[2]) / 4.f;
+      const float TV_1 = dt_fast_hypotf(gradient_1_x, gradient_1_y);
+
+      // gradient on diagonals
+      const float gradient_2_y = (c[-2 * stride - 2] - c[2 * stride + 2]) / (2.f * sqrtf(2.f));
+      const float gradient_2_x = (c[-2 * stride + 2] - c[2 * stride - 2]) / (2.f * sqrtf(2.f));
+      const float TV_2 = dt_fast_hypotf(gradient_2_x, gradient_2_y);
+
+      // gradient on principal directions
+      const float gradient_3_y = (c[-stride] - c[stride]) / 2.f;
+      const float gradient_3_x = (c[-1] - c[1]) / 2.f;
+      const float TV_3 = dt_fast_hypotf(gradient_3_x, gradient_3_y);
+
+      // gradient on diagonals
+      const float gradient_4_y = (c[-stride - 1] - c[stride + 1]) / (sqrtf(2.f));
+      const float gradient_4_x = (c[-stride + 1] - c[stride - 1]) / (sqrtf(2.f));
+      const float TV_4 = dt_fast_hypotf(gradient_4_x, gradient_4_y);
+
+      // Total Variation = norm(grad_x, grad_y). We use it as a metric of global contrast since it doesn't use the current pixel.
+      // Laplacian = div(grad). We use it as a metric of local contrast, aka difference with current pixel and local average value.
+      // The ratio of both is meant to catch local contrast NOT correlated with global contrast, aka sharp edges.
+      // The TV is averaged from both directions, its coeff is made-up to balance local contrast detection.
+      const float TV = 100.f * (TV_1 + TV_2 + TV_3 + TV_4) / 4.f;
+      const float sharpness = (laplacian_close > 1e-15f)
+                                  ? fmaxf(fabsf(laplacian_close) - 0.5f * fabsf(laplacian_far), 0.f) / (TV + 1.f)
+                                  : 0.f;
+      out[j] = sharpness;
+
+      // Compute the mass and integrals over x and y
+      row_mass += sharpness;
+      row_x += (float)j * sharpness;
+    }
+
+    *mass += row_mass;
+    *x_integral += row_x;
+    *y_integral += (float)i * row_mass;
+  }
+}
+
+// Fill luma_ds with the sharpness map of `image` and get the details barycenter.
+// luma is used as the prefiltered luminance buffer.
+static int _sharpness_map(const uint8_t *const restrict image, float *const restrict luma,
+                          float *const restrict luma_ds, const int buf_width, const int buf_height,
+                          float *x, float *y)
+{
   const size_t npixels = (size_t)buf_height * buf_width;
   // Create a luma buffer as the euclidian norm of RGB channels
   __OMP_PARALLEL_FOR_SIMD__(aligned(image, luma:64))
@@ -73,140 +188,80 @@ int dt_focuspeaking(cairo_t *cr,
 
   // Prefilter noise
   if(fast_eigf_surface_blur(luma, buf_width, buf_height, 12, 0.00005f, 4, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f), 1.0f) != 0)
-  {
-    err = 1;
-    goto error_early;
-  }
+    return 1;
+
+  // ensure defined value for borders
+  memset(luma_ds, 0, sizeof(float) * npixels);
 
-  // Compute the laplacian of a gaussian
   float mass = 0.f;
   float x_integral = 0.f;
   float y_integral = 0.f;
-  __OMP_PARALLEL_FOR__(collapse(2) reduction(+:mass, x_integral, y_integral))
-  for(size_t i = 0; i < buf_height; ++i)
-    for(size_t j = 0; j < buf_width; ++j)
+
+  if(buf_width > 2 * DT_FOCUSPEAKING_BORDER && buf_height > 2 * DT_FOCUSPEAKING_BORDER)
+  {
+    const size_t width = buf_width;
+    const size_t first = DT_FOCUSPEAKING_BORDER;
+    const size_t last = buf_height - DT_FOCUSPEAKING_BORDER;
+    const size_t bands = (last - first + DT_FOCUSPEAKING_BAND - 1) / DT_FOCUSPEAKING_BAND;
+    int err = 0;
+
+    __OMP_PARALLEL__(reduction(+:mass, x_integral, y_integral, err))
     {
-      size_t index = i * buf_width + j;
-      if(i < 8 || i >= buf_height - 8 || j < 8 || j > buf_width - 8)
-      {
-        // ensure defined value for borders
-        luma_ds[index] = 0.0f;
-      }
-      else
+      float *const restrict scratch = dt_alloc_align_float((size_t)4 * (DT_FOCUSPEAKING_BAND + 12) * width);
+      if(IS_NULL_PTR(scratch)) err++;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for(size_t band = 0; band < bands; band++)
       {
-        // Laplacian of a Gaussian kernel with sigma = 1.05
-        static const float kernel[7][7]
-            = { { 0.00053449f, 0.00352729f,  0.00992912f,  0.01362207f,  0.00992912f, 0.00352729f, 0.00053449f },
-                { 0.00352729f, 0.01828379f,  0.03437727f,  0.03474665f,  0.03437727f, 0.01828379f, 0.00352729f },
-                { 0.00992912f, 0.03437727f, -0.00982925f, -0.09093110f, -0.00982925f, 0.03437727f, 0.00992912f },
-                { 0.01362207f, 0.03474665f, -0.09093110f, -0.26187433f, -0.09093110f, 0.03474665f, 0.01362207f },
-                { 0.00992912f, 0.03437727f, -0.00982925f, -0.09093110f, -0.00982925f, 0.03437727f, 0.00992912f },
-                { 0.00352729f, 0.01828379f,  0.03437727f,  0.03474665f,  0.03437727f, 0.01828379f, 0.00352729f },
-                { 0.00053449f, 0.00352729f,  0.00992912f,  0.01362207f,  0.00992912f, 0.00352729f, 0.00053449f } };
-
-        // The close laplacian is the local-local contrast
-        // The far laplacian is the far local contrast, sampled 2 times farther in an a-trous fashion.
-        // If far / 2 = close, we are on a slowly-varying gradient, aka on a contrasted edge that is not sharp.
-        float laplacian_close = 0.f;
-        float laplacian_far = 0.f;
-
-        for(int ii = 0; ii < 7; ii++)
-          for(int jj = 0; jj < 7; jj++)
-          {
-            laplacian_close += luma[(i - 3 + ii) * buf_width + (j - 3 + jj)] * kernel[ii][jj];
-            laplacian_far += luma[(i + (-3 + ii) * 2) * buf_width + (j + (-3 + jj) * 2)] * kernel[ii][jj];
-          }
-
-        // gradient on principal directions
-        const float gradient_1_y = (luma[(i - 2) * buf_width + (j)] - luma[(i + 2) * buf_width + (j)]) / 4.f;
-        const float gradient_1_x = (luma[(i) * buf_width + (j - 2)] - luma[(i) * buf_width + (j + 2)]) / 4.f;
-        const float TV_1 = dt_fast_hypotf(gradient_1_x, gradient_1_y);
-
-        // gradient on diagonals
-        const float gradient_2_y = (luma[(i - 2) * buf_width + (j - 2)] - luma[(i + 2) * buf_width + (j + 2)]) / (2.f * sqrtf(2.f));
-        const float gradient_2_x = (luma[(i - 2) * buf_width + (j + 2)] - luma[(i + 2) * buf_width + (j - 2)]) / (2.f * sqrtf(2.f));
-        const float TV_2 = dt_fast_hypotf(gradient_2_x, gradient_2_y);
-
-        // gradient on principal directions
-        const float gradient_3_y = (luma[(i - 1) * buf_width + (j)] - luma[(i + 1) * buf_width + (j)]) / 2.f;
-        const float gradient_3_x = (luma[(i) * buf_width + (j - 1)] - luma[(i) * buf_width + (j + 1)]) / 2.f;
-        const float TV_3 = dt_fast_hypotf(gradient_3_x, gradient_3_y);
-
-        // gradient on diagonals
-        const float gradient_4_y = (luma[(i - 1) * buf_width + (j - 1)] - luma[(i + 1) * buf_width + (j + 1)]) / (sqrtf(2.f));
-        const float gradient_4_x = (luma[(i - 1) * buf_width + (j + 1)] - luma[(i + 1) * buf_width + (j - 1)]) / (sqrtf(2.f));
-        const float TV_4 = dt_fast_hypotf(gradient_4_x, gradient_4_y);
-
-        // Total Variation = norm(grad_x, grad_y). We use it as a metric of global contrast since it doesn't use the current pixel.
-        // Laplacian = div(grad). We use it as a metric of local contrast, aka difference with current pixel and local average value.
-        // The ratio of both is meant to catch local contrast NOT correlated with global contrast, aka sharp edges.
-        // The TV is averaged from both directions, its coeff is made-up to balance local contrast detection.
-        const float TV = 100.f * (TV_1 + TV_2 + TV_3 + TV_4) / 4.f;
-        luma_ds[index] = (laplacian_close > 1e-15f) ? fmaxf(fabsf(laplacian_close) - 0.5f * fabsf(laplacian_far), 0.f) / (TV + 1.f) : 0.f;
-
-        // Compute the mass and integrals over x and y
-        mass += luma_ds[index];
-        x_integral += ((float)j) * luma_ds[index];
-        y_integral += ((float)i) * luma_ds[index];
+        if(IS_NULL_PTR(scratch)) continue;
+        const size_t r0 = first + band * DT_FOCUSPEAKING_BAND;
+        const size_t r1 = MIN(r0 + DT_FOCUSPEAKING_BAND, last);
+        _sharpness_band(luma, luma_ds, scratch, width, r0, r1, &mass, &x_integral, &y_integral);
       }
+
+      dt_free_align(scratch);
     }
 
+    if(err) return 1;
+  }
+
   // Compute the coordinates of the details barycenter
-  if(x) *x = CLAMP(x_integral / mass, 0, buf_height);
-  if(y) *y = CLAMP(y_integral / mass, 0, buf_height);
+  if(x) *x = (mass > 0.f) ? CLAMP(x_integral / mass, 0, buf_width) : 0.f;
+  if(y) *y = (mass > 0.f) ? CLAMP(y_integral / mass, 0, buf_height) : 0.f;
 
-  // Stop there if no drawing is requested
-  if(!draw)
-  {
-    dt_free_align(luma);
-    dt_free_align(luma_ds);
-    return 0;
-  }
+  return 0;
+}
 
-  // Plain aligned allocation: this is a transient GUI overlay buffer, not pipeline memory,
-  // so it has no business being charged against the pixelpipe cache budget.
-  focus_peaking = dt_alloc_align(sizeof(uint8_t) * buf_width * buf_height * 4);
-  if(IS_NULL_PTR(focus_peaking))
-  {
-    err = 1;
-    goto error;
-  }
+// Turn the sharpness map into a BGRA overlay. luma is reused as scratch.
+static uint8_t *_sharpness_overlay(float *const restrict luma, const float *const restrict luma_ds,
+                                   const int buf_width, const int buf_height)
+{
+  if(buf_width <= 2 * DT_FOCUSPEAKING_BORDER || buf_height <= 2 * DT_FOCUSPEAKING_BORDER)
+    return NULL;
 
-  // Dilate the mask to improve connectivity
-  __OMP_PARALLEL_FOR__(collapse(2))
-  for(size_t i = 0; i < buf_height; ++i)
-    for(size_t j = 0; j < buf_width; ++j)
-    {
-      size_t index = i * buf_width + j;
-      if(i < 8 || i >= buf_height - 8 || j < 8 || j > buf_width - 8)
-      {
-        // ensure defined value for borders
-        luma[index] = 0.0f;
-      }
-      else
-      {
-        // Dilating kernel
-        static const float kernel[3][3] = { { 1.f } };
-        luma[index] = 0.f;
-        for(int ii = 0; ii < 3; ii++)
-          for(int jj = 0; jj < 3; jj++)
-            luma[index] += luma_ds[(i - 1 + ii) * buf_width + (j - 1 + jj)] * kernel[ii][jj];
-      }
-    }
+  // Plain aligned allocation: this is a GUI overlay buffer, not pipeline memory,
+  // so it has no business being charged against the pixelpipe cache budget.
+  uint8_t *const restrict focus_peaking = dt_alloc_align(sizeof(uint8_t) * buf_width * buf_height * 4);
+  if(IS_NULL_PTR(focus_peaking)) return NULL;
+
+  // The former "dilating" 3×3 kernel had only its top-left tap set,
+  // so this is just the map shifted by one pixel on both directions.
+  memset(luma, 0, sizeof(float) * buf_width * buf_height);
+  __OMP_PARALLEL_FOR__()
+  for(size_t i = DT_FOCUSPEAKING_BORDER; i < buf_height - DT_FOCUSPEAKING_BORDER; ++i)
+    memcpy(luma + i * buf_width + DT_FOCUSPEAKING_BORDER,
+           luma_ds + (i - 1) * buf_width + DT_FOCUSPEAKING_BORDER - 1,
+           sizeof(float) * (buf_width - 2 * DT_FOCUSPEAKING_BORDER));
 
   // Anti-aliasing
   if(dt_box_mean(luma, buf_height, buf_width, 1, 3, 1) != 0)
-  {
-    err = 1;
     goto error;
-  }
 
   // Postfilter to connect isolated dots and draw lines
   if(fast_eigf_surface_blur(luma, buf_width, buf_height, 12, 0.000005f, 1, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f), 1.0f) != 0)
-  {
-    err = 1;
     goto error;
-  }
 
   // Compute the laplacian mean over the picture
   float TV_sum = 0.0f;
@@ -217,7 +272,7 @@ int dt_focuspeaking(cairo_t *cr,
 
   // Compute the standard deviation
   float sigma = 0.0f;
-  __OMP_PARALLEL_FOR_SIMD__(collapse(2) aligned(focus_peaking, luma:64) reduction(+:sigma))
+  __OMP_PARALLEL_FOR_SIMD__(collapse(2) aligned(luma:64) reduction(+:sigma))
   for(size_t i = 8; i < buf_height - 8; ++i)
     for(size_t j = 8; j < buf_width - 8; ++j)
        sigma += sqf(luma[i * buf_width + j] - TV_sum) / ((float)(buf_height - 16) * (float)(buf_width - 16));
@@ -263,7 +318,15 @@ int dt_focuspeaking(cairo_t *cr,
       }
     }
 
-  // draw the focus peaking overlay
+  return focus_peaking;
+
+error:
+  dt_free_align(focus_peaking);
+  return NULL;
+}
+
+static void _paint_overlay(cairo_t *cr, uint8_t *focus_peaking, const int buf_width, const int buf_height)
+{
   cairo_save(cr);
   cairo_rectangle(cr, 0, 0, buf_width, buf_height);
   cairo_surface_t *surface = cairo_image_surface_create_for_data((unsigned char *)focus_peaking,
@@ -275,14 +338,182 @@ int dt_focuspeaking(cairo_t *cr,
   cairo_pattern_set_filter(cairo_get_source (cr), dt_widget_image_filter());
   cairo_fill(cr);
   cairo_restore(cr);
-
-  // cleanup
   cairo_surface_destroy(surface);
+}
+
+// Compute the barycenter, and the overlay if `overlay` is not NULL.
+static int _focuspeaking_compute(const uint8_t *const restrict image, const int buf_width, const int buf_height,
+                                 float *x, float *y, uint8_t **overlay)
+{
+  float *const restrict luma = dt_alloc_align_float((size_t)buf_width * buf_height);
+  float *const restrict luma_ds = dt_alloc_align_float((size_t)buf_width * buf_height);
+  int err = 0;
+
+  if(IS_NULL_PTR(luma_ds) || IS_NULL_PTR(luma)
+     || _sharpness_map(image, luma, luma_ds, buf_width, buf_height, x, y) != 0)
+  {
+    err = 1;
+  }
+  else if(overlay)
+  {
+    *overlay = _sharpness_overlay(luma, luma_ds, buf_width, buf_height);
+    // Images too small to have a sharpness map simply get no overlay
+    if(IS_NULL_PTR(*overlay) && buf_width > 2 * DT_FOCUSPEAKING_BORDER
+       && buf_height > 2 * DT_FOCUSPEAKING_BORDER)
+      err = 1;
+  }
 
-error:
-  dt_free_align(focus_peaking);
-error_early:
   dt_free_align(luma);
   dt_free_align(luma_ds);
   return err;
 }
+
+int dt_focuspeaking(cairo_t *cr,
+                    uint8_t *const restrict image,
+                    const int buf_width, const int buf_height,
+                    gboolean draw,
+                    float *x, float *y)
+{
+  uint8_t *focus_peaking = NULL;
+  if(_focuspeaking_compute(image, buf_width, buf_height, x, y, draw ? &focus_peaking : NULL) != 0)
+    return 1;
+
+  if(focus_peaking)
+  {
+    _paint_overlay(cr, focus_peaking, buf_width, buf_height);
+    dt_free_align(focus_peaking);
+  }
+  return 0;
+}
+
+
+/* Cache of the sharpness results, so redrawing or re-zooming the same thumbnail doesn't
+ * recompute them. Entries are keyed by image, history and buffer size, plus a fingerprint of
+ * a few rows of the buffer: the mipmap of an unedited image can be replaced by a processed
+ * one of the same size without its history changing (embedded JPEG vs. rendered thumbnail).
+ * An entry stays alive while a thread paints its overlay, even if it gets evicted meanwhile.
+ */
+typedef struct dt_focuspeaking_map_t
+{
+  int32_t imgid;
+  uint64_t history_hash;
+  uint64_t fingerprint;
+  int width, height;
+  float x, y;
+  uint8_t *overlay; // NULL until the overlay has been requested once
+  int refs;
+  uint64_t last_use;
+} dt_focuspeaking_map_t;
+
+static GMutex _cache_lock;
+static dt_focuspeaking_map_t *_cache[DT_FOCUSPEAKING_CACHE_SIZE] = { NULL };
+static uint64_t _cache_clock = 0;
+
+// Call with _cache_lock held
+static void _map_unref(dt_focuspeaking_map_t *map)
+{
+  if(IS_NULL_PTR(map) || --map->refs > 0) return;
+  dt_free_align(map->overlay);
+  dt_free(map);
+}
+
+static uint64_t _fingerprint(const uint8_t *const image, const int buf_width, const int buf_height)
+{
+  const size_t stride = (size_t)buf_width * 4;
+  const int samples = MIN(buf_height, 16);
+  uint64_t hash = 5381;
+  for(int k = 0; k < samples; k++)
+  {
+    const size_t row = (samples > 1) ? (size_t)k * (buf_height - 1) / (samples - 1) : 0;
+    hash = dt_hash(hash, (const char *)image + row * stride, stride);
+  }
+  return hash;
+}
+
+int dt_focuspeaking_cached(cairo_t *cr, uint8_t *const restrict image, const int buf_width,
+                           const int buf_height, gboolean draw, const int32_t imgid,
+                           const uint64_t history_hash, float *x, float *y)
+{
+  if(imgid <= 0) return dt_focuspeaking(cr, image, buf_width, buf_height, draw, x, y);
+
+  const uint64_t fingerprint = _fingerprint(image, buf_width, buf_height);
+  dt_focuspeaking_map_t *hit = NULL;
+
+  g_mutex_lock(&_cache_lock);
+  for(int k = 0; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+  {
+    dt_focuspeaking_map_t *map = _cache[k];
+    if(map && map->imgid == imgid && map->history_hash == history_hash && map->fingerprint == fingerprint
+       && map->width == buf_width && map->height == buf_height && (!draw || map->overlay))
+    {
+      map->refs++;
+      map->last_use = ++_cache_clock;
+      hit = map;
+      break;
+    }
+  }
+  g_mutex_unlock(&_cache_lock);
+
+  if(hit)
+  {
+    if(x) *x = hit->x;
+    if(y) *y = hit->y;
+    if(draw) _paint_overlay(cr, hit->overlay, buf_width, buf_height);
+
+    g_mutex_lock(&_cache_lock);
+    _map_unref(hit);
+    g_mutex_unlock(&_cache_lock);
+    return 0;
+  }
+
+  dt_focuspeaking_map_t *map = g_new0(dt_focuspeaking_map_t, 1);
+  map->imgid = imgid;
+  map->history_hash = history_hash;
+  map->fingerprint = fingerprint;
+  map->width = buf_width;
+  map->height = buf_height;
+  map->refs = 1;
+
+  if(_focuspeaking_compute(image, buf_width, buf_height, &map->x, &map->y, draw ? &map->overlay : NULL) != 0)
+  {
+    dt_free_align(map->overlay);
+    dt_free(map);
+    return 1;
+  }
+
+  if(x) *x = map->x;
+  if(y) *y = map->y;
+  if(map->overlay) _paint_overlay(cr, map->overlay, buf_width, buf_height);
+
+  // Store it in place of the same key (computed without overlay, or by a concurrent thread),
+  // else of the least recently used entry.
+  g_mutex_lock(&_cache_lock);
+  int slot = 0;
+  for(int k = 0; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+  {
+    const dt_focuspeaking_map_t *other = _cache[k];
+    if(IS_NULL_PTR(other) || (other->imgid == imgid && other->width == buf_width && other->height == buf_height))
+    {
+      slot = k;
+      break;
+    }
+    if(other->last_use < _cache[slot]->last_use) slot = k;
+  }
+  _map_unref(_cache[slot]);
+  map->last_use = ++_cache_clock;
+  _cache[slot] = map;
+  g_mutex_unlock(&_cache_lock);
+
+  return 0;
+}
+
+void dt_focuspeaking_cache_clear(void)
+{
+  g_mutex_lock(&_cache_lock);
+  for(int k = 0; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+  {
+    _map_unref(_cache[k]);
+    _cache[k] = NULL;
+  }
+  g_mutex_unlock(&_cache_lock);
+}
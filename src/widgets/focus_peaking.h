@@ -34,6 +34,19 @@ G_BEGIN_DECLS
 int dt_focuspeaking(cairo_t *cr, uint8_t *const restrict image, const int buf_width,
                     const int buf_height, gboolean draw, float *x, float *y);
 
+/**
+ * @brief Same as dt_focuspeaking(), reusing the sharpness overlay and details barycenter
+ * computed for the same image, history and buffer, if any.
+ *
+ * @details Results are kept for the last few buffers seen. Pass imgid <= 0 to bypass the cache.
+ */
+int dt_focuspeaking_cached(cairo_t *cr, uint8_t *const restrict image, const int buf_width,
+                           const int buf_height, gboolean draw, const int32_t imgid,
+                           const uint64_t history_hash, float *x, float *y);
+
+/** @brief Drop all the cached sharpness results. */
+void dt_focuspeaking_cache_clear(void);
+
 G_END_DECLS
 
 #endif // DT_WIDGETS_FOCUS_PEAKING_H
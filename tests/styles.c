@@ -17,11 +17,15 @@
 */
 
 #include "darktable.h"
+#include "caches/image_cache.h"
 #include "database/database.h"
 #include "common/film.h"
 #include "common/history_actions.h"
 #include "common/image.h"
 #include "common/styles.h"
+#include "develop/develop.h"
+#include "develop/dev_history.h"
+#include "system/openmp.h"
 
 #include <assert.h>
 #include <gio/gio.h>
@@ -328,6 +332,426 @@ static int apply_style_to_image(const char *scenario, const char *style_name, co
              : 0;
 }
 
+/**
+ * @brief Number of main.history and main.masks_history rows found for only one of two images,
+ * plus one when their history_end differ.
+ */
+static int history_rows_differ(const int32_t actual_imgid, const int32_t expected_imgid)
+{
+  return sql_int_for_bound_images(
+      "WITH actual AS ("
+      "  SELECT num, module, operation, op_params, enabled, blendop_params, blendop_version,"
+      "         multi_priority, IFNULL(multi_name, '')"
+      "  FROM main.history WHERE imgid=?1"
+      "), expected AS ("
+      "  SELECT num, module, operation, op_params, enabled, blendop_params, blendop_version,"
+      "         multi_priority, IFNULL(multi_name, '')"
+      "  FROM main.history WHERE imgid=?2"
+      "), actual_masks AS ("
+      "  SELECT num, formid, form, name, version, points, points_count, source"
+      "  FROM main.masks_history WHERE imgid=?1"
+      "), expected_masks AS ("
+      "  SELECT num, formid, form, name, version, points, points_count, source"
+      "  FROM main.masks_history WHERE imgid=?2"
+      ")"
+      "SELECT"
+      "  (SELECT COUNT(*) FROM (SELECT * FROM actual EXCEPT SELECT * FROM expected))"
+      "  +"
+      "  (SELECT COUNT(*) FROM (SELECT * FROM expected EXCEPT SELECT * FROM actual))"
+      "  +"
+      "  (SELECT COUNT(*) FROM (SELECT * FROM actual_masks EXCEPT SELECT * FROM expected_masks))"
+      "  +"
+      "  (SELECT COUNT(*) FROM (SELECT * FROM expected_masks EXCEPT SELECT * FROM actual_masks))"
+      "  +"
+      "  ((SELECT history_end FROM main.images WHERE id=?1)"
+      "   != (SELECT history_end FROM main.images WHERE id=?2))",
+      actual_imgid, expected_imgid);
+}
+
+static int compare_full_history(const char *scenario, const int32_t actual_imgid, const int32_t expected_imgid,
+                                char **failure_reason)
+{
+  // Unlike the XMP fixtures, two images taking the same style from the same start must end up
+  // with the very same history, params included.
+  const int diff = history_rows_differ(actual_imgid, expected_imgid);
+
+  if(!diff) return 0;
+
+  test_fail(scenario, "history differs from the style applied image by image", failure_reason);
+  print_enabled_state_summary("actual", actual_imgid);
+  print_enabled_state_summary("expected", expected_imgid);
+  return 1;
+}
+
+static void set_test_image_orientation(const int32_t imgid, const dt_image_orientation_t orientation)
+{
+  dt_image_t *img = dt_image_cache_get(imgid, 'w');
+  if(IS_NULL_PTR(img)) return;
+  img->orientation = orientation;
+  dt_image_cache_write_release(img, DT_IMAGE_CACHE_RELAXED);
+}
+
+#define FLIP_V1_STYLE "prepared_flip_v1"
+
+/**
+ * @brief Import, once, a generated style holding a legacy (v1) flip item.
+ *
+ * Its conversion to v2 reads the image orientation, so the source stack of the style depends
+ * on the image: images with different orientations get different source stacks.
+ *
+ * @return the style id, 0 on failure.
+ */
+static int import_flip_v1_style(const char *scenario, char **failure_reason)
+{
+  int style_id = dt_styles_get_id_by_name(FLIP_V1_STYLE);
+  if(style_id) return style_id;
+
+  char *style_path = g_build_filename(test_image_dir, FLIP_V1_STYLE ".dtstyle", NULL);
+  const char *style_xml
+      = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<darktable_style version=\"1.0\"><info><name>" FLIP_V1_STYLE "</name><description></description>"
+        "</info><style><plugin><num>0</num><module>1</module><operation>flip</operation>"
+        "<op_params>01000000</op_params><enabled>1</enabled><blendop_params></blendop_params>"
+        "<blendop_version>0</blendop_version><multi_priority>0</multi_priority><multi_name></multi_name>"
+        "</plugin></style></darktable_style>\n";
+
+  if(!g_file_set_contents(style_path, style_xml, -1, NULL))
+  {
+    dt_free(style_path);
+    test_fail(scenario, "could not write the style", failure_reason);
+    return 0;
+  }
+  dt_styles_import_from_file(style_path);
+  dt_free(style_path);
+
+  style_id = dt_styles_get_id_by_name(FLIP_V1_STYLE);
+  if(style_id == 0) test_fail(scenario, "imported style is missing from the database", failure_reason);
+  return style_id;
+}
+
+/**
+ * @brief Apply a style through one prepared style to images differing only by their EXIF
+ * orientation, and check each history against the same style applied to that image alone.
+ *
+ * A source stack shared between both orientations would give one of them the wrong flip.
+ */
+static int run_prepared_orientation_check(const char *source_image_path)
+{
+  const char *scenario = "prepared_flip_v1";
+  char *failure_reason = NULL;
+  int result = 1;
+
+  printf("\n[STEP] %s\n", scenario);
+
+  dt_styles_prepared_t *prepared = NULL;
+  int32_t imgids[4] = { 0 };
+  const int style_id = import_flip_v1_style(scenario, &failure_reason);
+  if(style_id == 0) goto end;
+
+  // upright and rotated through the prepared style, then each one alone
+  for(int k = 0; k < 4; k++)
+  {
+    imgids[k] = create_test_image(source_image_path);
+    if(imgids[k] <= 0)
+    {
+      test_fail(scenario, "could not import test image", &failure_reason);
+      goto end;
+    }
+  }
+  set_test_image_orientation(imgids[0], ORIENTATION_NONE);
+  set_test_image_orientation(imgids[1], ORIENTATION_ROTATE_CW_90_DEG);
+  set_test_image_orientation(imgids[2], ORIENTATION_NONE);
+  set_test_image_orientation(imgids[3], ORIENTATION_ROTATE_CW_90_DEG);
+
+  dt_conf_set_bool("history/copy_iop_order", FALSE);
+  dt_conf_set_bool("history/paste_instances", TRUE);
+
+  prepared = dt_styles_prepare(FLIP_V1_STYLE, style_id, DT_HISTORY_MERGE_APPEND);
+  if(IS_NULL_PTR(prepared)
+     || dt_styles_prepared_apply_to_image(prepared, imgids[0], NULL)
+     || dt_styles_prepared_apply_to_image(prepared, imgids[1], NULL)
+     || dt_styles_apply_to_image_merge(FLIP_V1_STYLE, style_id, imgids[2], DT_HISTORY_MERGE_APPEND, NULL)
+     || dt_styles_apply_to_image_merge(FLIP_V1_STYLE, style_id, imgids[3], DT_HISTORY_MERGE_APPEND, NULL))
+  {
+    test_fail(scenario, "style application failed", &failure_reason);
+    goto end;
+  }
+
+  if(compare_full_history(scenario, imgids[0], imgids[2], &failure_reason)) goto end;
+  if(compare_full_history(scenario, imgids[1], imgids[3], &failure_reason)) goto end;
+
+  printf("[OK] %s\n", scenario);
+  result = 0;
+
+end:
+  dt_styles_prepared_free(prepared);
+  printf("%s.dtstyle: %s", scenario, result ? "FAILED" : "PASSED");
+  if(result) printf(" - %s", failure_reason ? failure_reason : "unknown failure");
+  printf("\n");
+  dt_free(failure_reason);
+  return result;
+}
+
+#define BATCH_IMAGES 4
+
+// Orientations of the batch: two images share each source stack of the first, the last has its own.
+static const dt_image_orientation_t batch_orientations[BATCH_IMAGES]
+    = { ORIENTATION_NONE, ORIENTATION_ROTATE_CW_90_DEG, ORIENTATION_NONE, ORIENTATION_ROTATE_CCW_90_DEG };
+
+static int batch_report_calls = 0;
+static GThread *batch_report_thread = NULL;
+
+// Stands for the GUI report: accepts, and records that it was asked, and from where.
+static gboolean batch_report_accept(struct dt_develop_t *dev_dest, struct dt_develop_t *dev_src,
+                                    const gboolean merge_iop_order, const gboolean used_source_order,
+                                    const dt_history_merge_strategy_t strategy, GHashTable *src_last_by_id,
+                                    GHashTable *dst_last_before_by_id, const GHashTable *orig_ids,
+                                    const GHashTable *mod_list_ids, const char *source_label,
+                                    dt_hm_batch_state_t *batch)
+{
+  g_atomic_int_inc(&batch_report_calls);
+  if(g_thread_self() != batch_report_thread) batch_report_thread = NULL;
+  return FALSE;
+}
+
+static int import_batch_images(const char *scenario, const char *source_image_path, int32_t *imgids,
+                               char **failure_reason)
+{
+  for(int k = 0; k < BATCH_IMAGES; k++)
+  {
+    imgids[k] = create_test_image(source_image_path);
+    if(imgids[k] <= 0) return test_fail(scenario, "could not import test image", failure_reason);
+    set_test_image_orientation(imgids[k], batch_orientations[k]);
+  }
+  return 0;
+}
+
+/**
+ * @brief Apply a prepared style to a batch of images concurrently, and check each history
+ * against the same style applied to that image alone.
+ *
+ * The batch runs twice. First with no report handler, as ansel-cli does: every image is merged
+ * by the workers. Then with a handler and a settled batch whose cached order applies to none of
+ * the images: the workers must not accept these merges in the report's place, they defer them,
+ * and every image is merged again from the calling thread, after the report was asked.
+ */
+static int run_prepared_batch_check(const char *source_image_path)
+{
+  const char *scenario = "prepared_batch";
+  char *failure_reason = NULL;
+  int result = 1;
+
+  printf("\n[STEP] %s\n", scenario);
+
+  dt_styles_prepared_t *prepared = NULL;
+  dt_hm_batch_state_t batch = { .decision = DT_HM_BATCH_UNDECIDED };
+  int32_t expected[BATCH_IMAGES] = { 0 };
+  int32_t headless[BATCH_IMAGES] = { 0 };
+  int32_t deferred[BATCH_IMAGES] = { 0 };
+
+#ifdef _OPENMP
+  // The runner is started with one thread: make the batch actually concurrent.
+  omp_set_num_threads(4);
+#endif
+
+  const int style_id = import_flip_v1_style(scenario, &failure_reason);
+  if(style_id == 0) goto end;
+
+  if(import_batch_images(scenario, source_image_path, expected, &failure_reason)
+     || import_batch_images(scenario, source_image_path, headless, &failure_reason)
+     || import_batch_images(scenario, source_image_path, deferred, &failure_reason))
+    goto end;
+
+  dt_conf_set_bool("history/copy_iop_order", FALSE);
+  dt_conf_set_bool("history/paste_instances", TRUE);
+
+  for(int k = 0; k < BATCH_IMAGES; k++)
+    if(dt_styles_apply_to_image_merge(FLIP_V1_STYLE, style_id, expected[k], DT_HISTORY_MERGE_APPEND, NULL))
+    {
+      test_fail(scenario, "style application failed", &failure_reason);
+      goto end;
+    }
+
+  prepared = dt_styles_prepare(FLIP_V1_STYLE, style_id, DT_HISTORY_MERGE_APPEND);
+  if(IS_NULL_PTR(prepared)
+     || dt_styles_prepared_apply_to_images(prepared, headless, BATCH_IMAGES, &batch, FALSE) != BATCH_IMAGES)
+  {
+    test_fail(scenario, "concurrent style application failed", &failure_reason);
+    goto end;
+  }
+  for(int k = 0; k < BATCH_IMAGES; k++)
+    if(compare_full_history(scenario, headless[k], expected[k], &failure_reason)) goto end;
+
+  // Accepted for the whole batch, with an order captured from an image that had a module none of
+  // these ones has.
+  dt_hm_batch_state_cleanup(&batch);
+  batch.decision = DT_HM_BATCH_ACCEPT;
+  batch.order_ids = g_list_append(NULL, g_strdup("no_such_module|"));
+  batch_report_calls = 0;
+  batch_report_thread = g_thread_self();
+  dt_hm_set_merge_report_handler(batch_report_accept);
+  const int changed = dt_styles_prepared_apply_to_images(prepared, deferred, BATCH_IMAGES, &batch, FALSE);
+  dt_hm_set_merge_report_handler(NULL);
+
+  if(changed != BATCH_IMAGES)
+  {
+    test_fail(scenario, "deferred style application failed", &failure_reason);
+    goto end;
+  }
+  if(batch_report_calls != BATCH_IMAGES || IS_NULL_PTR(batch_report_thread))
+  {
+    test_fail(scenario, "merges the cached order does not fit were not reported from the caller",
+              &failure_reason);
+    goto end;
+  }
+  for(int k = 0; k < BATCH_IMAGES; k++)
+    if(compare_full_history(scenario, deferred[k], expected[k], &failure_reason)) goto end;
+
+  printf("[OK] %s\n", scenario);
+  result = 0;
+
+end:
+#ifdef _OPENMP
+  omp_set_num_threads(dt_get_num_openmp_threads());
+#endif
+  dt_hm_batch_state_cleanup(&batch);
+  dt_styles_prepared_free(prepared);
+  printf("%s: %s", scenario, result ? "FAILED" : "PASSED");
+  if(result) printf(" - %s", failure_reason ? failure_reason : "unknown failure");
+  printf("\n");
+  dt_free(failure_reason);
+  return result;
+}
+
+/**
+ * @brief Write the history of @p dev to @p imgid, which it wrote last, and in full to
+ * @p reference_imgid, which it never wrote, then compare the rows of both images.
+ *
+ * The first write only replaces the rows from the first item that changed since the previous
+ * one: it must leave the database as the full rewrite does.
+ */
+static int check_history_delta(const char *scenario, const char *step, dt_develop_t *dev, const int32_t imgid,
+                               const int32_t reference_imgid, char **failure_reason)
+{
+  dt_dev_write_history_ext(dev, imgid);
+  dt_dev_write_history_ext(dev, reference_imgid);
+  const int diff = history_rows_differ(imgid, reference_imgid);
+
+  // The reference is now what dev wrote last: write the image again, in full, so that the next
+  // step writes a delta against it.
+  dt_dev_write_history_ext(dev, imgid);
+  if(!diff) return 0;
+
+  char *message = g_strdup_printf("history written after %s differs from a full rewrite", step);
+  test_fail(scenario, message, failure_reason);
+  dt_free(message);
+  print_enabled_state_summary("actual", imgid);
+  print_enabled_state_summary("expected", reference_imgid);
+  return 1;
+}
+
+/**
+ * @brief Toggle history item @p num of @p dev, the way edits reach shared items.
+ *
+ * @return FALSE if the item was not cloned: the record of the previous write shares every item,
+ * so an edit made in place would go unseen by the next one.
+ */
+static gboolean edit_history_item(dt_develop_t *dev, const int num)
+{
+  dt_dev_history_item_t *item = (dt_dev_history_item_t *)g_list_nth_data(dev->history, num);
+  dt_dev_history_item_t *edited = dt_dev_history_cow_touch(dev, item);
+  if(IS_NULL_PTR(edited) || edited == item) return FALSE;
+  edited->enabled = !edited->enabled;
+  return TRUE;
+}
+
+/**
+ * @brief Change a history written in full in each way the darkroom does, and check that every
+ * write of only what changed leaves the database as a full rewrite of the same history does.
+ */
+static int run_history_delta_check(const char *source_image_path)
+{
+  const char *scenario = "history_delta";
+  char *failure_reason = NULL;
+  int result = 1;
+  GList *before = NULL;
+
+  printf("\n[STEP] %s\n", scenario);
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, FALSE);
+
+  const int32_t imgid = create_test_image(source_image_path);
+  const int32_t reference_imgid = create_test_image(source_image_path);
+  if(imgid <= 0 || reference_imgid <= 0)
+  {
+    test_fail(scenario, "could not import test image", &failure_reason);
+    goto end;
+  }
+
+  char *xmp_path = g_build_filename(ANSEL_TEST_SOURCE_DIR, "tests", "styles", "end_mixed_instances.xmp", NULL);
+  const int loaded = load_xmp_on_image(scenario, imgid, xmp_path, &failure_reason);
+  dt_free(xmp_path);
+  if(loaded) goto end;
+
+  dt_dev_reload_history_items(&dev, imgid);
+  const int length = g_list_length(dev.history);
+  if(length < 4)
+  {
+    test_fail(scenario, "the fixture history is too short", &failure_reason);
+    goto end;
+  }
+  dt_dev_write_history_ext(&dev, imgid);
+
+  dt_dev_set_history_end_ext(&dev, length - 1);
+  if(check_history_delta(scenario, "moving the history end", &dev, imgid, reference_imgid, &failure_reason))
+    goto end;
+
+  if(!edit_history_item(&dev, length / 2))
+  {
+    test_fail(scenario, "a written history item was edited in place", &failure_reason);
+    goto end;
+  }
+  if(check_history_delta(scenario, "editing an item", &dev, imgid, reference_imgid, &failure_reason))
+    goto end;
+
+  // dt_dev_history_truncate() writes the image itself.
+  dt_dev_set_history_end_ext(&dev, length - 2);
+  dt_dev_history_truncate(&dev, imgid);
+  if(check_history_delta(scenario, "truncating", &dev, imgid, reference_imgid, &failure_reason))
+    goto end;
+
+  // Undo an edit as the darkroom does: the record taken before it is restored, sharing its
+  // items with the history written before the edit.
+  before = dt_dev_history_share(dev.history);
+  const int before_end = dt_dev_get_history_end_ext(&dev);
+  if(!edit_history_item(&dev, 1))
+  {
+    test_fail(scenario, "a written history item was edited in place", &failure_reason);
+    goto end;
+  }
+  if(check_history_delta(scenario, "editing an item", &dev, imgid, reference_imgid, &failure_reason))
+    goto end;
+
+  dt_dev_history_free_history(&dev);
+  dev.history = dt_dev_history_share(before);
+  dt_dev_set_history_end_ext(&dev, before_end);
+  dt_dev_pop_history_items_ext(&dev);
+  if(check_history_delta(scenario, "undoing", &dev, imgid, reference_imgid, &failure_reason)) goto end;
+
+  printf("[OK] %s\n", scenario);
+  result = 0;
+
+end:
+  dt_dev_history_release_snapshot(before);
+  dt_dev_cleanup(&dev);
+  printf("%s: %s", scenario, result ? "FAILED" : "PASSED");
+  if(result) printf(" - %s", failure_reason ? failure_reason : "unknown failure");
+  printf("\n");
+  dt_free(failure_reason);
+  return result;
+}
+
 static int run_style_scenario(const char *scenario_dir, const char *source_image_path, const char *style_file,
                               char **failure_reason)
 {
@@ -539,7 +963,10 @@ int main(int argc, char *argv[])
 
   if(dt_init(argc_override, argv_override, FALSE, FALSE)) exit(1);
 
-  const int result = run_style_scenarios(scenario_dir, source_image_path);
+  int result = run_style_scenarios(scenario_dir, source_image_path);
+  result |= run_prepared_orientation_check(source_image_path);
+  result |= run_prepared_batch_check(source_image_path);
+  result |= run_history_delta_check(source_image_path);
 
   dt_cleanup();
   dt_free(noiseprofiles);
@@ -0,0 +1,258 @@
+/*
+    This file is part of the Ansel project.
+    Copyright (C) 2026 Aurélien PIERRE.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measures the latency of committing one stroke to a drawlayer sidecar TIFF, against the
+ * number of layers it holds.
+ *
+ * Two ways are timed for each layer count, on the same file:
+ *   - rewrite: every page is decoded and re-encoded into a temporary file renamed over the
+ *     sidecar. That is what every commit used to cost, and what structural changes (insert,
+ *     delete, rename) still cost.
+ *   - in place: only the tiles of the touched layer that the stroke changed are journaled,
+ *     synced, and rewritten (src/iop/drawlayer/sidecar.c), which is what a commit costs now.
+ * The in-place time should not depend on the layer count; the rewrite time grows with it.
+ *
+ * Built with -DBUILD_MICROBENCH=ON, as the benchmark_drawlayer_sidecar target of tools/. It
+ * needs only glib and libtiff, and does not link against Ansel.
+ *
+ * Usage: benchmark_drawlayer_sidecar [width height [directory]]
+ * Defaults to 4000 x 3000 layers in the system temporary directory. Run it on the disk your
+ * images live on: both paths end with fsync, so the disk matters as much as the CPU.
+ */
+
+#include "iop/drawlayer/sidecar.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPEATS 5
+
+static const int layer_counts[] = { 1, 2, 4, 8, 12, 16 };
+
+typedef struct benchmark_stroke_t
+{
+  int x;
+  int y;
+  int width;
+  int height;
+  uint16_t value; // half-float written under the stroke, changed at every commit
+} benchmark_stroke_t;
+
+static gboolean _set_tags(TIFF *tiff, const uint32_t width, const uint32_t height, const char *name)
+{
+  const uint16_t extrasamples[] = { EXTRASAMPLE_ASSOCALPHA };
+  return TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, width) && TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, height)
+         && TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 16)
+         && TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP)
+         && TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 4)
+         && TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+         && TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB)
+         && TIFFSetField(tiff, TIFFTAG_EXTRASAMPLES, 1, extrasamples)
+         && TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE)
+         && dt_drawlayer_sidecar_set_tile_layout(tiff) && TIFFSetField(tiff, TIFFTAG_PAGENAME, name);
+}
+
+/* Paint-like content: a few opaque-ish blobs with some grain over a transparent page, so
+ * deflate has about as much work as on a real layer. */
+static void _synthetic_row(uint16_t *row, const uint32_t width, const uint32_t y, const int layer)
+{
+  memset(row, 0, (size_t)width * 4 * sizeof(uint16_t));
+  const uint32_t band = (uint32_t)(layer * 97) % 700;
+  if((y + band) % 900 > 500) return;
+  for(uint32_t x = (uint32_t)(layer * 131) % 400; x < width; x += 1 + (x % 3))
+  {
+    const uint16_t grain = (uint16_t)(0x3400 + ((x * 2654435761u + y * 40503u + (uint32_t)layer) >> 22));
+    row[4 * x + 0] = grain;
+    row[4 * x + 1] = (uint16_t)(grain - 0x100);
+    row[4 * x + 2] = (uint16_t)(grain - 0x200);
+    row[4 * x + 3] = 0x3c00; // 1.0
+  }
+}
+
+static gboolean _write_page(TIFF *tiff, const uint32_t width, const uint32_t height, const int layer,
+                            TIFF *src, const benchmark_stroke_t *stroke)
+{
+  char name[64];
+  g_snprintf(name, sizeof(name), "layer %d", layer);
+  if(!_set_tags(tiff, width, height, name)) return FALSE;
+
+  dt_drawlayer_sidecar_reader_t reader = { 0 };
+  dt_drawlayer_sidecar_writer_t writer = { 0 };
+  uint16_t *row = g_malloc_n((gsize)width * 4, sizeof(uint16_t));
+  gboolean ok = dt_drawlayer_sidecar_writer_init(&writer, tiff, width, height)
+                && (!src || dt_drawlayer_sidecar_reader_init(&reader, src));
+  for(uint32_t y = 0; y < height && ok; y++)
+  {
+    if(src)
+      ok = dt_drawlayer_sidecar_read_row(&reader, y, row);
+    else
+      _synthetic_row(row, width, y, layer);
+
+    if(stroke && (int)y >= stroke->y && (int)y < stroke->y + stroke->height)
+      for(int x = stroke->x; x < stroke->x + stroke->width; x++)
+        for(int c = 0; c < 4; c++) row[4 * x + c] = stroke->value;
+
+    ok = ok && dt_drawlayer_sidecar_write_row(&writer, row);
+  }
+  ok = ok && dt_drawlayer_sidecar_writer_finish(&writer);
+  dt_drawlayer_sidecar_reader_cleanup(&reader);
+  dt_drawlayer_sidecar_writer_cleanup(&writer);
+  g_free(row);
+  return ok && TIFFWriteDirectory(tiff);
+}
+
+static gboolean _create_sidecar(const char *path, const uint32_t width, const uint32_t height, const int layers)
+{
+  TIFF *tiff = TIFFOpen(path, "wb");
+  if(!tiff) return FALSE;
+  gboolean ok = TRUE;
+  for(int layer = 0; layer < layers && ok; layer++) ok = _write_page(tiff, width, height, layer, NULL, NULL);
+  TIFFClose(tiff);
+  return ok;
+}
+
+/** The former commit: copy every page through a temporary file, patching the target one. */
+static gboolean _commit_rewrite(const char *path, const uint32_t width, const uint32_t height, const int layers,
+                                const int target, const benchmark_stroke_t *stroke)
+{
+  gchar *tmp_path = g_strdup_printf("%s.tmp", path);
+  TIFF *src = TIFFOpen(path, "rb");
+  TIFF *dst = TIFFOpen(tmp_path, "wb");
+  gboolean ok = src && dst;
+  for(int layer = 0; layer < layers && ok; layer++)
+    ok = TIFFSetDirectory(src, (tdir_t)layer)
+         && _write_page(dst, width, height, layer, src, layer == target ? stroke : NULL);
+  if(dst)
+  {
+    ok = ok && TIFFFlush(dst) && g_fsync(TIFFFileno(dst)) == 0;
+    TIFFClose(dst);
+  }
+  if(src) TIFFClose(src);
+  ok = ok && g_rename(tmp_path, path) == 0;
+  g_free(tmp_path);
+  return ok;
+}
+
+static void _fill_stroke(void *user_data, const uint32_t x, const uint32_t y, const uint32_t width,
+                         const uint32_t height, uint16_t *pixels)
+{
+  const benchmark_stroke_t *stroke = (const benchmark_stroke_t *)user_data;
+  const int x0 = MAX(stroke->x, (int)x);
+  const int x1 = MIN(stroke->x + stroke->width, (int)(x + width));
+  const int y0 = MAX(stroke->y, (int)y);
+  const int y1 = MIN(stroke->y + stroke->height, (int)(y + height));
+  for(int row = y0; row < y1; row++)
+    for(int col = x0; col < x1; col++)
+      for(int c = 0; c < 4; c++)
+        pixels[4 * ((size_t)(row - y) * DT_DRAWLAYER_SIDECAR_TILE + (col - x)) + c] = stroke->value;
+}
+
+static int _compare_doubles(const void *a, const void *b)
+{
+  const double da = *(const double *)a;
+  const double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static double _median(double *values, const int count)
+{
+  qsort(values, count, sizeof(double), _compare_doubles);
+  return values[count / 2];
+}
+
+int main(int argc, char *argv[])
+{
+  const uint32_t width = argc > 2 ? (uint32_t)atoi(argv[1]) : 4000;
+  const uint32_t height = argc > 2 ? (uint32_t)atoi(argv[2]) : 3000;
+  if(width < 512 || height < 512)
+  {
+    fprintf(stderr, "layers must be at least 512 x 512\n");
+    return 1;
+  }
+
+  gchar *dir = argc > 3 ? g_strdup(argv[3]) : g_dir_make_tmp("ansel-sidecar-XXXXXX", NULL);
+  if(!dir)
+  {
+    fprintf(stderr, "could not create a temporary directory\n");
+    return 1;
+  }
+  gchar *path = g_build_filename(dir, "benchmark.ansel.tiff", NULL);
+
+  // About what one brush stroke commits: a 300 x 200 bounding box, across tile boundaries.
+  benchmark_stroke_t stroke = { .x = (int)width / 2 - 150, .y = (int)height / 2 - 100, .width = 300, .height = 200 };
+
+  printf("%u x %u layers, %d commits per point, median times\n\n", width, height, REPEATS);
+  printf("%8s %14s %14s %8s\n", "layers", "rewrite (ms)", "in place (ms)", "tiles");
+
+  int status = 0;
+  for(size_t k = 0; k < G_N_ELEMENTS(layer_counts) && !status; k++)
+  {
+    const int layers = layer_counts[k];
+    const int target = layers / 2;
+    double rewrite[REPEATS];
+    double in_place[REPEATS];
+    int tiles = 0;
+
+    if(!_create_sidecar(path, width, height, layers))
+    {
+      fprintf(stderr, "could not create %s\n", path);
+      status = 1;
+      break;
+    }
+
+    for(int r = 0; r < REPEATS && !status; r++)
+    {
+      stroke.value = (uint16_t)(0x3800 + 2 * r);
+      const gint64 t0 = g_get_monotonic_time();
+      if(!_commit_rewrite(path, width, height, layers, target, &stroke)) status = 1;
+      const gint64 t1 = g_get_monotonic_time();
+
+      stroke.value++;
+      char name[64];
+      g_snprintf(name, sizeof(name), "layer %d", target);
+      if(dt_drawlayer_sidecar_update_tiles(path, target, name, stroke.x, stroke.y, stroke.width, stroke.height,
+                                           _fill_stroke, &stroke, &tiles)
+         != DT_DRAWLAYER_SIDECAR_UPDATE_DONE)
+        status = 1;
+      const gint64 t2 = g_get_monotonic_time();
+
+      rewrite[r] = (t1 - t0) / 1000.0;
+      in_place[r] = (t2 - t1) / 1000.0;
+    }
+
+    if(status)
+      fprintf(stderr, "commit failed with %d layers\n", layers);
+    else
+      printf("%8d %14.1f %14.1f %8d\n", layers, _median(rewrite, REPEATS), _median(in_place, REPEATS), tiles);
+  }
+
+  g_unlink(path);
+  if(argc <= 3) g_rmdir(dir);
+  g_free(path);
+  g_free(dir);
+  return status;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on